@@ -0,0 +1,27 @@
+# - Find zck
+# Find the native zchunk includes and library
+#
+#  ZCK_INCLUDE_DIR    - where to find zck.h, etc.
+#  ZCK_LIBRARIES      - List of libraries when using libzck.
+#  ZCK_FOUND          - True if libzck found.
+
+IF (ZCK_INCLUDE_DIR)
+  # Already in cache, be silent
+  SET(ZCK_FIND_QUIETLY TRUE)
+ENDIF (ZCK_INCLUDE_DIR)
+
+FIND_PATH(ZCK_INCLUDE_DIR zck.h)
+FIND_LIBRARY(ZCK_LIBRARY NAMES zck)
+
+# handle the QUIETLY and REQUIRED arguments and set ZCK_FOUND to TRUE if
+# all listed variables are TRUE
+INCLUDE(FindPackageHandleStandardArgs)
+FIND_PACKAGE_HANDLE_STANDARD_ARGS(ZCK DEFAULT_MSG ZCK_LIBRARY ZCK_INCLUDE_DIR)
+
+IF(ZCK_FOUND)
+  SET( ZCK_LIBRARIES ${ZCK_LIBRARY} )
+ELSE(ZCK_FOUND)
+  SET( ZCK_LIBRARIES )
+ENDIF(ZCK_FOUND)
+
+MARK_AS_ADVANCED( ZCK_LIBRARY ZCK_INCLUDE_DIR )
@@ -2,7 +2,7 @@
 
 _cr_compress_type()
 {
-    COMPREPLY=( $( compgen -W "bz2 gz xz" -- "$2" ) )
+    COMPREPLY=( $( compgen -W "bz2 gz xz zstd" -- "$2" ) )
 }
 
 _cr_checksum_type()
@@ -18,7 +18,7 @@ _cr_createrepo()
         -V|--version|-h|--help)
             return 0
             ;;
-        --update-md-path|-o|--outputdir|--oldpackagedirs)
+        --update-md-path|-o|--outputdir|--oldpackagedirs|--zck-dict-dir|--assemble)
             COMPREPLY=( $( compgen -d -- "$2" ) )
             return 0
             ;;
@@ -30,7 +30,7 @@ _cr_createrepo()
             _cr_checksum_type "$1" "$2"
             return 0
             ;;
-        -i|--pkglist|--read-pkgs-list)
+        -i|--pkglist|--read-pkgs-list|--batch|--checksum-manifest)
             COMPREPLY=( $( compgen -f -o plusdirs -- "$2" ) )
             return 0
             ;;
@@ -52,7 +52,7 @@ _cr_createrepo()
             COMPREPLY=( $( compgen -W "{1..$max}" -- "$2" ) )
             return 0
             ;;
-        --compress-type)
+        --compress-type|--compress-variant)
             _cr_compress_type "$1" "$2"
             return 0
             ;;
@@ -65,12 +65,19 @@ _cr_createrepo()
             --skip-stat --pkglist --includepkg --outputdir
             --skip-symlinks --changelog-limit --unique-md-filenames
             --simple-md-filenames --retain-old-md --distro --content --repo
-            --revision --read-pkgs-list --workers --xz
-            --compress-type --keep-all-metadata --compatibility
+            --revision --read-pkgs-list --workers --prefetch
+            --prefetch-threads --xz
+            --compress-type --general-compress-type
+            --zstd-level --zstd-long --zstd-workers --compress-variant
+            --zck --zck-dict-dir --zck-dict-train --segmented --segment-size
+            --shard --assemble
+            --keep-all-metadata --compatibility
             --retain-old-md-by-age --cachedir --local-sqlite
-            --cut-dirs --location-prefix
+            --checksum-manifest --checksum-manifest-verify
+            --cut-dirs --location-prefix --profile --stats-json
+            --batch --batch-jobs
             --deltas --oldpackagedirs
-            --num-deltas --max-delta-rpm-size' -- "$2" ) )
+            --num-deltas --max-delta-rpm-size --no-delta-cache' -- "$2" ) )
     else
         COMPREPLY=( $( compgen -d -- "$2" ) )
     fi
@@ -93,10 +100,13 @@ _cr_mergerepo()
             COMPREPLY=( $( compgen -d -- "$2" ) )
             return 0
             ;;
-        --compress-type)
+        --compress-type|--general-compress-type)
             _cr_compress_type "" "$2"
             return 0
             ;;
+        --workers)
+            return 0
+            ;;
         --method)
             COMPREPLY=( $( compgen -W "repo ts nvr" -- "$2" ) )
             return 0
@@ -106,7 +116,9 @@ _cr_mergerepo()
     if [[ $2 == -* ]] ; then
         COMPREPLY=( $( compgen -W '--version --help --repo --archlist --database
             --no-database --verbose --outputdir --nogroups --noupdateinfo
-            --compress-type --method --all --noarch-repo --unique-md-filenames
+            --updateinfo-index --compress-type --general-compress-type --workers
+            --method --all
+            --noarch-repo --unique-md-filenames
             --simple-md-filenames --omit-baseurl --koji --groupfile
             --blocked' -- "$2" ) )
     else
@@ -176,6 +188,34 @@ _cr_sqliterepo()
 } &&
 complete -F _cr_sqliterepo -o filenames sqliterepo_c
 
+_cr_watchrepo()
+{
+    COMPREPLY=()
+
+    case $3 in
+        -h|--help|-V|--version|--delay|--max-delay|--workers|--changelog-limit)
+            return 0
+            ;;
+        -s|--checksum)
+            _cr_checksum_type "$1" "$2"
+            return 0
+            ;;
+        --socket)
+            COMPREPLY=( $( compgen -f -- "$2" ) )
+            return 0
+            ;;
+    esac
+
+    if [[ $2 == -* ]] ; then
+        COMPREPLY=( $( compgen -W '--help --version --quiet --verbose
+            --delay --max-delay --socket --workers --checksum
+            --changelog-limit --no-database --skip-symlinks ' -- "$2" ) )
+    else
+        COMPREPLY=( $( compgen -d -- "$2" ) )
+    fi
+} &&
+complete -F _cr_watchrepo -o filenames watchrepo_c
+
 # Local variables:
 # mode: shell-script
 # sh-basic-offset: 4
@@ -23,19 +23,106 @@
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 #include <openssl/evp.h>
 #include "error.h"
 #include "checksum.h"
 
 #define ERR_DOMAIN              CREATEREPO_C_ERROR
 #define MAX_CHECKSUM_NAME_LEN   7
-#define BUFFER_SIZE             2048
+#define BUFFER_SIZE             (1024*1024)
 
 struct _cr_ChecksumCtx {
     EVP_MD_CTX      *ctx;
     cr_ChecksumType type;
 };
 
+/** Per-thread resources used by cr_checksum_file().
+ * Digest context and read buffer are allocated once per thread and
+ * reused for every file the thread hashes.
+ */
+typedef struct {
+    EVP_MD_CTX      *ctx;
+    unsigned char   *buf;
+} cr_ChecksumThreadData;
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static void
+cr_checksumthreaddata_free(gpointer data)
+{
+    cr_ChecksumThreadData *tdata = data;
+
+    if (!tdata)
+        return;
+
+    if (tdata->ctx)
+        EVP_MD_CTX_destroy(tdata->ctx);
+    g_free(tdata->buf);
+    g_free(tdata);
+}
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+static GPrivate checksum_thread_data =
+                        G_PRIVATE_INIT(cr_checksumthreaddata_free);
+#endif
+
+/** Return thread data for the calling thread.
+ * @param owned     Set to TRUE if the caller is responsible for freeing
+ *                  the returned data (thread local storage is not
+ *                  available).
+ * @return          cr_ChecksumThreadData or NULL on error
+ */
+static cr_ChecksumThreadData *
+cr_checksumthreaddata_get(gboolean *owned)
+{
+    cr_ChecksumThreadData *tdata = NULL;
+
+    *owned = TRUE;
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+    tdata = g_private_get(&checksum_thread_data);
+    if (tdata) {
+        *owned = FALSE;
+        return tdata;
+    }
+#endif
+
+    tdata = g_malloc0(sizeof(cr_ChecksumThreadData));
+    tdata->ctx = EVP_MD_CTX_create();
+    if (!tdata->ctx) {
+        g_free(tdata);
+        return NULL;
+    }
+    tdata->buf = g_malloc(BUFFER_SIZE);
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+    g_private_set(&checksum_thread_data, tdata);
+    *owned = FALSE;
+#endif
+
+    return tdata;
+}
+
+/** Convert raw digest into a malloced lowercase hex string.
+ */
+static char *
+cr_checksum_hexlify(const unsigned char *raw, unsigned int len)
+{
+    char *checksum = g_malloc(sizeof(char) * (len * 2 + 1));
+
+    for (unsigned int x = 0; x < len; x++) {
+        checksum[x*2]   = hex_digits[raw[x] >> 4];
+        checksum[x*2+1] = hex_digits[raw[x] & 0x0f];
+    }
+    checksum[len*2] = '\0';
+
+    return checksum;
+}
+
 cr_ChecksumType
 cr_checksum_type(const char *name)
 {
@@ -111,14 +198,13 @@ cr_checksum_file(const char *filename,
                  cr_ChecksumType type,
                  GError **err)
 {
-    FILE *f;
-    int rc;
+    int fd;
+    gboolean owned;
     unsigned int len;
     ssize_t readed;
-    char buf[BUFFER_SIZE];
     unsigned char raw_checksum[EVP_MAX_MD_SIZE];
-    char *checksum;
-    EVP_MD_CTX *ctx;
+    char *checksum = NULL;
+    cr_ChecksumThreadData *tdata;
     const EVP_MD *ctx_type;
 
     switch (type) {
@@ -137,43 +223,65 @@ cr_checksum_file(const char *filename,
             return NULL;
     }
 
-    f = fopen(filename, "rb");
-    if (!f) {
+    fd = open(filename, O_RDONLY);
+    if (fd == -1) {
         g_set_error(err, ERR_DOMAIN, CRE_IO,
                     "Cannot open a file: %s", g_strerror(errno));
         return NULL;
     }
 
-    ctx = EVP_MD_CTX_create();
-    rc = EVP_DigestInit_ex(ctx, ctx_type, NULL);
-    if (!rc) {
+#ifdef POSIX_FADV_SEQUENTIAL
+    // Let the kernel know that we are going to read the whole file
+    // at once, so it could do aggressive readahead
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    tdata = cr_checksumthreaddata_get(&owned);
+    if (!tdata) {
         g_set_error(err, ERR_DOMAIN, CRE_OPENSSL,
-                    "EVP_DigestInit_ex() failed");
-        EVP_MD_CTX_destroy(ctx);
-        fclose(f);
+                    "EVP_MD_CTX_create() failed");
+        close(fd);
         return NULL;
     }
 
-    while ((readed = fread(buf, 1, BUFFER_SIZE, f)) == BUFFER_SIZE)
-        EVP_DigestUpdate(ctx, buf, readed);
+    if (!EVP_DigestInit_ex(tdata->ctx, ctx_type, NULL)) {
+        g_set_error(err, ERR_DOMAIN, CRE_OPENSSL,
+                    "EVP_DigestInit_ex() failed");
+        goto cleanup;
+    }
 
-    if (feof(f)) {
-        EVP_DigestUpdate(ctx, buf, readed);
-    } else {
-        g_set_error(err, ERR_DOMAIN, CRE_IO,
-                    "Error while reading a file: %s", g_strerror(errno));
-        EVP_MD_CTX_destroy(ctx);
-        fclose(f);
-        return NULL;
+    while (1) {
+        readed = read(fd, tdata->buf, BUFFER_SIZE);
+        if (readed == 0)
+            break;  // EOF
+        if (readed == -1) {
+            if (errno == EINTR)
+                continue;
+            g_set_error(err, ERR_DOMAIN, CRE_IO,
+                        "Error while reading a file: %s", g_strerror(errno));
+            goto cleanup;
+        }
+        EVP_DigestUpdate(tdata->ctx, tdata->buf, readed);
+    }
+
+    if (!EVP_DigestFinal_ex(tdata->ctx, raw_checksum, &len)) {
+        g_set_error(err, ERR_DOMAIN, CRE_OPENSSL,
+                    "EVP_DigestFinal_ex() failed");
+        goto cleanup;
     }
 
-    fclose(f);
+    checksum = cr_checksum_hexlify(raw_checksum, len);
+
+cleanup:
+#ifdef POSIX_FADV_DONTNEED
+    // The content is not needed anymore, don't let it evict
+    // more useful data from the page cache
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+    close(fd);
 
-    EVP_DigestFinal_ex(ctx, raw_checksum, &len);
-    EVP_MD_CTX_destroy(ctx);
-    checksum = g_malloc0(sizeof(char) * (len * 2 + 1));
-    for (size_t x = 0; x < len; x++)
-        sprintf(checksum+(x*2), "%02x", raw_checksum[x]);
+    if (owned)
+        cr_checksumthreaddata_free(tdata);
 
     return checksum;
 }
@@ -265,9 +373,7 @@ cr_checksum_final(cr_ChecksumCtx *ctx, GError **err)
 
     EVP_MD_CTX_destroy(ctx->ctx);
 
-    checksum = g_malloc0(sizeof(char) * (len * 2 + 1));
-    for (size_t x = 0; x < len; x++)
-        sprintf(checksum+(x*2), "%02x", raw_checksum[x]);
+    checksum = cr_checksum_hexlify(raw_checksum, len);
 
     g_free(ctx);
 
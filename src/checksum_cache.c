@@ -0,0 +1,633 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "checksum_cache.h"
+#include "error.h"
+
+#define ERR_DOMAIN              CREATEREPO_C_ERROR
+#define CACHE_HEADER            "# createrepo_c checksum cache\n"
+#define CACHE_WRITE_BATCH       256     // Records buffered before a write
+#define CACHE_COMPACT_MIN_STALE 64      // Don't bother with compaction of
+                                        // files with less stale records
+
+struct _cr_ChecksumCache {
+    gchar       *path;          // Path to the cache file
+    int         fd;             // Opened cache file (O_APPEND)
+    char        *map;           // Private mapping of the file content
+    size_t      map_len;        // Length of the mapping
+    off_t       indexed;        // Content of the opened file up to this
+                                // offset is in the index (0 if the file
+                                // was replaced by another process)
+    off_t       seen;           // Content of the opened file up to this
+                                // offset was read (by open or by lookups)
+    GHashTable  *index;         // Records from the file (points to map)
+                                // Read only after open -> lock-free lookups
+    GHashTable  *new_records;   // Records inserted during this run or
+                                // appended by other processes after open
+    GString     *wbuf;          // Records waiting for write
+    guint       pending;        // Number of records in wbuf
+    GMutex      *mutex;         // Guards new_records, wbuf and seen
+    gboolean    shared;         // Other processes fill the file right now,
+                                // misses read their appended records
+
+    guint64     records;        // Valid records loaded from the file
+    guint64     stale;          // Duplicate or malformed records
+    volatile gint hits;
+    volatile gint misses;
+    volatile gint inserts;
+};
+
+static gboolean
+is_valid_checksum(const char *checksum)
+{
+    if (!*checksum)
+        return FALSE;
+    for (; *checksum; checksum++)
+        if (!g_ascii_isxdigit(*checksum))
+            return FALSE;
+    return TRUE;
+}
+
+/** Write the whole buffer into the fd.
+ */
+static int
+write_all(int fd, const char *buf, size_t len, GError **err)
+{
+    while (len > 0) {
+        ssize_t ret = write(fd, buf, len);
+        if (ret == -1) {
+            if (errno == EINTR)
+                continue;
+            g_set_error(err, ERR_DOMAIN, CRE_IO,
+                        "write() failed: %s", g_strerror(errno));
+            return CRE_IO;
+        }
+        buf += ret;
+        len -= ret;
+    }
+    return CRE_OK;
+}
+
+/** Parse records of the buffer into the table (later records win).
+ * Terminators are written directly into the buffer, so keys and values
+ * in the table point to the buffer.
+ * @param records       Incremented for every new key (or NULL)
+ * @param stale         Incremented for every duplicate or malformed
+ *                      record (or NULL)
+ */
+static void
+parse_records(char *buf,
+              size_t len,
+              GHashTable *table,
+              guint64 *records,
+              guint64 *stale)
+{
+    char *cur = buf;
+    char *end = buf + len;
+    guint64 new_keys = 0, bad = 0;
+
+    while (cur < end) {
+        char *eol = memchr(cur, '\n', end - cur);
+        if (!eol) {
+            // Incomplete record at the end of the file
+            bad++;
+            break;
+        }
+
+        *eol = '\0';
+
+        if (*cur != '#' && *cur != '\0') {
+            char *tab = strchr(cur, '\t');
+            if (tab && tab != cur && is_valid_checksum(tab+1)) {
+                *tab = '\0';
+                if (g_hash_table_lookup(table, cur))
+                    bad++;
+                else
+                    new_keys++;
+                g_hash_table_replace(table, cur, tab+1);
+            } else {
+                bad++;
+            }
+        }
+
+        cur = eol + 1;
+    }
+
+    if (records)
+        *records += new_keys;
+    if (stale)
+        *stale += bad;
+}
+
+/** Lock the cache file. If the file was replaced by a compaction of
+ * another process meanwhile, the new file is opened (and locked)
+ * instead, so nothing is written into an unlinked file.
+ * @param operation     LOCK_EX or LOCK_SH
+ * @return              cr_Error code
+ */
+static int
+lock_current(cr_ChecksumCache *cache, int operation, GError **err)
+{
+    struct stat fd_st, path_st;
+
+    while (1) {
+        int fd;
+
+        flock(cache->fd, operation);
+
+        if (fstat(cache->fd, &fd_st) == -1) {
+            g_set_error(err, ERR_DOMAIN, CRE_STAT, "Cannot stat %s: %s",
+                        cache->path, g_strerror(errno));
+            flock(cache->fd, LOCK_UN);
+            return CRE_STAT;
+        }
+
+        if (stat(cache->path, &path_st) == 0
+            && path_st.st_dev == fd_st.st_dev
+            && path_st.st_ino == fd_st.st_ino)
+            return CRE_OK;
+
+        // Replaced (or removed) file
+        fd = open(cache->path, O_RDWR | O_CREAT | O_APPEND, 0664);
+        if (fd == -1) {
+            g_set_error(err, ERR_DOMAIN, CRE_IO, "Cannot open %s: %s",
+                        cache->path, g_strerror(errno));
+            flock(cache->fd, LOCK_UN);
+            return CRE_IO;
+        }
+        flock(cache->fd, LOCK_UN);
+        close(cache->fd);
+        cache->fd = fd;
+        cache->indexed = 0;
+        cache->seen = 0;
+        g_debug("%s: %s was replaced, reopened", __func__, cache->path);
+    }
+}
+
+/** Read the content of the opened file from the offset.
+ * @return              Malloced buffer or NULL on error
+ */
+static char *
+read_tail(cr_ChecksumCache *cache, off_t offset, size_t *len, GError **err)
+{
+    struct stat st;
+    char *buf;
+    size_t done = 0;
+
+    if (fstat(cache->fd, &st) == -1) {
+        g_set_error(err, ERR_DOMAIN, CRE_STAT, "Cannot stat %s: %s",
+                    cache->path, g_strerror(errno));
+        return NULL;
+    }
+
+    *len = (st.st_size > offset) ? (size_t) (st.st_size - offset) : 0;
+    buf = g_malloc(*len + 1);
+
+    while (done < *len) {
+        ssize_t ret = pread(cache->fd, buf + done, *len - done,
+                            offset + done);
+        if (ret == -1 && errno == EINTR)
+            continue;
+        if (ret <= 0) {
+            g_set_error(err, ERR_DOMAIN, CRE_IO, "Cannot read %s: %s",
+                        cache->path,
+                        ret ? g_strerror(errno) : "Unexpected end of file");
+            g_free(buf);
+            return NULL;
+        }
+        done += ret;
+    }
+
+    return buf;
+}
+
+cr_ChecksumCache *
+cr_checksumcache_open(const char *path, GError **err)
+{
+    int fd;
+    struct stat st;
+    cr_ChecksumCache *cache;
+
+    assert(path);
+    assert(!err || *err == NULL);
+
+    fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0664);
+    if (fd == -1) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "Cannot open %s: %s", path, g_strerror(errno));
+        return NULL;
+    }
+
+    cache = g_malloc0(sizeof(cr_ChecksumCache));
+    cache->path         = g_strdup(path);
+    cache->fd           = fd;
+    cache->index        = g_hash_table_new(g_str_hash, g_str_equal);
+    cache->new_records  = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                g_free, g_free);
+    cache->wbuf         = g_string_sized_new(CACHE_WRITE_BATCH * 128);
+    cache->mutex        = g_mutex_new();
+
+    // The file could be just replaced by a compaction
+    if (lock_current(cache, LOCK_EX, err) != CRE_OK) {
+        cr_checksumcache_close(cache, NULL);
+        return NULL;
+    }
+    fd = cache->fd;
+
+    if (fstat(fd, &st) == -1) {
+        g_set_error(err, ERR_DOMAIN, CRE_STAT,
+                    "Cannot stat %s: %s", path, g_strerror(errno));
+        flock(fd, LOCK_UN);
+        cr_checksumcache_close(cache, NULL);
+        return NULL;
+    }
+
+    if (st.st_size == 0) {
+        write_all(fd, CACHE_HEADER, strlen(CACHE_HEADER), NULL);
+    } else {
+        cache->map_len = st.st_size;
+        cache->map = mmap(NULL, cache->map_len, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE, fd, 0);
+        if (cache->map == MAP_FAILED) {
+            g_set_error(err, ERR_DOMAIN, CRE_IO,
+                        "Cannot mmap %s: %s", path, g_strerror(errno));
+            cache->map = NULL;
+            cache->map_len = 0;
+            flock(fd, LOCK_UN);
+            cr_checksumcache_close(cache, NULL);
+            return NULL;
+        }
+
+        madvise(cache->map, cache->map_len, MADV_SEQUENTIAL);
+
+        // Make sure that new records will start on a new line
+        if (cache->map[cache->map_len-1] != '\n')
+            write_all(fd, "\n", 1, NULL);
+
+        parse_records(cache->map, cache->map_len, cache->index,
+                      &cache->records, &cache->stale);
+    }
+    cache->indexed = cache->map_len;
+    cache->seen = cache->map_len;
+
+    flock(fd, LOCK_UN);
+
+    g_debug("%s: %s: %"G_GUINT64_FORMAT" records (%"G_GUINT64_FORMAT
+            " stale) loaded", __func__, path, cache->records, cache->stale);
+
+    return cache;
+}
+
+/** Add records appended to the file since it was read last time
+ * (by other processes) into new_records. Mutex must be held by the caller.
+ */
+static void
+read_appended(cr_ChecksumCache *cache)
+{
+    GError *tmp_err = NULL;
+    GHashTable *appended;
+    GHashTableIter iter;
+    gpointer key, value;
+    struct stat st;
+    char *buf;
+    size_t len;
+
+    // Nothing was appended and the file wasn't replaced by a compaction
+    // (the replaced file has no links) -> no lock and no path lookup
+    if (fstat(cache->fd, &st) == 0
+        && st.st_size <= cache->seen
+        && st.st_nlink > 0)
+        return;
+
+    if (lock_current(cache, LOCK_SH, &tmp_err) != CRE_OK) {
+        g_debug("%s: %s", __func__, tmp_err->message);
+        g_error_free(tmp_err);
+        return;
+    }
+    buf = read_tail(cache, cache->seen, &len, &tmp_err);
+    flock(cache->fd, LOCK_UN);
+    if (!buf) {
+        g_debug("%s: %s", __func__, tmp_err->message);
+        g_error_free(tmp_err);
+        return;
+    }
+
+    // Only complete records (a writer could die in the middle of one)
+    while (len > 0 && buf[len-1] != '\n')
+        len--;
+
+    appended = g_hash_table_new(g_str_hash, g_str_equal);
+    parse_records(buf, len, appended, NULL, NULL);
+    g_hash_table_iter_init(&iter, appended);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        if (g_hash_table_lookup(cache->index, key)
+            || g_hash_table_lookup(cache->new_records, key))
+            continue;
+        g_hash_table_insert(cache->new_records,
+                            g_strdup(key),
+                            g_strdup(value));
+    }
+    g_hash_table_destroy(appended);
+
+    cache->seen += len;
+    g_free(buf);
+}
+
+const char *
+cr_checksumcache_lookup(cr_ChecksumCache *cache, const char *key)
+{
+    const char *checksum;
+
+    assert(cache);
+    assert(key);
+
+    checksum = g_hash_table_lookup(cache->index, key);
+    if (!checksum) {
+        g_mutex_lock(cache->mutex);
+        checksum = g_hash_table_lookup(cache->new_records, key);
+        if (!checksum && cache->shared) {
+            // The record could be just written by another process
+            read_appended(cache);
+            checksum = g_hash_table_lookup(cache->new_records, key);
+        }
+        g_mutex_unlock(cache->mutex);
+    }
+
+    if (checksum)
+        g_atomic_int_inc(&cache->hits);
+    else
+        g_atomic_int_inc(&cache->misses);
+
+    return checksum;
+}
+
+/** Write out buffered records. Mutex must be held by the caller.
+ */
+static int
+flush_unlocked(cr_ChecksumCache *cache, GError **err)
+{
+    int ret;
+
+    if (cache->wbuf->len == 0)
+        return CRE_OK;
+
+    ret = lock_current(cache, LOCK_EX, err);
+    if (ret != CRE_OK)
+        return ret;
+    ret = write_all(cache->fd, cache->wbuf->str, cache->wbuf->len, err);
+    flock(cache->fd, LOCK_UN);
+
+    g_string_truncate(cache->wbuf, 0);
+    cache->pending = 0;
+
+    return ret;
+}
+
+int
+cr_checksumcache_insert(cr_ChecksumCache *cache,
+                        const char *key,
+                        const char *checksum,
+                        GError **err)
+{
+    int ret = CRE_OK;
+
+    assert(cache);
+    assert(key);
+    assert(checksum);
+    assert(!err || *err == NULL);
+
+    if (!*key || strpbrk(key, "\t\n") || !is_valid_checksum(checksum)) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "Invalid checksum cache record \"%s\"", key);
+        return CRE_BADARG;
+    }
+
+    g_mutex_lock(cache->mutex);
+
+    if (!g_hash_table_lookup(cache->new_records, key)) {
+        g_hash_table_insert(cache->new_records,
+                            g_strdup(key),
+                            g_strdup(checksum));
+        g_string_append_printf(cache->wbuf, "%s\t%s\n", key, checksum);
+        cache->pending++;
+        g_atomic_int_inc(&cache->inserts);
+
+        if (cache->pending >= CACHE_WRITE_BATCH)
+            ret = flush_unlocked(cache, err);
+    }
+
+    g_mutex_unlock(cache->mutex);
+
+    return ret;
+}
+
+void
+cr_checksumcache_set_shared(cr_ChecksumCache *cache, gboolean shared)
+{
+    assert(cache);
+
+    cache->shared = shared;
+}
+
+int
+cr_checksumcache_flush(cr_ChecksumCache *cache, GError **err)
+{
+    int ret;
+
+    assert(cache);
+    assert(!err || *err == NULL);
+
+    g_mutex_lock(cache->mutex);
+    ret = flush_unlocked(cache, err);
+    g_mutex_unlock(cache->mutex);
+
+    return ret;
+}
+
+/** Append a record to a GString.
+ */
+static void
+compact_record(gpointer key, gpointer value, gpointer user_data)
+{
+    GString *out = user_data;
+    g_string_append_printf(out, "%s\t%s\n", (char *) key, (char *) value);
+}
+
+int
+cr_checksumcache_compact(cr_ChecksumCache *cache, GError **err)
+{
+    int fd, ret;
+    gchar *tmp_path = NULL;
+    GString *out = NULL;
+    GHashTable *all = NULL;
+    char *tail = NULL;
+    size_t tail_len;
+
+    assert(cache);
+    assert(!err || *err == NULL);
+
+    ret = cr_checksumcache_flush(cache, err);
+    if (ret != CRE_OK)
+        return ret;
+
+    // The lock is held until the compacted file replaces the old one,
+    // so no record appended by another process can get lost. Writers
+    // which wait for the lock switch to the new file (see lock_current()).
+    ret = lock_current(cache, LOCK_EX, err);
+    if (ret != CRE_OK)
+        return ret;
+
+    // Records appended to the file since it was indexed (by this and
+    // other processes) override the indexed ones
+    tail = read_tail(cache, cache->indexed, &tail_len, err);
+    if (!tail) {
+        ret = CRE_IO;
+        goto cleanup;
+    }
+
+    all = g_hash_table_new(g_str_hash, g_str_equal);
+    if (cache->indexed) {
+        GHashTableIter iter;
+        gpointer key, value;
+        g_hash_table_iter_init(&iter, cache->index);
+        while (g_hash_table_iter_next(&iter, &key, &value))
+            g_hash_table_replace(all, key, value);
+    }
+    parse_records(tail, tail_len, all, NULL, NULL);
+
+    out = g_string_sized_new(cache->map_len + tail_len + 1024);
+    g_string_append(out, CACHE_HEADER);
+    g_hash_table_foreach(all, compact_record, out);
+
+    tmp_path = g_strconcat(cache->path, ".XXXXXX", NULL);
+    fd = g_mkstemp(tmp_path);
+    if (fd == -1) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "Cannot create %s: %s", tmp_path, g_strerror(errno));
+        ret = CRE_IO;
+        goto cleanup;
+    }
+
+    ret = write_all(fd, out->str, out->len, err);
+    fchmod(fd, 0664);
+    close(fd);
+
+    if (ret != CRE_OK) {
+        g_remove(tmp_path);
+        goto cleanup;
+    }
+
+    if (g_rename(tmp_path, cache->path) == -1) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO, "Cannot rename %s -> %s: %s",
+                    tmp_path, cache->path, g_strerror(errno));
+        g_remove(tmp_path);
+        ret = CRE_IO;
+        goto cleanup;
+    }
+
+    // Switch to the new file. The old mapping stays valid.
+    fd = open(cache->path, O_RDWR | O_APPEND);
+    if (fd == -1) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO, "Cannot open %s: %s",
+                    cache->path, g_strerror(errno));
+        ret = CRE_IO;
+        goto cleanup;
+    }
+    flock(cache->fd, LOCK_UN);
+    close(cache->fd);
+    cache->fd = fd;
+    cache->indexed = 0;     // Records of the tail are not in the index
+    cache->seen = 0;
+    cache->stale = 0;
+
+    g_debug("%s: %s compacted", __func__, cache->path);
+
+cleanup:
+    if (ret != CRE_OK)
+        flock(cache->fd, LOCK_UN);
+    if (all)
+        g_hash_table_destroy(all);
+    if (out)
+        g_string_free(out, TRUE);
+    g_free(tail);
+    g_free(tmp_path);
+    return ret;
+}
+
+void
+cr_checksumcache_stats(cr_ChecksumCache *cache, cr_ChecksumCacheStats *stats)
+{
+    assert(cache);
+    assert(stats);
+
+    stats->records  = cache->records;
+    stats->stale    = cache->stale;
+    stats->hits     = (guint64) g_atomic_int_get(&cache->hits);
+    stats->misses   = (guint64) g_atomic_int_get(&cache->misses);
+    stats->inserts  = (guint64) g_atomic_int_get(&cache->inserts);
+}
+
+int
+cr_checksumcache_close(cr_ChecksumCache *cache, GError **err)
+{
+    int ret = CRE_OK;
+    GError *tmp_err = NULL;
+
+    assert(!err || *err == NULL);
+
+    if (!cache)
+        return CRE_OK;
+
+    if (cache->fd != -1) {
+        ret = cr_checksumcache_flush(cache, &tmp_err);
+
+        if (ret == CRE_OK
+            && cache->stale >= CACHE_COMPACT_MIN_STALE
+            && cache->stale * 4 > cache->records)
+            ret = cr_checksumcache_compact(cache, &tmp_err);
+
+        if (tmp_err)
+            g_propagate_error(err, tmp_err);
+
+        close(cache->fd);
+    }
+
+    if (cache->map)
+        munmap(cache->map, cache->map_len);
+
+    g_hash_table_destroy(cache->index);
+    g_hash_table_destroy(cache->new_records);
+    g_string_free(cache->wbuf, TRUE);
+    g_mutex_free(cache->mutex);
+    g_free(cache->path);
+    g_free(cache);
+
+    return ret;
+}
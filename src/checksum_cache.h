@@ -0,0 +1,146 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#ifndef __C_CREATEREPOLIB_CHECKSUM_CACHE_H__
+#define __C_CREATEREPOLIB_CHECKSUM_CACHE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <glib.h>
+
+/** \defgroup   checksum_cache  Persistent cache of package checksums.
+ *
+ * All records live in a single append-only file. The file is mmaped
+ * and indexed when the cache is opened; lookups into this index don't
+ * take any lock and are safe to be done from multiple threads.
+ * New records are buffered and appended to the file in batches.
+ * The file can be shared by concurrent runs: appends and compaction
+ * are done under flock(), and a run whose file was replaced by
+ * a compaction switches to the new file before it writes again.
+ * If the cache is marked as shared (see cr_checksumcache_set_shared()),
+ * a lookup which doesn't find the key reads records appended by other
+ * runs since the last such read, so a checksum written
+ * (see cr_checksumcache_flush()) by a concurrent run can be used.
+ *
+ * Record format (one per line):
+ * \code
+ * <key>\t<checksum>\n
+ * \endcode
+ *
+ * \addtogroup checksum_cache
+ *  @{
+ */
+
+/** Default name of the cache file inside of a cache directory.
+ */
+#define CR_CHECKSUM_CACHE_FILENAME  "checksums.cache"
+
+/** Checksum cache.
+ */
+typedef struct _cr_ChecksumCache cr_ChecksumCache;
+
+/** Statistics of a checksum cache usage.
+ */
+typedef struct {
+    guint64 records;    /*!< Number of valid records loaded from the file */
+    guint64 hits;       /*!< Number of successful lookups */
+    guint64 misses;     /*!< Number of unsuccessful lookups */
+    guint64 inserts;    /*!< Number of newly inserted records */
+    guint64 stale;      /*!< Duplicate or malformed records in the file */
+} cr_ChecksumCacheStats;
+
+/** Open (and create if it doesn't exist) a checksum cache file
+ * and build its index.
+ * @param path      Path to the cache file.
+ * @param err       GError **
+ * @return          cr_ChecksumCache or NULL on error
+ */
+cr_ChecksumCache *cr_checksumcache_open(const char *path, GError **err);
+
+/** Look up a checksum. Thread safe. On a miss in a shared cache, records
+ * appended to the file by other processes are loaded and searched too.
+ * @param cache     cr_ChecksumCache
+ * @param key       Key of the record.
+ * @return          Checksum (owned by the cache, valid until
+ *                  cr_checksumcache_close()) or NULL
+ */
+const char *cr_checksumcache_lookup(cr_ChecksumCache *cache, const char *key);
+
+/** Insert a new record. Records are buffered and written to the file
+ * in batches. Thread safe.
+ * @param cache     cr_ChecksumCache
+ * @param key       Key of the record (must not contain tab or newline).
+ * @param checksum  Checksum.
+ * @param err       GError **
+ * @return          cr_Error code
+ */
+int cr_checksumcache_insert(cr_ChecksumCache *cache,
+                            const char *key,
+                            const char *checksum,
+                            GError **err);
+
+/** Mark the cache as filled by other processes at the same time
+ * (e.g. other repositories of a --batch run). Lookups which miss then
+ * check the file for records appended by these processes. Must be called
+ * before the cache is used by multiple threads.
+ * @param cache     cr_ChecksumCache
+ * @param shared    Whether other processes write into the file
+ */
+void cr_checksumcache_set_shared(cr_ChecksumCache *cache, gboolean shared);
+
+/** Write all buffered records to the file. Thread safe.
+ * @param cache     cr_ChecksumCache
+ * @param err       GError **
+ * @return          cr_Error code
+ */
+int cr_checksumcache_flush(cr_ChecksumCache *cache, GError **err);
+
+/** Rewrite the cache file without duplicate and malformed records.
+ * Records appended by other processes since the file was opened are
+ * kept. Must not be called while other threads use the cache.
+ * @param cache     cr_ChecksumCache
+ * @param err       GError **
+ * @return          cr_Error code
+ */
+int cr_checksumcache_compact(cr_ChecksumCache *cache, GError **err);
+
+/** Get usage statistics of the cache.
+ * @param cache     cr_ChecksumCache
+ * @param stats     cr_ChecksumCacheStats to be filled
+ */
+void cr_checksumcache_stats(cr_ChecksumCache *cache,
+                            cr_ChecksumCacheStats *stats);
+
+/** Flush buffered records, compact the file if it contains too many
+ * stale records and free the cache.
+ * @param cache     cr_ChecksumCache
+ * @param err       GError **
+ * @return          cr_Error code
+ */
+int cr_checksumcache_close(cr_ChecksumCache *cache, GError **err);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __C_CREATEREPOLIB_CHECKSUM_CACHE_H__ */
@@ -0,0 +1,329 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "checksum_manifest.h"
+#include "error.h"
+
+#define ERR_DOMAIN              CREATEREPO_C_ERROR
+
+/** A record of the manifest.
+ */
+struct ManifestEntry {
+    const char  *checksum;      // Checksum (points to the map)
+    gint64      size;           // Size of the file or -1 if not recorded
+    gint64      mtime;          // Mtime of the file
+};
+
+struct _cr_ChecksumManifest {
+    char        *map;           // Private mapping of the file content
+    size_t      map_len;        // Length of the mapping
+    gchar       *last_line;     // Copy of the last line if it isn't
+                                // terminated by a newline
+    GHashTable  *index;         // Path -> struct ManifestEntry
+                                // Read only after load -> lock-free lookups
+    struct ManifestEntry *entries; // Records (one per line at most)
+    gdouble     verify_rate;    // Percentage of hits to verify
+
+    guint64     records;        // Records loaded from the file
+    volatile gint hits;
+    volatile gint misses;
+    volatile gint outdated;
+    volatile gint verified;
+    volatile gint mismatches;
+};
+
+/** Length of a hex checksum of the type (0 for unknown type).
+ */
+static gsize
+checksum_hex_len(cr_ChecksumType type)
+{
+    switch (type) {
+        case CR_CHECKSUM_MD5:       return 32;
+        case CR_CHECKSUM_SHA:
+        case CR_CHECKSUM_SHA1:      return 40;
+        case CR_CHECKSUM_SHA224:    return 56;
+        case CR_CHECKSUM_SHA256:    return 64;
+        case CR_CHECKSUM_SHA384:    return 96;
+        case CR_CHECKSUM_SHA512:    return 128;
+        default:                    return 0;
+    }
+}
+
+/** Parse a decimal number terminated by a tab.
+ * @return      Pointer behind the tab or NULL
+ */
+static char *
+parse_number(char *str, gint64 *value)
+{
+    char *endptr;
+
+    if (!g_ascii_isdigit(*str))
+        return NULL;
+    *value = g_ascii_strtoll(str, &endptr, 10);
+    if (*endptr != '\t')
+        return NULL;
+    return endptr + 1;
+}
+
+/** Parse a (zero terminated) line into the entry.
+ * The checksum is lowered and terminated in place.
+ * @return      Path of the entry or NULL if the line is malformed
+ */
+static char *
+parse_line(char *line, gsize checksum_len, struct ManifestEntry *entry)
+{
+    char *path;
+    gsize len = 0;
+
+    while (g_ascii_isxdigit(line[len])) {
+        line[len] = g_ascii_tolower(line[len]);
+        len++;
+    }
+
+    if (len != checksum_len)
+        return NULL;
+
+    entry->checksum = line;
+    entry->size = -1;
+    entry->mtime = 0;
+
+    if (line[len] == '\t') {
+        // <checksum>\t<size>\t<mtime>\t<path>
+        path = parse_number(line + len + 1, &entry->size);
+        if (path)
+            path = parse_number(path, &entry->mtime);
+        if (!path)
+            return NULL;
+    } else if (line[len] == ' ') {
+        // <checksum>  <path> (optionally "*<path>" for binary mode)
+        path = line + len + 1;
+        while (*path == ' ')
+            path++;
+        if (*path == '*')
+            path++;
+    } else {
+        return NULL;
+    }
+
+    line[len] = '\0';
+
+    while (g_str_has_prefix(path, "./"))
+        path += 2;
+
+    return *path ? path : NULL;
+}
+
+cr_ChecksumManifest *
+cr_checksummanifest_load(const char *path,
+                         cr_ChecksumType type,
+                         GError **err)
+{
+    int fd;
+    struct stat st;
+    gsize checksum_len;
+    guint lines = 0, lineno = 0;
+    cr_ChecksumManifest *manifest;
+
+    assert(path);
+    assert(!err || *err == NULL);
+
+    checksum_len = checksum_hex_len(type);
+    if (!checksum_len) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "Unsupported checksum type for a checksum manifest");
+        return NULL;
+    }
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "Cannot open %s: %s", path, g_strerror(errno));
+        return NULL;
+    }
+
+    if (fstat(fd, &st) == -1) {
+        g_set_error(err, ERR_DOMAIN, CRE_STAT,
+                    "Cannot stat %s: %s", path, g_strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    manifest = g_malloc0(sizeof(cr_ChecksumManifest));
+    manifest->index = g_hash_table_new(g_str_hash, g_str_equal);
+
+    if (st.st_size > 0) {
+        manifest->map_len = st.st_size;
+        manifest->map = mmap(NULL, manifest->map_len, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE, fd, 0);
+        if (manifest->map == MAP_FAILED) {
+            g_set_error(err, ERR_DOMAIN, CRE_IO,
+                        "Cannot mmap %s: %s", path, g_strerror(errno));
+            manifest->map = NULL;
+            manifest->map_len = 0;
+            close(fd);
+            cr_checksummanifest_free(manifest);
+            return NULL;
+        }
+        madvise(manifest->map, manifest->map_len, MADV_SEQUENTIAL);
+    }
+
+    close(fd);
+
+    // One entry per line at most
+    for (size_t x = 0; x < manifest->map_len; x++)
+        if (manifest->map[x] == '\n')
+            lines++;
+    manifest->entries = g_new(struct ManifestEntry, lines + 1);
+
+    char *cur = manifest->map;
+    char *end = manifest->map + manifest->map_len;
+
+    while (cur < end) {
+        char *line = cur;
+        char *eol = memchr(cur, '\n', end - cur);
+        size_t len;
+
+        if (eol) {
+            *eol = '\0';
+            cur = eol + 1;
+        } else {
+            // The last line is not terminated and there is no room
+            // for a terminator in the mapping
+            manifest->last_line = g_strndup(cur, end - cur);
+            line = manifest->last_line;
+            cur = end;
+        }
+
+        len = strlen(line);
+        if (len && line[len-1] == '\r')
+            line[len-1] = '\0';
+        lineno++;
+
+        if (*line != '#' && *line != '\0') {
+            struct ManifestEntry *entry = &manifest->entries[manifest->records];
+            char *entry_path = parse_line(line, checksum_len, entry);
+            if (!entry_path) {
+                g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                            "%s:%u: Malformed line (a %s checksum is "
+                            "expected)", path, lineno,
+                            cr_checksum_name_str(type));
+                cr_checksummanifest_free(manifest);
+                return NULL;
+            }
+            g_hash_table_replace(manifest->index, entry_path, entry);
+            manifest->records++;
+        }
+    }
+
+    g_debug("%s: %s: %"G_GUINT64_FORMAT" records loaded",
+            __func__, path, manifest->records);
+
+    return manifest;
+}
+
+void
+cr_checksummanifest_set_verify_rate(cr_ChecksumManifest *manifest,
+                                    gdouble percent)
+{
+    assert(manifest);
+    manifest->verify_rate = CLAMP(percent, 0.0, 100.0);
+}
+
+const char *
+cr_checksummanifest_lookup(cr_ChecksumManifest *manifest,
+                           const char *path,
+                           gint64 size,
+                           gint64 mtime,
+                           gboolean *verify)
+{
+    const struct ManifestEntry *entry;
+
+    assert(manifest);
+    assert(path);
+
+    if (verify)
+        *verify = FALSE;
+
+    entry = g_hash_table_lookup(manifest->index, path);
+    if (!entry) {
+        g_atomic_int_inc(&manifest->misses);
+        return NULL;
+    }
+
+    if (entry->size >= 0 && (entry->size != size || entry->mtime != mtime)) {
+        g_atomic_int_inc(&manifest->outdated);
+        return NULL;
+    }
+
+    g_atomic_int_inc(&manifest->hits);
+
+    if (verify && manifest->verify_rate > 0.0)
+        *verify = manifest->verify_rate >= 100.0
+                  || g_random_double_range(0.0, 100.0) < manifest->verify_rate;
+
+    return entry->checksum;
+}
+
+void
+cr_checksummanifest_verified(cr_ChecksumManifest *manifest, gboolean match)
+{
+    assert(manifest);
+
+    g_atomic_int_inc(&manifest->verified);
+    if (!match)
+        g_atomic_int_inc(&manifest->mismatches);
+}
+
+void
+cr_checksummanifest_stats(cr_ChecksumManifest *manifest,
+                          cr_ChecksumManifestStats *stats)
+{
+    assert(manifest);
+    assert(stats);
+
+    stats->records    = manifest->records;
+    stats->hits       = (guint64) g_atomic_int_get(&manifest->hits);
+    stats->misses     = (guint64) g_atomic_int_get(&manifest->misses);
+    stats->outdated   = (guint64) g_atomic_int_get(&manifest->outdated);
+    stats->verified   = (guint64) g_atomic_int_get(&manifest->verified);
+    stats->mismatches = (guint64) g_atomic_int_get(&manifest->mismatches);
+}
+
+void
+cr_checksummanifest_free(cr_ChecksumManifest *manifest)
+{
+    if (!manifest)
+        return;
+
+    g_hash_table_destroy(manifest->index);
+    g_free(manifest->entries);
+    g_free(manifest->last_line);
+    if (manifest->map)
+        munmap(manifest->map, manifest->map_len);
+    g_free(manifest);
+}
@@ -0,0 +1,124 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#ifndef __C_CREATEREPOLIB_CHECKSUM_MANIFEST_H__
+#define __C_CREATEREPOLIB_CHECKSUM_MANIFEST_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <glib.h>
+#include "checksum.h"
+
+/** \defgroup   checksum_manifest   Precomputed checksums of packages.
+ *
+ * A manifest supplies checksums of packages (e.g. recorded by an artifact
+ * store) so they don't have to be computed. The whole manifest is loaded
+ * into an index on open; lookups are lock-free and thread safe.
+ *
+ * Two formats of lines are accepted (empty lines and lines starting
+ * with '#' are ignored):
+ * \code
+ * <checksum>  <path>
+ * <checksum>\t<size>\t<mtime>\t<path>
+ * \endcode
+ * The first one is the output of sha256sum and similar tools. With the
+ * second one, the checksum is used only if size and mtime of the file
+ * match. Paths are relative to the directory of the repository.
+ *
+ * \addtogroup checksum_manifest
+ *  @{
+ */
+
+/** Checksum manifest.
+ */
+typedef struct _cr_ChecksumManifest cr_ChecksumManifest;
+
+/** Statistics of a checksum manifest usage.
+ */
+typedef struct {
+    guint64 records;    /*!< Number of records loaded from the file */
+    guint64 hits;       /*!< Number of successful lookups */
+    guint64 misses;     /*!< Lookups of paths missing in the manifest */
+    guint64 outdated;   /*!< Lookups with different size or mtime */
+    guint64 verified;   /*!< Checksums verified by computation */
+    guint64 mismatches; /*!< Verified checksums which were wrong */
+} cr_ChecksumManifestStats;
+
+/** Load a manifest file and build its index.
+ * @param path          Path to the manifest.
+ * @param type          Type of checksums in the manifest.
+ * @param err           GError **
+ * @return              cr_ChecksumManifest or NULL on error
+ */
+cr_ChecksumManifest *cr_checksummanifest_load(const char *path,
+                                              cr_ChecksumType type,
+                                              GError **err);
+
+/** Set which part of successful lookups should be verified.
+ * @param manifest      cr_ChecksumManifest
+ * @param percent       Percentage (0 - 100) of lookups to verify
+ */
+void cr_checksummanifest_set_verify_rate(cr_ChecksumManifest *manifest,
+                                         gdouble percent);
+
+/** Look up a checksum. Thread safe.
+ * @param manifest      cr_ChecksumManifest
+ * @param path          Path of the package relative to the repository.
+ * @param size          Size of the file.
+ * @param mtime         Modification time of the file.
+ * @param verify        If not NULL, set to TRUE when the returned
+ *                      checksum was sampled for verification (the caller
+ *                      should compute the checksum and report the result
+ *                      by cr_checksummanifest_verified()).
+ * @return              Checksum (owned by the manifest) or NULL
+ */
+const char *cr_checksummanifest_lookup(cr_ChecksumManifest *manifest,
+                                       const char *path,
+                                       gint64 size,
+                                       gint64 mtime,
+                                       gboolean *verify);
+
+/** Report result of a verification. Thread safe.
+ * @param manifest      cr_ChecksumManifest
+ * @param match         Computed checksum matched the manifest
+ */
+void cr_checksummanifest_verified(cr_ChecksumManifest *manifest,
+                                  gboolean match);
+
+/** Get usage statistics of the manifest.
+ * @param manifest      cr_ChecksumManifest
+ * @param stats         cr_ChecksumManifestStats to be filled
+ */
+void cr_checksummanifest_stats(cr_ChecksumManifest *manifest,
+                               cr_ChecksumManifestStats *stats);
+
+/** Free the manifest.
+ * @param manifest      cr_ChecksumManifest
+ */
+void cr_checksummanifest_free(cr_ChecksumManifest *manifest);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __C_CREATEREPOLIB_CHECKSUM_MANIFEST_H__ */
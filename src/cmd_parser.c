@@ -27,6 +27,7 @@
 #include "error.h"
 #include "compression_wrapper.h"
 #include "misc.h"
+#include "shard.h"
 #include "cleanup.h"
 
 
@@ -59,6 +60,7 @@ struct CmdOptions _cmd_options = {
         .oldpackagedirs             = NULL,
         .num_deltas                 = 1,
         .max_delta_rpm_size         = CR_DEFAULT_MAX_DELTA_RPM_SIZE,
+        .no_delta_cache             = FALSE,
 
         .checksum_cachedir          = NULL,
         .repomd_checksum_type       = CR_CHECKSUM_SHA256,
@@ -144,6 +146,12 @@ static GOptionEntry cmd_entries[] =
       "READ_PKGS_LIST" },
     { "workers", 0, 0, G_OPTION_ARG_INT, &(_cmd_options.workers),
       "Number of workers to spawn to read rpms.", NULL },
+    { "prefetch", 0, 0, G_OPTION_ARG_INT, &(_cmd_options.prefetch),
+      "Read up to NUM packages ahead of the workers (stat, header and "
+      "checksum) by dedicated I/O threads. Useful on storage with high "
+      "latency. (default: 0 - disabled)", "NUM" },
+    { "prefetch-threads", 0, 0, G_OPTION_ARG_INT, &(_cmd_options.prefetch_threads),
+      "Number of I/O threads used by --prefetch.", NULL },
     { "xz", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.xz_compression),
       "Use xz for repodata compression.", NULL },
     { "compress-type", 0, 0, G_OPTION_ARG_STRING, &(_cmd_options.compress_type),
@@ -151,6 +159,44 @@ static GOptionEntry cmd_entries[] =
     { "general-compress-type", 0, 0, G_OPTION_ARG_STRING, &(_cmd_options.general_compress_type),
       "Which compression type to use (even for primary, filelists and other xml).",
       "COMPRESSION_TYPE" },
+    { "zstd-level", 0, 0, G_OPTION_ARG_INT, &(_cmd_options.zstd_level),
+      "Compression level (1-22) used for zstd compression.", "LEVEL" },
+    { "zstd-long", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.zstd_long),
+      "Enable long distance matching for zstd compression.", NULL },
+    { "zstd-workers", 0, 0, G_OPTION_ARG_INT, &(_cmd_options.zstd_workers),
+      "Number of extra threads used by a single zstd compression.", NULL },
+    { "compress-variant", 0, 0, G_OPTION_ARG_STRING_ARRAY,
+      &(_cmd_options.compress_variants),
+      "Write primary, filelists and other also with this compression type "
+      "(in the same pass) and add them into repomd.xml. Can be used "
+      "multiple times.", "COMPRESSION_TYPE" },
+    { "zck", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.zck_compression),
+      "Generate zchunk files as well as the standard repodata.", NULL },
+    { "zck-dict-dir", 0, 0, G_OPTION_ARG_FILENAME, &(_cmd_options.zck_dict_dir),
+      "Directory containing compression dictionaries for use by zchunk "
+      "(primary.zdict, filelists.zdict and other.zdict).", "ZCK_DICT_DIR" },
+    { "zck-dict-train", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.zck_dict_train),
+      "Use the zchunk dictionaries of the previous repodata, or train new "
+      "ones from the old metadata (--update), and publish them "
+      "in the repodata.", NULL },
+    { "segmented", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.segmented),
+      "Compress primary, filelists and other in independent segments "
+      "and copy unchanged segments from the previous repodata instead of "
+      "compressing them again. Not supported with bz2 and zck compression.",
+      NULL },
+    { "segment-size", 0, 0, G_OPTION_ARG_INT, &(_cmd_options.segment_size),
+      "Average number of packages in a segment (used with --segmented).",
+      "NUM" },
+    { "shard", 0, 0, G_OPTION_ARG_STRING, &(_cmd_options.shard),
+      "Process only the K-th of N equal slices of the sorted package list "
+      "and write its metadata into the output directory for --assemble. "
+      "Implies --segmented.", "K/N" },
+    { "assemble", 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &(_cmd_options.assemble),
+      "Don't read any packages, concatenate metadata of shards written "
+      "by --shard into the output repodata instead. Give output "
+      "directories of all shards in order (use the option for each of "
+      "them). Use the same compression options as for the shards. "
+      "Implies --segmented.", "DIR" },
     { "keep-all-metadata", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.keep_all_metadata),
       "Keep groupfile and updateinfo from source repo during update.", NULL },
     { "compatibility", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.compatibility),
@@ -161,6 +207,19 @@ static GOptionEntry cmd_entries[] =
       "Available units (m - minutes, h - hours, d - days)", "AGE" },
     { "cachedir", 'c', 0, G_OPTION_ARG_FILENAME, &(_cmd_options.cachedir),
       "Set path to cache dir", "CACHEDIR." },
+    { "checksum-manifest", 0, 0, G_OPTION_ARG_FILENAME, &(_cmd_options.checksum_manifest),
+      "Use checksums of packages from FILE instead of computing them. "
+      "Each line is either \"CHECKSUM  PATH\" (output of sha256sum and "
+      "similar tools) or \"CHECKSUM<tab>SIZE<tab>MTIME<tab>PATH\" (the "
+      "checksum is used only if size and mtime of the package match). "
+      "PATH is relative to the directory to index, checksums must be "
+      "of the --checksum type.", "FILE" },
+    { "checksum-manifest-verify", 0, 0, G_OPTION_ARG_DOUBLE,
+      &(_cmd_options.checksum_manifest_verify),
+      "Compute checksums of randomly chosen PERCENT of packages found "
+      "in the --checksum-manifest anyway. A wrong checksum in the manifest "
+      "is reported as an error and the computed one is used. (default: 0)",
+      "PERCENT" },
 #ifdef CR_DELTA_RPM_SUPPORT
     { "deltas", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.deltas),
       "Tells createrepo to generate deltarpms and the delta metadata.", NULL },
@@ -171,6 +230,10 @@ static GOptionEntry cmd_entries[] =
       "The number of older versions to make deltas against. Defaults to 1.", "INT" },
     { "max-delta-rpm-size", 0, 0, G_OPTION_ARG_INT64, &(_cmd_options.max_delta_rpm_size),
       "Max size of an rpm that to run deltarpm against (in bytes).", "MAX_DELTA_RPM_SIZE" },
+    { "no-delta-cache", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.no_delta_cache),
+      "Regenerate all deltarpms. By default, deltas made by previous runs "
+      "for the same pair of packages (compared by checksums) are reused "
+      "and deltas that are not needed anymore are removed.", NULL },
 #endif
     { "local-sqlite", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.local_sqlite),
       "Gen sqlite DBs locally (into a directory for temporary files). "
@@ -188,6 +251,25 @@ static GOptionEntry cmd_entries[] =
       "Checksum type to be used in repomd.xml", "CHECKSUM_TYPE"},
     { "error-exit-val", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.error_exit_val),
       "Exit with retval 2 if there were any errors during processing", NULL },
+    { "profile", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.profile),
+      "Measure time spent in particular phases of the repodata generation "
+      "and log a summary at the end.", NULL },
+    { "stats-json", 0, 0, G_OPTION_ARG_FILENAME, &(_cmd_options.stats_json),
+      "Write timings and counters (see --profile) as JSON into FILE. "
+      "Implies --profile.", "FILE" },
+    { "batch", 0, 0, G_OPTION_ARG_FILENAME, &(_cmd_options.batch),
+      "Process all repositories listed in FILE. Each line contains "
+      "a directory to index followed by its own options (shell-like quoting, "
+      "empty lines and lines starting with # are ignored). Options given "
+      "on the command line are used for all repositories. Every repository "
+      "is processed by its own process, locked and published on its own. "
+      "--workers given on the command line is the number of workers shared "
+      "by all repositories. Use the same absolute --cachedir to share "
+      "the checksum cache among the repositories (a package hardlinked "
+      "into several repositories is hashed once).", "FILE" },
+    { "batch-jobs", 0, 0, G_OPTION_ARG_INT, &(_cmd_options.batch_jobs),
+      "Number of repositories processed at the same time in --batch mode. "
+      "(default: --workers)", "NUM" },
     { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL },
 };
 
@@ -259,6 +341,9 @@ check_and_set_compression_type(const char *type_str,
         *type = CR_CW_BZ2_COMPRESSION;
     } else if (!strcmp(compress_str->str, "xz")) {
         *type = CR_CW_XZ_COMPRESSION;
+    } else if (!strcmp(compress_str->str, "zstd")
+               || !strcmp(compress_str->str, "zst")) {
+        *type = CR_CW_ZSTD_COMPRESSION;
     } else {
         g_set_error(err, ERR_DOMAIN, CRE_BADARG,
                     "Unknown/Unsupported compression type \"%s\"", type_str);
@@ -341,6 +426,19 @@ check_arguments(struct CmdOptions *options,
         options->workers = DEFAULT_WORKERS;
     }
 
+    // Check prefetch
+    if (options->prefetch < 0 || options->prefetch_threads < 0) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "--prefetch and --prefetch-threads cannot be negative");
+        return FALSE;
+    }
+
+    if (options->prefetch_threads && !options->prefetch) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "--prefetch-threads can be used only with --prefetch");
+        return FALSE;
+    }
+
     // Check changelog_limit
     if ((options->changelog_limit < -1)) {
         g_warning("Wrong changelog limit \"%d\" - Using 10", options->changelog_limit);
@@ -398,6 +496,136 @@ check_arguments(struct CmdOptions *options,
         }
     }
 
+    // Check zstd parameters
+    if (options->zstd_level < 0 || options->zstd_level > 22) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "Bad zstd compression level %d (use 1-22)",
+                    options->zstd_level);
+        return FALSE;
+    }
+
+    if (options->zstd_workers < 0) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "Number of zstd workers cannot be negative");
+        return FALSE;
+    }
+
+    // Check zchunk options
+    if (options->zck_dict_dir) {
+        if (!options->zck_compression) {
+            g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                        "--zck-dict-dir can be used only with --zck");
+            return FALSE;
+        }
+
+        if (!g_file_test(options->zck_dict_dir, G_FILE_TEST_IS_DIR)) {
+            g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                        "--zck-dict-dir %s is not a directory",
+                        options->zck_dict_dir);
+            return FALSE;
+        }
+    }
+
+    if (options->zck_dict_train) {
+        if (!options->zck_compression) {
+            g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                        "--zck-dict-train can be used only with --zck");
+            return FALSE;
+        }
+
+        if (options->zck_dict_dir) {
+            g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                        "--zck-dict-train cannot be combined with "
+                        "--zck-dict-dir");
+            return FALSE;
+        }
+    }
+
+    // Check shard options
+    if (options->shard) {
+        if (cr_shard_parse(options->shard, &options->shard_index,
+                           &options->shard_count, err) != CRE_OK)
+            return FALSE;
+    }
+
+    if (options->shard || options->assemble) {
+        const char *option = options->shard ? "--shard" : "--assemble";
+
+        if (options->shard && options->assemble) {
+            g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                        "--shard and --assemble cannot be used together");
+            return FALSE;
+        }
+
+        if (options->split || options->deltas || options->zck_compression
+            || options->compress_variants)
+        {
+            g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                        "%s cannot be used with --split, --deltas, --zck "
+                        "and --compress-variant", option);
+            return FALSE;
+        }
+
+        if (options->assemble && options->update) {
+            g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                        "--assemble cannot be used with --update");
+            return FALSE;
+        }
+
+        // Shards are concatenated from segments
+        options->segmented = TRUE;
+    }
+
+    // Check segments options
+    if (options->segment_size < 0) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "Segment size cannot be negative");
+        return FALSE;
+    }
+
+    if (options->segment_size && !options->segmented) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "--segment-size can be used only with --segmented");
+        return FALSE;
+    }
+
+    if (options->segmented
+        && (options->general_compression_type == CR_CW_BZ2_COMPRESSION
+            || options->general_compression_type == CR_CW_ZCK_COMPRESSION))
+    {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "--segmented is not supported with %s compression",
+                    cr_compression_suffix(options->general_compression_type));
+        return FALSE;
+    }
+
+    // Check compression variants
+    for (int x = 0; options->compress_variants && options->compress_variants[x]; x++) {
+        cr_CompressionType type;
+        cr_CompressionType xml_type = CR_CW_GZ_COMPRESSION;
+
+        if (options->general_compression_type != CR_CW_UNKNOWN_COMPRESSION)
+            xml_type = options->general_compression_type;
+
+        if (!check_and_set_compression_type(options->compress_variants[x],
+                                            &type, err))
+            return FALSE;
+
+        if (type == xml_type
+            || g_slist_find(options->compression_variants,
+                            GINT_TO_POINTER(type)))
+        {
+            g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                        "Compression variant \"%s\" is used more than once",
+                        options->compress_variants[x]);
+            return FALSE;
+        }
+
+        options->compression_variants = g_slist_append(
+                                        options->compression_variants,
+                                        GINT_TO_POINTER(type));
+    }
+
     int x;
 
     // Process exclude glob masks
@@ -554,6 +782,21 @@ check_arguments(struct CmdOptions *options,
         return FALSE;
     }
 
+    // Check checksum manifest
+    if (options->checksum_manifest_verify < 0.0
+        || options->checksum_manifest_verify > 100.0) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "--checksum-manifest-verify must be between 0 and 100");
+        return FALSE;
+    }
+
+    if (options->checksum_manifest_verify > 0.0 && !options->checksum_manifest) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "--checksum-manifest-verify can be used only with "
+                    "--checksum-manifest");
+        return FALSE;
+    }
+
     return TRUE;
 }
 
@@ -574,6 +817,11 @@ free_options(struct CmdOptions *options)
     g_free(options->retain_old_md_by_age);
     g_free(options->cachedir);
     g_free(options->checksum_cachedir);
+    g_free(options->stats_json);
+    g_free(options->zck_dict_dir);
+    g_free(options->checksum_manifest);
+    g_free(options->batch);
+    g_free(options->shard);
 
     g_strfreev(options->excludes);
     g_strfreev(options->includepkg);
@@ -581,6 +829,8 @@ free_options(struct CmdOptions *options)
     g_strfreev(options->content_tags);
     g_strfreev(options->repo_tags);
     g_strfreev(options->oldpackagedirs);
+    g_strfreev(options->compress_variants);
+    g_strfreev(options->assemble);
 
     cr_slist_free_full(options->include_pkgs, g_free);
     cr_slist_free_full(options->exclude_masks,
@@ -589,4 +839,5 @@ free_options(struct CmdOptions *options)
     cr_slist_free_full(options->distro_cpeids, g_free);
     cr_slist_free_full(options->distro_values, g_free);
     g_slist_free(options->oldpackagedirs_paths);
+    g_slist_free(options->compression_variants);
 }
@@ -68,6 +68,9 @@ struct CmdOptions {
     char *revision;             /*!< user-specified revision */
     char *read_pkgs_list;       /*!< output the paths to pkgs actually read */
     gint workers;               /*!< number of threads to spawn */
+    gint prefetch;              /*!< number of packages read ahead
+                                     (0 = disabled) */
+    gint prefetch_threads;      /*!< number of threads reading ahead */
     gboolean xz_compression;    /*!< use xz for repodata compression */
     gboolean keep_all_metadata; /*!< keep groupfile and updateinfo from source
                                      repo during update */
@@ -95,6 +98,8 @@ struct CmdOptions {
                                      deltas against */
     gint64 max_delta_rpm_size;  /*!< Max size of an rpm that to run
                                      deltarpm against */
+    gboolean no_delta_cache;    /*!< Don't reuse deltas from previous
+                                     runs */
     gboolean local_sqlite;      /*!< Gen sqlite locally into a directory for
                                      temporary files.
                                      For situations when sqlite has a trouble
@@ -106,6 +111,31 @@ struct CmdOptions {
                                      during repodata generation. */
     gchar *repomd_checksum;     /*!< Checksum type for entries in repomd.xml */
     gboolean error_exit_val;        /*!< exit 2 on processing errors */
+    gboolean profile;           /*!< log time spent in particular phases */
+    char *stats_json;           /*!< write profiling stats as JSON here */
+    gint zstd_level;            /*!< zstd compression level (0 = default) */
+    gboolean zstd_long;         /*!< zstd long distance matching */
+    gint zstd_workers;          /*!< zstd worker threads per file */
+    gboolean zck_compression;   /*!< generate zchunk primary, filelists
+                                     and other in addition */
+    char *zck_dict_dir;         /*!< dir with zchunk dictionaries */
+    gboolean zck_dict_train;    /*!< reuse or train zchunk dictionaries
+                                     and add them to repomd */
+    gboolean segmented;         /*!< write primary, filelists and other
+                                     in reusable compressed segments */
+    gint segment_size;          /*!< average number of packages
+                                     in a segment (0 = default) */
+    char **compress_variants;   /*!< additional compression types of
+                                     primary, filelists and other */
+    char *shard;                /*!< slice of packages to process ("K/N") */
+    char **assemble;            /*!< output directories of shards
+                                     to assemble */
+    char *checksum_manifest;    /*!< file with precomputed checksums */
+    gdouble checksum_manifest_verify; /*!< percentage of checksums from
+                                     the manifest to verify */
+    char *batch;                /*!< file with repositories to process */
+    gint batch_jobs;            /*!< number of repositories processed
+                                     at the same time (0 = auto) */
 
     /* Items filled by check_arguments() */
 
@@ -122,12 +152,17 @@ struct CmdOptions {
     cr_ChecksumType repomd_checksum_type;   /*!< checksum type */
     cr_CompressionType compression_type;    /*!< compression type */
     cr_CompressionType general_compression_type; /*!< compression type */
+    GSList *compression_variants; /*!< additional compression types
+                                     (cr_CompressionType in pointers) */
     gint64 md_max_age;          /*!< Max age of files in repodata/.
                                      Older files will be removed
                                      during --update.
                                      Filled if --retain-old-md-by-age
                                      is used */
     char *checksum_cachedir;    /*!< Path to cachedir */
+    guint shard_index;          /*!< number of the shard (1 - shard_count),
+                                     0 if --shard is not used */
+    guint shard_count;          /*!< number of shards */
     GSList *oldpackagedirs_paths; /*!< paths to look for older pkgs to delta against */
 
 };
@@ -29,6 +29,14 @@
 #include <zlib.h>
 #include <bzlib.h>
 #include <lzma.h>
+#ifdef WITH_ZSTD
+#include <zstd.h>
+#endif
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef WITH_ZCHUNK
+#include <zck.h>
+#endif
 #include "error.h"
 #include "compression_wrapper.h"
 
@@ -82,11 +90,82 @@ LZMA_CHECK_SHA256
 #define XZ_DECODER_FLAGS        0
 #define XZ_BUFFER_SIZE          (1024*32)
 
+/*
+1 (fastest) .. 22 (best, --ultra levels)
+Levels around 10 are still faster than XZ and give a ratio between
+gzip and XZ on repodata.
+*/
+#define CR_CW_ZSTD_COMPRESSION_LEVEL    10
+
+/*
+Data written into a file with variants are passed to compression threads
+of the variants in blocks of this size. At most TEE_MAX_BLOCKS blocks
+wait for a variant, a writer faster than the variant is blocked.
+*/
+#define TEE_BLOCK_SIZE          (1024*1024)
+#define TEE_MAX_BLOCKS          8
+
+/*
+Magic bytes of a Zstandard frame (0xFD2FB528 little endian)
+*/
+#define ZSTD_MAGIC              "\x28\xb5\x2f\xfd"
+#define ZSTD_MAGIC_LEN          4
+
+/*
+Magic bytes of a zchunk file ("\0ZCK1")
+*/
+#define ZCK_MAGIC               "\0ZCK1"
+#define ZCK_MAGIC_LEN           5
+
 #if ZLIB_VERNUM < 0x1240
 // XXX: Zlib has gzbuffer since 1.2.4
 #define gzbuffer(a,b) 0
 #endif
 
+/*
+liblzma has the multithreaded decoder since 5.4.0. It decodes blocks
+in parallel if their sizes are stored in block headers (this is done
+by the multithreaded encoder), other streams are decoded in one thread.
+*/
+#if LZMA_VERSION >= 50040002U
+#define WITH_XZ_MT_DECODER
+#endif
+
+/* Default number of threads of the xz decoder is the number of CPUs,
+   but at most this */
+#define XZ_DECODER_THREADS_MAX  8
+
+/* Upper limit of the read buffer size, sizes are int in cr_read() */
+#define READ_BUFFER_SIZE_MAX    (1024*1024*256)
+
+static int zstd_level = CR_CW_ZSTD_COMPRESSION_LEVEL;
+static gboolean zstd_long_mode = FALSE;
+static int zstd_workers = 0;
+
+static gsize read_buffer_size = CR_CW_READ_BUFFER_SIZE;
+static int xz_decoder_threads = 0;
+static gboolean threaded_read = TRUE;
+
+void
+cr_compression_set_zstd_params(int level, gboolean long_mode, int workers)
+{
+    zstd_level = (level > 0) ? level : CR_CW_ZSTD_COMPRESSION_LEVEL;
+    zstd_long_mode = long_mode;
+    zstd_workers = (workers > 0) ? workers : 0;
+}
+
+void
+cr_compression_set_read_params(gsize buffer_size,
+                               int xz_threads,
+                               gboolean threaded)
+{
+    read_buffer_size = buffer_size ? buffer_size : CR_CW_READ_BUFFER_SIZE;
+    if (read_buffer_size > READ_BUFFER_SIZE_MAX)
+        read_buffer_size = READ_BUFFER_SIZE_MAX;
+    xz_decoder_threads = (xz_threads > 0) ? xz_threads : 0;
+    threaded_read = threaded;
+}
+
 cr_ContentStat *
 cr_contentstat_new(cr_ChecksumType type, GError **err)
 {
@@ -115,9 +194,111 @@ cr_contentstat_free(cr_ContentStat *cstat, GError **err)
 typedef struct {
     lzma_stream stream;
     FILE *file;
-    unsigned char buffer[XZ_BUFFER_SIZE];
+    size_t buffer_size;
+    unsigned char *buffer;
+    lzma_index *index;      /*!< Index of written blocks (segmented mode) */
+    GByteArray *segment;    /*!< Content of the open block (segmented mode) */
 } XzFile;
 
+/** Decoding thread of a file opened for reading.
+ * The thread decodes into one of two buffers while cr_read() copies
+ * data out of the other one. A buffer is either empty (len == -1)
+ * and owned by the thread, or full and owned by cr_read().
+ * Full buffer with len == 0 marks the end of the file (or an error).
+ */
+typedef struct {
+    GThread *thread;        /*!< Decoding thread (started by 1st read) */
+    GMutex *mutex;          /*!< Guards len, stop and err */
+    GCond *cond;            /*!< Signals a change of a buffer state */
+    unsigned char *buf[2];  /*!< Double buffer */
+    int len[2];             /*!< Decoded bytes in the buffer, -1 = empty */
+    size_t size;            /*!< Size of each buffer */
+    int cur;                /*!< Buffer being consumed by cr_read() */
+    int pos;                /*!< Consumed bytes of the current buffer */
+    gboolean stop;          /*!< cr_close() asks the thread to finish */
+    GError *err;            /*!< Decoding error */
+} CrReader;
+
+static CrReader *cr_reader_new(void);
+static void cr_reader_free(CrReader *reader);
+
+/** Block of data shared by all variants of a file.
+ */
+typedef struct {
+    volatile gint refs;     /*!< Variants which didn't write the block yet */
+    size_t len;             /*!< Length of the data */
+    unsigned char data[];   /*!< Data */
+} CrTeeBlock;
+
+/** Variant of a written file (see cr_add_variant()). Blocks of data
+ * written into the file are queued and written (compressed) into
+ * the variant by its own thread. The thread also closes the variant.
+ */
+typedef struct {
+    CR_FILE *file;          /*!< The variant */
+    GThread *thread;        /*!< Compression thread */
+    GMutex *mutex;          /*!< Guards queue, finish and err */
+    GCond *cond;            /*!< Signals a change of the queue */
+    GQueue *queue;          /*!< Queued CrTeeBlocks */
+    gboolean finish;        /*!< No more blocks will be queued */
+    GError *err;            /*!< The first error of the variant */
+} CrTeeVariant;
+
+/** Variants of a written file.
+ */
+typedef struct {
+    GPtrArray *variants;    /*!< CrTeeVariants */
+    GByteArray *pending;    /*!< Data not passed to the variants yet */
+} CrTee;
+
+static void cr_tee_finish(CrTee *tee);
+static int cr_tee_free(CrTee *tee, GError **err);
+static int cr_tee_write(CrTee *tee, const void *buf, size_t len,
+                        GError **err);
+
+#ifdef WITH_ZSTD
+typedef struct {
+    ZSTD_CCtx *cctx;        /*!< Compression context (write mode) */
+    ZSTD_DCtx *dctx;        /*!< Decompression context (read mode) */
+    ZSTD_inBuffer in;       /*!< Not yet decoded input (read mode) */
+    gboolean flush;         /*!< Decoder may have buffered output */
+    gboolean frame_end;     /*!< Last decoded byte ended a frame */
+    FILE *file;
+    size_t buffer_size;
+    unsigned char *buffer;
+} ZstdFile;
+#endif
+
+#ifdef WITH_ZCHUNK
+typedef struct {
+    zckCtx *zck;            /*!< Zchunk context */
+    int fd;                 /*!< Underlying file descriptor */
+} ZckFile;
+#endif
+
+/** Check if the file starts with the specified magic bytes.
+ * libmagic in older versions doesn't know Zstandard and zchunk formats.
+ */
+static gboolean
+cr_has_magic(const char *filename, const char *magic_bytes, size_t len)
+{
+    char magic[8];
+    gboolean ret = FALSE;
+    FILE *f;
+
+    assert(len <= sizeof(magic));
+
+    f = fopen(filename, "rb");
+    if (!f)
+        return FALSE;
+
+    if (fread(magic, 1, len, f) == len)
+        ret = !memcmp(magic, magic_bytes, len);
+
+    fclose(f);
+    return ret;
+}
+
 cr_CompressionType
 cr_detect_compression(const char *filename, GError **err)
 {
@@ -148,7 +329,15 @@ cr_detect_compression(const char *filename, GError **err)
     } else if (g_str_has_suffix(filename, ".xz"))
     {
         return CR_CW_XZ_COMPRESSION;
-    } else if (g_str_has_suffix(filename, ".xml"))
+    } else if (g_str_has_suffix(filename, ".zst") ||
+               g_str_has_suffix(filename, ".zstd"))
+    {
+        return CR_CW_ZSTD_COMPRESSION;
+    } else if (g_str_has_suffix(filename, ".zck"))
+    {
+        return CR_CW_ZCK_COMPRESSION;
+    } else if (g_str_has_suffix(filename, ".xml") ||
+               g_str_has_suffix(filename, ".zdict"))
     {
         return CR_CW_NO_COMPRESSION;
     }
@@ -156,6 +345,11 @@ cr_detect_compression(const char *filename, GError **err)
 
     // No success? Let's get hardcore... (Use magic bytes)
 
+    if (cr_has_magic(filename, ZSTD_MAGIC, ZSTD_MAGIC_LEN))
+        return CR_CW_ZSTD_COMPRESSION;
+    if (cr_has_magic(filename, ZCK_MAGIC, ZCK_MAGIC_LEN))
+        return CR_CW_ZCK_COMPRESSION;
+
     magic_t myt = magic_open(MAGIC_MIME);
     if (myt == NULL) {
         g_set_error(err, ERR_DOMAIN, CRE_MAGIC,
@@ -201,6 +395,12 @@ cr_detect_compression(const char *filename, GError **err)
             type = CR_CW_XZ_COMPRESSION;
         }
 
+        else if (g_str_has_prefix(mime_type, "application/zstd") ||
+                 g_str_has_prefix(mime_type, "application/x-zstd"))
+        {
+            type = CR_CW_ZSTD_COMPRESSION;
+        }
+
         else if (g_str_has_prefix(mime_type, "text/plain") ||
                  g_str_has_prefix(mime_type, "text/xml") ||
                  g_str_has_prefix(mime_type, "application/xml") ||
@@ -248,6 +448,10 @@ cr_compression_type(const char *name)
         type = CR_CW_BZ2_COMPRESSION;
     if (!g_strcmp0(name_lower, "xz"))
         type = CR_CW_XZ_COMPRESSION;
+    if (!g_strcmp0(name_lower, "zst") || !g_strcmp0(name_lower, "zstd"))
+        type = CR_CW_ZSTD_COMPRESSION;
+    if (!g_strcmp0(name_lower, "zck"))
+        type = CR_CW_ZCK_COMPRESSION;
 
     g_free(name_lower);
 
@@ -264,6 +468,10 @@ cr_compression_suffix(cr_CompressionType comtype)
             return ".bz2";
         case CR_CW_XZ_COMPRESSION:
             return ".xz";
+        case CR_CW_ZSTD_COMPRESSION:
+            return ".zst";
+        case CR_CW_ZCK_COMPRESSION:
+            return ".zck";
         default:
             return NULL;
     }
@@ -281,6 +489,189 @@ cr_gz_strerror(gzFile f)
 }
 
 
+/** Encode the content of the open segment as a single xz block.
+ * Sizes are stored in the block header, so the block can be later
+ * appended to another stream by cr_write_segment() and decoded
+ * in parallel by the multithreaded decoder.
+ */
+static int
+cr_xz_encode_segment(XzFile *xz_file, GError **err)
+{
+    GByteArray *segment = xz_file->segment;
+    lzma_options_lzma opt;
+    lzma_filter filters[2];
+    lzma_block block;
+    uint8_t *out;
+    size_t out_size, out_pos = 0;
+    lzma_ret rc;
+    int ret = CRE_OK;
+
+    if (!segment->len)
+        return CRE_OK;
+
+    lzma_lzma_preset(&opt, CR_CW_XZ_COMPRESSION_LEVEL);
+    // Dictionary bigger than the block would be just a waste of memory
+    if (opt.dict_size > segment->len)
+        opt.dict_size = MAX(segment->len, LZMA_DICT_SIZE_MIN);
+
+    filters[0].id = LZMA_FILTER_LZMA2;
+    filters[0].options = &opt;
+    filters[1].id = LZMA_VLI_UNKNOWN;
+    filters[1].options = NULL;
+
+    memset(&block, 0, sizeof(block));
+    block.version = 0;
+    block.check = XZ_CHECK;
+    block.filters = filters;
+
+    out_size = lzma_block_buffer_bound(segment->len);
+    out = g_malloc(out_size);
+
+    rc = lzma_block_buffer_encode(&block, NULL, segment->data, segment->len,
+                                  out, &out_pos, out_size);
+    if (rc == LZMA_OK)
+        rc = lzma_index_append(xz_file->index, NULL,
+                               lzma_block_unpadded_size(&block),
+                               block.uncompressed_size);
+    if (rc != LZMA_OK) {
+        ret = CRE_XZ;
+        g_set_error(err, ERR_DOMAIN, CRE_XZ,
+                    "XZ: Cannot encode a block (%d)", rc);
+    } else if (fwrite(out, 1, out_pos, xz_file->file) != out_pos) {
+        ret = CRE_XZ;
+        g_set_error(err, ERR_DOMAIN, CRE_XZ,
+                    "XZ: fwrite(): %s", g_strerror(errno));
+    }
+
+    g_free(out);
+    g_byte_array_set_size(segment, 0);
+
+    return ret;
+}
+
+/** Add blocks of an already compressed segment into the index
+ * of the stream. All blocks must have their sizes in headers.
+ */
+static int
+cr_xz_index_segment(XzFile *xz_file,
+                    const uint8_t *segment,
+                    size_t len,
+                    GError **err)
+{
+    size_t pos = 0;
+
+    while (pos < len) {
+        lzma_filter filters[LZMA_FILTERS_MAX + 1];
+        lzma_block block;
+        lzma_vli total = 0;
+        lzma_ret rc = LZMA_DATA_ERROR;
+
+        memset(&block, 0, sizeof(block));
+        block.version = 0;
+        block.check = XZ_CHECK;
+        block.filters = filters;
+        block.header_size = lzma_block_header_size_decode(segment[pos]);
+
+        // Zero byte is the index indicator, not a block
+        if (segment[pos] != 0x00 && pos + block.header_size <= len)
+            rc = lzma_block_header_decode(&block, NULL, segment + pos);
+
+        if (rc == LZMA_OK) {
+            for (int x = 0; filters[x].id != LZMA_VLI_UNKNOWN; x++)
+                free(filters[x].options);
+
+            total = lzma_block_total_size(&block);
+            if (block.uncompressed_size == LZMA_VLI_UNKNOWN
+                || total == 0 || pos + total > len)
+                rc = LZMA_DATA_ERROR;
+        }
+
+        if (rc == LZMA_OK)
+            rc = lzma_index_append(xz_file->index, NULL,
+                                   lzma_block_unpadded_size(&block),
+                                   block.uncompressed_size);
+
+        if (rc != LZMA_OK) {
+            g_set_error(err, ERR_DOMAIN, CRE_XZ,
+                        "XZ: Segment is not a sequence of blocks "
+                        "with known sizes (%d)", rc);
+            return CRE_XZ;
+        }
+
+        pos += total;
+    }
+
+    return CRE_OK;
+}
+
+/** Write the index and the footer of a segmented stream.
+ */
+static int
+cr_xz_write_index(XzFile *xz_file, GError **err)
+{
+    lzma_stream_flags flags = { .version = 0, .check = XZ_CHECK };
+    size_t size = lzma_index_size(xz_file->index);
+    size_t pos = 0;
+    uint8_t *buf = g_malloc(size + LZMA_STREAM_HEADER_SIZE);
+    int ret = CRE_OK;
+
+    flags.backward_size = size;
+
+    if (lzma_index_buffer_encode(xz_file->index, buf, &pos, size) != LZMA_OK
+        || lzma_stream_footer_encode(&flags, buf + pos) != LZMA_OK)
+    {
+        ret = CRE_XZ;
+        g_set_error(err, ERR_DOMAIN, CRE_XZ,
+                    "XZ: Cannot encode the stream index");
+    } else if (fwrite(buf, 1, size + LZMA_STREAM_HEADER_SIZE, xz_file->file)
+               != size + LZMA_STREAM_HEADER_SIZE)
+    {
+        ret = CRE_XZ;
+        g_set_error(err, ERR_DOMAIN, CRE_XZ,
+                    "XZ: fwrite(): %s", g_strerror(errno));
+    }
+
+    g_free(buf);
+
+    return ret;
+}
+
+#ifdef WITH_ZSTD
+/** Finish the current frame and write out rest of buffers.
+ */
+static int
+cr_zstd_end_frame(ZstdFile *zstd_file, GError **err)
+{
+    ZSTD_inBuffer in = { NULL, 0, 0 };
+    size_t remaining;
+
+    do {
+        ZSTD_outBuffer out = { zstd_file->buffer,
+                               zstd_file->buffer_size, 0 };
+
+        remaining = ZSTD_compressStream2(zstd_file->cctx,
+                                         &out, &in, ZSTD_e_end);
+        if (ZSTD_isError(remaining)) {
+            g_set_error(err, ERR_DOMAIN, CRE_ZSTD,
+                        "ZSTD: ZSTD_compressStream2() error: %s",
+                        ZSTD_getErrorName(remaining));
+            return CRE_ZSTD;
+        }
+
+        if (fwrite(zstd_file->buffer, 1, out.pos,
+                   zstd_file->file) != out.pos) {
+            g_set_error(err, ERR_DOMAIN, CRE_ZSTD,
+                        "ZSTD: fwrite() error: %s",
+                        g_strerror(errno));
+            return CRE_ZSTD;
+        }
+    } while (remaining);
+
+    return CRE_OK;
+}
+#endif
+
+
 CR_FILE *
 cr_sopen(const char *filename,
          cr_OpenMode mode,
@@ -360,11 +751,36 @@ cr_sopen(const char *filename,
             break;
 
         case (CR_CW_GZ_COMPRESSION): // ---------------------------------------
-            file->FILE = (void *) gzopen(filename, mode_str);
-            if (!file->FILE) {
-                g_set_error(err, ERR_DOMAIN, CRE_GZ,
-                            "gzopen(): %s", g_strerror(errno));
-                break;
+            if (mode == CR_CW_MODE_WRITE) {
+                // Keep the underlying file, compressed segments
+                // are appended directly into it (see cr_write_segment())
+                FILE *f = fopen(filename, mode_str);
+                if (!f) {
+                    g_set_error(err, ERR_DOMAIN, CRE_GZ,
+                                "fopen(): %s", g_strerror(errno));
+                    break;
+                }
+
+                int fd = dup(fileno(f));
+                if (fd != -1)
+                    file->FILE = (void *) gzdopen(fd, mode_str);
+                if (!file->FILE) {
+                    g_set_error(err, ERR_DOMAIN, CRE_GZ,
+                                "gzdopen(): %s", g_strerror(errno));
+                    if (fd != -1)
+                        close(fd);
+                    fclose(f);
+                    break;
+                }
+
+                file->INNERFILE = f;
+            } else {
+                file->FILE = (void *) gzopen(filename, mode_str);
+                if (!file->FILE) {
+                    g_set_error(err, ERR_DOMAIN, CRE_GZ,
+                                "gzopen(): %s", g_strerror(errno));
+                    break;
+                }
             }
 
             if (mode == CR_CW_MODE_WRITE)
@@ -372,7 +788,10 @@ cr_sopen(const char *filename,
                             CR_CW_GZ_COMPRESSION_LEVEL,
                             GZ_STRATEGY);
 
-            if (gzbuffer((gzFile) file->FILE, GZ_BUFFER_SIZE) == -1) {
+            // Inflate is much faster with bigger chunks of input
+            if (gzbuffer((gzFile) file->FILE,
+                         (mode == CR_CW_MODE_READ) ? read_buffer_size
+                                                   : GZ_BUFFER_SIZE) == -1) {
                 g_debug("%s: gzbuffer() call failed", __func__);
                 g_set_error(err, ERR_DOMAIN, CRE_GZ,
                             "gzbuffer() call failed");
@@ -390,6 +809,9 @@ cr_sopen(const char *filename,
                 break;
             }
 
+            if (mode == CR_CW_MODE_READ)
+                setvbuf(f, NULL, _IOFBF, read_buffer_size);
+
             if (mode == CR_CW_MODE_WRITE) {
                 file->FILE = (void *) BZ2_bzWriteOpen(&bzerror,
                                                       f,
@@ -435,7 +857,7 @@ cr_sopen(const char *filename,
 
         case (CR_CW_XZ_COMPRESSION): { // -------------------------------------
             int ret;
-            XzFile *xz_file = g_malloc(sizeof(XzFile));
+            XzFile *xz_file = g_malloc0(sizeof(XzFile));
             lzma_stream *stream = &(xz_file->stream);
             memset(stream, 0, sizeof(lzma_stream));
             /* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ XXX: This part
@@ -502,9 +924,30 @@ cr_sopen(const char *filename,
                                             XZ_CHECK);
 
             } else {
-                ret = lzma_auto_decoder(stream,
-                                        XZ_MEMORY_USAGE_LIMIT,
-                                        XZ_DECODER_FLAGS);
+#ifdef WITH_XZ_MT_DECODER
+                uint32_t threads = xz_decoder_threads;
+                if (!threads) {
+                    threads = lzma_cputhreads();
+                    if (threads > XZ_DECODER_THREADS_MAX)
+                        threads = XZ_DECODER_THREADS_MAX;
+                }
+
+                if (threads > 1) {
+                    lzma_mt mt = {
+                        .flags = XZ_DECODER_FLAGS,
+                        .threads = threads,
+                        .timeout = 0,
+                        // Above this limit the decoder falls back
+                        // to a single thread
+                        .memlimit_threading = lzma_physmem() / 4,
+                        .memlimit_stop = XZ_MEMORY_USAGE_LIMIT,
+                    };
+                    ret = lzma_stream_decoder_mt(stream, &mt);
+                } else
+#endif
+                    ret = lzma_auto_decoder(stream,
+                                            XZ_MEMORY_USAGE_LIMIT,
+                                            XZ_DECODER_FLAGS);
             }
 
             if (ret != LZMA_OK) {
@@ -547,10 +990,151 @@ cr_sopen(const char *filename,
             }
 
             xz_file->file = f;
+            xz_file->buffer_size = (mode == CR_CW_MODE_READ) ? read_buffer_size
+                                                             : XZ_BUFFER_SIZE;
+            xz_file->buffer = g_malloc(xz_file->buffer_size);
             file->FILE = (void *) xz_file;
             break;
         }
 
+        case (CR_CW_ZSTD_COMPRESSION): { // -----------------------------------
+#ifdef WITH_ZSTD
+            size_t rc = 0;
+            ZstdFile *zstd_file = g_malloc0(sizeof(ZstdFile));
+
+            // Prepare compression/decompression context
+
+            if (mode == CR_CW_MODE_WRITE) {
+                zstd_file->cctx = ZSTD_createCCtx();
+                if (!zstd_file->cctx) {
+                    g_set_error(err, ERR_DOMAIN, CRE_ZSTD,
+                                "ZSTD_createCCtx(): Cannot allocate memory");
+                    g_free(zstd_file);
+                    break;
+                }
+
+                rc = ZSTD_CCtx_setParameter(zstd_file->cctx,
+                                            ZSTD_c_compressionLevel,
+                                            zstd_level);
+                if (!ZSTD_isError(rc))
+                    rc = ZSTD_CCtx_setParameter(zstd_file->cctx,
+                                                ZSTD_c_checksumFlag, 1);
+                if (!ZSTD_isError(rc) && zstd_long_mode)
+                    rc = ZSTD_CCtx_setParameter(zstd_file->cctx,
+                                        ZSTD_c_enableLongDistanceMatching, 1);
+
+                if (!ZSTD_isError(rc) && zstd_workers > 0) {
+                    // libzstd may be built without multithreading support,
+                    // in such case just compress in this thread
+                    size_t wrc = ZSTD_CCtx_setParameter(zstd_file->cctx,
+                                                        ZSTD_c_nbWorkers,
+                                                        zstd_workers);
+                    if (ZSTD_isError(wrc))
+                        g_debug("%s: ZSTD: Cannot use %d workers: %s",
+                                __func__, zstd_workers,
+                                ZSTD_getErrorName(wrc));
+                }
+
+                zstd_file->buffer_size = ZSTD_CStreamOutSize();
+            } else {
+                zstd_file->dctx = ZSTD_createDCtx();
+                if (!zstd_file->dctx) {
+                    g_set_error(err, ERR_DOMAIN, CRE_ZSTD,
+                                "ZSTD_createDCtx(): Cannot allocate memory");
+                    g_free(zstd_file);
+                    break;
+                }
+
+                zstd_file->buffer_size = MAX(ZSTD_DStreamInSize(),
+                                             read_buffer_size);
+            }
+
+            if (ZSTD_isError(rc)) {
+                g_set_error(err, ERR_DOMAIN, CRE_ZSTD,
+                            "ZSTD: Cannot set compression parameters: %s",
+                            ZSTD_getErrorName(rc));
+                ZSTD_freeCCtx(zstd_file->cctx);
+                g_free(zstd_file);
+                break;
+            }
+
+            // Open input/output file
+
+            FILE *f = fopen(filename, mode_str);
+            if (!f) {
+                g_set_error(err, ERR_DOMAIN, CRE_ZSTD,
+                            "fopen(): %s", g_strerror(errno));
+                ZSTD_freeCCtx(zstd_file->cctx);
+                ZSTD_freeDCtx(zstd_file->dctx);
+                g_free(zstd_file);
+                break;
+            }
+
+            zstd_file->buffer = g_malloc(zstd_file->buffer_size);
+            zstd_file->file = f;
+            file->FILE = (void *) zstd_file;
+#else
+            g_set_error(err, ERR_DOMAIN, CRE_ZSTD,
+                        "createrepo_c was built without Zstandard support");
+#endif
+            break;
+        }
+
+        case (CR_CW_ZCK_COMPRESSION): { // ------------------------------------
+#ifdef WITH_ZCHUNK
+            int fd;
+            gboolean ok;
+            ZckFile *zck_file;
+
+            if (mode == CR_CW_MODE_WRITE)
+                fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+            else
+                fd = open(filename, O_RDONLY);
+
+            if (fd < 0) {
+                g_set_error(err, ERR_DOMAIN, CRE_IO,
+                            "open(): %s", g_strerror(errno));
+                break;
+            }
+
+            zckCtx *zck = zck_create();
+            if (!zck) {
+                g_set_error(err, ERR_DOMAIN, CRE_ZCK,
+                            "zck_create(): Cannot allocate memory");
+                close(fd);
+                break;
+            }
+
+            if (mode == CR_CW_MODE_WRITE) {
+                // Chunks are ended explicitly by cr_end_chunk()
+                // (e.g. on package boundaries in cr_XmlFile)
+                ok = zck_init_write(zck, fd)
+                     && zck_set_ioption(zck, ZCK_MANUAL_CHUNK, 1)
+                     && zck_set_ioption(zck, ZCK_ZSTD_COMP_LEVEL, zstd_level);
+            } else {
+                ok = zck_init_read(zck, fd);
+            }
+
+            if (!ok) {
+                g_set_error(err, ERR_DOMAIN, CRE_ZCK,
+                            "Cannot initialize zchunk file: %s",
+                            zck_get_error(zck));
+                zck_free(&zck);
+                close(fd);
+                break;
+            }
+
+            zck_file = g_malloc0(sizeof(ZckFile));
+            zck_file->zck = zck;
+            zck_file->fd = fd;
+            file->FILE = (void *) zck_file;
+#else
+            g_set_error(err, ERR_DOMAIN, CRE_ZCK,
+                        "createrepo_c was built without zchunk support");
+#endif
+            break;
+        }
+
         default: // -----------------------------------------------------------
             break;
     }
@@ -580,6 +1164,14 @@ cr_sopen(const char *filename,
         }
     }
 
+    // Decoding of compressed files runs in its own thread
+    if (mode == CR_CW_MODE_READ && threaded_read
+        && (type == CR_CW_GZ_COMPRESSION
+            || type == CR_CW_BZ2_COMPRESSION
+            || type == CR_CW_XZ_COMPRESSION
+            || type == CR_CW_ZSTD_COMPRESSION))
+        file->reader = cr_reader_new();
+
     assert(!err || (!file && *err != NULL) || (file && *err == NULL));
 
     return file;
@@ -598,6 +1190,12 @@ cr_close(CR_FILE *cr_file, GError **err)
     if (!cr_file)
         return CRE_OK;
 
+    // Decoding thread must not touch the file anymore
+    cr_reader_free(cr_file->reader);
+
+    // Variants are finished by their threads while the file is closed
+    cr_tee_finish(cr_file->tee);
+
     switch (cr_file->type) {
 
         case (CR_CW_NO_COMPRESSION): // ---------------------------------------
@@ -612,6 +1210,8 @@ cr_close(CR_FILE *cr_file, GError **err)
 
         case (CR_CW_GZ_COMPRESSION): // ---------------------------------------
             rc = gzclose((gzFile) cr_file->FILE);
+            if (cr_file->INNERFILE)
+                fclose(cr_file->INNERFILE);
             if (rc == Z_OK)
                 ret = CRE_OK;
             else {
@@ -675,11 +1275,16 @@ cr_close(CR_FILE *cr_file, GError **err)
             XzFile *xz_file = (XzFile *) cr_file->FILE;
             lzma_stream *stream = &(xz_file->stream);
 
-            if (cr_file->mode == CR_CW_MODE_WRITE) {
+            if (cr_file->mode == CR_CW_MODE_WRITE && xz_file->index) {
+                // Segmented - encode the last block and finish the stream
+                ret = cr_xz_encode_segment(xz_file, err);
+                if (ret == CRE_OK)
+                    ret = cr_xz_write_index(xz_file, err);
+            } else if (cr_file->mode == CR_CW_MODE_WRITE) {
                 // Write out rest of buffer
                 while (1) {
                     stream->next_out = (uint8_t*) xz_file->buffer;
-                    stream->avail_out = XZ_BUFFER_SIZE;
+                    stream->avail_out = xz_file->buffer_size;
 
                     rc = lzma_code(stream, LZMA_FINISH);
 
@@ -719,7 +1324,7 @@ cr_close(CR_FILE *cr_file, GError **err)
                         break;
                     }
 
-                    size_t olen = XZ_BUFFER_SIZE - stream->avail_out;
+                    size_t olen = xz_file->buffer_size - stream->avail_out;
                     if (fwrite(xz_file->buffer, 1, olen, xz_file->file) != olen) {
                         // Error while writing
                         ret = CRE_XZ;
@@ -740,9 +1345,65 @@ cr_close(CR_FILE *cr_file, GError **err)
 
             fclose(xz_file->file);
             lzma_end(stream);
-            g_free(stream);
+            if (xz_file->index)
+                lzma_index_end(xz_file->index, NULL);
+            if (xz_file->segment)
+                g_byte_array_free(xz_file->segment, TRUE);
+            g_free(xz_file->buffer);
+            g_free(xz_file);
+            break;
+        }
+
+#ifdef WITH_ZSTD
+        case (CR_CW_ZSTD_COMPRESSION): { // -----------------------------------
+            ZstdFile *zstd_file = (ZstdFile *) cr_file->FILE;
+            ret = CRE_OK;
+
+            // A segmented file may end with an already finished frame,
+            // finishing it again would append an empty frame
+            if (cr_file->mode == CR_CW_MODE_WRITE
+                && (!cr_file->segmented || cr_file->segment_size
+                    || ftell(zstd_file->file) == 0))
+                ret = cr_zstd_end_frame(zstd_file, err);
+
+            if (fclose(zstd_file->file) && ret == CRE_OK) {
+                ret = CRE_ZSTD;
+                g_set_error(err, ERR_DOMAIN, CRE_ZSTD,
+                            "ZSTD: fclose() error: %s", g_strerror(errno));
+            }
+
+            ZSTD_freeCCtx(zstd_file->cctx);
+            ZSTD_freeDCtx(zstd_file->dctx);
+            g_free(zstd_file->buffer);
+            g_free(zstd_file);
+            break;
+        }
+#endif
+
+#ifdef WITH_ZCHUNK
+        case (CR_CW_ZCK_COMPRESSION): { // ------------------------------------
+            ZckFile *zck_file = (ZckFile *) cr_file->FILE;
+            ret = CRE_OK;
+
+            // In write mode this writes out the header with the index
+            if (!zck_close(zck_file->zck)) {
+                ret = CRE_ZCK;
+                g_set_error(err, ERR_DOMAIN, CRE_ZCK,
+                            "ZCK: zck_close() error: %s",
+                            zck_get_error(zck_file->zck));
+            }
+
+            if (close(zck_file->fd) && ret == CRE_OK) {
+                ret = CRE_IO;
+                g_set_error(err, ERR_DOMAIN, CRE_IO,
+                            "ZCK: close() error: %s", g_strerror(errno));
+            }
+
+            zck_free(&(zck_file->zck));
+            g_free(zck_file);
             break;
         }
+#endif
 
         default: // -----------------------------------------------------------
             ret = CRE_BADARG;
@@ -760,6 +1421,17 @@ cr_close(CR_FILE *cr_file, GError **err)
             cr_file->stat->checksum = NULL;
     }
 
+    if (cr_file->tee) {
+        GError *tmp_err = NULL;
+        int tee_ret = cr_tee_free(cr_file->tee, &tmp_err);
+        if (tmp_err && ret == CRE_OK) {
+            ret = tee_ret;
+            g_propagate_error(err, tmp_err);
+        } else if (tmp_err) {
+            g_error_free(tmp_err);
+        }
+    }
+
     g_free(cr_file);
 
     assert(!err || (ret != CRE_OK && *err != NULL)
@@ -770,22 +1442,14 @@ cr_close(CR_FILE *cr_file, GError **err)
 
 
 
-int
-cr_read(CR_FILE *cr_file, void *buffer, unsigned int len, GError **err)
+/** Read and decode data of the file in the calling thread.
+ */
+static int
+cr_read_raw(CR_FILE *cr_file, void *buffer, unsigned int len, GError **err)
 {
     int bzerror;
     int ret;
 
-    assert(cr_file);
-    assert(buffer);
-    assert(!err || *err == NULL);
-
-    if (cr_file->mode != CR_CW_MODE_READ) {
-        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
-                    "File is not opened in read mode");
-        return CR_CW_ERR;
-    }
-
     switch (cr_file->type) {
 
         case (CR_CW_NO_COMPRESSION): // ---------------------------------------
@@ -865,7 +1529,7 @@ cr_read(CR_FILE *cr_file, void *buffer, unsigned int len, GError **err)
 
                 // Fill input buffer
                 if (stream->avail_in == 0) {
-                    if ((lret = fread(xz_file->buffer, 1, XZ_BUFFER_SIZE, xz_file->file)) < 0) {
+                    if ((lret = fread(xz_file->buffer, 1, xz_file->buffer_size, xz_file->file)) < 0) {
                         g_debug("%s: XZ: Error while fread", __func__);
                         g_set_error(err, ERR_DOMAIN, CRE_XZ,
                                     "XZ: fread(): %s", g_strerror(errno));
@@ -944,6 +1608,93 @@ cr_read(CR_FILE *cr_file, void *buffer, unsigned int len, GError **err)
             break;
         }
 
+#ifdef WITH_ZSTD
+        case (CR_CW_ZSTD_COMPRESSION): { // -----------------------------------
+            ZstdFile *zstd_file = (ZstdFile *) cr_file->FILE;
+            ZSTD_outBuffer out = { buffer, len, 0 };
+
+            while (out.pos < out.size) {
+                size_t rc;
+
+                // Fill input buffer
+                if (zstd_file->in.pos == zstd_file->in.size
+                    && !zstd_file->flush)
+                {
+                    size_t rlen = fread(zstd_file->buffer, 1,
+                                        zstd_file->buffer_size,
+                                        zstd_file->file);
+                    if (rlen == 0) {
+                        if (ferror(zstd_file->file)) {
+                            g_set_error(err, ERR_DOMAIN, CRE_ZSTD,
+                                        "ZSTD: fread(): %s",
+                                        g_strerror(errno));
+                            return CR_CW_ERR;
+                        }
+                        if (!zstd_file->frame_end && ftell(zstd_file->file)) {
+                            g_set_error(err, ERR_DOMAIN, CRE_ZSTD,
+                                        "ZSTD: Compressed file is truncated");
+                            return CR_CW_ERR;
+                        }
+                        break;   // EOF
+                    }
+                    zstd_file->in.src = zstd_file->buffer;
+                    zstd_file->in.size = rlen;
+                    zstd_file->in.pos = 0;
+                }
+
+                // Decode (concatenated frames are decoded one by one)
+                size_t in_pos = zstd_file->in.pos;
+                rc = ZSTD_decompressStream(zstd_file->dctx,
+                                           &out, &(zstd_file->in));
+                if (ZSTD_isError(rc)) {
+                    g_debug("%s: ZSTD: Error while decoding: %s",
+                            __func__, ZSTD_getErrorName(rc));
+                    g_set_error(err, ERR_DOMAIN, CRE_ZSTD,
+                                "ZSTD: Error while decoding: %s",
+                                ZSTD_getErrorName(rc));
+                    return CR_CW_ERR;
+                }
+
+                // Full output buffer means there may be more data
+                // buffered in the decoder even without a new input
+                zstd_file->flush = (out.pos == out.size);
+                if (rc == 0)
+                    zstd_file->frame_end = TRUE;
+                else if (zstd_file->in.pos != in_pos)
+                    zstd_file->frame_end = FALSE;   // Next frame started
+            }
+
+            ret = out.pos;
+            break;
+        }
+#endif
+
+#ifdef WITH_ZCHUNK
+        case (CR_CW_ZCK_COMPRESSION): { // ------------------------------------
+            ZckFile *zck_file = (ZckFile *) cr_file->FILE;
+            unsigned int done = 0;
+
+            // Callers expect a short read only at the end of the file
+            while (done < len) {
+                ssize_t rc = zck_read(zck_file->zck,
+                                      (char *) buffer + done,
+                                      len - done);
+                if (rc < 0) {
+                    g_set_error(err, ERR_DOMAIN, CRE_ZCK,
+                                "ZCK: Error while decoding: %s",
+                                zck_get_error(zck_file->zck));
+                    return CR_CW_ERR;
+                }
+                if (rc == 0)
+                    break;   // EOF
+                done += rc;
+            }
+
+            ret = done;
+            break;
+        }
+#endif
+
         default: // -----------------------------------------------------------
             ret = CR_CW_ERR;
             g_set_error(err, ERR_DOMAIN, CRE_BADARG,
@@ -954,24 +1705,367 @@ cr_read(CR_FILE *cr_file, void *buffer, unsigned int len, GError **err)
     assert(!err || (ret == CR_CW_ERR && *err != NULL)
            || (ret != CR_CW_ERR && *err == NULL));
 
-    if (cr_file->stat && ret != CR_CW_ERR) {
-        cr_file->stat->size += ret;
-        if (cr_file->checksum_ctx) {
-            GError *tmp_err = NULL;
-            cr_checksum_update(cr_file->checksum_ctx, buffer, ret, &tmp_err);
-            if (tmp_err) {
-                g_propagate_error(err, tmp_err);
-                return CR_CW_ERR;
-            }
+    return ret;
+}
+
+static gpointer
+cr_reader_thread(gpointer data)
+{
+    CR_FILE *cr_file = data;
+    CrReader *reader = cr_file->reader;
+    int x = 0;
+
+    while (1) {
+        int ret;
+        GError *tmp_err = NULL;
+
+        g_mutex_lock(reader->mutex);
+        while (reader->len[x] != -1 && !reader->stop)
+            g_cond_wait(reader->cond, reader->mutex);
+        if (reader->stop) {
+            g_mutex_unlock(reader->mutex);
+            break;
         }
+        g_mutex_unlock(reader->mutex);
+
+        ret = cr_read_raw(cr_file, reader->buf[x], reader->size, &tmp_err);
+
+        g_mutex_lock(reader->mutex);
+        if (ret == CR_CW_ERR) {
+            reader->err = tmp_err;
+            ret = 0;
+        }
+        reader->len[x] = ret;
+        g_cond_signal(reader->cond);
+        g_mutex_unlock(reader->mutex);
+
+        if (ret == 0)
+            break;  // EOF or error
+
+        x ^= 1;
     }
 
-    return ret;
+    return NULL;
 }
 
+static CrReader *
+cr_reader_new(void)
+{
+    CrReader *reader = g_malloc0(sizeof(CrReader));
 
+    reader->mutex = g_mutex_new();
+    reader->cond = g_cond_new();
+    reader->size = read_buffer_size;
+    reader->buf[0] = g_malloc(reader->size);
+    reader->buf[1] = g_malloc(reader->size);
+    reader->len[0] = -1;
+    reader->len[1] = -1;
 
-int
+    return reader;
+}
+
+/** Stop the decoding thread and free the reader.
+ */
+static void
+cr_reader_free(CrReader *reader)
+{
+    if (!reader)
+        return;
+
+    if (reader->thread) {
+        g_mutex_lock(reader->mutex);
+        reader->stop = TRUE;
+        g_cond_signal(reader->cond);
+        g_mutex_unlock(reader->mutex);
+        g_thread_join(reader->thread);
+    }
+
+    if (reader->err)
+        g_error_free(reader->err);
+    g_mutex_free(reader->mutex);
+    g_cond_free(reader->cond);
+    g_free(reader->buf[0]);
+    g_free(reader->buf[1]);
+    g_free(reader);
+}
+
+/** Copy decoded data out of the double buffer. The decoding thread
+ * is started by the first call, so the decoder can still be set up
+ * (e.g. cr_set_dict()) after the file is opened.
+ */
+static int
+cr_reader_read(CR_FILE *cr_file, void *buffer, unsigned int len, GError **err)
+{
+    CrReader *reader = cr_file->reader;
+    unsigned int done = 0;
+
+    if (!reader->thread) {
+        GError *tmp_err = NULL;
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+        reader->thread = g_thread_try_new("cr_read", cr_reader_thread,
+                                          cr_file, &tmp_err);
+#else
+        reader->thread = g_thread_create(cr_reader_thread, cr_file,
+                                         TRUE, &tmp_err);
+#endif
+        if (!reader->thread) {
+            g_propagate_prefixed_error(err, tmp_err,
+                                       "Cannot start decoding thread: ");
+            return CR_CW_ERR;
+        }
+    }
+
+    while (done < len) {
+        int avail;
+
+        g_mutex_lock(reader->mutex);
+        while (reader->len[reader->cur] == -1)
+            g_cond_wait(reader->cond, reader->mutex);
+        avail = reader->len[reader->cur];
+        g_mutex_unlock(reader->mutex);
+
+        if (avail == 0) {
+            // The buffer stays full, so all following reads end here too
+            if (reader->err) {
+                g_propagate_error(err, g_error_copy(reader->err));
+                return CR_CW_ERR;
+            }
+            break;  // EOF
+        }
+
+        unsigned int chunk = MIN((unsigned int) (avail - reader->pos),
+                                 len - done);
+        memcpy((char *) buffer + done,
+               reader->buf[reader->cur] + reader->pos,
+               chunk);
+        reader->pos += chunk;
+        done += chunk;
+
+        if (reader->pos == avail) {
+            // Hand the buffer back to the decoding thread
+            g_mutex_lock(reader->mutex);
+            reader->len[reader->cur] = -1;
+            g_cond_signal(reader->cond);
+            g_mutex_unlock(reader->mutex);
+            reader->cur ^= 1;
+            reader->pos = 0;
+        }
+    }
+
+    return done;
+}
+
+static void
+cr_tee_block_unref(CrTeeBlock *block)
+{
+    if (g_atomic_int_dec_and_test(&block->refs))
+        g_free(block);
+}
+
+/** Write queued blocks into the variant and close it when
+ * the file is closed.
+ */
+static gpointer
+cr_tee_thread(gpointer data)
+{
+    CrTeeVariant *variant = data;
+    gboolean failed = FALSE;
+    GError *tmp_err = NULL;
+
+    while (1) {
+        CrTeeBlock *block;
+
+        g_mutex_lock(variant->mutex);
+        while (g_queue_get_length(variant->queue) == 0 && !variant->finish)
+            g_cond_wait(variant->cond, variant->mutex);
+        block = g_queue_pop_head(variant->queue);
+        g_cond_signal(variant->cond);   // Writer may wait for a free slot
+        g_mutex_unlock(variant->mutex);
+
+        if (!block)
+            break;  // Finished and empty
+
+        // After an error the queue is just drained
+        if (!failed
+            && cr_write(variant->file, block->data, block->len,
+                        &tmp_err) == CR_CW_ERR)
+        {
+            failed = TRUE;
+            g_mutex_lock(variant->mutex);
+            variant->err = tmp_err;
+            g_cond_signal(variant->cond);
+            g_mutex_unlock(variant->mutex);
+            tmp_err = NULL;
+        }
+
+        cr_tee_block_unref(block);
+    }
+
+    cr_close(variant->file, &tmp_err);
+    variant->file = NULL;
+
+    g_mutex_lock(variant->mutex);
+    if (tmp_err && !variant->err)
+        variant->err = tmp_err;
+    else if (tmp_err)
+        g_error_free(tmp_err);
+    g_mutex_unlock(variant->mutex);
+
+    return NULL;
+}
+
+/** Pass pending data to all variants.
+ */
+static int
+cr_tee_dispatch(CrTee *tee, GError **err)
+{
+    CrTeeBlock *block;
+    int ret = CRE_OK;
+
+    if (!tee->pending->len)
+        return CRE_OK;
+
+    block = g_malloc(sizeof(CrTeeBlock) + tee->pending->len);
+    block->refs = tee->variants->len;
+    block->len = tee->pending->len;
+    memcpy(block->data, tee->pending->data, tee->pending->len);
+    g_byte_array_set_size(tee->pending, 0);
+
+    for (guint x = 0; x < tee->variants->len; x++) {
+        CrTeeVariant *variant = g_ptr_array_index(tee->variants, x);
+
+        g_mutex_lock(variant->mutex);
+        while (g_queue_get_length(variant->queue) >= TEE_MAX_BLOCKS
+               && !variant->err)
+            g_cond_wait(variant->cond, variant->mutex);
+
+        if (variant->err) {
+            if (ret == CRE_OK) {
+                ret = variant->err->code;
+                g_propagate_prefixed_error(err, g_error_copy(variant->err),
+                                           "Cannot write a variant: ");
+            }
+            g_mutex_unlock(variant->mutex);
+            cr_tee_block_unref(block);
+            continue;
+        }
+
+        g_queue_push_tail(variant->queue, block);
+        g_cond_signal(variant->cond);
+        g_mutex_unlock(variant->mutex);
+    }
+
+    return ret;
+}
+
+static int
+cr_tee_write(CrTee *tee, const void *buf, size_t len, GError **err)
+{
+    g_byte_array_append(tee->pending, buf, len);
+    if (tee->pending->len < TEE_BLOCK_SIZE)
+        return CRE_OK;
+    return cr_tee_dispatch(tee, err);
+}
+
+/** Pass the rest of data to the variants and let their threads
+ * close them. Errors are reported by cr_tee_free().
+ */
+static void
+cr_tee_finish(CrTee *tee)
+{
+    if (!tee)
+        return;
+
+    cr_tee_dispatch(tee, NULL);
+
+    for (guint x = 0; x < tee->variants->len; x++) {
+        CrTeeVariant *variant = g_ptr_array_index(tee->variants, x);
+        g_mutex_lock(variant->mutex);
+        variant->finish = TRUE;
+        g_cond_signal(variant->cond);
+        g_mutex_unlock(variant->mutex);
+    }
+}
+
+/** Wait for the variant threads and free the tee.
+ * The first error of the variants is returned.
+ */
+static int
+cr_tee_free(CrTee *tee, GError **err)
+{
+    int ret = CRE_OK;
+
+    if (!tee)
+        return CRE_OK;
+
+    for (guint x = 0; x < tee->variants->len; x++) {
+        CrTeeVariant *variant = g_ptr_array_index(tee->variants, x);
+
+        g_thread_join(variant->thread);
+
+        if (variant->err && ret == CRE_OK) {
+            ret = variant->err->code;
+            g_propagate_prefixed_error(err, variant->err,
+                                       "Cannot write a variant: ");
+        } else if (variant->err) {
+            g_error_free(variant->err);
+        }
+
+        g_queue_free(variant->queue);
+        g_mutex_free(variant->mutex);
+        g_cond_free(variant->cond);
+        g_free(variant);
+    }
+
+    g_ptr_array_free(tee->variants, TRUE);
+    g_byte_array_free(tee->pending, TRUE);
+    g_free(tee);
+
+    return ret;
+}
+
+int
+cr_read(CR_FILE *cr_file, void *buffer, unsigned int len, GError **err)
+{
+    int ret;
+
+    assert(cr_file);
+    assert(buffer);
+    assert(!err || *err == NULL);
+
+    if (cr_file->mode != CR_CW_MODE_READ) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "File is not opened in read mode");
+        return CR_CW_ERR;
+    }
+
+    if (cr_file->reader)
+        ret = cr_reader_read(cr_file, buffer, len, err);
+    else
+        ret = cr_read_raw(cr_file, buffer, len, err);
+
+    assert(!err || (ret == CR_CW_ERR && *err != NULL)
+           || (ret != CR_CW_ERR && *err == NULL));
+
+    if (cr_file->stat && ret != CR_CW_ERR) {
+        cr_file->stat->size += ret;
+        if (cr_file->checksum_ctx) {
+            GError *tmp_err = NULL;
+            cr_checksum_update(cr_file->checksum_ctx, buffer, ret, &tmp_err);
+            if (tmp_err) {
+                g_propagate_error(err, tmp_err);
+                return CR_CW_ERR;
+            }
+        }
+    }
+
+    return ret;
+}
+
+
+
+int
 cr_write(CR_FILE *cr_file, const void *buffer, unsigned int len, GError **err)
 {
     int bzerror;
@@ -999,6 +2093,9 @@ cr_write(CR_FILE *cr_file, const void *buffer, unsigned int len, GError **err)
         }
     }
 
+    if (cr_file->segmented)
+        cr_file->segment_size += len;
+
     switch (cr_file->type) {
 
         case (CR_CW_NO_COMPRESSION): // ---------------------------------------
@@ -1056,13 +2153,20 @@ cr_write(CR_FILE *cr_file, const void *buffer, unsigned int len, GError **err)
             lzma_stream *stream = &(xz_file->stream);
 
             ret = len;
+
+            if (xz_file->segment) {
+                // Segmented - the block is encoded when the segment ends
+                g_byte_array_append(xz_file->segment, buffer, len);
+                break;
+            }
+
             stream->next_in = buffer;
             stream->avail_in = len;
 
             while (stream->avail_in) {
                 int lret;
                 stream->next_out = xz_file->buffer;
-                stream->avail_out = XZ_BUFFER_SIZE;
+                stream->avail_out = xz_file->buffer_size;
                 lret = lzma_code(stream, LZMA_RUN);
                 if (lret != LZMA_OK) {
                     const char *err_msg;
@@ -1099,7 +2203,7 @@ cr_write(CR_FILE *cr_file, const void *buffer, unsigned int len, GError **err)
                     break;   // Error while coding
                 }
 
-                size_t out_len = XZ_BUFFER_SIZE - stream->avail_out;
+                size_t out_len = xz_file->buffer_size - stream->avail_out;
                 if ((fwrite(xz_file->buffer, 1, out_len, xz_file->file)) != out_len) {
                     ret = CR_CW_ERR;
                     g_set_error(err, ERR_DOMAIN, CRE_XZ,
@@ -1111,12 +2215,70 @@ cr_write(CR_FILE *cr_file, const void *buffer, unsigned int len, GError **err)
             break;
         }
 
+#ifdef WITH_ZSTD
+        case (CR_CW_ZSTD_COMPRESSION): { // -----------------------------------
+            ZstdFile *zstd_file = (ZstdFile *) cr_file->FILE;
+            ZSTD_inBuffer in = { buffer, len, 0 };
+
+            ret = len;
+
+            while (in.pos < in.size) {
+                ZSTD_outBuffer out = { zstd_file->buffer,
+                                       zstd_file->buffer_size, 0 };
+                size_t rc = ZSTD_compressStream2(zstd_file->cctx,
+                                                 &out, &in, ZSTD_e_continue);
+                if (ZSTD_isError(rc)) {
+                    ret = CR_CW_ERR;
+                    g_set_error(err, ERR_DOMAIN, CRE_ZSTD,
+                                "ZSTD: ZSTD_compressStream2() error: %s",
+                                ZSTD_getErrorName(rc));
+                    break;   // Error while coding
+                }
+
+                if (fwrite(zstd_file->buffer, 1, out.pos,
+                           zstd_file->file) != out.pos) {
+                    ret = CR_CW_ERR;
+                    g_set_error(err, ERR_DOMAIN, CRE_ZSTD,
+                                "ZSTD: fwrite(): %s", g_strerror(errno));
+                    break;   // Error while writing
+                }
+            }
+
+            break;
+        }
+#endif
+
+#ifdef WITH_ZCHUNK
+        case (CR_CW_ZCK_COMPRESSION): { // ------------------------------------
+            ZckFile *zck_file = (ZckFile *) cr_file->FILE;
+
+            if (len == 0) {
+                ret = 0;
+                break;
+            }
+
+            if (zck_write(zck_file->zck, buffer, len) != (ssize_t) len) {
+                g_set_error(err, ERR_DOMAIN, CRE_ZCK,
+                            "ZCK: zck_write() error: %s",
+                            zck_get_error(zck_file->zck));
+                break;
+            }
+
+            ret = len;
+            break;
+        }
+#endif
+
         default: // -----------------------------------------------------------
             g_set_error(err, ERR_DOMAIN, CRE_BADARG,
                         "Bad compressed file type");
             break;
     }
 
+    if (ret != CR_CW_ERR && cr_file->tee && len
+        && cr_tee_write(cr_file->tee, buffer, len, err) != CRE_OK)
+        ret = CR_CW_ERR;
+
     assert(!err || (ret == CR_CW_ERR && *err != NULL)
            || (ret != CR_CW_ERR && *err == NULL));
 
@@ -1149,6 +2311,8 @@ cr_puts(CR_FILE *cr_file, const char *str, GError **err)
         case (CR_CW_GZ_COMPRESSION): // ---------------------------------------
         case (CR_CW_BZ2_COMPRESSION): // --------------------------------------
         case (CR_CW_XZ_COMPRESSION): // ---------------------------------------
+        case (CR_CW_ZSTD_COMPRESSION): // -------------------------------------
+        case (CR_CW_ZCK_COMPRESSION): // --------------------------------------
             len = strlen(str);
             ret = cr_write(cr_file, str, len, err);
             if (ret != (int) len)
@@ -1210,6 +2374,8 @@ cr_printf(GError **err, CR_FILE *cr_file, const char *format, ...)
         case (CR_CW_GZ_COMPRESSION): // ---------------------------------------
         case (CR_CW_BZ2_COMPRESSION): // --------------------------------------
         case (CR_CW_XZ_COMPRESSION): // ---------------------------------------
+        case (CR_CW_ZSTD_COMPRESSION): // -------------------------------------
+        case (CR_CW_ZCK_COMPRESSION): // --------------------------------------
             tmp_ret = cr_write(cr_file, buf, ret, err);
             if (tmp_ret != (int) ret)
                 ret = CR_CW_ERR;
@@ -1229,3 +2395,495 @@ cr_printf(GError **err, CR_FILE *cr_file, const char *format, ...)
 
     return ret;
 }
+
+
+
+int
+cr_set_dict(CR_FILE *cr_file, const void *dict, unsigned int len, GError **err)
+{
+    int ret = CRE_OK;
+
+    assert(cr_file);
+    assert(!err || *err == NULL);
+
+    if (!dict || len == 0)
+        return CRE_OK;
+
+    if (cr_file->reader && ((CrReader *) cr_file->reader)->thread) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "Dictionary must be set before reading");
+        return CRE_BADARG;
+    }
+
+    switch (cr_file->type) {
+
+#ifdef WITH_ZSTD
+        case (CR_CW_ZSTD_COMPRESSION): { // -----------------------------------
+            ZstdFile *zstd_file = (ZstdFile *) cr_file->FILE;
+            size_t rc;
+
+            if (cr_file->mode == CR_CW_MODE_WRITE)
+                rc = ZSTD_CCtx_loadDictionary(zstd_file->cctx, dict, len);
+            else
+                rc = ZSTD_DCtx_loadDictionary(zstd_file->dctx, dict, len);
+
+            if (ZSTD_isError(rc)) {
+                ret = CRE_ZSTD;
+                g_set_error(err, ERR_DOMAIN, CRE_ZSTD,
+                            "ZSTD: Cannot load dictionary: %s",
+                            ZSTD_getErrorName(rc));
+            }
+            break;
+        }
+#endif
+
+#ifdef WITH_ZCHUNK
+        case (CR_CW_ZCK_COMPRESSION): { // ------------------------------------
+            ZckFile *zck_file = (ZckFile *) cr_file->FILE;
+
+            // Zchunk stores the dictionary in the file, readers don't need it
+            if (cr_file->mode != CR_CW_MODE_WRITE) {
+                ret = CRE_BADARG;
+                g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                            "File is not opened in write mode");
+                break;
+            }
+
+            if (!zck_set_soption(zck_file->zck, ZCK_COMP_DICT, dict, len)) {
+                ret = CRE_ZCK;
+                g_set_error(err, ERR_DOMAIN, CRE_ZCK,
+                            "ZCK: Cannot set dictionary: %s",
+                            zck_get_error(zck_file->zck));
+            }
+            break;
+        }
+#endif
+
+        default: // -----------------------------------------------------------
+            ret = CRE_BADARG;
+            g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                        "Compression type doesn't support dictionaries");
+            break;
+    }
+
+    return ret;
+}
+
+
+
+int
+cr_end_chunk(CR_FILE *cr_file, GError **err)
+{
+    int ret = CRE_OK;
+
+    assert(cr_file);
+    assert(!err || *err == NULL);
+
+    if (cr_file->mode != CR_CW_MODE_WRITE) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "File is not opened in write mode");
+        return CRE_BADARG;
+    }
+
+    switch (cr_file->type) {
+
+#ifdef WITH_ZCHUNK
+        case (CR_CW_ZCK_COMPRESSION): { // ------------------------------------
+            ZckFile *zck_file = (ZckFile *) cr_file->FILE;
+
+            if (zck_end_chunk(zck_file->zck) < 0) {
+                ret = CRE_ZCK;
+                g_set_error(err, ERR_DOMAIN, CRE_ZCK,
+                            "ZCK: zck_end_chunk() error: %s",
+                            zck_get_error(zck_file->zck));
+            }
+            break;
+        }
+#endif
+
+        default: // -----------------------------------------------------------
+            break;
+    }
+
+    return ret;
+}
+
+
+
+int
+cr_set_segmented(CR_FILE *cr_file, GError **err)
+{
+    assert(cr_file);
+    assert(!err || *err == NULL);
+
+    if (cr_file->mode != CR_CW_MODE_WRITE) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "File is not opened in write mode");
+        return CRE_BADARG;
+    }
+
+    if (cr_file->segmented)
+        return CRE_OK;
+
+    switch (cr_file->type) {
+
+        case (CR_CW_NO_COMPRESSION): // ---------------------------------------
+        case (CR_CW_GZ_COMPRESSION): // ---------------------------------------
+        case (CR_CW_ZSTD_COMPRESSION): // -------------------------------------
+            // Each segment is a complete gzip member or zstd frame,
+            // concatenation of them is a valid file
+            break;
+
+        case (CR_CW_XZ_COMPRESSION): { // -------------------------------------
+            // Concatenated xz streams are not supported by all decoders,
+            // so all segments are blocks of a single stream. Blocks are
+            // encoded by cr_xz_encode_segment(), the stream encoder
+            // is not used at all.
+            XzFile *xz_file = (XzFile *) cr_file->FILE;
+            lzma_stream_flags flags = { .version = 0, .check = XZ_CHECK };
+            uint8_t header[LZMA_STREAM_HEADER_SIZE];
+
+            if (xz_file->stream.total_in) {
+                g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                            "Some data were already written");
+                return CRE_BADARG;
+            }
+
+            lzma_end(&(xz_file->stream));
+
+            if (lzma_stream_header_encode(&flags, header) != LZMA_OK) {
+                g_set_error(err, ERR_DOMAIN, CRE_XZ,
+                            "XZ: Cannot encode the stream header");
+                return CRE_XZ;
+            }
+
+            if (fwrite(header, 1, LZMA_STREAM_HEADER_SIZE, xz_file->file)
+                != LZMA_STREAM_HEADER_SIZE)
+            {
+                g_set_error(err, ERR_DOMAIN, CRE_XZ,
+                            "XZ: fwrite(): %s", g_strerror(errno));
+                return CRE_XZ;
+            }
+
+            xz_file->index = lzma_index_init(NULL);
+            if (!xz_file->index) {
+                g_set_error(err, ERR_DOMAIN, CRE_XZ,
+                            "XZ: lzma_index_init(): Cannot allocate memory");
+                return CRE_XZ;
+            }
+
+            xz_file->segment = g_byte_array_new();
+            break;
+        }
+
+        default: // -----------------------------------------------------------
+            g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                        "Segments are not supported by %s compression",
+                        cr_compression_suffix(cr_file->type));
+            return CRE_BADARG;
+    }
+
+    cr_file->segmented = TRUE;
+    cr_file->segment_size = 0;
+
+    return CRE_OK;
+}
+
+
+
+int
+cr_end_segment(CR_FILE *cr_file, gint64 *offset, GError **err)
+{
+    int ret = CRE_OK;
+    gint64 pos = -1;
+
+    assert(cr_file);
+    assert(!err || *err == NULL);
+
+    if (!cr_file->segmented) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "File is not segmented");
+        return CRE_BADARG;
+    }
+
+    switch (cr_file->type) {
+
+        case (CR_CW_NO_COMPRESSION): // ---------------------------------------
+            pos = ftell((FILE *) cr_file->FILE);
+            break;
+
+        case (CR_CW_GZ_COMPRESSION): // ---------------------------------------
+            // Finishing an empty segment would write an empty member
+            if (cr_file->segment_size
+                && gzflush((gzFile) cr_file->FILE, Z_FINISH) != Z_OK)
+            {
+                ret = CRE_GZ;
+                g_set_error(err, ERR_DOMAIN, CRE_GZ, "gzflush(): %s",
+                            cr_gz_strerror((gzFile) cr_file->FILE));
+                break;
+            }
+            pos = lseek(fileno(cr_file->INNERFILE), 0, SEEK_CUR);
+            break;
+
+        case (CR_CW_XZ_COMPRESSION): { // -------------------------------------
+            XzFile *xz_file = (XzFile *) cr_file->FILE;
+            ret = cr_xz_encode_segment(xz_file, err);
+            pos = ftell(xz_file->file);
+            break;
+        }
+
+#ifdef WITH_ZSTD
+        case (CR_CW_ZSTD_COMPRESSION): { // -----------------------------------
+            ZstdFile *zstd_file = (ZstdFile *) cr_file->FILE;
+            if (cr_file->segment_size)
+                ret = cr_zstd_end_frame(zstd_file, err);
+            pos = ftell(zstd_file->file);
+            break;
+        }
+#endif
+
+        default: // -----------------------------------------------------------
+            ret = CRE_BADARG;
+            g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                        "Bad compressed file type");
+            break;
+    }
+
+    if (ret == CRE_OK && pos < 0) {
+        ret = CRE_IO;
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "Cannot get offset of the segment: %s",
+                    g_strerror(errno));
+    }
+
+    cr_file->segment_size = 0;
+    if (offset)
+        *offset = pos;
+
+    return ret;
+}
+
+
+
+int
+cr_write_segment(CR_FILE *cr_file,
+                 const void *segment,
+                 size_t len,
+                 const void *content,
+                 size_t content_len,
+                 GError **err)
+{
+    FILE *f = NULL;
+
+    assert(cr_file);
+    assert(segment || !len);
+    assert(!err || *err == NULL);
+
+    if (!cr_file->segmented) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "File is not segmented");
+        return CRE_BADARG;
+    }
+
+    if (cr_file->segment_size) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "Current segment was not ended");
+        return CRE_BADARG;
+    }
+
+    switch (cr_file->type) {
+
+        case (CR_CW_NO_COMPRESSION): // ---------------------------------------
+            f = (FILE *) cr_file->FILE;
+            break;
+
+        case (CR_CW_GZ_COMPRESSION): // ---------------------------------------
+            f = (FILE *) cr_file->INNERFILE;
+            break;
+
+        case (CR_CW_XZ_COMPRESSION): { // -------------------------------------
+            XzFile *xz_file = (XzFile *) cr_file->FILE;
+            int rc = cr_xz_index_segment(xz_file, segment, len, err);
+            if (rc != CRE_OK)
+                return rc;
+            f = xz_file->file;
+            break;
+        }
+
+#ifdef WITH_ZSTD
+        case (CR_CW_ZSTD_COMPRESSION): // -------------------------------------
+            f = ((ZstdFile *) cr_file->FILE)->file;
+            break;
+#endif
+
+        default: // -----------------------------------------------------------
+            g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                        "Bad compressed file type");
+            return CRE_BADARG;
+    }
+
+    // Gzip writes directly into the file descriptor, so nothing
+    // may stay in the stdio buffer
+    if (fwrite(segment, 1, len, f) != len || fflush(f)) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "fwrite(): %s", g_strerror(errno));
+        return CRE_IO;
+    }
+
+    if (cr_file->stat) {
+        cr_file->stat->size += content_len;
+        if (cr_file->checksum_ctx && content_len) {
+            GError *tmp_err = NULL;
+            cr_checksum_update(cr_file->checksum_ctx, content, content_len,
+                               &tmp_err);
+            if (tmp_err) {
+                int code = tmp_err->code;
+                g_propagate_error(err, tmp_err);
+                return code;
+            }
+        }
+    }
+
+    // Variants are not segmented, they get the content
+    if (cr_file->tee && content_len)
+        return cr_tee_write(cr_file->tee, content, content_len, err);
+
+    return CRE_OK;
+}
+
+int
+cr_add_variant(CR_FILE *cr_file, CR_FILE *variant, GError **err)
+{
+    CrTee *tee;
+    CrTeeVariant *tee_variant;
+    GError *tmp_err = NULL;
+
+    assert(cr_file);
+    assert(variant);
+    assert(!err || *err == NULL);
+
+    if (cr_file->mode != CR_CW_MODE_WRITE
+        || variant->mode != CR_CW_MODE_WRITE)
+    {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "Variants are supported only in write mode");
+        return CRE_BADARG;
+    }
+
+    if (variant->type == CR_CW_ZCK_COMPRESSION || variant->tee) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "Zchunk files and files with variants "
+                    "cannot be variants");
+        return CRE_BADARG;
+    }
+
+    tee_variant = g_malloc0(sizeof(CrTeeVariant));
+    tee_variant->file = variant;
+    tee_variant->mutex = g_mutex_new();
+    tee_variant->cond = g_cond_new();
+    tee_variant->queue = g_queue_new();
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+    tee_variant->thread = g_thread_try_new("cr_variant", cr_tee_thread,
+                                           tee_variant, &tmp_err);
+#else
+    tee_variant->thread = g_thread_create(cr_tee_thread, tee_variant,
+                                          TRUE, &tmp_err);
+#endif
+    if (!tee_variant->thread) {
+        int code = tmp_err->code;
+        g_propagate_prefixed_error(err, tmp_err,
+                                   "Cannot start compression thread: ");
+        g_queue_free(tee_variant->queue);
+        g_mutex_free(tee_variant->mutex);
+        g_cond_free(tee_variant->cond);
+        g_free(tee_variant);
+        return code;
+    }
+
+    tee = cr_file->tee;
+    if (!tee) {
+        tee = g_malloc0(sizeof(CrTee));
+        tee->variants = g_ptr_array_new();
+        tee->pending = g_byte_array_sized_new(TEE_BLOCK_SIZE);
+        cr_file->tee = tee;
+    }
+    g_ptr_array_add(tee->variants, tee_variant);
+
+    return CRE_OK;
+}
+
+int
+cr_get_zchunk_header_info(const char *filename,
+                          char **checksum,
+                          cr_ChecksumType *checksum_type,
+                          gint64 *size,
+                          GError **err)
+{
+    assert(filename);
+    assert(checksum);
+    assert(checksum_type);
+    assert(size);
+    assert(!err || *err == NULL);
+
+#ifdef WITH_ZCHUNK
+    int ret = CRE_OK;
+    char *digest;
+    zckCtx *zck;
+    int fd = open(filename, O_RDONLY);
+
+    if (fd < 0) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "Cannot open %s: %s", filename, g_strerror(errno));
+        return CRE_IO;
+    }
+
+    zck = zck_create();
+    if (!zck || !zck_init_read(zck, fd)) {
+        g_set_error(err, ERR_DOMAIN, CRE_ZCK,
+                    "Cannot read zchunk header of %s: %s", filename,
+                    zck ? zck_get_error(zck) : "Cannot allocate memory");
+        if (zck)
+            zck_free(&zck);
+        close(fd);
+        return CRE_ZCK;
+    }
+
+    switch (zck_get_full_hash_type(zck)) {
+        case ZCK_HASH_SHA1:
+            *checksum_type = CR_CHECKSUM_SHA1;
+            break;
+        case ZCK_HASH_SHA256:
+            *checksum_type = CR_CHECKSUM_SHA256;
+            break;
+        case ZCK_HASH_SHA512:
+            *checksum_type = CR_CHECKSUM_SHA512;
+            break;
+        default:
+            *checksum_type = CR_CHECKSUM_UNKNOWN;
+            break;
+    }
+
+    digest = zck_get_header_digest(zck);
+    *size = zck_get_header_length(zck);
+
+    if (!digest || *size < 0 || *checksum_type == CR_CHECKSUM_UNKNOWN) {
+        ret = CRE_ZCK;
+        g_set_error(err, ERR_DOMAIN, CRE_ZCK,
+                    "Cannot get zchunk header checksum of %s", filename);
+        *checksum = NULL;
+    } else {
+        *checksum = g_strdup(digest);
+    }
+
+    free(digest);
+    zck_free(&zck);
+    close(fd);
+
+    return ret;
+#else
+    g_set_error(err, ERR_DOMAIN, CRE_ZCK,
+                "createrepo_c was built without zchunk support");
+    return CRE_ZCK;
+#endif
+}
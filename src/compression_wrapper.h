@@ -41,6 +41,8 @@ typedef enum {
     CR_CW_GZ_COMPRESSION,             /*!< Gzip compression */
     CR_CW_BZ2_COMPRESSION,            /*!< BZip2 compression */
     CR_CW_XZ_COMPRESSION,             /*!< XZ compression */
+    CR_CW_ZSTD_COMPRESSION,           /*!< Zstandard compression */
+    CR_CW_ZCK_COMPRESSION,            /*!< Zchunk compression */
     CR_CW_COMPRESSION_SENTINEL,       /*!< Sentinel of the list */
 } cr_CompressionType;
 
@@ -83,6 +85,11 @@ typedef struct {
     cr_OpenMode         mode;           /*!< Mode */
     cr_ContentStat      *stat;          /*!< Content stats */
     cr_ChecksumCtx      *checksum_ctx;  /*!< Checksum contenxt */
+    void                *reader;        /*!< Decoding thread (read mode) */
+    gboolean            segmented;      /*!< Written in segments */
+    gint64              segment_size;   /*!< Content size of the open
+                                             segment */
+    void                *tee;           /*!< Variants (write mode) */
 } CR_FILE;
 
 #define CR_CW_ERR       -1      /*!< Return value - Error */
@@ -106,6 +113,57 @@ cr_CompressionType cr_detect_compression(const char* filename, GError **err);
  */
 cr_CompressionType cr_compression_type(const char *name);
 
+/** Set parameters of the Zstandard compression. They are used by all
+ * files opened for writting after this call. Not thread safe, this is
+ * meant to be called once during the program initialization.
+ * @param level         compression level (1-22), 0 means default
+ * @param long_mode     enable long distance matching (better ratio
+ *                      for big files, more memory is needed)
+ * @param workers       number of libzstd worker threads, 0 means
+ *                      compression in the calling thread
+ */
+void cr_compression_set_zstd_params(int level,
+                                    gboolean long_mode,
+                                    int workers);
+
+/** Default size of buffers used for reading of compressed files.
+ */
+#define CR_CW_READ_BUFFER_SIZE      (1024*1024)
+
+/** Set parameters of the decompression. They are used by all files
+ * opened for reading after this call. Not thread safe, this is meant
+ * to be called once during the program initialization.
+ * @param buffer_size   size of read buffers (input of decoders and
+ *                      buffers of the decoding thread), 0 means
+ *                      CR_CW_READ_BUFFER_SIZE
+ * @param xz_threads    number of threads of the xz decoder, 0 means
+ *                      number of CPUs (liblzma >= 5.4 is needed,
+ *                      only streams with multiple blocks are decoded
+ *                      in parallel)
+ * @param threaded      decode compressed files in a separate thread,
+ *                      so decoding overlaps with processing of the
+ *                      data returned by cr_read() (enabled by default)
+ */
+void cr_compression_set_read_params(gsize buffer_size,
+                                    int xz_threads,
+                                    gboolean threaded);
+
+/** Get checksum and size of the header of a zchunk file.
+ * Zchunk aware clients download the header first and use its index
+ * of chunk checksums to fetch only chunks they don't have yet.
+ * @param filename      zchunk file
+ * @param checksum      checksum of the header (malloced string)
+ * @param checksum_type type of the header checksum
+ * @param size          size of the header in bytes
+ * @param err           GError **
+ * @return              cr_Error code
+ */
+int cr_get_zchunk_header_info(const char *filename,
+                              char **checksum,
+                              cr_ChecksumType *checksum_type,
+                              gint64 *size,
+                              GError **err);
+
 /** Open/Create the specified file.
  * @param FILENAME      filename
  * @param MODE          open mode
@@ -154,6 +212,89 @@ int cr_write(CR_FILE *cr_file,
              unsigned int len,
              GError **err);
 
+/** Use a compression dictionary for the cr_file.
+ * Must be called right after the cr_file is opened, before any data
+ * are written or read. Only zstd and zchunk files support dictionaries.
+ * A zstd file must be read with the same dictionary it was written with,
+ * zchunk files carry their dictionary and accept one only in write mode.
+ * @param cr_file       CR_FILE pointer
+ * @param dict          dictionary data
+ * @param len           size of the dictionary
+ * @param err           GError **
+ * @return              cr_Error code
+ */
+int cr_set_dict(CR_FILE *cr_file,
+                const void *dict,
+                unsigned int len,
+                GError **err);
+
+/** End the current chunk of the cr_file. Data written till now are
+ * compressed independently of the following data. This is a no-op
+ * for compression types without a notion of chunks (all but zchunk).
+ * @param cr_file       CR_FILE pointer
+ * @param err           GError **
+ * @return              cr_Error code
+ */
+int cr_end_chunk(CR_FILE *cr_file, GError **err);
+
+/** Write the file as a sequence of independently compressed segments
+ * (gzip members, zstd frames, blocks of a single xz stream with sizes
+ * stored in their headers). Segments are ended by cr_end_segment()
+ * and segments of another file of the same compression type can be
+ * copied into the file verbatim by cr_write_segment().
+ * Must be called before the first write. Not supported by bzip2
+ * and zchunk.
+ * @param cr_file       CR_FILE pointer
+ * @param err           GError **
+ * @return              cr_Error code
+ */
+int cr_set_segmented(CR_FILE *cr_file, GError **err);
+
+/** End the current segment of a segmented file. Data written till now
+ * are compressed independently of the following data. Ending of an
+ * empty segment doesn't write anything.
+ * @param cr_file       CR_FILE pointer
+ * @param offset        offset of the end of the segment in the
+ *                      compressed file or NULL
+ * @param err           GError **
+ * @return              cr_Error code
+ */
+int cr_end_segment(CR_FILE *cr_file, gint64 *offset, GError **err);
+
+/** Append an already compressed segment (e.g. a segment of an older
+ * version of the file) to a segmented file. Can be used only when
+ * no segment is open, i.e. right after cr_set_segmented(),
+ * cr_end_segment() or another cr_write_segment().
+ * @param cr_file       CR_FILE pointer
+ * @param segment       compressed segment
+ * @param len           size of the compressed segment
+ * @param content       uncompressed content of the segment, it is used
+ *                      only for the cr_ContentStat of the file
+ * @param content_len   size of the content
+ * @param err           GError **
+ * @return              cr_Error code
+ */
+int cr_write_segment(CR_FILE *cr_file,
+                     const void *segment,
+                     size_t len,
+                     const void *content,
+                     size_t content_len,
+                     GError **err);
+
+/** Add a variant to the cr_file. Everything written into the cr_file
+ * is written into the variant too, each variant is compressed by its
+ * own thread. Variants are closed (and their errors reported) by
+ * cr_close() of the cr_file. Must be called before the first write.
+ * Both files must be opened in write mode, zchunk files cannot be
+ * variants (their chunks are not passed).
+ * @param cr_file       CR_FILE pointer
+ * @param variant       CR_FILE opened for writing, on success the cr_file
+ *                      takes its ownership
+ * @param err           GError **
+ * @return              cr_Error code
+ */
+int cr_add_variant(CR_FILE *cr_file, CR_FILE *variant, GError **err);
+
 /** Writes the string pointed by str into the cr_file.
  * @param cr_file       CR_FILE pointer
  * @param str           null terminated ('\0') string
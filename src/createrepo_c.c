@@ -24,8 +24,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <signal.h>
 #include <sys/types.h>
+#include <sys/sem.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <dirent.h>
 #include <fcntl.h>
 #include <stdint.h>
@@ -34,8 +37,11 @@
 #include "compression_wrapper.h"
 #include "createrepo_shared.h"
 #include "deltarpms.h"
+#include "dictionary.h"
 #include "dumper_thread.h"
 #include "checksum.h"
+#include "checksum_cache.h"
+#include "checksum_manifest.h"
 #include "cleanup.h"
 #include "error.h"
 #include "helpers.h"
@@ -43,12 +49,16 @@
 #include "locate_metadata.h"
 #include "misc.h"
 #include "parsepkg.h"
+#include "profile.h"
 #include "repomd.h"
+#include "segments.h"
+#include "shard.h"
 #include "sqlite.h"
 #include "threads.h"
 #include "version.h"
 #include "xml_dump.h"
 #include "xml_file.h"
+#include "xml_parser.h"
 
 #define OUTDELTADIR "drpms/"
 
@@ -116,6 +126,11 @@ task_cmp(gconstpointer a_p, gconstpointer b_p, G_GNUC_UNUSED gpointer user_data)
  *                          will be processed will be appended to.
  * @param output_pkg_list   File where relative paths of processed packages
  *                          will be writen to.
+ * @param task_paths        Array where full paths of the tasks will be
+ *                          appended to (in the order of task ids) or NULL.
+ * @param shard             If not NULL, only packages of the slice of
+ *                          the shard are processed. Slice of the shard
+ *                          (first, packages and total) is filled in.
  * @return                  Number of packages that are going to be processed
  */
 static long
@@ -125,10 +140,14 @@ fill_pool(GThreadPool *pool,
           GSList **current_pkglist,
           FILE *output_pkg_list,
           long *package_count,
-          int  media_id)
+          int  media_id,
+          GPtrArray *task_paths,
+          cr_ShardInfo *shard)
 {
     GQueue queue = G_QUEUE_INIT;
     struct PoolTask *task;
+    size_t in_dir_len = strlen(in_dir);
+    gint64 first, packages;
 
     if ( ! cmd_options->split ) {
         media_id = 0;
@@ -142,7 +161,6 @@ fill_pool(GThreadPool *pool,
 
         g_message("Directory walk started");
 
-        size_t in_dir_len = strlen(in_dir);
         GStringChunk *sub_dirs_chunk = g_string_chunk_new(1024);
         GQueue *sub_dirs = g_queue_new();
         gchar *input_dir_stripped;
@@ -203,9 +221,6 @@ fill_pool(GThreadPool *pool,
                     task->full_path = full_path;
                     task->filename = g_strdup(filename);
                     task->path = g_strdup(dirname);
-                    if (output_pkg_list)
-                        fprintf(output_pkg_list, "%s\n", repo_relative_path);
-                    *current_pkglist = g_slist_prepend(*current_pkglist, task->filename);
                     // TODO: One common path for all tasks with the same path?
                     g_queue_insert_sorted(&queue, task, task_cmp, NULL);
                 } else {
@@ -249,18 +264,40 @@ fill_pool(GThreadPool *pool,
                 task->full_path = full_path;
                 task->filename  = g_strdup(filename);         // foobar.rpm
                 task->path      = strndup(relative_path, x);  // packages/i386/
-                if (output_pkg_list)
-                    fprintf(output_pkg_list, "%s\n", relative_path);
-                *current_pkglist = g_slist_prepend(*current_pkglist, task->filename);
                 g_queue_insert_sorted(&queue, task, task_cmp, NULL);
             }
         }
     }
 
+    // Select the slice of the shard
+    first = 0;
+    packages = g_queue_get_length(&queue);
+    if (shard) {
+        shard->total = packages;
+        cr_shard_range(shard->total, shard->index, shard->count,
+                       &shard->first, &shard->packages);
+        first = shard->first;
+        packages = shard->packages;
+    }
+
     // Push sorted tasks into the thread pool
-    while ((task = g_queue_pop_head(&queue)) != NULL) {
+    for (gint64 x = 0; (task = g_queue_pop_head(&queue)) != NULL; x++) {
+        if (x < first || x >= first + packages) {
+            g_free(task->full_path);
+            g_free(task->filename);
+            g_free(task->path);
+            g_free(task);
+            continue;
+        }
+
+        if (output_pkg_list)
+            fprintf(output_pkg_list, "%s\n", task->full_path + in_dir_len);
+        *current_pkglist = g_slist_prepend(*current_pkglist, task->filename);
+
         task->id = *package_count;
         task->media_id = media_id;
+        if (task_paths)
+            g_ptr_array_add(task_paths, g_strdup(task->full_path));
         g_thread_pool_push(pool, task, NULL);
         ++*package_count;
     }
@@ -322,6 +359,704 @@ prepare_cache_dir(struct CmdOptions *cmd_options,
 }
 
 
+/** Prepare a zchunk dictionary for the new repodata.
+ * The dictionary published in the previous repodata is reused - a new
+ * dictionary changes all chunks and clients would have to download
+ * whole files again. A new one is trained from the old metadata
+ * only if there is no previous dictionary.
+ *
+ * @param name              Name of the metadata ("primary", ...)
+ * @param type              Type of the xml file
+ * @param old_repomd        Previous repomd or NULL
+ * @param old_dir           Directory of the previous repo
+ * @param old_metadata      Old metadata (--update) or NULL
+ * @param dict_dir          Directory where the dictionary should be stored
+ * @param err               GError **
+ * @return                  Path to the stored dictionary or NULL
+ */
+static gchar *
+prepare_zck_dict(const gchar *name,
+                 cr_XmlFileType type,
+                 cr_Repomd *old_repomd,
+                 const gchar *old_dir,
+                 cr_Metadata *old_metadata,
+                 const gchar *dict_dir,
+                 GError **err)
+{
+    gchar *dict_path = NULL;
+    gchar *dict = NULL;
+    gsize dict_len = 0;
+    gchar *rec_type = g_strconcat(name, "_zck_dict", NULL);
+    cr_RepomdRecord *rec = cr_repomd_get_record(old_repomd, rec_type);
+    GError *tmp_err = NULL;
+
+    if (rec && rec->location_href) {
+        gchar *path = g_build_filename(old_dir, rec->location_href, NULL);
+        if (g_file_get_contents(path, &dict, &dict_len, &tmp_err)) {
+            g_message("Reusing zchunk dictionary %s", path);
+        } else {
+            g_warning("Cannot read zchunk dictionary %s: %s",
+                      path, tmp_err->message);
+            g_clear_error(&tmp_err);
+        }
+        g_free(path);
+    }
+
+    if (!dict && old_metadata) {
+        void *trained = NULL;
+
+        if (cr_dict_train_from_metadata(old_metadata, type, 0, 0,
+                                        &trained, &dict_len,
+                                        &tmp_err) == CRE_OK)
+        {
+            g_message("Trained %"G_GSIZE_FORMAT" bytes zchunk dictionary "
+                      "for %s", dict_len, name);
+            dict = trained;
+        } else {
+            g_warning("Cannot train zchunk dictionary for %s: %s",
+                      name, tmp_err->message);
+            g_clear_error(&tmp_err);
+        }
+    }
+
+    if (dict) {
+        dict_path = g_strconcat(dict_dir, name, CR_DICT_SUFFIX, NULL);
+        if (!g_file_set_contents(dict_path, dict, dict_len, &tmp_err)) {
+            g_propagate_prefixed_error(err, tmp_err,
+                                       "Cannot write %s: ", dict_path);
+            g_free(dict_path);
+            dict_path = NULL;
+        }
+    } else {
+        g_debug("No zchunk dictionary for %s", name);
+    }
+
+    g_free(dict);
+    g_free(rec_type);
+    return dict_path;
+}
+
+
+/** Write a xml file in segments (--segmented).
+ * Segments described by the index of the previous version of the file
+ * (e.g. repodata/primary.segments) are reused when their content
+ * doesn't change. Old index which cannot be used is just ignored.
+ *
+ * @param f                 Opened xml file
+ * @param name              Name of the metadata ("primary", ...)
+ * @param old_dir           Directory of the previous repodata
+ * @param pkgs              Average number of packages in a segment
+ * @param old_index         Loaded old index or NULL (to be freed
+ *                          after the file is closed)
+ * @param index             New index of the file (to be freed
+ *                          after it is written)
+ * @param err               GError **
+ * @return                  cr_Error code
+ */
+static int
+setup_segments(cr_XmlFile *f,
+               const gchar *name,
+               const gchar *old_dir,
+               guint pkgs,
+               cr_SegmentIndex **old_index,
+               cr_SegmentIndex **index,
+               GError **err)
+{
+    gchar *path = g_strconcat(old_dir, name, CR_SEGMENTS_SUFFIX, NULL);
+    GError *tmp_err = NULL;
+
+    *old_index = NULL;
+    if (g_file_test(path, G_FILE_TEST_IS_REGULAR)) {
+        *old_index = cr_segmentindex_load(path, old_dir, &tmp_err);
+        if (tmp_err) {
+            g_message("Segments of %s cannot be reused: %s",
+                      name, tmp_err->message);
+            g_clear_error(&tmp_err);
+        } else {
+            g_debug("Loaded %u old segments of %s",
+                    cr_segmentindex_len(*old_index), name);
+        }
+    }
+    g_free(path);
+
+    *index = cr_segmentindex_new();
+    return cr_xmlfile_set_segments(f, pkgs, *old_index, *index, err);
+}
+
+
+/** Write segment index of a xml file into the repodata directory.
+ * The index is not part of repomd.xml, failure is not fatal.
+ *
+ * @param index             Segment index of the file
+ * @param name              Name of the metadata ("primary", ...)
+ * @param rec               Repomd record of the (renamed) file
+ * @param dir               Repodata directory
+ */
+static void
+write_segments(cr_SegmentIndex *index,
+               const gchar *name,
+               cr_RepomdRecord *rec,
+               const gchar *dir)
+{
+    gchar *path;
+    GError *tmp_err = NULL;
+
+    if (!index || !rec)
+        return;
+
+    path = g_strconcat(dir, name, CR_SEGMENTS_SUFFIX, NULL);
+    if (cr_segmentindex_write(index, path, rec->location_real,
+                              &tmp_err) != CRE_OK)
+    {
+        g_warning("Cannot write segment index %s: %s",
+                  path, tmp_err->message);
+        g_clear_error(&tmp_err);
+    }
+    g_free(path);
+}
+
+
+/** Open a zchunk variant of a xml file.
+ * If the dict_dir contains a dictionary for the type of the file
+ * (e.g. primary.zdict), the dictionary is used for compression.
+ *
+ * @param filename          Path to the new file
+ * @param type              Type of the xml file
+ * @param name              Name of the metadata ("primary", ...)
+ * @param dict_dir          Directory with dictionaries or NULL
+ * @param stat              cr_ContentStat or NULL
+ * @param err               GError **
+ * @return                  Opened cr_XmlFile or NULL on error
+ */
+static cr_XmlFile *
+open_zck_xmlfile(const gchar *filename,
+                 cr_XmlFileType type,
+                 const gchar *name,
+                 const gchar *dict_dir,
+                 cr_ContentStat *stat,
+                 GError **err)
+{
+    cr_XmlFile *f;
+    gchar *dict_path, *dict = NULL;
+    gsize dict_len = 0;
+    GError *tmp_err = NULL;
+
+    f = cr_xmlfile_sopen(filename, type, CR_CW_ZCK_COMPRESSION, stat, err);
+    if (!f || !dict_dir)
+        return f;
+
+    dict_path = g_strconcat(dict_dir, "/", name, ".zdict", NULL);
+    if (!g_file_test(dict_path, G_FILE_TEST_IS_REGULAR)) {
+        g_debug("No zchunk dictionary %s", dict_path);
+        g_free(dict_path);
+        return f;
+    }
+
+    if (g_file_get_contents(dict_path, &dict, &dict_len, &tmp_err))
+        cr_set_dict(f->f, dict, dict_len, &tmp_err);
+
+    if (tmp_err) {
+        g_propagate_prefixed_error(err, tmp_err,
+                "Cannot use zchunk dictionary %s: ", dict_path);
+        cr_xmlfile_close(f, NULL);
+        f = NULL;
+    } else {
+        g_debug("Using zchunk dictionary %s", dict_path);
+    }
+
+    g_free(dict);
+    g_free(dict_path);
+    return f;
+}
+
+
+/** Compression variant of primary, filelists and other xml.
+ */
+typedef struct {
+    cr_CompressionType      type;
+    gchar                   *filename[3];
+    cr_ContentStat          *stat[3];
+    cr_RepomdRecord         *rec[3];
+    cr_RepomdRecordFillTask *task[3];
+} CompressionVariant;
+
+static const gchar *variant_names[3] = { "primary", "filelists", "other" };
+
+/** Write primary, filelists and other (in this order in files)
+ * with the compression too. The variant is appended to the variants.
+ */
+static gboolean
+open_compression_variant(cr_XmlFile **files,
+                         cr_CompressionType type,
+                         const gchar *tmp_out_repo,
+                         cr_ChecksumType checksum_type,
+                         GSList **variants,
+                         GError **err)
+{
+    CompressionVariant *variant = g_new0(CompressionVariant, 1);
+
+    variant->type = type;
+    *variants = g_slist_append(*variants, variant);
+
+    for (int x = 0; x < 3; x++) {
+        variant->filename[x] = g_strconcat(tmp_out_repo, "/",
+                                           variant_names[x], ".xml",
+                                           cr_compression_suffix(type), NULL);
+        variant->stat[x] = cr_contentstat_new(checksum_type, NULL);
+        if (cr_xmlfile_add_variant(files[x], variant->filename[x], type,
+                                   variant->stat[x], err) != CRE_OK)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+static void
+compression_variant_free(CompressionVariant *variant)
+{
+    for (int x = 0; x < 3; x++) {
+        g_free(variant->filename[x]);
+        cr_contentstat_free(variant->stat[x], NULL);
+    }
+    g_free(variant);
+}
+
+
+/** Load shard files of shards to assemble and check that the shards
+ * are complete and in order.
+ *
+ * @param dirs              Output directories of the shards
+ * @param err               GError **
+ * @return                  GArray of cr_ShardInfo or NULL on error
+ */
+static GArray *
+load_shards(char **dirs, GError **err)
+{
+    GArray *shards = g_array_new(FALSE, TRUE, sizeof(cr_ShardInfo));
+
+    for (int x = 0; dirs[x]; x++) {
+        cr_ShardInfo shard;
+        gchar *path = g_build_filename(dirs[x], "repodata",
+                                       CR_SHARD_FILENAME, NULL);
+        int ret = cr_shard_load(&shard, path, err);
+
+        g_free(path);
+        if (ret != CRE_OK) {
+            g_array_free(shards, TRUE);
+            return NULL;
+        }
+        g_array_append_val(shards, shard);
+    }
+
+    if (cr_shard_check((cr_ShardInfo *) shards->data, shards->len,
+                       err) != CRE_OK)
+    {
+        g_array_free(shards, TRUE);
+        return NULL;
+    }
+
+    return shards;
+}
+
+
+/** Append a sqlite database of a shard to the database.
+ * Compressed database is decompressed into the tmp_dir first.
+ *
+ * @param db                Opened database
+ * @param path              Path to the database of the shard
+ * @param tmp_dir           Directory for the decompressed database
+ * @param err               GError **
+ * @return                  FALSE if err is set, TRUE otherwise
+ */
+static gboolean
+append_shard_db(cr_SqliteDb *db,
+                const char *path,
+                const char *tmp_dir,
+                GError **err)
+{
+    gchar *db_path;
+    gboolean ret;
+
+    if (g_str_has_suffix(path, ".sqlite")) {
+        db_path = g_strdup(path);
+    } else {
+        db_path = g_build_filename(tmp_dir, "shard.sqlite", NULL);
+        if (cr_decompress_file(path, db_path, CR_CW_AUTO_DETECT_COMPRESSION,
+                               err) != CRE_OK)
+        {
+            g_free(db_path);
+            return FALSE;
+        }
+    }
+
+    ret = cr_db_append(db, db_path, err) == CRE_OK;
+
+    if (strcmp(db_path, path))
+        remove(db_path);
+    g_free(db_path);
+
+    return ret;
+}
+
+
+/** Append metadata of shards to the opened xml files and databases.
+ * Compressed segments of the xml files are copied as they are, so
+ * the packages are neither rendered nor compressed again.
+ *
+ * @param dirs              Output directories of the shards
+ * @param shards            Shard files (see load_shards())
+ * @param xml_files         Primary, filelists and other xml files
+ * @param dbs               Primary, filelists and other dbs (or NULLs)
+ * @param tmp_dir           Directory for decompressed databases
+ * @param err               GError **
+ * @return                  FALSE if err is set, TRUE otherwise
+ */
+static gboolean
+assemble_shards(char **dirs,
+                GArray *shards,
+                cr_XmlFile **xml_files,
+                cr_SqliteDb **dbs,
+                const char *tmp_dir,
+                GError **err)
+{
+    static const char *names[3] = { "primary", "filelists", "other" };
+
+    for (guint x = 0; x < shards->len; x++) {
+        cr_ShardInfo *shard = &g_array_index(shards, cr_ShardInfo, x);
+        gchar *repodata = g_build_filename(dirs[x], "repodata", NULL);
+        struct cr_MetadataLocation *ml = NULL;
+        gboolean ok = TRUE;
+
+        for (int y = 0; ok && y < 3; y++)
+            ok = cr_shard_append_xml(xml_files[y], shard, repodata,
+                                     names[y], err) == CRE_OK;
+
+        if (ok && dbs[0]) {
+            ml = cr_locate_metadata(dirs[x], FALSE, err);
+            ok = ml != NULL;
+        }
+
+        if (ok && dbs[0]) {
+            const char *hrefs[3] = { ml->pri_sqlite_href,
+                                     ml->fil_sqlite_href,
+                                     ml->oth_sqlite_href };
+
+            for (int y = 0; ok && y < 3; y++) {
+                if (!hrefs[y]) {
+                    g_set_error(err, CREATEREPO_C_ERROR, CRE_NOFILE,
+                                "Shard %s has no %s database (use "
+                                "--no-database for --assemble too)",
+                                dirs[x], names[y]);
+                    ok = FALSE;
+                } else {
+                    ok = append_shard_db(dbs[y], hrefs[y], tmp_dir, err);
+                }
+            }
+        }
+
+        cr_metadatalocation_free(ml);
+        g_free(repodata);
+        if (!ok)
+            return FALSE;
+
+        g_debug("Shard %u/%u from %s assembled (%"G_GINT64_FORMAT
+                " packages)", shard->index, shard->count, dirs[x],
+                shard->packages);
+    }
+
+    return TRUE;
+}
+
+
+/** A repository of a --batch run.
+ */
+typedef struct {
+    gchar *line;        /*!< Line of the batch file (for messages) */
+    gchar **argv;       /*!< Arguments of the repository (with argv[0]) */
+    pid_t pid;          /*!< Running child or 0 */
+    gint64 started;     /*!< Monotonic time of the start */
+} BatchRepo;
+
+/** Parse batch file. Each non empty line which doesn't start with '#'
+ * is a directory to index followed by its options.
+ * @param path          Path to the batch file
+ * @param prog          argv[0] used for all repositories
+ * @param err           GError **
+ * @return              GPtrArray of BatchRepo or NULL on error
+ */
+static GPtrArray *
+parse_batch_file(const char *path, const char *prog, GError **err)
+{
+    _cleanup_free_ gchar *content = NULL;
+    GError *tmp_err = NULL;
+    GPtrArray *repos;
+    gchar **lines;
+
+    assert(!err || *err == NULL);
+
+    if (!g_file_get_contents(path, &content, NULL, &tmp_err)) {
+        g_set_error(err, CREATEREPO_C_ERROR, CRE_IO,
+                    "Cannot read batch file %s: %s", path, tmp_err->message);
+        g_error_free(tmp_err);
+        return NULL;
+    }
+
+    repos = g_ptr_array_new();
+    lines = g_strsplit(content, "\n", 0);
+
+    for (int x = 0; lines[x]; x++) {
+        gchar *line = g_strstrip(lines[x]);
+        gchar **args = NULL;
+        gint args_len = 0;
+        BatchRepo *repo;
+
+        if (*line == '\0' || *line == '#')
+            continue;
+
+        if (!g_shell_parse_argv(line, &args_len, &args, &tmp_err)) {
+            g_set_error(err, CREATEREPO_C_ERROR, CRE_BADARG,
+                        "%s:%d: %s", path, x+1, tmp_err->message);
+            g_error_free(tmp_err);
+            g_strfreev(lines);
+            g_ptr_array_free(repos, TRUE);
+            return NULL;
+        }
+
+        for (int y = 0; y < args_len; y++) {
+            if (g_str_has_prefix(args[y], "--batch")) {
+                g_set_error(err, CREATEREPO_C_ERROR, CRE_BADARG,
+                            "%s:%d: %s cannot be used in a batch file",
+                            path, x+1, args[y]);
+                g_strfreev(args);
+                g_strfreev(lines);
+                g_ptr_array_free(repos, TRUE);
+                return NULL;
+            }
+        }
+
+        repo = g_new0(BatchRepo, 1);
+        repo->line = g_strdup(line);
+        repo->argv = g_new0(gchar *, args_len + 2);
+        repo->argv[0] = g_strdup(prog);
+        for (int y = 0; y < args_len; y++)
+            repo->argv[y+1] = args[y];
+        g_free(args);
+        g_ptr_array_add(repos, repo);
+    }
+
+    g_strfreev(lines);
+    return repos;
+}
+
+/** SysV semaphore with the number of free workers shared by all
+ * repositories of a --batch run (see UserData.workers_sem) or -1.
+ * Inherited by the forked children.
+ */
+static int batch_workers_sem = -1;
+
+/** This process is a child of a --batch run.
+ */
+static gboolean batch_child = FALSE;
+
+/** Argument of semctl(SETVAL).
+ */
+union batch_semun {
+    int val;
+    struct semid_ds *buf;
+    unsigned short *array;
+};
+
+/** Remove the semaphore of the --batch run and terminate the process
+ * by the signal.
+ */
+static void
+batch_sighandler(int sig)
+{
+    if (batch_workers_sem != -1)
+        semctl(batch_workers_sem, 0, IPC_RMID);
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+/** Create the pool of --workers workers shared by all repositories
+ * of the --batch run. Without it every repository uses its own workers.
+ */
+static void
+batch_workers_init(int workers)
+{
+    union batch_semun arg;
+
+    batch_workers_sem = semget(IPC_PRIVATE, 1, IPC_CREAT | 0600);
+    if (batch_workers_sem == -1) {
+        g_warning("Batch: Cannot create a semaphore: %s - repositories "
+                  "won't share workers", g_strerror(errno));
+        return;
+    }
+
+    arg.val = workers;
+    if (semctl(batch_workers_sem, 0, SETVAL, arg) == -1) {
+        g_warning("Batch: Cannot set a semaphore: %s - repositories "
+                  "won't share workers", g_strerror(errno));
+        semctl(batch_workers_sem, 0, IPC_RMID);
+        batch_workers_sem = -1;
+        return;
+    }
+
+    signal(SIGINT, batch_sighandler);
+    signal(SIGTERM, batch_sighandler);
+    signal(SIGHUP, batch_sighandler);
+}
+
+/** Remove the pool of workers shared by the --batch run.
+ */
+static void
+batch_workers_free(void)
+{
+    if (batch_workers_sem == -1)
+        return;
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGHUP, SIG_DFL);
+    semctl(batch_workers_sem, 0, IPC_RMID);
+    batch_workers_sem = -1;
+}
+
+/** Process all repositories from the --batch file.
+ *
+ * Package parser and libxml2 are initialized just once, then every
+ * repository is processed by a forked child which continues as a regular
+ * createrepo_c run (with its own lock, cleanup handlers and atomic
+ * publication of the repodata). Up to --batch-jobs children run at
+ * the same time.
+ *
+ * The children share one pool of --workers workers: a worker of a child
+ * reads a package only when it gets a free worker of the batch
+ * (a semaphore), so the number of packages read at the same time doesn't
+ * depend on the number of running children. With --cachedir the children
+ * share the checksum cache file, a child which misses a checksum locks
+ * the package file and looks at records written by the other children
+ * meanwhile, so a package hardlinked into several repositories is hashed
+ * only once.
+ *
+ * In the parent process this function never returns - it exits when all
+ * repositories are done. In a child it returns with argc and argv set
+ * to the arguments of the child's repository.
+ */
+static void
+run_batch(struct CmdOptions *cmd_options, int *argc, char ***argv)
+{
+    GError *tmp_err = NULL;
+    GPtrArray *repos;
+    guint next = 0, running = 0, failed = 0;
+    int jobs = cmd_options->batch_jobs;
+
+    cr_setup_logging(cmd_options->quiet, cmd_options->verbose);
+
+    if (*argc > 1) {
+        g_printerr("Directories to index must be listed in the batch file\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (jobs < 0) {
+        g_printerr("--batch-jobs cannot be negative\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (jobs == 0)
+        jobs = cmd_options->workers;
+
+    repos = parse_batch_file(cmd_options->batch, (*argv)[0], &tmp_err);
+    if (!repos) {
+        g_printerr("%s\n", tmp_err->message);
+        g_error_free(tmp_err);
+        exit(EXIT_FAILURE);
+    }
+
+    // Shared by all children (no thread may be started before fork)
+    cr_package_parser_init();
+    cr_xml_dump_init();
+    batch_workers_init(cmd_options->workers);
+
+    g_message("Batch: %u repositories, up to %d at the same time, "
+              "%d workers", repos->len, jobs, cmd_options->workers);
+
+    while (next < repos->len || running > 0) {
+        if (next < repos->len && running < (guint) jobs) {
+            BatchRepo *repo = g_ptr_array_index(repos, next++);
+            pid_t pid;
+
+            fflush(NULL);
+            pid = fork();
+            if (pid == -1) {
+                g_critical("Batch: Cannot fork for %s: %s",
+                           repo->line, g_strerror(errno));
+                failed++;
+                continue;
+            }
+
+            if (pid == 0) {
+                // Child - continue as a run for a single repository
+                batch_child = TRUE;
+                signal(SIGINT, SIG_DFL);
+                signal(SIGTERM, SIG_DFL);
+                signal(SIGHUP, SIG_DFL);
+                g_free(cmd_options->batch);
+                cmd_options->batch = NULL;
+                *argc = g_strv_length(repo->argv);
+                *argv = repo->argv;
+                return;
+            }
+
+            g_debug("Batch: %s (pid %d) started", repo->line, (int) pid);
+            repo->pid = pid;
+            repo->started = g_get_monotonic_time();
+            running++;
+            continue;
+        }
+
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid == -1) {
+            if (errno == EINTR)
+                continue;
+            g_critical("Batch: waitpid() failed: %s", g_strerror(errno));
+            batch_workers_free();
+            exit(EXIT_FAILURE);
+        }
+
+        for (guint x = 0; x < next; x++) {
+            BatchRepo *repo = g_ptr_array_index(repos, x);
+            if (repo->pid != pid)
+                continue;
+
+            gdouble seconds = (g_get_monotonic_time() - repo->started) / 1000000.0;
+            repo->pid = 0;
+            running--;
+
+            if (WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS) {
+                g_message("Batch: %s done in %.2f s", repo->line, seconds);
+            } else {
+                failed++;
+                if (WIFSIGNALED(status))
+                    g_critical("Batch: %s killed by signal %d after %.2f s",
+                               repo->line, WTERMSIG(status), seconds);
+                else
+                    g_critical("Batch: %s failed (exit status %d) after %.2f s",
+                               repo->line, WEXITSTATUS(status), seconds);
+            }
+            break;
+        }
+    }
+
+    g_message("Batch: %u repositories done, %u failed",
+              repos->len - failed, failed);
+
+    batch_workers_free();
+    free_options(cmd_options);
+    exit(failed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+
 int
 main(int argc, char **argv)
 {
@@ -346,6 +1081,17 @@ main(int argc, char **argv)
         exit(EXIT_SUCCESS);
     }
 
+    if (cmd_options->batch) {
+        // Returns only in a forked child, with arguments of its repository
+        run_batch(cmd_options, &argc, &argv);
+        cmd_options = parse_arguments(&argc, &argv, &tmp_err);
+        if (!cmd_options) {
+            g_printerr("Argument parsing failed: %s\n", tmp_err->message);
+            g_error_free(tmp_err);
+            exit(EXIT_FAILURE);
+        }
+    }
+
     if ( cmd_options->split ) {
         if (argc < 2) {
             g_printerr("Must specify at least one directory to index.\n");
@@ -402,6 +1148,14 @@ main(int argc, char **argv)
     // Set logging stuff
     cr_setup_logging(cmd_options->quiet, cmd_options->verbose);
 
+    // Enable profiling before any worker thread is started
+    if (cmd_options->profile || cmd_options->stats_json)
+        cr_profile_enable();
+
+    cr_compression_set_zstd_params(cmd_options->zstd_level,
+                                   cmd_options->zstd_long,
+                                   cmd_options->zstd_workers);
+
     // Emit debug message with version
     g_debug("Version: %s", cr_version_string_with_features());
 
@@ -479,24 +1233,55 @@ main(int argc, char **argv)
     g_debug("Thread pool ready");
 
     long package_count = 0;
+    GPtrArray *task_paths = NULL;
     GSList *current_pkglist = NULL;
     /* ^^^ List with basenames of files which will be processed */
 
-    for (int media_id = 1; media_id < argc; media_id++ ) {
-        gchar *tmp_in_dir = cr_normalize_dir_path(argv[media_id]);
-        // Thread pool - Fill with tasks
-        fill_pool(pool,
-                  tmp_in_dir,
-                  cmd_options,
-                  &current_pkglist,
-                  output_pkg_list,
-                  &package_count,
-                  media_id);
-        g_free(tmp_in_dir);
-    }
+    if (cmd_options->prefetch)
+        task_paths = g_ptr_array_new_with_free_func(g_free);
+
+    cr_ShardInfo shard = { .index = cmd_options->shard_index,
+                           .count = cmd_options->shard_count };
+    GArray *shards = NULL;  // Shards to assemble
+
+    gint64 prof_start = cr_profile_start();
+    if (cmd_options->assemble) {
+        // Packages are taken from the shards
+        shards = load_shards(cmd_options->assemble, &tmp_err);
+        if (!shards) {
+            g_critical("Cannot assemble shards: %s", tmp_err->message);
+            g_clear_error(&tmp_err);
+            exit(EXIT_FAILURE);
+        }
+        if (shards->len)
+            package_count = g_array_index(shards, cr_ShardInfo, 0).total;
+        g_message("Assembling %u shards - %ld packages",
+                  shards->len, package_count);
+    } else {
+        for (int media_id = 1; media_id < argc; media_id++ ) {
+            gchar *tmp_in_dir = cr_normalize_dir_path(argv[media_id]);
+            // Thread pool - Fill with tasks
+            fill_pool(pool,
+                      tmp_in_dir,
+                      cmd_options,
+                      &current_pkglist,
+                      output_pkg_list,
+                      &package_count,
+                      media_id,
+                      task_paths,
+                      cmd_options->shard ? &shard : NULL);
+            g_free(tmp_in_dir);
+        }
 
-    g_debug("Package count: %ld", package_count);
-    g_message("Directory walk done - %ld packages", package_count);
+        cr_profile_stop(CR_PROF_DIR_WALK, prof_start);
+        g_debug("Package count: %ld", package_count);
+        g_message("Directory walk done - %ld packages", package_count);
+        if (cmd_options->shard)
+            g_message("Shard %u/%u: packages %"G_GINT64_FORMAT" - %"
+                      G_GINT64_FORMAT" of %"G_GINT64_FORMAT,
+                      shard.index, shard.count, shard.first + 1,
+                      shard.first + shard.packages, shard.total);
+    }
 
     if (output_pkg_list)
         fclose(output_pkg_list);
@@ -511,6 +1296,7 @@ main(int argc, char **argv)
 
     if (package_count && cmd_options->update) {
         int ret;
+        prof_start = cr_profile_start();
         old_metadata = cr_metadata_new(CR_HT_KEY_FILENAME, 1, current_pkglist);
         cr_metadata_set_dupaction(old_metadata, CR_HT_DUPACT_REMOVEALL);
 
@@ -555,6 +1341,7 @@ main(int argc, char **argv)
 
         g_message("Loaded information about %d packages",
                   g_hash_table_size(cr_metadata_hashtable(old_metadata)));
+        cr_profile_stop(CR_PROF_MD_LOAD, prof_start);
     }
 
     g_slist_free(current_pkglist);
@@ -682,7 +1469,10 @@ main(int argc, char **argv)
     fil_xml_filename = g_strconcat(tmp_out_repo, "/filelists.xml", xml_compression_suffix, NULL);
     oth_xml_filename = g_strconcat(tmp_out_repo, "/other.xml", xml_compression_suffix, NULL);
 
-    pri_stat = cr_contentstat_new(cmd_options->repomd_checksum_type, NULL);
+    // Content of segments copied from shards is unknown, open checksums
+    // of assembled files are computed from the files when filling repomd
+    pri_stat = cmd_options->assemble ? NULL
+               : cr_contentstat_new(cmd_options->repomd_checksum_type, NULL);
     pri_cr_file = cr_xmlfile_sopen_primary(pri_xml_filename,
                                            xml_compression,
                                            pri_stat,
@@ -699,7 +1489,8 @@ main(int argc, char **argv)
         exit(EXIT_FAILURE);
     }
 
-    fil_stat = cr_contentstat_new(cmd_options->repomd_checksum_type, NULL);
+    fil_stat = cmd_options->assemble ? NULL
+               : cr_contentstat_new(cmd_options->repomd_checksum_type, NULL);
     fil_cr_file = cr_xmlfile_sopen_filelists(fil_xml_filename,
                                             xml_compression,
                                             fil_stat,
@@ -718,7 +1509,8 @@ main(int argc, char **argv)
         exit(EXIT_FAILURE);
     }
 
-    oth_stat = cr_contentstat_new(cmd_options->repomd_checksum_type, NULL);
+    oth_stat = cmd_options->assemble ? NULL
+               : cr_contentstat_new(cmd_options->repomd_checksum_type, NULL);
     oth_cr_file = cr_xmlfile_sopen_other(oth_xml_filename,
                                         xml_compression,
                                         oth_stat,
@@ -745,6 +1537,154 @@ main(int argc, char **argv)
     cr_xmlfile_set_num_of_pkgs(fil_cr_file, package_count, NULL);
     cr_xmlfile_set_num_of_pkgs(oth_cr_file, package_count, NULL);
 
+    // Setup segments
+    cr_SegmentIndex *pri_old_segments = NULL;
+    cr_SegmentIndex *fil_old_segments = NULL;
+    cr_SegmentIndex *oth_old_segments = NULL;
+    cr_SegmentIndex *pri_segments = NULL;
+    cr_SegmentIndex *fil_segments = NULL;
+    cr_SegmentIndex *oth_segments = NULL;
+
+    if (cmd_options->segmented) {
+        guint segment_size = (guint) cmd_options->segment_size;
+
+        setup_segments(pri_cr_file, "primary", out_repo, segment_size,
+                       &pri_old_segments, &pri_segments, &tmp_err);
+        if (!tmp_err)
+            setup_segments(fil_cr_file, "filelists", out_repo, segment_size,
+                           &fil_old_segments, &fil_segments, &tmp_err);
+        if (!tmp_err)
+            setup_segments(oth_cr_file, "other", out_repo, segment_size,
+                           &oth_old_segments, &oth_segments, &tmp_err);
+        if (tmp_err) {
+            g_critical("Cannot write metadata in segments: %s",
+                       tmp_err->message);
+            g_clear_error(&tmp_err);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Compression variants
+    GSList *compression_variants = NULL;
+    cr_XmlFile *xml_files[3] = { pri_cr_file, fil_cr_file, oth_cr_file };
+
+    for (GSList *elem = cmd_options->compression_variants;
+         elem;
+         elem = g_slist_next(elem))
+    {
+        cr_CompressionType type = GPOINTER_TO_INT(elem->data);
+
+        g_debug("Creating .xml%s files", cr_compression_suffix(type));
+        if (!open_compression_variant(xml_files, type, tmp_out_repo,
+                                      cmd_options->repomd_checksum_type,
+                                      &compression_variants, &tmp_err))
+        {
+            g_critical("Cannot open %s variant of xml files: %s",
+                       cr_compression_suffix(type), tmp_err->message);
+            g_clear_error(&tmp_err);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Open zchunk files
+    cr_XmlFile *pri_zck_file = NULL;
+    cr_XmlFile *fil_zck_file = NULL;
+    cr_XmlFile *oth_zck_file = NULL;
+
+    cr_ContentStat *pri_zck_stat = NULL;
+    cr_ContentStat *fil_zck_stat = NULL;
+    cr_ContentStat *oth_zck_stat = NULL;
+
+    gchar *pri_zck_filename = NULL;
+    gchar *fil_zck_filename = NULL;
+    gchar *oth_zck_filename = NULL;
+
+    gchar *pri_zck_dict_filename = NULL;
+    gchar *fil_zck_dict_filename = NULL;
+    gchar *oth_zck_dict_filename = NULL;
+    const gchar *zck_dict_dir = cmd_options->zck_dict_dir;
+
+    if (cmd_options->zck_dict_train) {
+        cr_Repomd *old_repomd = NULL;
+        gchar *old_repomd_path = g_strconcat(out_repo, "repomd.xml", NULL);
+
+        if (g_file_test(old_repomd_path, G_FILE_TEST_IS_REGULAR)) {
+            old_repomd = cr_repomd_new();
+            if (cr_xml_parse_repomd(old_repomd_path, old_repomd,
+                                    NULL, NULL, &tmp_err) != CRE_OK)
+            {
+                g_warning("Cannot parse %s: %s",
+                          old_repomd_path, tmp_err->message);
+                g_clear_error(&tmp_err);
+                cr_repomd_free(old_repomd);
+                old_repomd = NULL;
+            }
+        }
+
+        pri_zck_dict_filename = prepare_zck_dict("primary",
+                                            CR_XMLFILE_PRIMARY, old_repomd,
+                                            out_dir, old_metadata,
+                                            tmp_out_repo, &tmp_err);
+        if (!tmp_err)
+            fil_zck_dict_filename = prepare_zck_dict("filelists",
+                                            CR_XMLFILE_FILELISTS, old_repomd,
+                                            out_dir, old_metadata,
+                                            tmp_out_repo, &tmp_err);
+        if (!tmp_err)
+            oth_zck_dict_filename = prepare_zck_dict("other",
+                                            CR_XMLFILE_OTHER, old_repomd,
+                                            out_dir, old_metadata,
+                                            tmp_out_repo, &tmp_err);
+
+        if (tmp_err) {
+            g_critical("Cannot prepare zchunk dictionary: %s",
+                       tmp_err->message);
+            g_clear_error(&tmp_err);
+            exit(EXIT_FAILURE);
+        }
+
+        // Dictionaries which are not available are simply not found here
+        zck_dict_dir = tmp_out_repo;
+
+        cr_repomd_free(old_repomd);
+        g_free(old_repomd_path);
+    }
+
+    if (cmd_options->zck_compression) {
+        g_debug("Creating .xml.zck files");
+
+        pri_zck_filename = g_strconcat(tmp_out_repo, "/primary.xml.zck", NULL);
+        fil_zck_filename = g_strconcat(tmp_out_repo, "/filelists.xml.zck", NULL);
+        oth_zck_filename = g_strconcat(tmp_out_repo, "/other.xml.zck", NULL);
+
+        pri_zck_stat = cr_contentstat_new(cmd_options->repomd_checksum_type, NULL);
+        fil_zck_stat = cr_contentstat_new(cmd_options->repomd_checksum_type, NULL);
+        oth_zck_stat = cr_contentstat_new(cmd_options->repomd_checksum_type, NULL);
+
+        pri_zck_file = open_zck_xmlfile(pri_zck_filename, CR_XMLFILE_PRIMARY,
+                                        "primary", zck_dict_dir,
+                                        pri_zck_stat, &tmp_err);
+        if (pri_zck_file)
+            fil_zck_file = open_zck_xmlfile(fil_zck_filename,
+                                            CR_XMLFILE_FILELISTS, "filelists",
+                                            zck_dict_dir,
+                                            fil_zck_stat, &tmp_err);
+        if (fil_zck_file)
+            oth_zck_file = open_zck_xmlfile(oth_zck_filename,
+                                            CR_XMLFILE_OTHER, "other",
+                                            zck_dict_dir,
+                                            oth_zck_stat, &tmp_err);
+        if (!oth_zck_file) {
+            g_critical("Cannot open zchunk file: %s", tmp_err->message);
+            g_clear_error(&tmp_err);
+            exit(EXIT_FAILURE);
+        }
+
+        cr_xmlfile_set_num_of_pkgs(pri_zck_file, package_count, NULL);
+        cr_xmlfile_set_num_of_pkgs(fil_zck_file, package_count, NULL);
+        cr_xmlfile_set_num_of_pkgs(oth_zck_file, package_count, NULL);
+    }
+
     // Open sqlite databases
     gchar *pri_db_filename = NULL;
     gchar *fil_db_filename = NULL;
@@ -818,10 +1758,47 @@ main(int argc, char **argv)
         }
     }
 
+    // Open checksum cache
+    cr_ChecksumCache *checksum_cache = NULL;
+    if (cmd_options->checksum_cachedir) {
+        gchar *cache_path = g_build_filename(cmd_options->checksum_cachedir,
+                                             CR_CHECKSUM_CACHE_FILENAME,
+                                             NULL);
+        checksum_cache = cr_checksumcache_open(cache_path, &tmp_err);
+        if (!checksum_cache) {
+            g_warning("Cannot use checksum cache %s: %s",
+                      cache_path, tmp_err->message);
+            g_clear_error(&tmp_err);
+        } else if (batch_child) {
+            // Other repositories of the batch fill the cache too
+            cr_checksumcache_set_shared(checksum_cache, TRUE);
+        }
+        g_free(cache_path);
+    }
+
+    // Load checksum manifest
+    cr_ChecksumManifest *checksum_manifest = NULL;
+    if (cmd_options->checksum_manifest) {
+        checksum_manifest = cr_checksummanifest_load(
+                                        cmd_options->checksum_manifest,
+                                        cmd_options->checksum_type,
+                                        &tmp_err);
+        if (!checksum_manifest) {
+            g_critical("Cannot load checksum manifest: %s", tmp_err->message);
+            g_clear_error(&tmp_err);
+            exit(EXIT_FAILURE);
+        }
+        cr_checksummanifest_set_verify_rate(checksum_manifest,
+                                    cmd_options->checksum_manifest_verify);
+    }
+
     // Thread pool - User data initialization
     user_data.pri_f             = pri_cr_file;
     user_data.fil_f             = fil_cr_file;
     user_data.oth_f             = oth_cr_file;
+    user_data.pri_zck           = pri_zck_file;
+    user_data.fil_zck           = fil_zck_file;
+    user_data.oth_zck           = oth_zck_file;
     user_data.pri_db            = pri_db;
     user_data.fil_db            = fil_db;
     user_data.oth_db            = oth_db;
@@ -830,6 +1807,10 @@ main(int argc, char **argv)
     user_data.checksum_type_str = cr_checksum_name_str(cmd_options->checksum_type);
     user_data.checksum_type     = cmd_options->checksum_type;
     user_data.checksum_cachedir = cmd_options->checksum_cachedir;
+    user_data.checksum_cache    = checksum_cache;
+    user_data.shared_checksum_cache = (checksum_cache && batch_child);
+    user_data.checksum_manifest = checksum_manifest;
+    user_data.prefetch          = NULL;
     user_data.skip_symlinks     = cmd_options->skip_symlinks;
     user_data.repodir_name_len  = strlen(in_dir);
     user_data.package_count     = package_count;
@@ -853,15 +1834,91 @@ main(int argc, char **argv)
     user_data.cut_dirs          = cmd_options->cut_dirs;
     user_data.location_prefix   = cmd_options->location_prefix;
     user_data.had_errors        = 0;
+    user_data.inodes            = cr_dumper_inodes_new();
+    user_data.mutex_inodes      = g_mutex_new();
+    user_data.hardlinks_read    = 0;
+    user_data.hardlinks_reused  = 0;
+    user_data.workers_sem       = batch_workers_sem;
 
     g_debug("Thread pool user data ready");
 
+    // Start reading ahead
+    if (task_paths && task_paths->len) {
+        // With the checksum cache or manifest only headers are needed.
+        // In a --batch run checksums are left to the shared workers.
+        cr_ChecksumType prefetch_checksum =
+                        (checksum_cache || checksum_manifest || batch_child)
+                        ? CR_CHECKSUM_UNKNOWN
+                        : cmd_options->checksum_type;
+
+        user_data.prefetch = cr_prefetch_new(cmd_options->prefetch,
+                                             cmd_options->prefetch_threads,
+                                             prefetch_checksum,
+                                             cr_dumper_prefetch_skip,
+                                             &user_data,
+                                             &tmp_err);
+        if (!user_data.prefetch) {
+            g_warning("Cannot start prefetch: %s", tmp_err->message);
+            g_clear_error(&tmp_err);
+        } else {
+            for (guint x = 0; x < task_paths->len; x++)
+                cr_prefetch_add(user_data.prefetch,
+                                g_ptr_array_index(task_paths, x));
+            g_message("Prefetch started (%d packages ahead)",
+                      cmd_options->prefetch);
+        }
+    }
+
     // Start pool
     g_thread_pool_set_max_threads(pool, cmd_options->workers, NULL);
     g_message("Pool started (with %d workers)", cmd_options->workers);
+    prof_start = cr_profile_start();
 
     // Wait until pool is finished
     g_thread_pool_free(pool, FALSE, TRUE);
+    cr_profile_stop(CR_PROF_POOL, prof_start);
+
+    cr_prefetch_free(user_data.prefetch);
+    user_data.prefetch = NULL;
+    if (task_paths)
+        g_ptr_array_free(task_paths, TRUE);
+
+    if (checksum_manifest) {
+        cr_ChecksumManifestStats manifest_stats;
+        cr_checksummanifest_stats(checksum_manifest, &manifest_stats);
+        g_message("Checksum manifest: %"G_GUINT64_FORMAT" hits, "
+                  "%"G_GUINT64_FORMAT" misses, %"G_GUINT64_FORMAT
+                  " outdated (%"G_GUINT64_FORMAT" records loaded, "
+                  "%"G_GUINT64_FORMAT" verified, %"G_GUINT64_FORMAT
+                  " mismatches)",
+                  manifest_stats.hits, manifest_stats.misses,
+                  manifest_stats.outdated, manifest_stats.records,
+                  manifest_stats.verified, manifest_stats.mismatches);
+
+        // A wrong checksum means the manifest cannot be trusted
+        if (manifest_stats.mismatches)
+            user_data.had_errors = TRUE;
+
+        cr_checksummanifest_free(checksum_manifest);
+        checksum_manifest = NULL;
+        user_data.checksum_manifest = NULL;
+    }
+
+    // Concatenate shards
+    if (shards) {
+        cr_SqliteDb *dbs[3] = { pri_db, fil_db, oth_db };
+
+        if (!assemble_shards(cmd_options->assemble, shards, xml_files, dbs,
+                             tmp_out_repo, &tmp_err))
+        {
+            g_critical("Cannot assemble shards: %s", tmp_err->message);
+            g_clear_error(&tmp_err);
+            exit(EXIT_FAILURE);
+        }
+        g_message("%u shards assembled", shards->len);
+        g_array_free(shards, TRUE);
+        shards = NULL;
+    }
 
     // if there were any errors, exit nonzero
     if( cmd_options->error_exit_val && user_data.had_errors ) {
@@ -870,11 +1927,46 @@ main(int argc, char **argv)
 
     g_message("Pool finished%s", (user_data.had_errors ? " with errors" : ""));
 
+    if (user_data.hardlinks_reused)
+        g_message("Hardlinks: %ld packages copied from %ld files read once",
+                  user_data.hardlinks_reused, user_data.hardlinks_read);
+    cr_dumper_inodes_free(user_data.inodes);
+    user_data.inodes = NULL;
+
+    if (checksum_cache) {
+        cr_ChecksumCacheStats cache_stats;
+        cr_checksumcache_stats(checksum_cache, &cache_stats);
+        g_message("Checksum cache: %"G_GUINT64_FORMAT" hits, "
+                  "%"G_GUINT64_FORMAT" misses, %"G_GUINT64_FORMAT
+                  " new records (%"G_GUINT64_FORMAT" records loaded, "
+                  "%"G_GUINT64_FORMAT" stale)",
+                  cache_stats.hits, cache_stats.misses, cache_stats.inserts,
+                  cache_stats.records, cache_stats.stale);
+
+        cr_checksumcache_close(checksum_cache, &tmp_err);
+        if (tmp_err) {
+            g_warning("Error while closing checksum cache: %s",
+                      tmp_err->message);
+            g_clear_error(&tmp_err);
+        }
+        checksum_cache = NULL;
+    }
+
     cr_xml_dump_cleanup();
 
+    prof_start = cr_profile_start();
     cr_xmlfile_close(pri_cr_file, NULL);
     cr_xmlfile_close(fil_cr_file, NULL);
     cr_xmlfile_close(oth_cr_file, NULL);
+    cr_xmlfile_close(pri_zck_file, NULL);
+    cr_xmlfile_close(fil_zck_file, NULL);
+    cr_xmlfile_close(oth_zck_file, NULL);
+    cr_profile_stop(CR_PROF_XML_CLOSE, prof_start);
+
+    // Old segments were copied, the old files can be closed
+    cr_segmentindex_free(pri_old_segments);
+    cr_segmentindex_free(fil_old_segments);
+    cr_segmentindex_free(oth_old_segments);
 
     g_queue_free(user_data.buffer);
     g_mutex_free(user_data.mutex_buffer);
@@ -885,6 +1977,7 @@ main(int argc, char **argv)
     g_mutex_free(user_data.mutex_fil);
     g_mutex_free(user_data.mutex_oth);
     g_mutex_free(user_data.mutex_deltatargetpackages);
+    g_mutex_free(user_data.mutex_inodes);
 
     // Create repomd records for each file
     g_debug("Generating repomd.xml");
@@ -901,6 +1994,12 @@ main(int argc, char **argv)
     cr_RepomdRecord *compressed_groupfile_rec = NULL;
     cr_RepomdRecord *updateinfo_rec           = NULL;
     cr_RepomdRecord *prestodelta_rec          = NULL;
+    cr_RepomdRecord *pri_zck_rec              = NULL;
+    cr_RepomdRecord *fil_zck_rec              = NULL;
+    cr_RepomdRecord *oth_zck_rec              = NULL;
+    cr_RepomdRecord *pri_zck_dict_rec         = NULL;
+    cr_RepomdRecord *fil_zck_dict_rec         = NULL;
+    cr_RepomdRecord *oth_zck_dict_rec         = NULL;
 
     // XML
     cr_repomd_record_load_contentstat(pri_xml_rec, pri_stat);
@@ -933,6 +2032,91 @@ main(int argc, char **argv)
                                                 NULL);
     g_thread_pool_push(fill_pool, oth_fill_task, NULL);
 
+    // Compression variants of XML
+    for (GSList *elem = compression_variants; elem; elem = g_slist_next(elem)) {
+        CompressionVariant *variant = elem->data;
+
+        for (int x = 0; x < 3; x++) {
+            gchar *type = g_strconcat(variant_names[x], "_",
+                                      cr_compression_suffix(variant->type) + 1,
+                                      NULL);
+            variant->rec[x] = cr_repomd_record_new(type, variant->filename[x]);
+            g_free(type);
+
+            cr_repomd_record_load_contentstat(variant->rec[x],
+                                              variant->stat[x]);
+            cr_contentstat_free(variant->stat[x], NULL);
+            variant->stat[x] = NULL;
+
+            variant->task[x] = cr_repomdrecordfilltask_new(variant->rec[x],
+                                            cmd_options->repomd_checksum_type,
+                                            NULL);
+            g_thread_pool_push(fill_pool, variant->task[x], NULL);
+        }
+    }
+
+    // Zchunk XML
+    cr_RepomdRecordFillTask *pri_zck_fill_task = NULL;
+    cr_RepomdRecordFillTask *fil_zck_fill_task = NULL;
+    cr_RepomdRecordFillTask *oth_zck_fill_task = NULL;
+
+    if (cmd_options->zck_compression) {
+        pri_zck_rec = cr_repomd_record_new("primary_zck", pri_zck_filename);
+        fil_zck_rec = cr_repomd_record_new("filelists_zck", fil_zck_filename);
+        oth_zck_rec = cr_repomd_record_new("other_zck", oth_zck_filename);
+
+        cr_repomd_record_load_contentstat(pri_zck_rec, pri_zck_stat);
+        cr_repomd_record_load_contentstat(fil_zck_rec, fil_zck_stat);
+        cr_repomd_record_load_contentstat(oth_zck_rec, oth_zck_stat);
+
+        cr_contentstat_free(pri_zck_stat, NULL);
+        cr_contentstat_free(fil_zck_stat, NULL);
+        cr_contentstat_free(oth_zck_stat, NULL);
+
+        pri_zck_fill_task = cr_repomdrecordfilltask_new(pri_zck_rec,
+                                            cmd_options->repomd_checksum_type,
+                                            NULL);
+        g_thread_pool_push(fill_pool, pri_zck_fill_task, NULL);
+
+        fil_zck_fill_task = cr_repomdrecordfilltask_new(fil_zck_rec,
+                                            cmd_options->repomd_checksum_type,
+                                            NULL);
+        g_thread_pool_push(fill_pool, fil_zck_fill_task, NULL);
+
+        oth_zck_fill_task = cr_repomdrecordfilltask_new(oth_zck_rec,
+                                            cmd_options->repomd_checksum_type,
+                                            NULL);
+        g_thread_pool_push(fill_pool, oth_zck_fill_task, NULL);
+    }
+
+    // Zchunk dictionaries
+    if (pri_zck_dict_filename)
+        pri_zck_dict_rec = cr_repomd_record_new("primary_zck_dict",
+                                                pri_zck_dict_filename);
+    if (fil_zck_dict_filename)
+        fil_zck_dict_rec = cr_repomd_record_new("filelists_zck_dict",
+                                                fil_zck_dict_filename);
+    if (oth_zck_dict_filename)
+        oth_zck_dict_rec = cr_repomd_record_new("other_zck_dict",
+                                                oth_zck_dict_filename);
+
+    cr_RepomdRecord *zck_dict_recs[] = { pri_zck_dict_rec,
+                                         fil_zck_dict_rec,
+                                         oth_zck_dict_rec };
+    for (int x = 0; x < 3; x++) {
+        if (!zck_dict_recs[x])
+            continue;
+        cr_repomd_record_fill(zck_dict_recs[x],
+                              cmd_options->repomd_checksum_type,
+                              &tmp_err);
+        if (tmp_err) {
+            g_critical("Cannot process zchunk dictionary %s: %s",
+                       zck_dict_recs[x]->location_real, tmp_err->message);
+            g_clear_error(&tmp_err);
+            exit(EXIT_FAILURE);
+        }
+    }
+
     // Groupfile
     if (groupfile) {
         groupfile_rec = cr_repomd_record_new("group", groupfile);
@@ -971,6 +2155,18 @@ main(int argc, char **argv)
     cr_repomdrecordfilltask_free(pri_fill_task, NULL);
     cr_repomdrecordfilltask_free(fil_fill_task, NULL);
     cr_repomdrecordfilltask_free(oth_fill_task, NULL);
+    if (cmd_options->zck_compression) {
+        cr_repomdrecordfilltask_free(pri_zck_fill_task, NULL);
+        cr_repomdrecordfilltask_free(fil_zck_fill_task, NULL);
+        cr_repomdrecordfilltask_free(oth_zck_fill_task, NULL);
+    }
+    for (GSList *elem = compression_variants; elem; elem = g_slist_next(elem)) {
+        CompressionVariant *variant = elem->data;
+        for (int x = 0; x < 3; x++) {
+            cr_repomdrecordfilltask_free(variant->task[x], NULL);
+            variant->task[x] = NULL;
+        }
+    }
 
     // Sqlite db
     if (!cmd_options->no_database) {
@@ -1080,13 +2276,19 @@ main(int argc, char **argv)
         gchar *filename, *outdeltadir = NULL;
         gchar *prestodelta_xml_filename = NULL;
         GHashTable *ht_oldpackagedirs = NULL;
+        cr_DeltaCache *delta_cache = NULL;
+        gchar *prestodelta_cache_path = NULL;
         cr_XmlFile *prestodelta_cr_file = NULL;
         cr_ContentStat *prestodelta_stat = NULL;
 
+        prof_start = cr_profile_start();
         filename = g_strconcat("prestodelta.xml",
                                prestodelta_compression_suffix,
                                NULL);
         outdeltadir = g_build_filename(out_dir, OUTDELTADIR, NULL);
+        prestodelta_cache_path = g_build_filename(outdeltadir,
+                                                  CR_PRESTODELTA_CACHE_FILENAME,
+                                                  NULL);
         prestodelta_xml_filename = g_build_filename(tmp_out_repo,
                                                     filename,
                                                     NULL);
@@ -1104,6 +2306,17 @@ main(int argc, char **argv)
             goto deltaerror;
         }
 
+        // Deltas from previous runs
+        if (!cmd_options->no_delta_cache) {
+            delta_cache = cr_deltacache_open(outdeltadir,
+                                             cmd_options->checksum_type,
+                                             &tmp_err);
+            if (!delta_cache) {
+                g_warning("Cannot open delta cache: %s", tmp_err->message);
+                g_clear_error(&tmp_err);
+            }
+        }
+
         // 1) Scan old package directories
         ht_oldpackagedirs = cr_deltarpms_scan_oldpackagedirs(cmd_options->oldpackagedirs_paths,
                                                    cmd_options->max_delta_rpm_size,
@@ -1122,6 +2335,7 @@ main(int argc, char **argv)
                                  cmd_options->workers,
                                  cmd_options->max_delta_rpm_size,
                                  cmd_options->max_delta_rpm_size,
+                                 delta_cache,
                                  &tmp_err);
         if (!ret) {
             g_critical("Parallel generation of drpms failed: %s", tmp_err->message);
@@ -1129,6 +2343,21 @@ main(int argc, char **argv)
             goto deltaerror;
         }
 
+        // Drop deltas which are not needed anymore before they get
+        // into prestodelta.xml
+        if (delta_cache) {
+            cr_DeltaCacheStats delta_stats;
+            cr_deltacache_prune(delta_cache, NULL);
+            cr_deltacache_stats(delta_cache, &delta_stats);
+            g_message("Delta cache: %"G_GUINT64_FORMAT" hits, "
+                      "%"G_GUINT64_FORMAT" misses, %"G_GUINT64_FORMAT
+                      " new deltas, %"G_GUINT64_FORMAT" stale removed "
+                      "(%.1f s of makedeltarpm saved)",
+                      delta_stats.hits, delta_stats.misses,
+                      delta_stats.inserts, delta_stats.pruned,
+                      delta_stats.saved_us / 1000000.0);
+        }
+
         // 3) Generate prestodelta.xml file
         prestodelta_stat = cr_contentstat_new(cmd_options->repomd_checksum_type, NULL);
         prestodelta_cr_file = cr_xmlfile_sopen_prestodelta(prestodelta_xml_filename,
@@ -1148,6 +2377,7 @@ main(int argc, char **argv)
                         CR_CHECKSUM_SHA256, // Createrepo always uses SHA256
                         cmd_options->workers,
                         out_dir,
+                        prestodelta_cache_path,
                         &tmp_err);
         if (!ret) {
             g_critical("Cannot generate %s: %s", prestodelta_xml_filename,
@@ -1167,12 +2397,19 @@ main(int argc, char **argv)
 deltaerror:
         // 5) Cleanup
         g_hash_table_destroy(ht_oldpackagedirs);
+        cr_deltacache_close(delta_cache, &tmp_err);
+        if (tmp_err) {
+            g_warning("Error while closing delta cache: %s", tmp_err->message);
+            g_clear_error(&tmp_err);
+        }
         g_free(outdeltadir);
+        g_free(prestodelta_cache_path);
         g_free(prestodelta_xml_filename);
         cr_xmlfile_close(prestodelta_cr_file, NULL);
         cr_contentstat_free(prestodelta_stat, NULL);
         cr_slist_free_full(user_data.deltatargetpackages,
                        (GDestroyNotify) cr_deltatargetpackage_free);
+        cr_profile_stop(CR_PROF_DELTAS, prof_start);
     }
 #endif
 
@@ -1188,6 +2425,36 @@ deltaerror:
         cr_repomd_record_rename_file(compressed_groupfile_rec, NULL);
         cr_repomd_record_rename_file(updateinfo_rec, NULL);
         cr_repomd_record_rename_file(prestodelta_rec, NULL);
+        cr_repomd_record_rename_file(pri_zck_rec, NULL);
+        cr_repomd_record_rename_file(fil_zck_rec, NULL);
+        cr_repomd_record_rename_file(oth_zck_rec, NULL);
+        cr_repomd_record_rename_file(pri_zck_dict_rec, NULL);
+        cr_repomd_record_rename_file(fil_zck_dict_rec, NULL);
+        cr_repomd_record_rename_file(oth_zck_dict_rec, NULL);
+        for (GSList *elem = compression_variants; elem; elem = g_slist_next(elem)) {
+            CompressionVariant *variant = elem->data;
+            for (int x = 0; x < 3; x++)
+                cr_repomd_record_rename_file(variant->rec[x], NULL);
+        }
+    }
+
+    // Write segment indexes (file names are final now)
+    write_segments(pri_segments, "primary", pri_xml_rec, tmp_out_repo);
+    write_segments(fil_segments, "filelists", fil_xml_rec, tmp_out_repo);
+    write_segments(oth_segments, "other", oth_xml_rec, tmp_out_repo);
+    cr_segmentindex_free(pri_segments);
+    cr_segmentindex_free(fil_segments);
+    cr_segmentindex_free(oth_segments);
+
+    // Shard description for the assemble run
+    if (cmd_options->shard) {
+        gchar *shard_path = g_strconcat(tmp_out_repo, CR_SHARD_FILENAME, NULL);
+        if (cr_shard_write(&shard, shard_path, &tmp_err) != CRE_OK) {
+            g_critical("%s", tmp_err->message);
+            g_clear_error(&tmp_err);
+            exit(EXIT_FAILURE);
+        }
+        g_free(shard_path);
     }
 
     // Gen xml
@@ -1201,6 +2468,17 @@ deltaerror:
     cr_repomd_set_record(repomd_obj, compressed_groupfile_rec);
     cr_repomd_set_record(repomd_obj, updateinfo_rec);
     cr_repomd_set_record(repomd_obj, prestodelta_rec);
+    cr_repomd_set_record(repomd_obj, pri_zck_rec);
+    cr_repomd_set_record(repomd_obj, fil_zck_rec);
+    cr_repomd_set_record(repomd_obj, oth_zck_rec);
+    cr_repomd_set_record(repomd_obj, pri_zck_dict_rec);
+    cr_repomd_set_record(repomd_obj, fil_zck_dict_rec);
+    cr_repomd_set_record(repomd_obj, oth_zck_dict_rec);
+    for (GSList *elem = compression_variants; elem; elem = g_slist_next(elem)) {
+        CompressionVariant *variant = elem->data;
+        for (int x = 0; x < 3; x++)
+            cr_repomd_set_record(repomd_obj, variant->rec[x]);
+    }
 
     int i = 0;
     while (cmd_options->repo_tags && cmd_options->repo_tags[i])
@@ -1225,6 +2503,7 @@ deltaerror:
 
     cr_repomd_sort_records(repomd_obj);
 
+    prof_start = cr_profile_start();
     char *repomd_xml = cr_xml_dump_repomd(repomd_obj, &tmp_err);
     assert(repomd_xml || tmp_err);
     cr_repomd_free(repomd_obj);
@@ -1246,6 +2525,7 @@ deltaerror:
     fclose(frepomd);
     g_free(repomd_xml);
     g_free(repomd_path);
+    cr_profile_stop(CR_PROF_REPOMD_WRITE, prof_start);
 
 
     // Final move
@@ -1253,6 +2533,8 @@ deltaerror:
     cr_RetentionType retentiontype = CR_RETENTION_DEFAULT;
     gint64 retentionval = (gint64) cmd_options->retain_old;
 
+    prof_start = cr_profile_start();
+
     if (cmd_options->retain_old_md_by_age) {
         retentiontype = CR_RETENTION_BYAGE;
         retentionval = cmd_options->md_max_age;
@@ -1327,6 +2609,20 @@ deltaerror:
         }
     }
 
+    cr_profile_stop(CR_PROF_PUBLISH, prof_start);
+
+    // Profiling report
+    if (cr_profile_enabled()) {
+        cr_profile_log_summary();
+        if (cmd_options->stats_json
+            && !cr_profile_write_json(cmd_options->stats_json,
+                                      "createrepo_c", &tmp_err))
+        {
+            g_warning("%s", tmp_err->message);
+            g_clear_error(&tmp_err);
+        }
+    }
+
 
     // Clean up
     g_debug("Memory cleanup");
@@ -1344,6 +2640,14 @@ deltaerror:
     g_free(pri_xml_filename);
     g_free(fil_xml_filename);
     g_free(oth_xml_filename);
+    g_free(pri_zck_filename);
+    g_free(fil_zck_filename);
+    g_free(oth_zck_filename);
+    cr_slist_free_full(compression_variants,
+                       (GDestroyNotify) compression_variant_free);
+    g_free(pri_zck_dict_filename);
+    g_free(fil_zck_dict_filename);
+    g_free(oth_zck_dict_filename);
     g_free(pri_db_filename);
     g_free(fil_db_filename);
     g_free(oth_db_filename);
@@ -40,8 +40,12 @@ extern "C" {
 
 #include <glib.h>
 #include "checksum.h"
+#include "checksum_cache.h"
+#include "checksum_manifest.h"
 #include "compression_wrapper.h"
+#include "delta_cache.h"
 #include "deltarpms.h"
+#include "dictionary.h"
 #include "error.h"
 #include "load_metadata.h"
 #include "locate_metadata.h"
@@ -49,10 +53,15 @@ extern "C" {
 #include "package.h"
 #include "parsehdr.h"
 #include "parsepkg.h"
+#include "prefetch.h"
+#include "profile.h"
 #include "repomd.h"
+#include "segments.h"
+#include "shard.h"
 #include "sqlite.h"
 #include "threads.h"
 #include "updateinfo.h"
+#include "updateinfo_index.h"
 #include "version.h"
 #include "xml_dump.h"
 #include "xml_file.h"
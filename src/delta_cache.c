@@ -0,0 +1,715 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "delta_cache.h"
+#include "error.h"
+
+#define ERR_DOMAIN          CREATEREPO_C_ERROR
+#define CACHE_HEADER        "# createrepo_c delta cache"
+#define PRESTODELTA_HEADER  "# createrepo_c prestodelta cache"
+
+/** A delta in the cache directory.
+ */
+typedef struct {
+    gchar       *filename;  // Name of the delta file
+    gint64      size;       // Size of the delta file
+    gint64      mtime;      // Mtime of the delta file
+    gint64      build_us;   // Time spent by generation of the delta
+    gboolean    used;       // Looked up or inserted during this run
+} cr_DeltaRecord;
+
+/** Remembered checksum of a package file.
+ */
+typedef struct {
+    gint64      size;
+    gint64      mtime;
+    gint64      ino;
+    gchar       *pkgid;
+    gboolean    used;       // Asked for during this run
+} cr_PkgIdRecord;
+
+struct _cr_DeltaCache {
+    gchar           *dir;           // Directory with deltas
+    gchar           *path;          // Path to the index file
+    cr_ChecksumType checksum_type;  // Type of the keys
+    GHashTable      *deltas;        // "<old>\t<new>" -> cr_DeltaRecord
+    GHashTable      *pkgids;        // Package path -> cr_PkgIdRecord
+    GSList          *foreign;       // Delta filenames from records made
+                                    // with another checksum type
+    GMutex          *mutex;         // Guards everything above
+    cr_DeltaCacheStats stats;
+};
+
+static void
+cr_deltarecord_free(cr_DeltaRecord *rec)
+{
+    if (!rec)
+        return;
+    g_free(rec->filename);
+    g_free(rec);
+}
+
+static void
+cr_pkgidrecord_free(cr_PkgIdRecord *rec)
+{
+    if (!rec)
+        return;
+    g_free(rec->pkgid);
+    g_free(rec);
+}
+
+static void
+deltacache_free(cr_DeltaCache *cache)
+{
+    g_hash_table_destroy(cache->deltas);
+    g_hash_table_destroy(cache->pkgids);
+    g_slist_free_full(cache->foreign, g_free);
+    g_mutex_free(cache->mutex);
+    g_free(cache->dir);
+    g_free(cache->path);
+    g_free(cache);
+}
+
+static gboolean
+parse_int64(const char *str, gint64 *val)
+{
+    char *end;
+
+    if (!*str)
+        return FALSE;
+    *val = g_ascii_strtoll(str, &end, 10);
+    return *end == '\0';
+}
+
+/** Filenames and paths are stored as the last (or an inner) field
+ * of a tab separated line.
+ */
+static gboolean
+is_storable(const char *str)
+{
+    return *str && !strchr(str, '\t') && !strchr(str, '\n');
+}
+
+static void
+load_record(cr_DeltaCache *cache, const char *line, gboolean foreign)
+{
+    gchar **fields = NULL;
+    gint64 size, mtime, val;
+
+    if (line[0] == 'D' && line[1] == '\t') {
+        fields = g_strsplit(line + 2, "\t", 6);
+        if (g_strv_length(fields) != 6
+            || !*fields[0] || !*fields[1] || !is_storable(fields[2])
+            || strchr(fields[2], '/')
+            || !parse_int64(fields[3], &size)
+            || !parse_int64(fields[4], &mtime)
+            || !parse_int64(fields[5], &val))
+            goto exit;
+
+        if (foreign) {
+            cache->foreign = g_slist_prepend(cache->foreign,
+                                             g_strdup(fields[2]));
+            goto exit;
+        }
+
+        cr_DeltaRecord *rec = g_new0(cr_DeltaRecord, 1);
+        rec->filename   = g_strdup(fields[2]);
+        rec->size       = size;
+        rec->mtime      = mtime;
+        rec->build_us   = val;
+        g_hash_table_replace(cache->deltas,
+                             g_strconcat(fields[0], "\t", fields[1], NULL),
+                             rec);
+        cache->stats.records++;
+    } else if (line[0] == 'P' && line[1] == '\t' && !foreign) {
+        fields = g_strsplit(line + 2, "\t", 5);
+        if (g_strv_length(fields) != 5
+            || !parse_int64(fields[0], &size)
+            || !parse_int64(fields[1], &mtime)
+            || !parse_int64(fields[2], &val)
+            || !*fields[3] || !is_storable(fields[4]))
+            goto exit;
+
+        cr_PkgIdRecord *rec = g_new0(cr_PkgIdRecord, 1);
+        rec->size   = size;
+        rec->mtime  = mtime;
+        rec->ino    = val;
+        rec->pkgid  = g_strdup(fields[3]);
+        g_hash_table_replace(cache->pkgids, g_strdup(fields[4]), rec);
+    }
+
+exit:
+    g_strfreev(fields);
+}
+
+cr_DeltaCache *
+cr_deltacache_open(const char *dir,
+                   cr_ChecksumType checksum_type,
+                   GError **err)
+{
+    cr_DeltaCache *cache;
+    gchar *content = NULL;
+    GError *tmp_err = NULL;
+
+    assert(dir);
+    assert(!err || *err == NULL);
+
+    if (!cr_checksum_name_str(checksum_type)) {
+        g_set_error(err, ERR_DOMAIN, CRE_UNKNOWNCHECKSUMTYPE,
+                    "Unknown checksum type");
+        return NULL;
+    }
+
+    cache = g_new0(cr_DeltaCache, 1);
+    cache->dir              = g_strdup(dir);
+    cache->path             = g_build_filename(dir, CR_DELTA_CACHE_FILENAME,
+                                               NULL);
+    cache->checksum_type    = checksum_type;
+    cache->deltas           = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                    g_free,
+                                    (GDestroyNotify) cr_deltarecord_free);
+    cache->pkgids           = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                    g_free,
+                                    (GDestroyNotify) cr_pkgidrecord_free);
+    cache->mutex            = g_mutex_new();
+
+    if (!g_file_get_contents(cache->path, &content, NULL, &tmp_err)) {
+        if (g_error_matches(tmp_err, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+            // No index yet
+            g_error_free(tmp_err);
+            return cache;
+        }
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "Cannot read %s: %s", cache->path, tmp_err->message);
+        g_error_free(tmp_err);
+        deltacache_free(cache);
+        return NULL;
+    }
+
+    gchar **lines = g_strsplit(content, "\n", 0);
+    g_free(content);
+
+    // Keys made with another checksum type are useless
+    gchar *header = g_strdup_printf("%s %s", CACHE_HEADER,
+                                    cr_checksum_name_str(checksum_type));
+    gboolean foreign = g_strcmp0(lines[0], header) != 0;
+    g_free(header);
+
+    if (lines[0])
+        for (gchar **line = lines + 1; *line; line++)
+            load_record(cache, *line, foreign);
+    g_strfreev(lines);
+
+    g_debug("%s: %s: %"G_GUINT64_FORMAT" records loaded%s", __func__,
+            cache->path, cache->stats.records,
+            foreign ? " (different checksum type)" : "");
+
+    return cache;
+}
+
+gchar *
+cr_deltacache_pkgid(cr_DeltaCache *cache, const char *path, GError **err)
+{
+    struct stat st;
+    cr_PkgIdRecord *rec;
+    gchar *pkgid;
+
+    assert(cache);
+    assert(path);
+    assert(!err || *err == NULL);
+
+    if (stat(path, &st) == -1) {
+        g_set_error(err, ERR_DOMAIN, CRE_STAT,
+                    "Cannot stat %s: %s", path, g_strerror(errno));
+        return NULL;
+    }
+
+    g_mutex_lock(cache->mutex);
+    rec = g_hash_table_lookup(cache->pkgids, path);
+    if (rec && rec->size == (gint64) st.st_size
+            && rec->mtime == (gint64) st.st_mtime
+            && rec->ino == (gint64) st.st_ino)
+    {
+        rec->used = TRUE;
+        pkgid = g_strdup(rec->pkgid);
+        g_mutex_unlock(cache->mutex);
+        return pkgid;
+    }
+    g_mutex_unlock(cache->mutex);
+
+    pkgid = cr_checksum_file(path, cache->checksum_type, err);
+    if (!pkgid)
+        return NULL;
+
+    if (!is_storable(path))
+        return pkgid;
+
+    rec = g_new0(cr_PkgIdRecord, 1);
+    rec->size   = st.st_size;
+    rec->mtime  = st.st_mtime;
+    rec->ino    = st.st_ino;
+    rec->pkgid  = g_strdup(pkgid);
+    rec->used   = TRUE;
+
+    g_mutex_lock(cache->mutex);
+    g_hash_table_replace(cache->pkgids, g_strdup(path), rec);
+    g_mutex_unlock(cache->mutex);
+
+    return pkgid;
+}
+
+gchar *
+cr_deltacache_lookup(cr_DeltaCache *cache,
+                     const char *old_pkgid,
+                     const char *new_pkgid)
+{
+    gchar *key, *path = NULL;
+    cr_DeltaRecord *rec;
+    struct stat st;
+
+    assert(cache);
+    assert(old_pkgid);
+    assert(new_pkgid);
+
+    key = g_strconcat(old_pkgid, "\t", new_pkgid, NULL);
+
+    g_mutex_lock(cache->mutex);
+    rec = g_hash_table_lookup(cache->deltas, key);
+    if (rec) {
+        path = g_build_filename(cache->dir, rec->filename, NULL);
+        if (stat(path, &st) == 0 && S_ISREG(st.st_mode)
+            && rec->size == (gint64) st.st_size
+            && rec->mtime == (gint64) st.st_mtime)
+        {
+            rec->used = TRUE;
+            cache->stats.hits++;
+            cache->stats.saved_us += rec->build_us;
+        } else {
+            // Delta was removed or modified
+            g_debug("%s: %s is not valid anymore", __func__, path);
+            g_hash_table_remove(cache->deltas, key);
+            g_free(path);
+            path = NULL;
+        }
+    }
+    if (!path)
+        cache->stats.misses++;
+    g_mutex_unlock(cache->mutex);
+
+    g_free(key);
+    return path;
+}
+
+int
+cr_deltacache_insert(cr_DeltaCache *cache,
+                     const char *old_pkgid,
+                     const char *new_pkgid,
+                     const char *drpm_path,
+                     gint64 build_us,
+                     GError **err)
+{
+    cr_DeltaRecord *rec;
+    struct stat st;
+    gchar *filename, *path;
+
+    assert(cache);
+    assert(old_pkgid);
+    assert(new_pkgid);
+    assert(drpm_path);
+    assert(!err || *err == NULL);
+
+    if (!is_storable(old_pkgid) || !is_storable(new_pkgid)) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG, "Bad checksum");
+        return CRE_BADARG;
+    }
+
+    filename = g_path_get_basename(drpm_path);
+    path = g_build_filename(cache->dir, filename, NULL);
+    if (stat(path, &st) == -1) {
+        g_set_error(err, ERR_DOMAIN, CRE_STAT,
+                    "Cannot stat %s: %s", path, g_strerror(errno));
+        g_free(filename);
+        g_free(path);
+        return CRE_STAT;
+    }
+    g_free(path);
+
+    if (!is_storable(filename)) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "Unsupported filename: %s", filename);
+        g_free(filename);
+        return CRE_BADARG;
+    }
+
+    rec = g_new0(cr_DeltaRecord, 1);
+    rec->filename   = filename;
+    rec->size       = st.st_size;
+    rec->mtime      = st.st_mtime;
+    rec->build_us   = build_us;
+    rec->used       = TRUE;
+
+    g_mutex_lock(cache->mutex);
+    g_hash_table_replace(cache->deltas,
+                         g_strconcat(old_pkgid, "\t", new_pkgid, NULL),
+                         rec);
+    cache->stats.inserts++;
+    g_mutex_unlock(cache->mutex);
+
+    return CRE_OK;
+}
+
+/** Remove a delta file unless it's in the keep table.
+ */
+static void
+prune_file(cr_DeltaCache *cache, GHashTable *keep, const char *filename)
+{
+    if (g_hash_table_lookup(keep, filename))
+        return;
+
+    // The same file could be referenced by several stale records
+    g_hash_table_insert(keep, g_strdup(filename), GINT_TO_POINTER(1));
+
+    gchar *path = g_build_filename(cache->dir, filename, NULL);
+    if (g_remove(path) == -1) {
+        if (errno != ENOENT)
+            g_warning("Cannot remove stale delta %s: %s",
+                      path, g_strerror(errno));
+    } else {
+        g_debug("%s: Removed stale delta %s", __func__, path);
+        cache->stats.pruned++;
+    }
+    g_free(path);
+}
+
+int
+cr_deltacache_prune(cr_DeltaCache *cache, GError **err)
+{
+    GHashTable *keep;
+    GHashTableIter iter;
+    gpointer key, value;
+
+    assert(cache);
+    assert(!err || *err == NULL);
+
+    // Files referenced by used records must stay
+    keep = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    g_hash_table_iter_init(&iter, cache->deltas);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        cr_DeltaRecord *rec = value;
+        if (rec->used)
+            g_hash_table_insert(keep, g_strdup(rec->filename),
+                                GINT_TO_POINTER(1));
+    }
+
+    for (GSList *elem = cache->foreign; elem; elem = g_slist_next(elem))
+        prune_file(cache, keep, elem->data);
+    g_slist_free_full(cache->foreign, g_free);
+    cache->foreign = NULL;
+
+    g_hash_table_iter_init(&iter, cache->deltas);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        cr_DeltaRecord *rec = value;
+        if (!rec->used) {
+            prune_file(cache, keep, rec->filename);
+            g_hash_table_iter_remove(&iter);
+        }
+    }
+
+    g_hash_table_destroy(keep);
+
+    return CRE_OK;
+}
+
+void
+cr_deltacache_stats(cr_DeltaCache *cache, cr_DeltaCacheStats *stats)
+{
+    assert(cache);
+    assert(stats);
+
+    g_mutex_lock(cache->mutex);
+    *stats = cache->stats;
+    g_mutex_unlock(cache->mutex);
+}
+
+int
+cr_deltacache_close(cr_DeltaCache *cache, GError **err)
+{
+    int ret = CRE_OK;
+    GString *out;
+    GHashTableIter iter;
+    gpointer key, value;
+    GError *tmp_err = NULL;
+
+    assert(!err || *err == NULL);
+
+    if (!cache)
+        return CRE_OK;
+
+    out = g_string_new(NULL);
+    g_string_append_printf(out, "%s %s\n", CACHE_HEADER,
+                           cr_checksum_name_str(cache->checksum_type));
+
+    g_hash_table_iter_init(&iter, cache->deltas);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        cr_DeltaRecord *rec = value;
+        g_string_append_printf(out, "D\t%s\t%s\t%"G_GINT64_FORMAT
+                               "\t%"G_GINT64_FORMAT"\t%"G_GINT64_FORMAT"\n",
+                               (char *) key, rec->filename, rec->size,
+                               rec->mtime, rec->build_us);
+    }
+
+    // Remember only packages that were used during this run
+    g_hash_table_iter_init(&iter, cache->pkgids);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        cr_PkgIdRecord *rec = value;
+        if (!rec->used)
+            continue;
+        g_string_append_printf(out, "P\t%"G_GINT64_FORMAT"\t%"G_GINT64_FORMAT
+                               "\t%"G_GINT64_FORMAT"\t%s\t%s\n",
+                               rec->size, rec->mtime, rec->ino,
+                               rec->pkgid, (char *) key);
+    }
+
+    if (!g_file_set_contents(cache->path, out->str, out->len, &tmp_err)) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO, "Cannot write %s: %s",
+                    cache->path, tmp_err->message);
+        g_error_free(tmp_err);
+        ret = CRE_IO;
+    }
+
+    g_string_free(out, TRUE);
+    deltacache_free(cache);
+
+    return ret;
+}
+
+
+/*
+ * Cache of rendered prestodelta.xml chunks
+ */
+
+/** A <delta> element rendered during a previous run.
+ */
+typedef struct {
+    gint64      size;
+    gint64      mtime;
+    gint64      ino;
+    gchar       *nevra;
+    gchar       *xml_chunk;
+} cr_PrestoDeltaCacheRecord;
+
+struct _cr_PrestoDeltaCache {
+    cr_ChecksumType checksum_type;  // Checksum type used in the chunks
+    GHashTable      *records;       // Drpm path -> cr_PrestoDeltaCacheRecord
+};
+
+static void
+cr_prestodeltacacherecord_free(cr_PrestoDeltaCacheRecord *rec)
+{
+    if (!rec)
+        return;
+    g_free(rec->nevra);
+    g_free(rec->xml_chunk);
+    g_free(rec);
+}
+
+cr_PrestoDeltaCache *
+cr_prestodeltacache_new(cr_ChecksumType checksum_type)
+{
+    cr_PrestoDeltaCache *cache = g_new0(cr_PrestoDeltaCache, 1);
+    cache->checksum_type    = checksum_type;
+    cache->records          = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                g_free,
+                                (GDestroyNotify) cr_prestodeltacacherecord_free);
+    return cache;
+}
+
+cr_PrestoDeltaCache *
+cr_prestodeltacache_load(const char *path, cr_ChecksumType checksum_type)
+{
+    cr_PrestoDeltaCache *cache;
+    gchar *content = NULL, *header;
+    gchar **lines;
+    guint count;
+
+    cache = cr_prestodeltacache_new(checksum_type);
+
+    if (!path || !g_file_get_contents(path, &content, NULL, NULL))
+        return cache;
+
+    lines = g_strsplit(content, "\n", 0);
+    g_free(content);
+
+    // A line without the trailing newline comes from a truncated file
+    count = g_strv_length(lines);
+    if (count) {
+        g_free(lines[count-1]);
+        lines[count-1] = NULL;
+    }
+
+    header = g_strdup_printf("%s %s", PRESTODELTA_HEADER,
+                             cr_checksum_name_str(checksum_type));
+    if (lines[0] && !g_strcmp0(lines[0], header)) {
+        for (gchar **line = lines + 1; *line; line++) {
+            gchar **fields = g_strsplit(*line, "\t", 6);
+            gint64 size, mtime, ino;
+
+            if (g_strv_length(fields) == 6
+                && parse_int64(fields[0], &size)
+                && parse_int64(fields[1], &mtime)
+                && parse_int64(fields[2], &ino)
+                && *fields[3] && *fields[4] && *fields[5])
+            {
+                cr_PrestoDeltaCacheRecord *rec;
+                rec = g_new0(cr_PrestoDeltaCacheRecord, 1);
+                rec->size       = size;
+                rec->mtime      = mtime;
+                rec->ino        = ino;
+                rec->nevra      = g_strcompress(fields[4]);
+                rec->xml_chunk  = g_strcompress(fields[5]);
+                g_hash_table_replace(cache->records, g_strdup(fields[3]), rec);
+            }
+            g_strfreev(fields);
+        }
+    }
+    g_free(header);
+    g_strfreev(lines);
+
+    g_debug("%s: %s: %u records loaded", __func__, path,
+            g_hash_table_size(cache->records));
+
+    return cache;
+}
+
+gboolean
+cr_prestodeltacache_lookup(cr_PrestoDeltaCache *cache,
+                           const char *drpm_path,
+                           gint64 size,
+                           gint64 mtime,
+                           gint64 ino,
+                           gchar **nevra,
+                           gchar **xml_chunk)
+{
+    cr_PrestoDeltaCacheRecord *rec;
+
+    assert(cache);
+    assert(drpm_path);
+    assert(nevra && xml_chunk);
+
+    rec = g_hash_table_lookup(cache->records, drpm_path);
+    if (!rec || rec->size != size || rec->mtime != mtime || rec->ino != ino)
+        return FALSE;
+
+    *nevra      = g_strdup(rec->nevra);
+    *xml_chunk  = g_strdup(rec->xml_chunk);
+    return TRUE;
+}
+
+void
+cr_prestodeltacache_set(cr_PrestoDeltaCache *cache,
+                        const char *drpm_path,
+                        gint64 size,
+                        gint64 mtime,
+                        gint64 ino,
+                        const char *nevra,
+                        const char *xml_chunk)
+{
+    cr_PrestoDeltaCacheRecord *rec;
+
+    assert(cache);
+    assert(drpm_path);
+
+    if (!is_storable(drpm_path) || !nevra || !*nevra
+        || !xml_chunk || !*xml_chunk)
+        return;
+
+    rec = g_new0(cr_PrestoDeltaCacheRecord, 1);
+    rec->size       = size;
+    rec->mtime      = mtime;
+    rec->ino        = ino;
+    rec->nevra      = g_strdup(nevra);
+    rec->xml_chunk  = g_strdup(xml_chunk);
+    g_hash_table_replace(cache->records, g_strdup(drpm_path), rec);
+}
+
+guint
+cr_prestodeltacache_size(cr_PrestoDeltaCache *cache)
+{
+    assert(cache);
+    return g_hash_table_size(cache->records);
+}
+
+int
+cr_prestodeltacache_write(cr_PrestoDeltaCache *cache,
+                          const char *path,
+                          GError **err)
+{
+    int ret = CRE_OK;
+    GString *out;
+    GHashTableIter iter;
+    gpointer key, value;
+    GError *tmp_err = NULL;
+
+    assert(cache);
+    assert(path);
+    assert(!err || *err == NULL);
+
+    out = g_string_new(NULL);
+    g_string_append_printf(out, "%s %s\n", PRESTODELTA_HEADER,
+                           cr_checksum_name_str(cache->checksum_type));
+
+    g_hash_table_iter_init(&iter, cache->records);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        cr_PrestoDeltaCacheRecord *rec = value;
+        gchar *nevra = g_strescape(rec->nevra, NULL);
+        gchar *chunk = g_strescape(rec->xml_chunk, NULL);
+        g_string_append_printf(out, "%"G_GINT64_FORMAT"\t%"G_GINT64_FORMAT
+                               "\t%"G_GINT64_FORMAT"\t%s\t%s\t%s\n",
+                               rec->size, rec->mtime, rec->ino,
+                               (char *) key, nevra, chunk);
+        g_free(nevra);
+        g_free(chunk);
+    }
+
+    if (!g_file_set_contents(path, out->str, out->len, &tmp_err)) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO, "Cannot write %s: %s",
+                    path, tmp_err->message);
+        g_error_free(tmp_err);
+        ret = CRE_IO;
+    }
+
+    g_string_free(out, TRUE);
+    return ret;
+}
+
+void
+cr_prestodeltacache_free(cr_PrestoDeltaCache *cache)
+{
+    if (!cache)
+        return;
+    g_hash_table_destroy(cache->records);
+    g_free(cache);
+}
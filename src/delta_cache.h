@@ -0,0 +1,236 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#ifndef __C_CREATEREPOLIB_DELTA_CACHE_H__
+#define __C_CREATEREPOLIB_DELTA_CACHE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <glib.h>
+#include "checksum.h"
+
+/** \defgroup   delta_cache  Persistent cache of generated deltarpms.
+ *
+ * Deltas are keyed by checksums (pkgIds) of the old and the new
+ * package. A delta found in the cache is reused as long as its file
+ * in the cache directory has the recorded size and mtime.
+ * To avoid rehashing of unchanged packages on every run, pkgIds of
+ * package files are remembered together with their size, mtime
+ * and inode.
+ *
+ * The index is a single text file inside of the directory with
+ * the deltas. It is loaded by cr_deltacache_open() and written
+ * by cr_deltacache_close(). Records (one per line):
+ * \code
+ * D\t<old pkgId>\t<new pkgId>\t<drpm filename>\t<size>\t<mtime>\t<build us>
+ * P\t<size>\t<mtime>\t<inode>\t<pkgId>\t<package path>
+ * \endcode
+ *
+ * \addtogroup delta_cache
+ *  @{
+ */
+
+/** Default name of the index file inside of the delta directory.
+ */
+#define CR_DELTA_CACHE_FILENAME     ".deltacache"
+
+/** Delta cache.
+ */
+typedef struct _cr_DeltaCache cr_DeltaCache;
+
+/** Statistics of a delta cache usage.
+ */
+typedef struct {
+    guint64 records;    /*!< Number of delta records loaded from the index */
+    guint64 hits;       /*!< Number of reused deltas */
+    guint64 misses;     /*!< Number of unsuccessful lookups */
+    guint64 inserts;    /*!< Number of newly generated deltas */
+    guint64 pruned;     /*!< Number of removed stale deltas */
+    gint64  saved_us;   /*!< Time that generation of the reused deltas
+                             took originally (microseconds) */
+} cr_DeltaCacheStats;
+
+/** Open a delta cache and load its index (if it exists).
+ * Records made with another checksum type are not used, deltas
+ * referenced by them are removed by cr_deltacache_prune().
+ * @param dir           Directory with deltas.
+ * @param checksum_type Type of checksums used as keys.
+ * @param err           GError **
+ * @return              cr_DeltaCache or NULL on error
+ */
+cr_DeltaCache *cr_deltacache_open(const char *dir,
+                                  cr_ChecksumType checksum_type,
+                                  GError **err);
+
+/** Get checksum of a package file. The remembered value is used
+ * if size, mtime and inode of the file didn't change. Thread safe.
+ * @param cache         cr_DeltaCache
+ * @param path          Path to the package.
+ * @param err           GError **
+ * @return              Malloced checksum or NULL on error
+ */
+gchar *cr_deltacache_pkgid(cr_DeltaCache *cache,
+                           const char *path,
+                           GError **err);
+
+/** Look up a delta. Thread safe.
+ * @param cache         cr_DeltaCache
+ * @param old_pkgid     Checksum of the old package.
+ * @param new_pkgid     Checksum of the new package.
+ * @return              Malloced path to the existing delta or NULL
+ */
+gchar *cr_deltacache_lookup(cr_DeltaCache *cache,
+                            const char *old_pkgid,
+                            const char *new_pkgid);
+
+/** Record a newly generated delta. Thread safe.
+ * @param cache         cr_DeltaCache
+ * @param old_pkgid     Checksum of the old package.
+ * @param new_pkgid     Checksum of the new package.
+ * @param drpm_path     Path to the delta (must be in the cache directory).
+ * @param build_us      Time spent by the generation (microseconds).
+ * @param err           GError **
+ * @return              cr_Error code
+ */
+int cr_deltacache_insert(cr_DeltaCache *cache,
+                         const char *old_pkgid,
+                         const char *new_pkgid,
+                         const char *drpm_path,
+                         gint64 build_us,
+                         GError **err);
+
+/** Remove deltas that were neither looked up nor inserted since
+ * the cache was opened. Call it only after a successful delta
+ * generation. Must not be called while other threads use the cache.
+ * @param cache         cr_DeltaCache
+ * @param err           GError **
+ * @return              cr_Error code
+ */
+int cr_deltacache_prune(cr_DeltaCache *cache, GError **err);
+
+/** Get usage statistics of the cache.
+ * @param cache         cr_DeltaCache
+ * @param stats         cr_DeltaCacheStats to be filled
+ */
+void cr_deltacache_stats(cr_DeltaCache *cache, cr_DeltaCacheStats *stats);
+
+/** Write the index and free the cache.
+ * @param cache         cr_DeltaCache
+ * @param err           GError **
+ * @return              cr_Error code
+ */
+int cr_deltacache_close(cr_DeltaCache *cache, GError **err);
+
+/** Cache of rendered prestodelta.xml chunks.
+ *
+ * Keeps the <delta> element and the NEVRA of the new package for every
+ * drpm of the previous run, so unchanged drpms are neither parsed nor
+ * checksummed again. A record is valid as long as the drpm has the
+ * recorded size, mtime and inode. Records (one per line, the NEVRA and
+ * the chunk are escaped by g_strescape()):
+ * \code
+ * <size>\t<mtime>\t<inode>\t<drpm path>\t<nevra>\t<chunk>
+ * \endcode
+ */
+typedef struct _cr_PrestoDeltaCache cr_PrestoDeltaCache;
+
+/** Create an empty prestodelta cache.
+ * @param checksum_type Checksum type used in the chunks.
+ * @return              cr_PrestoDeltaCache
+ */
+cr_PrestoDeltaCache *cr_prestodeltacache_new(cr_ChecksumType checksum_type);
+
+/** Load a prestodelta cache file. A missing, unreadable or damaged file
+ * and a file written for another checksum type are not errors, such
+ * file (or its damaged records) is simply ignored.
+ * @param path          Path to the cache file or NULL.
+ * @param checksum_type Checksum type used in the chunks.
+ * @return              cr_PrestoDeltaCache
+ */
+cr_PrestoDeltaCache *cr_prestodeltacache_load(const char *path,
+                                              cr_ChecksumType checksum_type);
+
+/** Get the chunk rendered for the drpm, if the drpm was not changed.
+ * Can be called from several threads at once as long as nobody
+ * modifies the cache.
+ * @param cache         cr_PrestoDeltaCache
+ * @param drpm_path     Path to the drpm.
+ * @param size          Current size of the drpm.
+ * @param mtime         Current mtime of the drpm.
+ * @param ino           Current inode of the drpm.
+ * @param nevra         NEVRA of the new package (newly allocated).
+ * @param xml_chunk     The <delta> element (newly allocated).
+ * @return              TRUE on a hit
+ */
+gboolean cr_prestodeltacache_lookup(cr_PrestoDeltaCache *cache,
+                                    const char *drpm_path,
+                                    gint64 size,
+                                    gint64 mtime,
+                                    gint64 ino,
+                                    gchar **nevra,
+                                    gchar **xml_chunk);
+
+/** Remember the chunk rendered for the drpm. Drpms with a path that
+ * cannot be stored are silently skipped.
+ * @param cache         cr_PrestoDeltaCache
+ * @param drpm_path     Path to the drpm.
+ * @param size          Size of the drpm.
+ * @param mtime         Mtime of the drpm.
+ * @param ino           Inode of the drpm.
+ * @param nevra         NEVRA of the new package.
+ * @param xml_chunk     The <delta> element.
+ */
+void cr_prestodeltacache_set(cr_PrestoDeltaCache *cache,
+                             const char *drpm_path,
+                             gint64 size,
+                             gint64 mtime,
+                             gint64 ino,
+                             const char *nevra,
+                             const char *xml_chunk);
+
+/** Number of records in the cache.
+ * @param cache         cr_PrestoDeltaCache
+ * @return              Number of records
+ */
+guint cr_prestodeltacache_size(cr_PrestoDeltaCache *cache);
+
+/** Write the cache file.
+ * @param cache         cr_PrestoDeltaCache
+ * @param path          Path to the cache file.
+ * @param err           GError **
+ * @return              cr_Error code
+ */
+int cr_prestodeltacache_write(cr_PrestoDeltaCache *cache,
+                              const char *path,
+                              GError **err);
+
+/** Free the cache.
+ * @param cache         cr_PrestoDeltaCache
+ */
+void cr_prestodeltacache_free(cr_PrestoDeltaCache *cache);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __C_CREATEREPOLIB_DELTA_CACHE_H__ */
@@ -34,6 +34,7 @@
 #include "parsepkg.h"
 #include "misc.h"
 #include "error.h"
+#include "profile.h"
 
 
 #define ERR_DOMAIN      CREATEREPO_C_ERROR
@@ -280,6 +281,7 @@ typedef struct {
     const char *outdeltadir;
     gint num_deltas;
     GHashTable *oldpackages;
+    cr_DeltaCache *cache;
     GMutex *mutex;
     gint64 active_work_size;
     gint active_tasks;
@@ -304,6 +306,7 @@ cr_delta_thread(gpointer data, gpointer udata)
     cr_DeltaTask *task = data;
     cr_DeltaThreadUserData *user_data = udata;
     cr_DeltaTargetPackage *tpkg = task->tpkg;  // Shortcut
+    gchar *new_pkgid = g_strdup(tpkg->pkgid);
 
     GHashTableIter iter;
     gpointer key, value;
@@ -359,20 +362,66 @@ cr_delta_thread(gpointer data, gpointer udata)
         for (GSList *lelem = local_candidates; lelem; lelem = g_slist_next(lelem)){
             GError *tmp_err = NULL;
             cr_DeltaTargetPackage *old = lelem->data;
+            gchar *old_pkgid = NULL, *drpmpath = NULL;
+            gint64 start;
+
+            // Reuse the delta from a previous run
+            if (user_data->cache) {
+                if (!new_pkgid)
+                    new_pkgid = cr_deltacache_pkgid(user_data->cache,
+                                                    tpkg->path, NULL);
+                if (new_pkgid)
+                    old_pkgid = cr_deltacache_pkgid(user_data->cache,
+                                                    old->path, NULL);
+                if (old_pkgid)
+                    drpmpath = cr_deltacache_lookup(user_data->cache,
+                                                    old_pkgid, new_pkgid);
+                if (drpmpath) {
+                    g_debug("Reusing delta %s -> %s: %s",
+                            old->path, tpkg->path, drpmpath);
+                    cr_profile_count(CR_PROF_CNT_DELTAS_REUSED, 1);
+                    g_free(drpmpath);
+                    g_free(old_pkgid);
+                    if (++x == user_data->num_deltas)
+                        break;
+                    continue;
+                }
+            }
 
             g_debug("Generating delta %s -> %s", old->path, tpkg->path);
-            cr_drpm_create(old, tpkg, user_data->outdeltadir, &tmp_err);
+            start = g_get_monotonic_time();
+            drpmpath = cr_drpm_create(old, tpkg, user_data->outdeltadir,
+                                      &tmp_err);
             if (tmp_err) {
                 g_warning("Cannot generate delta %s -> %s : %s",
                           old->path, tpkg->path, tmp_err->message);
                 g_error_free(tmp_err);
+                g_free(old_pkgid);
                 continue;
             }
+            cr_profile_count(CR_PROF_CNT_DELTAS_GENERATED, 1);
+
+            if (old_pkgid) {
+                cr_deltacache_insert(user_data->cache, old_pkgid, new_pkgid,
+                                     drpmpath,
+                                     g_get_monotonic_time() - start,
+                                     &tmp_err);
+                if (tmp_err) {
+                    g_warning("Cannot cache delta %s: %s",
+                              drpmpath, tmp_err->message);
+                    g_clear_error(&tmp_err);
+                }
+            }
+
+            g_free(drpmpath);
+            g_free(old_pkgid);
             if (++x == user_data->num_deltas)
                 break;
         }
     }
 
+    g_free(new_pkgid);
+
     g_debug("Deltas for \"%s\" (%"G_GINT64_FORMAT") generated",
             tpkg->name, tpkg->size_installed);
 
@@ -408,6 +457,7 @@ cr_deltarpms_parallel_deltas(GSList *targetpackages,
                    gint workers,
                    gint64 max_delta_rpm_size,
                    gint64 max_work_size,
+                   cr_DeltaCache *cache,
                    GError **err)
 {
     GThreadPool *pool;
@@ -430,6 +480,7 @@ cr_deltarpms_parallel_deltas(GSList *targetpackages,
     user_data.outdeltadir           = outdeltadir;
     user_data.num_deltas            = num_deltas;
     user_data.oldpackages           = oldpackages;
+    user_data.cache                 = cache;
     user_data.mutex                 = g_mutex_new();
     user_data.active_work_size      = G_GINT64_CONSTANT(0);
     user_data.active_tasks          = 0;
@@ -526,6 +577,7 @@ cr_deltatargetpackage_from_package(cr_Package *pkg,
     tpkg->location_href = cr_safe_string_chunk_insert(tpkg->chunk, pkg->location_href);
     tpkg->size_installed = pkg->size_installed;
     tpkg->path = cr_safe_string_chunk_insert(tpkg->chunk, path);
+    tpkg->pkgid = cr_safe_string_chunk_insert_null(tpkg->chunk, pkg->pkgId);
 
     return tpkg;
 }
@@ -640,11 +692,16 @@ cr_deltarpms_scan_targetdir(const char *path,
 
 typedef struct {
     gchar *full_path;
+    gchar *nevra;       // NEVRA of the new package (filled by the thread)
+    gchar *xml_chunk;   // <delta> element (filled by the thread)
+    gint64 size;        // Stat info of the drpm (filled by the thread)
+    gint64 mtime;
+    gint64 ino;
+    gboolean cached;    // Was the chunk taken from the cache?
 } cr_PrestoDeltaTask;
 
 typedef struct {
-    GMutex *mutex;
-    GHashTable *ht;
+    cr_PrestoDeltaCache *cache; // Read only while the pool is running
     cr_ChecksumType checksum_type;
     const gchar *prefix_to_strip;
     size_t prefix_len;
@@ -656,9 +713,18 @@ cr_prestodeltatask_free(cr_PrestoDeltaTask *task)
     if (!task)
         return;
     g_free(task->full_path);
+    g_free(task->nevra);
+    g_free(task->xml_chunk);
     g_free(task);
 }
 
+static gint
+cmp_prestodeltatask_path(gconstpointer a, gconstpointer b)
+{
+    return g_strcmp0(((const cr_PrestoDeltaTask *) a)->full_path,
+                     ((const cr_PrestoDeltaTask *) b)->full_path);
+}
+
 static gboolean
 walk_drpmsdir(const gchar *drpmsdir, GSList **inlist, GError **err)
 {
@@ -671,17 +737,19 @@ walk_drpmsdir(const gchar *drpmsdir, GSList **inlist, GError **err)
     assert(inlist);
     assert(!err || *err == NULL);
 
-    g_queue_push_head(sub_dirs, g_strdup(drpmsdir));
+    g_queue_push_head(sub_dirs, g_string_chunk_insert(sub_dirs_chunk,
+                                                      drpmsdir));
 
     // Recursively walk the drpmsdir
     gchar *dirname;
     while ((dirname = g_queue_pop_head(sub_dirs))) {
 
         // Open the directory
-        GDir *dirp = g_dir_open(drpmsdir, 0, NULL);
+        GDir *dirp = g_dir_open(dirname, 0, NULL);
         if (!dirp) {
             g_set_error(err, ERR_DOMAIN, CRE_IO,
-                        "Cannot open directory %s", drpmsdir);
+                        "Cannot open directory %s", dirname);
+            ret = FALSE;
             goto exit;
         }
 
@@ -709,7 +777,6 @@ walk_drpmsdir(const gchar *drpmsdir, GSList **inlist, GError **err)
             task->full_path = full_path;
             candidates = g_slist_prepend(candidates, task);
         }
-        g_free(dirname);
         g_dir_close(dirp);
     }
 
@@ -718,7 +785,7 @@ walk_drpmsdir(const gchar *drpmsdir, GSList **inlist, GError **err)
 
 exit:
     g_slist_free_full(candidates, (GDestroyNotify) cr_prestodeltatask_free);
-    cr_queue_free_full(sub_dirs, g_free);
+    g_queue_free(sub_dirs);
     g_string_chunk_free(sub_dirs_chunk);
 
     return ret;
@@ -733,10 +800,28 @@ cr_prestodelta_thread(gpointer data, gpointer udata)
 
     cr_DeltaPackage *dpkg = NULL;
     struct stat st;
-    gchar *xml_chunk = NULL, *key = NULL, *checksum = NULL;
+    gchar *xml_chunk = NULL, *checksum = NULL;
     GError *tmp_err = NULL;
 
-    printf("%s\n", task->full_path);
+    // Stat the package (to get the size and to validate the cache)
+    if (stat(task->full_path, &st) == -1) {
+        g_warning("%s: stat(%s) error (%s)", __func__,
+                  task->full_path, g_strerror(errno));
+        return;
+    }
+
+    task->size  = st.st_size;
+    task->mtime = st.st_mtime;
+    task->ino   = st.st_ino;
+
+    // Use the chunk rendered during a previous run
+    if (cr_prestodeltacache_lookup(user_data->cache, task->full_path,
+                                   task->size, task->mtime, task->ino,
+                                   &task->nevra, &task->xml_chunk))
+    {
+        task->cached = TRUE;
+        return;
+    }
 
     // Load delta package
     dpkg = cr_deltapackage_from_drpm_base(task->full_path, 0, 0, &tmp_err);
@@ -751,14 +836,7 @@ cr_prestodelta_thread(gpointer data, gpointer udata)
                                     dpkg->package->chunk,
                                     task->full_path + user_data->prefix_len);
 
-    // Stat the package (to get the size)
-    if (stat(task->full_path, &st) == -1) {
-        g_warning("%s: stat(%s) error (%s)", __func__,
-                  task->full_path, g_strerror(errno));
-        goto exit;
-    } else {
-        dpkg->package->size_package = st.st_size;
-    }
+    dpkg->package->size_package = st.st_size;
 
     // Calculate the checksum
     checksum = cr_checksum_file(task->full_path,
@@ -786,30 +864,11 @@ cr_prestodelta_thread(gpointer data, gpointer udata)
         goto exit;
     }
 
-    // Put the XML into the shared hash table
-    gpointer pkey = NULL;
-    gpointer pval = NULL;
-    key = cr_package_nevra(dpkg->package);
-    g_mutex_lock(user_data->mutex);
-    if (g_hash_table_lookup_extended(user_data->ht, key, &pkey, &pval)) {
-        // Key exists in the table
-        // 1. Remove the key and value from the table without freeing them
-        g_hash_table_steal(user_data->ht, key);
-        // 2. Append to the list (the value from the hash table)
-        GSList *list = (GSList *) pval;
-        list = g_slist_append(pval, xml_chunk);
-        // 3. Insert the modified list again
-        g_hash_table_insert(user_data->ht, pkey, list);
-    } else {
-        // Key doesn't exist yet
-        GSList *list = g_slist_prepend(NULL, xml_chunk);
-        g_hash_table_insert(user_data->ht, g_strdup(key), list);
-    }
-    g_mutex_unlock(user_data->mutex);
+    task->nevra     = cr_package_nevra(dpkg->package);
+    task->xml_chunk = xml_chunk;
 
 exit:
     g_free(checksum);
-    g_free(key);
     cr_deltapackage_free(dpkg);
 }
 
@@ -849,15 +908,17 @@ cr_deltarpms_generate_prestodelta_file(const gchar *drpmsdir,
                                        cr_ChecksumType checksum_type,
                                        gint workers,
                                        const gchar *prefix_to_strip,
+                                       const gchar *cache_path,
                                        GError **err)
 {
     gboolean ret = TRUE;
     GSList *candidates = NULL;
     GThreadPool *pool;
     cr_PrestoDeltaUserData user_data;
-    GHashTable *ht = NULL;
-    GHashTableIter iter;
-    gpointer key, value;
+    cr_PrestoDeltaCache *cache = NULL;
+    GHashTable *groups = NULL;
+    GPtrArray *nevras = NULL;
+    guint hits = 0, misses = 0;
     GError *tmp_err = NULL;
 
     assert(drpmsdir);
@@ -872,15 +933,14 @@ cr_deltarpms_generate_prestodelta_file(const gchar *drpmsdir,
         goto exit;
     }
 
+    // Make the output independent on the order of directory entries
+    candidates = g_slist_sort(candidates, cmp_prestodeltatask_path);
+
     // Setup pool of workers
 
-    ht = g_hash_table_new_full(g_str_hash,
-                               g_str_equal,
-                               (GDestroyNotify) g_free,
-                               (GDestroyNotify) cr_free_gslist_of_strings);
+    cache = cr_prestodeltacache_load(cache_path, checksum_type);
 
-    user_data.mutex             = g_mutex_new();
-    user_data.ht                = ht;
+    user_data.cache             = cache;
     user_data.checksum_type     = checksum_type;
     user_data.prefix_to_strip   = prefix_to_strip,
     user_data.prefix_len        = prefix_to_strip ? strlen(prefix_to_strip) : 0;
@@ -907,23 +967,71 @@ cr_deltarpms_generate_prestodelta_file(const gchar *drpmsdir,
 
     g_thread_pool_free(pool, FALSE, TRUE);
 
-    // Write out the results
+    // Group deltas by the new package. Groups are written in order
+    // of their first delta, deltas in a group are sorted by path.
 
+    groups = g_hash_table_new(g_str_hash, g_str_equal);
+    nevras = g_ptr_array_new();
+    for (GSList *elem = candidates; elem; elem = g_slist_next(elem)) {
+        cr_PrestoDeltaTask *task = elem->data;
+        GSList *list;
 
-    g_hash_table_iter_init(&iter, user_data.ht);
-    while (g_hash_table_iter_next(&iter, &key, &value)) {
-        gchar *chunk = NULL;
-        gchar *nevra = key;
+        if (!task->xml_chunk)
+            continue;
 
-        chunk = gen_newpackage_xml_chunk(nevra, (GSList *) value);
+        if (task->cached)
+            hits++;
+        else
+            misses++;
+
+        list = g_hash_table_lookup(groups, task->nevra);
+        if (!list)
+            g_ptr_array_add(nevras, task->nevra);
+        g_hash_table_insert(groups, task->nevra,
+                            g_slist_prepend(list, task->xml_chunk));
+    }
+
+    // Write out the results
+
+    for (guint x = 0; x < nevras->len; x++) {
+        gchar *nevra = g_ptr_array_index(nevras, x);
+        GSList *list = g_slist_reverse(g_hash_table_lookup(groups, nevra));
+        gchar *chunk = gen_newpackage_xml_chunk(nevra, list);
         cr_xmlfile_add_chunk(f, chunk, NULL);
         g_free(chunk);
+        g_slist_free(list);
+    }
+
+    g_debug("%s: %u deltas (%u from cache)", __func__, hits + misses, hits);
+
+    // Update the cache if anything changed
+
+    if (cache_path && (misses || hits != cr_prestodeltacache_size(cache))) {
+        cr_PrestoDeltaCache *new_cache;
+
+        // Only current drpms are remembered
+        new_cache = cr_prestodeltacache_new(checksum_type);
+        for (GSList *elem = candidates; elem; elem = g_slist_next(elem)) {
+            cr_PrestoDeltaTask *task = elem->data;
+            cr_prestodeltacache_set(new_cache, task->full_path, task->size,
+                                    task->mtime, task->ino, task->nevra,
+                                    task->xml_chunk);
+        }
+
+        if (cr_prestodeltacache_write(new_cache, cache_path, &tmp_err)) {
+            g_warning("%s", tmp_err->message);
+            g_clear_error(&tmp_err);
+        }
+        cr_prestodeltacache_free(new_cache);
     }
 
 exit:
     g_slist_free_full(candidates, (GDestroyNotify) cr_prestodeltatask_free);
-    g_mutex_free(user_data.mutex);
-    g_hash_table_destroy(ht);
+    if (nevras)
+        g_ptr_array_free(nevras, TRUE);
+    if (groups)
+        g_hash_table_destroy(groups);
+    cr_prestodeltacache_free(cache);
 
     return ret;
 }
@@ -0,0 +1,186 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <assert.h>
+#include <string.h>
+#include "error.h"
+#include "dictionary.h"
+#include "xml_dump.h"
+
+#ifdef WITH_ZSTD
+#include <zdict.h>
+#endif
+
+#define ERR_DOMAIN      CREATEREPO_C_ERROR
+
+struct _cr_DictTrainer {
+    gsize dict_size;        /*!< Maximal size of the dictionary */
+    GByteArray *samples;    /*!< All samples one after another */
+    GArray *sizes;          /*!< Sizes (size_t) of the samples */
+};
+
+cr_DictTrainer *
+cr_dicttrainer_new(gsize dict_size)
+{
+    cr_DictTrainer *trainer = g_new0(cr_DictTrainer, 1);
+    trainer->dict_size = dict_size ? dict_size : CR_DICT_DEFAULT_SIZE;
+    trainer->samples = g_byte_array_new();
+    trainer->sizes = g_array_new(FALSE, FALSE, sizeof(size_t));
+    return trainer;
+}
+
+void
+cr_dicttrainer_add_sample(cr_DictTrainer *trainer,
+                          const void *sample,
+                          gsize len)
+{
+    size_t size = len;
+
+    assert(trainer);
+
+    if (!sample || len == 0)
+        return;
+
+    g_byte_array_append(trainer->samples, sample, len);
+    g_array_append_val(trainer->sizes, size);
+}
+
+guint
+cr_dicttrainer_samples(cr_DictTrainer *trainer)
+{
+    assert(trainer);
+    return trainer->sizes->len;
+}
+
+int
+cr_dicttrainer_train(cr_DictTrainer *trainer,
+                     void **dict,
+                     gsize *dict_len,
+                     GError **err)
+{
+    assert(trainer);
+    assert(dict);
+    assert(dict_len);
+    assert(!err || *err == NULL);
+
+    *dict = NULL;
+    *dict_len = 0;
+
+    if (trainer->sizes->len == 0) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "No samples to train a dictionary from");
+        return CRE_BADARG;
+    }
+
+#ifdef WITH_ZSTD
+    void *buf = g_malloc(trainer->dict_size);
+    size_t rc = ZDICT_trainFromBuffer(buf,
+                                      trainer->dict_size,
+                                      trainer->samples->data,
+                                      (size_t *) trainer->sizes->data,
+                                      trainer->sizes->len);
+    if (ZDICT_isError(rc)) {
+        g_set_error(err, ERR_DOMAIN, CRE_ZSTD,
+                    "Cannot train a dictionary from %u samples (%u bytes): %s",
+                    trainer->sizes->len, trainer->samples->len,
+                    ZDICT_getErrorName(rc));
+        g_free(buf);
+        return CRE_ZSTD;
+    }
+
+    g_debug("%s: Trained %zu bytes dictionary from %u samples (%u bytes)",
+            __func__, rc, trainer->sizes->len, trainer->samples->len);
+
+    *dict = g_realloc(buf, rc);
+    *dict_len = rc;
+    return CRE_OK;
+#else
+    g_set_error(err, ERR_DOMAIN, CRE_ZSTD,
+                "createrepo_c was built without Zstandard support");
+    return CRE_ZSTD;
+#endif
+}
+
+void
+cr_dicttrainer_free(cr_DictTrainer *trainer)
+{
+    if (!trainer)
+        return;
+    g_byte_array_free(trainer->samples, TRUE);
+    g_array_free(trainer->sizes, TRUE);
+    g_free(trainer);
+}
+
+int
+cr_dict_train_from_metadata(cr_Metadata *md,
+                            cr_XmlFileType type,
+                            gsize dict_size,
+                            guint max_samples,
+                            void **dict,
+                            gsize *dict_len,
+                            GError **err)
+{
+    int ret;
+    guint total, step, x = 0;
+    GList *keys;
+    GHashTable *ht;
+    cr_DictTrainer *trainer;
+    char *(*dump)(cr_Package *, GError **);
+
+    assert(md);
+    assert(!err || *err == NULL);
+
+    switch (type) {
+        case CR_XMLFILE_PRIMARY:    dump = cr_xml_dump_primary;     break;
+        case CR_XMLFILE_FILELISTS:  dump = cr_xml_dump_filelists;   break;
+        case CR_XMLFILE_OTHER:      dump = cr_xml_dump_other;       break;
+        default:
+            g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                        "Unsupported type of metadata file: %d", type);
+            return CRE_BADARG;
+    }
+
+    if (!max_samples)
+        max_samples = CR_DICT_DEFAULT_SAMPLES;
+
+    // Hashtable order is random, sort the keys to make the sample
+    // (and thus the dictionary) reproducible
+    ht = cr_metadata_hashtable(md);
+    keys = g_list_sort(g_hash_table_get_keys(ht), (GCompareFunc) g_strcmp0);
+    total = g_list_length(keys);
+    step = (total > max_samples) ? total / max_samples : 1;
+
+    trainer = cr_dicttrainer_new(dict_size);
+    for (GList *elem = keys; elem; elem = g_list_next(elem), x++) {
+        if (x % step || cr_dicttrainer_samples(trainer) >= max_samples)
+            continue;
+
+        cr_Package *pkg = g_hash_table_lookup(ht, elem->data);
+        char *chunk = dump(pkg, NULL);
+        if (chunk)
+            cr_dicttrainer_add_sample(trainer, chunk, strlen(chunk));
+        g_free(chunk);
+    }
+    g_list_free(keys);
+
+    ret = cr_dicttrainer_train(trainer, dict, dict_len, err);
+    cr_dicttrainer_free(trainer);
+    return ret;
+}
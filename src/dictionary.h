@@ -0,0 +1,134 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#ifndef __C_CREATEREPOLIB_DICTIONARY_H__
+#define __C_CREATEREPOLIB_DICTIONARY_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <glib.h>
+#include "load_metadata.h"
+#include "xml_file.h"
+
+/** \defgroup   dictionary  Training of compression dictionaries.
+ *
+ * Metadata files consist of many small and very similar chunks
+ * (one per package). A dictionary trained from a sample of such chunks
+ * considerably improves the ratio of formats which compress chunks
+ * independently (zchunk). Use the dictionary via cr_set_dict().
+ *
+ * \code
+ * cr_DictTrainer *trainer = cr_dicttrainer_new(CR_DICT_DEFAULT_SIZE);
+ * cr_dicttrainer_add_sample(trainer, xml_chunk, strlen(xml_chunk));
+ * ...
+ * cr_dicttrainer_train(trainer, &dict, &dict_len, &err);
+ * cr_dicttrainer_free(trainer);
+ * \endcode
+ *
+ * \addtogroup dictionary
+ *  @{
+ */
+
+/** Default maximal size of a trained dictionary.
+ */
+#define CR_DICT_DEFAULT_SIZE        (64 * 1024)
+
+/** Default maximal number of packages sampled from a cr_Metadata.
+ */
+#define CR_DICT_DEFAULT_SAMPLES     4096
+
+/** Suffix of dictionary files.
+ */
+#define CR_DICT_SUFFIX              ".zdict"
+
+/** Collector of samples for a dictionary training.
+ */
+typedef struct _cr_DictTrainer cr_DictTrainer;
+
+/** Create a new trainer.
+ * @param dict_size     Maximal size of the resulting dictionary
+ *                      (0 for CR_DICT_DEFAULT_SIZE)
+ * @return              New cr_DictTrainer
+ */
+cr_DictTrainer *cr_dicttrainer_new(gsize dict_size);
+
+/** Add a sample (e.g. XML chunk of a single package).
+ * @param trainer       cr_DictTrainer
+ * @param sample        Data of the sample
+ * @param len           Length of the sample
+ */
+void cr_dicttrainer_add_sample(cr_DictTrainer *trainer,
+                               const void *sample,
+                               gsize len);
+
+/** Number of samples added so far.
+ * @param trainer       cr_DictTrainer
+ * @return              Number of samples
+ */
+guint cr_dicttrainer_samples(cr_DictTrainer *trainer);
+
+/** Train a dictionary from the added samples.
+ * @param trainer       cr_DictTrainer
+ * @param dict          Malloced dictionary (free it with g_free())
+ * @param dict_len      Length of the dictionary
+ * @param err           GError **
+ * @return              cr_Error code
+ */
+int cr_dicttrainer_train(cr_DictTrainer *trainer,
+                         void **dict,
+                         gsize *dict_len,
+                         GError **err);
+
+/** Free the trainer and all its samples.
+ * @param trainer       cr_DictTrainer
+ */
+void cr_dicttrainer_free(cr_DictTrainer *trainer);
+
+/** Train a dictionary for a metadata file from loaded metadata.
+ * Packages are sampled in order of their hashtable keys, so the same
+ * metadata always result in the same dictionary.
+ * @param md            Loaded metadata
+ * @param type          CR_XMLFILE_PRIMARY, CR_XMLFILE_FILELISTS
+ *                      or CR_XMLFILE_OTHER
+ * @param dict_size     Maximal size of the dictionary
+ *                      (0 for CR_DICT_DEFAULT_SIZE)
+ * @param max_samples   Maximal number of sampled packages
+ *                      (0 for CR_DICT_DEFAULT_SAMPLES)
+ * @param dict          Malloced dictionary (free it with g_free())
+ * @param dict_len      Length of the dictionary
+ * @param err           GError **
+ * @return              cr_Error code
+ */
+int cr_dict_train_from_metadata(cr_Metadata *md,
+                                cr_XmlFileType type,
+                                gsize dict_size,
+                                guint max_samples,
+                                void **dict,
+                                gsize *dict_len,
+                                GError **err);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __C_CREATEREPOLIB_DICTIONARY_H__ */
@@ -24,19 +24,25 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/sem.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include "checksum.h"
+#include "checksum_cache.h"
 #include "cleanup.h"
 #include "deltarpms.h"
 #include "dumper_thread.h"
 #include "error.h"
 #include "misc.h"
 #include "parsepkg.h"
+#include "profile.h"
 #include "xml_dump.h"
 
 #define MAX_TASK_BUFFER_LEN         20
-#define CACHEDCHKSUM_BUFFER_LEN     2048
+#define MAX_IDLE_INODES             256
 
 struct BufferedTask {
     long id;                        // ID of the task
@@ -62,6 +68,189 @@ buf_task_sort_func(gconstpointer a, gconstpointer b, G_GNUC_UNUSED gpointer data
 }
 
 
+/** Identification of a package file shared by hardlinks.
+ */
+struct InodeKey {
+    dev_t dev;
+    ino_t ino;
+    gint64 size;
+    gint64 mtime;
+};
+
+/** Package read from a file with more hardlinks.
+ */
+struct InodeSlot {
+    struct InodeKey key;
+    GMutex *mutex;                  // Held while the package is being read
+    cr_Package *pkg;                // Package of the first link or NULL
+    gint64 remaining;               // Links which were not processed yet
+    guint users;                    // Tasks which hold the slot
+    GList *idle_link;               // Link in cr_DumperInodes.idle or NULL
+};
+
+/** Packages read from files with more hardlinks.
+ */
+struct _cr_DumperInodes {
+    GHashTable *slots;              // struct InodeSlot by struct InodeKey
+    GQueue idle;                    // Slots held by no task, oldest first
+};
+
+static guint
+inode_key_hash(gconstpointer key)
+{
+    const struct InodeKey *k = key;
+    return (guint) (k->ino ^ (k->ino >> 32) ^ k->dev);
+}
+
+static gboolean
+inode_key_equal(gconstpointer a, gconstpointer b)
+{
+    const struct InodeKey *ka = a;
+    const struct InodeKey *kb = b;
+    return ka->ino == kb->ino && ka->dev == kb->dev
+           && ka->size == kb->size && ka->mtime == kb->mtime;
+}
+
+static void
+inode_slot_free(struct InodeSlot *slot)
+{
+    g_mutex_free(slot->mutex);
+    cr_package_free(slot->pkg);
+    g_free(slot);
+}
+
+cr_DumperInodes *
+cr_dumper_inodes_new(void)
+{
+    cr_DumperInodes *inodes = g_new0(cr_DumperInodes, 1);
+    inodes->slots = g_hash_table_new_full(inode_key_hash,
+                                          inode_key_equal,
+                                          NULL,
+                                          (GDestroyNotify) inode_slot_free);
+    g_queue_init(&inodes->idle);
+    return inodes;
+}
+
+void
+cr_dumper_inodes_free(cr_DumperInodes *inodes)
+{
+    if (!inodes)
+        return;
+    g_queue_clear(&inodes->idle);
+    g_hash_table_destroy(inodes->slots);
+    g_free(inodes);
+}
+
+/** Get locked slot of a file with more hardlinks.
+ * @return              Locked slot or NULL if the file has a single link
+ */
+static struct InodeSlot *
+inode_slot_acquire(struct UserData *udata, const struct stat *st)
+{
+    struct InodeKey key;
+    struct InodeSlot *slot;
+
+    if (!udata->inodes || st->st_nlink < 2)
+        return NULL;
+
+    memset(&key, 0, sizeof(key));
+    key.dev   = st->st_dev;
+    key.ino   = st->st_ino;
+    key.size  = st->st_size;
+    key.mtime = st->st_mtime;
+
+    g_mutex_lock(udata->mutex_inodes);
+    slot = g_hash_table_lookup(udata->inodes->slots, &key);
+    if (!slot) {
+        slot = g_new0(struct InodeSlot, 1);
+        slot->key = key;
+        slot->mutex = g_mutex_new();
+        slot->remaining = st->st_nlink;
+        g_hash_table_insert(udata->inodes->slots, &slot->key, slot);
+    } else if (slot->idle_link) {
+        g_queue_delete_link(&udata->inodes->idle, slot->idle_link);
+        slot->idle_link = NULL;
+    }
+    slot->users++;
+    g_mutex_unlock(udata->mutex_inodes);
+
+    // Wait until a task which reads the same file is done
+    g_mutex_lock(slot->mutex);
+    return slot;
+}
+
+/** Unlock the slot. The slot is freed if all links were processed.
+ * Otherwise it is kept for the other links, but only the last
+ * MAX_IDLE_INODES unused slots are kept: st_nlink counts also links
+ * which are never processed (links outside of the input directory or
+ * packages with reused old metadata), so the remaining links cannot
+ * be relied on. Links of a package usually share the file name and
+ * tasks are sorted by file name, so they are processed close together.
+ * @param reused        Package of the task was copied from the slot
+ */
+static void
+inode_slot_release(struct UserData *udata,
+                   struct InodeSlot *slot,
+                   gboolean reused)
+{
+    cr_DumperInodes *inodes = udata->inodes;
+
+    g_mutex_unlock(slot->mutex);
+
+    g_mutex_lock(udata->mutex_inodes);
+    if (reused)
+        udata->hardlinks_reused++;
+    slot->users--;
+    slot->remaining--;
+    if (slot->users == 0) {
+        if (slot->remaining <= 0) {
+            g_hash_table_remove(inodes->slots, &slot->key);
+        } else {
+            g_queue_push_tail(&inodes->idle, slot);
+            slot->idle_link = g_queue_peek_tail_link(&inodes->idle);
+        }
+    }
+    while (g_queue_get_length(&inodes->idle) > MAX_IDLE_INODES) {
+        struct InodeSlot *oldest = g_queue_pop_head(&inodes->idle);
+        g_hash_table_remove(inodes->slots, &oldest->key);
+    }
+    g_mutex_unlock(udata->mutex_inodes);
+}
+
+/** Take a worker of the pool shared by all repositories of a --batch run.
+ * @return              TRUE if the worker has to be returned
+ */
+static gboolean
+batch_worker_acquire(struct UserData *udata)
+{
+    // SEM_UNDO returns workers of a process which dies
+    struct sembuf op = { 0, -1, SEM_UNDO };
+
+    if (udata->workers_sem == -1)
+        return FALSE;
+
+    while (semop(udata->workers_sem, &op, 1) == -1) {
+        if (errno == EINTR)
+            continue;
+        g_warning("Cannot get a worker of the batch: %s", g_strerror(errno));
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/** Return the worker taken by batch_worker_acquire().
+ */
+static void
+batch_worker_release(struct UserData *udata)
+{
+    struct sembuf op = { 0, 1, SEM_UNDO };
+
+    if (semop(udata->workers_sem, &op, 1) == -1)
+        g_warning("Cannot return a worker of the batch: %s",
+                  g_strerror(errno));
+}
+
+
 static void
 write_pkg(long id,
           struct cr_XmlStruct res,
@@ -69,13 +258,22 @@ write_pkg(long id,
           struct UserData *udata)
 {
     GError *tmp_err = NULL;
+    gint64 prof_start;
 
     // Write primary data
+    prof_start = cr_profile_start();
     g_mutex_lock(udata->mutex_pri);
     while (udata->id_pri != id)
         g_cond_wait (udata->cond_pri, udata->mutex_pri);
     ++udata->id_pri;
-    cr_xmlfile_add_chunk(udata->pri_f, (const char *) res.primary, &tmp_err);
+    cr_profile_sample(CR_PROF_HIST_WAIT_PRIMARY,
+                      cr_profile_stop(CR_PROF_WAIT_PRIMARY, prof_start));
+    prof_start = cr_profile_start();
+    cr_xmlfile_add_pkg_chunk(udata->pri_f, (const char *) res.primary,
+                             pkg->pkgId, &tmp_err);
+    if (!tmp_err && udata->pri_zck)
+        cr_xmlfile_add_chunk(udata->pri_zck, (const char *) res.primary, &tmp_err);
+    cr_profile_stop(CR_PROF_WRITE_PRIMARY, prof_start);
     if (tmp_err) {
         g_critical("Cannot add primary chunk:\n%s\nError: %s",
                    res.primary, tmp_err->message);
@@ -97,11 +295,19 @@ write_pkg(long id,
     g_mutex_unlock(udata->mutex_pri);
 
     // Write fielists data
+    prof_start = cr_profile_start();
     g_mutex_lock(udata->mutex_fil);
     while (udata->id_fil != id)
         g_cond_wait (udata->cond_fil, udata->mutex_fil);
     ++udata->id_fil;
-    cr_xmlfile_add_chunk(udata->fil_f, (const char *) res.filelists, &tmp_err);
+    cr_profile_sample(CR_PROF_HIST_WAIT_FILELISTS,
+                      cr_profile_stop(CR_PROF_WAIT_FILELISTS, prof_start));
+    prof_start = cr_profile_start();
+    cr_xmlfile_add_pkg_chunk(udata->fil_f, (const char *) res.filelists,
+                             pkg->pkgId, &tmp_err);
+    if (!tmp_err && udata->fil_zck)
+        cr_xmlfile_add_chunk(udata->fil_zck, (const char *) res.filelists, &tmp_err);
+    cr_profile_stop(CR_PROF_WRITE_FILELISTS, prof_start);
     if (tmp_err) {
         g_critical("Cannot add filelists chunk:\n%s\nError: %s",
                    res.filelists, tmp_err->message);
@@ -123,11 +329,19 @@ write_pkg(long id,
     g_mutex_unlock(udata->mutex_fil);
 
     // Write other data
+    prof_start = cr_profile_start();
     g_mutex_lock(udata->mutex_oth);
     while (udata->id_oth != id)
         g_cond_wait (udata->cond_oth, udata->mutex_oth);
     ++udata->id_oth;
-    cr_xmlfile_add_chunk(udata->oth_f, (const char *) res.other, &tmp_err);
+    cr_profile_sample(CR_PROF_HIST_WAIT_OTHER,
+                      cr_profile_stop(CR_PROF_WAIT_OTHER, prof_start));
+    prof_start = cr_profile_start();
+    cr_xmlfile_add_pkg_chunk(udata->oth_f, (const char *) res.other,
+                             pkg->pkgId, &tmp_err);
+    if (!tmp_err && udata->oth_zck)
+        cr_xmlfile_add_chunk(udata->oth_zck, (const char *) res.other, &tmp_err);
+    cr_profile_stop(CR_PROF_WRITE_OTHER, prof_start);
     if (tmp_err) {
         g_critical("Cannot add other chunk:\n%s\nError: %s",
                    res.other, tmp_err->message);
@@ -153,16 +367,56 @@ static char *
 get_checksum(const char *filename,
              cr_ChecksumType type,
              cr_Package *pkg,
-             const char *cachedir,
+             cr_ChecksumCache *cache,
+             cr_ChecksumManifest *manifest,
+             const char *relative_path,
+             gboolean shared_file,
              GError **err)
 {
     GError *tmp_err = NULL;
     char *checksum = NULL;
-    char *cachefn = NULL;
+    char *cachekey = NULL;
+    int lock_fd = -1;
+
+    if (manifest) {
+        // Try the precomputed checksum
+        gboolean verify;
+        const char *known;
+
+        known = cr_checksummanifest_lookup(manifest, relative_path,
+                                           pkg->size_package, pkg->time_file,
+                                           &verify);
+        if (known && !verify) {
+            g_debug("Checksum from manifest used: %s: \"%s\"",
+                    relative_path, known);
+            return g_strdup(known);
+        }
+
+        if (known) {
+            checksum = cr_checksum_file(filename, type, &tmp_err);
+            if (!checksum) {
+                g_propagate_prefixed_error(err, tmp_err,
+                                           "Error while checksum calculation: ");
+                return NULL;
+            }
 
-    if (cachedir) {
-        // Prepare cache fn
+            if (strcmp(checksum, known)) {
+                g_critical("Wrong checksum of %s in the checksum manifest: "
+                           "\"%s\" (computed \"%s\")",
+                           relative_path, known, checksum);
+                cr_checksummanifest_verified(manifest, FALSE);
+            } else {
+                cr_checksummanifest_verified(manifest, TRUE);
+            }
+
+            return checksum;
+        }
+    }
+
+    if (cache) {
+        // Prepare cache key
         char *key;
+        const char *cached;
         cr_ChecksumCtx *ctx = cr_checksum_new(type, err);
         if (!ctx) return NULL;
 
@@ -176,26 +430,33 @@ get_checksum(const char *filename,
         key = cr_checksum_final(ctx, err);
         if (!key) return NULL;
 
-        cachefn = g_strdup_printf("%s%s-%s-%"G_GINT64_FORMAT"-%"G_GINT64_FORMAT,
-                                  cachedir,
-                                  cr_get_filename(pkg->location_href),
-                                  key, pkg->size_installed, pkg->time_file);
+        cachekey = g_strdup_printf("%s-%s-%"G_GINT64_FORMAT"-%"G_GINT64_FORMAT,
+                                   cr_get_filename(pkg->location_href),
+                                   key, pkg->size_installed, pkg->time_file);
         free(key);
 
         // Try to load checksum
-        FILE *f = fopen(cachefn, "r");
-        if (f) {
-            char buf[CACHEDCHKSUM_BUFFER_LEN];
-            size_t readed = fread(buf, 1, CACHEDCHKSUM_BUFFER_LEN, f);
-            if (!ferror(f) && readed > 0) {
-                checksum = g_strndup(buf, readed);
-            }
-            fclose(f);
+        cached = cr_checksumcache_lookup(cache, cachekey);
+        if (cached) {
+            g_debug("Cached checksum used: %s: \"%s\"", cachekey, cached);
+            checksum = g_strdup(cached);
+            goto exit;
         }
 
-        if (checksum) {
-            g_debug("Cached checksum used: %s: \"%s\"", cachefn, checksum);
-            goto exit;
+        // Another process could compute checksum of the same file
+        // (a hardlink in its repository) right now. The lock of the file
+        // makes it wait and use the computed checksum from the cache.
+        if (shared_file) {
+            lock_fd = open(filename, O_RDONLY);
+            if (lock_fd != -1 && flock(lock_fd, LOCK_EX) == 0) {
+                cached = cr_checksumcache_lookup(cache, cachekey);
+                if (cached) {
+                    g_debug("Cached checksum used: %s: \"%s\"",
+                            cachekey, cached);
+                    checksum = g_strdup(cached);
+                    goto exit;
+                }
+            }
         }
     }
 
@@ -208,22 +469,22 @@ get_checksum(const char *filename,
     }
 
     // Cache the checksum value
-    if (cachefn && !g_file_test(cachefn, G_FILE_TEST_EXISTS)) {
-        gchar *template = g_strconcat(cachefn, "-XXXXXX", NULL);
-        gint fd = g_mkstemp(template);
-        if (fd < 0) {
-            g_free(template);
-            goto exit;
+    if (cachekey) {
+        cr_checksumcache_insert(cache, cachekey, checksum, &tmp_err);
+        // Write it before the file is unlocked
+        if (!tmp_err && lock_fd != -1)
+            cr_checksumcache_flush(cache, &tmp_err);
+        if (tmp_err) {
+            g_warning("Cannot cache checksum of %s: %s",
+                      filename, tmp_err->message);
+            g_clear_error(&tmp_err);
         }
-        write(fd, checksum, strlen(checksum));
-        close(fd);
-        if (g_rename(template, cachefn) == -1)
-            g_remove(template);
-        g_free(template);
     }
 
 exit:
-    g_free(cachefn);
+    if (lock_fd != -1)
+        close(lock_fd);     // Unlocks the file
+    g_free(cachekey);
 
     return checksum;
 }
@@ -246,25 +507,64 @@ prepare_split_media_baseurl(int media_id, const char *location_base)
     return g_strdup_printf("%s#%d", tmp_location_base, media_id);
 }
 
+/** Can be the package from old metadata used for a file with the stat?
+ */
+static gboolean
+old_md_usable(struct UserData *udata,
+              cr_Package *md,
+              const struct stat *stat_buf)
+{
+    if (udata->skip_stat)
+        return TRUE;
+
+    return stat_buf->st_mtime == md->time_file
+           && stat_buf->st_size == md->size_package
+           && !strcmp(udata->checksum_type_str, md->checksum_type);
+}
+
+gboolean
+cr_dumper_prefetch_skip(const char *path,
+                        const struct stat *st,
+                        gpointer user_data)
+{
+    struct UserData *udata = user_data;
+    cr_Package *md;
+
+    if (!udata->old_metadata)
+        return FALSE;
+
+    md = g_hash_table_lookup(cr_metadata_hashtable(udata->old_metadata),
+                             cr_get_filename(path));
+    return md && old_md_usable(udata, md, st);
+}
+
 static cr_Package *
 load_rpm(const char *fullpath,
          cr_ChecksumType checksum_type,
-         const char *checksum_cachedir,
+         cr_ChecksumCache *checksum_cache,
+         cr_ChecksumManifest *checksum_manifest,
+         gboolean shared_cache,
+         const char *relative_path,
          const char *location_href,
          const char *location_base,
          int changelog_limit,
          struct stat *stat_buf,
          cr_HeaderReadingFlags hdrrflags,
+         const cr_PrefetchResult *prefetched,
          GError **err)
 {
     cr_Package *pkg = NULL;
     GError *tmp_err = NULL;
+    gint64 prof_start;
+    nlink_t nlink;
 
     assert(fullpath);
     assert(!err || *err == NULL);
 
     // Get a package object
+    prof_start = cr_profile_start();
     pkg = cr_package_from_rpm_base(fullpath, changelog_limit, hdrrflags, err);
+    cr_profile_stop(CR_PROF_HEADER_READ, prof_start);
     if (!pkg)
         goto errexit;
 
@@ -279,7 +579,10 @@ load_rpm(const char *fullpath,
     // Get file stat
     if (!stat_buf) {
         struct stat stat_buf_own;
-        if (stat(fullpath, &stat_buf_own) == -1) {
+        prof_start = cr_profile_start();
+        int rc = stat(fullpath, &stat_buf_own);
+        cr_profile_stop(CR_PROF_STAT, prof_start);
+        if (rc == -1) {
             g_warning("%s: stat(%s) error (%s)", __func__,
                       fullpath, g_strerror(errno));
             g_set_error(err,  CREATEREPO_C_ERROR, CRE_IO, "stat(%s) failed: %s",
@@ -288,31 +591,54 @@ load_rpm(const char *fullpath,
         }
         pkg->time_file    = stat_buf_own.st_mtime;
         pkg->size_package = stat_buf_own.st_size;
+        nlink             = stat_buf_own.st_nlink;
     } else {
         pkg->time_file    = stat_buf->st_mtime;
         pkg->size_package = stat_buf->st_size;
+        nlink             = stat_buf->st_nlink;
+    }
+
+    // Get header range
+    // Note: This must be done before the checksum calculation, because
+    // cr_checksum_file() drops the file content from the page cache.
+    // The mmap header reader fills the range on its own
+    if (prefetched) {
+        pkg->rpm_header_start = prefetched->hdr_range.start;
+        pkg->rpm_header_end = prefetched->hdr_range.end;
+    } else if (!pkg->rpm_header_end) {
+        struct cr_HeaderRangeStruct hdr_r;
+        prof_start = cr_profile_start();
+        hdr_r = cr_get_header_byte_range(fullpath, &tmp_err);
+        cr_profile_stop(CR_PROF_HEADER_RANGE, prof_start);
+        if (tmp_err) {
+            g_propagate_prefixed_error(err, tmp_err,
+                                       "Error while determinig header range: ");
+            goto errexit;
+        }
+
+        pkg->rpm_header_start = hdr_r.start;
+        pkg->rpm_header_end = hdr_r.end;
     }
 
     // Compute checksum
-    char *checksum = get_checksum(fullpath, checksum_type, pkg,
-                                  checksum_cachedir, &tmp_err);
-    if (!checksum)
+    // Only a file with more links can be in other repositories of the batch
+    char *checksum;
+    prof_start = cr_profile_start();
+    if (prefetched && prefetched->checksum)
+        checksum = g_strdup(prefetched->checksum);
+    else
+        checksum = get_checksum(fullpath, checksum_type, pkg,
+                                checksum_cache, checksum_manifest,
+                                relative_path, shared_cache && nlink > 1,
+                                &tmp_err);
+    cr_profile_stop(CR_PROF_CHECKSUM, prof_start);
+    if (!checksum) {
+        g_propagate_error(err, tmp_err);
         goto errexit;
+    }
     pkg->pkgId = cr_safe_string_chunk_insert(pkg->chunk, checksum);
     free(checksum);
 
-    // Get header range
-    struct cr_HeaderRangeStruct hdr_r = cr_get_header_byte_range(fullpath,
-                                                                 &tmp_err);
-    if (tmp_err) {
-        g_propagate_prefixed_error(err, tmp_err,
-                                   "Error while determinig header range: ");
-        goto errexit;
-    }
-
-    pkg->rpm_header_start = hdr_r.start;
-    pkg->rpm_header_end = hdr_r.end;
-
     return pkg;
 
 errexit:
@@ -330,6 +656,10 @@ cr_dumper_thread(gpointer data, gpointer user_data)
     struct stat stat_buf;       // Struct with info from stat() on file
     struct cr_XmlStruct res;    // Structure for generated XML
     cr_HeaderReadingFlags hdrrflags = CR_HDRR_NONE;
+    cr_PrefetchResult *prefetched = NULL; // Result of read-ahead
+    gint64 prof_start;
+    gboolean have_stat = FALSE; // Is stat_buf filled?
+    gboolean batch_worker = FALSE; // Has a worker of the --batch run?
 
     struct UserData *udata = (struct UserData *) user_data;
     struct PoolTask *task  = (struct PoolTask *) data;
@@ -364,15 +694,35 @@ cr_dumper_thread(gpointer data, gpointer user_data)
     }
 
     // If --cachedir is used, load signatures and hdrid from packages too
-    if (udata->checksum_cachedir)
+    if (udata->checksum_cache)
         hdrrflags = CR_HDRR_LOADHDRID | CR_HDRR_LOADSIGNATURES;
 
+    // Get the package read ahead by the prefetch threads
+    if (udata->prefetch) {
+        prefetched = cr_prefetch_get(udata->prefetch, task->id);
+        if (prefetched && prefetched->err) {
+            // Let the usual code report the error
+            g_debug("Prefetch of %s failed: %s",
+                    task->full_path, prefetched->err->message);
+            prefetched = NULL;
+        }
+    }
+
     // Get stat info about file
-    if (udata->old_metadata && !(udata->skip_stat)) {
-        if (stat(task->full_path, &stat_buf) == -1) {
+    cr_profile_count(CR_PROF_CNT_PACKAGES, 1);
+    if (prefetched) {
+        stat_buf = prefetched->st;
+        have_stat = TRUE;
+    } else if (udata->old_metadata && !(udata->skip_stat)) {
+        prof_start = cr_profile_start();
+        int rc = stat(task->full_path, &stat_buf);
+        cr_profile_stop(CR_PROF_STAT, prof_start);
+        if (rc == -1) {
             g_critical("Stat() on %s: %s", task->full_path, g_strerror(errno));
+            cr_profile_count(CR_PROF_CNT_PACKAGES_FAILED, 1);
             goto task_cleanup;
         }
+        have_stat = TRUE;
     }
 
     // Update stuff
@@ -385,12 +735,7 @@ cr_dumper_thread(gpointer data, gpointer user_data)
         if (md) {
             g_debug("CACHE HIT %s", task->filename);
 
-            if (udata->skip_stat) {
-                old_used = TRUE;
-            } else if (stat_buf.st_mtime == md->time_file
-                       && stat_buf.st_size == md->size_package
-                       && !strcmp(udata->checksum_type_str, md->checksum_type))
-            {
+            if (old_md_usable(udata, md, &stat_buf)) {
                 old_used = TRUE;
             } else {
                 g_debug("%s metadata are obsolete -> generating new",
@@ -412,42 +757,111 @@ cr_dumper_thread(gpointer data, gpointer user_data)
 
     // Load package and gen XML metadata
     if (!old_used) {
-        // Load package from file
-        pkg = load_rpm(task->full_path, udata->checksum_type,
-                       udata->checksum_cachedir, location_href,
-                       location_base, udata->changelog_limit,
-                       NULL, hdrrflags, &tmp_err);
-        assert(pkg || tmp_err);
+        struct InodeSlot *slot = NULL;
+        gboolean reused = FALSE;
+
+        batch_worker = batch_worker_acquire(udata);
+
+        // Stat info identifies hardlinks of already read files
+        if (!have_stat) {
+            prof_start = cr_profile_start();
+            have_stat = (stat(task->full_path, &stat_buf) == 0);
+            cr_profile_stop(CR_PROF_STAT, prof_start);
+        }
+
+        if (have_stat)
+            slot = inode_slot_acquire(udata, &stat_buf);
+
+        if (slot && slot->pkg) {
+            // Other link of the file was already read
+            pkg = cr_package_copy(slot->pkg);
+            pkg->location_href = cr_safe_string_chunk_insert(pkg->chunk,
+                                                             location_href);
+            pkg->location_base = cr_safe_string_chunk_insert(pkg->chunk,
+                                                             location_base);
+            reused = TRUE;
+            cr_profile_count(CR_PROF_CNT_PACKAGES_DEDUPED, 1);
+        } else {
+            // Load package from file
+            if (prefetched && prefetched->read)
+                cr_profile_count(CR_PROF_CNT_PACKAGES_PREFETCHED, 1);
+            pkg = load_rpm(task->full_path, udata->checksum_type,
+                           udata->checksum_cache, udata->checksum_manifest,
+                           udata->shared_checksum_cache,
+                           task->full_path + udata->repodir_name_len,
+                           location_href, location_base,
+                           udata->changelog_limit,
+                           have_stat ? &stat_buf : NULL, hdrrflags,
+                           (prefetched && prefetched->read) ? prefetched : NULL,
+                           &tmp_err);
+            assert(pkg || tmp_err);
+
+            if (slot && pkg) {
+                slot->pkg = cr_package_copy(pkg);
+                g_mutex_lock(udata->mutex_inodes);
+                udata->hardlinks_read++;
+                g_mutex_unlock(udata->mutex_inodes);
+            }
+        }
+
+        if (slot)
+            inode_slot_release(udata, slot, reused);
 
         if (!pkg) {
             g_warning("Cannot read package: %s: %s",
                       task->full_path, tmp_err->message);
             udata->had_errors = TRUE;
             g_clear_error(&tmp_err);
+            cr_profile_count(CR_PROF_CNT_PACKAGES_FAILED, 1);
             goto task_cleanup;
         }
+        if (!reused)
+            cr_profile_count(CR_PROF_CNT_PACKAGES_READ, 1);
 
+        prof_start = cr_profile_start();
         res = cr_xml_dump(pkg, &tmp_err);
+        cr_profile_stop(CR_PROF_XML_DUMP, prof_start);
         if (tmp_err) {
             g_critical("Cannot dump XML for %s (%s): %s",
                        pkg->name, pkg->pkgId, tmp_err->message);
             udata->had_errors = TRUE;
             g_clear_error(&tmp_err);
+            cr_profile_count(CR_PROF_CNT_PACKAGES_FAILED, 1);
             goto task_cleanup;
         }
     } else {
         // Just gen XML from old loaded metadata
         pkg = md;
+        cr_profile_count(CR_PROF_CNT_PACKAGES_REUSED, 1);
+        prof_start = cr_profile_start();
         res = cr_xml_dump(md, &tmp_err);
+        cr_profile_stop(CR_PROF_XML_DUMP, prof_start);
         if (tmp_err) {
             g_critical("Cannot dump XML for %s (%s): %s",
                        md->name, md->pkgId, tmp_err->message);
             udata->had_errors = TRUE;
             g_clear_error(&tmp_err);
+            cr_profile_count(CR_PROF_CNT_PACKAGES_FAILED, 1);
             goto task_cleanup;
         }
     }
 
+    // Writing in order of tasks may wait for other tasks, so the worker
+    // of the batch must be returned before
+    if (batch_worker) {
+        batch_worker_release(udata);
+        batch_worker = FALSE;
+    }
+
+    // The file is not needed anymore
+    if (udata->prefetch)
+        cr_prefetch_release(udata->prefetch, task->id);
+
+    if (cr_profile_enabled())
+        cr_profile_count(CR_PROF_CNT_XML_BYTES, strlen(res.primary)
+                                                + strlen(res.filelists)
+                                                + strlen(res.other));
+
 #ifdef CR_DELTA_RPM_SUPPORT
     // Delta candidate
     if (udata->deltas
@@ -474,6 +888,9 @@ cr_dumper_thread(gpointer data, gpointer user_data)
     // Buffering stuff
     g_mutex_lock(udata->mutex_buffer);
 
+    cr_profile_sample(CR_PROF_HIST_BUFFER_DEPTH,
+                      g_queue_get_length(udata->buffer));
+
     if (g_queue_get_length(udata->buffer) < MAX_TASK_BUFFER_LEN
         && udata->id_pri != task->id
         && udata->package_count > (task->id + 1))
@@ -503,6 +920,7 @@ cr_dumper_thread(gpointer data, gpointer user_data)
 
         g_queue_insert_sorted(udata->buffer, buf_task, buf_task_sort_func, NULL);
         g_mutex_unlock(udata->mutex_buffer);
+        cr_profile_count(CR_PROF_CNT_TASKS_BUFFERED, 1);
 
         g_free(task->full_path);
         g_free(task->filename);
@@ -525,6 +943,12 @@ cr_dumper_thread(gpointer data, gpointer user_data)
     g_free(res.other);
 
 task_cleanup:
+    if (batch_worker)
+        batch_worker_release(udata);
+
+    if (udata->prefetch)
+        cr_prefetch_release(udata->prefetch, task->id);
+
     if (udata->id_pri <= task->id) {
         // An error was encountered and we have to wait to increment counters
         g_mutex_lock(udata->mutex_pri);
@@ -30,10 +30,13 @@ extern "C" {
 #include <rpm/rpmlib.h>
 #endif	/* RPM5 */
 
+#include "checksum_cache.h"
+#include "checksum_manifest.h"
 #include "load_metadata.h"
 #include "locate_metadata.h"
 #include "misc.h"
 #include "package.h"
+#include "prefetch.h"
 #include "sqlite.h"
 #include "xml_file.h"
 
@@ -42,6 +45,11 @@ extern "C" {
  *  @{
  */
 
+/** Packages read from files with more hardlinks
+ * (see cr_dumper_inodes_new()).
+ */
+typedef struct _cr_DumperInodes cr_DumperInodes;
+
 struct PoolTask {
     long  id;                       // ID of the task
     long  media_id;                 // ID of media in split mode, 0 if not in split mode
@@ -54,6 +62,9 @@ struct UserData {
     cr_XmlFile *pri_f;              // Opened compressed primary.xml.*
     cr_XmlFile *fil_f;              // Opened compressed filelists.xml.*
     cr_XmlFile *oth_f;              // Opened compressed other.xml.*
+    cr_XmlFile *pri_zck;            // Opened primary.xml.zck or NULL
+    cr_XmlFile *fil_zck;            // Opened filelists.xml.zck or NULL
+    cr_XmlFile *oth_zck;            // Opened other.xml.zck or NULL
     cr_SqliteDb *pri_db;            // Primary db
     cr_SqliteDb *fil_db;            // Filelists db
     cr_SqliteDb *oth_db;            // Other db
@@ -64,6 +75,14 @@ struct UserData {
     const char *checksum_type_str;  // Name of selected checksum
     cr_ChecksumType checksum_type;  // Constant representing selected checksum
     const char *checksum_cachedir;  // Dir with cached checksums
+    cr_ChecksumCache *checksum_cache; // Cache of checksums (or NULL)
+    gboolean shared_checksum_cache; // Other processes fill the cache at
+                                    // the same time (--batch), lock files
+                                    // with more links while their
+                                    // checksum is computed
+    cr_ChecksumManifest *checksum_manifest; // Precomputed checksums (or NULL)
+    cr_Prefetch *prefetch;          // Read-ahead of packages (or NULL),
+                                    // ids of packages are ids of tasks
     gboolean skip_symlinks;         // Skip symlinks
     long package_count;             // Total number of packages to process
 
@@ -99,12 +118,56 @@ struct UserData {
     gchar *location_prefix;         // Append this prefix into location_href
                                     // during repodata generation
     gboolean had_errors;            // Any errors encountered?
+
+    // Hardlinks
+    cr_DumperInodes *inodes;        // Packages read from files with more
+                                    // links (see cr_dumper_inodes_new())
+                                    // or NULL
+    GMutex *mutex_inodes;           // Mutex for the inodes and counters
+    long hardlinks_read;            // Files with more links read
+    long hardlinks_reused;          // Packages copied from another link
+
+    // Batch
+    int workers_sem;                // SysV semaphore counting free workers
+                                    // of all repositories of a --batch run
+                                    // or -1
 };
 
 
 void
 cr_dumper_thread(gpointer data, gpointer user_data);
 
+/** Create a table of packages read from files with more hardlinks.
+ * Files are identified by device, inode, size and mtime; the header
+ * and checksum of such file are read just once and the package is
+ * copied (with its own location) for the other links.
+ * Entries are freed when all links were processed; entries of files
+ * whose other links are not processed (e.g. they are outside of the
+ * repository) are evicted when too many of them are unused.
+ * @return              cr_DumperInodes for UserData.inodes
+ */
+cr_DumperInodes *
+cr_dumper_inodes_new(void);
+
+/** Free the table of packages read from files with more hardlinks.
+ * @param inodes        cr_DumperInodes or NULL
+ */
+void
+cr_dumper_inodes_free(cr_DumperInodes *inodes);
+
+/** cr_PrefetchSkipFunc for the prefetch of cr_dumper_thread() packages.
+ * Content of a package is not needed if its metadata from the old
+ * metadata will be reused.
+ * @param path          Path to the package
+ * @param st            stat() of the package
+ * @param user_data     struct UserData
+ * @return              TRUE if the package won't be read
+ */
+gboolean
+cr_dumper_prefetch_skip(const char *path,
+                        const struct stat *st,
+                        gpointer user_data);
+
 /** @} */
 
 #ifdef __cplusplus
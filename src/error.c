@@ -85,6 +85,10 @@ cr_strerror(cr_Error rc)
             return "Child process exited abnormally";
         case CRE_DELTARPM:
             return "Deltarpm error";
+        case CRE_ZSTD:
+            return "Zstandard library related error";
+        case CRE_ZCK:
+            return "Zchunk library related error";
         default:
             return "Unknown error";
     }
@@ -94,6 +94,10 @@ typedef enum {
         (32) Bad updateinfo.xml file */
     CRE_SIGPROCMASK, /*!<
         (33) Cannot change blocked signals */
+    CRE_ZSTD, /*!<
+        (34) Zstandard library related error */
+    CRE_ZCK, /*!<
+        (35) Zchunk library related error */
     CRE_SENTINEL, /*!<
         (XX) Sentinel */
 } cr_Error;
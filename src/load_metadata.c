@@ -336,6 +336,7 @@ cr_load_xml_files(GHashTable *hashtable,
                   const char *other_xml_path,
                   GStringChunk *chunk,
                   GHashTable *pkglist_ht,
+                  gboolean primary_only,
                   GError **err)
 {
     cr_CbData cb_data;
@@ -372,6 +373,9 @@ cr_load_xml_files(GHashTable *hashtable,
         return code;
     }
 
+    if (primary_only)
+        return CRE_OK;
+
     cb_data.state = PARSING_FIL;
 
     if (filelists_xml_path) {
@@ -413,10 +417,11 @@ cr_load_xml_files(GHashTable *hashtable,
     return CRE_OK;
 }
 
-int
-cr_metadata_load_xml(cr_Metadata *md,
-                     struct cr_MetadataLocation *ml,
-                     GError **err)
+static int
+cr_metadata_load_xml_files(cr_Metadata *md,
+                           struct cr_MetadataLocation *ml,
+                           gboolean primary_only,
+                           GError **err)
 {
     int result;
     GError *tmp_err = NULL;
@@ -441,6 +446,7 @@ cr_metadata_load_xml(cr_Metadata *md,
                                ml->oth_xml_href,
                                md->chunk,
                                md->pkglist_ht,
+                               primary_only,
                                &tmp_err);
 
     if (result != CRE_OK) {
@@ -546,6 +552,83 @@ cr_metadata_load_xml(cr_Metadata *md,
     return CRE_OK;
 }
 
+int
+cr_metadata_load_xml(cr_Metadata *md,
+                     struct cr_MetadataLocation *ml,
+                     GError **err)
+{
+    return cr_metadata_load_xml_files(md, ml, FALSE, err);
+}
+
+int
+cr_metadata_load_primary_xml(cr_Metadata *md,
+                             struct cr_MetadataLocation *ml,
+                             GError **err)
+{
+    return cr_metadata_load_xml_files(md, ml, TRUE, err);
+}
+
+int
+cr_metadata_load_filelists_other_xml(GHashTable *packages,
+                                     struct cr_MetadataLocation *ml,
+                                     GError **err)
+{
+    cr_CbData cb_data;
+    GError *tmp_err = NULL;
+
+    assert(packages);
+    assert(ml);
+    assert(!err || *err == NULL);
+
+    if (g_hash_table_size(packages) == 0)
+        return CRE_OK;
+
+    // Packages are standalone, strings go into their own chunks
+    cb_data.ht              = packages;
+    cb_data.chunk           = NULL;
+    cb_data.pkglist_ht      = NULL;
+    cb_data.ignored_pkgIds  = NULL;
+    cb_data.pkgKey          = G_GINT64_CONSTANT(0);
+
+    if (ml->fil_xml_href) {
+        cb_data.state = PARSING_FIL;
+        cr_xml_parse_filelists(ml->fil_xml_href,
+                               newpkgcb,
+                               &cb_data,
+                               pkgcb,
+                               &cb_data,
+                               cr_warning_cb,
+                               "Filelists XML parser",
+                               &tmp_err);
+        if (tmp_err) {
+            int code = tmp_err->code;
+            g_debug("filelists.xml parsing error: %s", tmp_err->message);
+            g_propagate_prefixed_error(err, tmp_err, "filelists.xml parsing: ");
+            return code;
+        }
+    }
+
+    if (ml->oth_xml_href) {
+        cb_data.state = PARSING_OTH;
+        cr_xml_parse_other(ml->oth_xml_href,
+                           newpkgcb,
+                           &cb_data,
+                           pkgcb,
+                           &cb_data,
+                           cr_warning_cb,
+                           "Other XML parser",
+                           &tmp_err);
+        if (tmp_err) {
+            int code = tmp_err->code;
+            g_debug("other.xml parsing error: %s", tmp_err->message);
+            g_propagate_prefixed_error(err, tmp_err, "other.xml parsing: ");
+            return code;
+        }
+    }
+
+    return CRE_OK;
+}
+
 int
 cr_metadata_locate_and_load_xml(cr_Metadata *md,
                                 const char *repopath,
@@ -134,6 +134,32 @@ int cr_metadata_load_xml(cr_Metadata *md,
                          struct cr_MetadataLocation *ml,
                          GError **err);
 
+/** Load only primary.xml from the specified location.
+ * File entries listed in primary.xml are skipped when the location
+ * has filelists.xml, the complete lists can be loaded later for
+ * selected packages by cr_metadata_load_filelists_other_xml().
+ * @param md            metadata object
+ * @param ml            metadata location
+ * @param err           GError **
+ * @return              cr_Error code
+ */
+int cr_metadata_load_primary_xml(cr_Metadata *md,
+                                 struct cr_MetadataLocation *ml,
+                                 GError **err);
+
+/** Stream filelists.xml and other.xml from the specified location and
+ * fill the data only into packages from the hashtable. Records of
+ * other packages are skipped. Packages must be standalone (not sharing
+ * a single string chunk).
+ * @param packages      hashtable with packages (key is pkgId)
+ * @param ml            metadata location
+ * @param err           GError **
+ * @return              cr_Error code
+ */
+int cr_metadata_load_filelists_other_xml(GHashTable *packages,
+                                         struct cr_MetadataLocation *ml,
+                                         GError **err);
+
 /** Locate and load metadata from the specified path.
  * @param md            metadata object
  * @param repopath      path to repo (to directory with repodata/ subdir)
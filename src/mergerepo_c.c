@@ -38,7 +38,10 @@
 #include "repomd.h"
 #include "sqlite.h"
 #include "threads.h"
+#include "updateinfo.h"
+#include "updateinfo_index.h"
 #include "xml_file.h"
+#include "xml_parser.h"
 #include "cleanup.h"
 
 
@@ -49,6 +52,9 @@
 #define DEFAULT_OUTPUTDIR               "merged_repo/"
 #define DEFAULT_DB_COMPRESSION_TYPE             CR_CW_BZ2_COMPRESSION
 #define DEFAULT_GROUPFILE_COMPRESSION_TYPE      CR_CW_GZ_COMPRESSION
+#define DEFAULT_XML_COMPRESSION_TYPE            CR_CW_GZ_COMPRESSION
+#define DEFAULT_WORKERS                 5
+#define MAX_RENDERED_AHEAD              2048
 
 // struct KojiMergedReposStuff
 // contains information needed to simulate sort_and_filter() method from
@@ -123,7 +129,10 @@ struct CmdOptions {
     char *outputrepo;
     gboolean nogroups;
     gboolean noupdateinfo;
+    gboolean updateinfo_index;
     char *compress_type;
+    char *general_compress_type;
+    int workers;
     char *merge_method_str;
     gboolean all;
     char *noarch_repo_url;
@@ -145,6 +154,7 @@ struct CmdOptions {
     GSList *arch_list;
     cr_CompressionType db_compression_type;
     cr_CompressionType groupfile_compression_type;
+    cr_CompressionType xml_compression_type;
     MergeMethod merge_method;
 };
 
@@ -152,6 +162,8 @@ struct CmdOptions {
 struct CmdOptions _cmd_options = {
         .db_compression_type = DEFAULT_DB_COMPRESSION_TYPE,
         .groupfile_compression_type = DEFAULT_GROUPFILE_COMPRESSION_TYPE,
+        .xml_compression_type = DEFAULT_XML_COMPRESSION_TYPE,
+        .workers = DEFAULT_WORKERS,
         .merge_method = MM_DEFAULT,
         .unique_md_filenames = TRUE,
         .simple_md_filenames = FALSE,
@@ -178,8 +190,17 @@ static GOptionEntry cmd_entries[] =
       "Do not merge group (comps) metadata", NULL },
     { "noupdateinfo", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.noupdateinfo),
       "Do not merge updateinfo metadata", NULL },
+    { "updateinfo-index", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.updateinfo_index),
+      "Store an index of packages referenced by the merged updates "
+      "(updateinfo_index record).", NULL },
     { "compress-type", 0, 0, G_OPTION_ARG_STRING, &(_cmd_options.compress_type),
       "Which compression type to use", "COMPRESS_TYPE" },
+    { "general-compress-type", 0, 0, G_OPTION_ARG_STRING, &(_cmd_options.general_compress_type),
+      "Which compression type to use (even for primary, filelists and other xml)",
+      "COMPRESS_TYPE" },
+    { "workers", 0, 0, G_OPTION_ARG_INT, &(_cmd_options.workers),
+      "Number of workers to spawn to render metadata of merged packages.",
+      NULL },
     { "method", 0, 0, G_OPTION_ARG_STRING, &(_cmd_options.merge_method_str),
       "Specify merge method for packages with the same name and arch (available"
       " merge methods: repo (default), ts, nvr)", "MERGE_METHOD" },
@@ -347,14 +368,40 @@ check_arguments(struct CmdOptions *options)
 
         if (type == CR_CW_UNKNOWN_COMPRESSION) {
             g_critical("Compression %s not available: Please choose from: "
-                       "gz or bz2 or xz", options->compress_type);
+                       "gz, bz2, xz or zstd", options->compress_type);
+            ret = FALSE;
+        } else {
+            options->db_compression_type = type;
+            options->groupfile_compression_type = type;
+        }
+    }
+
+    // General compress type
+    if (options->general_compress_type) {
+
+        cr_CompressionType type;
+        type = cr_compression_type(options->general_compress_type);
+
+        if (type == CR_CW_UNKNOWN_COMPRESSION
+            || type == CR_CW_ZCK_COMPRESSION)
+        {
+            g_critical("Compression %s not available: Please choose from: "
+                       "gz, bz2, xz or zstd", options->general_compress_type);
             ret = FALSE;
         } else {
+            options->xml_compression_type = type;
             options->db_compression_type = type;
             options->groupfile_compression_type = type;
         }
     }
 
+    // Check workers
+    if ((options->workers < 1) || (options->workers > 100)) {
+        g_warning("Wrong number of workers - Using %d workers.",
+                  DEFAULT_WORKERS);
+        options->workers = DEFAULT_WORKERS;
+    }
+
     // Merge method
     if (options->merge_method_str) {
         if (options->koji) {
@@ -425,6 +472,7 @@ free_options(struct CmdOptions *options)
     g_free(options->outputdir);
     g_free(options->archlist);
     g_free(options->compress_type);
+    g_free(options->general_compress_type);
     g_free(options->merge_method_str);
     g_free(options->noarch_repo_url);
 
@@ -940,6 +988,69 @@ add_package(cr_Package *pkg,
 }
 
 
+/** Load filelists and other data for packages which remained
+ * in the merged hashtable. Every repo is parsed only once and
+ * only if it provided at least one of the packages.
+ */
+static gboolean
+load_selected_packages_details(GHashTable *merged,
+                               GSList *repo_list,
+                               GHashTable *origins)
+{
+    gboolean ret = TRUE;
+    guint repos = g_slist_length(repo_list);
+    GHashTable **selected;  // Per repo: Key: pkgId, Value: package
+    GHashTableIter iter;
+    gpointer key, value;
+
+    selected = g_new0(GHashTable *, repos);
+    for (guint x = 0; x < repos; x++)
+        selected[x] = g_hash_table_new(g_str_hash, g_str_equal);
+
+    g_hash_table_iter_init(&iter, merged);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        for (GSList *elem = value; elem; elem = g_slist_next(elem)) {
+            cr_Package *pkg = elem->data;
+            gint origin = GPOINTER_TO_INT(g_hash_table_lookup(origins, pkg));
+
+            // Packages from noarch repo are loaded completely
+            if (origin == 0 || origin > (gint) repos || !pkg->pkgId)
+                continue;
+
+            g_hash_table_insert(selected[origin-1], pkg->pkgId, pkg);
+        }
+    }
+
+    guint repoid = 0;
+    for (GSList *elem = repo_list; elem; elem = g_slist_next(elem), repoid++) {
+        struct cr_MetadataLocation *ml = elem->data;
+        GError *tmp_err = NULL;
+
+        if (!ml || g_hash_table_size(selected[repoid]) == 0)
+            continue;
+
+        g_debug("Loading filelists and other data of %u packages from: %s",
+                g_hash_table_size(selected[repoid]), ml->original_url);
+
+        if (cr_metadata_load_filelists_other_xml(selected[repoid], ml,
+                                                 &tmp_err) != CRE_OK)
+        {
+            g_critical("Cannot load repo: \"%s\": %s",
+                       ml->repomd, tmp_err->message);
+            g_clear_error(&tmp_err);
+            ret = FALSE;
+            break;
+        }
+    }
+
+    for (guint x = 0; x < repos; x++)
+        g_hash_table_destroy(selected[x]);
+    g_free(selected);
+
+    return ret;
+}
+
+
 long
 merge_repos(GHashTable *merged,
             GSList *repo_list,
@@ -952,8 +1063,19 @@ merge_repos(GHashTable *merged,
 {
     long loaded_packages = 0;
     GSList *used_noarch_keys = NULL;
+    GHashTable *origins;
 
-    // Load all repos
+    // origins:
+    //   Key: added package
+    //   Value: index of its repo in the repo_list + 1
+    // Packages replaced later by add_package() are freed but their
+    // stale records are harmless - only packages which remain in the
+    // merged hashtable are looked up, and a record of a reused address
+    // is always overwritten when the new package is added.
+    origins = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    // First phase - load only primary.xml of all repos and select
+    // packages which will be in the result
 
     int repoid = 0;
     GSList *element = NULL;
@@ -977,7 +1099,7 @@ merge_repos(GHashTable *merged,
 
         g_debug("Processing: %s", repopath);
 
-        if (cr_metadata_load_xml(metadata, ml, NULL) != CRE_OK) {
+        if (cr_metadata_load_primary_xml(metadata, ml, NULL) != CRE_OK) {
             cr_metadata_free(metadata);
             g_critical("Cannot load repo: \"%s\"", ml->repomd);
             break;
@@ -1025,6 +1147,8 @@ merge_repos(GHashTable *merged,
                     // Original package was added
                     // => remove only record from hashtable
                     g_hash_table_iter_steal(&iter);
+                    g_hash_table_insert(origins, pkg,
+                                        GINT_TO_POINTER(repoid + 1));
                 } else {
                     // Package from noarch repo was added
                     // => do not remove record, just make note
@@ -1065,6 +1189,14 @@ merge_repos(GHashTable *merged,
         g_hash_table_steal(noarch_hashtable, (gconstpointer) element->data);
     g_slist_free(used_noarch_keys);
 
+    // Second phase - stream filelists.xml and other.xml of the repos
+    // and keep only records of the selected packages
+
+    if (!load_selected_packages_details(merged, repo_list, origins))
+        loaded_packages = -1;
+
+    g_hash_table_destroy(origins);
+
     return loaded_packages;
 }
 
@@ -1082,8 +1214,513 @@ package_cmp(gconstpointer a_p, gconstpointer b_p)
 }
 
 
+/** Metadata streams written by the dump pipeline.
+ */
+typedef enum {
+    DUMP_PRI,
+    DUMP_FIL,
+    DUMP_OTH,
+    DUMP_SENTINEL,
+} DumpStream;
+
+/** Kinds of tasks of the dump pipeline thread pool.
+ * (Values are non zero because the pool doesn't accept NULL tasks.)
+ */
+typedef enum {
+    DUMP_TASK_RENDER = 1,               // Render packages into XML chunks
+    DUMP_TASK_WRITE_PRI,                // Write primary in merged order
+    DUMP_TASK_WRITE_FIL,                // Write filelists in merged order
+    DUMP_TASK_WRITE_OTH,                // Write other in merged order
+} DumpTask;
+
+/** Rendered chunks of a single package.
+ */
+struct DumpChunk {
+    char *xml[DUMP_SENTINEL];           // Chunks (freed by writers)
+    gboolean done;                      // Is the package rendered?
+};
+
+/** Shared state of the dump pipeline.
+ * Workers render packages into XML chunks in any order. Every stream
+ * has its own writer which consumes the chunks in the merged order,
+ * writes (compresses) them and adds the package into its sqlite db.
+ * Workers never get more than MAX_RENDERED_AHEAD packages ahead
+ * of the slowest writer.
+ */
+struct DumpPipeline {
+    GPtrArray *pkgs;                    // Packages in the merged order
+    struct DumpChunk *chunks;           // Chunks of the packages
+    cr_XmlFile *xml[DUMP_SENTINEL];     // Output xml files
+    cr_SqliteDb *db[DUMP_SENTINEL];     // Output dbs or NULLs
+    long next;                          // Next package to render
+    long written[DUMP_SENTINEL];        // Packages written per stream
+    GMutex *mutex;
+    GCond *cond_rendered;               // A package was rendered
+    GCond *cond_written;                // A writer moved forward
+    gboolean had_errors;                // Any errors encountered? (mutex)
+};
+
+static long
+dump_slowest_writer(struct DumpPipeline *dp)
+{
+    long min = dp->written[0];
+    for (int x = 1; x < DUMP_SENTINEL; x++)
+        min = MIN(min, dp->written[x]);
+    return min;
+}
+
+static void
+dump_render(struct DumpPipeline *dp)
+{
+    long total = (long) dp->pkgs->len;
+
+    while (1) {
+        long id;
+        cr_Package *pkg;
+        struct cr_XmlStruct res;
+
+        g_mutex_lock(dp->mutex);
+        while (dp->next < total
+               && dp->next - dump_slowest_writer(dp) >= MAX_RENDERED_AHEAD)
+            g_cond_wait(dp->cond_written, dp->mutex);
+        id = dp->next++;
+        g_mutex_unlock(dp->mutex);
+
+        if (id >= total)
+            break;
+
+        pkg = g_ptr_array_index(dp->pkgs, id);
+        g_debug("Writing metadata for %s (%s-%s.%s)",
+                pkg->name, pkg->version, pkg->release, pkg->arch);
+        res = cr_xml_dump(pkg, NULL);
+
+        g_mutex_lock(dp->mutex);
+        dp->chunks[id].xml[DUMP_PRI] = res.primary;
+        dp->chunks[id].xml[DUMP_FIL] = res.filelists;
+        dp->chunks[id].xml[DUMP_OTH] = res.other;
+        dp->chunks[id].done = TRUE;
+        g_cond_broadcast(dp->cond_rendered);
+        g_mutex_unlock(dp->mutex);
+    }
+}
+
+static void
+dump_write(struct DumpPipeline *dp, DumpStream stream)
+{
+    long total = (long) dp->pkgs->len;
+
+    for (long id = 0; id < total; id++) {
+        char *chunk;
+        cr_Package *pkg = g_ptr_array_index(dp->pkgs, id);
+        gboolean failed = FALSE;
+        GError *tmp_err = NULL;
+
+        g_mutex_lock(dp->mutex);
+        while (!dp->chunks[id].done)
+            g_cond_wait(dp->cond_rendered, dp->mutex);
+        chunk = dp->chunks[id].xml[stream];
+        dp->chunks[id].xml[stream] = NULL;
+        g_mutex_unlock(dp->mutex);
+
+        cr_xmlfile_add_chunk(dp->xml[stream], chunk, &tmp_err);
+        if (tmp_err) {
+            g_critical("Cannot add chunk of %s: %s",
+                       pkg->location_href, tmp_err->message);
+            g_clear_error(&tmp_err);
+            failed = TRUE;
+        }
+
+        if (dp->db[stream]) {
+            cr_db_add_pkg(dp->db[stream], pkg, &tmp_err);
+            if (tmp_err) {
+                g_critical("Cannot add record of %s into the db: %s",
+                           pkg->location_href, tmp_err->message);
+                g_clear_error(&tmp_err);
+                failed = TRUE;
+            }
+        }
+
+        free(chunk);
+
+        g_mutex_lock(dp->mutex);
+        if (failed)
+            dp->had_errors = TRUE;
+        dp->written[stream] = id + 1;
+        g_cond_broadcast(dp->cond_written);
+        g_mutex_unlock(dp->mutex);
+    }
+}
+
+static void
+dump_thread(gpointer data, gpointer user_data)
+{
+    struct DumpPipeline *dp = user_data;
+
+    switch (GPOINTER_TO_INT(data)) {
+        case DUMP_TASK_RENDER:
+            dump_render(dp);
+            break;
+        case DUMP_TASK_WRITE_PRI:
+            dump_write(dp, DUMP_PRI);
+            break;
+        case DUMP_TASK_WRITE_FIL:
+            dump_write(dp, DUMP_FIL);
+            break;
+        case DUMP_TASK_WRITE_OTH:
+            dump_write(dp, DUMP_OTH);
+            break;
+    }
+}
+
+/** Render and write all packages of the merged hashtable.
+ * Packages are sorted by name and then by location.
+ * @return      FALSE if any error was encountered
+ */
+static gboolean
+dump_packages(GHashTable *merged_hashtable,
+              cr_XmlFile **xml,
+              cr_SqliteDb **db,
+              int workers)
+{
+    struct DumpPipeline dp;
+    GThreadPool *pool;
+    GList *keys, *key;
+    GError *tmp_err = NULL;
+
+    memset(&dp, 0, sizeof(dp));
+    dp.pkgs = g_ptr_array_new();
+
+    keys = g_hash_table_get_keys(merged_hashtable);
+    keys = g_list_sort(keys, (GCompareFunc) g_strcmp0);
+
+    for (key = keys; key; key = g_list_next(key)) {
+        GSList *value = g_hash_table_lookup(merged_hashtable, key->data);
+        GSList *sorted = g_slist_sort(g_slist_copy(value), package_cmp);
+        for (GSList *elem = sorted; elem; elem = g_slist_next(elem))
+            g_ptr_array_add(dp.pkgs, elem->data);
+        g_slist_free(sorted);
+    }
+
+    g_list_free(keys);
+
+    if (dp.pkgs->len == 0) {
+        g_ptr_array_free(dp.pkgs, TRUE);
+        return TRUE;
+    }
+
+    dp.chunks = g_new0(struct DumpChunk, dp.pkgs->len);
+    for (int x = 0; x < DUMP_SENTINEL; x++) {
+        dp.xml[x] = xml[x];
+        dp.db[x] = db[x];
+    }
+    dp.mutex = g_mutex_new();
+    dp.cond_rendered = g_cond_new();
+    dp.cond_written = g_cond_new();
+
+    // Every task runs in its own thread until the whole output is done
+    pool = g_thread_pool_new(dump_thread,
+                             &dp,
+                             workers + DUMP_SENTINEL,
+                             TRUE,
+                             &tmp_err);
+    if (!pool) {
+        g_critical("Cannot create thread pool: %s", tmp_err->message);
+        g_error_free(tmp_err);
+        dp.had_errors = TRUE;
+    } else {
+        g_thread_pool_push(pool, GINT_TO_POINTER(DUMP_TASK_WRITE_PRI), NULL);
+        g_thread_pool_push(pool, GINT_TO_POINTER(DUMP_TASK_WRITE_FIL), NULL);
+        g_thread_pool_push(pool, GINT_TO_POINTER(DUMP_TASK_WRITE_OTH), NULL);
+        for (int x = 0; x < workers; x++)
+            g_thread_pool_push(pool, GINT_TO_POINTER(DUMP_TASK_RENDER), NULL);
+        g_thread_pool_free(pool, FALSE, TRUE);
+    }
+
+    g_mutex_free(dp.mutex);
+    g_cond_free(dp.cond_rendered);
+    g_cond_free(dp.cond_written);
+    g_free(dp.chunks);
+    g_ptr_array_free(dp.pkgs, TRUE);
+
+    return !dp.had_errors;
+}
+
+
+
+/** Parsing of updateinfo.xml of a single repo.
+ */
+struct UpdateinfoTask {
+    const char *path;                   // Path to updateinfo.xml
+    cr_UpdateInfo *uinfo;               // Parsed updateinfo
+    GError *err;                        // Error or NULL
+};
+
+static void
+updateinfo_parse_thread(gpointer data, G_GNUC_UNUSED gpointer user_data)
+{
+    struct UpdateinfoTask *task = data;
+
+    g_debug("Parsing updateinfo: %s", task->path);
+    cr_xml_parse_updateinfo(task->path, task->uinfo, cr_warning_cb,
+                            "Updateinfo XML parser", &task->err);
+}
+
+/** Time of the last change of the update record (updated date or issued
+ * date if it was never updated) as a unix timestamp. Dates are either
+ * a timestamp or "YYYY-MM-DD HH:MM:SS" in UTC (time part is optional).
+ */
+static gint64
+updaterecord_timestamp(cr_UpdateRecord *rec)
+{
+    const char *date = rec->updated_date ? rec->updated_date
+                                         : rec->issued_date;
+    gint y = 0, mo = 0, d = 0, h = 0, mi = 0, sec = 0;
+    gint64 timestamp = 0;
+    GDateTime *dt;
+
+    if (!date || !*date)
+        return 0;
+
+    if (strspn(date, "0123456789") == strlen(date))
+        return g_ascii_strtoll(date, NULL, 10);
+
+    if (sscanf(date, "%d-%d-%d %d:%d:%d", &y, &mo, &d, &h, &mi, &sec) < 3)
+        return 0;
+
+    dt = g_date_time_new_utc(y, mo, d, h, mi, sec);
+    if (dt) {
+        timestamp = g_date_time_to_unix(dt);
+        g_date_time_unref(dt);
+    }
+
+    return timestamp;
+}
+
+/** NEVRA key of a package used to match updateinfo packages
+ * against merged packages.
+ */
+static gchar *
+nevra_key(const char *name, const char *epoch, const char *version,
+          const char *release, const char *arch)
+{
+    return g_strdup_printf("%s-%s:%s-%s.%s", name,
+                           (epoch && *epoch) ? epoch : "0",
+                           version, release, arch);
+}
+
+/** Remove packages which are not part of the merged repo from
+ * collections of the update record. Collections which become empty
+ * are removed as well.
+ * @return      FALSE if the record had collections and none is left
+ */
+static gboolean
+updaterecord_filter(cr_UpdateRecord *rec, GHashTable *nevras)
+{
+    GSList *collections = NULL;
+
+    if (!rec->collections)
+        return TRUE;
+
+    for (GSList *elem = rec->collections; elem; elem = g_slist_next(elem)) {
+        cr_UpdateCollection *col = elem->data;
+        GSList *packages = NULL;
+
+        for (GSList *e = col->packages; e; e = g_slist_next(e)) {
+            cr_UpdateCollectionPackage *pkg = e->data;
+            _cleanup_free_ gchar *key = nevra_key(pkg->name, pkg->epoch,
+                                                  pkg->version, pkg->release,
+                                                  pkg->arch);
+            if (g_hash_table_lookup_extended(nevras, key, NULL, NULL))
+                packages = g_slist_prepend(packages, pkg);
+            else
+                cr_updatecollectionpackage_free(pkg);
+        }
+
+        g_slist_free(col->packages);
+        col->packages = g_slist_reverse(packages);
+        col->packages_tail = NULL;
+
+        if (col->packages)
+            collections = g_slist_prepend(collections, col);
+        else
+            cr_updatecollection_free(col);
+    }
+
+    g_slist_free(rec->collections);
+    rec->collections = g_slist_reverse(collections);
+    rec->collections_tail = NULL;
+
+    return rec->collections != NULL;
+}
+
+/** Merge updateinfo.xml files of the repos into a single file.
+ * Files are parsed in parallel. Records with the same id are
+ * deduplicated - the one with the latest updated (issued) date wins,
+ * the first one in the repo order wins a tie. Records keep the order
+ * of the first occurrence of their id. Collections are filtered to
+ * packages of the merged repo. The result is written record by record.
+ * Written records are added into the index if one is passed.
+ * @return      FALSE if any error was encountered
+ */
+static gboolean
+merge_updateinfo(GSList *repo_list,
+                 GHashTable *merged_hashtable,
+                 const char *path,
+                 cr_CompressionType compression,
+                 int workers,
+                 cr_UpdateInfoIndex *index)
+{
+    gboolean ret = TRUE;
+    GPtrArray *tasks = g_ptr_array_new();
+    GPtrArray *records = g_ptr_array_new();  // Output order
+    GHashTable *ids;        // Key: id, Value: index into records + 1
+    GHashTable *nevras;     // Set of NEVRAs of merged packages
+    GHashTableIter iter;
+    gpointer key, value;
+    cr_XmlFile *f;
+    GError *tmp_err = NULL;
+    long written = 0;
+
+    // Parse all updateinfo files
+
+    for (GSList *elem = repo_list; elem; elem = g_slist_next(elem)) {
+        struct cr_MetadataLocation *ml = elem->data;
+        struct UpdateinfoTask *task;
+
+        if (!ml || !ml->updateinfo_href)
+            continue;
+
+        task = g_new0(struct UpdateinfoTask, 1);
+        task->path = ml->updateinfo_href;
+        task->uinfo = cr_updateinfo_new();
+        g_ptr_array_add(tasks, task);
+    }
+
+    if (tasks->len > 0) {
+        GThreadPool *pool = g_thread_pool_new(updateinfo_parse_thread,
+                                              NULL,
+                                              MIN(workers, (int) tasks->len),
+                                              FALSE,
+                                              NULL);
+        for (guint x = 0; x < tasks->len; x++)
+            g_thread_pool_push(pool, g_ptr_array_index(tasks, x), NULL);
+        g_thread_pool_free(pool, FALSE, TRUE);
+    }
+
+    // Dedupe records by id
+
+    ids = g_hash_table_new(g_str_hash, g_str_equal);
+
+    for (guint x = 0; x < tasks->len; x++) {
+        struct UpdateinfoTask *task = g_ptr_array_index(tasks, x);
+
+        if (task->err) {
+            g_critical("Cannot parse %s: %s", task->path, task->err->message);
+            ret = FALSE;
+            continue;
+        }
+
+        for (GSList *e = task->uinfo->updates; e; e = g_slist_next(e)) {
+            cr_UpdateRecord *rec = e->data;
+            guint pos;
+
+            if (!rec->id) {
+                g_ptr_array_add(records, rec);
+                continue;
+            }
+
+            pos = GPOINTER_TO_UINT(g_hash_table_lookup(ids, rec->id));
+            if (!pos) {
+                g_ptr_array_add(records, rec);
+                g_hash_table_insert(ids, rec->id,
+                                    GUINT_TO_POINTER(records->len));
+            } else {
+                cr_UpdateRecord *erec = g_ptr_array_index(records, pos-1);
+                if (updaterecord_timestamp(rec) > updaterecord_timestamp(erec)) {
+                    g_debug("Update %s from %s replaces an older one",
+                            rec->id, task->path);
+                    g_ptr_array_index(records, pos-1) = rec;
+                    g_hash_table_insert(ids, rec->id, GUINT_TO_POINTER(pos));
+                }
+            }
+        }
+    }
+
+    g_hash_table_destroy(ids);
+
+    // Prepare NEVRAs of merged packages
+
+    nevras = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    g_hash_table_iter_init(&iter, merged_hashtable);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        for (GSList *elem = value; elem; elem = g_slist_next(elem)) {
+            cr_Package *pkg = elem->data;
+            g_hash_table_insert(nevras,
+                                nevra_key(pkg->name, pkg->epoch, pkg->version,
+                                          pkg->release, pkg->arch),
+                                NULL);
+        }
+    }
+
+    // Write the result
+
+    f = cr_xmlfile_sopen_updateinfo(path, compression, NULL, &tmp_err);
+    if (!f) {
+        g_critical("Cannot open %s: %s", path, tmp_err->message);
+        g_clear_error(&tmp_err);
+        ret = FALSE;
+    }
+
+    for (guint x = 0; f && x < records->len; x++) {
+        cr_UpdateRecord *rec = g_ptr_array_index(records, x);
+
+        if (!updaterecord_filter(rec, nevras))
+            continue;
+
+        cr_xmlfile_add_updaterecord(f, rec, &tmp_err);
+        if (tmp_err) {
+            g_critical("Cannot write update %s: %s", rec->id, tmp_err->message);
+            g_clear_error(&tmp_err);
+            ret = FALSE;
+            break;
+        }
+        if (index)
+            cr_updateinfoindex_add_record(index, rec);
+        written++;
+    }
+
+    if (f) {
+        cr_xmlfile_close(f, &tmp_err);
+        if (tmp_err) {
+            g_critical("Cannot close %s: %s", path, tmp_err->message);
+            g_clear_error(&tmp_err);
+            ret = FALSE;
+        }
+    }
+
+    g_debug("Updateinfo: %ld updates from %u repos written",
+            written, tasks->len);
+
+    // Cleanup
+
+    g_hash_table_destroy(nevras);
+    g_ptr_array_free(records, TRUE);
+    for (guint x = 0; x < tasks->len; x++) {
+        struct UpdateinfoTask *task = g_ptr_array_index(tasks, x);
+        cr_updateinfo_free(task->uinfo);
+        g_clear_error(&task->err);
+        g_free(task);
+    }
+    g_ptr_array_free(tasks, TRUE);
+
+    return ret;
+}
+
+
+
 int
 dump_merged_metadata(GHashTable *merged_hashtable,
+                     GSList *repo_list,
                      long packages,
                      gchar *groupfile,
                      struct CmdOptions *cmd_options)
@@ -1102,21 +1739,24 @@ dump_merged_metadata(GHashTable *merged_hashtable,
 
     const char *groupfile_suffix = cr_compression_suffix(
                                     cmd_options->groupfile_compression_type);
+    const char *xml_suffix = cr_compression_suffix(
+                                    cmd_options->xml_compression_type);
 
     gchar *pri_xml_filename = g_strconcat(cmd_options->tmp_out_repo,
-                                          "/primary.xml.gz", NULL);
+                                          "/primary.xml", xml_suffix, NULL);
     gchar *fil_xml_filename = g_strconcat(cmd_options->tmp_out_repo,
-                                          "/filelists.xml.gz", NULL);
+                                          "/filelists.xml", xml_suffix, NULL);
     gchar *oth_xml_filename = g_strconcat(cmd_options->tmp_out_repo,
-                                          "/other.xml.gz", NULL);
+                                          "/other.xml", xml_suffix, NULL);
     gchar *update_info_filename = NULL;
+    gchar *update_info_index_filename = NULL;
     if (!cmd_options->noupdateinfo)
         update_info_filename  = g_strconcat(cmd_options->tmp_out_repo,
                                             "/updateinfo.xml",
                                             groupfile_suffix, NULL);
 
     pri_f = cr_xmlfile_sopen_primary(pri_xml_filename,
-                                     CR_CW_GZ_COMPRESSION,
+                                     cmd_options->xml_compression_type,
                                      pri_stat,
                                      &tmp_err);
     if (tmp_err) {
@@ -1133,7 +1773,7 @@ dump_merged_metadata(GHashTable *merged_hashtable,
     }
 
     fil_f = cr_xmlfile_sopen_filelists(fil_xml_filename,
-                                       CR_CW_GZ_COMPRESSION,
+                                       cmd_options->xml_compression_type,
                                        fil_stat,
                                        &tmp_err);
     if (tmp_err) {
@@ -1151,7 +1791,7 @@ dump_merged_metadata(GHashTable *merged_hashtable,
     }
 
     oth_f = cr_xmlfile_sopen_other(oth_xml_filename,
-                                   CR_CW_GZ_COMPRESSION,
+                                   cmd_options->xml_compression_type,
                                    oth_stat,
                                    &tmp_err);
     if (tmp_err) {
@@ -1205,41 +1845,11 @@ dump_merged_metadata(GHashTable *merged_hashtable,
 
     // Dump hashtable
 
-    GList *keys, *key;
-    keys = g_hash_table_get_keys(merged_hashtable);
-    keys = g_list_sort(keys, (GCompareFunc) g_strcmp0);
-
-    for (key = keys; key; key = g_list_next(key)) {
-        gpointer value = g_hash_table_lookup(merged_hashtable, key->data);
-        GSList *element = (GSList *) value;
-        element = g_slist_sort(element, package_cmp);
-        for (; element; element=g_slist_next(element)) {
-            struct cr_XmlStruct res;
-            cr_Package *pkg;
-
-            pkg = (cr_Package *) element->data;
-            res = cr_xml_dump(pkg, NULL);
-
-            g_debug("Writing metadata for %s (%s-%s.%s)",
-                    pkg->name, pkg->version, pkg->release, pkg->arch);
-
-            cr_xmlfile_add_chunk(pri_f, (const char *) res.primary, NULL);
-            cr_xmlfile_add_chunk(fil_f, (const char *) res.filelists, NULL);
-            cr_xmlfile_add_chunk(oth_f, (const char *) res.other, NULL);
+    cr_XmlFile *xml_files[DUMP_SENTINEL] = { pri_f, fil_f, oth_f };
+    cr_SqliteDb *dbs[DUMP_SENTINEL] = { pri_db, fil_db, oth_db };
 
-            if (!cmd_options->no_database) {
-                cr_db_add_pkg(pri_db, pkg, NULL);
-                cr_db_add_pkg(fil_db, pkg, NULL);
-                cr_db_add_pkg(oth_db, pkg, NULL);
-            }
-
-            free(res.primary);
-            free(res.filelists);
-            free(res.other);
-        }
-    }
-
-    g_list_free(keys);
+    if (!dump_packages(merged_hashtable, xml_files, dbs, cmd_options->workers))
+        g_critical("Errors were encountered while writing metadata");
 
 
     // Close files
@@ -1250,23 +1860,37 @@ dump_merged_metadata(GHashTable *merged_hashtable,
 
 
     // Write updateinfo.xml
-    // TODO
 
     if (!cmd_options->noupdateinfo) {
-        CR_FILE *update_info = cr_open(update_info_filename,
-                                       CR_CW_MODE_WRITE,
-                                       cmd_options->groupfile_compression_type,
-                                       &tmp_err);
-        if (update_info) {
-            cr_puts(update_info,
-                    "<?xml version=\"1.0\"?>\n<updates></updates>\n",
-                    NULL);
-            cr_close(update_info, NULL);
-        } else {
-            g_warning("Cannot open %s: %s",
-                      update_info_filename,
-                      tmp_err->message);
-            g_error_free(tmp_err);
+        cr_UpdateInfoIndex *update_info_index = NULL;
+
+        if (cmd_options->updateinfo_index)
+            update_info_index = cr_updateinfoindex_new();
+
+        if (!merge_updateinfo(repo_list,
+                              merged_hashtable,
+                              update_info_filename,
+                              cmd_options->groupfile_compression_type,
+                              cmd_options->workers,
+                              update_info_index))
+            g_warning("Errors were encountered while merging updateinfo");
+
+        if (update_info_index) {
+            update_info_index_filename = g_strconcat(cmd_options->tmp_out_repo,
+                                                     "/updateinfo_index",
+                                                     groupfile_suffix, NULL);
+            cr_updateinfoindex_write(update_info_index,
+                                     update_info_index_filename,
+                                     cmd_options->groupfile_compression_type,
+                                     NULL,
+                                     &tmp_err);
+            if (tmp_err) {
+                g_critical("%s", tmp_err->message);
+                g_clear_error(&tmp_err);
+                g_free(update_info_index_filename);
+                update_info_index_filename = NULL;
+            }
+            cr_updateinfoindex_free(update_info_index);
         }
     }
 
@@ -1284,6 +1908,7 @@ dump_merged_metadata(GHashTable *merged_hashtable,
     cr_RepomdRecord *groupfile_rec            = NULL;
     cr_RepomdRecord *compressed_groupfile_rec = NULL;
     cr_RepomdRecord *update_info_rec          = NULL;
+    cr_RepomdRecord *update_info_index_rec    = NULL;
     cr_RepomdRecord *pkgorigins_rec           = NULL;
 
 
@@ -1339,6 +1964,13 @@ dump_merged_metadata(GHashTable *merged_hashtable,
         cr_repomd_record_fill(update_info_rec, CR_CHECKSUM_SHA256, NULL);
     }
 
+    if (update_info_index_filename) {
+        update_info_index_rec = cr_repomd_record_new(
+                                        CR_UPDATEINFO_INDEX_RECORD_TYPE,
+                                        update_info_index_filename);
+        cr_repomd_record_fill(update_info_index_rec, CR_CHECKSUM_SHA256, NULL);
+    }
+
 
     // Pkgorigins
 
@@ -1478,6 +2110,7 @@ dump_merged_metadata(GHashTable *merged_hashtable,
         cr_repomd_record_rename_file(groupfile_rec, NULL);
         cr_repomd_record_rename_file(compressed_groupfile_rec, NULL);
         cr_repomd_record_rename_file(update_info_rec, NULL);
+        cr_repomd_record_rename_file(update_info_index_rec, NULL);
         cr_repomd_record_rename_file(pkgorigins_rec, NULL);
     }
 
@@ -1494,6 +2127,7 @@ dump_merged_metadata(GHashTable *merged_hashtable,
     cr_repomd_set_record(repomd_obj, groupfile_rec);
     cr_repomd_set_record(repomd_obj, compressed_groupfile_rec);
     cr_repomd_set_record(repomd_obj, update_info_rec);
+    cr_repomd_set_record(repomd_obj, update_info_index_rec);
     cr_repomd_set_record(repomd_obj, pkgorigins_rec);
 
     char *repomd_xml = cr_xml_dump_repomd(repomd_obj, NULL);
@@ -1584,6 +2218,7 @@ dump_merged_metadata(GHashTable *merged_hashtable,
     g_free(fil_xml_filename);
     g_free(oth_xml_filename);
     g_free(update_info_filename);
+    g_free(update_info_index_filename);
 
 
     return 1;
@@ -1793,6 +2428,12 @@ main(int argc, char **argv)
                                       : NULL,
                                   koji_stuff,
                                   cmd_options->omit_baseurl);
+    if (loaded_packages < 0) {
+        if (cmd_options->koji)
+            koji_stuff_destroy(&koji_stuff);
+        destroy_merged_metadata_hashtable(merged_hashtable);
+        return 1;
+    }
 
     // Destroy koji stuff - we have to close pkgorigins file before dump
 
@@ -1802,7 +2443,8 @@ main(int argc, char **argv)
 
     // Dump metadata
 
-    dump_merged_metadata(merged_hashtable, loaded_packages, groupfile, cmd_options);
+    dump_merged_metadata(merged_hashtable, local_repos, loaded_packages,
+                         groupfile, cmd_options);
 
 
     // Remove downloaded repos and free repo location structures
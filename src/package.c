@@ -236,6 +236,7 @@ cr_package_copy(cr_Package *orig)
         file->name = cr_safe_string_chunk_insert(pkg->chunk, orig_file->name);
         pkg->files = g_slist_prepend(pkg->files, file);
     }
+    pkg->files = g_slist_reverse(pkg->files);
 
     for (GSList *elem = orig->changelogs; elem; elem = g_slist_next(elem)) {
         cr_ChangelogEntry *orig_log = elem->data;
@@ -245,6 +246,7 @@ cr_package_copy(cr_Package *orig)
         log->changelog = cr_safe_string_chunk_insert(pkg->chunk, orig_log->changelog);
         pkg->changelogs = g_slist_prepend(pkg->changelogs, log);
     }
+    pkg->changelogs = g_slist_reverse(pkg->changelogs);
 
     return pkg;
 }
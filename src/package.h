@@ -81,7 +81,7 @@ typedef struct {
 /** Package
  */
 typedef struct {
-    gint64 pkgKey;              /*!< used while inserting into sqlite db */
+    gint64 pkgKey;              /*!< order of the package in loaded metadata */
     char *pkgId;                /*!< package hash */
     char *name;                 /*!< name */
     char *arch;                 /*!< architecture */
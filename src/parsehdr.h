@@ -46,6 +46,9 @@ typedef enum {
     CR_HDRR_NONE            = (1 << 0),
     CR_HDRR_LOADHDRID       = (1 << 1), /*!< Load hdrid */
     CR_HDRR_LOADSIGNATURES  = (1 << 2), /*!< Load siggpg and siggpg */
+    CR_HDRR_RPMIO           = (1 << 3), /*!< Read the header by
+        rpmReadPackageFile() (honours digest and signature checks set
+        in the transaction set) instead of the mmap based reader */
 } cr_HeaderReadingFlags;
 
 /** Read data from header and return filled cr_Package structure.
@@ -20,7 +20,9 @@
 #include <glib.h>
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -163,6 +165,245 @@ read_header(const char *filename, Header *hdr, GError **err)
     return TRUE;
 }
 
+#ifndef	RPM5
+
+/* Layout of a package file:
+ *  - lead (96 bytes)
+ *  - signature header, padded to 8 bytes
+ *  - main header
+ *  - payload
+ * A header starts with 8 bytes of magic followed by two big-endian
+ * 32bit numbers (count of index entries and length of the data store),
+ * the index (16 bytes per entry) and the data store.
+ */
+#define RPMLEAD_LEN         96
+#define RPMLEAD_MAGIC       0xedabeedb
+#define RPMLEAD_TYPE_SOURCE 1
+#define RPMLEAD_SIGTYPE_HDR 5
+#define HDR_MAGIC_LEN       8
+#define HDR_INTRO_LEN       16
+#define HDR_ENTRY_LEN       16
+#define HDR_TAGS_MAX        0x0000ffff
+#define HDR_DATA_MAX        0x0fffffff
+
+static const unsigned char hdr_magic[] = { 0x8e, 0xad, 0xe8, 0x01 };
+
+/** A header inside of a mapped package file.
+ * All pointers point into the mapping, nothing is copied.
+ */
+typedef struct {
+    const unsigned char *index; /*!< First index entry */
+    const unsigned char *data;  /*!< Data store */
+    guint32 il;                 /*!< Number of index entries */
+    guint32 dl;                 /*!< Length of the data store */
+    gsize start;                /*!< Offset of the header (magic) */
+    gsize end;                  /*!< Offset of the first byte after */
+} cr_HdrView;
+
+static inline guint32
+be32(const unsigned char *p)
+{
+    return ((guint32) p[0] << 24) | ((guint32) p[1] << 16)
+           | ((guint32) p[2] << 8) | (guint32) p[3];
+}
+
+static inline guint16
+be16(const unsigned char *p)
+{
+    return (guint16) ((p[0] << 8) | p[1]);
+}
+
+static gboolean
+hdrview_init(cr_HdrView *view,
+             const unsigned char *map,
+             gsize size,
+             gsize offset,
+             const char *filename,
+             GError **err)
+{
+    if (size < HDR_INTRO_LEN || offset > size - HDR_INTRO_LEN
+        || memcmp(map + offset, hdr_magic, sizeof(hdr_magic)))
+    {
+        g_set_error(err, ERR_DOMAIN, CRE_ERROR,
+                    "%s: Bad header magic at offset %"G_GSIZE_FORMAT,
+                    filename, offset);
+        return FALSE;
+    }
+
+    view->il = be32(map + offset + HDR_MAGIC_LEN);
+    view->dl = be32(map + offset + HDR_MAGIC_LEN + 4);
+    if (view->il == 0 || view->il > HDR_TAGS_MAX || view->dl > HDR_DATA_MAX
+        || (gsize) view->il * HDR_ENTRY_LEN + view->dl
+                > size - offset - HDR_INTRO_LEN)
+    {
+        g_set_error(err, ERR_DOMAIN, CRE_ERROR,
+                    "%s: Corrupted header at offset %"G_GSIZE_FORMAT
+                    " (%u entries, %u bytes of data)",
+                    filename, offset, view->il, view->dl);
+        return FALSE;
+    }
+
+    view->start = offset;
+    view->index = map + offset + HDR_INTRO_LEN;
+    view->data  = view->index + (gsize) view->il * HDR_ENTRY_LEN;
+    view->end   = offset + HDR_INTRO_LEN
+                  + (gsize) view->il * HDR_ENTRY_LEN + view->dl;
+    return TRUE;
+}
+
+/** Find an entry of the header. Returns pointer to its data inside
+ * the mapping or NULL if there is no such entry of the given type
+ * or if the entry points outside of the data store.
+ */
+static const unsigned char *
+hdrview_get(const cr_HdrView *view,
+            guint32 tag,
+            guint32 type,
+            guint32 *count)
+{
+    for (guint32 x = 0; x < view->il; x++) {
+        const unsigned char *entry = view->index + (gsize) x * HDR_ENTRY_LEN;
+        if (be32(entry) != tag)
+            continue;
+
+        guint32 offset = be32(entry + 8);
+        guint32 cnt    = be32(entry + 12);
+        if (be32(entry + 4) != type || cnt == 0 || offset >= view->dl)
+            return NULL;
+        if (type == RPM_INT32_TYPE
+            && (offset % 4 || cnt > (view->dl - offset) / 4))
+            return NULL;
+
+        *count = cnt;
+        return view->data + offset;
+    }
+
+    return NULL;
+}
+
+/** Read the main header of a local package via mmap.
+ * The lead and both headers are validated in place and only the
+ * main header blob is copied (once) into the rpm Header. Tag data
+ * obtained via headerGet(HEADERGET_MINMEM) point into that blob.
+ * Of the signature header only the tags needed by
+ * cr_package_from_header() are merged into the main header.
+ *
+ * Digests and signatures are never checked by this reader. Use
+ * CR_HDRR_RPMIO to read the package with rpmReadPackageFile().
+ *
+ * @return      TRUE on success, FALSE with err set on error and FALSE
+ *              with err unset if the package cannot be handled by this
+ *              reader and rpmReadPackageFile() should be used instead
+ */
+static gboolean
+read_header_mmap(const char *filename,
+                 Header *hdr,
+                 struct cr_HeaderRangeStruct *hdr_range,
+                 GError **err)
+{
+    gboolean ret = FALSE;
+    struct stat st;
+    unsigned char *map;
+    cr_HdrView sig, hdrv;
+    guint32 count;
+    const unsigned char *val;
+
+    assert(filename);
+    assert(!err || *err == NULL);
+
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "Cannot open %s: %s", filename, g_strerror(errno));
+        return FALSE;
+    }
+
+    if (fstat(fd, &st) == -1) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "Cannot stat %s: %s", filename, g_strerror(errno));
+        close(fd);
+        return FALSE;
+    }
+
+    if (!S_ISREG(st.st_mode) || st.st_size < RPMLEAD_LEN + HDR_INTRO_LEN) {
+        // Let rpm report what is wrong
+        close(fd);
+        return FALSE;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        // E.g. a huge package on a 32bit system
+        g_debug("%s: mmap of %s failed: %s", __func__, filename,
+                g_strerror(errno));
+        return FALSE;
+    }
+
+    // Lead
+    if (be32(map) != RPMLEAD_MAGIC || map[4] < 3
+        || be16(map + 78) != RPMLEAD_SIGTYPE_HDR)
+    {
+        g_set_error(err, ERR_DOMAIN, CRE_ERROR,
+                    "%s: Not a rpm package or unsupported lead", filename);
+        goto cleanup;
+    }
+
+    // Signature header
+    if (!hdrview_init(&sig, map, st.st_size, RPMLEAD_LEN, filename, err))
+        goto cleanup;
+
+    // Main header
+    gsize hdrstart = sig.end + (8 - (sig.end % 8)) % 8;
+    if (!hdrview_init(&hdrv, map, st.st_size, hdrstart, filename, err))
+        goto cleanup;
+
+    if (!hdrview_get(&hdrv, RPMTAG_HEADERIMMUTABLE, RPM_BIN_TYPE, &count)) {
+        // Legacy (v3) header, it needs to be converted by rpm
+        ret = FALSE;
+        goto cleanup;
+    }
+
+    *hdr = headerImport((void *) (map + hdrv.start + HDR_MAGIC_LEN),
+                        hdrv.end - hdrv.start - HDR_MAGIC_LEN,
+                        HEADERIMPORT_COPY);
+    if (!*hdr) {
+        g_set_error(err, ERR_DOMAIN, CRE_ERROR,
+                    "%s: Corrupted main header", filename);
+        goto cleanup;
+    }
+
+    // What rpmReadPackageFile() would have merged or retrofitted
+    if (!headerIsEntry(*hdr, RPMTAG_ARCHIVESIZE)
+        && (val = hdrview_get(&sig, RPMSIGTAG_PAYLOADSIZE,
+                              RPM_INT32_TYPE, &count)))
+    {
+        guint32 size = be32(val);
+        headerPutUint32(*hdr, RPMTAG_ARCHIVESIZE, &size, 1);
+    }
+
+    if (be16(map + 6) == RPMLEAD_TYPE_SOURCE
+        && !headerIsEntry(*hdr, RPMTAG_SOURCERPM)
+        && !headerIsEntry(*hdr, RPMTAG_SOURCEPACKAGE))
+    {
+        guint32 one = 1;
+        headerPutUint32(*hdr, RPMTAG_SOURCEPACKAGE, &one, 1);
+    }
+
+    if (hdr_range) {
+        hdr_range->start = hdrv.start;
+        hdr_range->end   = hdrv.end;
+    }
+
+    ret = TRUE;
+
+cleanup:
+    munmap(map, st.st_size);
+    return ret;
+}
+
+#endif	/* RPM5 */
+
 cr_Package *
 cr_package_from_rpm_base(const char *filename,
                          int changelog_limit,
@@ -171,6 +412,8 @@ cr_package_from_rpm_base(const char *filename,
 {
     Header hdr = NULL;
     cr_Package *pkg = NULL;
+    gboolean bingo = FALSE;
+    struct cr_HeaderRangeStruct hdr_range = { 0, 0 };
 
     assert(filename);
     assert(!err || *err == NULL);
@@ -178,13 +421,30 @@ cr_package_from_rpm_base(const char *filename,
 #ifdef	RPM5
     G_LOCK_DEFINE_STATIC(mutex_rpm);
     G_LOCK(mutex_rpm);
+#else
+    // Merging of siggpg, sigpgp and hdrid from the signature header
+    // is left to rpm
+    if (!(flags & (CR_HDRR_RPMIO|CR_HDRR_LOADHDRID|CR_HDRR_LOADSIGNATURES))) {
+        GError *tmp_err = NULL;
+        bingo = read_header_mmap(filename, &hdr, &hdr_range, &tmp_err);
+        if (tmp_err) {
+            g_propagate_error(err, tmp_err);
+            return NULL;
+        }
+    }
 #endif
 
-    gboolean bingo = read_header(filename, &hdr, err);
+    if (!bingo)
+        bingo = read_header(filename, &hdr, err);
 
     if (bingo)
 	pkg = cr_package_from_header(hdr, changelog_limit, flags, err);
 
+    if (pkg) {
+        pkg->rpm_header_start = hdr_range.start;
+        pkg->rpm_header_end   = hdr_range.end;
+    }
+
 #ifdef	RPM5
     G_UNLOCK(mutex_rpm);
     g_thread_yield();
@@ -239,6 +499,22 @@ cr_package_from_rpm(const char *filename,
         pkg->size_package = stat_buf->st_size;
     }
 
+    // Get header range (unless the header reader already knows it)
+    // Note: Must precede the checksum calculation which drops the file
+    // content from the page cache.
+    if (!pkg->rpm_header_end) {
+        struct cr_HeaderRangeStruct hdr_r = cr_get_header_byte_range(filename,
+                                                                     &tmp_err);
+        if (tmp_err) {
+            g_propagate_prefixed_error(err, tmp_err,
+                                       "Error while determinig header range: ");
+            goto errexit;
+        }
+
+        pkg->rpm_header_start = hdr_r.start;
+        pkg->rpm_header_end = hdr_r.end;
+    }
+
     // Compute checksum
     char *checksum = cr_checksum_file(filename, checksum_type, &tmp_err);
     if (!checksum) {
@@ -249,18 +525,6 @@ cr_package_from_rpm(const char *filename,
     pkg->pkgId = cr_safe_string_chunk_insert(pkg->chunk, checksum);
     free(checksum);
 
-    // Get header range
-    struct cr_HeaderRangeStruct hdr_r = cr_get_header_byte_range(filename,
-                                                                 &tmp_err);
-    if (tmp_err) {
-        g_propagate_prefixed_error(err, tmp_err,
-                                   "Error while determinig header range: ");
-        goto errexit;
-    }
-
-    pkg->rpm_header_start = hdr_r.start;
-    pkg->rpm_header_end = hdr_r.end;
-
     return pkg;
 
 errexit:
@@ -47,8 +47,11 @@ void cr_package_parser_cleanup();
 
 /** Generate a package object from a package file.
  * Some attributes like pkgId (checksum), checksum_type, time_file,
- * location_href, location_base, rpm_header_start, rpm_header_end
- * are not filled.
+ * location_href, location_base are not filled.
+ * Local packages are mmaped and their header is validated and
+ * imported in place, in that case rpm_header_start and rpm_header_end
+ * are filled as well (otherwise they are 0).
+ * Use CR_HDRR_RPMIO to read the package by rpmReadPackageFile().
  * @param filename              filename
  * @param changelog_limit       number of changelogs that will be loaded
  * @param flags                 Flags for header reading
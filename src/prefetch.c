@@ -0,0 +1,351 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+
+#include <glib.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "error.h"
+#include "prefetch.h"
+#include "profile.h"
+
+#define ERR_DOMAIN      CREATEREPO_C_ERROR
+#define BUFFER_SIZE     (1024*1024)
+
+typedef enum {
+    CR_PF_WAITING,      // Not passed to the I/O threads yet
+    CR_PF_QUEUED,       // Passed to the I/O threads
+    CR_PF_DONE,         // Result is ready
+    CR_PF_CANCELLED,    // Requested before it was queued, won't be read
+    CR_PF_RELEASED,     // Released by the consumer
+} cr_PrefetchState;
+
+typedef struct {
+    char                *path;
+    cr_PrefetchState    state;
+    int                 fd;     // Kept open until release
+    cr_PrefetchResult   res;
+} cr_PrefetchEntry;
+
+struct _cr_Prefetch {
+    GThreadPool         *pool;      // I/O threads
+    GMutex              *mutex;
+    GCond               *cond;      // Signalled when an entry is done
+    GPtrArray           *entries;   // cr_PrefetchEntry, index is the id
+    long                low;        // Oldest unreleased entry
+    long                queued;     // Entries passed to the pool
+                                    // (or cancelled)
+    guint               depth;
+    cr_ChecksumType     checksum_type;
+    cr_PrefetchSkipFunc skip;
+    gpointer            skip_data;
+};
+
+/** Read the file of the entry. Called from the I/O threads without
+ * the lock, the entry is not touched by anybody else until it's done.
+ */
+static void
+cr_prefetch_read(cr_Prefetch *pf, cr_PrefetchEntry *entry)
+{
+    cr_PrefetchResult *res = &entry->res;
+    cr_ChecksumCtx *ctx;
+    unsigned char *buf;
+    GError *tmp_err = NULL;
+
+    entry->fd = open(entry->path, O_RDONLY);
+    if (entry->fd == -1) {
+        g_set_error(&res->err, ERR_DOMAIN, CRE_IO,
+                    "Cannot open %s: %s", entry->path, g_strerror(errno));
+        return;
+    }
+
+    if (fstat(entry->fd, &res->st) == -1) {
+        g_set_error(&res->err, ERR_DOMAIN, CRE_IO,
+                    "stat(%s) failed: %s", entry->path, g_strerror(errno));
+        return;
+    }
+
+    if (pf->skip && pf->skip(entry->path, &res->st, pf->skip_data))
+        return;
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(entry->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    res->hdr_range = cr_get_header_byte_range(entry->path, &tmp_err);
+    if (tmp_err) {
+        g_propagate_error(&res->err, tmp_err);
+        return;
+    }
+
+    if (pf->checksum_type == CR_CHECKSUM_UNKNOWN) {
+        // Only the header will be read by the consumer
+#ifdef POSIX_FADV_WILLNEED
+        posix_fadvise(entry->fd, 0, res->hdr_range.end, POSIX_FADV_WILLNEED);
+#endif
+        res->read = TRUE;
+        return;
+    }
+
+    ctx = cr_checksum_new(pf->checksum_type, &tmp_err);
+    if (!ctx) {
+        g_propagate_error(&res->err, tmp_err);
+        return;
+    }
+
+    buf = g_malloc(BUFFER_SIZE);
+    while (1) {
+        ssize_t readed = read(entry->fd, buf, BUFFER_SIZE);
+        if (readed == 0)
+            break;  // EOF
+        if (readed == -1) {
+            if (errno == EINTR)
+                continue;
+            g_set_error(&tmp_err, ERR_DOMAIN, CRE_IO,
+                        "Error while reading %s: %s",
+                        entry->path, g_strerror(errno));
+            break;
+        }
+        if (cr_checksum_update(ctx, buf, readed, &tmp_err) != CRE_OK)
+            break;
+    }
+    g_free(buf);
+
+    res->checksum = cr_checksum_final(ctx, tmp_err ? NULL : &tmp_err);
+    if (tmp_err) {
+        g_propagate_error(&res->err, tmp_err);
+        g_free(res->checksum);
+        res->checksum = NULL;
+        return;
+    }
+
+    res->read = TRUE;
+}
+
+static void
+cr_prefetch_thread(gpointer data, gpointer user_data)
+{
+    cr_PrefetchEntry *entry = data;
+    cr_Prefetch *pf = user_data;
+
+    cr_prefetch_read(pf, entry);
+
+    g_mutex_lock(pf->mutex);
+    entry->state = CR_PF_DONE;
+    g_cond_broadcast(pf->cond);
+    g_mutex_unlock(pf->mutex);
+}
+
+/** Pass entries within the window to the I/O threads.
+ * Must be called with the lock held.
+ */
+static void
+cr_prefetch_schedule(cr_Prefetch *pf)
+{
+    while (pf->queued < (long) pf->entries->len
+           && pf->queued < pf->low + (long) pf->depth)
+    {
+        cr_PrefetchEntry *entry = g_ptr_array_index(pf->entries, pf->queued++);
+        if (entry->state != CR_PF_WAITING)
+            continue;
+        entry->state = CR_PF_QUEUED;
+        g_thread_pool_push(pf->pool, entry, NULL);
+    }
+}
+
+static void
+cr_prefetch_entry_clear(cr_PrefetchEntry *entry)
+{
+    if (entry->fd != -1) {
+#ifdef POSIX_FADV_DONTNEED
+        // Don't let the content evict more useful data from the page cache
+        posix_fadvise(entry->fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+        close(entry->fd);
+        entry->fd = -1;
+    }
+    g_free(entry->res.checksum);
+    entry->res.checksum = NULL;
+    g_clear_error(&entry->res.err);
+    g_free(entry->path);
+    entry->path = NULL;
+}
+
+cr_Prefetch *
+cr_prefetch_new(guint depth,
+                guint threads,
+                cr_ChecksumType checksum_type,
+                cr_PrefetchSkipFunc skip,
+                gpointer skip_data,
+                GError **err)
+{
+    cr_Prefetch *pf;
+    GError *tmp_err = NULL;
+
+    assert(!err || *err == NULL);
+
+    if (!depth) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "Prefetch depth must be a positive number");
+        return NULL;
+    }
+
+    pf = g_new0(cr_Prefetch, 1);
+    pf->mutex           = g_mutex_new();
+    pf->cond            = g_cond_new();
+    pf->entries         = g_ptr_array_new();
+    pf->depth           = depth;
+    pf->checksum_type   = checksum_type;
+    pf->skip            = skip;
+    pf->skip_data       = skip_data;
+
+    pf->pool = g_thread_pool_new(cr_prefetch_thread, pf,
+                                 threads ? threads : CR_PREFETCH_DEFAULT_THREADS,
+                                 TRUE, &tmp_err);
+    if (!pf->pool) {
+        g_propagate_prefixed_error(err, tmp_err,
+                                   "Cannot start prefetch threads: ");
+        g_ptr_array_free(pf->entries, TRUE);
+        g_mutex_free(pf->mutex);
+        g_cond_free(pf->cond);
+        g_free(pf);
+        return NULL;
+    }
+
+    return pf;
+}
+
+long
+cr_prefetch_add(cr_Prefetch *pf, const char *path)
+{
+    cr_PrefetchEntry *entry;
+    long id;
+
+    assert(pf);
+    assert(path);
+
+    entry = g_new0(cr_PrefetchEntry, 1);
+    entry->path  = g_strdup(path);
+    entry->state = CR_PF_WAITING;
+    entry->fd    = -1;
+
+    g_mutex_lock(pf->mutex);
+    id = pf->entries->len;
+    g_ptr_array_add(pf->entries, entry);
+    cr_prefetch_schedule(pf);
+    g_mutex_unlock(pf->mutex);
+
+    return id;
+}
+
+cr_PrefetchResult *
+cr_prefetch_get(cr_Prefetch *pf, long id)
+{
+    cr_PrefetchEntry *entry;
+    cr_PrefetchResult *res = NULL;
+    gint64 prof_start = cr_profile_start();
+
+    assert(pf);
+
+    g_mutex_lock(pf->mutex);
+
+    if (id < 0 || id >= (long) pf->entries->len) {
+        g_mutex_unlock(pf->mutex);
+        return NULL;
+    }
+
+    entry = g_ptr_array_index(pf->entries, id);
+    if (entry->state == CR_PF_WAITING) {
+        // Too far ahead, the caller will read the file itself
+        entry->state = CR_PF_CANCELLED;
+    } else {
+        while (entry->state == CR_PF_QUEUED)
+            g_cond_wait(pf->cond, pf->mutex);
+        if (entry->state == CR_PF_DONE)
+            res = &entry->res;
+    }
+
+    g_mutex_unlock(pf->mutex);
+    cr_profile_stop(CR_PROF_WAIT_PREFETCH, prof_start);
+
+    return res;
+}
+
+void
+cr_prefetch_release(cr_Prefetch *pf, long id)
+{
+    cr_PrefetchEntry *entry;
+
+    assert(pf);
+
+    g_mutex_lock(pf->mutex);
+
+    if (id < 0 || id >= (long) pf->entries->len) {
+        g_mutex_unlock(pf->mutex);
+        return;
+    }
+
+    entry = g_ptr_array_index(pf->entries, id);
+    if (entry->state == CR_PF_WAITING)
+        entry->state = CR_PF_CANCELLED;
+    while (entry->state == CR_PF_QUEUED)
+        g_cond_wait(pf->cond, pf->mutex);
+
+    if (entry->state != CR_PF_RELEASED) {
+        cr_prefetch_entry_clear(entry);
+        entry->state = CR_PF_RELEASED;
+    }
+
+    // Move the window
+    while (pf->low < (long) pf->entries->len) {
+        cr_PrefetchEntry *low = g_ptr_array_index(pf->entries, pf->low);
+        if (low->state != CR_PF_RELEASED)
+            break;
+        pf->low++;
+    }
+    cr_prefetch_schedule(pf);
+
+    g_mutex_unlock(pf->mutex);
+}
+
+void
+cr_prefetch_free(cr_Prefetch *pf)
+{
+    if (!pf)
+        return;
+
+    // Entries which were not started yet are dropped
+    g_thread_pool_free(pf->pool, TRUE, TRUE);
+
+    for (guint x = 0; x < pf->entries->len; x++) {
+        cr_PrefetchEntry *entry = g_ptr_array_index(pf->entries, x);
+        cr_prefetch_entry_clear(entry);
+        g_free(entry);
+    }
+
+    g_ptr_array_free(pf->entries, TRUE);
+    g_mutex_free(pf->mutex);
+    g_cond_free(pf->cond);
+    g_free(pf);
+}
@@ -0,0 +1,149 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+
+#ifndef __C_CREATEREPOLIB_PREFETCH_H__
+#define __C_CREATEREPOLIB_PREFETCH_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <glib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "checksum.h"
+#include "misc.h"
+
+/** \defgroup   prefetch    Read-ahead of packages for the dumper threads.
+ *
+ * Packages are read by a small pool of I/O threads in the order in which
+ * they will be processed, at most a given number of packages ahead of
+ * the oldest package which was not released yet. For every package
+ * the I/O thread does stat(), determines the header range and reads
+ * the whole file (computing its checksum on the way), so the header
+ * reading in the dumper thread is served from the page cache.
+ * The content is dropped from the page cache when the package
+ * is released.
+ *
+ * \code
+ * cr_Prefetch *pf = cr_prefetch_new(32, 4, CR_CHECKSUM_SHA256,
+ *                                   NULL, NULL, NULL);
+ * cr_prefetch_add(pf, "/foo/a.rpm");  // id 0
+ * cr_prefetch_add(pf, "/foo/b.rpm");  // id 1
+ * ...
+ * cr_PrefetchResult *res = cr_prefetch_get(pf, 0);
+ * if (res && !res->err)
+ *     use(res->checksum);
+ * cr_prefetch_release(pf, 0);
+ * ...
+ * cr_prefetch_free(pf);
+ * \endcode
+ *
+ *  \addtogroup prefetch
+ *  @{
+ */
+
+/** Default number of I/O threads.
+ */
+#define CR_PREFETCH_DEFAULT_THREADS     4
+
+typedef struct _cr_Prefetch cr_Prefetch;
+
+/** Result of prefetching of a single package.
+ */
+typedef struct {
+    struct stat st;             /*!< stat() of the file */
+    gboolean    read;           /*!< The file was read (not skipped),
+                                     hdr_range is valid */
+    struct cr_HeaderRangeStruct hdr_range; /*!< Header range */
+    char        *checksum;      /*!< Checksum of the file (if read and
+                                     a checksum type was requested) */
+    GError      *err;           /*!< Error (other items are not valid) */
+} cr_PrefetchResult;
+
+/** Function which decides whether the content of a file is needed.
+ * It is called from the I/O threads.
+ * @param path          Path to the file
+ * @param st            stat() of the file
+ * @param user_data     User data
+ * @return              TRUE if only stat() is needed (e.g. metadata of
+ *                      the package are reused)
+ */
+typedef gboolean (*cr_PrefetchSkipFunc)(const char *path,
+                                        const struct stat *st,
+                                        gpointer user_data);
+
+/** Create a new prefetch engine.
+ * @param depth         Max number of packages read ahead of the oldest
+ *                      unreleased package
+ * @param threads       Number of I/O threads (0 for default)
+ * @param checksum_type Type of checksum to compute or CR_CHECKSUM_UNKNOWN
+ *                      to just read the header into the page cache
+ * @param skip          Function which decides whether the content of
+ *                      a package is needed or NULL
+ * @param skip_data     User data for the skip function
+ * @param err           GError **
+ * @return              New cr_Prefetch or NULL on error
+ */
+cr_Prefetch *cr_prefetch_new(guint depth,
+                             guint threads,
+                             cr_ChecksumType checksum_type,
+                             cr_PrefetchSkipFunc skip,
+                             gpointer skip_data,
+                             GError **err);
+
+/** Append a package. Packages get ids in the order in which they are
+ * added (starting from 0) and they are read in this order.
+ * @param pf            cr_Prefetch
+ * @param path          Path to the package
+ * @return              Id of the package
+ */
+long cr_prefetch_add(cr_Prefetch *pf, const char *path);
+
+/** Wait for the result of the package. If reading of the package was not
+ * started yet (the caller is too far ahead), the package is not read by
+ * the engine at all and NULL is returned.
+ * @param pf            cr_Prefetch
+ * @param id            Id of the package
+ * @return              Result owned by the engine (valid until
+ *                      cr_prefetch_release()) or NULL
+ */
+cr_PrefetchResult *cr_prefetch_get(cr_Prefetch *pf, long id);
+
+/** Release the package - free its result and drop its content
+ * from the page cache. Every added package must be released to let
+ * the engine read the following packages.
+ * @param pf            cr_Prefetch
+ * @param id            Id of the package
+ */
+void cr_prefetch_release(cr_Prefetch *pf, long id);
+
+/** Stop the I/O threads and free the engine.
+ * @param pf            cr_Prefetch
+ */
+void cr_prefetch_free(cr_Prefetch *pf);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __C_CREATEREPOLIB_PREFETCH_H__ */
@@ -0,0 +1,354 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <assert.h>
+#include <string.h>
+#include "error.h"
+#include "profile.h"
+
+#define ERR_DOMAIN      CREATEREPO_C_ERROR
+
+/** Profiling data of a single thread.
+ * Slots are never freed, they are linked into a global list
+ * so data of finished threads are still part of the report.
+ */
+typedef struct {
+    gint64  time[CR_PROF_PHASE_SENTINEL];   /*!< Total time (us) */
+    gint64  calls[CR_PROF_PHASE_SENTINEL];  /*!< Number of measurements */
+    gint64  counter[CR_PROF_CNT_SENTINEL];
+    gint64  hist[CR_PROF_HIST_SENTINEL][CR_PROF_HIST_BUCKETS];
+} cr_ProfileSlot;
+
+static const char *phase_names[CR_PROF_PHASE_SENTINEL] = {
+    "dir_walk",
+    "metadata_load",
+    "pool",
+    "stat",
+    "header_read",
+    "header_range",
+    "checksum",
+    "wait_prefetch",
+    "xml_dump",
+    "wait_primary",
+    "wait_filelists",
+    "wait_other",
+    "write_primary",
+    "write_filelists",
+    "write_other",
+    "db_add_primary",
+    "db_add_filelists",
+    "db_add_other",
+    "xml_close",
+    "db_close",
+    "compress_file",
+    "repomd_checksum",
+    "repomd_open_stat",
+    "repomd_fill",
+    "deltas",
+    "repomd_write",
+    "publish",
+};
+
+static const char *counter_names[CR_PROF_CNT_SENTINEL] = {
+    "packages",
+    "packages_reused",
+    "packages_read",
+    "packages_failed",
+    "tasks_buffered",
+    "xml_bytes",
+    "segments_reused",
+    "segments_written",
+    "packages_prefetched",
+    "deltas_reused",
+    "deltas_generated",
+    "packages_deduped",
+};
+
+static const char *hist_names[CR_PROF_HIST_SENTINEL] = {
+    "wait_primary_us",
+    "wait_filelists_us",
+    "wait_other_us",
+    "buffer_depth",
+};
+
+static gboolean profile_enabled = FALSE;
+static gint64 profile_started = 0;
+static GSList *profile_slots = NULL;
+G_LOCK_DEFINE_STATIC(profile_slots);
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+static GPrivate profile_slot = G_PRIVATE_INIT(NULL);
+#endif
+
+/** Return slot of the calling thread. Without thread local storage
+ * a single shared slot is used and the caller must hold the lock
+ * (see SLOT_LOCK/SLOT_UNLOCK).
+ */
+static cr_ProfileSlot *
+cr_profile_slot(void)
+{
+    cr_ProfileSlot *slot;
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+    slot = g_private_get(&profile_slot);
+    if (slot)
+        return slot;
+
+    slot = g_new0(cr_ProfileSlot, 1);
+    g_private_set(&profile_slot, slot);
+    G_LOCK(profile_slots);
+    profile_slots = g_slist_prepend(profile_slots, slot);
+    G_UNLOCK(profile_slots);
+#else
+    if (profile_slots)
+        return profile_slots->data;
+    slot = g_new0(cr_ProfileSlot, 1);
+    profile_slots = g_slist_prepend(profile_slots, slot);
+#endif
+
+    return slot;
+}
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+#define SLOT_LOCK()
+#define SLOT_UNLOCK()
+#else
+#define SLOT_LOCK()     G_LOCK(profile_slots)
+#define SLOT_UNLOCK()   G_UNLOCK(profile_slots)
+#endif
+
+void
+cr_profile_enable(void)
+{
+    profile_enabled = TRUE;
+    profile_started = g_get_monotonic_time();
+}
+
+gboolean
+cr_profile_enabled(void)
+{
+    return profile_enabled;
+}
+
+gint64
+cr_profile_start(void)
+{
+    if (!profile_enabled)
+        return 0;
+    return g_get_monotonic_time();
+}
+
+gint64
+cr_profile_stop(cr_ProfilePhase phase, gint64 start)
+{
+    gint64 elapsed;
+    cr_ProfileSlot *slot;
+
+    if (!profile_enabled)
+        return 0;
+
+    assert(phase < CR_PROF_PHASE_SENTINEL);
+
+    elapsed = g_get_monotonic_time() - start;
+    if (elapsed < 0)
+        elapsed = 0;
+
+    SLOT_LOCK();
+    slot = cr_profile_slot();
+    slot->time[phase] += elapsed;
+    slot->calls[phase]++;
+    SLOT_UNLOCK();
+
+    return elapsed;
+}
+
+void
+cr_profile_count(cr_ProfileCounter counter, gint64 value)
+{
+    cr_ProfileSlot *slot;
+
+    if (!profile_enabled)
+        return;
+
+    assert(counter < CR_PROF_CNT_SENTINEL);
+
+    SLOT_LOCK();
+    slot = cr_profile_slot();
+    slot->counter[counter] += value;
+    SLOT_UNLOCK();
+}
+
+static int
+cr_profile_bucket(gint64 value)
+{
+    int bucket = 0;
+
+    while (value > 0 && bucket < CR_PROF_HIST_BUCKETS - 1) {
+        value >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+void
+cr_profile_sample(cr_ProfileHistogram hist, gint64 value)
+{
+    cr_ProfileSlot *slot;
+
+    if (!profile_enabled)
+        return;
+
+    assert(hist < CR_PROF_HIST_SENTINEL);
+
+    SLOT_LOCK();
+    slot = cr_profile_slot();
+    slot->hist[hist][cr_profile_bucket(value)]++;
+    SLOT_UNLOCK();
+}
+
+/** Sum data of all threads into the total.
+ * Values read from running threads may be slightly out of date,
+ * which is fine for a report.
+ */
+static void
+cr_profile_aggregate(cr_ProfileSlot *total, guint *threads)
+{
+    memset(total, 0, sizeof(*total));
+    *threads = 0;
+
+    G_LOCK(profile_slots);
+    for (GSList *elem = profile_slots; elem; elem = g_slist_next(elem)) {
+        cr_ProfileSlot *slot = elem->data;
+
+        for (int x = 0; x < CR_PROF_PHASE_SENTINEL; x++) {
+            total->time[x] += slot->time[x];
+            total->calls[x] += slot->calls[x];
+        }
+        for (int x = 0; x < CR_PROF_CNT_SENTINEL; x++)
+            total->counter[x] += slot->counter[x];
+        for (int x = 0; x < CR_PROF_HIST_SENTINEL; x++)
+            for (int y = 0; y < CR_PROF_HIST_BUCKETS; y++)
+                total->hist[x][y] += slot->hist[x][y];
+        (*threads)++;
+    }
+    G_UNLOCK(profile_slots);
+}
+
+gchar *
+cr_profile_report_json(const char *program)
+{
+    cr_ProfileSlot total;
+    guint threads;
+    GString *json = g_string_new(NULL);
+
+    cr_profile_aggregate(&total, &threads);
+
+    g_string_append_printf(json,
+            "{\n  \"program\": \"%s\",\n"
+            "  \"wall_us\": %"G_GINT64_FORMAT",\n"
+            "  \"threads\": %u,\n",
+            program ? program : "",
+            profile_started ? g_get_monotonic_time() - profile_started : 0,
+            threads);
+
+    // Phases
+    g_string_append(json, "  \"phases\": {");
+    for (int x = 0; x < CR_PROF_PHASE_SENTINEL; x++) {
+        g_string_append_printf(json,
+                "%s\n    \"%s\": {\"us\": %"G_GINT64_FORMAT
+                ", \"calls\": %"G_GINT64_FORMAT"}",
+                x ? "," : "", phase_names[x],
+                total.time[x], total.calls[x]);
+    }
+    g_string_append(json, "\n  },\n");
+
+    // Counters
+    g_string_append(json, "  \"counters\": {");
+    for (int x = 0; x < CR_PROF_CNT_SENTINEL; x++) {
+        g_string_append_printf(json, "%s\n    \"%s\": %"G_GINT64_FORMAT,
+                x ? "," : "", counter_names[x], total.counter[x]);
+    }
+    g_string_append(json, "\n  },\n");
+
+    // Histograms - trailing empty buckets are omitted
+    g_string_append(json, "  \"histograms\": {");
+    for (int x = 0; x < CR_PROF_HIST_SENTINEL; x++) {
+        int last = CR_PROF_HIST_BUCKETS - 1;
+        while (last >= 0 && total.hist[x][last] == 0)
+            last--;
+
+        g_string_append_printf(json, "%s\n    \"%s\": [",
+                               x ? "," : "", hist_names[x]);
+        for (int y = 0; y <= last; y++)
+            g_string_append_printf(json, "%s%"G_GINT64_FORMAT,
+                                   y ? ", " : "", total.hist[x][y]);
+        g_string_append(json, "]");
+    }
+    g_string_append(json, "\n  }\n}\n");
+
+    return g_string_free(json, FALSE);
+}
+
+void
+cr_profile_log_summary(void)
+{
+    cr_ProfileSlot total;
+    guint threads;
+
+    if (!profile_enabled)
+        return;
+
+    cr_profile_aggregate(&total, &threads);
+
+    g_message("Profile (%u threads, wall %.3f s):", threads,
+              (g_get_monotonic_time() - profile_started) / 1000000.0);
+    for (int x = 0; x < CR_PROF_PHASE_SENTINEL; x++) {
+        if (!total.calls[x])
+            continue;
+        g_message("  %-18s %10.3f s %10"G_GINT64_FORMAT" calls",
+                  phase_names[x], total.time[x] / 1000000.0, total.calls[x]);
+    }
+    for (int x = 0; x < CR_PROF_CNT_SENTINEL; x++)
+        g_message("  %-18s %10"G_GINT64_FORMAT,
+                  counter_names[x], total.counter[x]);
+}
+
+gboolean
+cr_profile_write_json(const char *path, const char *program, GError **err)
+{
+    gchar *json;
+    GError *tmp_err = NULL;
+
+    assert(path);
+    assert(!err || *err == NULL);
+
+    json = cr_profile_report_json(program);
+    if (!g_file_set_contents(path, json, -1, &tmp_err)) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "Cannot write stats to %s: %s", path, tmp_err->message);
+        g_error_free(tmp_err);
+        g_free(json);
+        return FALSE;
+    }
+
+    g_free(json);
+    return TRUE;
+}
@@ -0,0 +1,169 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#ifndef __C_CREATEREPOLIB_PROFILE_H__
+#define __C_CREATEREPOLIB_PROFILE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <glib.h>
+
+/** \defgroup   profile     Lightweight per-phase profiling.
+ *
+ * Timers and counters are kept per thread (no locking on the hot path)
+ * and aggregated on request. All functions are no-op (a single branch)
+ * until cr_profile_enable() is called.
+ *
+ * \code
+ * gint64 start = cr_profile_start();
+ * do_something();
+ * cr_profile_stop(CR_PROF_XML_DUMP, start);
+ * \endcode
+ *
+ * \addtogroup profile
+ *  @{
+ */
+
+/** Timed phases.
+ */
+typedef enum {
+    CR_PROF_DIR_WALK,           /*!< Directory walk */
+    CR_PROF_MD_LOAD,            /*!< Loading of old metadata (--update) */
+    CR_PROF_POOL,               /*!< Whole dumper pool run */
+    CR_PROF_STAT,               /*!< stat() of packages */
+    CR_PROF_HEADER_READ,        /*!< Reading of rpm headers */
+    CR_PROF_HEADER_RANGE,       /*!< Getting header byte range */
+    CR_PROF_CHECKSUM,           /*!< Package checksum (incl. cache) */
+    CR_PROF_WAIT_PREFETCH,      /*!< Waiting for a prefetched package */
+    CR_PROF_XML_DUMP,           /*!< cr_xml_dump() */
+    CR_PROF_WAIT_PRIMARY,       /*!< Waiting for a turn to write primary */
+    CR_PROF_WAIT_FILELISTS,     /*!< Waiting for a turn to write filelists */
+    CR_PROF_WAIT_OTHER,         /*!< Waiting for a turn to write other */
+    CR_PROF_WRITE_PRIMARY,      /*!< Writing (compression) of primary */
+    CR_PROF_WRITE_FILELISTS,    /*!< Writing (compression) of filelists */
+    CR_PROF_WRITE_OTHER,        /*!< Writing (compression) of other */
+    CR_PROF_DB_ADD_PRIMARY,     /*!< cr_db_add_pkg() into primary db */
+    CR_PROF_DB_ADD_FILELISTS,   /*!< cr_db_add_pkg() into filelists db */
+    CR_PROF_DB_ADD_OTHER,       /*!< cr_db_add_pkg() into other db */
+    CR_PROF_XML_CLOSE,          /*!< Closing (flushing) of xml files */
+    CR_PROF_DB_CLOSE,           /*!< Indexing and closing of dbs */
+    CR_PROF_COMPRESS_FILE,      /*!< Compression of a file (e.g. db) */
+    CR_PROF_REPOMD_CHECKSUM,    /*!< Checksum of a repomd record file */
+    CR_PROF_REPOMD_OPEN_STAT,   /*!< Checksum of decompressed content */
+    CR_PROF_REPOMD_FILL,        /*!< Whole repomd record fill */
+    CR_PROF_DELTAS,             /*!< Delta rpms and prestodelta */
+    CR_PROF_REPOMD_WRITE,       /*!< Generation of repomd.xml */
+    CR_PROF_PUBLISH,            /*!< Retention and final move */
+    CR_PROF_PHASE_SENTINEL,     /*!< Sentinel of the list */
+} cr_ProfilePhase;
+
+/** Counters.
+ */
+typedef enum {
+    CR_PROF_CNT_PACKAGES,           /*!< Processed tasks */
+    CR_PROF_CNT_PACKAGES_REUSED,    /*!< Packages reused from old metadata */
+    CR_PROF_CNT_PACKAGES_READ,      /*!< Packages read from rpm files */
+    CR_PROF_CNT_PACKAGES_FAILED,    /*!< Packages that failed */
+    CR_PROF_CNT_TASKS_BUFFERED,     /*!< Tasks put into the buffer */
+    CR_PROF_CNT_XML_BYTES,          /*!< Bytes of generated XML */
+    CR_PROF_CNT_SEGMENTS_REUSED,    /*!< Segments copied from old files */
+    CR_PROF_CNT_SEGMENTS_WRITTEN,   /*!< Segments compressed again */
+    CR_PROF_CNT_PACKAGES_PREFETCHED,/*!< Packages read by prefetch threads */
+    CR_PROF_CNT_DELTAS_REUSED,      /*!< Deltas reused from previous runs */
+    CR_PROF_CNT_DELTAS_GENERATED,   /*!< Deltas made by makedeltarpm */
+    CR_PROF_CNT_PACKAGES_DEDUPED,   /*!< Packages copied from a hardlink */
+    CR_PROF_CNT_SENTINEL,           /*!< Sentinel of the list */
+} cr_ProfileCounter;
+
+/** Histograms. Buckets are powers of two: bucket N holds values
+ * from 2^(N-1) to 2^N - 1, bucket 0 holds zero.
+ */
+typedef enum {
+    CR_PROF_HIST_WAIT_PRIMARY,      /*!< Wait for primary turn (us) */
+    CR_PROF_HIST_WAIT_FILELISTS,    /*!< Wait for filelists turn (us) */
+    CR_PROF_HIST_WAIT_OTHER,        /*!< Wait for other turn (us) */
+    CR_PROF_HIST_BUFFER_DEPTH,      /*!< Length of the task buffer */
+    CR_PROF_HIST_SENTINEL,          /*!< Sentinel of the list */
+} cr_ProfileHistogram;
+
+#define CR_PROF_HIST_BUCKETS    32  /*!< Number of buckets of a histogram */
+
+/** Enable profiling. Should be called before any other thread is started.
+ */
+void cr_profile_enable(void);
+
+/** Is profiling enabled?
+ */
+gboolean cr_profile_enabled(void);
+
+/** Get start timestamp for a phase.
+ * @return          Monotonic time in microseconds or 0 if profiling
+ *                  is disabled.
+ */
+gint64 cr_profile_start(void);
+
+/** Account time elapsed from start to the phase.
+ * @param phase     Phase
+ * @param start     Value returned by cr_profile_start()
+ * @return          Elapsed time in microseconds (0 if disabled)
+ */
+gint64 cr_profile_stop(cr_ProfilePhase phase, gint64 start);
+
+/** Add a value to a counter.
+ * @param counter   Counter
+ * @param value     Value
+ */
+void cr_profile_count(cr_ProfileCounter counter, gint64 value);
+
+/** Add a sample to a histogram.
+ * @param hist      Histogram
+ * @param value     Sample (negative values are counted as zero)
+ */
+void cr_profile_sample(cr_ProfileHistogram hist, gint64 value);
+
+/** Aggregate data of all threads and return a JSON report.
+ * @param program   Name of the program (e.g. "createrepo_c")
+ * @return          Malloced string with JSON document
+ */
+gchar *cr_profile_report_json(const char *program);
+
+/** Aggregate data of all threads and log a human readable summary
+ * via g_message().
+ */
+void cr_profile_log_summary(void);
+
+/** Write the JSON report into a file.
+ * @param path      Path to the output file
+ * @param program   Name of the program
+ * @param err       GError **
+ * @return          TRUE on success
+ */
+gboolean cr_profile_write_json(const char *path,
+                               const char *program,
+                               GError **err);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __C_CREATEREPOLIB_PROFILE_H__ */
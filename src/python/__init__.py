@@ -42,6 +42,12 @@ BZ2_COMPRESSION         = _createrepo_c.BZ2_COMPRESSION
 #: XZ compression
 XZ_COMPRESSION          = _createrepo_c.XZ_COMPRESSION
 
+#: Zstandard compression
+ZSTD_COMPRESSION        = _createrepo_c.ZSTD_COMPRESSION
+
+#: Zchunk compression
+ZCK_COMPRESSION         = _createrepo_c.ZCK_COMPRESSION
+
 #: Gzip compression alias
 GZ                      = _createrepo_c.GZ_COMPRESSION
 
@@ -51,6 +57,12 @@ BZ2                     = _createrepo_c.BZ2_COMPRESSION
 #: XZ compression alias
 XZ                      = _createrepo_c.XZ_COMPRESSION
 
+#: Zstandard compression alias
+ZSTD                    = _createrepo_c.ZSTD_COMPRESSION
+
+#: Zchunk compression alias
+ZCK                     = _createrepo_c.ZCK_COMPRESSION
+
 HT_KEY_DEFAULT  = _createrepo_c.HT_KEY_DEFAULT  #: Default key (hash)
 HT_KEY_HASH     = _createrepo_c.HT_KEY_HASH     #: Package hash as a key
 HT_KEY_NAME     = _createrepo_c.HT_KEY_NAME     #: Package name as a key
@@ -222,6 +234,16 @@ class UpdateInfo(_createrepo_c.UpdateInfo):
             xml_parse_updateinfo(path, self)
 
 
+# UpdateInfoIndex class
+
+class UpdateInfoIndex(_createrepo_c.UpdateInfoIndex):
+    def __init__(self, path=None):
+        """:arg path: Path to an index stored by write() or None"""
+        _createrepo_c.UpdateInfoIndex.__init__(self)
+        if path:
+            self.load(path)
+
+
 # UpdateRecord class
 
 UpdateRecord = _createrepo_c.UpdateRecord
@@ -306,6 +328,25 @@ def xml_parse_other(path, newpkgcb=None, pkgcb=None, warningcb=None):
     """Parse other.xml"""
     return _createrepo_c.xml_parse_other(path, newpkgcb, pkgcb, warningcb)
 
+def xml_parse_primary_batch(path, batchcb, batch_size=1000,
+                            warningcb=None, do_files=1):
+    """Parse primary.xml and call batchcb with lists of (at most)
+    batch_size packages. Much faster than a per-package callback."""
+    return _createrepo_c.xml_parse_primary_batch(path, batchcb, batch_size,
+                                                 warningcb, do_files)
+
+def xml_parse_filelists_batch(path, batchcb, batch_size=1000, warningcb=None):
+    """Parse filelists.xml and call batchcb with lists of (at most)
+    batch_size packages."""
+    return _createrepo_c.xml_parse_filelists_batch(path, batchcb, batch_size,
+                                                   warningcb)
+
+def xml_parse_other_batch(path, batchcb, batch_size=1000, warningcb=None):
+    """Parse other.xml and call batchcb with lists of (at most)
+    batch_size packages."""
+    return _createrepo_c.xml_parse_other_batch(path, batchcb, batch_size,
+                                               warningcb)
+
 def xml_parse_updateinfo(path, updateinfoobj, warningcb=None):
     """Parse updateinfo.xml"""
     return _createrepo_c.xml_parse_updateinfo(path, updateinfoobj, warningcb)
@@ -316,6 +357,7 @@ def xml_parse_repomd(path, repomdobj, warningcb=None):
 
 checksum_name_str   = _createrepo_c.checksum_name_str
 checksum_type       = _createrepo_c.checksum_type
+checksum_file       = _createrepo_c.checksum_file
 
 def compress_file(src, dst, comtype, stat=None):
     return _createrepo_c.compress_file_with_stat(src, dst, comtype, stat)
@@ -326,3 +368,13 @@ def decompress_file(src, dst, comtype, stat=None):
 compression_suffix  = _createrepo_c.compression_suffix
 detect_compression  = _createrepo_c.detect_compression
 compression_type    = _createrepo_c.compression_type
+
+def set_zstd_params(level=0, long_mode=False, workers=0):
+    """Set parameters of the Zstandard compression used by files
+    opened for writing afterwards."""
+    return _createrepo_c.set_zstd_params(level, long_mode, workers)
+
+def set_read_params(buffer_size=0, xz_threads=0, threaded=True):
+    """Set parameters of the decompression used by files
+    opened for reading afterwards."""
+    return _createrepo_c.set_read_params(buffer_size, xz_threads, threaded)
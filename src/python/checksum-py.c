@@ -47,3 +47,27 @@ py_checksum_type(G_GNUC_UNUSED PyObject *self, PyObject *args)
 
     return PyLong_FromLong((long) cr_checksum_type(type));
 }
+
+PyObject *
+py_checksum_file(G_GNUC_UNUSED PyObject *self, PyObject *args)
+{
+    char *path, *checksum;
+    int type;
+    GError *tmp_err = NULL;
+    PyObject *py_checksum;
+
+    if (!PyArg_ParseTuple(args, "si:py_checksum_file", &path, &type))
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    checksum = cr_checksum_file(path, type, &tmp_err);
+    Py_END_ALLOW_THREADS
+    if (tmp_err) {
+        nice_exception(&tmp_err, NULL);
+        return NULL;
+    }
+
+    py_checksum = PyUnicodeOrNone_FromString(checksum);
+    g_free(checksum);
+    return py_checksum;
+}
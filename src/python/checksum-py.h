@@ -34,4 +34,10 @@ PyDoc_STRVAR(checksum_type__doc__,
 
 PyObject *py_checksum_type(PyObject *self, PyObject *args);
 
+PyDoc_STRVAR(checksum_file__doc__,
+"checksum_file(path, checksum_type) -> str\n\n"
+"Calculate checksum of the file");
+
+PyObject *py_checksum_file(PyObject *self, PyObject *args);
+
 #endif
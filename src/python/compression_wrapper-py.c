@@ -51,7 +51,9 @@ py_detect_compression(G_GNUC_UNUSED PyObject *self, PyObject *args)
     if (!PyArg_ParseTuple(args, "s:py_detect_compression", &filename))
         return NULL;
 
+    Py_BEGIN_ALLOW_THREADS
     type = cr_detect_compression(filename, &tmp_err);
+    Py_END_ALLOW_THREADS
     if (tmp_err) {
         nice_exception(&tmp_err, NULL);
         return NULL;
@@ -71,6 +73,49 @@ py_compression_type(G_GNUC_UNUSED PyObject *self, PyObject *args)
     return PyLong_FromLong((long) cr_compression_type(name));
 }
 
+PyObject *
+py_set_zstd_params(G_GNUC_UNUSED PyObject *self, PyObject *args)
+{
+    int level, workers;
+    PyObject *py_long_mode;
+
+    if (!PyArg_ParseTuple(args, "iOi:py_set_zstd_params",
+                          &level, &py_long_mode, &workers))
+        return NULL;
+
+    if (level < 0 || level > 22) {
+        PyErr_SetString(PyExc_ValueError, "Bad zstd compression level");
+        return NULL;
+    }
+
+    cr_compression_set_zstd_params(level,
+                                   PyObject_IsTrue(py_long_mode),
+                                   workers);
+    Py_RETURN_NONE;
+}
+
+PyObject *
+py_set_read_params(G_GNUC_UNUSED PyObject *self, PyObject *args)
+{
+    long long buffer_size;
+    int xz_threads;
+    PyObject *py_threaded;
+
+    if (!PyArg_ParseTuple(args, "LiO:py_set_read_params",
+                          &buffer_size, &xz_threads, &py_threaded))
+        return NULL;
+
+    if (buffer_size < 0 || xz_threads < 0) {
+        PyErr_SetString(PyExc_ValueError, "Negative value is not allowed");
+        return NULL;
+    }
+
+    cr_compression_set_read_params((gsize) buffer_size,
+                                   xz_threads,
+                                   PyObject_IsTrue(py_threaded));
+    Py_RETURN_NONE;
+}
+
 /*
  * CrFile object
  */
@@ -79,6 +124,7 @@ typedef struct {
     PyObject_HEAD
     CR_FILE *f;
     PyObject *py_stat;
+    int busy;   /*!< File is used by a call that released the GIL */
 } _CrFileObject;
 
 static PyObject * py_close(_CrFileObject *self, void *nothing);
@@ -93,6 +139,11 @@ check_CrFileStatus(const _CrFileObject *self)
             "Improper createrepo_c CrFile object (Already closed file?).");
         return -1;
     }
+    if (self->busy) {
+        PyErr_SetString(CrErr_Exception,
+            "CrFile object is being used by another thread");
+        return -1;
+    }
     return 0;
 }
 
@@ -107,6 +158,7 @@ crfile_new(PyTypeObject *type,
     if (self) {
         self->f = NULL;
         self->py_stat = NULL;
+        self->busy = 0;
     }
     return (PyObject *)self;
 }
@@ -156,7 +208,9 @@ crfile_init(_CrFileObject *self, PyObject *args, G_GNUC_UNUSED PyObject *kwds)
     }
 
     /* Init */
+    Py_BEGIN_ALLOW_THREADS
     self->f = cr_sopen(path, mode, comtype, stat, &err);
+    Py_END_ALLOW_THREADS
     if (err) {
         nice_exception(&err, "CrFile %s init failed: ", path);
         return -1;
@@ -214,7 +268,11 @@ py_write(_CrFileObject *self, PyObject *args)
     if (check_CrFileStatus(self))
         return NULL;
 
+    self->busy = 1;
+    Py_BEGIN_ALLOW_THREADS
     cr_write(self->f, str, len, &tmp_err);
+    Py_END_ALLOW_THREADS
+    self->busy = 0;
     if (tmp_err) {
         nice_exception(&tmp_err, NULL);
         return NULL;
@@ -232,9 +290,18 @@ py_close(_CrFileObject *self, G_GNUC_UNUSED void *nothing)
 {
     GError *tmp_err = NULL;
 
+    if (self->busy) {
+        PyErr_SetString(CrErr_Exception,
+            "CrFile object is being used by another thread");
+        return NULL;
+    }
+
     if (self->f) {
-        cr_close(self->f, &tmp_err);
+        CR_FILE *f = self->f;
         self->f = NULL;
+        Py_BEGIN_ALLOW_THREADS
+        cr_close(f, &tmp_err);
+        Py_END_ALLOW_THREADS
     }
 
     Py_XDECREF(self->py_stat);
@@ -44,5 +44,19 @@ PyDoc_STRVAR(compression_type__doc__,
 
 PyObject *py_compression_type(PyObject *self, PyObject *args);
 
+PyDoc_STRVAR(set_zstd_params__doc__,
+"set_zstd_params(level, long_mode, workers) -> None\n\n"
+"Set level (0 = default), long distance matching and number of worker\n"
+"threads of the Zstandard compression");
+
+PyObject *py_set_zstd_params(PyObject *self, PyObject *args);
+
+PyDoc_STRVAR(set_read_params__doc__,
+"set_read_params(buffer_size, xz_threads, threaded) -> None\n\n"
+"Set size of read buffers (0 = default), number of threads of the xz\n"
+"decoder (0 = number of CPUs) and decoding in a separate thread");
+
+PyObject *py_set_read_params(PyObject *self, PyObject *args);
+
 
 #endif
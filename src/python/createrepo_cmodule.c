@@ -37,6 +37,7 @@
 #include "updatecollection-py.h"
 #include "updatecollectionpackage-py.h"
 #include "updateinfo-py.h"
+#include "updateinfo_index-py.h"
 #include "updaterecord-py.h"
 #include "updatereference-py.h"
 #include "xml_dump-py.h"
@@ -72,10 +73,18 @@ static struct PyMethodDef createrepo_c_methods[] = {
         METH_VARARGS, xml_parse_repomd__doc__},
     {"xml_parse_updateinfo",    (PyCFunction)py_xml_parse_updateinfo,
         METH_VARARGS, xml_parse_updateinfo__doc__},
+    {"xml_parse_primary_batch", (PyCFunction)py_xml_parse_primary_batch,
+        METH_VARARGS, xml_parse_primary_batch__doc__},
+    {"xml_parse_filelists_batch",(PyCFunction)py_xml_parse_filelists_batch,
+        METH_VARARGS, xml_parse_filelists_batch__doc__},
+    {"xml_parse_other_batch",   (PyCFunction)py_xml_parse_other_batch,
+        METH_VARARGS, xml_parse_other_batch__doc__},
     {"checksum_name_str",       (PyCFunction)py_checksum_name_str,
         METH_VARARGS, checksum_name_str__doc__},
     {"checksum_type",           (PyCFunction)py_checksum_type,
         METH_VARARGS, checksum_type__doc__},
+    {"checksum_file",           (PyCFunction)py_checksum_file,
+        METH_VARARGS, checksum_file__doc__},
     {"compress_file_with_stat", (PyCFunction)py_compress_file_with_stat,
         METH_VARARGS, compress_file_with_stat__doc__},
     {"decompress_file_with_stat",(PyCFunction)py_decompress_file_with_stat,
@@ -86,6 +95,10 @@ static struct PyMethodDef createrepo_c_methods[] = {
         METH_VARARGS, detect_compression__doc__},
     {"compression_type",        (PyCFunction)py_compression_type,
         METH_VARARGS, compression_type__doc__},
+    {"set_zstd_params",         (PyCFunction)py_set_zstd_params,
+        METH_VARARGS, set_zstd_params__doc__},
+    {"set_read_params",         (PyCFunction)py_set_read_params,
+        METH_VARARGS, set_read_params__doc__},
     { NULL }
 };
 
@@ -198,6 +211,13 @@ init_createrepo_c(void)
     Py_INCREF(&UpdateInfo_Type);
     PyModule_AddObject(m, "UpdateInfo", (PyObject *)&UpdateInfo_Type);
 
+    /* _createrepo_c.UpdateInfoIndex */
+    if (PyType_Ready(&UpdateInfoIndex_Type) < 0)
+        return FAILURE;
+    Py_INCREF(&UpdateInfoIndex_Type);
+    PyModule_AddObject(m, "UpdateInfoIndex",
+                       (PyObject *)&UpdateInfoIndex_Type);
+
     /* _createrepo_c.UpdateRecord */
     if (PyType_Ready(&UpdateRecord_Type) < 0)
         return FAILURE;
@@ -256,6 +276,8 @@ init_createrepo_c(void)
     PyModule_AddIntConstant(m, "GZ_COMPRESSION", CR_CW_GZ_COMPRESSION);
     PyModule_AddIntConstant(m, "BZ2_COMPRESSION", CR_CW_BZ2_COMPRESSION);
     PyModule_AddIntConstant(m, "XZ_COMPRESSION", CR_CW_XZ_COMPRESSION);
+    PyModule_AddIntConstant(m, "ZSTD_COMPRESSION", CR_CW_ZSTD_COMPRESSION);
+    PyModule_AddIntConstant(m, "ZCK_COMPRESSION", CR_CW_ZCK_COMPRESSION);
 
     /* Load Metadata key values */
     PyModule_AddIntConstant(m, "HT_KEY_DEFAULT", CR_HT_KEY_DEFAULT);
@@ -34,6 +34,7 @@
 typedef struct {
     PyObject_HEAD
     cr_Metadata *md;
+    int busy;   /*!< Metadata are being loaded with the GIL released */
 } _MetadataObject;
 
 static int
@@ -45,6 +46,11 @@ check_MetadataStatus(const _MetadataObject *self)
         PyErr_SetString(PyExc_TypeError, "Improper createrepo_c Metadata object.");
         return -1;
     }
+    if (self->busy) {
+        PyErr_SetString(CrErr_Exception,
+            "Metadata object is being used by another thread");
+        return -1;
+    }
     return 0;
 }
 
@@ -56,8 +62,10 @@ metadata_new(PyTypeObject *type,
              G_GNUC_UNUSED PyObject *kwds)
 {
     _MetadataObject *self = (_MetadataObject *)type->tp_alloc(type, 0);
-    if (self)
+    if (self) {
         self->md = NULL;
+        self->busy = 0;
+    }
     return (PyObject *)self;
 }
 
@@ -84,6 +92,12 @@ metadata_init(_MetadataObject *self, PyObject *args, PyObject *kwds)
                           &key, &use_single_chunk, &PyList_Type, &py_pkglist))
         return -1;
 
+    if (self->busy) {
+        PyErr_SetString(CrErr_Exception,
+            "Metadata object is being used by another thread");
+        return -1;
+    }
+
     /* Free all previous resources when reinitialization */
     if (self->md) {
         cr_metadata_free(self->md);
@@ -148,7 +162,11 @@ load_xml(_MetadataObject *self, PyObject *args)
     if (check_MetadataStatus(self))
         return NULL;
 
+    self->busy = 1;
+    Py_BEGIN_ALLOW_THREADS
     cr_metadata_load_xml(self->md, MetadataLocation_FromPyObject(ml), &tmp_err);
+    Py_END_ALLOW_THREADS
+    self->busy = 0;
     if (tmp_err) {
         nice_exception(&tmp_err, NULL);
         return NULL;
@@ -173,7 +191,11 @@ locate_and_load_xml(_MetadataObject *self, PyObject *args)
     if (check_MetadataStatus(self))
         return NULL;
 
+    self->busy = 1;
+    Py_BEGIN_ALLOW_THREADS
     cr_metadata_locate_and_load_xml(self->md, path, &tmp_err);
+    Py_END_ALLOW_THREADS
+    self->busy = 0;
     if (tmp_err) {
         nice_exception(&tmp_err, NULL);
         return NULL;
@@ -87,10 +87,16 @@ metadatalocation_init(_MetadataLocationObject *self,
     /* Free all previous resources when reinitialization */
     if (self->ml) {
         cr_metadatalocation_free(self->ml);
+        self->ml = NULL;
     }
 
     /* Init */
-    self->ml = cr_locate_metadata(repopath, PyObject_IsTrue(py_ignore_db), &tmp_err);
+    int ignore_db = PyObject_IsTrue(py_ignore_db);
+    cr_MetadataLocation *ml;
+    Py_BEGIN_ALLOW_THREADS
+    ml = cr_locate_metadata(repopath, ignore_db, &tmp_err);
+    Py_END_ALLOW_THREADS
+    self->ml = ml;
     if (tmp_err) {
         nice_exception(&tmp_err, NULL);
         return -1;
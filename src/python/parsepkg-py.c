@@ -47,9 +47,11 @@ py_package_from_rpm(G_GNUC_UNUSED PyObject *self, PyObject *args)
         return NULL;
     }
 
+    Py_BEGIN_ALLOW_THREADS
     pkg = cr_package_from_rpm(filename, checksum_type, location_href,
                               location_base, changelog_limit, NULL,
                               flags, &tmp_err);
+    Py_END_ALLOW_THREADS
     if (tmp_err) {
         nice_exception(&tmp_err, "Cannot load %s: ", filename);
         return NULL;
@@ -77,8 +79,10 @@ py_xml_from_rpm(G_GNUC_UNUSED PyObject *self, PyObject *args)
         return NULL;
     }
 
+    Py_BEGIN_ALLOW_THREADS
     xml_res = cr_xml_from_rpm(filename, checksum_type, location_href,
                               location_base, changelog_limit, NULL, &tmp_err);
+    Py_END_ALLOW_THREADS
     if (tmp_err) {
         nice_exception(&tmp_err, "Cannot load %s: ", filename);
         return NULL;
@@ -161,7 +161,9 @@ fill(_RepomdRecordObject *self, PyObject *args)
     if (check_RepomdRecordStatus(self))
         return NULL;
 
+    Py_BEGIN_ALLOW_THREADS
     cr_repomd_record_fill(self->record, checksum_type, &err);
+    Py_END_ALLOW_THREADS
     if (err) {
         nice_exception(&err, NULL);
         return NULL;
@@ -194,11 +196,15 @@ compress_and_fill(_RepomdRecordObject *self, PyObject *args)
     if (check_RepomdRecordStatus(self))
         return NULL;
 
+    cr_RepomdRecord *compressed = RepomdRecord_FromPyObject(compressed_repomdrecord);
+
+    Py_BEGIN_ALLOW_THREADS
     cr_repomd_record_compress_and_fill(self->record,
-                                       RepomdRecord_FromPyObject(compressed_repomdrecord),
+                                       compressed,
                                        checksum_type,
                                        compression_type,
                                        &err);
+    Py_END_ALLOW_THREADS
     if (err) {
         nice_exception(&err, NULL);
         return NULL;
@@ -216,7 +222,9 @@ rename_file(_RepomdRecordObject *self, G_GNUC_UNUSED void *nothing)
 {
     GError *err = NULL;
 
+    Py_BEGIN_ALLOW_THREADS
     cr_repomd_record_rename_file(self->record, &err);
+    Py_END_ALLOW_THREADS
     if (err) {
         nice_exception(&err, NULL);
         return NULL;
@@ -378,12 +386,18 @@ static PyGetSetDef repomdrecord_getsetters[] = {
         "Checksum of the archive content", OFFSET(checksum_open)},
     {"checksum_open_type",  (getter)get_str, (setter)set_str,
         "Type of the archive content checksum", OFFSET(checksum_open_type)},
+    {"checksum_header",     (getter)get_str, (setter)set_str,
+        "Checksum of the zchunk header", OFFSET(checksum_header)},
+    {"checksum_header_type", (getter)get_str, (setter)set_str,
+        "Type of the zchunk header checksum", OFFSET(checksum_header_type)},
     {"timestamp",           (getter)get_num, (setter)set_num,
         "Mtime of the file", OFFSET(timestamp)},
     {"size",                (getter)get_num, (setter)set_num,
         "Size of the file", OFFSET(size)},
     {"size_open",           (getter)get_num, (setter)set_num,
         "Size of the archive content", OFFSET(size_open)},
+    {"size_header",         (getter)get_num, (setter)set_num,
+        "Size of the zchunk header", OFFSET(size_header)},
     {"db_ver",              (getter)get_int, (setter)set_int,
         "Database version (used only for sqlite databases like "
         "primary.sqlite etc.)", OFFSET(db_ver)},
@@ -29,6 +29,7 @@
 typedef struct {
     PyObject_HEAD
     cr_SqliteDb *db;
+    int busy;   /*!< Db is used by a call that released the GIL */
 } _SqliteObject;
 
 // Forward declaration
@@ -45,6 +46,11 @@ check_SqliteStatus(const _SqliteObject *self)
             "Improper createrepo_c Sqlite object (Already closed db?)");
         return -1;
     }
+    if (self->busy) {
+        PyErr_SetString(CrErr_Exception,
+            "Sqlite object is being used by another thread");
+        return -1;
+    }
     return 0;
 }
 
@@ -56,8 +62,10 @@ sqlite_new(PyTypeObject *type,
            G_GNUC_UNUSED PyObject *kwds)
 {
     _SqliteObject *self = (_SqliteObject *)type->tp_alloc(type, 0);
-    if (self)
+    if (self) {
         self->db = NULL;
+        self->busy = 0;
+    }
     return (PyObject *)self;
 }
 
@@ -93,7 +101,9 @@ sqlite_init(_SqliteObject *self, PyObject *args, G_GNUC_UNUSED PyObject *kwds)
     }
 
     /* Init */
+    Py_BEGIN_ALLOW_THREADS
     self->db = cr_db_open(path, db_type, &err);
+    Py_END_ALLOW_THREADS
     if (err) {
         nice_exception(&err, NULL);
         return -1;
@@ -140,7 +150,66 @@ add_pkg(_SqliteObject *self, PyObject *args)
     if (check_SqliteStatus(self))
         return NULL;
 
+    self->busy = 1;
+    Py_BEGIN_ALLOW_THREADS
     cr_db_add_pkg(self->db, Package_FromPyObject(py_pkg), &err);
+    Py_END_ALLOW_THREADS
+    self->busy = 0;
+    if (err) {
+        nice_exception(&err, NULL);
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(add_pkgs__doc__,
+"add_pkgs(packages) -> None\n\n"
+"Add a sequence of Packages to the database. The GIL is released\n"
+"only once for the whole sequence.");
+
+static PyObject *
+add_pkgs(_SqliteObject *self, PyObject *args)
+{
+    PyObject *py_pkgs, *seq;
+    Py_ssize_t len;
+    cr_Package **pkgs;
+    GError *err = NULL;
+
+    if (!PyArg_ParseTuple(args, "O:add_pkgs", &py_pkgs))
+        return NULL;
+
+    if (check_SqliteStatus(self))
+        return NULL;
+
+    seq = PySequence_Fast(py_pkgs, "Sequence of Packages expected");
+    if (!seq)
+        return NULL;
+
+    len = PySequence_Fast_GET_SIZE(seq);
+    pkgs = g_new(cr_Package *, len ? len : 1);
+    for (Py_ssize_t x = 0; x < len; x++) {
+        PyObject *py_pkg = PySequence_Fast_GET_ITEM(seq, x);
+        if (!PackageObject_Check(py_pkg)) {
+            PyErr_SetString(PyExc_TypeError, "Sequence of Packages expected");
+            g_free(pkgs);
+            Py_DECREF(seq);
+            return NULL;
+        }
+        pkgs[x] = Package_FromPyObject(py_pkg);
+    }
+
+    // The sequence holds references to all the packages meanwhile
+    self->busy = 1;
+    Py_BEGIN_ALLOW_THREADS
+    for (Py_ssize_t x = 0; x < len && !err; x++)
+        cr_db_add_pkg(self->db, pkgs[x], &err);
+    Py_END_ALLOW_THREADS
+    self->busy = 0;
+
+    g_free(pkgs);
+    Py_DECREF(seq);
+
     if (err) {
         nice_exception(&err, NULL);
         return NULL;
@@ -183,9 +252,18 @@ close_db(_SqliteObject *self, G_GNUC_UNUSED void *nothing)
 {
     GError *err = NULL;
 
+    if (self->busy) {
+        PyErr_SetString(CrErr_Exception,
+            "Sqlite object is being used by another thread");
+        return NULL;
+    }
+
     if (self->db) {
-        cr_db_close(self->db, &err);
+        cr_SqliteDb *db = self->db;
         self->db = NULL;
+        Py_BEGIN_ALLOW_THREADS
+        cr_db_close(db, &err);
+        Py_END_ALLOW_THREADS
         if (err) {
             nice_exception(&err, NULL);
             return NULL;
@@ -198,6 +276,8 @@ close_db(_SqliteObject *self, G_GNUC_UNUSED void *nothing)
 static struct PyMethodDef sqlite_methods[] = {
     {"add_pkg", (PyCFunction)add_pkg, METH_VARARGS,
         add_pkg__doc__},
+    {"add_pkgs", (PyCFunction)add_pkgs, METH_VARARGS,
+        add_pkgs__doc__},
     {"dbinfo_update", (PyCFunction)dbinfo_update, METH_VARARGS,
         dbinfo_update__doc__},
     {"close", (PyCFunction)close_db, METH_NOARGS,
@@ -0,0 +1,377 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <Python.h>
+#include <assert.h>
+#include <stddef.h>
+
+#include "updateinfo_index-py.h"
+#include "updateinfo-py.h"
+#include "updaterecord-py.h"
+#include "exception-py.h"
+#include "typeconversion.h"
+
+typedef struct {
+    PyObject_HEAD
+    cr_UpdateInfoIndex *index;
+} _UpdateInfoIndexObject;
+
+static int
+check_UpdateInfoIndexStatus(const _UpdateInfoIndexObject *self)
+{
+    assert(self != NULL);
+    assert(UpdateInfoIndexObject_Check(self));
+    if (self->index == NULL) {
+        PyErr_SetString(CrErr_Exception, "Improper createrepo_c UpdateInfoIndex object.");
+        return -1;
+    }
+    return 0;
+}
+
+/* Function on the type */
+
+static PyObject *
+updateinfoindex_new(PyTypeObject *type,
+                    G_GNUC_UNUSED PyObject *args,
+                    G_GNUC_UNUSED PyObject *kwds)
+{
+    _UpdateInfoIndexObject *self = (_UpdateInfoIndexObject *)type->tp_alloc(type, 0);
+    if (self) {
+        self->index = NULL;
+    }
+    return (PyObject *)self;
+}
+
+PyDoc_STRVAR(updateinfoindex_init__doc__,
+"UpdateInfoIndex object\n\n"
+"Index of packages referenced by updates");
+
+static int
+updateinfoindex_init(_UpdateInfoIndexObject *self,
+                     G_GNUC_UNUSED PyObject *args,
+                     G_GNUC_UNUSED PyObject *kwds)
+{
+    /* Free all previous resources when reinitialization */
+    if (self->index) {
+        cr_updateinfoindex_free(self->index);
+    }
+
+    /* Init */
+    self->index = cr_updateinfoindex_new();
+    if (self->index == NULL) {
+        PyErr_SetString(CrErr_Exception, "UpdateInfoIndex initialization failed");
+        return -1;
+    }
+
+    return 0;
+}
+
+static void
+updateinfoindex_dealloc(_UpdateInfoIndexObject *self)
+{
+    if (self->index)
+        cr_updateinfoindex_free(self->index);
+    Py_TYPE(self)->tp_free(self);
+}
+
+static PyObject *
+updateinfoindex_repr(G_GNUC_UNUSED _UpdateInfoIndexObject *self)
+{
+    return PyUnicode_FromFormat("<createrepo_c.UpdateInfoIndex object>");
+}
+
+static Py_ssize_t
+updateinfoindex_length(_UpdateInfoIndexObject *self)
+{
+    if (check_UpdateInfoIndexStatus(self))
+        return -1;
+    return (Py_ssize_t) cr_updateinfoindex_size(self->index);
+}
+
+/* Convert a list of strings owned by the index */
+static PyObject *
+list_of_strings(GSList *glist)
+{
+    PyObject *list;
+
+    if ((list = PyList_New(0)) == NULL) {
+        g_slist_free(glist);
+        return NULL;
+    }
+
+    for (GSList *elem = glist; elem; elem = g_slist_next(elem)) {
+        PyObject *str = PyUnicodeOrNone_FromString(elem->data);
+        if (!str)
+            continue;
+        PyList_Append(list, str);
+        Py_DECREF(str);
+    }
+
+    g_slist_free(glist);
+    return list;
+}
+
+/* UpdateInfoIndex methods */
+
+PyDoc_STRVAR(add_record__doc__,
+"add_record(updaterecord) -> None\n\n"
+"Add packages of the UpdateRecord");
+
+static PyObject *
+add_record(_UpdateInfoIndexObject *self, PyObject *args)
+{
+    PyObject *record;
+
+    if (!PyArg_ParseTuple(args, "O!:add_record", &UpdateRecord_Type, &record))
+        return NULL;
+    if (check_UpdateInfoIndexStatus(self))
+        return NULL;
+
+    cr_updateinfoindex_add_record(self->index,
+                                  UpdateRecord_FromPyObject(record));
+    Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(add_updateinfo__doc__,
+"add_updateinfo(updateinfo) -> None\n\n"
+"Add packages of all UpdateRecords of the UpdateInfo");
+
+static PyObject *
+add_updateinfo(_UpdateInfoIndexObject *self, PyObject *args)
+{
+    PyObject *updateinfo;
+
+    if (!PyArg_ParseTuple(args, "O!:add_updateinfo", &UpdateInfo_Type,
+                          &updateinfo))
+        return NULL;
+    if (check_UpdateInfoIndexStatus(self))
+        return NULL;
+
+    cr_updateinfoindex_add_updateinfo(self->index,
+                                      UpdateInfo_FromPyObject(updateinfo));
+    Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(parse__doc__,
+"parse(path) -> None\n\n"
+"Parse updateinfo.xml and add its records. Could be called from "
+"several threads at once");
+
+static PyObject *
+parse(_UpdateInfoIndexObject *self, PyObject *args)
+{
+    char *path;
+    GError *tmp_err = NULL;
+
+    if (!PyArg_ParseTuple(args, "s:parse", &path))
+        return NULL;
+    if (check_UpdateInfoIndexStatus(self))
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    cr_updateinfoindex_parse(self->index, path, &tmp_err);
+    Py_END_ALLOW_THREADS
+    if (tmp_err) {
+        nice_exception(&tmp_err, NULL);
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(updates_by_nevra__doc__,
+"updates_by_nevra(nevra) -> list\n\n"
+"Ids of updates referencing the package "
+"(nevra format: name-epoch:version-release.arch)");
+
+static PyObject *
+updates_by_nevra(_UpdateInfoIndexObject *self, PyObject *args)
+{
+    char *nevra;
+
+    if (!PyArg_ParseTuple(args, "s:updates_by_nevra", &nevra))
+        return NULL;
+    if (check_UpdateInfoIndexStatus(self))
+        return NULL;
+
+    return list_of_strings(cr_updateinfoindex_updates_by_nevra(self->index,
+                                                               nevra));
+}
+
+PyDoc_STRVAR(updates_by_name__doc__,
+"updates_by_name(name) -> list\n\n"
+"Ids of updates referencing any version of the package");
+
+static PyObject *
+updates_by_name(_UpdateInfoIndexObject *self, PyObject *args)
+{
+    char *name;
+
+    if (!PyArg_ParseTuple(args, "s:updates_by_name", &name))
+        return NULL;
+    if (check_UpdateInfoIndexStatus(self))
+        return NULL;
+
+    return list_of_strings(cr_updateinfoindex_updates_by_name(self->index,
+                                                              name));
+}
+
+PyDoc_STRVAR(packages__doc__,
+"packages(update_id) -> list\n\n"
+"NEVRAs of packages referenced by the update");
+
+static PyObject *
+packages(_UpdateInfoIndexObject *self, PyObject *args)
+{
+    char *update_id;
+
+    if (!PyArg_ParseTuple(args, "s:packages", &update_id))
+        return NULL;
+    if (check_UpdateInfoIndexStatus(self))
+        return NULL;
+
+    return list_of_strings(cr_updateinfoindex_packages(self->index,
+                                                       update_id));
+}
+
+PyDoc_STRVAR(write__doc__,
+"write(path, compressiontype) -> None\n\n"
+"Store the index into a file");
+
+static PyObject *
+updateinfoindex_write(_UpdateInfoIndexObject *self, PyObject *args)
+{
+    char *path;
+    int comtype;
+    GError *tmp_err = NULL;
+
+    if (!PyArg_ParseTuple(args, "si:write", &path, &comtype))
+        return NULL;
+    if (check_UpdateInfoIndexStatus(self))
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    cr_updateinfoindex_write(self->index, path, comtype, NULL, &tmp_err);
+    Py_END_ALLOW_THREADS
+    if (tmp_err) {
+        nice_exception(&tmp_err, NULL);
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(load__doc__,
+"load(path) -> None\n\n"
+"Replace content of the index by an index stored by write()");
+
+static PyObject *
+updateinfoindex_load(_UpdateInfoIndexObject *self, PyObject *args)
+{
+    char *path;
+    cr_UpdateInfoIndex *index;
+    GError *tmp_err = NULL;
+
+    if (!PyArg_ParseTuple(args, "s:load", &path))
+        return NULL;
+    if (check_UpdateInfoIndexStatus(self))
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    index = cr_updateinfoindex_load(path, &tmp_err);
+    Py_END_ALLOW_THREADS
+    if (tmp_err) {
+        nice_exception(&tmp_err, NULL);
+        return NULL;
+    }
+
+    cr_updateinfoindex_free(self->index);
+    self->index = index;
+    Py_RETURN_NONE;
+}
+
+static struct PyMethodDef updateinfoindex_methods[] = {
+    {"add_record", (PyCFunction)add_record, METH_VARARGS,
+        add_record__doc__},
+    {"add_updateinfo", (PyCFunction)add_updateinfo, METH_VARARGS,
+        add_updateinfo__doc__},
+    {"parse", (PyCFunction)parse, METH_VARARGS,
+        parse__doc__},
+    {"updates_by_nevra", (PyCFunction)updates_by_nevra, METH_VARARGS,
+        updates_by_nevra__doc__},
+    {"updates_by_name", (PyCFunction)updates_by_name, METH_VARARGS,
+        updates_by_name__doc__},
+    {"packages", (PyCFunction)packages, METH_VARARGS,
+        packages__doc__},
+    {"write", (PyCFunction)updateinfoindex_write, METH_VARARGS,
+        write__doc__},
+    {"load", (PyCFunction)updateinfoindex_load, METH_VARARGS,
+        load__doc__},
+    {NULL} /* sentinel */
+};
+
+static PySequenceMethods updateinfoindex_sequence = {
+    (lenfunc) updateinfoindex_length,   /* sq_length */
+};
+
+/* Object */
+
+
+PyTypeObject UpdateInfoIndex_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "createrepo_c.UpdateInfoIndex", /* tp_name */
+    sizeof(_UpdateInfoIndexObject), /* tp_basicsize */
+    0,                              /* tp_itemsize */
+    (destructor) updateinfoindex_dealloc, /* tp_dealloc */
+    0,                              /* tp_print */
+    0,                              /* tp_getattr */
+    0,                              /* tp_setattr */
+    0,                              /* tp_compare */
+    (reprfunc) updateinfoindex_repr,/* tp_repr */
+    0,                              /* tp_as_number */
+    &updateinfoindex_sequence,      /* tp_as_sequence */
+    0,                              /* tp_as_mapping */
+    0,                              /* tp_hash */
+    0,                              /* tp_call */
+    0,                              /* tp_str */
+    0,                              /* tp_getattro */
+    0,                              /* tp_setattro */
+    0,                              /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT|Py_TPFLAGS_BASETYPE, /* tp_flags */
+    updateinfoindex_init__doc__,    /* tp_doc */
+    0,                              /* tp_traverse */
+    0,                              /* tp_clear */
+    0,                              /* tp_richcompare */
+    0,                              /* tp_weaklistoffset */
+    0,                              /* tp_iter */
+    0,                              /* tp_iternext */
+    updateinfoindex_methods,        /* tp_methods */
+    0,                              /* tp_members */
+    0,                              /* tp_getset */
+    0,                              /* tp_base */
+    0,                              /* tp_dict */
+    0,                              /* tp_descr_get */
+    0,                              /* tp_descr_set */
+    0,                              /* tp_dictoffset */
+    (initproc) updateinfoindex_init,/* tp_init */
+    0,                              /* tp_alloc */
+    updateinfoindex_new,            /* tp_new */
+    0,                              /* tp_free */
+    0,                              /* tp_is_gc */
+};
@@ -23,6 +23,7 @@
 
 #include "xml_file-py.h"
 #include "package-py.h"
+#include "updaterecord-py.h"
 #include "exception-py.h"
 #include "contentstat-py.h"
 #include "typeconversion.h"
@@ -31,6 +32,7 @@ typedef struct {
     PyObject_HEAD
     cr_XmlFile *xmlfile;
     PyObject *py_stat;
+    int busy;   /*!< File is used by a call that released the GIL */
 } _XmlFileObject;
 
 static PyObject * xmlfile_close(_XmlFileObject *self, void *nothing);
@@ -45,6 +47,11 @@ check_XmlFileStatus(const _XmlFileObject *self)
             "Improper createrepo_c XmlFile object (Already closed file?).");
         return -1;
     }
+    if (self->busy) {
+        PyErr_SetString(CrErr_Exception,
+            "XmlFile object is being used by another thread");
+        return -1;
+    }
     return 0;
 }
 
@@ -59,6 +66,7 @@ xmlfile_new(PyTypeObject *type,
     if (self) {
         self->xmlfile = NULL;
         self->py_stat = NULL;
+        self->busy = 0;
     }
     return (PyObject *)self;
 }
@@ -116,7 +124,9 @@ xmlfile_init(_XmlFileObject *self, PyObject *args, G_GNUC_UNUSED PyObject *kwds)
     }
 
     /* Init */
+    Py_BEGIN_ALLOW_THREADS
     self->xmlfile = cr_xmlfile_sopen(path, type, comtype, stat, &err);
+    Py_END_ALLOW_THREADS
     if (err) {
         nice_exception(&err, NULL);
         return -1;
@@ -201,7 +211,98 @@ add_pkg(_XmlFileObject *self, PyObject *args)
     if (check_XmlFileStatus(self))
         return NULL;
 
+    self->busy = 1;
+    Py_BEGIN_ALLOW_THREADS
     cr_xmlfile_add_pkg(self->xmlfile, Package_FromPyObject(py_pkg), &err);
+    Py_END_ALLOW_THREADS
+    self->busy = 0;
+    if (err) {
+        nice_exception(&err, NULL);
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(add_pkgs__doc__,
+"add_pkgs(packages) -> None\n\n"
+"Add a sequence of Packages to the xml. The GIL is released\n"
+"only once for the whole sequence.");
+
+static PyObject *
+add_pkgs(_XmlFileObject *self, PyObject *args)
+{
+    PyObject *py_pkgs, *seq;
+    Py_ssize_t len;
+    cr_Package **pkgs;
+    GError *err = NULL;
+
+    if (!PyArg_ParseTuple(args, "O:add_pkgs", &py_pkgs))
+        return NULL;
+
+    if (check_XmlFileStatus(self))
+        return NULL;
+
+    seq = PySequence_Fast(py_pkgs, "Sequence of Packages expected");
+    if (!seq)
+        return NULL;
+
+    len = PySequence_Fast_GET_SIZE(seq);
+    pkgs = g_new(cr_Package *, len ? len : 1);
+    for (Py_ssize_t x = 0; x < len; x++) {
+        PyObject *py_pkg = PySequence_Fast_GET_ITEM(seq, x);
+        if (!PackageObject_Check(py_pkg)) {
+            PyErr_SetString(PyExc_TypeError, "Sequence of Packages expected");
+            g_free(pkgs);
+            Py_DECREF(seq);
+            return NULL;
+        }
+        pkgs[x] = Package_FromPyObject(py_pkg);
+    }
+
+    // The sequence holds references to all the packages meanwhile
+    self->busy = 1;
+    Py_BEGIN_ALLOW_THREADS
+    for (Py_ssize_t x = 0; x < len && !err; x++)
+        cr_xmlfile_add_pkg(self->xmlfile, pkgs[x], &err);
+    Py_END_ALLOW_THREADS
+    self->busy = 0;
+
+    g_free(pkgs);
+    Py_DECREF(seq);
+
+    if (err) {
+        nice_exception(&err, NULL);
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+PyDoc_STRVAR(add_updaterecord__doc__,
+"add_updaterecord(UpdateRecord) -> None\n\n"
+"Add UpdateRecord to the updateinfo xml");
+
+static PyObject *
+add_updaterecord(_XmlFileObject *self, PyObject *args)
+{
+    PyObject *py_rec;
+    GError *err = NULL;
+
+    if (!PyArg_ParseTuple(args, "O!:add_updaterecord",
+                          &UpdateRecord_Type, &py_rec))
+        return NULL;
+
+    if (check_XmlFileStatus(self))
+        return NULL;
+
+    self->busy = 1;
+    Py_BEGIN_ALLOW_THREADS
+    cr_xmlfile_add_updaterecord(self->xmlfile,
+                                UpdateRecord_FromPyObject(py_rec),
+                                &err);
+    Py_END_ALLOW_THREADS
+    self->busy = 0;
     if (err) {
         nice_exception(&err, NULL);
         return NULL;
@@ -226,7 +327,11 @@ add_chunk(_XmlFileObject *self, PyObject *args)
     if (check_XmlFileStatus(self))
         return NULL;
 
+    self->busy = 1;
+    Py_BEGIN_ALLOW_THREADS
     cr_xmlfile_add_chunk(self->xmlfile, chunk, &err);
+    Py_END_ALLOW_THREADS
+    self->busy = 0;
     if (err) {
         nice_exception(&err, NULL);
         return NULL;
@@ -244,9 +349,18 @@ xmlfile_close(_XmlFileObject *self, G_GNUC_UNUSED void *nothing)
 {
     GError *err = NULL;
 
+    if (self->busy) {
+        PyErr_SetString(CrErr_Exception,
+            "XmlFile object is being used by another thread");
+        return NULL;
+    }
+
     if (self->xmlfile) {
-        cr_xmlfile_close(self->xmlfile, &err);
+        cr_XmlFile *xmlfile = self->xmlfile;
         self->xmlfile = NULL;
+        Py_BEGIN_ALLOW_THREADS
+        cr_xmlfile_close(xmlfile, &err);
+        Py_END_ALLOW_THREADS
     }
 
     Py_XDECREF(self->py_stat);
@@ -265,6 +379,10 @@ static struct PyMethodDef xmlfile_methods[] = {
         set_num_of_pkgs__doc__},
     {"add_pkg", (PyCFunction)add_pkg, METH_VARARGS,
         add_pkg__doc__},
+    {"add_pkgs", (PyCFunction)add_pkgs, METH_VARARGS,
+        add_pkgs__doc__},
+    {"add_updaterecord", (PyCFunction)add_updaterecord, METH_VARARGS,
+        add_updaterecord__doc__},
     {"add_chunk", (PyCFunction)add_chunk, METH_VARARGS,
         add_chunk__doc__},
     {"close", (PyCFunction)xmlfile_close, METH_NOARGS,
@@ -30,11 +30,26 @@
 #include "updateinfo-py.h"
 #include "exception-py.h"
 
+/* The GIL is released while the C parser runs. Every callback takes
+ * the GIL back (CB_ACQUIRE_GIL) and releases it again before it returns
+ * to the parser (CB_RELEASE_GIL).
+ */
+#define CB_ACQUIRE_GIL(data)    PyEval_RestoreThread((data)->tstate)
+#define CB_RELEASE_GIL(data)    ((data)->tstate = PyEval_SaveThread())
+
+#define DEFAULT_BATCH_SIZE      1000
+
 typedef struct {
     PyObject *py_newpkgcb;
     PyObject *py_pkgcb;
     PyObject *py_warningcb;
     PyObject *py_pkg;       /*!< Current processed package */
+    PyObject *py_batchcb;   /*!< Callback for a list of packages */
+    GPtrArray *batch;       /*!< Parsed packages (cr_Package *) waiting
+                                 for the py_batchcb */
+    guint batch_size;       /*!< Max length of the batch */
+    PyThreadState *tstate;  /*!< Saved thread state while the GIL
+                                 is released */
 } CbData;
 
 static int
@@ -47,6 +62,9 @@ c_newpkgcb(cr_Package **pkg,
 {
     PyObject *arglist, *result;
     CbData *data = cbdata;
+    int ret = CR_CB_RET_OK;
+
+    CB_ACQUIRE_GIL(data);
 
     if (data->py_pkg) {
         // Decref ref count on previous processed package
@@ -61,14 +79,16 @@ c_newpkgcb(cr_Package **pkg,
     if (result == NULL) {
         // Exception raised
         PyErr_ToGError(err);
-        return CR_CB_RET_ERR;
+        ret = CR_CB_RET_ERR;
+        goto exit;
     }
 
     if (!PackageObject_Check(result) && result != Py_None) {
         PyErr_SetString(PyExc_TypeError,
             "Expected a cr_Package or None as a callback return value");
         Py_DECREF(result);
-        return CR_CB_RET_ERR;
+        ret = CR_CB_RET_ERR;
+        goto exit;
     }
 
     if (result == Py_None) {
@@ -80,7 +100,9 @@ c_newpkgcb(cr_Package **pkg,
         data->py_pkg = result; // Store reference to current package
     }
 
-    return CR_CB_RET_OK;
+exit:
+    CB_RELEASE_GIL(data);
+    return ret;
 }
 
 static int
@@ -90,6 +112,9 @@ c_pkgcb(cr_Package *pkg,
 {
     PyObject *arglist, *result, *py_pkg;
     CbData *data = cbdata;
+    int ret = CR_CB_RET_OK;
+
+    CB_ACQUIRE_GIL(data);
 
     if (data->py_pkg)
         py_pkg = data->py_pkg;
@@ -105,11 +130,13 @@ c_pkgcb(cr_Package *pkg,
     if (result == NULL) {
         // Exception raised
         PyErr_ToGError(err);
-        return CR_CB_RET_ERR;
+        ret = CR_CB_RET_ERR;
+    } else {
+        Py_DECREF(result);
     }
 
-    Py_DECREF(result);
-    return CR_CB_RET_OK;
+    CB_RELEASE_GIL(data);
+    return ret;
 }
 
 static int
@@ -120,6 +147,9 @@ c_warningcb(cr_XmlParserWarningType type,
 {
     PyObject *arglist, *result;
     CbData *data = cbdata;
+    int ret = CR_CB_RET_OK;
+
+    CB_ACQUIRE_GIL(data);
 
     arglist = Py_BuildValue("(is)", type, msg);
     result = PyObject_CallObject(data->py_warningcb, arglist);
@@ -128,11 +158,80 @@ c_warningcb(cr_XmlParserWarningType type,
     if (result == NULL) {
         // Exception raised
         PyErr_ToGError(err);
-        return CR_CB_RET_ERR;
+        ret = CR_CB_RET_ERR;
+    } else {
+        Py_DECREF(result);
+    }
+
+    CB_RELEASE_GIL(data);
+    return ret;
+}
+
+/** Pass the parsed packages to the Python batch callback as a list.
+ * Must be called without the GIL.
+ */
+static int
+flush_batch(CbData *data, GError **err)
+{
+    PyObject *list, *result;
+    int ret = CR_CB_RET_OK;
+    guint len = data->batch->len;
+
+    if (!len)
+        return CR_CB_RET_OK;
+
+    CB_ACQUIRE_GIL(data);
+
+    list = PyList_New(len);
+    for (guint x = 0; list && x < len; x++) {
+        cr_Package *pkg = g_ptr_array_index(data->batch, x);
+        PyObject *py_pkg = Object_FromPackage(pkg, 1);
+        if (!py_pkg) {
+            // Free the rest of packages, the list owns the previous ones
+            for (guint y = x; y < len; y++)
+                cr_package_free(g_ptr_array_index(data->batch, y));
+            Py_CLEAR(list);
+            break;
+        }
+        PyList_SET_ITEM(list, x, py_pkg);
+    }
+    g_ptr_array_set_size(data->batch, 0);
+
+    if (!list) {
+        PyErr_ToGError(err);
+        ret = CR_CB_RET_ERR;
+        goto exit;
+    }
+
+    result = PyObject_CallFunctionObjArgs(data->py_batchcb, list, NULL);
+    Py_DECREF(list);
+
+    if (result == NULL) {
+        // Exception raised
+        PyErr_ToGError(err);
+        ret = CR_CB_RET_ERR;
+    } else {
+        Py_DECREF(result);
     }
 
-    Py_DECREF(result);
-    return CR_CB_RET_OK;
+exit:
+    CB_RELEASE_GIL(data);
+    return ret;
+}
+
+static int
+c_batch_pkgcb(cr_Package *pkg,
+              void *cbdata,
+              GError **err)
+{
+    CbData *data = cbdata;
+
+    // No Python object is touched here - the GIL is not needed
+    g_ptr_array_add(data->batch, pkg);
+    if (data->batch->len < data->batch_size)
+        return CR_CB_RET_OK;
+
+    return flush_batch(data, err);
 }
 
 PyObject *
@@ -192,7 +291,11 @@ py_xml_parse_primary(G_GNUC_UNUSED PyObject *self, PyObject *args)
     cbdata.py_pkgcb     = py_pkgcb;
     cbdata.py_warningcb = py_warningcb;
     cbdata.py_pkg       = NULL;
+    cbdata.py_batchcb   = NULL;
+    cbdata.batch        = NULL;
+    cbdata.batch_size   = 0;
 
+    cbdata.tstate = PyEval_SaveThread();
     cr_xml_parse_primary(filename,
                          ptr_c_newpkgcb,
                          &cbdata,
@@ -202,6 +305,7 @@ py_xml_parse_primary(G_GNUC_UNUSED PyObject *self, PyObject *args)
                          &cbdata,
                          do_files,
                          &tmp_err);
+    PyEval_RestoreThread(cbdata.tstate);
 
     Py_XDECREF(py_newpkgcb);
     Py_XDECREF(py_pkgcb);
@@ -271,7 +375,11 @@ py_xml_parse_filelists(G_GNUC_UNUSED PyObject *self, PyObject *args)
     cbdata.py_pkgcb     = py_pkgcb;
     cbdata.py_warningcb = py_warningcb;
     cbdata.py_pkg       = NULL;
+    cbdata.py_batchcb   = NULL;
+    cbdata.batch        = NULL;
+    cbdata.batch_size   = 0;
 
+    cbdata.tstate = PyEval_SaveThread();
     cr_xml_parse_filelists(filename,
                            ptr_c_newpkgcb,
                            &cbdata,
@@ -280,6 +388,7 @@ py_xml_parse_filelists(G_GNUC_UNUSED PyObject *self, PyObject *args)
                            ptr_c_warningcb,
                            &cbdata,
                            &tmp_err);
+    PyEval_RestoreThread(cbdata.tstate);
 
     Py_XDECREF(py_newpkgcb);
     Py_XDECREF(py_pkgcb);
@@ -349,7 +458,11 @@ py_xml_parse_other(G_GNUC_UNUSED PyObject *self, PyObject *args)
     cbdata.py_pkgcb     = py_pkgcb;
     cbdata.py_warningcb = py_warningcb;
     cbdata.py_pkg       = NULL;
+    cbdata.py_batchcb   = NULL;
+    cbdata.batch        = NULL;
+    cbdata.batch_size   = 0;
 
+    cbdata.tstate = PyEval_SaveThread();
     cr_xml_parse_other(filename,
                        ptr_c_newpkgcb,
                        &cbdata,
@@ -358,6 +471,7 @@ py_xml_parse_other(G_GNUC_UNUSED PyObject *self, PyObject *args)
                        ptr_c_warningcb,
                        &cbdata,
                        &tmp_err);
+    PyEval_RestoreThread(cbdata.tstate);
 
     Py_XDECREF(py_newpkgcb);
     Py_XDECREF(py_pkgcb);
@@ -406,14 +520,19 @@ py_xml_parse_repomd(G_GNUC_UNUSED PyObject *self, PyObject *args)
     cbdata.py_pkgcb     = NULL;
     cbdata.py_warningcb = py_warningcb;
     cbdata.py_pkg       = NULL;
+    cbdata.py_batchcb   = NULL;
+    cbdata.batch        = NULL;
+    cbdata.batch_size   = 0;
 
     repomd = Repomd_FromPyObject(py_repomd);
 
+    cbdata.tstate = PyEval_SaveThread();
     cr_xml_parse_repomd(filename,
                        repomd,
                        ptr_c_warningcb,
                        &cbdata,
                        &tmp_err);
+    PyEval_RestoreThread(cbdata.tstate);
 
     Py_XDECREF(py_repomd);
     Py_XDECREF(py_warningcb);
@@ -460,14 +579,19 @@ py_xml_parse_updateinfo(G_GNUC_UNUSED PyObject *self, PyObject *args)
     cbdata.py_pkgcb     = NULL;
     cbdata.py_warningcb = py_warningcb;
     cbdata.py_pkg       = NULL;
+    cbdata.py_batchcb   = NULL;
+    cbdata.batch        = NULL;
+    cbdata.batch_size   = 0;
 
     updateinfo = UpdateInfo_FromPyObject(py_updateinfo);
 
+    cbdata.tstate = PyEval_SaveThread();
     cr_xml_parse_updateinfo(filename,
                             updateinfo,
                             ptr_c_warningcb,
                             &cbdata,
                             &tmp_err);
+    PyEval_RestoreThread(cbdata.tstate);
 
     Py_XDECREF(py_updateinfo);
     Py_XDECREF(py_warningcb);
@@ -479,3 +603,153 @@ py_xml_parse_updateinfo(G_GNUC_UNUSED PyObject *self, PyObject *args)
 
     Py_RETURN_NONE;
 }
+
+/** Parse primary, filelists or other xml and pass parsed packages
+ * to the py_batchcb in lists of (at most) batch_size packages.
+ * The GIL is held only while the Python objects are created and
+ * the callback runs.
+ */
+static PyObject *
+xml_parse_batch(cr_XmlFileType type,
+                const char *filename,
+                PyObject *py_batchcb,
+                int batch_size,
+                PyObject *py_warningcb,
+                int do_files)
+{
+    CbData cbdata;
+    GError *tmp_err = NULL;
+
+    if (!PyCallable_Check(py_batchcb)) {
+        PyErr_SetString(PyExc_TypeError, "batchcb must be callable");
+        return NULL;
+    }
+
+    if (!PyCallable_Check(py_warningcb) && py_warningcb != Py_None) {
+        PyErr_SetString(PyExc_TypeError, "warningcb must be callable or None");
+        return NULL;
+    }
+
+    if (batch_size <= 0)
+        batch_size = DEFAULT_BATCH_SIZE;
+
+    Py_XINCREF(py_batchcb);
+    Py_XINCREF(py_warningcb);
+
+    cr_XmlParserWarningCb ptr_c_warningcb = NULL;
+    if (py_warningcb != Py_None)
+        ptr_c_warningcb = c_warningcb;
+
+    cbdata.py_newpkgcb  = NULL;
+    cbdata.py_pkgcb     = NULL;
+    cbdata.py_warningcb = py_warningcb;
+    cbdata.py_pkg       = NULL;
+    cbdata.py_batchcb   = py_batchcb;
+    cbdata.batch        = g_ptr_array_sized_new(batch_size);
+    cbdata.batch_size   = (guint) batch_size;
+
+    cbdata.tstate = PyEval_SaveThread();
+
+    switch (type) {
+        case CR_XMLFILE_PRIMARY:
+            cr_xml_parse_primary(filename, NULL, NULL,
+                                 c_batch_pkgcb, &cbdata,
+                                 ptr_c_warningcb, &cbdata,
+                                 do_files, &tmp_err);
+            break;
+        case CR_XMLFILE_FILELISTS:
+            cr_xml_parse_filelists(filename, NULL, NULL,
+                                   c_batch_pkgcb, &cbdata,
+                                   ptr_c_warningcb, &cbdata,
+                                   &tmp_err);
+            break;
+        case CR_XMLFILE_OTHER:
+            cr_xml_parse_other(filename, NULL, NULL,
+                               c_batch_pkgcb, &cbdata,
+                               ptr_c_warningcb, &cbdata,
+                               &tmp_err);
+            break;
+        default:
+            assert(0);
+            break;
+    }
+
+    // The last incomplete batch
+    if (!tmp_err)
+        flush_batch(&cbdata, &tmp_err);
+
+    // Packages left after an error
+    for (guint x = 0; x < cbdata.batch->len; x++)
+        cr_package_free(g_ptr_array_index(cbdata.batch, x));
+    g_ptr_array_free(cbdata.batch, TRUE);
+
+    PyEval_RestoreThread(cbdata.tstate);
+
+    Py_XDECREF(py_batchcb);
+    Py_XDECREF(py_warningcb);
+
+    if (tmp_err) {
+        nice_exception(&tmp_err, NULL);
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+PyObject *
+py_xml_parse_primary_batch(G_GNUC_UNUSED PyObject *self, PyObject *args)
+{
+    char *filename;
+    int batch_size, do_files;
+    PyObject *py_batchcb, *py_warningcb;
+
+    if (!PyArg_ParseTuple(args, "sOiOi:py_xml_parse_primary_batch",
+                                         &filename,
+                                         &py_batchcb,
+                                         &batch_size,
+                                         &py_warningcb,
+                                         &do_files)) {
+        return NULL;
+    }
+
+    return xml_parse_batch(CR_XMLFILE_PRIMARY, filename, py_batchcb,
+                           batch_size, py_warningcb, do_files);
+}
+
+PyObject *
+py_xml_parse_filelists_batch(G_GNUC_UNUSED PyObject *self, PyObject *args)
+{
+    char *filename;
+    int batch_size;
+    PyObject *py_batchcb, *py_warningcb;
+
+    if (!PyArg_ParseTuple(args, "sOiO:py_xml_parse_filelists_batch",
+                                         &filename,
+                                         &py_batchcb,
+                                         &batch_size,
+                                         &py_warningcb)) {
+        return NULL;
+    }
+
+    return xml_parse_batch(CR_XMLFILE_FILELISTS, filename, py_batchcb,
+                           batch_size, py_warningcb, 0);
+}
+
+PyObject *
+py_xml_parse_other_batch(G_GNUC_UNUSED PyObject *self, PyObject *args)
+{
+    char *filename;
+    int batch_size;
+    PyObject *py_batchcb, *py_warningcb;
+
+    if (!PyArg_ParseTuple(args, "sOiO:py_xml_parse_other_batch",
+                                         &filename,
+                                         &py_batchcb,
+                                         &batch_size,
+                                         &py_warningcb)) {
+        return NULL;
+    }
+
+    return xml_parse_batch(CR_XMLFILE_OTHER, filename, py_batchcb,
+                           batch_size, py_warningcb, 0);
+}
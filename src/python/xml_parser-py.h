@@ -52,4 +52,22 @@ PyDoc_STRVAR(xml_parse_updateinfo__doc__,
 
 PyObject *py_xml_parse_updateinfo(PyObject *self, PyObject *args);
 
+PyDoc_STRVAR(xml_parse_primary_batch__doc__,
+"xml_parse_primary_batch(filename, batchcb, batch_size, warningcb, do_files) -> None\n\n"
+"Parse primary.xml, batchcb is called with lists of batch_size packages");
+
+PyObject *py_xml_parse_primary_batch(PyObject *self, PyObject *args);
+
+PyDoc_STRVAR(xml_parse_filelists_batch__doc__,
+"xml_parse_filelists_batch(filename, batchcb, batch_size, warningcb) -> None\n\n"
+"Parse filelists.xml, batchcb is called with lists of batch_size packages");
+
+PyObject *py_xml_parse_filelists_batch(PyObject *self, PyObject *args);
+
+PyDoc_STRVAR(xml_parse_other_batch__doc__,
+"xml_parse_other_batch(filename, batchcb, batch_size, warningcb) -> None\n\n"
+"Parse other.xml, batchcb is called with lists of batch_size packages");
+
+PyObject *py_xml_parse_other_batch(PyObject *self, PyObject *args);
+
 #endif
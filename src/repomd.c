@@ -29,6 +29,7 @@
 #include "error.h"
 #include "misc.h"
 #include "checksum.h"
+#include "profile.h"
 #include "repomd.h"
 #include "repomd_internal.h"
 #include "compression_wrapper.h"
@@ -56,6 +57,7 @@ cr_repomd_record_new(const char *type, const char *path)
     md->chunk = g_string_chunk_new(128);
     md->type  = cr_safe_string_chunk_insert(md->chunk, type);
     md->size_open = G_GINT64_CONSTANT(-1);
+    md->size_header = G_GINT64_CONSTANT(-1);
 
     if (path) {
         gchar *filename = cr_get_filename(path);
@@ -100,9 +102,14 @@ cr_repomd_record_copy(const cr_RepomdRecord *orig)
                                                 orig->checksum_open);
     rec->checksum_open_type = cr_safe_string_chunk_insert(rec->chunk,
                                                 orig->checksum_open_type);
+    rec->checksum_header    = cr_safe_string_chunk_insert(rec->chunk,
+                                                orig->checksum_header);
+    rec->checksum_header_type = cr_safe_string_chunk_insert(rec->chunk,
+                                                orig->checksum_header_type);
     rec->timestamp = orig->timestamp;
     rec->size      = orig->size;
     rec->size_open = orig->size_open;
+    rec->size_header = orig->size_header;
     rec->db_ver    = orig->db_ver;
 
     return rec;
@@ -222,8 +229,10 @@ cr_repomd_record_fill(cr_RepomdRecord *md,
 
     if (!md->checksum_type || !md->checksum) {
         gchar *chksum;
+        gint64 prof_start = cr_profile_start();
 
         chksum = cr_checksum_file(path, checksum_t, &tmp_err);
+        cr_profile_stop(CR_PROF_REPOMD_CHECKSUM, prof_start);
         if (!chksum) {
             int code = tmp_err->code;
             g_propagate_prefixed_error(err, tmp_err,
@@ -253,8 +262,10 @@ cr_repomd_record_fill(cr_RepomdRecord *md,
         {
             // File compressed by supported algorithm
             contentStat *open_stat = NULL;
+            gint64 prof_start = cr_profile_start();
 
             open_stat = cr_get_compressed_content_stat(path, checksum_t, &tmp_err);
+            cr_profile_stop(CR_PROF_REPOMD_OPEN_STAT, prof_start);
             if (tmp_err) {
                 int code = tmp_err->code;
                 g_propagate_prefixed_error(err, tmp_err,
@@ -282,6 +293,31 @@ cr_repomd_record_fill(cr_RepomdRecord *md,
     }
 
 
+    // Get checksum and size of zchunk header
+
+    if ((!md->checksum_header || md->size_header == G_GINT64_CONSTANT(-1))
+        && cr_detect_compression(path, NULL) == CR_CW_ZCK_COMPRESSION)
+    {
+        char *hchecksum = NULL;
+        cr_ChecksumType htype;
+        gint64 hsize;
+
+        cr_get_zchunk_header_info(path, &hchecksum, &htype, &hsize, &tmp_err);
+        if (tmp_err) {
+            int code = tmp_err->code;
+            g_propagate_prefixed_error(err, tmp_err,
+                    "Error while reading zchunk header of %s: ", path);
+            return code;
+        }
+
+        md->checksum_header = g_string_chunk_insert(md->chunk, hchecksum);
+        md->checksum_header_type = g_string_chunk_insert(md->chunk,
+                                            cr_checksum_name_str(htype));
+        md->size_header = hsize;
+        g_free(hchecksum);
+    }
+
+
     // Get timestamp and size of compressed file
 
     if (!md->timestamp || !md->size) {
@@ -332,6 +368,7 @@ cr_repomd_record_compress_and_fill(cr_RepomdRecord *record,
     struct stat gf_stat, cgf_stat;
     const char *checksum_str = cr_checksum_name_str(checksum_type);
     GError *tmp_err = NULL;
+    gint64 prof_start;
 
     assert(record);
     assert(crecord);
@@ -371,6 +408,7 @@ cr_repomd_record_compress_and_fill(cr_RepomdRecord *record,
 
     // Compress file + get size of non compressed file
 
+    prof_start = cr_profile_start();
     cw_plain = cr_open(path,
                        CR_CW_MODE_READ,
                        CR_CW_NO_COMPRESSION,
@@ -416,6 +454,7 @@ cr_repomd_record_compress_and_fill(cr_RepomdRecord *record,
                 "Error while closing %s: ", path);
         return ret;
     }
+    cr_profile_stop(CR_PROF_COMPRESS_FILE, prof_start);
 
     // Compute checksums
 
@@ -791,7 +830,19 @@ record_type_value(const char *type) {
         return 5;
     if (!g_strcmp0(type, "other_db"))
         return 6;
-    return 7;
+    if (!g_strcmp0(type, "primary_zck"))
+        return 7;
+    if (!g_strcmp0(type, "filelists_zck"))
+        return 8;
+    if (!g_strcmp0(type, "other_zck"))
+        return 9;
+    if (!g_strcmp0(type, "primary_zck_dict"))
+        return 10;
+    if (!g_strcmp0(type, "filelists_zck_dict"))
+        return 11;
+    if (!g_strcmp0(type, "other_zck_dict"))
+        return 12;
+    return 13;
 }
 
 static gint
@@ -83,6 +83,9 @@ typedef struct {
     gint64 timestamp;           /*!< mtime of the file */
     gint64 size;                /*!< size of file in bytes */
     gint64 size_open;           /*!< size of uncompressed file in bytes */
+    char *checksum_header;      /*!< checksum of zchunk header */
+    char *checksum_header_type; /*!< checksum type of zchunk header */
+    gint64 size_header;         /*!< size of zchunk header in bytes */
     int db_ver;                 /*!< version of database */
 
     GStringChunk *chunk;        /*!< String chunk */
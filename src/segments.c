@@ -0,0 +1,422 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "error.h"
+#include "segments.h"
+
+#define ERR_DOMAIN              CREATEREPO_C_ERROR
+#define SEGMENTS_VERSION        1
+
+typedef struct {
+    gint64      offset;     // Offset in the data file
+    gint64      size;       // Size of the compressed segment
+    gchar       *checksum;  // Checksum of the uncompressed content
+    GPtrArray   *pkgids;    // pkgIds of packages in the segment
+} cr_Segment;
+
+struct _cr_SegmentIndex {
+    GPtrArray           *segments;  // cr_Segment
+    GHashTable          *by_checksum; // checksum -> cr_Segment (weak)
+    cr_CompressionType  comtype;    // Compression of the loaded data file
+    FILE                *data;      // Opened data file of a loaded index
+};
+
+static void
+cr_segment_free(cr_Segment *segment)
+{
+    if (!segment)
+        return;
+    g_free(segment->checksum);
+    g_ptr_array_free(segment->pkgids, TRUE);
+    g_free(segment);
+}
+
+cr_SegmentIndex *
+cr_segmentindex_new(void)
+{
+    cr_SegmentIndex *index = g_new0(cr_SegmentIndex, 1);
+    index->segments = g_ptr_array_new_with_free_func(
+                                        (GDestroyNotify) cr_segment_free);
+    index->by_checksum = g_hash_table_new(g_str_hash, g_str_equal);
+    index->comtype = CR_CW_UNKNOWN_COMPRESSION;
+    return index;
+}
+
+void
+cr_segmentindex_append(cr_SegmentIndex *index,
+                       gint64 offset,
+                       gint64 size,
+                       const char *checksum,
+                       GPtrArray *pkgids)
+{
+    cr_Segment *segment;
+
+    assert(index);
+    assert(checksum);
+    assert(pkgids);
+
+    // Separators of the index format must not appear in pkgIds
+    for (guint x = 0; x < pkgids->len; x++)
+        g_strdelimit(g_ptr_array_index(pkgids, x), "\t\n,", '_');
+
+    segment = g_new0(cr_Segment, 1);
+    segment->offset     = offset;
+    segment->size       = size;
+    segment->checksum   = g_strdup(checksum);
+    segment->pkgids     = pkgids;
+    g_ptr_array_add(index->segments, segment);
+    g_hash_table_replace(index->by_checksum, segment->checksum, segment);
+}
+
+guint
+cr_segmentindex_len(cr_SegmentIndex *index)
+{
+    assert(index);
+    return index->segments->len;
+}
+
+cr_CompressionType
+cr_segmentindex_compression(cr_SegmentIndex *index)
+{
+    assert(index);
+    return index->comtype;
+}
+
+/** Parse a segment line of the index.
+ */
+static gboolean
+parse_segment(cr_SegmentIndex *index, const char *line)
+{
+    gchar **cols = g_strsplit(line, "\t", 4);
+    gchar **ids;
+    gchar *end;
+    gint64 offset, size;
+    GPtrArray *pkgids;
+
+    if (g_strv_length(cols) != 4 || !*cols[2]) {
+        g_strfreev(cols);
+        return FALSE;
+    }
+
+    offset = g_ascii_strtoll(cols[0], &end, 10);
+    if (*end || offset < 0) {
+        g_strfreev(cols);
+        return FALSE;
+    }
+    size = g_ascii_strtoll(cols[1], &end, 10);
+    if (*end || size <= 0) {
+        g_strfreev(cols);
+        return FALSE;
+    }
+
+    pkgids = g_ptr_array_new_with_free_func(g_free);
+    ids = g_strsplit(cols[3], ",", -1);
+    for (gchar **id = ids; *id; id++)
+        if (**id)
+            g_ptr_array_add(pkgids, g_strdup(*id));
+    g_strfreev(ids);
+
+    cr_segmentindex_append(index, offset, size, cols[2], pkgids);
+    g_strfreev(cols);
+    return TRUE;
+}
+
+cr_SegmentIndex *
+cr_segmentindex_load(const char *path, const char *dir, GError **err)
+{
+    gchar *content = NULL;
+    gchar **lines = NULL, **cols = NULL;
+    gchar *data_path = NULL;
+    gchar *end;
+    gint64 size, mtime;
+    struct stat st;
+    cr_SegmentIndex *index = NULL;
+    GError *tmp_err = NULL;
+
+    assert(path);
+    assert(dir);
+    assert(!err || *err == NULL);
+
+    if (!g_file_get_contents(path, &content, NULL, &tmp_err)) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "Cannot read %s: %s", path, tmp_err->message);
+        g_error_free(tmp_err);
+        return NULL;
+    }
+
+    lines = g_strsplit(content, "\n", -1);
+    g_free(content);
+
+    // Header
+    cols = lines[0] ? g_strsplit(lines[0], "\t", -1) : NULL;
+    if (!cols || g_strv_length(cols) != 3
+        || g_strcmp0(cols[0], "segments")
+        || atoi(cols[1]) != SEGMENTS_VERSION
+        || cr_checksum_type(cols[2]) != CR_SEGMENTS_CHECKSUM)
+    {
+        g_set_error(err, ERR_DOMAIN, CRE_ERROR,
+                    "%s: Unsupported segment index", path);
+        goto error;
+    }
+    g_strfreev(cols);
+
+    // Data file
+    cols = lines[1] ? g_strsplit(lines[1], "\t", -1) : NULL;
+    if (!cols || g_strv_length(cols) != 4
+        || g_strcmp0(cols[0], "file")
+        || !*cols[1] || strchr(cols[1], '/'))
+    {
+        g_set_error(err, ERR_DOMAIN, CRE_ERROR,
+                    "%s: Malformed segment index", path);
+        goto error;
+    }
+
+    size = g_ascii_strtoll(cols[2], &end, 10);
+    if (*end)
+        size = -1;
+    mtime = g_ascii_strtoll(cols[3], &end, 10);
+    if (*end)
+        mtime = -1;
+
+    data_path = g_build_filename(dir, cols[1], NULL);
+    if (stat(data_path, &st) == -1) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "Cannot stat %s: %s", data_path, g_strerror(errno));
+        goto error;
+    }
+
+    if ((gint64) st.st_size != size || (gint64) st.st_mtime != mtime) {
+        g_set_error(err, ERR_DOMAIN, CRE_STAT,
+                    "%s was modified after %s was written", data_path, path);
+        goto error;
+    }
+
+    index = cr_segmentindex_new();
+
+    for (gchar **line = lines + 2; *line; line++) {
+        if (!**line)
+            continue;
+        if (!parse_segment(index, *line)) {
+            g_set_error(err, ERR_DOMAIN, CRE_ERROR,
+                        "%s: Malformed segment record: %s", path, *line);
+            goto error;
+        }
+    }
+
+    index->comtype = cr_detect_compression(data_path, &tmp_err);
+    if (tmp_err) {
+        g_propagate_error(err, tmp_err);
+        goto error;
+    }
+
+    index->data = fopen(data_path, "rb");
+    if (!index->data) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "Cannot open %s: %s", data_path, g_strerror(errno));
+        goto error;
+    }
+
+    g_strfreev(cols);
+    g_strfreev(lines);
+    g_free(data_path);
+    return index;
+
+error:
+    cr_segmentindex_free(index);
+    g_strfreev(cols);
+    g_strfreev(lines);
+    g_free(data_path);
+    return NULL;
+}
+
+/** Read a segment from the data file.
+ */
+static guchar *
+read_segment(cr_SegmentIndex *index,
+             cr_Segment *segment,
+             gsize *len,
+             GError **err)
+{
+    guchar *buf;
+
+    if (fseeko(index->data, (off_t) segment->offset, SEEK_SET) == -1) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "fseeko(): %s", g_strerror(errno));
+        return NULL;
+    }
+
+    buf = g_malloc(segment->size);
+    if (fread(buf, 1, segment->size, index->data) != (size_t) segment->size) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "Cannot read segment at %"G_GINT64_FORMAT": %s",
+                    segment->offset,
+                    ferror(index->data) ? g_strerror(errno)
+                                        : "Unexpected end of file");
+        g_free(buf);
+        return NULL;
+    }
+
+    *len = segment->size;
+    return buf;
+}
+
+guchar *
+cr_segmentindex_get(cr_SegmentIndex *index,
+                    const char *checksum,
+                    GPtrArray *pkgids,
+                    gsize *len,
+                    GError **err)
+{
+    cr_Segment *segment;
+
+    assert(index);
+    assert(checksum);
+    assert(pkgids);
+    assert(len);
+    assert(!err || *err == NULL);
+
+    if (!index->data)
+        return NULL;
+
+    segment = g_hash_table_lookup(index->by_checksum, checksum);
+    if (!segment || segment->pkgids->len != pkgids->len)
+        return NULL;
+
+    for (guint x = 0; x < pkgids->len; x++)
+        if (g_strcmp0(g_ptr_array_index(segment->pkgids, x),
+                      g_ptr_array_index(pkgids, x)))
+            return NULL;
+
+    return read_segment(index, segment, len, err);
+}
+
+guchar *
+cr_segmentindex_read(cr_SegmentIndex *index,
+                     guint n,
+                     gsize *len,
+                     const char **checksum,
+                     GPtrArray **pkgids,
+                     GError **err)
+{
+    cr_Segment *segment;
+
+    assert(index);
+    assert(len);
+    assert(!err || *err == NULL);
+
+    if (!index->data) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "Index has no data file");
+        return NULL;
+    }
+
+    if (n >= index->segments->len) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "No segment %u in the index", n);
+        return NULL;
+    }
+
+    segment = g_ptr_array_index(index->segments, n);
+    if (checksum)
+        *checksum = segment->checksum;
+    if (pkgids)
+        *pkgids = segment->pkgids;
+
+    return read_segment(index, segment, len, err);
+}
+
+int
+cr_segmentindex_write(cr_SegmentIndex *index,
+                      const char *path,
+                      const char *data_path,
+                      GError **err)
+{
+    struct stat st;
+    gchar *basename;
+    GString *out;
+    GError *tmp_err = NULL;
+
+    assert(index);
+    assert(path);
+    assert(data_path);
+    assert(!err || *err == NULL);
+
+    if (stat(data_path, &st) == -1) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "Cannot stat %s: %s", data_path, g_strerror(errno));
+        return CRE_IO;
+    }
+
+    basename = g_path_get_basename(data_path);
+    out = g_string_new(NULL);
+    g_string_append_printf(out, "segments\t%d\t%s\n",
+                           SEGMENTS_VERSION,
+                           cr_checksum_name_str(CR_SEGMENTS_CHECKSUM));
+    g_string_append_printf(out, "file\t%s\t%"G_GINT64_FORMAT
+                           "\t%"G_GINT64_FORMAT"\n",
+                           basename, (gint64) st.st_size,
+                           (gint64) st.st_mtime);
+    g_free(basename);
+
+    for (guint x = 0; x < index->segments->len; x++) {
+        cr_Segment *segment = g_ptr_array_index(index->segments, x);
+
+        g_string_append_printf(out, "%"G_GINT64_FORMAT"\t%"G_GINT64_FORMAT
+                               "\t%s\t", segment->offset, segment->size,
+                               segment->checksum);
+        for (guint y = 0; y < segment->pkgids->len; y++) {
+            if (y)
+                g_string_append_c(out, ',');
+            g_string_append(out, g_ptr_array_index(segment->pkgids, y));
+        }
+        g_string_append_c(out, '\n');
+    }
+
+    if (!g_file_set_contents(path, out->str, out->len, &tmp_err)) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "Cannot write %s: %s", path, tmp_err->message);
+        g_error_free(tmp_err);
+        g_string_free(out, TRUE);
+        return CRE_IO;
+    }
+
+    g_string_free(out, TRUE);
+    return CRE_OK;
+}
+
+void
+cr_segmentindex_free(cr_SegmentIndex *index)
+{
+    if (!index)
+        return;
+    if (index->data)
+        fclose(index->data);
+    g_hash_table_destroy(index->by_checksum);
+    g_ptr_array_free(index->segments, TRUE);
+    g_free(index);
+}
@@ -0,0 +1,170 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#ifndef __C_CREATEREPOLIB_SEGMENTS_H__
+#define __C_CREATEREPOLIB_SEGMENTS_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <glib.h>
+#include "checksum.h"
+#include "compression_wrapper.h"
+
+/** \defgroup   segments    Index of independently compressed segments.
+ *
+ * A segmented metadata file is a sequence of independently compressed
+ * pieces (gzip members, xz blocks, zstd frames), each of them holding
+ * XML of a run of packages. The segment index stored next to the file
+ * records where every segment starts, how long it is, a checksum of its
+ * uncompressed content and the pkgIds of its packages. When the file is
+ * regenerated, segments with unchanged content are copied from the old
+ * file as they are instead of being compressed again.
+ *
+ * Index format (tab separated):
+ * \code
+ * segments\t1\tsha256
+ * file\t<basename>\t<size>\t<mtime>
+ * <offset>\t<size>\t<checksum>\t<pkgid>,<pkgid>,...
+ * \endcode
+ *
+ * \addtogroup segments
+ *  @{
+ */
+
+/** Suffix of a segment index file (appended to the name of the data file).
+ */
+#define CR_SEGMENTS_SUFFIX          ".segments"
+
+/** Default average number of packages in a segment.
+ */
+#define CR_SEGMENTS_DEFAULT_PKGS    128
+
+/** Checksum type used for the segment content.
+ */
+#define CR_SEGMENTS_CHECKSUM        CR_CHECKSUM_SHA256
+
+/** Segment index.
+ */
+typedef struct _cr_SegmentIndex cr_SegmentIndex;
+
+/** Create an empty segment index.
+ * @return          New cr_SegmentIndex
+ */
+cr_SegmentIndex *cr_segmentindex_new(void);
+
+/** Load a segment index. The data file it describes is looked up
+ * in the specified directory and opened, so segments could be read
+ * from it later. If the data file doesn't match the index (it was
+ * modified since the index was written) an error is returned.
+ * @param path      Path to the index file.
+ * @param dir       Directory with the data file.
+ * @param err       GError **
+ * @return          cr_SegmentIndex or NULL on error
+ */
+cr_SegmentIndex *cr_segmentindex_load(const char *path,
+                                      const char *dir,
+                                      GError **err);
+
+/** Add a segment to the index.
+ * @param index     cr_SegmentIndex
+ * @param offset    Offset of the segment in the data file.
+ * @param size      Size of the (compressed) segment.
+ * @param checksum  Checksum of the uncompressed content.
+ * @param pkgids    GPtrArray of pkgIds (malloced strings) of packages
+ *                  in the segment. The index takes the ownership.
+ */
+void cr_segmentindex_append(cr_SegmentIndex *index,
+                            gint64 offset,
+                            gint64 size,
+                            const char *checksum,
+                            GPtrArray *pkgids);
+
+/** Number of segments in the index.
+ * @param index     cr_SegmentIndex
+ * @return          Number of segments
+ */
+guint cr_segmentindex_len(cr_SegmentIndex *index);
+
+/** Compression of the data file of a loaded index.
+ * @param index     cr_SegmentIndex
+ * @return          cr_CompressionType (CR_CW_UNKNOWN_COMPRESSION for
+ *                  an index which wasn't loaded)
+ */
+cr_CompressionType cr_segmentindex_compression(cr_SegmentIndex *index);
+
+/** Read a segment with the matching content from the data file
+ * of a loaded index.
+ * @param index     cr_SegmentIndex
+ * @param checksum  Checksum of the uncompressed content.
+ * @param pkgids    GPtrArray of pkgIds of packages in the segment.
+ * @param len       Length of the returned segment.
+ * @param err       GError **
+ * @return          Malloced (compressed) segment or NULL if there is
+ *                  no such segment or on error (err is set)
+ */
+guchar *cr_segmentindex_get(cr_SegmentIndex *index,
+                            const char *checksum,
+                            GPtrArray *pkgids,
+                            gsize *len,
+                            GError **err);
+
+/** Read the n-th segment from the data file of a loaded index.
+ * @param index     cr_SegmentIndex
+ * @param n         Number of the segment (0 - cr_segmentindex_len() - 1)
+ * @param len       Length of the returned segment.
+ * @param checksum  If not NULL, set to the checksum of the uncompressed
+ *                  content (owned by the index).
+ * @param pkgids    If not NULL, set to pkgIds of packages in the segment
+ *                  (owned by the index).
+ * @param err       GError **
+ * @return          Malloced (compressed) segment or NULL on error
+ */
+guchar *cr_segmentindex_read(cr_SegmentIndex *index,
+                             guint n,
+                             gsize *len,
+                             const char **checksum,
+                             GPtrArray **pkgids,
+                             GError **err);
+
+/** Write the index for a data file.
+ * @param index     cr_SegmentIndex
+ * @param path      Path to the index file.
+ * @param data_path Path to the data file (must be already closed).
+ * @param err       GError **
+ * @return          cr_Error code
+ */
+int cr_segmentindex_write(cr_SegmentIndex *index,
+                          const char *path,
+                          const char *data_path,
+                          GError **err);
+
+/** Free the index (and close its data file).
+ * @param index     cr_SegmentIndex
+ */
+void cr_segmentindex_free(cr_SegmentIndex *index);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __C_CREATEREPOLIB_SEGMENTS_H__ */
@@ -0,0 +1,287 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "error.h"
+#include "segments.h"
+#include "shard.h"
+
+#define ERR_DOMAIN              CREATEREPO_C_ERROR
+#define SHARD_VERSION           1
+
+/** Parse a non-negative decimal number.
+ */
+static gboolean
+parse_number(const char *str, gint64 *value)
+{
+    gchar *end;
+
+    if (!str || !g_ascii_isdigit(*str))
+        return FALSE;
+    *value = g_ascii_strtoll(str, &end, 10);
+    return *end == '\0';
+}
+
+int
+cr_shard_parse(const char *str, guint *index, guint *count, GError **err)
+{
+    gchar **parts;
+    gint64 k, n;
+    gboolean ok;
+
+    assert(str);
+    assert(index);
+    assert(count);
+    assert(!err || *err == NULL);
+
+    parts = g_strsplit(str, "/", 3);
+    ok = g_strv_length(parts) == 2
+         && parse_number(parts[0], &k)
+         && parse_number(parts[1], &n)
+         && k >= 1 && k <= n && n <= G_MAXUINT;
+    g_strfreev(parts);
+
+    if (!ok) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "Bad shard \"%s\" (K/N with 1 <= K <= N expected)", str);
+        return CRE_BADARG;
+    }
+
+    *index = (guint) k;
+    *count = (guint) n;
+    return CRE_OK;
+}
+
+void
+cr_shard_range(gint64 total,
+               guint index,
+               guint count,
+               gint64 *first,
+               gint64 *packages)
+{
+    gint64 end;
+
+    assert(total >= 0);
+    assert(index >= 1 && index <= count);
+    assert(first);
+    assert(packages);
+
+    *first = total * (index - 1) / count;
+    end = total * index / count;
+    *packages = end - *first;
+}
+
+int
+cr_shard_write(const cr_ShardInfo *shard, const char *path, GError **err)
+{
+    gchar *content;
+    GError *tmp_err = NULL;
+
+    assert(shard);
+    assert(path);
+    assert(!err || *err == NULL);
+
+    content = g_strdup_printf("shard\t%d\n%u\t%u\t%"G_GINT64_FORMAT
+                              "\t%"G_GINT64_FORMAT"\t%"G_GINT64_FORMAT"\n",
+                              SHARD_VERSION, shard->index, shard->count,
+                              shard->first, shard->packages, shard->total);
+
+    if (!g_file_set_contents(path, content, -1, &tmp_err)) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "Cannot write %s: %s", path, tmp_err->message);
+        g_error_free(tmp_err);
+        g_free(content);
+        return CRE_IO;
+    }
+
+    g_free(content);
+    return CRE_OK;
+}
+
+int
+cr_shard_load(cr_ShardInfo *shard, const char *path, GError **err)
+{
+    gchar *content = NULL;
+    gchar **lines = NULL, **cols = NULL;
+    gint64 values[5];
+    gboolean ok;
+    GError *tmp_err = NULL;
+
+    assert(shard);
+    assert(path);
+    assert(!err || *err == NULL);
+
+    if (!g_file_get_contents(path, &content, NULL, &tmp_err)) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "Cannot read %s: %s", path, tmp_err->message);
+        g_error_free(tmp_err);
+        return CRE_IO;
+    }
+
+    lines = g_strsplit(content, "\n", 3);
+    g_free(content);
+
+    if (!lines[0] || !lines[1]
+        || strcmp(lines[0], "shard\t" G_STRINGIFY(SHARD_VERSION)))
+    {
+        g_set_error(err, ERR_DOMAIN, CRE_ERROR,
+                    "%s: Unsupported shard file", path);
+        g_strfreev(lines);
+        return CRE_ERROR;
+    }
+
+    cols = g_strsplit(lines[1], "\t", -1);
+    ok = g_strv_length(cols) == 5;
+    for (int x = 0; ok && x < 5; x++)
+        ok = parse_number(cols[x], &values[x]);
+    g_strfreev(cols);
+    g_strfreev(lines);
+
+    if (ok)
+        ok = values[0] >= 1 && values[0] <= values[1]
+             && values[1] <= G_MAXUINT
+             && values[2] + values[3] <= values[4];
+
+    if (!ok) {
+        g_set_error(err, ERR_DOMAIN, CRE_ERROR,
+                    "%s: Malformed shard file", path);
+        return CRE_ERROR;
+    }
+
+    shard->index    = (guint) values[0];
+    shard->count    = (guint) values[1];
+    shard->first    = values[2];
+    shard->packages = values[3];
+    shard->total    = values[4];
+    return CRE_OK;
+}
+
+int
+cr_shard_check(const cr_ShardInfo *shards, guint len, GError **err)
+{
+    gint64 next = 0;
+
+    assert(shards || !len);
+    assert(!err || *err == NULL);
+
+    for (guint x = 0; x < len; x++) {
+        const cr_ShardInfo *shard = &shards[x];
+
+        if (shard->index != x + 1 || shard->count != len) {
+            g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                        "Shard %u/%u found where shard %u/%u is expected",
+                        shard->index, shard->count, x + 1, len);
+            return CRE_BADARG;
+        }
+
+        if (shard->total != shards[0].total || shard->first != next) {
+            g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                        "Shard %u/%u doesn't continue the previous shard "
+                        "(different package lists?)", x + 1, len);
+            return CRE_BADARG;
+        }
+
+        next += shard->packages;
+    }
+
+    if (len && next != shards[0].total) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "Shards contain %"G_GINT64_FORMAT" of %"G_GINT64_FORMAT
+                    " packages", next, shards[0].total);
+        return CRE_BADARG;
+    }
+
+    return CRE_OK;
+}
+
+int
+cr_shard_append_xml(cr_XmlFile *f,
+                    const cr_ShardInfo *shard,
+                    const char *repodata,
+                    const char *name,
+                    GError **err)
+{
+    gchar *filename, *path;
+    cr_SegmentIndex *index;
+    gint64 packages = 0;
+    int ret = CRE_OK;
+    GError *tmp_err = NULL;
+
+    assert(f);
+    assert(shard);
+    assert(repodata);
+    assert(name);
+    assert(!err || *err == NULL);
+
+    filename = g_strconcat(name, CR_SEGMENTS_SUFFIX, NULL);
+    path = g_build_filename(repodata, filename, NULL);
+    g_free(filename);
+    index = cr_segmentindex_load(path, repodata, &tmp_err);
+    if (!index) {
+        ret = tmp_err->code;
+        g_propagate_error(err, tmp_err);
+        g_free(path);
+        return ret;
+    }
+
+    if (cr_segmentindex_compression(index) != f->f->type) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "%s: Segments use %s compression instead of %s", path,
+                    cr_compression_suffix(cr_segmentindex_compression(index)),
+                    cr_compression_suffix(f->f->type));
+        ret = CRE_BADARG;
+        goto cleanup;
+    }
+
+    for (guint x = 0; x < cr_segmentindex_len(index); x++) {
+        const char *checksum;
+        GPtrArray *pkgids;
+        guchar *segment;
+        gsize len;
+
+        segment = cr_segmentindex_read(index, x, &len, &checksum, &pkgids,
+                                       &tmp_err);
+        if (segment)
+            cr_xmlfile_add_segment(f, segment, len, checksum, pkgids,
+                                   &tmp_err);
+        g_free(segment);
+        if (tmp_err) {
+            ret = tmp_err->code;
+            g_propagate_prefixed_error(err, tmp_err, "%s: ", path);
+            goto cleanup;
+        }
+
+        packages += pkgids->len;
+    }
+
+    if (packages != shard->packages) {
+        g_set_error(err, ERR_DOMAIN, CRE_ERROR,
+                    "%s: %"G_GINT64_FORMAT" packages found, %"G_GINT64_FORMAT
+                    " expected", path, packages, shard->packages);
+        ret = CRE_ERROR;
+    }
+
+cleanup:
+    cr_segmentindex_free(index);
+    g_free(path);
+    return ret;
+}
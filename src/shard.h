@@ -0,0 +1,134 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#ifndef __C_CREATEREPOLIB_SHARD_H__
+#define __C_CREATEREPOLIB_SHARD_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <glib.h>
+#include "xml_file.h"
+
+/** \defgroup   shard       Repodata generated in shards.
+ *
+ * A big repository can be generated by several processes (on one or
+ * more hosts). Every shard processes a contiguous slice of the sorted
+ * package list and writes segmented primary, filelists and other
+ * (see segments) together with a shard file describing the slice.
+ * The assemble step copies compressed segments of all shards in order
+ * into the final files, so the packages are neither rendered nor
+ * compressed again.
+ *
+ * Shard file format (tab separated):
+ * \code
+ * shard\t1
+ * <index>\t<count>\t<first>\t<packages>\t<total>
+ * \endcode
+ *
+ * \addtogroup shard
+ *  @{
+ */
+
+/** Name of the shard file in the repodata directory.
+ */
+#define CR_SHARD_FILENAME       "shard"
+
+/** Slice of the package list processed by a shard.
+ */
+typedef struct {
+    guint   index;      /*!< Number of the shard (1 - count) */
+    guint   count;      /*!< Number of shards */
+    gint64  first;      /*!< Position of the first package of the shard
+                             in the whole sorted package list */
+    gint64  packages;   /*!< Number of packages in the shard */
+    gint64  total;      /*!< Number of packages in the whole list */
+} cr_ShardInfo;
+
+/** Parse a shard specification in the "K/N" format.
+ * @param str       String to parse
+ * @param index     Number of the shard (1 - count)
+ * @param count     Number of shards
+ * @param err       GError **
+ * @return          cr_Error code
+ */
+int cr_shard_parse(const char *str, guint *index, guint *count, GError **err);
+
+/** Compute the slice of a shard. Slices of all shards are contiguous,
+ * don't overlap and their sizes differ at most by one.
+ * @param total     Number of packages in the whole list
+ * @param index     Number of the shard (1 - count)
+ * @param count     Number of shards
+ * @param first     Position of the first package of the shard
+ * @param packages  Number of packages in the shard
+ */
+void cr_shard_range(gint64 total,
+                    guint index,
+                    guint count,
+                    gint64 *first,
+                    gint64 *packages);
+
+/** Write a shard file.
+ * @param shard     cr_ShardInfo
+ * @param path      Path to the file
+ * @param err       GError **
+ * @return          cr_Error code
+ */
+int cr_shard_write(const cr_ShardInfo *shard, const char *path, GError **err);
+
+/** Load a shard file.
+ * @param shard     cr_ShardInfo to be filled
+ * @param path      Path to the file
+ * @param err       GError **
+ * @return          cr_Error code
+ */
+int cr_shard_load(cr_ShardInfo *shard, const char *path, GError **err);
+
+/** Check that the shards are complete and in order, i.e. they are
+ * shards 1 - N of N and their slices cover the whole package list.
+ * @param shards    Array of cr_ShardInfo
+ * @param len       Number of shards in the array
+ * @param err       GError **
+ * @return          cr_Error code
+ */
+int cr_shard_check(const cr_ShardInfo *shards, guint len, GError **err);
+
+/** Append all segments of a shard's xml file to a segmented file
+ * (see cr_xmlfile_add_segment()).
+ * @param f         An opened segmented cr_XmlFile
+ * @param shard     cr_ShardInfo of the shard
+ * @param repodata  Repodata directory of the shard
+ * @param name      Name of the metadata ("primary", "filelists", ...)
+ * @param err       GError **
+ * @return          cr_Error code
+ */
+int cr_shard_append_xml(cr_XmlFile *f,
+                        const cr_ShardInfo *shard,
+                        const char *repodata,
+                        const char *name,
+                        GError **err);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __C_CREATEREPOLIB_SHARD_H__ */
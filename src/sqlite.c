@@ -31,6 +31,7 @@
 #include <errno.h>
 #include <libxml/encoding.h>
 #include "misc.h"
+#include "profile.h"
 #include "sqlite.h"
 #include "error.h"
 #include "xml_dump.h"
@@ -641,7 +642,12 @@ force_null(const char *str)
         return str;
 }
 
-static void
+/** Insert a package record.
+ * The key is returned instead of being stored into the package, as
+ * the same package can be inserted into other dbs at the same time.
+ * @return          pkgKey of the new record (0 on error)
+ */
+static gint64
 db_package_write (sqlite3 *db,
                   sqlite3_stmt *handle,
                   cr_Package *p,
@@ -680,15 +686,15 @@ db_package_write (sqlite3 *db,
     rc = sqlite3_step (handle);
     sqlite3_reset (handle);
 
-    if (rc == SQLITE_DONE) {
-        p->pkgKey = sqlite3_last_insert_rowid (db);
-    } else {
-        g_critical ("Error adding package to db: %s",
-                    sqlite3_errmsg(db));
-        g_set_error(err, ERR_DOMAIN, CRE_DB,
-                    "Error adding package to db: %s",
-                    sqlite3_errmsg(db));
-    }
+    if (rc == SQLITE_DONE)
+        return sqlite3_last_insert_rowid (db);
+
+    g_critical ("Error adding package to db: %s",
+                sqlite3_errmsg(db));
+    g_set_error(err, ERR_DOMAIN, CRE_DB,
+                "Error adding package to db: %s",
+                sqlite3_errmsg(db));
+    return 0;
 }
 
 
@@ -1044,7 +1050,10 @@ db_package_ids_prepare(sqlite3 *db, GError **err)
 }
 
 
-static void
+/** Insert a package id record (see db_package_write()).
+ * @return          pkgKey of the new record (0 on error)
+ */
+static gint64
 db_package_ids_write(sqlite3 *db,
                      sqlite3_stmt *handle,
                      cr_Package *pkg,
@@ -1058,15 +1067,15 @@ db_package_ids_write(sqlite3 *db,
     rc = sqlite3_step (handle);
     sqlite3_reset (handle);
 
-    if (rc == SQLITE_DONE) {
-        pkg->pkgKey = sqlite3_last_insert_rowid (db);
-    } else {
-        g_critical("Error adding package to db: %s",
-                   sqlite3_errmsg(db));
-        g_set_error(err, ERR_DOMAIN, CRE_DB,
-                    "Error adding package to db: %s",
-                    sqlite3_errmsg(db));
-    }
+    if (rc == SQLITE_DONE)
+        return sqlite3_last_insert_rowid (db);
+
+    g_critical("Error adding package to db: %s",
+               sqlite3_errmsg(db));
+    g_set_error(err, ERR_DOMAIN, CRE_DB,
+                "Error adding package to db: %s",
+                sqlite3_errmsg(db));
+    return 0;
 }
 
 /*
@@ -1201,10 +1210,11 @@ cr_db_add_primary_pkg(cr_DbPrimaryStatements stmts,
 {
     GError *tmp_err = NULL;
     GSList *iter;
+    gint64 pkgKey;
 
     assert(!err || *err == NULL);
 
-    db_package_write(stmts->db, stmts->pkg_handle, pkg, &tmp_err);
+    pkgKey = db_package_write(stmts->db, stmts->pkg_handle, pkg, &tmp_err);
     if (tmp_err) {
         g_propagate_error(err, tmp_err);
         return;
@@ -1213,7 +1223,7 @@ cr_db_add_primary_pkg(cr_DbPrimaryStatements stmts,
     for (iter = pkg->provides; iter; iter = iter->next) {
         db_dependency_write(stmts->db,
                             stmts->provides_handle,
-                            pkg->pkgKey,
+                            pkgKey,
                             (cr_Dependency *) iter->data,
                             FALSE,
                             &tmp_err);
@@ -1226,7 +1236,7 @@ cr_db_add_primary_pkg(cr_DbPrimaryStatements stmts,
     for (iter = pkg->conflicts; iter; iter = iter->next) {
         db_dependency_write(stmts->db,
                             stmts->conflicts_handle,
-                            pkg->pkgKey,
+                            pkgKey,
                             (cr_Dependency *) iter->data,
                             FALSE,
                             &tmp_err);
@@ -1239,7 +1249,7 @@ cr_db_add_primary_pkg(cr_DbPrimaryStatements stmts,
     for (iter = pkg->obsoletes; iter; iter = iter->next) {
         db_dependency_write(stmts->db,
                             stmts->obsoletes_handle,
-                            pkg->pkgKey,
+                            pkgKey,
                             (cr_Dependency *) iter->data,
                             FALSE,
                             &tmp_err);
@@ -1252,7 +1262,7 @@ cr_db_add_primary_pkg(cr_DbPrimaryStatements stmts,
     for (iter = pkg->requires; iter; iter = iter->next) {
         db_dependency_write(stmts->db,
                             stmts->requires_handle,
-                            pkg->pkgKey,
+                            pkgKey,
                             (cr_Dependency *) iter->data,
                             TRUE,
                             &tmp_err);
@@ -1265,7 +1275,7 @@ cr_db_add_primary_pkg(cr_DbPrimaryStatements stmts,
     for (iter = pkg->suggests; iter; iter = iter->next) {
         db_dependency_write(stmts->db,
                             stmts->suggests_handle,
-                            pkg->pkgKey,
+                            pkgKey,
                             (cr_Dependency *) iter->data,
                             TRUE,
                             &tmp_err);
@@ -1278,7 +1288,7 @@ cr_db_add_primary_pkg(cr_DbPrimaryStatements stmts,
     for (iter = pkg->enhances; iter; iter = iter->next) {
         db_dependency_write(stmts->db,
                             stmts->enhances_handle,
-                            pkg->pkgKey,
+                            pkgKey,
                             (cr_Dependency *) iter->data,
                             TRUE,
                             &tmp_err);
@@ -1291,7 +1301,7 @@ cr_db_add_primary_pkg(cr_DbPrimaryStatements stmts,
     for (iter = pkg->recommends; iter; iter = iter->next) {
         db_dependency_write(stmts->db,
                             stmts->recommends_handle,
-                            pkg->pkgKey,
+                            pkgKey,
                             (cr_Dependency *) iter->data,
                             TRUE,
                             &tmp_err);
@@ -1304,7 +1314,7 @@ cr_db_add_primary_pkg(cr_DbPrimaryStatements stmts,
     for (iter = pkg->supplements; iter; iter = iter->next) {
         db_dependency_write(stmts->db,
                             stmts->supplements_handle,
-                            pkg->pkgKey,
+                            pkgKey,
                             (cr_Dependency *) iter->data,
                             TRUE,
                             &tmp_err);
@@ -1315,7 +1325,7 @@ cr_db_add_primary_pkg(cr_DbPrimaryStatements stmts,
     }
 
     for (iter = pkg->files; iter; iter = iter->next) {
-        db_file_write(stmts->db, stmts->files_handle, pkg->pkgKey,
+        db_file_write(stmts->db, stmts->files_handle, pkgKey,
                       (cr_PackageFile *) iter->data, &tmp_err);
         if (tmp_err) {
             g_propagate_error(err, tmp_err);
@@ -1380,11 +1390,13 @@ cr_db_add_filelists_pkg(cr_DbFilelistsStatements stmts,
                         GError **err)
 {
     GError *tmp_err = NULL;
+    gint64 pkgKey;
 
     assert(!err || *err == NULL);
 
     // Add record into the package table
-    db_package_ids_write(stmts->db, stmts->package_id_handle, pkg, &tmp_err);
+    pkgKey = db_package_ids_write(stmts->db, stmts->package_id_handle, pkg,
+                                  &tmp_err);
     if (tmp_err) {
         g_propagate_error(err, tmp_err);
         return;
@@ -1401,7 +1413,7 @@ cr_db_add_filelists_pkg(cr_DbFilelistsStatements stmts,
     hash = package_files_to_hash(pkg->files);
     g_hash_table_iter_init(&iter, hash);
     while (g_hash_table_iter_next (&iter, &key, &value)) {
-        cr_db_write_file(stmts->db, stmts->filelists_handle, pkg->pkgKey, key, value, &tmp_err);
+        cr_db_write_file(stmts->db, stmts->filelists_handle, pkgKey, key, value, &tmp_err);
         if (tmp_err) {
             g_propagate_error(err, tmp_err);
             break;
@@ -1467,6 +1479,7 @@ cr_db_add_other_pkg(cr_DbOtherStatements stmts, cr_Package *pkg, GError **err)
     int rc;
     GSList *iter;
     cr_ChangelogEntry *entry;
+    gint64 pkgKey;
     GError *tmp_err = NULL;
 
     assert(!err || *err == NULL);
@@ -1474,7 +1487,8 @@ cr_db_add_other_pkg(cr_DbOtherStatements stmts, cr_Package *pkg, GError **err)
     sqlite3_stmt *handle = stmts->changelog_handle;
 
     // Add package record into the packages table
-    db_package_ids_write(stmts->db, stmts->package_id_handle, pkg, &tmp_err);
+    pkgKey = db_package_ids_write(stmts->db, stmts->package_id_handle, pkg,
+                                  &tmp_err);
     if (tmp_err) {
         g_propagate_error(err, tmp_err);
         return;
@@ -1484,7 +1498,7 @@ cr_db_add_other_pkg(cr_DbOtherStatements stmts, cr_Package *pkg, GError **err)
     for (iter = pkg->changelogs; iter; iter = iter->next) {
         entry = (cr_ChangelogEntry *) iter->data;
 
-        sqlite3_bind_int  (handle, 1, pkg->pkgKey);
+        sqlite3_bind_int  (handle, 1, pkgKey);
         cr_sqlite3_bind_text (handle, 2, entry->author, -1, SQLITE_STATIC);
         sqlite3_bind_int  (handle, 3, entry->date);
         cr_sqlite3_bind_text (handle, 4, entry->changelog, -1, SQLITE_STATIC);
@@ -1557,15 +1571,15 @@ cr_db_open(const char *path, cr_DatabaseType db_type, GError **err)
         return NULL;
     }
 
-    db_create_dbinfo_table(db, &tmp_err);
-    if (tmp_err) {
-        g_propagate_error(err, tmp_err);
-        sqlite3_close(db);
-        return NULL;
-    }
-
     if (!exists) {
         // Do not recreate tables, indexes and triggers if db has existed.
+        db_create_dbinfo_table(db, &tmp_err);
+        if (tmp_err) {
+            g_propagate_error(err, tmp_err);
+            sqlite3_close(db);
+            return NULL;
+        }
+
         switch (db_type) {
             case CR_DB_PRIMARY:
                 db_create_primary_tables(db, &tmp_err);
@@ -1639,10 +1653,207 @@ cr_db_open(const char *path, cr_DatabaseType db_type, GError **err)
 }
 
 
+/** Build INSERT ... SELECT statement copying a table of the attached
+ * "shard" database into the main one with shifted pkgKeys.
+ */
+static gchar *
+db_append_table_sql(sqlite3 *db, const char *table, gint64 offset,
+                    GError **err)
+{
+    int rc;
+    char *sql;
+    sqlite3_stmt *handle = NULL;
+    GString *columns = g_string_new(NULL);
+    GString *values = g_string_new(NULL);
+    gchar *result = NULL;
+
+    sql = sqlite3_mprintf("PRAGMA shard.table_info(\"%w\")", table);
+    rc = sqlite3_prepare_v2(db, sql, -1, &handle, NULL);
+    sqlite3_free(sql);
+    if (rc != SQLITE_OK) {
+        g_set_error(err, ERR_DOMAIN, CRE_DB,
+                    "Cannot get columns of %s: %s", table, sqlite3_errmsg(db));
+        goto cleanup;
+    }
+
+    while ((rc = sqlite3_step(handle)) == SQLITE_ROW) {
+        const char *column = (const char *) sqlite3_column_text(handle, 1);
+        char *quoted = sqlite3_mprintf("\"%w\"", column);
+
+        if (columns->len) {
+            g_string_append(columns, ", ");
+            g_string_append(values, ", ");
+        }
+        g_string_append(columns, quoted);
+        if (!g_strcmp0(column, "pkgKey"))
+            g_string_append_printf(values, "%s + %"G_GINT64_FORMAT,
+                                   quoted, offset);
+        else
+            g_string_append(values, quoted);
+        sqlite3_free(quoted);
+    }
+
+    if (rc != SQLITE_DONE || !columns->len) {
+        g_set_error(err, ERR_DOMAIN, CRE_DB,
+                    "Cannot get columns of %s: %s", table, sqlite3_errmsg(db));
+        goto cleanup;
+    }
+
+    sql = sqlite3_mprintf("INSERT INTO main.\"%w\" (%s) "
+                          "SELECT %s FROM shard.\"%w\" ORDER BY rowid",
+                          table, columns->str, values->str, table);
+    result = g_strdup(sql);
+    sqlite3_free(sql);
+
+cleanup:
+    sqlite3_finalize(handle);
+    g_string_free(columns, TRUE);
+    g_string_free(values, TRUE);
+    return result;
+}
+
+int
+cr_db_append(cr_SqliteDb *sqlitedb, const char *path, GError **err)
+{
+    int rc;
+    int ret = CRE_OK;
+    char *sql;
+    sqlite3 *db;
+    sqlite3_stmt *handle = NULL;
+    gint64 offset = 0;
+    GError *tmp_err = NULL;
+
+    assert(sqlitedb);
+    assert(path);
+    assert(!err || *err == NULL);
+
+    db = sqlitedb->db;
+
+    // Databases cannot be attached inside of a transaction
+    sqlite3_exec(db, "COMMIT", NULL, NULL, NULL);
+
+    sql = sqlite3_mprintf("ATTACH DATABASE %Q AS shard", path);
+    rc = sqlite3_exec(db, sql, NULL, NULL, NULL);
+    sqlite3_free(sql);
+    if (rc != SQLITE_OK) {
+        g_set_error(err, ERR_DOMAIN, CRE_DB,
+                    "Cannot attach %s: %s", path, sqlite3_errmsg(db));
+        sqlite3_exec(db, "BEGIN", NULL, NULL, NULL);
+        return CRE_DB;
+    }
+
+    // A failed append must not leave a part of the shard behind
+    sqlite3_exec(db, "SAVEPOINT append", NULL, NULL, NULL);
+
+    // Appended packages get keys behind the present ones
+    rc = sqlite3_prepare_v2(db,
+                            "SELECT COALESCE(MAX(pkgKey), 0) FROM main.packages",
+                            -1, &handle, NULL);
+    if (rc == SQLITE_OK && sqlite3_step(handle) == SQLITE_ROW) {
+        offset = sqlite3_column_int64(handle, 0);
+    } else {
+        g_set_error(err, ERR_DOMAIN, CRE_DB,
+                    "Cannot get the last package key: %s", sqlite3_errmsg(db));
+        ret = CRE_DB;
+    }
+    sqlite3_finalize(handle);
+    handle = NULL;
+
+    // Copy all tables except db_info
+    if (ret == CRE_OK)
+        rc = sqlite3_prepare_v2(db,
+                                "SELECT name FROM shard.sqlite_master "
+                                "WHERE type = 'table' AND name != 'db_info'",
+                                -1, &handle, NULL);
+    if (ret == CRE_OK && rc != SQLITE_OK) {
+        g_set_error(err, ERR_DOMAIN, CRE_DB,
+                    "Cannot list tables of %s: %s", path, sqlite3_errmsg(db));
+        ret = CRE_DB;
+    }
+
+    while (ret == CRE_OK && (rc = sqlite3_step(handle)) == SQLITE_ROW) {
+        const char *table = (const char *) sqlite3_column_text(handle, 0);
+        gchar *insert = db_append_table_sql(db, table, offset, &tmp_err);
+
+        if (!insert) {
+            ret = tmp_err->code;
+            g_propagate_error(err, tmp_err);
+            break;
+        }
+
+        rc = sqlite3_exec(db, insert, NULL, NULL, NULL);
+        g_free(insert);
+        if (rc != SQLITE_OK) {
+            g_set_error(err, ERR_DOMAIN, CRE_DB,
+                        "Cannot append table %s of %s: %s",
+                        table, path, sqlite3_errmsg(db));
+            ret = CRE_DB;
+        }
+    }
+
+    if (ret == CRE_OK && rc != SQLITE_DONE) {
+        g_set_error(err, ERR_DOMAIN, CRE_DB,
+                    "Cannot list tables of %s: %s", path, sqlite3_errmsg(db));
+        ret = CRE_DB;
+    }
+
+    sqlite3_finalize(handle);
+
+    if (ret != CRE_OK)
+        sqlite3_exec(db, "ROLLBACK TO append", NULL, NULL, NULL);
+
+    // Detaching isn't possible inside of a transaction either
+    if (sqlite3_exec(db, "RELEASE append", NULL, NULL, NULL) != SQLITE_OK
+        && ret == CRE_OK)
+    {
+        g_set_error(err, ERR_DOMAIN, CRE_DB,
+                    "Cannot commit the append of %s: %s",
+                    path, sqlite3_errmsg(db));
+        ret = CRE_DB;
+    }
+    sqlite3_exec(db, "DETACH DATABASE shard", NULL, NULL, NULL);
+    sqlite3_exec(db, "BEGIN", NULL, NULL, NULL);
+
+    return ret;
+}
+
+
+int
+cr_db_remove_pkg(cr_SqliteDb *sqlitedb, const char *pkgid, GError **err)
+{
+    int rc;
+    sqlite3_stmt *handle = NULL;
+
+    assert(sqlitedb);
+    assert(pkgid);
+    assert(!err || *err == NULL);
+
+    // Rows of the other tables are removed by the triggers
+    rc = sqlite3_prepare_v2(sqlitedb->db,
+                            "DELETE FROM packages WHERE pkgId = ?",
+                            -1, &handle, NULL);
+    if (rc == SQLITE_OK) {
+        cr_sqlite3_bind_text(handle, 1, pkgid, -1, SQLITE_STATIC);
+        rc = sqlite3_step(handle);
+    }
+
+    if (rc != SQLITE_OK && rc != SQLITE_DONE) {
+        g_set_error(err, ERR_DOMAIN, CRE_DB,
+                    "Cannot remove package %s: %s",
+                    pkgid, sqlite3_errmsg(sqlitedb->db));
+        sqlite3_finalize(handle);
+        return CRE_DB;
+    }
+
+    sqlite3_finalize(handle);
+    return CRE_OK;
+}
+
 int
 cr_db_close(cr_SqliteDb *sqlitedb, GError **err)
 {
     GError *tmp_err = NULL;
+    gint64 prof_start = cr_profile_start();
 
     assert(!err || *err == NULL);
 
@@ -1680,6 +1891,8 @@ cr_db_close(cr_SqliteDb *sqlitedb, GError **err)
 
     g_free(sqlitedb);
 
+    cr_profile_stop(CR_PROF_DB_CLOSE, prof_start);
+
     return CRE_OK;
 }
 
@@ -1688,6 +1901,7 @@ int
 cr_db_add_pkg(cr_SqliteDb *sqlitedb, cr_Package *pkg, GError **err)
 {
     GError *tmp_err = NULL;
+    gint64 prof_start;
 
     assert(sqlitedb);
     assert(sqlitedb->type < CR_DB_SENTINEL);
@@ -1696,15 +1910,20 @@ cr_db_add_pkg(cr_SqliteDb *sqlitedb, cr_Package *pkg, GError **err)
     if (!pkg)
         return CRE_OK;
 
+    prof_start = cr_profile_start();
+
     switch (sqlitedb->type) {
     case CR_DB_PRIMARY:
         cr_db_add_primary_pkg(sqlitedb->statements.pri, pkg, &tmp_err);
+        cr_profile_stop(CR_PROF_DB_ADD_PRIMARY, prof_start);
         break;
     case CR_DB_FILELISTS:
         cr_db_add_filelists_pkg(sqlitedb->statements.fil, pkg, &tmp_err);
+        cr_profile_stop(CR_PROF_DB_ADD_FILELISTS, prof_start);
         break;
     case CR_DB_OTHER:
         cr_db_add_other_pkg(sqlitedb->statements.oth, pkg, &tmp_err);
+        cr_profile_stop(CR_PROF_DB_ADD_OTHER, prof_start);
         break;
     default:
         g_critical("%s: Bad db type", __func__);
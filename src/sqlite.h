@@ -162,6 +162,30 @@ int cr_db_dbinfo_update(cr_SqliteDb *sqlitedb,
                         const char *checksum,
                         GError **err);
 
+/** Append all packages of another database of the same type.
+ * The database is attached (ATTACH DATABASE) and its tables are copied
+ * by INSERT ... SELECT with pkgKeys shifted behind the packages already
+ * present in the sqlitedb. Nothing is parsed or rendered again.
+ * @param sqlitedb              open db connection
+ * @param path                  path to the (uncompressed) database
+ * @param err                   **GError
+ * @return                      cr_Error code
+ */
+int cr_db_append(cr_SqliteDb *sqlitedb,
+                 const char *path,
+                 GError **err);
+
+/** Remove all packages with the pkgId from the db, together with their
+ * dependencies, files or changelogs.
+ * @param sqlitedb              open db connection
+ * @param pkgid                 pkgId of the package
+ * @param err                   **GError
+ * @return                      cr_Error code
+ */
+int cr_db_remove_pkg(cr_SqliteDb *sqlitedb,
+                     const char *pkgid,
+                     GError **err);
+
 /** Close db.
  *  - creates indexes on tables
  *  - commits transaction
@@ -21,6 +21,7 @@
 #include "threads.h"
 #include "error.h"
 #include "misc.h"
+#include "profile.h"
 
 #define ERR_DOMAIN      CREATEREPO_C_ERROR
 
@@ -84,6 +85,7 @@ cr_compressing_thread(gpointer data, G_GNUC_UNUSED gpointer user_data)
 {
     cr_CompressionTask *task = data;
     GError *tmp_err = NULL;
+    gint64 prof_start;
 
     assert(task);
 
@@ -92,11 +94,13 @@ cr_compressing_thread(gpointer data, G_GNUC_UNUSED gpointer user_data)
                                 cr_compression_suffix(task->type),
                                 NULL);
 
+    prof_start = cr_profile_start();
     cr_compress_file_with_stat(task->src,
                                task->dst,
                                task->type,
                                task->stat,
                                &tmp_err);
+    cr_profile_stop(CR_PROF_COMPRESS_FILE, prof_start);
 
     if (tmp_err) {
         // Error encountered
@@ -143,10 +147,12 @@ cr_repomd_record_fill_thread(gpointer data, G_GNUC_UNUSED gpointer user_data)
 {
     cr_RepomdRecordFillTask *task = data;
     GError *tmp_err = NULL;
+    gint64 prof_start = cr_profile_start();
 
     assert(task);
 
     cr_repomd_record_fill(task->record, task->checksum_type, &tmp_err);
+    cr_profile_stop(CR_PROF_REPOMD_FILL, prof_start);
 
     if (tmp_err) {
         // Error encountered
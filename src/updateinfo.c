@@ -27,6 +27,34 @@
 #include "checksum.h"
 
 
+/** Append data to the list in constant time.
+ * @param list      List
+ * @param tail      Last element of the list or NULL if it is not known
+ * @param data      Data
+ * @return          New start of the list
+ */
+static GSList *
+cr_slist_append_tail(GSList *list, GSList **tail, gpointer data)
+{
+    GSList *elem = g_slist_alloc();
+    elem->data = data;
+    elem->next = NULL;
+
+    if (!list) {
+        *tail = elem;
+        return elem;
+    }
+
+    if (!*tail)
+        *tail = g_slist_last(list);
+    while ((*tail)->next)  // The list was extended behind our back
+        *tail = (*tail)->next;
+
+    (*tail)->next = elem;
+    *tail = elem;
+    return list;
+}
+
 /*
  * cr_UpdateCollectionPackage
  */
@@ -126,7 +154,9 @@ cr_updatecollection_append_package(cr_UpdateCollection *collection,
                                    cr_UpdateCollectionPackage *pkg)
 {
     if (!collection || !pkg) return;
-    collection->packages = g_slist_append(collection->packages, pkg);
+    collection->packages = cr_slist_append_tail(collection->packages,
+                                                &collection->packages_tail,
+                                                pkg);
 }
 
 
@@ -245,7 +275,9 @@ cr_updaterecord_append_reference(cr_UpdateRecord *record,
                                  cr_UpdateReference *ref)
 {
     if (!record || !ref) return;
-    record->references = g_slist_append(record->references, ref);
+    record->references = cr_slist_append_tail(record->references,
+                                              &record->references_tail,
+                                              ref);
 }
 
 void
@@ -253,7 +285,9 @@ cr_updaterecord_append_collection(cr_UpdateRecord *record,
                                   cr_UpdateCollection *collection)
 {
     if (!record || !collection) return;
-    record->collections = g_slist_append(record->collections, collection);
+    record->collections = cr_slist_append_tail(record->collections,
+                                               &record->collections_tail,
+                                               collection);
 }
 
 
@@ -281,6 +315,8 @@ void
 cr_updateinfo_apped_record(cr_UpdateInfo *uinfo, cr_UpdateRecord *record)
 {
     if (!uinfo || !record) return;
-    uinfo->updates = g_slist_append(uinfo->updates, record);
+    uinfo->updates = cr_slist_append_tail(uinfo->updates,
+                                          &uinfo->updates_tail,
+                                          record);
 }
 
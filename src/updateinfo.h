@@ -31,6 +31,10 @@ extern "C" {
  *
  * Module for generating updateinfo.xml.
  *
+ * The *_append_* functions run in constant time. They remember
+ * the last element of the list in the *_tail member. When a list is
+ * modified directly, set its tail to NULL.
+ *
  *  \addtogroup updateinfo
  *  @{
  */
@@ -54,6 +58,7 @@ typedef struct {
     gchar *shortname;   /*!< e.g. rhn-tools-rhel-x86_64-server-6.5.aus */
     gchar *name;        /*!< e.g. RHN Tools for RHEL AUS (v. 6.5 for 64-bit x86_64) */
     GSList *packages;   /*!< List of cr_UpdateCollectionPackage */
+    GSList *packages_tail;  /*!< Last element of packages or NULL */
     GStringChunk *chunk;
 } cr_UpdateCollection;
 
@@ -84,12 +89,15 @@ typedef struct {
 
     GSList *references; /*!< List of cr_UpdateReference */
     GSList *collections;/*!< List of cr_UpdateCollection */
+    GSList *references_tail;    /*!< Last element of references or NULL */
+    GSList *collections_tail;   /*!< Last element of collections or NULL */
 
     GStringChunk *chunk;/*!< String chunk */
 } cr_UpdateRecord;
 
 typedef struct {
     GSList *updates;    /*!< List of cr_UpdateRecord */
+    GSList *updates_tail;   /*!< Last element of updates or NULL */
 } cr_UpdateInfo;
 
 /*
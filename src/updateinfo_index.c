@@ -0,0 +1,606 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <assert.h>
+#include <string.h>
+#include "error.h"
+#include "misc.h"
+#include "updateinfo_index.h"
+#include "xml_parser.h"
+
+#define ERR_DOMAIN          CREATEREPO_C_ERROR
+#define INDEX_HEADER        "updateinfo_index 1"
+#define READ_BUFFER_SIZE    65536
+
+/** A (package, update) pair.
+ */
+typedef struct {
+    const char *name;       /*!< Package name (in the chunk) */
+    const char *nevra;      /*!< Package NEVRA (in the chunk) */
+    guint update;           /*!< Index into updates */
+} cr_IndexEntry;
+
+/** An update.
+ */
+typedef struct {
+    const char *id;         /*!< Update id (in the chunk) */
+    guint first;            /*!< First entry of the update */
+    guint count;            /*!< Number of entries of the update */
+} cr_IndexUpdate;
+
+struct _cr_UpdateInfoIndex {
+    GStringChunk *chunk;    /*!< All strings */
+    GHashTable *ids;        /*!< Update id -> index into updates + 1 */
+    GArray *updates;        /*!< cr_IndexUpdate */
+    GArray *entries;        /*!< cr_IndexEntry, when sorted then by update
+                                 and NEVRA without duplicates */
+    GArray *by_nevra;       /*!< Entry indexes sorted by NEVRA and id */
+    GArray *by_name;        /*!< Entry indexes sorted by name and id */
+    GArray *by_id;          /*!< Update indexes sorted by id */
+    gboolean sorted;        /*!< Are the arrays up to date? */
+    GMutex *mutex;
+};
+
+cr_UpdateInfoIndex *
+cr_updateinfoindex_new(void)
+{
+    cr_UpdateInfoIndex *index = g_new0(cr_UpdateInfoIndex, 1);
+    index->chunk    = g_string_chunk_new(16384);
+    index->ids      = g_hash_table_new(g_str_hash, g_str_equal);
+    index->updates  = g_array_new(FALSE, FALSE, sizeof(cr_IndexUpdate));
+    index->entries  = g_array_new(FALSE, FALSE, sizeof(cr_IndexEntry));
+    index->by_nevra = g_array_new(FALSE, FALSE, sizeof(guint));
+    index->by_name  = g_array_new(FALSE, FALSE, sizeof(guint));
+    index->by_id    = g_array_new(FALSE, FALSE, sizeof(guint));
+    index->sorted   = TRUE;
+    index->mutex    = g_mutex_new();
+    return index;
+}
+
+void
+cr_updateinfoindex_free(cr_UpdateInfoIndex *index)
+{
+    if (!index)
+        return;
+
+    g_string_chunk_free(index->chunk);
+    g_hash_table_destroy(index->ids);
+    g_array_free(index->updates, TRUE);
+    g_array_free(index->entries, TRUE);
+    g_array_free(index->by_nevra, TRUE);
+    g_array_free(index->by_name, TRUE);
+    g_array_free(index->by_id, TRUE);
+    g_mutex_free(index->mutex);
+    g_free(index);
+}
+
+/** Get index of the update with the id, add the update if it is
+ * not known yet. Must be called with the mutex locked.
+ */
+static guint
+index_update(cr_UpdateInfoIndex *index, const char *id)
+{
+    cr_IndexUpdate update;
+    guint pos;
+
+    pos = GPOINTER_TO_UINT(g_hash_table_lookup(index->ids, id));
+    if (pos)
+        return pos - 1;
+
+    update.id    = g_string_chunk_insert_const(index->chunk, id);
+    update.first = 0;
+    update.count = 0;
+    g_array_append_val(index->updates, update);
+    g_hash_table_insert(index->ids, (gpointer) update.id,
+                        GUINT_TO_POINTER(index->updates->len));
+    index->sorted = FALSE;
+
+    return index->updates->len - 1;
+}
+
+/** Add a (package, update) pair. Must be called with the mutex locked.
+ */
+static void
+index_entry(cr_UpdateInfoIndex *index,
+            guint update,
+            const char *name,
+            const char *nevra)
+{
+    cr_IndexEntry entry;
+
+    entry.name   = g_string_chunk_insert_const(index->chunk, name);
+    entry.nevra  = g_string_chunk_insert_const(index->chunk, nevra);
+    entry.update = update;
+    g_array_append_val(index->entries, entry);
+    index->sorted = FALSE;
+}
+
+void
+cr_updateinfoindex_add_record(cr_UpdateInfoIndex *index, cr_UpdateRecord *rec)
+{
+    guint update;
+
+    assert(index);
+    assert(rec);
+
+    if (!rec->id)
+        return;
+
+    g_mutex_lock(index->mutex);
+
+    update = index_update(index, rec->id);
+
+    for (GSList *elem = rec->collections; elem; elem = g_slist_next(elem)) {
+        cr_UpdateCollection *col = elem->data;
+
+        for (GSList *e = col->packages; e; e = g_slist_next(e)) {
+            cr_UpdateCollectionPackage *pkg = e->data;
+            gchar *nevra;
+
+            if (!pkg->name)
+                continue;
+
+            nevra = g_strdup_printf("%s-%s:%s-%s.%s", pkg->name,
+                                    (pkg->epoch && *pkg->epoch) ? pkg->epoch : "0",
+                                    pkg->version ? pkg->version : "",
+                                    pkg->release ? pkg->release : "",
+                                    pkg->arch ? pkg->arch : "");
+            index_entry(index, update, pkg->name, nevra);
+            g_free(nevra);
+        }
+    }
+
+    g_mutex_unlock(index->mutex);
+}
+
+void
+cr_updateinfoindex_add_updateinfo(cr_UpdateInfoIndex *index,
+                                  cr_UpdateInfo *updateinfo)
+{
+    assert(index);
+    assert(updateinfo);
+
+    for (GSList *elem = updateinfo->updates; elem; elem = g_slist_next(elem))
+        cr_updateinfoindex_add_record(index, elem->data);
+}
+
+int
+cr_updateinfoindex_parse(cr_UpdateInfoIndex *index,
+                         const char *path,
+                         GError **err)
+{
+    int ret;
+    cr_UpdateInfo *updateinfo;
+
+    assert(index);
+    assert(path);
+    assert(!err || *err == NULL);
+
+    updateinfo = cr_updateinfo_new();
+    ret = cr_xml_parse_updateinfo(path, updateinfo, NULL, NULL, err);
+    if (ret == CRE_OK)
+        cr_updateinfoindex_add_updateinfo(index, updateinfo);
+    cr_updateinfo_free(updateinfo);
+
+    return ret;
+}
+
+// Sorting
+
+#define ENTRY(array, x)     (&g_array_index((array), cr_IndexEntry, (x)))
+#define UPDATE(array, x)    (&g_array_index((array), cr_IndexUpdate, (x)))
+
+static int
+entry_by_update_cmp(gconstpointer a, gconstpointer b)
+{
+    const cr_IndexEntry *ea = a, *eb = b;
+
+    if (ea->update != eb->update)
+        return ea->update < eb->update ? -1 : 1;
+    return strcmp(ea->nevra, eb->nevra);
+}
+
+static int
+pos_by_nevra_cmp(gconstpointer a, gconstpointer b, gpointer user_data)
+{
+    cr_UpdateInfoIndex *index = user_data;
+    const cr_IndexEntry *ea = ENTRY(index->entries, *((const guint *) a));
+    const cr_IndexEntry *eb = ENTRY(index->entries, *((const guint *) b));
+    int ret = strcmp(ea->nevra, eb->nevra);
+    if (ret)
+        return ret;
+    return strcmp(UPDATE(index->updates, ea->update)->id,
+                  UPDATE(index->updates, eb->update)->id);
+}
+
+static int
+pos_by_name_cmp(gconstpointer a, gconstpointer b, gpointer user_data)
+{
+    cr_UpdateInfoIndex *index = user_data;
+    const cr_IndexEntry *ea = ENTRY(index->entries, *((const guint *) a));
+    const cr_IndexEntry *eb = ENTRY(index->entries, *((const guint *) b));
+    int ret = strcmp(ea->name, eb->name);
+    if (ret)
+        return ret;
+    return strcmp(UPDATE(index->updates, ea->update)->id,
+                  UPDATE(index->updates, eb->update)->id);
+}
+
+static int
+pos_by_id_cmp(gconstpointer a, gconstpointer b, gpointer user_data)
+{
+    cr_UpdateInfoIndex *index = user_data;
+    return strcmp(UPDATE(index->updates, *((const guint *) a))->id,
+                  UPDATE(index->updates, *((const guint *) b))->id);
+}
+
+/** Rebuild sorted arrays. Must be called with the mutex locked.
+ */
+static void
+index_sort(cr_UpdateInfoIndex *index)
+{
+    GArray *entries = index->entries;
+    guint len = 0;
+
+    if (index->sorted)
+        return;
+
+    // Group entries by update and drop duplicates
+
+    g_array_sort(entries, entry_by_update_cmp);
+    for (guint x = 0; x < entries->len; x++) {
+        if (len && !entry_by_update_cmp(ENTRY(entries, x),
+                                        ENTRY(entries, len-1)))
+            continue;
+        if (x != len)
+            *ENTRY(entries, len) = *ENTRY(entries, x);
+        len++;
+    }
+    g_array_set_size(entries, len);
+
+    for (guint x = 0; x < index->updates->len; x++)
+        UPDATE(index->updates, x)->count = 0;
+    for (guint x = 0; x < len; x++) {
+        cr_IndexUpdate *update = UPDATE(index->updates,
+                                        ENTRY(entries, x)->update);
+        if (!update->count)
+            update->first = x;
+        update->count++;
+    }
+
+    // Lookup arrays
+
+    g_array_set_size(index->by_nevra, len);
+    g_array_set_size(index->by_name, len);
+    for (guint x = 0; x < len; x++) {
+        g_array_index(index->by_nevra, guint, x) = x;
+        g_array_index(index->by_name, guint, x) = x;
+    }
+
+    g_array_set_size(index->by_id, index->updates->len);
+    for (guint x = 0; x < index->updates->len; x++)
+        g_array_index(index->by_id, guint, x) = x;
+
+    g_array_sort_with_data(index->by_nevra, pos_by_nevra_cmp, index);
+    g_array_sort_with_data(index->by_name, pos_by_name_cmp, index);
+    g_array_sort_with_data(index->by_id, pos_by_id_cmp, index);
+
+    index->sorted = TRUE;
+}
+
+// Lookups
+
+/** Key of an array element.
+ */
+typedef const char *(*ElemKeyFunc)(cr_UpdateInfoIndex *index, guint pos);
+
+static const char *
+nevra_key(cr_UpdateInfoIndex *index, guint pos)
+{
+    return ENTRY(index->entries, g_array_index(index->by_nevra, guint, pos))->nevra;
+}
+
+static const char *
+name_key(cr_UpdateInfoIndex *index, guint pos)
+{
+    return ENTRY(index->entries, g_array_index(index->by_name, guint, pos))->name;
+}
+
+static const char *
+id_key(cr_UpdateInfoIndex *index, guint pos)
+{
+    return UPDATE(index->updates, g_array_index(index->by_id, guint, pos))->id;
+}
+
+/** Binary search of the first element with key not less than the key.
+ */
+static guint
+lower_bound(cr_UpdateInfoIndex *index,
+            guint len,
+            ElemKeyFunc elem_key,
+            const char *key)
+{
+    guint lo = 0, hi = len;
+
+    while (lo < hi) {
+        guint mid = lo + (hi - lo) / 2;
+        if (strcmp(elem_key(index, mid), key) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/** Ids of updates of entries with the key in the sorted array.
+ */
+static GSList *
+updates_by_key(cr_UpdateInfoIndex *index,
+               GArray *array,
+               ElemKeyFunc elem_key,
+               const char *key)
+{
+    GSList *ids = NULL;
+    const char *last = NULL;
+
+    g_mutex_lock(index->mutex);
+    index_sort(index);
+
+    for (guint x = lower_bound(index, array->len, elem_key, key);
+         x < array->len && !strcmp(elem_key(index, x), key);
+         x++)
+    {
+        cr_IndexEntry *entry = ENTRY(index->entries,
+                                     g_array_index(array, guint, x));
+        const char *id = UPDATE(index->updates, entry->update)->id;
+        // Entries of a key are sorted by id
+        if (id != last)
+            ids = g_slist_prepend(ids, (gpointer) id);
+        last = id;
+    }
+
+    g_mutex_unlock(index->mutex);
+
+    return g_slist_reverse(ids);
+}
+
+guint
+cr_updateinfoindex_size(cr_UpdateInfoIndex *index)
+{
+    guint size;
+
+    assert(index);
+
+    g_mutex_lock(index->mutex);
+    size = index->updates->len;
+    g_mutex_unlock(index->mutex);
+
+    return size;
+}
+
+GSList *
+cr_updateinfoindex_updates_by_nevra(cr_UpdateInfoIndex *index,
+                                    const char *nevra)
+{
+    assert(index);
+    assert(nevra);
+    return updates_by_key(index, index->by_nevra, nevra_key, nevra);
+}
+
+GSList *
+cr_updateinfoindex_updates_by_name(cr_UpdateInfoIndex *index,
+                                   const char *name)
+{
+    assert(index);
+    assert(name);
+    return updates_by_key(index, index->by_name, name_key, name);
+}
+
+GSList *
+cr_updateinfoindex_packages(cr_UpdateInfoIndex *index, const char *update_id)
+{
+    GSList *nevras = NULL;
+    guint pos;
+
+    assert(index);
+    assert(update_id);
+
+    g_mutex_lock(index->mutex);
+    index_sort(index);
+
+    pos = lower_bound(index, index->by_id->len, id_key, update_id);
+    if (pos < index->by_id->len && !strcmp(id_key(index, pos), update_id)) {
+        cr_IndexUpdate *update = UPDATE(index->updates,
+                                        g_array_index(index->by_id, guint, pos));
+        for (guint x = update->first + update->count; x > update->first; x--)
+            nevras = g_slist_prepend(nevras, (gpointer) ENTRY(index->entries, x-1)->nevra);
+    }
+
+    g_mutex_unlock(index->mutex);
+
+    return nevras;
+}
+
+// Persistence
+
+int
+cr_updateinfoindex_write(cr_UpdateInfoIndex *index,
+                         const char *path,
+                         cr_CompressionType comtype,
+                         cr_ContentStat *stat,
+                         GError **err)
+{
+    CR_FILE *f;
+    GString *buf;
+    GError *tmp_err = NULL;
+
+    assert(index);
+    assert(path);
+    assert(!err || *err == NULL);
+
+    f = cr_sopen(path, CR_CW_MODE_WRITE, comtype, stat, &tmp_err);
+    if (!f) {
+        int code = tmp_err->code;
+        g_propagate_prefixed_error(err, tmp_err, "Cannot open %s: ", path);
+        return code;
+    }
+
+    buf = g_string_new(INDEX_HEADER "\n");
+
+    g_mutex_lock(index->mutex);
+    index_sort(index);
+
+    for (guint x = 0; x < index->by_id->len && !tmp_err; x++) {
+        cr_IndexUpdate *update = UPDATE(index->updates,
+                                        g_array_index(index->by_id, guint, x));
+        gchar *id = g_strescape(update->id, NULL);
+
+        g_string_append_printf(buf, "U\t%s\n", id);
+        g_free(id);
+
+        for (guint y = update->first; y < update->first + update->count; y++) {
+            cr_IndexEntry *entry = ENTRY(index->entries, y);
+            gchar *name = g_strescape(entry->name, NULL);
+            gchar *nevra = g_strescape(entry->nevra, NULL);
+
+            g_string_append_printf(buf, "P\t%s\t%s\n", name, nevra);
+            g_free(name);
+            g_free(nevra);
+        }
+
+        if (buf->len >= READ_BUFFER_SIZE) {
+            cr_write(f, buf->str, buf->len, &tmp_err);
+            g_string_truncate(buf, 0);
+        }
+    }
+
+    g_mutex_unlock(index->mutex);
+
+    if (!tmp_err && buf->len)
+        cr_write(f, buf->str, buf->len, &tmp_err);
+    g_string_free(buf, TRUE);
+
+    if (tmp_err) {
+        int code = tmp_err->code;
+        g_propagate_prefixed_error(err, tmp_err, "Cannot write %s: ", path);
+        cr_close(f, NULL);
+        return code;
+    }
+
+    if (cr_close(f, &tmp_err) != CRE_OK) {
+        int code = tmp_err->code;
+        g_propagate_prefixed_error(err, tmp_err, "Cannot close %s: ", path);
+        return code;
+    }
+
+    return CRE_OK;
+}
+
+/** Parse a line of a stored index.
+ * @return              FALSE if the line is malformed
+ */
+static gboolean
+load_line(cr_UpdateInfoIndex *index, const char *line, guint *update)
+{
+    gchar **fields;
+    gboolean ret = TRUE;
+
+    if (!*line)
+        return TRUE;
+
+    fields = g_strsplit(line, "\t", 0);
+
+    if (!strcmp(fields[0], "U") && g_strv_length(fields) == 2) {
+        gchar *id = g_strcompress(fields[1]);
+        *update = index_update(index, id);
+        g_free(id);
+    } else if (!strcmp(fields[0], "P") && g_strv_length(fields) == 3
+               && *update != G_MAXUINT) {
+        gchar *name = g_strcompress(fields[1]);
+        gchar *nevra = g_strcompress(fields[2]);
+        index_entry(index, *update, name, nevra);
+        g_free(name);
+        g_free(nevra);
+    } else {
+        ret = FALSE;
+    }
+
+    g_strfreev(fields);
+    return ret;
+}
+
+cr_UpdateInfoIndex *
+cr_updateinfoindex_load(const char *path, GError **err)
+{
+    CR_FILE *f;
+    GString *content;
+    cr_UpdateInfoIndex *index;
+    gchar **lines;
+    char buffer[READ_BUFFER_SIZE];
+    int readed;
+    guint update = G_MAXUINT;
+    GError *tmp_err = NULL;
+
+    assert(path);
+    assert(!err || *err == NULL);
+
+    f = cr_open(path, CR_CW_MODE_READ, CR_CW_AUTO_DETECT_COMPRESSION, &tmp_err);
+    if (!f) {
+        g_propagate_prefixed_error(err, tmp_err, "Cannot open %s: ", path);
+        return NULL;
+    }
+
+    content = g_string_new(NULL);
+    while ((readed = cr_read(f, buffer, READ_BUFFER_SIZE, &tmp_err)) > 0)
+        g_string_append_len(content, buffer, readed);
+    cr_close(f, NULL);
+
+    if (tmp_err) {
+        g_propagate_prefixed_error(err, tmp_err, "Cannot read %s: ", path);
+        g_string_free(content, TRUE);
+        return NULL;
+    }
+
+    lines = g_strsplit(content->str, "\n", 0);
+    g_string_free(content, TRUE);
+
+    if (g_strcmp0(lines[0], INDEX_HEADER)) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "%s is not an updateinfo index", path);
+        g_strfreev(lines);
+        return NULL;
+    }
+
+    index = cr_updateinfoindex_new();
+    for (gchar **line = lines + 1; *line; line++) {
+        if (!load_line(index, *line, &update)) {
+            g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                        "Malformed line %ld of %s",
+                        (long) (line - lines + 1), path);
+            cr_updateinfoindex_free(index);
+            index = NULL;
+            break;
+        }
+    }
+
+    g_strfreev(lines);
+    return index;
+}
@@ -0,0 +1,164 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#ifndef __C_CREATEREPOLIB_UPDATEINFO_INDEX_H__
+#define __C_CREATEREPOLIB_UPDATEINFO_INDEX_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <glib.h>
+#include "compression_wrapper.h"
+#include "updateinfo.h"
+
+/** \defgroup   updateinfo_index    Index of packages referenced by updates.
+ *
+ * Maps package NEVRAs ("name-epoch:version-release.arch", epoch
+ * defaults to "0") and package names to ids of updates which reference
+ * them, and update ids to NEVRAs of their packages. Lookups are binary
+ * searches over sorted arrays; strings are stored only once.
+ *
+ * Records may be added from several threads at once (e.g. from threads
+ * parsing different updateinfo files). The arrays are sorted by the
+ * first lookup after a modification.
+ *
+ * The index can be stored as a compressed text file (repomd record
+ * type CR_UPDATEINFO_INDEX_RECORD_TYPE). First line is a header,
+ * other lines are (strings are escaped by g_strescape()):
+ * \code
+ * U\t<update id>
+ * P\t<package name>\t<package NEVRA>
+ * \endcode
+ * Every P line belongs to the closest preceding U line.
+ *
+ * \addtogroup updateinfo_index
+ *  @{
+ */
+
+/** Type of repomd record of a stored index.
+ */
+#define CR_UPDATEINFO_INDEX_RECORD_TYPE     "updateinfo_index"
+
+/** Index of updates.
+ */
+typedef struct _cr_UpdateInfoIndex cr_UpdateInfoIndex;
+
+/** Create an empty index.
+ * @return              new cr_UpdateInfoIndex
+ */
+cr_UpdateInfoIndex *cr_updateinfoindex_new(void);
+
+/** Add an update record (its id and packages of all its collections).
+ * Records without an id are ignored. Packages of records with the same
+ * id are joined. Thread safe.
+ * @param index         cr_UpdateInfoIndex
+ * @param rec           cr_UpdateRecord
+ */
+void cr_updateinfoindex_add_record(cr_UpdateInfoIndex *index,
+                                   cr_UpdateRecord *rec);
+
+/** Add all records of the updateinfo. Thread safe.
+ * @param index         cr_UpdateInfoIndex
+ * @param updateinfo    cr_UpdateInfo
+ */
+void cr_updateinfoindex_add_updateinfo(cr_UpdateInfoIndex *index,
+                                       cr_UpdateInfo *updateinfo);
+
+/** Parse an updateinfo.xml file (could be compressed) and add its
+ * records. Parsed records are freed right after they are indexed.
+ * Thread safe, several files can be parsed in parallel.
+ * @param index         cr_UpdateInfoIndex
+ * @param path          path to updateinfo.xml
+ * @param err           GError **
+ * @return              cr_Error code
+ */
+int cr_updateinfoindex_parse(cr_UpdateInfoIndex *index,
+                             const char *path,
+                             GError **err);
+
+/** Number of updates in the index.
+ * @param index         cr_UpdateInfoIndex
+ * @return              number of updates
+ */
+guint cr_updateinfoindex_size(cr_UpdateInfoIndex *index);
+
+/** Get ids of updates which reference the package.
+ * @param index         cr_UpdateInfoIndex
+ * @param nevra         NEVRA of the package
+ * @return              list of update ids sorted by id. Strings are
+ *                      owned by the index, free only the list by
+ *                      g_slist_free().
+ */
+GSList *cr_updateinfoindex_updates_by_nevra(cr_UpdateInfoIndex *index,
+                                            const char *nevra);
+
+/** Get ids of updates which reference any version of the package.
+ * @param index         cr_UpdateInfoIndex
+ * @param name          name of the package
+ * @return              list of update ids sorted by id. Strings are
+ *                      owned by the index, free only the list by
+ *                      g_slist_free().
+ */
+GSList *cr_updateinfoindex_updates_by_name(cr_UpdateInfoIndex *index,
+                                           const char *name);
+
+/** Get NEVRAs of packages referenced by the update.
+ * @param index         cr_UpdateInfoIndex
+ * @param update_id     id of the update
+ * @return              sorted list of NEVRAs. Strings are owned by
+ *                      the index, free only the list by g_slist_free().
+ */
+GSList *cr_updateinfoindex_packages(cr_UpdateInfoIndex *index,
+                                    const char *update_id);
+
+/** Store the index into a file.
+ * @param index         cr_UpdateInfoIndex
+ * @param path          output path
+ * @param comtype       type of compression
+ * @param stat          cr_ContentStat for stats of the uncompressed
+ *                      content or NULL
+ * @param err           GError **
+ * @return              cr_Error code
+ */
+int cr_updateinfoindex_write(cr_UpdateInfoIndex *index,
+                             const char *path,
+                             cr_CompressionType comtype,
+                             cr_ContentStat *stat,
+                             GError **err);
+
+/** Load an index stored by cr_updateinfoindex_write().
+ * @param path          path to the (compressed) index file
+ * @param err           GError **
+ * @return              cr_UpdateInfoIndex or NULL on error
+ */
+cr_UpdateInfoIndex *cr_updateinfoindex_load(const char *path, GError **err);
+
+/** Free the index.
+ * @param index         cr_UpdateInfoIndex
+ */
+void cr_updateinfoindex_free(cr_UpdateInfoIndex *index);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __C_CREATEREPOLIB_UPDATEINFO_INDEX_H__ */
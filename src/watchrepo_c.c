@@ -0,0 +1,1693 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "error.h"
+#include "cleanup.h"
+#include "version.h"
+#include "misc.h"
+#include "checksum.h"
+#include "compression_wrapper.h"
+#include "createrepo_shared.h"
+#include "helpers.h"
+#include "load_metadata.h"
+#include "package.h"
+#include "parsepkg.h"
+#include "repomd.h"
+#include "segments.h"
+#include "sqlite.h"
+#include "xml_dump.h"
+#include "xml_file.h"
+#include "xml_parser.h"
+
+
+#define DEFAULT_DELAY           5
+#define DEFAULT_MAX_DELAY       60
+#define DEFAULT_WORKERS         5
+#define DEFAULT_CHECKSUM        "sha256"
+#define DEFAULT_CHANGELOG_LIMIT 10
+#define INOTIFY_BUFFER_SIZE     65536
+#define STATE_DIR_NAME          ".watchrepo"
+
+#define WATCH_MASK  (IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM \
+                     | IN_DELETE | IN_ONLYDIR)
+
+/**
+ * Command line options
+ */
+typedef struct {
+
+    /* Items filled by cmd option parser */
+
+    gboolean version;           /*!< print program version */
+    gboolean quiet;             /*!< quiet mode */
+    gboolean verbose;           /*!< verbose mode */
+    int delay;                  /*!< seconds without changes before a run */
+    int max_delay;              /*!< max seconds from the first change */
+    gchar *socket_path;         /*!< path of the control socket */
+    int workers;                /*!< number of threads reading packages */
+    gchar *checksum;            /*!< type of package checksums */
+    int changelog_limit;        /*!< number of changelog entries */
+    gboolean no_database;       /*!< do not generate sqlite databases */
+    gboolean skip_symlinks;     /*!< ignore symlinked packages */
+
+    /* Items filled by check_arguments() */
+
+    cr_ChecksumType checksum_type;  /*!< parsed checksum */
+
+} WatchrepoCmdOptions;
+
+/**
+ * A package of a watched repository
+ */
+typedef struct {
+    gchar *relpath;         /*!< Path relative to the repo (the table key) */
+    cr_Package *pkg;        /*!< Loaded package (NULL with --no-database) */
+    struct cr_XmlStruct res;/*!< Rendered XML chunks, NULL if not loaded */
+    gchar *pkgid;           /*!< pkgId of the loaded package */
+    gboolean broken;        /*!< Cannot be read, skipped until it changes */
+    gint64 mtime;           /*!< mtime of the loaded file */
+    gint64 size;            /*!< size of the loaded file */
+    guint scan;             /*!< Last scan of the repo that found the file */
+    guint64 serial;         /*!< Serial number of the last change of the file */
+} WatchedPkg;
+
+/**
+ * A watched repository
+ */
+typedef struct {
+    gchar *path;            /*!< Normalized path (with trailing '/') */
+    GHashTable *packages;   /*!< Relative path -> WatchedPkg */
+    guint scan;             /*!< Number of the last scan of the tree */
+    gboolean dirty;         /*!< Metadata don't match the packages */
+    gboolean forced;        /*!< Run without waiting for the delay */
+    gint64 first_change;    /*!< Monotonic time of the first unhandled change */
+    gint64 last_change;     /*!< Monotonic time of the last change */
+    guint64 serial;         /*!< Last serial number given to a change */
+    GSList *waiting;        /*!< Clients waiting for the next run */
+    gboolean running;       /*!< A run is in progress, see start_run() */
+    gchar *lock_dir;        /*!< .repodata/ of the run in progress */
+    GHashTable *db_pkgids;  /*!< Relative path -> pkgId of packages in
+                                 the working databases (STATE_DIR_NAME/),
+                                 used only by the running run */
+    guint runs;             /*!< Number of finished runs */
+    guint failures;         /*!< Number of failed runs */
+} WatchedRepo;
+
+/**
+ * A watched directory
+ */
+typedef struct {
+    WatchedRepo *repo;
+    gchar *dir;             /*!< Path relative to the repo ("" or "dir/") */
+} WatchedDir;
+
+/**
+ * Daemon state
+ */
+typedef struct {
+    WatchrepoCmdOptions *options;
+    GPtrArray *repos;       /*!< WatchedRepo */
+    GHashTable *watches;    /*!< wd -> WatchedDir */
+    int inotify_fd;
+    GMainLoop *loop;
+    GThreadPool *runs;      /*!< Threads running generate_metadata() */
+} Watchrepo;
+
+/**
+ * Regeneration of the metadata of one repo. It works on its own copy
+ * of the packages in a thread while the main loop keeps watching.
+ */
+typedef struct {
+    Watchrepo *wr;
+    WatchedRepo *repo;
+    GPtrArray *pkgs;        /*!< WatchedPkg copies owned by the run */
+    GSList *waiting;        /*!< Clients waiting for this run */
+    gint64 started;         /*!< Monotonic time of the start */
+    gboolean success;       /*!< Metadata were published */
+    GError *err;            /*!< Error of a failed run */
+} MetadataRun;
+
+/** Watched repos, their .repodata/ dirs are removed when a signal kills us.
+ */
+static GPtrArray *watched_repos = NULL;
+
+static WatchrepoCmdOptions *
+watchrepocmdoptions_new(void)
+{
+    WatchrepoCmdOptions *options;
+
+    options = g_new0(WatchrepoCmdOptions, 1);
+    options->delay = DEFAULT_DELAY;
+    options->max_delay = DEFAULT_MAX_DELAY;
+    options->workers = DEFAULT_WORKERS;
+    options->changelog_limit = DEFAULT_CHANGELOG_LIMIT;
+
+    return options;
+}
+
+static void
+watchrepocmdoptions_free(WatchrepoCmdOptions *options)
+{
+    g_free(options->socket_path);
+    g_free(options->checksum);
+    g_free(options);
+}
+
+CR_DEFINE_CLEANUP_FUNCTION0(WatchrepoCmdOptions*, cr_local_watchrepocmdoptions_free, watchrepocmdoptions_free)
+#define _cleanup_watchrepocmdoptions_free_ __attribute__ ((cleanup(cr_local_watchrepocmdoptions_free)))
+
+/**
+ * Parse commandline arguments for watchrepo utility
+ */
+static gboolean
+parse_watchrepo_arguments(int *argc,
+                          char ***argv,
+                          WatchrepoCmdOptions *options,
+                          GError **err)
+{
+    const GOptionEntry cmd_entries[] = {
+
+        { "version", 'V', 0, G_OPTION_ARG_NONE, &(options->version),
+          "Show program's version number and exit.", NULL},
+        { "quiet", 'q', 0, G_OPTION_ARG_NONE, &(options->quiet),
+          "Run quietly.", NULL },
+        { "verbose", 'v', 0, G_OPTION_ARG_NONE, &(options->verbose),
+          "Run verbosely.", NULL },
+        { "delay", '\0', 0, G_OPTION_ARG_INT, &(options->delay),
+          "Regenerate metadata when there was no change in the repo for "
+          "this number of seconds (default: 5).", "<seconds>" },
+        { "max-delay", '\0', 0, G_OPTION_ARG_INT, &(options->max_delay),
+          "Regenerate metadata at latest after this number of seconds "
+          "since the first change even if changes keep coming (default: 60).",
+          "<seconds>" },
+        { "socket", '\0', 0, G_OPTION_ARG_FILENAME, &(options->socket_path),
+          "Listen for requests on this unix socket. Requests (one per line): "
+          "\"update <repo>\" rescans the repo and regenerates its metadata, "
+          "the reply is sent when the metadata are published; "
+          "\"status\" lists the repos.", "<path>" },
+        { "workers", '\0', 0, G_OPTION_ARG_INT, &(options->workers),
+          "Number of threads reading new and changed packages (default: 5).",
+          "<n>" },
+        { "checksum", 's', 0, G_OPTION_ARG_STRING, &(options->checksum),
+          "Choose the checksum type used in repomd.xml and for packages. "
+          "Possible values: md5, sha1, sha224, sha256, sha384, sha512 "
+          "(default: sha256).", "<checksum_type>" },
+        { "changelog-limit", '\0', 0, G_OPTION_ARG_INT, &(options->changelog_limit),
+          "Only import the last N changelog entries, from each rpm, into "
+          "the metadata (default: 10).", "<number>" },
+        { "no-database", '\0', 0, G_OPTION_ARG_NONE, &(options->no_database),
+          "Do not generate sqlite databases in the repository. Otherwise "
+          "uncompressed working copies of the databases are kept in "
+          STATE_DIR_NAME"/ of the repository and updated in place.", NULL },
+        { "skip-symlinks", '\0', 0, G_OPTION_ARG_NONE, &(options->skip_symlinks),
+          "Ignore symlinked packages.", NULL },
+        { NULL },
+    };
+
+    // Parse cmd arguments
+    GOptionContext *context;
+    context = g_option_context_new("<repo_directory> [<repo_directory> ...]");
+    g_option_context_set_summary(context, "Watch repositories and keep their "
+            "metadata up to date.");
+    g_option_context_add_main_entries(context, cmd_entries, NULL);
+    gboolean ret = g_option_context_parse(context, argc, argv, err);
+    g_option_context_free(context);
+    return ret;
+}
+
+/**
+ * Check parsed arguments and fill some other attributes
+ * of option struct accordingly.
+ */
+static gboolean
+check_arguments(WatchrepoCmdOptions *options, GError **err)
+{
+    if (options->delay < 0) {
+        g_set_error(err, CREATEREPO_C_ERROR, CRE_BADARG,
+                    "--delay must not be negative");
+        return FALSE;
+    }
+
+    if (options->max_delay < options->delay) {
+        g_set_error(err, CREATEREPO_C_ERROR, CRE_BADARG,
+                    "--max-delay must not be lower than --delay");
+        return FALSE;
+    }
+
+    if (options->workers < 1) {
+        g_set_error(err, CREATEREPO_C_ERROR, CRE_BADARG,
+                    "Wrong number of workers");
+        return FALSE;
+    }
+
+    if (options->changelog_limit < -1) {
+        g_set_error(err, CREATEREPO_C_ERROR, CRE_BADARG,
+                    "Wrong changelog limit \"%d\" - must be -1 or higher",
+                    options->changelog_limit);
+        return FALSE;
+    }
+
+    if (!options->checksum)
+        options->checksum = g_strdup(DEFAULT_CHECKSUM);
+
+    options->checksum_type = cr_checksum_type(options->checksum);
+    if (options->checksum_type == CR_CHECKSUM_UNKNOWN) {
+        g_set_error(err, CREATEREPO_C_ERROR, CRE_BADARG,
+                    "Unknown/Unsupported checksum type \"%s\"",
+                    options->checksum);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+// Package tree
+
+
+/** Mark the repo as changed.
+ */
+static void
+repo_changed(WatchedRepo *repo)
+{
+    gint64 now = g_get_monotonic_time();
+
+    if (!repo->dirty)
+        repo->first_change = now;
+    repo->last_change = now;
+    repo->dirty = TRUE;
+}
+
+static void
+xmlstruct_clear(struct cr_XmlStruct *res)
+{
+    g_free(res->primary);
+    g_free(res->filelists);
+    g_free(res->other);
+    memset(res, 0, sizeof(*res));
+}
+
+/** Forget the loaded content of the package, it is read again
+ * by the next run.
+ */
+static void
+watchedpkg_reset(WatchedPkg *wpkg)
+{
+    cr_package_free(wpkg->pkg);
+    wpkg->pkg = NULL;
+    xmlstruct_clear(&(wpkg->res));
+    g_free(wpkg->pkgid);
+    wpkg->pkgid = NULL;
+    wpkg->broken = FALSE;
+    wpkg->mtime = 0;
+    wpkg->size = 0;
+}
+
+/** Move the loaded content of src into dst.
+ */
+static void
+watchedpkg_move_content(WatchedPkg *dst, WatchedPkg *src)
+{
+    watchedpkg_reset(dst);
+    dst->pkg = src->pkg;
+    dst->res = src->res;
+    dst->pkgid = src->pkgid;
+    dst->broken = src->broken;
+    dst->mtime = src->mtime;
+    dst->size = src->size;
+
+    src->pkg = NULL;
+    memset(&(src->res), 0, sizeof(src->res));
+    src->pkgid = NULL;
+    watchedpkg_reset(src);
+}
+
+static void
+watchedpkg_free(WatchedPkg *wpkg)
+{
+    if (!wpkg)
+        return;
+    watchedpkg_reset(wpkg);
+    g_free(wpkg->relpath);
+    g_free(wpkg);
+}
+
+/** Add the package into the repo or mark it as found by the current scan.
+ * @param changed       The file was (re)written, a loaded content
+ *                      is dropped
+ */
+static void
+add_package(WatchedRepo *repo, const char *relpath, gboolean changed)
+{
+    WatchedPkg *wpkg = g_hash_table_lookup(repo->packages, relpath);
+
+    if (!wpkg) {
+        wpkg = g_new0(WatchedPkg, 1);
+        wpkg->relpath = g_strdup(relpath);
+        g_hash_table_insert(repo->packages, wpkg->relpath, wpkg);
+        wpkg->serial = ++repo->serial;
+    } else if (changed) {
+        watchedpkg_reset(wpkg);
+        wpkg->serial = ++repo->serial;
+    }
+
+    wpkg->scan = repo->scan;
+}
+
+/** Top level directories which are never watched (output of createrepo_c
+ * and of the runs, working databases).
+ */
+static gboolean
+ignored_dir(const char *reldir, const char *name)
+{
+    return !*reldir && (g_str_has_prefix(name, "repodata")
+                        || g_str_has_prefix(name, ".repodata")
+                        || !g_strcmp0(name, STATE_DIR_NAME));
+}
+
+static gboolean
+is_package(Watchrepo *wr, const char *full_path, const char *name)
+{
+    if (!g_str_has_suffix(name, ".rpm"))
+        return FALSE;
+    if (wr->options->skip_symlinks
+        && g_file_test(full_path, G_FILE_TEST_IS_SYMLINK))
+        return FALSE;
+    return g_file_test(full_path, G_FILE_TEST_IS_REGULAR);
+}
+
+/** Add an inotify watch to the directory and recursively to its
+ * subdirectories. Packages found in the tree are added into the repo,
+ * already known packages keep their loaded content.
+ * @return      Number of found packages
+ */
+static guint
+watch_dir(Watchrepo *wr, WatchedRepo *repo, const char *reldir)
+{
+    _cleanup_free_ gchar *full_dir = g_strconcat(repo->path, reldir, NULL);
+    const gchar *name;
+    GDir *dirp;
+    guint added = 0;
+    int wd;
+
+    wd = inotify_add_watch(wr->inotify_fd, full_dir, WATCH_MASK);
+    if (wd == -1) {
+        g_warning("Cannot watch %s: %s", full_dir, g_strerror(errno));
+    } else {
+        WatchedDir *wdir = g_hash_table_lookup(wr->watches, GINT_TO_POINTER(wd));
+        if (!wdir) {
+            wdir = g_new0(WatchedDir, 1);
+            g_hash_table_insert(wr->watches, GINT_TO_POINTER(wd), wdir);
+        }
+        g_free(wdir->dir);
+        wdir->repo = repo;
+        wdir->dir = g_strdup(reldir);
+    }
+
+    // Watch is set before the listing, nothing can be missed
+    dirp = g_dir_open(full_dir, 0, NULL);
+    if (!dirp) {
+        g_warning("Cannot open directory: %s", full_dir);
+        return 0;
+    }
+
+    while ((name = g_dir_read_name(dirp))) {
+        _cleanup_free_ gchar *full_path = g_strconcat(full_dir, name, NULL);
+
+        if (g_str_has_suffix(name, ".rpm")) {
+            if (is_package(wr, full_path, name)) {
+                _cleanup_free_ gchar *relpath = g_strconcat(reldir, name, NULL);
+                add_package(repo, relpath, FALSE);
+                added++;
+            }
+        } else if (!ignored_dir(reldir, name)
+                   && g_file_test(full_path, G_FILE_TEST_IS_DIR)) {
+            _cleanup_free_ gchar *subdir = g_strconcat(reldir, name, "/", NULL);
+            added += watch_dir(wr, repo, subdir);
+        }
+    }
+
+    g_dir_close(dirp);
+
+    return added;
+}
+
+/** Remove watches of the directory tree.
+ */
+static void
+remove_watches(Watchrepo *wr, WatchedRepo *repo, const char *reldir)
+{
+    GHashTableIter iter;
+    gpointer key, value;
+
+    g_hash_table_iter_init(&iter, wr->watches);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        WatchedDir *wdir = value;
+        if (wdir->repo == repo && g_str_has_prefix(wdir->dir, reldir)) {
+            inotify_rm_watch(wr->inotify_fd, GPOINTER_TO_INT(key));
+            g_hash_table_iter_remove(&iter);
+        }
+    }
+}
+
+/** Remove packages and watches of the directory tree.
+ * @return      Number of removed packages
+ */
+static guint
+unwatch_dir(Watchrepo *wr, WatchedRepo *repo, const char *reldir)
+{
+    GHashTableIter iter;
+    gpointer key;
+    guint removed = 0;
+
+    g_hash_table_iter_init(&iter, repo->packages);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        if (g_str_has_prefix(key, reldir)) {
+            g_hash_table_iter_remove(&iter);
+            removed++;
+        }
+    }
+
+    remove_watches(wr, repo, reldir);
+
+    return removed;
+}
+
+/** Walk the repo tree again. Packages which are still there keep
+ * their loaded content, the others are dropped.
+ */
+static void
+rescan_repo(Watchrepo *wr, WatchedRepo *repo)
+{
+    GHashTableIter iter;
+    gpointer value;
+    guint count;
+
+    repo->scan++;
+    remove_watches(wr, repo, "");
+    count = watch_dir(wr, repo, "");
+
+    g_hash_table_iter_init(&iter, repo->packages);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+        if (((WatchedPkg *) value)->scan != repo->scan)
+            g_hash_table_iter_remove(&iter);
+
+    g_message("%s: %u packages", repo->path, count);
+    repo_changed(repo);
+}
+
+/** Take over packages from the current metadata of the repo, so only
+ * packages which changed since they were generated are read by the first run.
+ */
+static void
+load_current_metadata(Watchrepo *wr, WatchedRepo *repo)
+{
+    const char *checksum = cr_checksum_name_str(wr->options->checksum_type);
+    cr_Metadata *md;
+    GHashTableIter iter;
+    gpointer value;
+    guint loaded = 0;
+    GError *tmp_err = NULL;
+
+    md = cr_metadata_new(CR_HT_KEY_FILENAME, 0, NULL);
+    if (cr_metadata_locate_and_load_xml(md, repo->path, &tmp_err) != CRE_OK) {
+        g_debug("%s: No usable metadata: %s", repo->path, tmp_err->message);
+        g_clear_error(&tmp_err);
+        cr_metadata_free(md);
+        return;
+    }
+
+    g_hash_table_iter_init(&iter, cr_metadata_hashtable(md));
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        cr_Package *pkg = value;
+        WatchedPkg *wpkg;
+        _cleanup_free_ gchar *full_path = NULL;
+        struct stat st;
+
+        if (!pkg->location_href || pkg->location_base
+            || g_strcmp0(pkg->checksum_type, checksum))
+            continue;
+
+        wpkg = g_hash_table_lookup(repo->packages, pkg->location_href);
+        if (!wpkg || wpkg->res.primary)
+            continue;
+
+        // Same test as createrepo_c --update does
+        full_path = g_strconcat(repo->path, wpkg->relpath, NULL);
+        if (stat(full_path, &st) == -1
+            || st.st_mtime != pkg->time_file
+            || st.st_size != pkg->size_package)
+            continue;
+
+        wpkg->res = cr_xml_dump(pkg, &tmp_err);
+        if (tmp_err) {
+            g_clear_error(&tmp_err);
+            xmlstruct_clear(&(wpkg->res));
+            continue;
+        }
+
+        if (!wr->options->no_database)
+            wpkg->pkg = cr_package_copy(pkg);
+        wpkg->pkgid = g_strdup(pkg->pkgId);
+        wpkg->mtime = st.st_mtime;
+        wpkg->size = st.st_size;
+        loaded++;
+    }
+
+    cr_metadata_free(md);
+    g_message("%s: %u packages taken from the current metadata",
+              repo->path, loaded);
+}
+
+static void
+handle_event(Watchrepo *wr, struct inotify_event *ev)
+{
+    WatchedDir *wdir;
+    WatchedRepo *repo;
+    _cleanup_free_ gchar *relpath = NULL;
+
+    if (ev->mask & IN_Q_OVERFLOW) {
+        g_warning("Inotify queue overflow - rescanning all repos");
+        for (guint x = 0; x < wr->repos->len; x++)
+            rescan_repo(wr, g_ptr_array_index(wr->repos, x));
+        return;
+    }
+
+    wdir = g_hash_table_lookup(wr->watches, GINT_TO_POINTER(ev->wd));
+    if (!wdir)
+        return;
+
+    if (ev->mask & IN_IGNORED) {
+        // Directory was removed (or unmounted)
+        g_hash_table_remove(wr->watches, GINT_TO_POINTER(ev->wd));
+        return;
+    }
+
+    if (!ev->len)
+        return;
+
+    repo = wdir->repo;
+    relpath = g_strconcat(wdir->dir, ev->name, NULL);
+
+    if (ev->mask & IN_ISDIR) {
+        if (ignored_dir(wdir->dir, ev->name))
+            return;
+
+        if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+            _cleanup_free_ gchar *subdir = g_strconcat(relpath, "/", NULL);
+            if (watch_dir(wr, repo, subdir) > 0)
+                repo_changed(repo);
+        } else if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+            _cleanup_free_ gchar *subdir = g_strconcat(relpath, "/", NULL);
+            if (unwatch_dir(wr, repo, subdir) > 0)
+                repo_changed(repo);
+        }
+        return;
+    }
+
+    if (!g_str_has_suffix(ev->name, ".rpm"))
+        return;
+
+    if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+        if (g_hash_table_remove(repo->packages, relpath)) {
+            g_debug("Removed: %s%s", repo->path, relpath);
+            repo_changed(repo);
+        }
+    } else {
+        _cleanup_free_ gchar *full_path = g_strconcat(repo->path, relpath, NULL);
+        struct stat st;
+
+        // A newly created regular file is still being written,
+        // wait for IN_CLOSE_WRITE. Links are complete right away.
+        if ((ev->mask & IN_CREATE)
+            && lstat(full_path, &st) == 0
+            && S_ISREG(st.st_mode) && st.st_nlink < 2)
+            return;
+
+        if (is_package(wr, full_path, ev->name)) {
+            g_debug("Changed: %s", full_path);
+            add_package(repo, relpath, TRUE);
+            repo_changed(repo);
+        }
+    }
+}
+
+static gboolean
+inotify_cb(G_GNUC_UNUSED GIOChannel *source,
+           G_GNUC_UNUSED GIOCondition condition,
+           gpointer data)
+{
+    Watchrepo *wr = data;
+    char buffer[INOTIFY_BUFFER_SIZE]
+        __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+
+    while ((len = read(wr->inotify_fd, buffer, sizeof(buffer))) > 0) {
+        for (char *ptr = buffer; ptr < buffer + len; ) {
+            struct inotify_event *ev = (struct inotify_event *) ptr;
+            handle_event(wr, ev);
+            ptr += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+
+    if (len == -1 && errno != EAGAIN && errno != EINTR) {
+        g_critical("Cannot read inotify events: %s", g_strerror(errno));
+        g_main_loop_quit(wr->loop);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+// Metadata generation
+
+
+/** Remove .repodata/ of interrupted runs and terminate.
+ */
+static void
+generating_sighandler(int sig)
+{
+    for (guint x = 0; watched_repos && x < watched_repos->len; x++) {
+        WatchedRepo *repo = g_ptr_array_index(watched_repos, x);
+        if (repo->lock_dir)
+            cr_remove_dir(repo->lock_dir, NULL);
+    }
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+typedef struct {
+    WatchedRepo *repo;
+    WatchrepoCmdOptions *options;
+} ReadPackageData;
+
+/** Thread pool function that loads a package and renders its XML chunks.
+ */
+static void
+read_package(gpointer data, gpointer user_data)
+{
+    WatchedPkg *wpkg = data;
+    ReadPackageData *rdata = user_data;
+    _cleanup_free_ gchar *full_path = NULL;
+    cr_Package *pkg;
+    struct stat st;
+    GError *tmp_err = NULL;
+
+    // A broken package is read again when its mtime or size changes
+    wpkg->broken = TRUE;
+
+    full_path = g_strconcat(rdata->repo->path, wpkg->relpath, NULL);
+    if (stat(full_path, &st) == -1) {
+        g_warning("Stat() on %s: %s", full_path, g_strerror(errno));
+        return;
+    }
+    wpkg->mtime = st.st_mtime;
+    wpkg->size = st.st_size;
+
+    pkg = cr_package_from_rpm(full_path, rdata->options->checksum_type,
+                              wpkg->relpath, NULL,
+                              rdata->options->changelog_limit, &st,
+                              CR_HDRR_NONE, &tmp_err);
+    if (!pkg) {
+        g_warning("Cannot read package: %s: %s", full_path, tmp_err->message);
+        g_error_free(tmp_err);
+        return;
+    }
+
+    wpkg->res = cr_xml_dump(pkg, &tmp_err);
+    if (tmp_err) {
+        g_critical("Cannot dump XML for %s (%s): %s",
+                   pkg->name, pkg->pkgId, tmp_err->message);
+        g_error_free(tmp_err);
+        xmlstruct_clear(&(wpkg->res));
+        cr_package_free(pkg);
+        return;
+    }
+
+    wpkg->broken = FALSE;
+    wpkg->pkgid = g_strdup(pkg->pkgId);
+    if (rdata->options->no_database)
+        cr_package_free(pkg);
+    else
+        wpkg->pkg = pkg;
+}
+
+/** Order of packages in the metadata (same as createrepo_c uses).
+ */
+static gint
+watchedpkg_cmp(gconstpointer a_p, gconstpointer b_p)
+{
+    const WatchedPkg *a = *((WatchedPkg **) a_p);
+    const WatchedPkg *b = *((WatchedPkg **) b_p);
+    int ret;
+
+    ret = g_strcmp0(cr_get_filename(a->relpath), cr_get_filename(b->relpath));
+    if (ret)
+        return ret;
+    return g_strcmp0(a->relpath, b->relpath);
+}
+
+/** Stat the packages of the run and load the new and changed ones.
+ * @param all   Packages of the run
+ * @return      Sorted array of loaded packages (owned by all)
+ */
+static GPtrArray *
+load_packages(WatchrepoCmdOptions *options, WatchedRepo *repo, GPtrArray *all)
+{
+    ReadPackageData rdata = { repo, options };
+    GPtrArray *pkgs = g_ptr_array_new();
+    GThreadPool *pool;
+    guint to_read = 0;
+
+    pool = g_thread_pool_new(read_package, &rdata, options->workers,
+                             FALSE, NULL);
+
+    for (guint x = 0; x < all->len; x++) {
+        WatchedPkg *wpkg = g_ptr_array_index(all, x);
+        _cleanup_free_ gchar *full_path = NULL;
+        struct stat st;
+
+        // Changes that were not reported (e.g. missed during a rescan)
+        full_path = g_strconcat(repo->path, wpkg->relpath, NULL);
+        if (stat(full_path, &st) == -1) {
+            watchedpkg_reset(wpkg);
+            continue;
+        }
+        if ((wpkg->res.primary || wpkg->broken)
+            && (st.st_mtime != wpkg->mtime || st.st_size != wpkg->size))
+            watchedpkg_reset(wpkg);
+
+        if (!wpkg->res.primary && !wpkg->broken) {
+            g_thread_pool_push(pool, wpkg, NULL);
+            to_read++;
+        }
+        g_ptr_array_add(pkgs, wpkg);
+    }
+
+    g_debug("%s: reading %u packages", repo->path, to_read);
+    g_thread_pool_free(pool, FALSE, TRUE);
+
+    // Broken packages are not part of the metadata
+    for (guint x = pkgs->len; x > 0; x--)
+        if (((WatchedPkg *) g_ptr_array_index(pkgs, x - 1))->broken)
+            g_ptr_array_remove_index_fast(pkgs, x - 1);
+
+    g_ptr_array_sort(pkgs, watchedpkg_cmp);
+
+    return pkgs;
+}
+
+/** Write one of primary, filelists and other from the rendered chunks
+ * into tmp_dir. The file is written in segments (see cr_xmlfile_set_segments())
+ * and segments which didn't change since the published metadata are
+ * copied from them as they are.
+ * @return      Filled record of the renamed file or NULL on error
+ */
+static cr_RepomdRecord *
+write_xml_file(WatchrepoCmdOptions *options,
+               WatchedRepo *repo,
+               GPtrArray *pkgs,
+               const char *tmp_dir,
+               const char *name,
+               cr_XmlFileType xml_type,
+               GError **err)
+{
+    _cleanup_free_ gchar *old_dir = NULL;
+    _cleanup_free_ gchar *old_index_path = NULL;
+    _cleanup_free_ gchar *index_path = NULL;
+    _cleanup_free_ gchar *xml_path = NULL;
+    cr_SegmentIndex *old_index = NULL;
+    cr_SegmentIndex *index = NULL;
+    cr_ContentStat *stat;
+    cr_RepomdRecord *rec = NULL;
+    cr_XmlFile *xml;
+    GError *tmp_err = NULL;
+
+    stat = cr_contentstat_new(options->checksum_type, err);
+    if (!stat)
+        return NULL;
+
+    old_dir = g_strconcat(repo->path, "repodata/", NULL);
+    old_index_path = g_strconcat(old_dir, name, CR_SEGMENTS_SUFFIX, NULL);
+    if (g_file_test(old_index_path, G_FILE_TEST_IS_REGULAR)) {
+        old_index = cr_segmentindex_load(old_index_path, old_dir, &tmp_err);
+        if (!old_index) {
+            g_debug("%s: Segments of %s cannot be reused: %s",
+                    repo->path, name, tmp_err->message);
+            g_clear_error(&tmp_err);
+        }
+    }
+    index = cr_segmentindex_new();
+
+    xml_path = g_strconcat(tmp_dir, name, ".xml.gz", NULL);
+    xml = cr_xmlfile_sopen(xml_path, xml_type, CR_CW_GZ_COMPRESSION, stat, err);
+    if (!xml)
+        goto cleanup;
+
+    if (cr_xmlfile_set_num_of_pkgs(xml, pkgs->len, err) != CRE_OK
+        || cr_xmlfile_set_segments(xml, 0, old_index, index, err) != CRE_OK)
+    {
+        cr_xmlfile_close(xml, NULL);
+        goto cleanup;
+    }
+
+    for (guint x = 0; x < pkgs->len; x++) {
+        WatchedPkg *wpkg = g_ptr_array_index(pkgs, x);
+        const char *chunk = xml_type == CR_XMLFILE_PRIMARY ? wpkg->res.primary
+                          : xml_type == CR_XMLFILE_FILELISTS ? wpkg->res.filelists
+                          : wpkg->res.other;
+        if (cr_xmlfile_add_pkg_chunk(xml, chunk, wpkg->pkgid, err) != CRE_OK) {
+            cr_xmlfile_close(xml, NULL);
+            goto cleanup;
+        }
+    }
+
+    if (cr_xmlfile_close(xml, err) != CRE_OK)
+        goto cleanup;
+
+    rec = cr_repomd_record_new(name, xml_path);
+    cr_repomd_record_load_contentstat(rec, stat);
+    if (cr_repomd_record_fill(rec, options->checksum_type, err) != CRE_OK
+        || cr_repomd_record_rename_file(rec, err) != CRE_OK)
+    {
+        cr_repomd_record_free(rec);
+        rec = NULL;
+        goto cleanup;
+    }
+
+    // The index is not part of repomd.xml, failure is not fatal
+    index_path = g_strconcat(tmp_dir, name, CR_SEGMENTS_SUFFIX, NULL);
+    if (cr_segmentindex_write(index, index_path, rec->location_real,
+                              &tmp_err) != CRE_OK)
+    {
+        g_warning("Cannot write segment index %s: %s",
+                  index_path, tmp_err->message);
+        g_clear_error(&tmp_err);
+    }
+
+cleanup:
+    cr_segmentindex_free(index);
+    cr_segmentindex_free(old_index);
+    cr_contentstat_free(stat, NULL);
+    return rec;
+}
+
+/** Apply removals and additions to one working database and write
+ * its compressed copy into tmp_dir.
+ * @return      Filled record of the renamed file or NULL on error
+ */
+static cr_RepomdRecord *
+update_database(WatchrepoCmdOptions *options,
+                const char *state_dir,
+                const char *tmp_dir,
+                const char *name,
+                cr_DatabaseType db_type,
+                GHashTable *removed,
+                GPtrArray *added,
+                cr_RepomdRecord *xml_rec,
+                GError **err)
+{
+    _cleanup_free_ gchar *db_path = NULL;
+    _cleanup_free_ gchar *bz2_path = NULL;
+    _cleanup_free_ gchar *rec_name = NULL;
+    cr_ContentStat *stat;
+    cr_RepomdRecord *rec;
+    cr_SqliteDb *db;
+    GHashTableIter iter;
+    gpointer key;
+
+    db_path = g_strconcat(state_dir, name, ".sqlite", NULL);
+    db = cr_db_open(db_path, db_type, err);
+    if (!db)
+        return NULL;
+
+    g_hash_table_iter_init(&iter, removed);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        if (cr_db_remove_pkg(db, key, err) != CRE_OK) {
+            cr_db_close(db, NULL);
+            return NULL;
+        }
+    }
+
+    for (guint x = 0; x < added->len; x++) {
+        WatchedPkg *wpkg = g_ptr_array_index(added, x);
+        if (cr_db_add_pkg(db, wpkg->pkg, err) != CRE_OK) {
+            cr_db_close(db, NULL);
+            return NULL;
+        }
+    }
+
+    if (cr_db_dbinfo_update(db, xml_rec->checksum, err) != CRE_OK) {
+        cr_db_close(db, NULL);
+        return NULL;
+    }
+
+    if (cr_db_close(db, err) != CRE_OK)
+        return NULL;
+
+    stat = cr_contentstat_new(options->checksum_type, err);
+    if (!stat)
+        return NULL;
+
+    bz2_path = g_strconcat(tmp_dir, name, ".sqlite.bz2", NULL);
+    if (cr_compress_file_with_stat(db_path, bz2_path, CR_CW_BZ2_COMPRESSION,
+                                   stat, err) != CRE_OK)
+    {
+        cr_contentstat_free(stat, NULL);
+        return NULL;
+    }
+
+    rec_name = g_strconcat(name, "_db", NULL);
+    rec = cr_repomd_record_new(rec_name, bz2_path);
+    cr_repomd_record_load_contentstat(rec, stat);
+    cr_contentstat_free(stat, NULL);
+    if (cr_repomd_record_fill(rec, options->checksum_type, err) != CRE_OK
+        || cr_repomd_record_rename_file(rec, err) != CRE_OK)
+    {
+        cr_repomd_record_free(rec);
+        return NULL;
+    }
+
+    return rec;
+}
+
+/** Bring the working databases of the repo up to date and write their
+ * compressed copies into tmp_dir. Only packages which were removed
+ * or changed since the previous run are removed from the databases
+ * and only new and changed packages are added.
+ * @param xml_recs      Records of primary, filelists and other
+ */
+static gboolean
+update_databases(WatchrepoCmdOptions *options,
+                 WatchedRepo *repo,
+                 GPtrArray *pkgs,
+                 const char *tmp_dir,
+                 cr_RepomdRecord **xml_recs,
+                 cr_Repomd *repomd,
+                 GError **err)
+{
+    static const char *names[] = { "primary", "filelists", "other" };
+    static const cr_DatabaseType types[] = { CR_DB_PRIMARY, CR_DB_FILELISTS,
+                                             CR_DB_OTHER };
+    _cleanup_free_ gchar *state_dir = NULL;
+    cr_RepomdRecord *recs[3] = { NULL, NULL, NULL };
+    GHashTable *current, *removed;
+    GPtrArray *added;
+    GHashTableIter iter;
+    gpointer key, value;
+    gboolean ret = FALSE;
+
+    state_dir = g_strconcat(repo->path, STATE_DIR_NAME, "/", NULL);
+    if (g_mkdir_with_parents(state_dir, 0755) == -1) {
+        g_set_error(err, CREATEREPO_C_ERROR, CRE_IO,
+                    "Cannot create %s: %s", state_dir, g_strerror(errno));
+        return FALSE;
+    }
+
+    // Databases of unknown content (e.g. left by a previous instance)
+    if (!g_hash_table_size(repo->db_pkgids)) {
+        for (int x = 0; x < 3; x++) {
+            _cleanup_free_ gchar *db_path = NULL;
+            db_path = g_strconcat(state_dir, names[x], ".sqlite", NULL);
+            g_unlink(db_path);
+        }
+    }
+
+    current = g_hash_table_new(g_str_hash, g_str_equal);
+    for (guint x = 0; x < pkgs->len; x++) {
+        WatchedPkg *wpkg = g_ptr_array_index(pkgs, x);
+        g_hash_table_insert(current, wpkg->relpath, wpkg);
+    }
+
+    // pkgIds of packages which are gone or changed
+    removed = g_hash_table_new(g_str_hash, g_str_equal);
+    g_hash_table_iter_init(&iter, repo->db_pkgids);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        WatchedPkg *wpkg = g_hash_table_lookup(current, key);
+        if (!wpkg || g_strcmp0(wpkg->pkgid, value))
+            g_hash_table_insert(removed, value, value);
+    }
+
+    // Removal by pkgId takes all copies of the package,
+    // copies which stay in the repo are added again
+    added = g_ptr_array_new();
+    for (guint x = 0; x < pkgs->len; x++) {
+        WatchedPkg *wpkg = g_ptr_array_index(pkgs, x);
+        const char *pkgid = g_hash_table_lookup(repo->db_pkgids, wpkg->relpath);
+        if (!pkgid || g_strcmp0(pkgid, wpkg->pkgid)
+            || g_hash_table_lookup(removed, pkgid))
+            g_ptr_array_add(added, wpkg);
+    }
+
+    g_debug("%s: databases: %u removed, %u added", repo->path,
+            g_hash_table_size(removed), added->len);
+
+    for (int x = 0; x < 3; x++) {
+        recs[x] = update_database(options, state_dir, tmp_dir, names[x],
+                                  types[x], removed, added, xml_recs[x], err);
+        if (!recs[x])
+            goto cleanup;
+    }
+
+    for (int x = 0; x < 3; x++)
+        cr_repomd_set_record(repomd, recs[x]);
+    ret = TRUE;
+
+cleanup:
+    g_hash_table_destroy(removed);
+    g_hash_table_destroy(current);
+    g_ptr_array_free(added, TRUE);
+
+    // The databases match the packages of this run now. After a failure
+    // their content is unknown, they are built from scratch next time.
+    g_hash_table_remove_all(repo->db_pkgids);
+    if (ret) {
+        for (guint x = 0; x < pkgs->len; x++) {
+            WatchedPkg *wpkg = g_ptr_array_index(pkgs, x);
+            g_hash_table_insert(repo->db_pkgids, g_strdup(wpkg->relpath),
+                                g_strdup(wpkg->pkgid));
+        }
+    } else {
+        for (int x = 0; x < 3; x++)
+            cr_repomd_record_free(recs[x]);
+    }
+
+    return ret;
+}
+
+/** Records of repomd.xml which are generated by the runs.
+ */
+static gboolean
+generated_record(const char *type)
+{
+    static const char *names[] = { "primary", "filelists", "other", NULL };
+
+    for (int x = 0; names[x]; x++) {
+        size_t len = strlen(names[x]);
+        if (!strncmp(type, names[x], len)
+            && (type[len] == '\0' || type[len] == '_'))
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+/** Take the records which are not generated by the runs (updateinfo,
+ * group, modules, prestodelta, ...) and the tags over from the current
+ * repomd.xml of the repo. Files of the records are copied into tmp_dir.
+ */
+static gboolean
+keep_other_records(WatchedRepo *repo,
+                   const char *tmp_dir,
+                   cr_Repomd *repomd,
+                   GError **err)
+{
+    _cleanup_free_ gchar *repomd_path = NULL;
+    cr_Repomd *old_repomd;
+
+    repomd_path = g_strconcat(repo->path, "repodata/repomd.xml", NULL);
+    if (!g_file_test(repomd_path, G_FILE_TEST_IS_REGULAR))
+        return TRUE;
+
+    old_repomd = cr_repomd_new();
+    if (cr_xml_parse_repomd(repomd_path, old_repomd, cr_warning_cb,
+                            "Repomd XML parser", err) != CRE_OK)
+    {
+        cr_repomd_free(old_repomd);
+        return FALSE;
+    }
+
+    for (GSList *elem = old_repomd->records; elem; elem = g_slist_next(elem)) {
+        cr_RepomdRecord *rec = elem->data;
+        const char *href = rec->location_href;
+
+        if (!rec->type || generated_record(rec->type))
+            continue;
+
+        // Files of the repodata/ dir move with it, others stay where they are
+        if (href && !rec->location_base
+            && g_str_has_prefix(href, "repodata/")
+            && !strchr(href + 9, '/'))
+        {
+            _cleanup_free_ gchar *src = g_strconcat(repo->path, href, NULL);
+            _cleanup_free_ gchar *dst = g_strconcat(tmp_dir, href + 9, NULL);
+
+            if (!g_file_test(src, G_FILE_TEST_IS_REGULAR)) {
+                g_warning("%s: File %s of the %s record is missing, "
+                          "the record is dropped", repo->path, href, rec->type);
+                continue;
+            }
+
+            if (!cr_better_copy_file(src, dst, err)) {
+                cr_repomd_free(old_repomd);
+                return FALSE;
+            }
+        }
+
+        g_debug("%s: Keeping the %s record", repo->path, rec->type);
+        cr_repomd_set_record(repomd, cr_repomd_record_copy(rec));
+    }
+
+    for (GSList *elem = old_repomd->repo_tags; elem; elem = g_slist_next(elem))
+        cr_repomd_add_repo_tag(repomd, elem->data);
+    for (GSList *elem = old_repomd->content_tags; elem; elem = g_slist_next(elem))
+        cr_repomd_add_content_tag(repomd, elem->data);
+    for (GSList *elem = old_repomd->distro_tags; elem; elem = g_slist_next(elem)) {
+        cr_DistroTag *tag = elem->data;
+        cr_repomd_add_distro_tag(repomd, tag->cpeid, tag->val);
+    }
+
+    cr_repomd_free(old_repomd);
+    return TRUE;
+}
+
+/** Regenerate and publish metadata of the repo from the packages
+ * of the run. Only new and changed packages are read.
+ */
+static gboolean
+generate_metadata(WatchrepoCmdOptions *options,
+                  WatchedRepo *repo,
+                  GPtrArray *all,
+                  GError **err)
+{
+    _cleanup_free_ gchar *lock_dir = NULL;
+    _cleanup_free_ gchar *tmp_dir = NULL;
+    _cleanup_free_ gchar *out_dir = NULL;
+    _cleanup_free_ gchar *old_dir = NULL;
+    _cleanup_free_ gchar *old_name = NULL;
+    _cleanup_free_ gchar *repomd_path = NULL;
+    _cleanup_free_ gchar *repomd_xml = NULL;
+    static const char *xml_names[] = { "primary", "filelists", "other" };
+    static const cr_XmlFileType xml_types[] = { CR_XMLFILE_PRIMARY,
+                                                CR_XMLFILE_FILELISTS,
+                                                CR_XMLFILE_OTHER };
+    cr_RepomdRecord *xml_recs[3] = { NULL, NULL, NULL };
+    cr_Repomd *repomd = NULL;
+    GPtrArray *pkgs = NULL;
+    gboolean old_renamed = FALSE;
+    gboolean ret = FALSE;
+
+    assert(!err || *err == NULL);
+
+    if (!cr_lock_repo(repo->path, FALSE, &lock_dir, &tmp_dir, err))
+        return FALSE;
+    repo->lock_dir = lock_dir;
+
+    pkgs = load_packages(options, repo, all);
+    g_message("%s: writing metadata (%u packages)", repo->path, pkgs->len);
+
+    repomd = cr_repomd_new();
+    for (int x = 0; x < 3; x++) {
+        xml_recs[x] = write_xml_file(options, repo, pkgs, tmp_dir,
+                                     xml_names[x], xml_types[x], err);
+        if (!xml_recs[x])
+            goto cleanup;
+        cr_repomd_set_record(repomd, xml_recs[x]);
+    }
+
+    if (!options->no_database
+        && !update_databases(options, repo, pkgs, tmp_dir, xml_recs, repomd, err))
+        goto cleanup;
+
+    if (!keep_other_records(repo, tmp_dir, repomd, err))
+        goto cleanup;
+
+    cr_repomd_sort_records(repomd);
+    repomd_xml = cr_xml_dump_repomd(repomd, err);
+    if (!repomd_xml)
+        goto cleanup;
+
+    repomd_path = g_strconcat(tmp_dir, "repomd.xml", NULL);
+    if (!g_file_set_contents(repomd_path, repomd_xml, -1, err))
+        goto cleanup;
+
+    // Publish the same way as createrepo_c does
+    out_dir = g_strconcat(repo->path, "repodata/", NULL);
+    if (!cr_old_metadata_retention(out_dir, tmp_dir, CR_RETENTION_DEFAULT, 0, err))
+        goto cleanup;
+
+    old_name = cr_append_pid_and_datetime("repodata.old.", NULL);
+    old_dir = g_strconcat(repo->path, old_name, NULL);
+    if (g_rename(out_dir, old_dir) == 0)
+        old_renamed = TRUE;
+
+    if (g_rename(tmp_dir, out_dir) == -1) {
+        g_set_error(err, CREATEREPO_C_ERROR, CRE_IO,
+                    "Cannot rename %s -> %s: %s", tmp_dir, out_dir,
+                    g_strerror(errno));
+        if (old_renamed)
+            g_rename(old_dir, out_dir);
+        goto cleanup;
+    }
+    repo->lock_dir = NULL;
+
+    if (old_renamed) {
+        GError *tmp_err = NULL;
+        if (!cr_rm(old_dir, CR_RM_RECURSIVE, NULL, &tmp_err)) {
+            g_warning("Cannot remove %s: %s", old_dir, tmp_err->message);
+            g_error_free(tmp_err);
+        }
+    }
+
+    ret = TRUE;
+
+cleanup:
+    if (repo->lock_dir) {
+        cr_remove_dir(lock_dir, NULL);
+        repo->lock_dir = NULL;
+    }
+    cr_repomd_free(repomd);
+    g_ptr_array_free(pkgs, TRUE);
+
+    return ret;
+}
+
+static void
+reply_clients(GSList *clients, const char *reply)
+{
+    for (GSList *elem = clients; elem; elem = g_slist_next(elem)) {
+        GIOChannel *channel = elem->data;
+        g_io_channel_write_chars(channel, reply, -1, NULL, NULL);
+        g_io_channel_shutdown(channel, TRUE, NULL);
+        g_io_channel_unref(channel);
+    }
+    g_slist_free(clients);
+}
+
+/** Take the result of a finished run over in the main loop.
+ */
+static gboolean
+finish_run(gpointer data)
+{
+    MetadataRun *run = data;
+    WatchedRepo *repo = run->repo;
+    gdouble seconds = (g_get_monotonic_time() - run->started) / 1000000.0;
+
+    // Packages which didn't change during the run keep the loaded content
+    for (guint x = 0; x < run->pkgs->len; x++) {
+        WatchedPkg *rpkg = g_ptr_array_index(run->pkgs, x);
+        WatchedPkg *wpkg = g_hash_table_lookup(repo->packages, rpkg->relpath);
+        if (wpkg && wpkg->serial == rpkg->serial)
+            watchedpkg_move_content(wpkg, rpkg);
+    }
+
+    if (run->success) {
+        g_message("%s: metadata published in %.2f s", repo->path, seconds);
+        reply_clients(run->waiting, "OK\n");
+    } else {
+        _cleanup_free_ gchar *reply = NULL;
+
+        // Try again after the next change
+        repo->failures++;
+        g_critical("%s: metadata generation failed after %.2f s: %s",
+                   repo->path, seconds, run->err->message);
+        reply = g_strdup_printf("FAILED %s\n", run->err->message);
+        reply_clients(run->waiting, reply);
+        g_error_free(run->err);
+    }
+
+    repo->runs++;
+    repo->running = FALSE;
+
+    g_ptr_array_free(run->pkgs, TRUE);
+    g_free(run);
+
+    return FALSE;
+}
+
+/** Thread pool function that runs generate_metadata() and passes
+ * the result to the main loop.
+ */
+static void
+run_thread(gpointer data, G_GNUC_UNUSED gpointer user_data)
+{
+    MetadataRun *run = data;
+
+    run->success = generate_metadata(run->wr->options, run->repo, run->pkgs,
+                                     &(run->err));
+    g_idle_add(finish_run, run);
+}
+
+/** Regenerate metadata of the repo in a thread. The loaded content
+ * of the packages is moved into the run and moved back by finish_run().
+ */
+static void
+start_run(Watchrepo *wr, WatchedRepo *repo)
+{
+    MetadataRun *run;
+    GHashTableIter iter;
+    gpointer value;
+
+    assert(!repo->running);
+
+    run = g_new0(MetadataRun, 1);
+    run->wr = wr;
+    run->repo = repo;
+    run->started = g_get_monotonic_time();
+    run->pkgs = g_ptr_array_new_with_free_func((GDestroyNotify) watchedpkg_free);
+
+    g_hash_table_iter_init(&iter, repo->packages);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        WatchedPkg *wpkg = value;
+        WatchedPkg *rpkg = g_new0(WatchedPkg, 1);
+        rpkg->relpath = g_strdup(wpkg->relpath);
+        rpkg->serial = wpkg->serial;
+        watchedpkg_move_content(rpkg, wpkg);
+        g_ptr_array_add(run->pkgs, rpkg);
+    }
+
+    // Changes and requests which come during the run are handled
+    // by the next one
+    run->waiting = repo->waiting;
+    repo->waiting = NULL;
+    repo->dirty = FALSE;
+    repo->forced = FALSE;
+    repo->running = TRUE;
+
+    g_message("%s: regenerating metadata", repo->path);
+    g_thread_pool_push(wr->runs, run, NULL);
+}
+
+/** Regenerate metadata of repos whose changes have settled.
+ */
+static gboolean
+timer_cb(gpointer data)
+{
+    Watchrepo *wr = data;
+    gint64 now = g_get_monotonic_time();
+    gint64 delay = (gint64) wr->options->delay * 1000000;
+    gint64 max_delay = (gint64) wr->options->max_delay * 1000000;
+
+    for (guint x = 0; x < wr->repos->len; x++) {
+        WatchedRepo *repo = g_ptr_array_index(wr->repos, x);
+
+        if (!repo->dirty || repo->running)
+            continue;
+
+        if (repo->forced
+            || now - repo->last_change >= delay
+            || now - repo->first_change >= max_delay)
+            start_run(wr, repo);
+    }
+
+    return TRUE;
+}
+
+
+// Control socket
+
+
+/** Absolute normalized path of the directory (with trailing '/').
+ */
+static gchar *
+repo_path(const char *path)
+{
+    char *real = realpath(path, NULL);
+    gchar *normalized = cr_normalize_dir_path(real ? real : path);
+    free(real);
+    return normalized;
+}
+
+static WatchedRepo *
+find_repo(Watchrepo *wr, const char *path)
+{
+    _cleanup_free_ gchar *normalized = repo_path(path);
+
+    for (guint x = 0; x < wr->repos->len; x++) {
+        WatchedRepo *repo = g_ptr_array_index(wr->repos, x);
+        if (!g_strcmp0(repo->path, normalized))
+            return repo;
+    }
+
+    return NULL;
+}
+
+static gboolean
+client_cb(GIOChannel *channel,
+          G_GNUC_UNUSED GIOCondition condition,
+          gpointer data)
+{
+    Watchrepo *wr = data;
+    gchar *line = NULL;
+    GIOStatus status;
+
+    status = g_io_channel_read_line(channel, &line, NULL, NULL, NULL);
+    if (status == G_IO_STATUS_AGAIN)
+        return TRUE;
+
+    if (status != G_IO_STATUS_NORMAL || !line) {
+        g_io_channel_shutdown(channel, FALSE, NULL);
+        g_io_channel_unref(channel);
+        g_free(line);
+        return FALSE;
+    }
+
+    g_strstrip(line);
+
+    if (g_str_has_prefix(line, "update ")) {
+        WatchedRepo *repo = find_repo(wr, g_strstrip(line + 7));
+        if (repo) {
+            g_debug("Update of %s requested", repo->path);
+            rescan_repo(wr, repo);
+            repo->forced = TRUE;
+            // The channel is replied and released by finish_run()
+            repo->waiting = g_slist_prepend(repo->waiting, channel);
+            g_free(line);
+            return FALSE;
+        }
+        g_io_channel_write_chars(channel, "ERROR Unknown repo\n", -1, NULL, NULL);
+    } else if (!g_strcmp0(line, "status")) {
+        for (guint x = 0; x < wr->repos->len; x++) {
+            WatchedRepo *repo = g_ptr_array_index(wr->repos, x);
+            GHashTableIter iter;
+            gpointer value;
+            guint loaded = 0;
+
+            g_hash_table_iter_init(&iter, repo->packages);
+            while (g_hash_table_iter_next(&iter, NULL, &value))
+                if (((WatchedPkg *) value)->res.primary)
+                    loaded++;
+
+            _cleanup_free_ gchar *msg = g_strdup_printf(
+                    "%s packages=%u loaded=%u dirty=%d running=%d runs=%u "
+                    "failures=%u\n",
+                    repo->path, g_hash_table_size(repo->packages), loaded,
+                    repo->dirty, repo->running, repo->runs, repo->failures);
+            g_io_channel_write_chars(channel, msg, -1, NULL, NULL);
+        }
+    } else {
+        g_io_channel_write_chars(channel, "ERROR Unknown request\n", -1, NULL, NULL);
+    }
+
+    g_free(line);
+    g_io_channel_shutdown(channel, TRUE, NULL);
+    g_io_channel_unref(channel);
+    return FALSE;
+}
+
+static gboolean
+accept_cb(G_GNUC_UNUSED GIOChannel *source,
+          G_GNUC_UNUSED GIOCondition condition,
+          gpointer data)
+{
+    int listen_fd = g_io_channel_unix_get_fd(source);
+    GIOChannel *channel;
+    int fd;
+
+    fd = accept(listen_fd, NULL, NULL);
+    if (fd == -1) {
+        g_warning("Cannot accept a connection: %s", g_strerror(errno));
+        return TRUE;
+    }
+
+    channel = g_io_channel_unix_new(fd);
+    g_io_channel_set_close_on_unref(channel, TRUE);
+    g_io_add_watch(channel, G_IO_IN | G_IO_HUP | G_IO_ERR, client_cb, data);
+
+    return TRUE;
+}
+
+static int
+open_socket(const char *path, GError **err)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        g_set_error(err, CREATEREPO_C_ERROR, CRE_BADARG,
+                    "Socket path %s is too long", path);
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+        g_set_error(err, CREATEREPO_C_ERROR, CRE_IO,
+                    "Cannot create socket: %s", g_strerror(errno));
+        return -1;
+    }
+
+    // Remove a socket left by a previous instance
+    g_unlink(path);
+
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1
+        || chmod(path, 0600) == -1
+        || listen(fd, 16) == -1)
+    {
+        g_set_error(err, CREATEREPO_C_ERROR, CRE_IO,
+                    "Cannot listen on %s: %s", path, g_strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+
+int
+main(int argc, char **argv)
+{
+    _cleanup_watchrepocmdoptions_free_ WatchrepoCmdOptions *options = NULL;
+    _cleanup_error_free_ GError *tmp_err = NULL;
+    Watchrepo wr;
+    GIOChannel *inotify_channel;
+    GIOChannel *socket_channel = NULL;
+
+    // Parse arguments
+    options = watchrepocmdoptions_new();
+    if (!parse_watchrepo_arguments(&argc, &argv, options, &tmp_err)) {
+        g_printerr("%s\n", tmp_err->message);
+        exit(EXIT_FAILURE);
+    }
+
+    // Set logging
+    cr_setup_logging(options->quiet, options->verbose);
+
+    // Print version if required
+    if (options->version) {
+        printf("Version: %s\n", cr_version_string_with_features());
+        exit(EXIT_SUCCESS);
+    }
+
+    // Check arguments
+    if (!check_arguments(options, &tmp_err)) {
+        g_printerr("%s\n", tmp_err->message);
+        exit(EXIT_FAILURE);
+    }
+
+    if (argc < 2) {
+        g_printerr("Must specify at least one repo directory to watch\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Emit debug message with version
+    g_debug("Version: %s", cr_version_string_with_features());
+
+    cr_package_parser_init();
+    cr_xml_dump_init();
+
+    // Do not leave .repodata/ behind when killed during a run
+    signal(SIGHUP, generating_sighandler);
+    signal(SIGINT, generating_sighandler);
+    signal(SIGTERM, generating_sighandler);
+
+    memset(&wr, 0, sizeof(wr));
+    wr.options = options;
+    wr.repos = g_ptr_array_new();
+    wr.watches = g_hash_table_new(g_direct_hash, g_direct_equal);
+    wr.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (wr.inotify_fd == -1) {
+        g_printerr("Cannot initialize inotify: %s\n", g_strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    // Initial walk - every repo is regenerated right away
+    for (int x = 1; x < argc; x++) {
+        WatchedRepo *repo;
+        gchar *path = repo_path(argv[x]);
+
+        if (!g_file_test(path, G_FILE_TEST_IS_DIR)) {
+            g_printerr("Directory %s must exist\n", path);
+            exit(EXIT_FAILURE);
+        }
+
+        repo = g_new0(WatchedRepo, 1);
+        repo->path = path;
+        repo->packages = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                               (GDestroyNotify) watchedpkg_free);
+        repo->db_pkgids = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                g_free, g_free);
+        g_ptr_array_add(wr.repos, repo);
+
+        rescan_repo(&wr, repo);
+        load_current_metadata(&wr, repo);
+        repo->forced = TRUE;
+    }
+    watched_repos = wr.repos;
+
+    // Repos are regenerated in parallel, each by one thread at a time
+    wr.runs = g_thread_pool_new(run_thread, NULL, wr.repos->len, FALSE, NULL);
+
+    // Control socket
+    if (options->socket_path) {
+        int fd = open_socket(options->socket_path, &tmp_err);
+        if (fd == -1) {
+            g_printerr("%s\n", tmp_err->message);
+            exit(EXIT_FAILURE);
+        }
+        socket_channel = g_io_channel_unix_new(fd);
+        g_io_channel_set_close_on_unref(socket_channel, TRUE);
+        g_io_add_watch(socket_channel, G_IO_IN, accept_cb, &wr);
+    }
+
+    inotify_channel = g_io_channel_unix_new(wr.inotify_fd);
+    g_io_add_watch(inotify_channel, G_IO_IN, inotify_cb, &wr);
+    g_timeout_add_seconds(1, timer_cb, &wr);
+
+    wr.loop = g_main_loop_new(NULL, FALSE);
+    g_main_loop_run(wr.loop);
+
+    // Only a fatal error gets here
+    g_main_loop_unref(wr.loop);
+    g_io_channel_unref(inotify_channel);
+    if (socket_channel) {
+        g_io_channel_unref(socket_channel);
+        g_unlink(options->socket_path);
+    }
+
+    exit(EXIT_FAILURE);
+}
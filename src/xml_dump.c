@@ -111,6 +111,91 @@ cr_xmlNewTextChild(xmlNodePtr parent,
     return child;
 }
 
+/** Return content which is valid UTF-8 (and without control chars
+ * if text is TRUE). *tmp is set to a malloced buffer which must be
+ * freed if a conversion was needed.
+ */
+static const char *
+cr_xml_sanitize(const char *orig_content, gboolean text, char **tmp)
+{
+    *tmp = NULL;
+
+    if (!orig_content)
+        return "";
+
+    if (xmlCheckUTF8(BAD_CAST orig_content)
+        && (!text || !cr_hascontrollchars(BAD_CAST orig_content)))
+        return orig_content;
+
+    *tmp = malloc(strlen(orig_content)*2 + 1);
+    cr_latin1_to_utf8(BAD_CAST orig_content, BAD_CAST *tmp);
+    return *tmp;
+}
+
+void
+cr_xml_append_text(GString *out, const char *orig_content)
+{
+    char *tmp;
+    const char *content = cr_xml_sanitize(orig_content, TRUE, &tmp);
+    const char *start = content;
+
+    for (const char *c = content; *c; c++) {
+        const char *entity;
+        switch (*c) {
+            case '<':  entity = "&lt;";     break;
+            case '>':  entity = "&gt;";     break;
+            case '&':  entity = "&amp;";    break;
+            case '\r': entity = "&#13;";    break;
+            default:   continue;
+        }
+        g_string_append_len(out, start, c - start);
+        g_string_append(out, entity);
+        start = c + 1;
+    }
+    g_string_append(out, start);
+
+    free(tmp);
+}
+
+void
+cr_xml_append_prop(GString *out, const char *name, const char *orig_content)
+{
+    char *tmp;
+    const char *content;
+    const char *start;
+
+    if (!orig_content)
+        return;
+
+    content = cr_xml_sanitize(orig_content, FALSE, &tmp);
+
+    g_string_append_c(out, ' ');
+    g_string_append(out, name);
+    g_string_append(out, "=\"");
+
+    start = content;
+    for (const char *c = content; *c; c++) {
+        const char *entity;
+        switch (*c) {
+            case '<':  entity = "&lt;";     break;
+            case '>':  entity = "&gt;";     break;
+            case '&':  entity = "&amp;";    break;
+            case '"':  entity = "&quot;";   break;
+            case '\t': entity = "&#9;";     break;
+            case '\n': entity = "&#10;";    break;
+            case '\r': entity = "&#13;";    break;
+            default:   continue;
+        }
+        g_string_append_len(out, start, c - start);
+        g_string_append(out, entity);
+        start = c + 1;
+    }
+    g_string_append(out, start);
+    g_string_append_c(out, '"');
+
+    free(tmp);
+}
+
 xmlAttrPtr
 cr_xmlNewProp(xmlNodePtr node, const xmlChar *name, const xmlChar *orig_content)
 {
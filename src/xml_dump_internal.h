@@ -92,6 +92,16 @@ cr_xmlNewProp_c(xmlNodePtr node,
     return cr_xmlNewProp(node, name, orig_content);
 }
 
+/** Append escaped text content. NULL is handled as an empty string and
+ * non UTF-8 content the same way as in cr_xmlNewTextChild().
+ * It is a faster alternative to a libxml tree for streamed output.
+ */
+void cr_xml_append_text(GString *out, const char *content);
+
+/** Append an attribute ( name="escaped value") only if its value is not
+ * NULL. Non UTF-8 value is handled the same way as in cr_xmlNewProp().
+ */
+void cr_xml_append_prop(GString *out, const char *name, const char *value);
 
 #ifdef __cplusplus
 }
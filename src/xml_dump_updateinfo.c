@@ -21,9 +21,6 @@
 #include <assert.h>
 #include <stdio.h>
 #include <string.h>
-#include <libxml/encoding.h>
-#include <libxml/xmlwriter.h>
-#include <libxml/xmlsave.h>
 #include "error.h"
 #include "updateinfo.h"
 #include "xml_dump.h"
@@ -32,148 +29,194 @@
 #define ERR_DOMAIN      CREATEREPO_C_ERROR
 #define INDENT          2
 
-void
-cr_xml_dump_updatecollectionpackages(xmlNodePtr collection, GSList *packages)
+/*
+ * The updateinfo is written directly into a string (no libxml tree is
+ * built), one <update> element at a time. The output is formatted
+ * the same way as a libxml dump of the tree would be.
+ */
+
+static void
+cr_xml_indent(GString *out, int level)
 {
-    for (GSList *elem = packages; elem; elem = g_slist_next(elem)) {
-        cr_UpdateCollectionPackage *pkg = elem->data;
-        xmlNodePtr package;
-
-        package = xmlNewChild(collection, NULL, BAD_CAST "package", NULL);
-        cr_xmlNewProp_c(package, BAD_CAST "name", BAD_CAST pkg->name);
-        cr_xmlNewProp_c(package, BAD_CAST "version", BAD_CAST pkg->version);
-        cr_xmlNewProp_c(package, BAD_CAST "release", BAD_CAST pkg->release);
-        cr_xmlNewProp_c(package, BAD_CAST "epoch", BAD_CAST pkg->epoch);
-        cr_xmlNewProp_c(package, BAD_CAST "arch", BAD_CAST pkg->arch);
-        cr_xmlNewProp_c(package, BAD_CAST "src", BAD_CAST pkg->src);
-        cr_xmlNewTextChild_c(package, NULL, BAD_CAST "filename",
-                             BAD_CAST pkg->filename);
-
-        if (pkg->sum) {
-            xmlNodePtr sum;
-            sum = cr_xmlNewTextChild_c(package,
-                                       NULL,
-                                       BAD_CAST "sum",
-                                       BAD_CAST pkg->sum);
-            cr_xmlNewProp_c(sum,
-                            BAD_CAST "type",
-                            BAD_CAST cr_checksum_name_str(pkg->sum_type));
-        }
+    for (int x = 0; x < level * INDENT; x++)
+        g_string_append_c(out, ' ');
+}
+
+/** Append <name>content</name> if the content is not NULL.
+ */
+static void
+cr_xml_append_text_child(GString *out,
+                         int level,
+                         const char *name,
+                         const char *content)
+{
+    if (!content)
+        return;
+
+    cr_xml_indent(out, level);
+    g_string_append_printf(out, "<%s>", name);
+    cr_xml_append_text(out, content);
+    g_string_append_printf(out, "</%s>\n", name);
+}
 
-        if (pkg->reboot_suggested)
-            xmlNewChild(package, NULL, BAD_CAST "reboot_suggested", NULL);
+static void
+cr_xml_dump_updatecollectionpackage(GString *out,
+                                    int level,
+                                    cr_UpdateCollectionPackage *pkg)
+{
+    cr_xml_indent(out, level);
+    g_string_append(out, "<package");
+    cr_xml_append_prop(out, "name", pkg->name);
+    cr_xml_append_prop(out, "version", pkg->version);
+    cr_xml_append_prop(out, "release", pkg->release);
+    cr_xml_append_prop(out, "epoch", pkg->epoch);
+    cr_xml_append_prop(out, "arch", pkg->arch);
+    cr_xml_append_prop(out, "src", pkg->src);
+
+    if (!pkg->filename && !pkg->sum && !pkg->reboot_suggested) {
+        g_string_append(out, "/>\n");
+        return;
     }
+
+    g_string_append(out, ">\n");
+
+    cr_xml_append_text_child(out, level+1, "filename", pkg->filename);
+
+    if (pkg->sum) {
+        cr_xml_indent(out, level+1);
+        g_string_append(out, "<sum");
+        cr_xml_append_prop(out, "type", cr_checksum_name_str(pkg->sum_type));
+        g_string_append_c(out, '>');
+        cr_xml_append_text(out, pkg->sum);
+        g_string_append(out, "</sum>\n");
+    }
+
+    if (pkg->reboot_suggested) {
+        cr_xml_indent(out, level+1);
+        g_string_append(out, "<reboot_suggested/>\n");
+    }
+
+    cr_xml_indent(out, level);
+    g_string_append(out, "</package>\n");
 }
 
-void
-cr_xml_dump_updateinforecord_pkglist(xmlNodePtr update, GSList *collections)
+static void
+cr_xml_dump_updaterecord_pkglist(GString *out, int level, GSList *collections)
 {
-    xmlNodePtr pkglist;
+    cr_xml_indent(out, level);
 
-    pkglist = xmlNewChild(update, NULL, BAD_CAST "pkglist", NULL);
+    if (!collections) {
+        g_string_append(out, "<pkglist/>\n");
+        return;
+    }
+
+    g_string_append(out, "<pkglist>\n");
 
     for (GSList *elem = collections; elem; elem = g_slist_next(elem)) {
         cr_UpdateCollection *col = elem->data;
-        xmlNodePtr collection;
 
-        collection = xmlNewChild(pkglist, NULL, BAD_CAST "collection", NULL);
-        cr_xmlNewProp_c(collection, BAD_CAST "short", BAD_CAST col->shortname);
-        cr_xmlNewTextChild_c(collection,
-                             NULL,
-                             BAD_CAST "name",
-                             BAD_CAST col->name);
+        cr_xml_indent(out, level+1);
+        g_string_append(out, "<collection");
+        cr_xml_append_prop(out, "short", col->shortname);
+
+        if (!col->name && !col->packages) {
+            g_string_append(out, "/>\n");
+            continue;
+        }
 
-        cr_xml_dump_updatecollectionpackages(collection, col->packages);
+        g_string_append(out, ">\n");
+        cr_xml_append_text_child(out, level+2, "name", col->name);
+        for (GSList *e = col->packages; e; e = g_slist_next(e))
+            cr_xml_dump_updatecollectionpackage(out, level+2, e->data);
+
+        cr_xml_indent(out, level+1);
+        g_string_append(out, "</collection>\n");
     }
+
+    cr_xml_indent(out, level);
+    g_string_append(out, "</pkglist>\n");
 }
 
-void
-cr_xml_dump_updateinforecord_references(xmlNodePtr update, GSList *refs)
+static void
+cr_xml_dump_updaterecord_references(GString *out, int level, GSList *refs)
 {
-    xmlNodePtr references;
-    references = xmlNewChild(update, NULL, BAD_CAST "references", NULL);
+    cr_xml_indent(out, level);
+
+    if (!refs) {
+        g_string_append(out, "<references/>\n");
+        return;
+    }
+
+    g_string_append(out, "<references>\n");
 
     for (GSList *elem = refs; elem; elem = g_slist_next(elem)) {
         cr_UpdateReference *ref = elem->data;
-        xmlNodePtr reference;
 
-        reference = xmlNewChild(references, NULL, BAD_CAST "reference", NULL);
-        cr_xmlNewProp_c(reference, BAD_CAST "href", BAD_CAST ref->href);
-        cr_xmlNewProp_c(reference, BAD_CAST "id", BAD_CAST ref->id);
-        cr_xmlNewProp_c(reference, BAD_CAST "type", BAD_CAST ref->type);
-        cr_xmlNewProp_c(reference, BAD_CAST "title", BAD_CAST ref->title);
+        cr_xml_indent(out, level+1);
+        g_string_append(out, "<reference");
+        cr_xml_append_prop(out, "href", ref->href);
+        cr_xml_append_prop(out, "id", ref->id);
+        cr_xml_append_prop(out, "type", ref->type);
+        cr_xml_append_prop(out, "title", ref->title);
+        g_string_append(out, "/>\n");
     }
+
+    cr_xml_indent(out, level);
+    g_string_append(out, "</references>\n");
 }
 
-xmlNodePtr
-cr_xml_dump_updateinforecord_internal(xmlNodePtr root, cr_UpdateRecord *rec)
+/** Append the <update> element.
+ */
+static void
+cr_xml_dump_updaterecord_internal(GString *out, int level, cr_UpdateRecord *rec)
 {
-    xmlNodePtr update, node;
+    cr_xml_indent(out, level);
+    g_string_append(out, "<update");
+    cr_xml_append_prop(out, "from", rec->from);
+    cr_xml_append_prop(out, "status", rec->status);
+    cr_xml_append_prop(out, "type", rec->type);
+    cr_xml_append_prop(out, "version", rec->version);
+    g_string_append(out, ">\n");
 
-    if (!rec)
-        return NULL;
-
-    // Update element
-    if (!root)
-        update = xmlNewNode(NULL, BAD_CAST "update");
-    else
-        update = xmlNewChild(root, NULL, BAD_CAST "update", NULL);
-
-    cr_xmlNewProp_c(update, BAD_CAST "from", BAD_CAST rec->from);
-    cr_xmlNewProp_c(update, BAD_CAST "status", BAD_CAST rec->status);
-    cr_xmlNewProp_c(update, BAD_CAST "type", BAD_CAST rec->type);
-    cr_xmlNewProp_c(update, BAD_CAST "version", BAD_CAST rec->version);
-
-    cr_xmlNewTextChild_c(update, NULL, BAD_CAST "id", BAD_CAST rec->id);
-    cr_xmlNewTextChild_c(update, NULL, BAD_CAST "title", BAD_CAST rec->title);
+    cr_xml_append_text_child(out, level+1, "id", rec->id);
+    cr_xml_append_text_child(out, level+1, "title", rec->title);
 
     if (rec->issued_date) {
-        node = xmlNewChild(update, NULL, BAD_CAST "issued", NULL);
-        cr_xmlNewProp(node, BAD_CAST "date", BAD_CAST rec->issued_date);
+        cr_xml_indent(out, level+1);
+        g_string_append(out, "<issued");
+        cr_xml_append_prop(out, "date", rec->issued_date);
+        g_string_append(out, "/>\n");
     }
 
     if (rec->updated_date) {
-        node = xmlNewChild(update, NULL, BAD_CAST "updated", NULL);
-        cr_xmlNewProp(node, BAD_CAST "date", BAD_CAST rec->updated_date);
+        cr_xml_indent(out, level+1);
+        g_string_append(out, "<updated");
+        cr_xml_append_prop(out, "date", rec->updated_date);
+        g_string_append(out, "/>\n");
     }
 
-    cr_xmlNewTextChild_c(update, NULL, BAD_CAST "rights", BAD_CAST rec->rights);
-    cr_xmlNewTextChild_c(update, NULL, BAD_CAST "release", BAD_CAST rec->release);
-    cr_xmlNewTextChild_c(update, NULL, BAD_CAST "pushcount", BAD_CAST rec->pushcount);
-    cr_xmlNewTextChild_c(update, NULL, BAD_CAST "severity", BAD_CAST rec->severity);
-    cr_xmlNewTextChild_c(update, NULL, BAD_CAST "summary", BAD_CAST rec->summary);
-    cr_xmlNewTextChild_c(update, NULL, BAD_CAST "description", BAD_CAST rec->description);
-    cr_xmlNewTextChild_c(update, NULL, BAD_CAST "solution", BAD_CAST rec->solution);
+    cr_xml_append_text_child(out, level+1, "rights", rec->rights);
+    cr_xml_append_text_child(out, level+1, "release", rec->release);
+    cr_xml_append_text_child(out, level+1, "pushcount", rec->pushcount);
+    cr_xml_append_text_child(out, level+1, "severity", rec->severity);
+    cr_xml_append_text_child(out, level+1, "summary", rec->summary);
+    cr_xml_append_text_child(out, level+1, "description", rec->description);
+    cr_xml_append_text_child(out, level+1, "solution", rec->solution);
 
     // References
-    cr_xml_dump_updateinforecord_references(update, rec->references);
+    cr_xml_dump_updaterecord_references(out, level+1, rec->references);
 
     // Pkglist
-    cr_xml_dump_updateinforecord_pkglist(update, rec->collections);
-
-    return update;
-}
+    cr_xml_dump_updaterecord_pkglist(out, level+1, rec->collections);
 
-
-void
-cr_xml_dump_updateinfo_body(xmlNodePtr root, cr_UpdateInfo *ui)
-{
-    GSList *element;
-
-    // Dump updates
-    for (element = ui->updates; element; element = g_slist_next(element)) {
-        cr_UpdateRecord *rec = element->data;
-        cr_xml_dump_updateinforecord_internal(root, rec);
-    }
+    cr_xml_indent(out, level);
+    g_string_append(out, "</update>\n");
 }
 
-
 char *
 cr_xml_dump_updateinfo(cr_UpdateInfo *updateinfo, GError **err)
 {
-    xmlDocPtr doc;
-    xmlNodePtr root;
-    char *result;
+    GString *out;
 
     assert(!err || *err == NULL);
 
@@ -182,28 +225,25 @@ cr_xml_dump_updateinfo(cr_UpdateInfo *updateinfo, GError **err)
 
     // Dump IT!
 
-    doc = xmlNewDoc(BAD_CAST XML_DOC_VERSION);
-    root = xmlNewNode(NULL, BAD_CAST "updates");
-    cr_xml_dump_updateinfo_body(root, updateinfo);
-    xmlDocSetRootElement(doc, root);
-    xmlDocDumpFormatMemoryEnc(doc,
-                              (xmlChar **) &result,
-                              NULL,
-                              XML_ENCODING,
-                              FORMAT_XML);
+    out = g_string_new("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
 
-    // Clean up
+    if (!updateinfo->updates) {
+        g_string_append(out, "<updates/>\n");
+        return g_string_free(out, FALSE);
+    }
 
-    xmlFreeDoc(doc);
+    g_string_append(out, "<updates>\n");
+    for (GSList *elem = updateinfo->updates; elem; elem = g_slist_next(elem))
+        cr_xml_dump_updaterecord_internal(out, 1, elem->data);
+    g_string_append(out, "</updates>\n");
 
-    return result;
+    return g_string_free(out, FALSE);
 }
 
 char *
 cr_xml_dump_updaterecord(cr_UpdateRecord *rec, GError **err)
 {
-    xmlNodePtr root;
-    char *result;
+    GString *out;
 
     assert(!err || *err == NULL);
 
@@ -215,29 +255,8 @@ cr_xml_dump_updaterecord(cr_UpdateRecord *rec, GError **err)
 
     // Dump IT!
 
-    xmlBufferPtr buf = xmlBufferCreate();
-    if (buf == NULL) {
-        g_critical("%s: Error creating the xml buffer", __func__);
-        g_set_error(err, ERR_DOMAIN, CRE_MEMORY,
-                    "Cannot create an xml buffer");
-        return NULL;
-    }
-
-    root = cr_xml_dump_updateinforecord_internal(NULL, rec);
-    // xmlNodeDump seems to be a little bit faster than xmlDocDumpFormatMemory
-    xmlNodeDump(buf, NULL, root, 1, FORMAT_XML);
-    assert(buf->content);
-    // First line in the buf is not indented, we must indent it by ourself
-    result = g_malloc(sizeof(char *) * buf->use + INDENT + 1);
-    for (int x = 0; x < INDENT; x++) result[x] = ' ';
-    memcpy((void *) result+INDENT, buf->content, buf->use);
-    result[buf->use + INDENT]   = '\n';
-    result[buf->use + INDENT + 1]   = '\0';
-
-    // Cleanup
-
-    xmlBufferFree(buf);
-    xmlFreeNode(root);
+    out = g_string_sized_new(1024);
+    cr_xml_dump_updaterecord_internal(out, 1, rec);
 
-    return result;
+    return g_string_free(out, FALSE);
 }
@@ -19,11 +19,13 @@
 
 #include <glib.h>
 #include <assert.h>
+#include <stdio.h>
 #include "xml_file.h"
 #include "error.h"
 #include "xml_dump.h"
 #include "compression_wrapper.h"
 #include "xml_dump_internal.h"
+#include "profile.h"
 
 #define ERR_DOMAIN              CREATEREPO_C_ERROR
 
@@ -46,6 +48,28 @@
 #define XML_PRESTODELTA_FOOTER  "</prestodelta>"
 #define XML_UPDATEINFO_FOOTER   "</updates>"
 
+/** State of a segmented file.
+ */
+typedef struct {
+    guint           pkgs;       // Average number of packages in a segment
+    cr_SegmentIndex *old_index; // Index of the old file (or NULL)
+    cr_SegmentIndex *index;     // Index of the written file
+    GString         *content;   // XML of the open segment
+    GPtrArray       *pkgids;    // pkgIds of packages in the open segment
+    gint64          offset;     // Offset of the open segment
+} cr_XmlFileSegments;
+
+static void
+cr_xmlfile_segments_free(cr_XmlFileSegments *seg)
+{
+    if (!seg)
+        return;
+    g_string_free(seg->content, TRUE);
+    if (seg->pkgids)
+        g_ptr_array_free(seg->pkgids, TRUE);
+    g_free(seg);
+}
+
 cr_XmlFile *
 cr_xmlfile_sopen(const char *filename,
                  cr_XmlFileType type,
@@ -109,6 +133,174 @@ cr_xmlfile_set_num_of_pkgs(cr_XmlFile *f, long num, GError **err)
     return CRE_OK;
 }
 
+int
+cr_xmlfile_set_segments(cr_XmlFile *f,
+                        guint pkgs,
+                        cr_SegmentIndex *old_index,
+                        cr_SegmentIndex *index,
+                        GError **err)
+{
+    cr_XmlFileSegments *seg;
+    GError *tmp_err = NULL;
+
+    assert(f);
+    assert(index);
+    assert(!err || *err == NULL);
+
+    if (f->header != 0) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "Header was already written");
+        return CRE_BADARG;
+    }
+
+    if (f->segments) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "Segments are already set");
+        return CRE_BADARG;
+    }
+
+    cr_set_segmented(f->f, &tmp_err);
+    if (tmp_err) {
+        int code = tmp_err->code;
+        g_propagate_error(err, tmp_err);
+        return code;
+    }
+
+    if (old_index && cr_segmentindex_compression(old_index) != f->f->type) {
+        g_debug("%s: Old segments use a different compression", __func__);
+        old_index = NULL;
+    }
+
+    seg = g_new0(cr_XmlFileSegments, 1);
+    seg->pkgs       = pkgs ? pkgs : CR_SEGMENTS_DEFAULT_PKGS;
+    seg->old_index  = old_index;
+    seg->index      = index;
+    seg->content    = g_string_new(NULL);
+    seg->pkgids     = g_ptr_array_new_with_free_func(g_free);
+    f->segments = seg;
+
+    return CRE_OK;
+}
+
+int
+cr_xmlfile_add_variant(cr_XmlFile *f,
+                       const char *filename,
+                       cr_CompressionType comtype,
+                       cr_ContentStat *stat,
+                       GError **err)
+{
+    CR_FILE *variant;
+    GError *tmp_err = NULL;
+
+    assert(f);
+    assert(filename);
+    assert(comtype < CR_CW_COMPRESSION_SENTINEL);
+    assert(!err || *err == NULL);
+
+    if (f->header != 0) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "Header was already written");
+        return CRE_BADARG;
+    }
+
+    if (g_file_test(filename, G_FILE_TEST_EXISTS)) {
+        g_set_error(err, ERR_DOMAIN, CRE_EXISTS,
+                    "File already exists");
+        return CRE_EXISTS;
+    }
+
+    variant = cr_sopen(filename, CR_CW_MODE_WRITE, comtype, stat, &tmp_err);
+    if (!variant) {
+        int code = tmp_err->code;
+        g_propagate_prefixed_error(err, tmp_err, "Cannot open %s: ", filename);
+        return code;
+    }
+
+    cr_add_variant(f->f, variant, &tmp_err);
+    if (tmp_err) {
+        int code = tmp_err->code;
+        g_propagate_error(err, tmp_err);
+        cr_close(variant, NULL);
+        remove(filename);
+        return code;
+    }
+
+    return CRE_OK;
+}
+
+/** Write the open segment - copy it from the old file if the old
+ * file has a segment with the same content or compress it -
+ * and add it to the index.
+ */
+static int
+cr_xmlfile_flush_segment(cr_XmlFile *f, GError **err)
+{
+    cr_XmlFileSegments *seg = f->segments;
+    cr_ChecksumCtx *ctx;
+    char *checksum = NULL;
+    guchar *old = NULL;
+    gsize old_len = 0;
+    gint64 end = 0;
+    GError *tmp_err = NULL;
+
+    if (!seg->content->len)
+        return CRE_OK;
+
+    ctx = cr_checksum_new(CR_SEGMENTS_CHECKSUM, &tmp_err);
+    if (!tmp_err)
+        cr_checksum_update(ctx, seg->content->str, seg->content->len, &tmp_err);
+    if (ctx)  // Final frees the context even after a failed update
+        checksum = cr_checksum_final(ctx, tmp_err ? NULL : &tmp_err);
+    if (tmp_err) {
+        int code = tmp_err->code;
+        g_propagate_prefixed_error(err, tmp_err, "Segment checksum: ");
+        g_free(checksum);
+        return code;
+    }
+
+    if (seg->old_index) {
+        old = cr_segmentindex_get(seg->old_index, checksum, seg->pkgids,
+                                  &old_len, &tmp_err);
+        if (tmp_err) {
+            // Not fatal, the segment is just compressed again
+            g_warning("Cannot reuse an old segment: %s", tmp_err->message);
+            g_clear_error(&tmp_err);
+        }
+    }
+
+    if (old) {
+        cr_write_segment(f->f, old, old_len,
+                         seg->content->str, seg->content->len, &tmp_err);
+        g_free(old);
+        end = seg->offset + old_len;
+        if (!tmp_err)
+            cr_profile_count(CR_PROF_CNT_SEGMENTS_REUSED, 1);
+    } else {
+        cr_write(f->f, seg->content->str, seg->content->len, &tmp_err);
+        if (!tmp_err)
+            cr_end_segment(f->f, &end, &tmp_err);
+        if (!tmp_err)
+            cr_profile_count(CR_PROF_CNT_SEGMENTS_WRITTEN, 1);
+    }
+
+    if (tmp_err) {
+        int code = tmp_err->code;
+        g_propagate_prefixed_error(err, tmp_err, "Cannot write segment: ");
+        g_free(checksum);
+        return code;
+    }
+
+    cr_segmentindex_append(seg->index, seg->offset, end - seg->offset,
+                           checksum, seg->pkgids);
+    g_free(checksum);
+
+    seg->offset = end;
+    seg->pkgids = g_ptr_array_new_with_free_func(g_free);
+    g_string_truncate(seg->content, 0);
+
+    return CRE_OK;
+}
+
 int
 cr_xmlfile_write_xml_header(cr_XmlFile *f, GError **err)
 {
@@ -148,6 +340,19 @@ cr_xmlfile_write_xml_header(cr_XmlFile *f, GError **err)
         return code;
     }
 
+    // Header is a chunk of its own, so it doesn't change with packages
+    if (f->segments)
+        cr_end_segment(f->f,
+                       &((cr_XmlFileSegments *) f->segments)->offset,
+                       &tmp_err);
+    else
+        cr_end_chunk(f->f, &tmp_err);
+    if (tmp_err) {
+        int code = tmp_err->code;
+        g_propagate_prefixed_error(err, tmp_err, "Cannot write XML header: ");
+        return code;
+    }
+
     f->header = 1;
 
     return CRE_OK;
@@ -233,7 +438,7 @@ cr_xmlfile_add_pkg(cr_XmlFile *f, cr_Package *pkg, GError **err)
     }
 
     if (xml) {
-        cr_xmlfile_add_chunk(f, xml, &tmp_err);
+        cr_xmlfile_add_pkg_chunk(f, xml, pkg->pkgId, &tmp_err);
         g_free(xml);
 
         if (tmp_err) {
@@ -246,8 +451,56 @@ cr_xmlfile_add_pkg(cr_XmlFile *f, cr_Package *pkg, GError **err)
     return CRE_OK;
 }
 
+int
+cr_xmlfile_add_updaterecord(cr_XmlFile *f,
+                            cr_UpdateRecord *rec,
+                            GError **err)
+{
+    char *xml;
+    GError *tmp_err = NULL;
+
+    assert(f);
+    assert(rec);
+    assert(!err || *err == NULL);
+    assert(f->footer == 0);
+
+    if (f->type != CR_XMLFILE_UPDATEINFO) {
+        g_critical("%s: Bad file type", __func__);
+        assert(0);
+        g_set_error(err, ERR_DOMAIN, CRE_ASSERT, "Bad file type");
+        return CRE_ASSERT;
+    }
+
+    xml = cr_xml_dump_updaterecord(rec, &tmp_err);
+    if (tmp_err) {
+        int code = tmp_err->code;
+        g_propagate_error(err, tmp_err);
+        return code;
+    }
+
+    cr_xmlfile_add_chunk(f, xml, &tmp_err);
+    g_free(xml);
+
+    if (tmp_err) {
+        int code = tmp_err->code;
+        g_propagate_error(err, tmp_err);
+        return code;
+    }
+
+    return CRE_OK;
+}
+
 int
 cr_xmlfile_add_chunk(cr_XmlFile *f, const char* chunk, GError **err)
+{
+    return cr_xmlfile_add_pkg_chunk(f, chunk, NULL, err);
+}
+
+int
+cr_xmlfile_add_pkg_chunk(cr_XmlFile *f,
+                         const char *chunk,
+                         const char *pkgid,
+                         GError **err)
 {
     GError *tmp_err = NULL;
 
@@ -267,6 +520,24 @@ cr_xmlfile_add_chunk(cr_XmlFile *f, const char* chunk, GError **err)
         }
     }
 
+    if (f->segments) {
+        cr_XmlFileSegments *seg = f->segments;
+
+        g_string_append(seg->content, chunk);
+        if (!pkgid)
+            return CRE_OK;
+
+        g_ptr_array_add(seg->pkgids, g_strdup(pkgid));
+
+        // Boundary depends only on the package, so inserting or removing
+        // of a package doesn't move boundaries of other segments
+        if (g_str_hash(pkgid) % seg->pkgs == 0
+            || seg->pkgids->len >= 4 * seg->pkgs)
+            return cr_xmlfile_flush_segment(f, err);
+
+        return CRE_OK;
+    }
+
     cr_puts(f->f, chunk, &tmp_err);
     if (tmp_err) {
         int code = tmp_err->code;
@@ -274,6 +545,76 @@ cr_xmlfile_add_chunk(cr_XmlFile *f, const char* chunk, GError **err)
         return code;
     }
 
+    cr_end_chunk(f->f, &tmp_err);
+    if (tmp_err) {
+        int code = tmp_err->code;
+        g_propagate_prefixed_error(err, tmp_err, "Error while write: ");
+        return code;
+    }
+
+    return CRE_OK;
+}
+
+int
+cr_xmlfile_add_segment(cr_XmlFile *f,
+                       const void *segment,
+                       gsize len,
+                       const char *checksum,
+                       GPtrArray *pkgids,
+                       GError **err)
+{
+    cr_XmlFileSegments *seg;
+    GPtrArray *ids;
+    GError *tmp_err = NULL;
+
+    assert(f);
+    assert(segment);
+    assert(checksum);
+    assert(pkgids);
+    assert(!err || *err == NULL);
+    assert(f->footer == 0);
+
+    seg = f->segments;
+    if (!seg) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "File is not segmented");
+        return CRE_BADARG;
+    }
+
+    if (f->f->stat || f->f->tee) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "Content of the segment is unknown, the file cannot "
+                    "have a content stat or variants");
+        return CRE_BADARG;
+    }
+
+    if (f->header == 0) {
+        cr_xmlfile_write_xml_header(f, &tmp_err);
+        if (tmp_err) {
+            int code = tmp_err->code;
+            g_propagate_error(err, tmp_err);
+            return code;
+        }
+    }
+
+    // Packages added before go into their own segment
+    cr_xmlfile_flush_segment(f, &tmp_err);
+    if (!tmp_err)
+        cr_write_segment(f->f, segment, len, NULL, 0, &tmp_err);
+    if (tmp_err) {
+        int code = tmp_err->code;
+        g_propagate_prefixed_error(err, tmp_err, "Cannot write segment: ");
+        return code;
+    }
+
+    ids = g_ptr_array_new_full(pkgids->len, g_free);
+    for (guint x = 0; x < pkgids->len; x++)
+        g_ptr_array_add(ids, g_strdup(g_ptr_array_index(pkgids, x)));
+
+    cr_segmentindex_append(seg->index, seg->offset, len, checksum, ids);
+    seg->offset += len;
+    cr_profile_count(CR_PROF_CNT_SEGMENTS_REUSED, 1);
+
     return CRE_OK;
 }
 
@@ -296,6 +637,15 @@ cr_xmlfile_close(cr_XmlFile *f, GError **err)
         }
     }
 
+    if (f->segments && f->footer == 0) {
+        cr_xmlfile_flush_segment(f, &tmp_err);
+        if (tmp_err) {
+            int code = tmp_err->code;
+            g_propagate_error(err, tmp_err);
+            return code;
+        }
+    }
+
     if (f->footer == 0) {
         cr_xmlfile_write_xml_footer(f, &tmp_err);
         if (tmp_err) {
@@ -313,6 +663,7 @@ cr_xmlfile_close(cr_XmlFile *f, GError **err)
         return code;
     }
 
+    cr_xmlfile_segments_free(f->segments);
     g_free(f);
 
     return CRE_OK;
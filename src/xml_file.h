@@ -27,6 +27,8 @@ extern "C" {
 #include <glib.h>
 #include "compression_wrapper.h"
 #include "package.h"
+#include "segments.h"
+#include "updateinfo.h"
 
 /** \defgroup   xml_file        XML file API.
  *  \addtogroup xml_file
@@ -57,6 +59,8 @@ typedef struct {
         0 if no footer was written yet. */
     long pkgs; /*!<
         Number of packages */
+    void *segments; /*!<
+        State of segmented writing (see cr_xmlfile_set_segments()) */
 } cr_XmlFile;
 
 /** Open a new primary XML file.
@@ -192,6 +196,49 @@ cr_XmlFile *cr_xmlfile_sopen(const char *filename,
  */
 int cr_xmlfile_set_num_of_pkgs(cr_XmlFile *f, long num, GError **err);
 
+/** Write the file in independently compressed segments of packages
+ * (see cr_set_segmented()) and record them into a segment index.
+ * Segment boundaries are derived from pkgIds of the packages, so
+ * a change of a package affects only the segment the package is in.
+ * Segments whose content matches a segment of the old index are
+ * copied from the old file instead of being compressed again.
+ * Must be called before any write operation.
+ * @param f             An opened cr_XmlFile
+ * @param pkgs          Average number of packages in a segment
+ *                      (0 for CR_SEGMENTS_DEFAULT_PKGS)
+ * @param old_index     Loaded index of the previous version of the
+ *                      file or NULL. It must stay valid until the file
+ *                      is closed.
+ * @param index         Empty index which will be filled with segments
+ *                      of the file. It must stay valid until the file
+ *                      is closed.
+ * @param err           **GError
+ * @return              cr_Error code
+ */
+int cr_xmlfile_set_segments(cr_XmlFile *f,
+                            guint pkgs,
+                            cr_SegmentIndex *old_index,
+                            cr_SegmentIndex *index,
+                            GError **err);
+
+/** Write the same content into one more file with a different
+ * compression (see cr_add_variant()). Each variant is compressed
+ * by its own thread and is closed together with the cr_XmlFile.
+ * Must be called before any write operation.
+ * @param f             An opened cr_XmlFile
+ * @param filename      Filename of the variant
+ * @param comtype       Type of compression of the variant
+ *                      (zchunk is not supported)
+ * @param stat          cr_ContentStat of the variant or NULL
+ * @param err           **GError
+ * @return              cr_Error code
+ */
+int cr_xmlfile_add_variant(cr_XmlFile *f,
+                           const char *filename,
+                           cr_CompressionType comtype,
+                           cr_ContentStat *stat,
+                           GError **err);
+
 /** Add package to the xml file.
  * @param f             An opened cr_XmlFile
  * @param pkg           Package object.
@@ -200,6 +247,18 @@ int cr_xmlfile_set_num_of_pkgs(cr_XmlFile *f, long num, GError **err);
  */
 int cr_xmlfile_add_pkg(cr_XmlFile *f, cr_Package *pkg, GError **err);
 
+/** Add update record to the updateinfo xml file.
+ * Records are written one by one, so the whole updateinfo doesn't
+ * have to be in memory.
+ * @param f             An opened cr_XmlFile of CR_XMLFILE_UPDATEINFO type
+ * @param rec           Update record
+ * @param err           **GError
+ * @return              cr_Error code
+ */
+int cr_xmlfile_add_updaterecord(cr_XmlFile *f,
+                                cr_UpdateRecord *rec,
+                                GError **err);
+
 /** Add (write) string with XML chunk into the file.
  * Note: Because of writing, in case of multithreaded program, shoud be
  * guarded by locks, this function could be much more effective than
@@ -207,6 +266,9 @@ int cr_xmlfile_add_pkg(cr_XmlFile *f, cr_Package *pkg, GError **err);
  * string with xml chunk is done in a critical section. In _add_chunk()
  * function, you could just dump XML whenever you want and in the
  * critical section do only writting.
+ * Every chunk (and the XML header) ends a compression chunk of
+ * the file (see cr_end_chunk()), so in a zchunk file each package
+ * is stored in its own chunk.
  * @param f             An opened cr_XmlFile
  * @param chunk         String with XML chunk.
  * @param err           **GError
@@ -214,6 +276,40 @@ int cr_xmlfile_add_pkg(cr_XmlFile *f, cr_Package *pkg, GError **err);
  */
 int cr_xmlfile_add_chunk(cr_XmlFile *f, const char *chunk, GError **err);
 
+/** Add (write) string with XML chunk of a package into the file.
+ * Same as cr_xmlfile_add_chunk(), but the pkgId of the package
+ * is used to split a segmented file (see cr_xmlfile_set_segments()).
+ * @param f             An opened cr_XmlFile
+ * @param chunk         String with XML chunk.
+ * @param pkgid         pkgId of the package or NULL.
+ * @param err           **GError
+ * @return              cr_Error code
+ */
+int cr_xmlfile_add_pkg_chunk(cr_XmlFile *f,
+                             const char *chunk,
+                             const char *pkgid,
+                             GError **err);
+
+/** Append an already compressed segment of packages (e.g. a segment
+ * of a shard, see cr_segmentindex_read()) to a segmented file
+ * (see cr_xmlfile_set_segments()). The segment must use the same
+ * compression as the file. Its content is not known, so the file
+ * must be opened without a cr_ContentStat and without variants.
+ * @param f             An opened segmented cr_XmlFile
+ * @param segment       Compressed segment
+ * @param len           Size of the segment
+ * @param checksum      Checksum of the uncompressed content
+ * @param pkgids        pkgIds of packages in the segment
+ * @param err           **GError
+ * @return              cr_Error code
+ */
+int cr_xmlfile_add_segment(cr_XmlFile *f,
+                           const void *segment,
+                           gsize len,
+                           const char *checksum,
+                           GPtrArray *pkgids,
+                           GError **err);
+
 /** Close an opened cr_XmlFile.
  * @param f             An opened cr_XmlFile
  * @param err           **GError
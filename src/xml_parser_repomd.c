@@ -50,6 +50,8 @@ typedef enum {
     STATE_TIMESTAMP,
     STATE_SIZE,
     STATE_OPENSIZE,
+    STATE_HEADERCHECKSUM,
+    STATE_HEADERSIZE,
     STATE_DBVERSION,
     NUMSTATES
 } cr_RepomdState;
@@ -75,6 +77,8 @@ static cr_StatesSwitch stateswitches[] = {
     { STATE_DATA,       "timestamp",        STATE_TIMESTAMP,    1 },
     { STATE_DATA,       "size",             STATE_SIZE,         1 },
     { STATE_DATA,       "open-size",        STATE_OPENSIZE,     1 },
+    { STATE_DATA,       "header-checksum",  STATE_HEADERCHECKSUM, 1 },
+    { STATE_DATA,       "header-size",      STATE_HEADERSIZE,   1 },
     { STATE_DATA,       "database_version", STATE_DBVERSION,    1 },
     { NUMSTATES,        NULL, NUMSTATES, 0 }
 };
@@ -231,9 +235,26 @@ cr_start_handler(void *pdata, const char *element, const char **attr)
                                                     val);
         break;
 
+    case STATE_HEADERCHECKSUM:
+        assert(pd->repomd);
+        assert(pd->repomdrecord);
+
+        val = cr_find_attr("type", attr);
+        if (!val) {
+            cr_xml_parser_warning(pd, CR_XML_WARNING_MISSINGATTR,
+                    "Missing attribute \"type\" of a header checksum element");
+            break;
+        }
+
+        pd->repomdrecord->checksum_header_type = g_string_chunk_insert(
+                                                    pd->repomdrecord->chunk,
+                                                    val);
+        break;
+
     case STATE_TIMESTAMP:
     case STATE_SIZE:
     case STATE_OPENSIZE:
+    case STATE_HEADERSIZE:
     case STATE_DBVERSION:
     default:
         break;
@@ -371,6 +392,22 @@ cr_end_handler(void *pdata, G_GNUC_UNUSED const char *element)
         pd->repomdrecord->size_open = cr_xml_parser_strtoll(pd, pd->content, 0);
         break;
 
+    case STATE_HEADERCHECKSUM:
+        assert(pd->repomd);
+        assert(pd->repomdrecord);
+
+        pd->repomdrecord->checksum_header = cr_safe_string_chunk_insert(
+                                            pd->repomdrecord->chunk,
+                                            pd->content);
+        break;
+
+    case STATE_HEADERSIZE:
+        assert(pd->repomd);
+        assert(pd->repomdrecord);
+
+        pd->repomdrecord->size_header = cr_xml_parser_strtoll(pd, pd->content, 0);
+        break;
+
     case STATE_DBVERSION:
         assert(pd->repomd);
         assert(pd->repomdrecord);
@@ -0,0 +1,155 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+/* Throughput benchmark of the checksum calculation.
+ *
+ * Usage: bench_checksum [SIZE_MIB] [FILE]
+ *
+ * If no FILE is specified, a temporary file with SIZE_MIB (default 256)
+ * of pseudo-random data is generated. For every checksum type two
+ * results are reported (as JSON):
+ *   checksum_mem  - cr_checksum_update() over an in-memory buffer (CPU)
+ *   checksum_file - cr_checksum_file() over the file (I/O + CPU)
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "bench_common.h"
+#include "fixtures.h"
+#include "createrepo/checksum.h"
+
+#define DEFAULT_SIZE_MIB        256
+#define MEM_BUFFER_SIZE         (1024*1024)
+
+static double
+bench_mem(cr_ChecksumType type, const unsigned char *buf, gint64 total)
+{
+    GTimer *timer = g_timer_new();
+    cr_ChecksumCtx *ctx = cr_checksum_new(type, NULL);
+    gint64 done = 0;
+
+    while (done < total) {
+        cr_checksum_update(ctx, buf, MEM_BUFFER_SIZE, NULL);
+        done += MEM_BUFFER_SIZE;
+    }
+    g_free(cr_checksum_final(ctx, NULL));
+
+    double secs = g_timer_elapsed(timer, NULL);
+    g_timer_destroy(timer);
+    return secs;
+}
+
+static double
+bench_file(cr_ChecksumType type, const char *path)
+{
+    GError *tmp_err = NULL;
+    GTimer *timer = g_timer_new();
+    char *checksum = cr_checksum_file(path, type, &tmp_err);
+    double secs = g_timer_elapsed(timer, NULL);
+
+    g_timer_destroy(timer);
+    if (!checksum) {
+        fprintf(stderr, "Cannot calculate checksum of %s: %s\n",
+                path, tmp_err->message);
+        g_clear_error(&tmp_err);
+        return 0.0;
+    }
+
+    g_free(checksum);
+    return secs;
+}
+
+int
+main(int argc, char **argv)
+{
+    gint64 size_mib = DEFAULT_SIZE_MIB;
+    gchar *path = NULL;
+    gboolean remove_file = FALSE;
+    unsigned char *buf;
+    struct stat st;
+
+    if (argc > 1)
+        size_mib = g_ascii_strtoll(argv[1], NULL, 10);
+    if (size_mib <= 0)
+        size_mib = DEFAULT_SIZE_MIB;
+
+    // Deterministic pseudo-random content
+    GRand *rand = g_rand_new_with_seed(42);
+    buf = g_malloc(MEM_BUFFER_SIZE);
+    for (int x = 0; x < MEM_BUFFER_SIZE; x += sizeof(guint32)) {
+        guint32 val = g_rand_int(rand);
+        memcpy(buf + x, &val, sizeof(guint32));
+    }
+    g_rand_free(rand);
+
+    if (argc > 2) {
+        path = g_strdup(argv[2]);
+    } else {
+        path = g_strdup(TMPDIR_TEMPLATE);
+        int fd = g_mkstemp(path);
+        if (fd == -1) {
+            fprintf(stderr, "Cannot create temporary file\n");
+            return EXIT_FAILURE;
+        }
+        for (gint64 x = 0; x < size_mib; x++) {
+            if (write(fd, buf, MEM_BUFFER_SIZE) != MEM_BUFFER_SIZE) {
+                fprintf(stderr, "Cannot write temporary file\n");
+                close(fd);
+                g_remove(path);
+                return EXIT_FAILURE;
+            }
+        }
+        close(fd);
+        remove_file = TRUE;
+    }
+
+    if (g_stat(path, &st) == -1) {
+        fprintf(stderr, "Cannot stat %s\n", path);
+        return EXIT_FAILURE;
+    }
+
+    bench_json_begin("bench_checksum", NULL);
+
+    for (cr_ChecksumType type = CR_CHECKSUM_MD5;
+         type < CR_CHECKSUM_SENTINEL;
+         type++)
+    {
+        if (type == CR_CHECKSUM_SHA)
+            continue;  // Alias of SHA1
+        const char *name = cr_checksum_name_str(type);
+        gint64 total = size_mib * MEM_BUFFER_SIZE;
+        bench_json_result("checksum_mem", name, 1, total,
+                          bench_mem(type, buf, total));
+        bench_json_result("checksum_file", name, 1, st.st_size,
+                          bench_file(type, path));
+    }
+    bench_json_end();
+
+    if (remove_file)
+        g_remove(path);
+    g_free(path);
+    g_free(buf);
+
+    return EXIT_SUCCESS;
+}
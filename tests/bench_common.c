@@ -0,0 +1,264 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include "bench_common.h"
+#include "createrepo/package.h"
+
+static const char *words[] = {
+    "library", "tool", "daemon", "plugin", "utility", "framework",
+    "client", "server", "parser", "backend", "support", "data",
+    "fast", "small", "secure", "common", "extra", "legacy",
+};
+
+static gboolean json_first = TRUE;
+
+static GOptionEntry synth_entries[] = {
+    { "packages", 'n', 0, G_OPTION_ARG_INT, NULL,
+      "Number of synthetic packages", "N" },
+    { "files", 0, 0, G_OPTION_ARG_INT, NULL,
+      "Number of files per package", "N" },
+    { "deps", 0, 0, G_OPTION_ARG_INT, NULL,
+      "Number of requires and provides per package", "N" },
+    { "changelogs", 0, 0, G_OPTION_ARG_INT, NULL,
+      "Number of changelog entries per package", "N" },
+    { "seed", 0, 0, G_OPTION_ARG_INT, NULL,
+      "Seed of the pseudo-random generator", "N" },
+    { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL },
+};
+
+void
+bench_synth_params_init(BenchSynthParams *params)
+{
+    params->packages    = BENCH_DEFAULT_PACKAGES;
+    params->files       = BENCH_DEFAULT_FILES;
+    params->deps        = BENCH_DEFAULT_DEPS;
+    params->changelogs  = BENCH_DEFAULT_CHANGELOGS;
+    params->seed        = BENCH_DEFAULT_SEED;
+}
+
+GOptionEntry *
+bench_synth_option_entries(BenchSynthParams *params)
+{
+    synth_entries[0].arg_data = &(params->packages);
+    synth_entries[1].arg_data = &(params->files);
+    synth_entries[2].arg_data = &(params->deps);
+    synth_entries[3].arg_data = &(params->changelogs);
+    synth_entries[4].arg_data = &(params->seed);
+    return synth_entries;
+}
+
+static char *
+synth_text(GRand *rand, GStringChunk *chunk, gint nwords)
+{
+    GString *str = g_string_sized_new(nwords * 8);
+
+    for (gint x = 0; x < nwords; x++) {
+        if (x)
+            g_string_append_c(str, ' ');
+        g_string_append(str, words[g_rand_int_range(rand, 0,
+                                                    G_N_ELEMENTS(words))]);
+    }
+
+    char *res = g_string_chunk_insert(chunk, str->str);
+    g_string_free(str, TRUE);
+    return res;
+}
+
+static cr_Dependency *
+synth_dep(GStringChunk *chunk,
+          const char *name,
+          const char *flags,
+          const char *version)
+{
+    cr_Dependency *dep = cr_dependency_new();
+    dep->name = g_string_chunk_insert(chunk, name);
+    if (flags) {
+        dep->flags   = g_string_chunk_insert(chunk, flags);
+        dep->epoch   = g_string_chunk_insert(chunk, "0");
+        dep->version = g_string_chunk_insert(chunk, version);
+        dep->release = g_string_chunk_insert(chunk, "1");
+    }
+    return dep;
+}
+
+cr_Package *
+bench_synth_package(const BenchSynthParams *params, gint idx)
+{
+    cr_Package *pkg = cr_package_new();
+    GStringChunk *chunk = pkg->chunk;
+    GRand *rand = g_rand_new_with_seed((guint32) params->seed * 1000003u
+                                       + (guint32) idx);
+    gchar *tmp;
+
+    tmp = g_strdup_printf("synth%06d", idx);
+    pkg->name = g_string_chunk_insert(chunk, tmp);
+    g_free(tmp);
+
+    pkg->arch = g_string_chunk_insert(chunk, (idx % 4) ? "x86_64" : "noarch");
+    pkg->epoch = g_string_chunk_insert(chunk, "0");
+    tmp = g_strdup_printf("%d.%d", g_rand_int_range(rand, 0, 10),
+                                   g_rand_int_range(rand, 0, 100));
+    pkg->version = g_string_chunk_insert(chunk, tmp);
+    g_free(tmp);
+    pkg->release = g_string_chunk_insert(chunk, "1");
+
+    pkg->summary = synth_text(rand, chunk, 6);
+    pkg->description = synth_text(rand, chunk,
+                                  g_rand_int_range(rand, 20, 200));
+    tmp = g_strdup_printf("http://example.com/%s", pkg->name);
+    pkg->url = g_string_chunk_insert(chunk, tmp);
+    g_free(tmp);
+
+    pkg->time_file = BENCH_EPOCH + idx;
+    pkg->time_build = BENCH_EPOCH + idx;
+    pkg->rpm_license = g_string_chunk_insert(chunk, "GPLv2+");
+    pkg->rpm_vendor = g_string_chunk_insert(chunk, "Bench");
+    pkg->rpm_group = g_string_chunk_insert(chunk, "Unspecified");
+    pkg->rpm_buildhost = g_string_chunk_insert(chunk, "bench.example.com");
+    tmp = g_strdup_printf("%s-%s-%s.src.rpm",
+                          pkg->name, pkg->version, pkg->release);
+    pkg->rpm_sourcerpm = g_string_chunk_insert(chunk, tmp);
+    g_free(tmp);
+    pkg->rpm_packager = g_string_chunk_insert(chunk, "Bench Packager");
+    pkg->rpm_header_start = 280;
+    pkg->rpm_header_end = 280 + g_rand_int_range(rand, 1000, 100000);
+    pkg->size_package = pkg->rpm_header_end + g_rand_int_range(rand, 0, 1<<20);
+    pkg->size_installed = g_rand_int_range(rand, 0, 1<<24);
+    pkg->size_archive = pkg->size_installed + 1024;
+
+    tmp = g_strdup_printf("Packages/%02d/%s-%s-%s.%s.rpm", idx % 32,
+                          pkg->name, pkg->version, pkg->release, pkg->arch);
+    pkg->location_href = g_string_chunk_insert(chunk, tmp);
+    g_free(tmp);
+
+    // pkgId must be unique for the seed
+    tmp = g_strdup_printf("%d-%s", params->seed, pkg->location_href);
+    gchar *pkgid = g_compute_checksum_for_string(G_CHECKSUM_SHA256, tmp, -1);
+    pkg->pkgId = g_string_chunk_insert(chunk, pkgid);
+    pkg->checksum_type = g_string_chunk_insert(chunk, "sha256");
+    g_free(pkgid);
+    g_free(tmp);
+
+    // Provides - the package itself and virtual capabilities
+    pkg->provides = g_slist_prepend(pkg->provides,
+                        synth_dep(chunk, pkg->name, "EQ", pkg->version));
+    for (gint x = 1; x < params->deps; x++) {
+        tmp = g_strdup_printf("%s-cap%d", pkg->name, x);
+        pkg->provides = g_slist_prepend(pkg->provides,
+                                        synth_dep(chunk, tmp, NULL, NULL));
+        g_free(tmp);
+    }
+    pkg->provides = g_slist_reverse(pkg->provides);
+
+    // Requires - packages and capabilities of the other packages
+    for (gint x = 0; x < params->deps && params->packages > 1; x++) {
+        gint target = g_rand_int_range(rand, 0, params->packages);
+        if (target == idx)
+            continue;
+        if (x % 2)
+            tmp = g_strdup_printf("synth%06d-cap%d", target,
+                            g_rand_int_range(rand, 1, MAX(2, params->deps)));
+        else
+            tmp = g_strdup_printf("synth%06d", target);
+        pkg->requires = g_slist_prepend(pkg->requires,
+                            synth_dep(chunk, tmp, (x % 4) ? NULL : "GE", "0.1"));
+        g_free(tmp);
+    }
+    pkg->requires = g_slist_reverse(pkg->requires);
+
+    // Files - the first one goes to primary.xml
+    for (gint x = 0; x < params->files; x++) {
+        cr_PackageFile *file = cr_package_file_new();
+        file->type = g_string_chunk_insert(chunk, "");
+        if (x == 0) {
+            file->path = g_string_chunk_insert(chunk, "/usr/bin/");
+            file->name = pkg->name;
+        } else {
+            tmp = g_strdup_printf("/usr/share/%s/d%02d/", pkg->name, x / 16);
+            file->path = g_string_chunk_insert(chunk, tmp);
+            g_free(tmp);
+            tmp = g_strdup_printf("file%04d.dat", x);
+            file->name = g_string_chunk_insert(chunk, tmp);
+            g_free(tmp);
+        }
+        pkg->files = g_slist_prepend(pkg->files, file);
+    }
+    pkg->files = g_slist_reverse(pkg->files);
+
+    // Changelogs - from the oldest
+    for (gint x = 0; x < params->changelogs; x++) {
+        cr_ChangelogEntry *entry = cr_changelog_entry_new();
+        tmp = g_strdup_printf("Bench Packager <bench@example.com> - %s-%d",
+                              pkg->version, x + 1);
+        entry->author = g_string_chunk_insert(chunk, tmp);
+        g_free(tmp);
+        entry->date = BENCH_EPOCH - (params->changelogs - x) * 86400;
+        entry->changelog = synth_text(rand, chunk,
+                                      g_rand_int_range(rand, 5, 40));
+        pkg->changelogs = g_slist_prepend(pkg->changelogs, entry);
+    }
+    pkg->changelogs = g_slist_reverse(pkg->changelogs);
+
+    g_rand_free(rand);
+    return pkg;
+}
+
+void
+bench_json_begin(const char *program, const BenchSynthParams *params)
+{
+    json_first = TRUE;
+    printf("{\n  \"program\": \"%s\",\n", program);
+    if (params)
+        printf("  \"params\": {\"packages\": %d, \"files\": %d, "
+               "\"deps\": %d, \"changelogs\": %d, \"seed\": %d},\n",
+               params->packages, params->files, params->deps,
+               params->changelogs, params->seed);
+    printf("  \"results\": [");
+}
+
+void
+bench_json_result(const char *name,
+                  const char *variant,
+                  gint64 items,
+                  gint64 bytes,
+                  double secs)
+{
+    printf("%s\n    {\"name\": \"%s\", \"variant\": \"%s\", "
+           "\"items\": %"G_GINT64_FORMAT", \"bytes\": %"G_GINT64_FORMAT", "
+           "\"seconds\": %.6f, \"items_per_sec\": %.1f, \"mb_per_sec\": %.3f}",
+           json_first ? "" : ",",
+           name,
+           variant ? variant : "",
+           items,
+           bytes,
+           secs,
+           secs > 0.0 ? items / secs : 0.0,
+           secs > 0.0 ? (bytes / (1000.0*1000.0)) / secs : 0.0);
+    json_first = FALSE;
+    fflush(stdout);
+}
+
+void
+bench_json_end(void)
+{
+    printf("\n  ]\n}\n");
+}
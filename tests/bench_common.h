@@ -0,0 +1,93 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#ifndef __C_CREATEREPOLIB_BENCH_COMMON_H__
+#define __C_CREATEREPOLIB_BENCH_COMMON_H__
+
+#include <glib.h>
+#include "createrepo/package.h"
+
+/* Shared code of the benchmarks:
+ *  - deterministic generator of synthetic packages
+ *  - stable JSON output of results
+ */
+
+#define BENCH_DEFAULT_PACKAGES      1000
+#define BENCH_DEFAULT_FILES         20
+#define BENCH_DEFAULT_DEPS          8
+#define BENCH_DEFAULT_CHANGELOGS    10
+#define BENCH_DEFAULT_SEED          42
+
+/** Base timestamp of synthetic packages (build time, file time,
+ * changelogs), used instead of the current time to keep the generated
+ * metadata reproducible.
+ */
+#define BENCH_EPOCH                 G_GINT64_CONSTANT(1400000000)
+
+/** Parameters of a synthetic repository.
+ */
+typedef struct {
+    gint packages;      /*!< Number of packages */
+    gint files;         /*!< Files per package */
+    gint deps;          /*!< Requires/provides per package (fan-out) */
+    gint changelogs;    /*!< Changelog entries per package */
+    gint seed;          /*!< Seed of the pseudo-random generator */
+} BenchSynthParams;
+
+/** Options for the GOptionContext of a benchmark which fill
+ * BenchSynthParams.
+ */
+GOptionEntry *bench_synth_option_entries(BenchSynthParams *params);
+
+/** Set default values of the params.
+ */
+void bench_synth_params_init(BenchSynthParams *params);
+
+/** Generate a synthetic package. The same params and idx always
+ * result in the same package.
+ * @param params    Parameters of the repository
+ * @param idx       Index of the package (0 .. params->packages-1)
+ * @return          New package (free it with cr_package_free())
+ */
+cr_Package *bench_synth_package(const BenchSynthParams *params, gint idx);
+
+/** Start a JSON report (printed to stdout).
+ * @param program   Name of the benchmark
+ * @param params    Parameters of the synthetic repository or NULL
+ */
+void bench_json_begin(const char *program, const BenchSynthParams *params);
+
+/** Print a single result of the JSON report.
+ * @param name      Name of the measured operation
+ * @param variant   Variant (e.g. compression type) or NULL
+ * @param items     Number of processed items (packages, files, ...)
+ * @param bytes     Number of processed bytes (0 if not relevant)
+ * @param secs      Elapsed time in seconds
+ */
+void bench_json_result(const char *name,
+                       const char *variant,
+                       gint64 items,
+                       gint64 bytes,
+                       double secs);
+
+/** Finish the JSON report.
+ */
+void bench_json_end(void);
+
+#endif /* __C_CREATEREPOLIB_BENCH_COMMON_H__ */
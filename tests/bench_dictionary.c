@@ -0,0 +1,230 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+/* Benchmark of compression dictionaries over a synthetic repository.
+ *
+ * Usage: bench_dictionary [OPTIONS]
+ *
+ * Every package chunk of primary/filelists/other is compressed
+ * independently (as in zchunk files), once without and once with
+ * a dictionary trained from every other package (the "previous run").
+ *
+ * Measured operations:
+ *   dict_train         - cr_dicttrainer_train() per metadata type
+ *   chunk_compress     - per-chunk compression (variant: <type>-plain
+ *                        or <type>-dict)
+ *   chunk_decompress   - per-chunk decompression
+ *   chunk_size         - total size of the compressed chunks (bytes)
+ *
+ * The report is printed to stdout as JSON, compression ratios
+ * are also printed to stderr.
+ */
+
+#include <glib.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <zstd.h>
+#include "bench_common.h"
+#include "createrepo/dictionary.h"
+#include "createrepo/package.h"
+#include "createrepo/xml_dump.h"
+
+#define BENCH_DICT_LEVEL    10
+
+static const char *type_names[] = { "primary", "filelists", "other" };
+
+/** Chunks of a single metadata type.
+ */
+typedef struct {
+    GPtrArray *chunks;      /*!< XML chunks (gchar *) */
+    gint64 bytes;           /*!< Total size of the chunks */
+} BenchChunks;
+
+static void
+bench_chunks(BenchChunks *chunks,
+             const char *name,
+             const char *variant,
+             ZSTD_CDict *cdict,
+             ZSTD_DDict *ddict)
+{
+    ZSTD_CCtx *cctx = ZSTD_createCCtx();
+    ZSTD_DCtx *dctx = ZSTD_createDCtx();
+    GPtrArray *compressed = g_ptr_array_new_with_free_func(g_free);
+    GArray *sizes = g_array_new(FALSE, FALSE, sizeof(size_t));
+    gchar *label = g_strconcat(name, "-", variant, NULL);
+    gint64 total = 0;
+    GTimer *timer = g_timer_new();
+
+    for (guint x = 0; x < chunks->chunks->len; x++) {
+        const char *chunk = g_ptr_array_index(chunks->chunks, x);
+        size_t len = strlen(chunk);
+        size_t bound = ZSTD_compressBound(len);
+        void *dst = g_malloc(bound);
+        size_t rc;
+
+        if (cdict)
+            rc = ZSTD_compress_usingCDict(cctx, dst, bound, chunk, len, cdict);
+        else
+            rc = ZSTD_compressCCtx(cctx, dst, bound, chunk, len,
+                                   BENCH_DICT_LEVEL);
+        if (ZSTD_isError(rc)) {
+            fprintf(stderr, "Compression failed: %s\n", ZSTD_getErrorName(rc));
+            exit(EXIT_FAILURE);
+        }
+
+        g_ptr_array_add(compressed, dst);
+        g_array_append_val(sizes, rc);
+        total += rc;
+    }
+    bench_json_result("chunk_compress", label, chunks->chunks->len,
+                      chunks->bytes, g_timer_elapsed(timer, NULL));
+
+    g_timer_start(timer);
+    for (guint x = 0; x < compressed->len; x++) {
+        const char *chunk = g_ptr_array_index(chunks->chunks, x);
+        size_t len = strlen(chunk);
+        void *dst = g_malloc(len);
+        size_t rc;
+
+        if (ddict)
+            rc = ZSTD_decompress_usingDDict(dctx, dst, len,
+                                            g_ptr_array_index(compressed, x),
+                                            g_array_index(sizes, size_t, x),
+                                            ddict);
+        else
+            rc = ZSTD_decompressDCtx(dctx, dst, len,
+                                     g_ptr_array_index(compressed, x),
+                                     g_array_index(sizes, size_t, x));
+        if (ZSTD_isError(rc) || rc != len || memcmp(dst, chunk, len)) {
+            fprintf(stderr, "Decompression of %s chunk %u failed\n", label, x);
+            exit(EXIT_FAILURE);
+        }
+        g_free(dst);
+    }
+    bench_json_result("chunk_decompress", label, compressed->len,
+                      chunks->bytes, g_timer_elapsed(timer, NULL));
+
+    bench_json_result("chunk_size", label, compressed->len, total, 0.0);
+    fprintf(stderr, "%-16s %12"G_GINT64_FORMAT" -> %12"G_GINT64_FORMAT
+            " bytes (ratio %.2f)\n", label, chunks->bytes, total,
+            total ? (double) chunks->bytes / total : 0.0);
+
+    g_timer_destroy(timer);
+    g_free(label);
+    g_array_free(sizes, TRUE);
+    g_ptr_array_free(compressed, TRUE);
+    ZSTD_freeCCtx(cctx);
+    ZSTD_freeDCtx(dctx);
+}
+
+int
+main(int argc, char **argv)
+{
+    BenchSynthParams params;
+    gint dict_size = CR_DICT_DEFAULT_SIZE;
+    BenchChunks chunks[3];
+    cr_DictTrainer *trainers[3];
+    GError *tmp_err = NULL;
+
+    bench_synth_params_init(&params);
+
+    GOptionEntry dict_entries[] = {
+        { "dict-size", 0, 0, G_OPTION_ARG_INT, &dict_size,
+          "Maximal size of a dictionary (default 64 KiB).", "BYTES" },
+        { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL },
+    };
+
+    GOptionContext *context = g_option_context_new(NULL);
+    g_option_context_set_summary(context,
+            "Benchmark of compression dictionaries.");
+    g_option_context_add_main_entries(context,
+                                      bench_synth_option_entries(&params),
+                                      NULL);
+    g_option_context_add_main_entries(context, dict_entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &tmp_err)) {
+        fprintf(stderr, "%s\n", tmp_err->message);
+        g_error_free(tmp_err);
+        g_option_context_free(context);
+        return EXIT_FAILURE;
+    }
+    g_option_context_free(context);
+
+    cr_xml_dump_init();
+
+    for (int t = 0; t < 3; t++) {
+        chunks[t].chunks = g_ptr_array_new_with_free_func(g_free);
+        chunks[t].bytes = 0;
+        trainers[t] = cr_dicttrainer_new(dict_size);
+    }
+
+    for (gint x = 0; x < params.packages; x++) {
+        cr_Package *pkg = bench_synth_package(&params, x);
+        struct cr_XmlStruct res = cr_xml_dump(pkg, NULL);
+        gchar *xml[3] = { res.primary, res.filelists, res.other };
+
+        for (int t = 0; t < 3; t++) {
+            if (x % 2 == 0)
+                cr_dicttrainer_add_sample(trainers[t], xml[t], strlen(xml[t]));
+            chunks[t].bytes += strlen(xml[t]);
+            g_ptr_array_add(chunks[t].chunks, xml[t]);
+        }
+        cr_package_free(pkg);
+    }
+
+    bench_json_begin("bench_dictionary", &params);
+
+    for (int t = 0; t < 3; t++) {
+        void *dict = NULL;
+        gsize dict_len = 0;
+        GTimer *timer = g_timer_new();
+
+        cr_dicttrainer_train(trainers[t], &dict, &dict_len, &tmp_err);
+        if (tmp_err) {
+            fprintf(stderr, "Cannot train %s dictionary: %s\n",
+                    type_names[t], tmp_err->message);
+            return EXIT_FAILURE;
+        }
+        bench_json_result("dict_train", type_names[t],
+                          cr_dicttrainer_samples(trainers[t]), dict_len,
+                          g_timer_elapsed(timer, NULL));
+        g_timer_destroy(timer);
+
+        ZSTD_CDict *cdict = ZSTD_createCDict(dict, dict_len, BENCH_DICT_LEVEL);
+        ZSTD_DDict *ddict = ZSTD_createDDict(dict, dict_len);
+
+        bench_chunks(&chunks[t], type_names[t], "plain", NULL, NULL);
+        bench_chunks(&chunks[t], type_names[t], "dict", cdict, ddict);
+
+        ZSTD_freeCDict(cdict);
+        ZSTD_freeDDict(ddict);
+        g_free(dict);
+    }
+
+    bench_json_end();
+
+    for (int t = 0; t < 3; t++) {
+        g_ptr_array_free(chunks[t].chunks, TRUE);
+        cr_dicttrainer_free(trainers[t]);
+    }
+
+    cr_xml_dump_cleanup();
+
+    return EXIT_SUCCESS;
+}
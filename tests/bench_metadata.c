@@ -0,0 +1,331 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+/* Microbenchmarks of the metadata pipeline over a synthetic repository.
+ *
+ * Usage: bench_metadata [OPTIONS]
+ *
+ * Measured operations:
+ *   xml_dump       - cr_xml_dump() of all packages
+ *   xml_write      - writing of primary/filelists/other for each
+ *                    compression type (cr_XmlFile)
+ *   compress_file  - cr_compress_file() of filelists.xml
+ *   parse_*        - XML parsers over the gzipped files
+ *   db_add_*       - cr_db_add_pkg() of all packages (incl. indexing)
+ *   checksum_file  - cr_checksum_file() of filelists.xml (sha256)
+ *
+ * The report is printed to stdout as JSON.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "bench_common.h"
+#include "fixtures.h"
+#include "createrepo/checksum.h"
+#include "createrepo/compression_wrapper.h"
+#include "createrepo/misc.h"
+#include "createrepo/package.h"
+#include "createrepo/sqlite.h"
+#include "createrepo/xml_dump.h"
+#include "createrepo/xml_file.h"
+#include "createrepo/xml_parser.h"
+
+static cr_CompressionType compression_types[] = {
+    CR_CW_NO_COMPRESSION,
+    CR_CW_GZ_COMPRESSION,
+    CR_CW_BZ2_COMPRESSION,
+    CR_CW_XZ_COMPRESSION,
+#ifdef WITH_ZSTD
+    CR_CW_ZSTD_COMPRESSION,
+#endif
+};
+
+static const char *
+compression_name(cr_CompressionType type)
+{
+    switch (type) {
+        case CR_CW_NO_COMPRESSION:  return "none";
+        case CR_CW_GZ_COMPRESSION:  return "gz";
+        case CR_CW_BZ2_COMPRESSION: return "bz2";
+        case CR_CW_XZ_COMPRESSION:  return "xz";
+        case CR_CW_ZSTD_COMPRESSION: return "zstd";
+        default:                    return "unknown";
+    }
+}
+
+static gint64
+file_size(const char *path)
+{
+    struct stat st;
+    if (g_stat(path, &st) == -1)
+        return 0;
+    return (gint64) st.st_size;
+}
+
+static int
+parser_pkgcb(cr_Package *pkg, void *cbdata, G_GNUC_UNUSED GError **err)
+{
+    (*((gint64 *) cbdata))++;
+    cr_package_free(pkg);
+    return CR_CB_RET_OK;
+}
+
+static void
+bench_xml_dump(GPtrArray *pkgs)
+{
+    gint64 bytes = 0;
+    GTimer *timer = g_timer_new();
+
+    for (guint x = 0; x < pkgs->len; x++) {
+        struct cr_XmlStruct res = cr_xml_dump(g_ptr_array_index(pkgs, x), NULL);
+        bytes += strlen(res.primary) + strlen(res.filelists)
+                 + strlen(res.other);
+        g_free(res.primary);
+        g_free(res.filelists);
+        g_free(res.other);
+    }
+
+    bench_json_result("xml_dump", NULL, pkgs->len, bytes,
+                      g_timer_elapsed(timer, NULL));
+    g_timer_destroy(timer);
+}
+
+static void
+bench_xml_write(GPtrArray *pkgs, const char *tmp_dir)
+{
+    for (guint t = 0; t < G_N_ELEMENTS(compression_types); t++) {
+        cr_CompressionType type = compression_types[t];
+        const char *suffix = cr_compression_suffix(type);
+        gchar *pri = g_strconcat(tmp_dir, "/primary.xml", suffix, NULL);
+        gchar *fil = g_strconcat(tmp_dir, "/filelists.xml", suffix, NULL);
+        gchar *oth = g_strconcat(tmp_dir, "/other.xml", suffix, NULL);
+        gint64 bytes = 0;
+        GTimer *timer = g_timer_new();
+
+        cr_XmlFile *pri_f = cr_xmlfile_open_primary(pri, type, NULL);
+        cr_XmlFile *fil_f = cr_xmlfile_open_filelists(fil, type, NULL);
+        cr_XmlFile *oth_f = cr_xmlfile_open_other(oth, type, NULL);
+        if (!pri_f || !fil_f || !oth_f) {
+            fprintf(stderr, "Cannot open xml files in %s\n", tmp_dir);
+            exit(EXIT_FAILURE);
+        }
+
+        for (guint x = 0; x < pkgs->len; x++) {
+            cr_Package *pkg = g_ptr_array_index(pkgs, x);
+            struct cr_XmlStruct res = cr_xml_dump(pkg, NULL);
+            cr_xmlfile_add_chunk(pri_f, res.primary, NULL);
+            cr_xmlfile_add_chunk(fil_f, res.filelists, NULL);
+            cr_xmlfile_add_chunk(oth_f, res.other, NULL);
+            bytes += strlen(res.primary) + strlen(res.filelists)
+                     + strlen(res.other);
+            g_free(res.primary);
+            g_free(res.filelists);
+            g_free(res.other);
+        }
+
+        cr_xmlfile_close(pri_f, NULL);
+        cr_xmlfile_close(fil_f, NULL);
+        cr_xmlfile_close(oth_f, NULL);
+
+        bench_json_result("xml_write", compression_name(type), pkgs->len,
+                          bytes, g_timer_elapsed(timer, NULL));
+
+        g_timer_destroy(timer);
+        g_free(pri);
+        g_free(fil);
+        g_free(oth);
+    }
+}
+
+static void
+bench_compress_file(const char *tmp_dir)
+{
+    gchar *src = g_build_filename(tmp_dir, "filelists.xml", NULL);
+    gint64 size = file_size(src);
+
+    for (guint t = 0; t < G_N_ELEMENTS(compression_types); t++) {
+        cr_CompressionType type = compression_types[t];
+        if (type == CR_CW_NO_COMPRESSION)
+            continue;
+
+        gchar *dst = g_strconcat(src, ".bench", cr_compression_suffix(type),
+                                 NULL);
+        gchar *back = g_strconcat(src, ".bench", NULL);
+        GTimer *timer = g_timer_new();
+        cr_compress_file(src, dst, type, NULL);
+        bench_json_result("compress_file", compression_name(type), 1, size,
+                          g_timer_elapsed(timer, NULL));
+
+        // Throughput is reported in uncompressed bytes for both directions
+        g_timer_start(timer);
+        cr_decompress_file(dst, back, type, NULL);
+        bench_json_result("decompress_file", compression_name(type), 1, size,
+                          g_timer_elapsed(timer, NULL));
+        g_timer_destroy(timer);
+        g_remove(dst);
+        g_remove(back);
+        g_free(dst);
+        g_free(back);
+    }
+
+    g_free(src);
+}
+
+static void
+bench_parsers(const char *tmp_dir)
+{
+    gchar *pri = g_build_filename(tmp_dir, "primary.xml.gz", NULL);
+    gchar *fil = g_build_filename(tmp_dir, "filelists.xml.gz", NULL);
+    gchar *oth = g_build_filename(tmp_dir, "other.xml.gz", NULL);
+    gchar *pri_plain = g_build_filename(tmp_dir, "primary.xml", NULL);
+    gchar *fil_plain = g_build_filename(tmp_dir, "filelists.xml", NULL);
+    gchar *oth_plain = g_build_filename(tmp_dir, "other.xml", NULL);
+    gint64 parsed;
+    GTimer *timer = g_timer_new();
+
+    parsed = 0;
+    g_timer_start(timer);
+    cr_xml_parse_primary(pri, NULL, NULL, parser_pkgcb, &parsed,
+                         NULL, NULL, 1, NULL);
+    bench_json_result("parse_primary", "gz", parsed, file_size(pri_plain),
+                      g_timer_elapsed(timer, NULL));
+
+    parsed = 0;
+    g_timer_start(timer);
+    cr_xml_parse_filelists(fil, NULL, NULL, parser_pkgcb, &parsed,
+                           NULL, NULL, NULL);
+    bench_json_result("parse_filelists", "gz", parsed, file_size(fil_plain),
+                      g_timer_elapsed(timer, NULL));
+
+    parsed = 0;
+    g_timer_start(timer);
+    cr_xml_parse_other(oth, NULL, NULL, parser_pkgcb, &parsed,
+                       NULL, NULL, NULL);
+    bench_json_result("parse_other", "gz", parsed, file_size(oth_plain),
+                      g_timer_elapsed(timer, NULL));
+
+    g_timer_destroy(timer);
+    g_free(pri);
+    g_free(fil);
+    g_free(oth);
+    g_free(pri_plain);
+    g_free(fil_plain);
+    g_free(oth_plain);
+}
+
+static void
+bench_sqlite(GPtrArray *pkgs, const char *tmp_dir)
+{
+    static const char *names[] = { "db_add_primary",
+                                   "db_add_filelists",
+                                   "db_add_other" };
+
+    for (cr_DatabaseType type = CR_DB_PRIMARY; type < CR_DB_SENTINEL; type++) {
+        GError *tmp_err = NULL;
+        gchar *path = g_strdup_printf("%s/bench_%d.sqlite", tmp_dir, type);
+        GTimer *timer = g_timer_new();
+
+        cr_SqliteDb *db = cr_db_open(path, type, &tmp_err);
+        if (!db) {
+            fprintf(stderr, "Cannot open %s: %s\n", path, tmp_err->message);
+            exit(EXIT_FAILURE);
+        }
+        for (guint x = 0; x < pkgs->len; x++)
+            cr_db_add_pkg(db, g_ptr_array_index(pkgs, x), NULL);
+        cr_db_close(db, NULL);
+
+        bench_json_result(names[type], NULL, pkgs->len, file_size(path),
+                          g_timer_elapsed(timer, NULL));
+        g_timer_destroy(timer);
+        g_remove(path);
+        g_free(path);
+    }
+}
+
+static void
+bench_checksum_file(const char *tmp_dir)
+{
+    gchar *path = g_build_filename(tmp_dir, "filelists.xml", NULL);
+    GTimer *timer = g_timer_new();
+
+    g_free(cr_checksum_file(path, CR_CHECKSUM_SHA256, NULL));
+    bench_json_result("checksum_file", "sha256", 1, file_size(path),
+                      g_timer_elapsed(timer, NULL));
+
+    g_timer_destroy(timer);
+    g_free(path);
+}
+
+int
+main(int argc, char **argv)
+{
+    BenchSynthParams params;
+    GError *tmp_err = NULL;
+
+    bench_synth_params_init(&params);
+
+    GOptionContext *context = g_option_context_new(NULL);
+    g_option_context_set_summary(context,
+            "Microbenchmarks of the metadata pipeline.");
+    g_option_context_add_main_entries(context,
+                                      bench_synth_option_entries(&params),
+                                      NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &tmp_err)) {
+        fprintf(stderr, "%s\n", tmp_err->message);
+        g_error_free(tmp_err);
+        g_option_context_free(context);
+        return EXIT_FAILURE;
+    }
+    g_option_context_free(context);
+
+    gchar *tmp_dir = g_strdup(TMPDIR_TEMPLATE);
+    if (!mkdtemp(tmp_dir)) {
+        fprintf(stderr, "Cannot create temporary directory\n");
+        return EXIT_FAILURE;
+    }
+
+    cr_xml_dump_init();
+
+    GPtrArray *pkgs = g_ptr_array_sized_new(params.packages);
+    for (gint x = 0; x < params.packages; x++)
+        g_ptr_array_add(pkgs, bench_synth_package(&params, x));
+
+    bench_json_begin("bench_metadata", &params);
+    bench_xml_dump(pkgs);
+    bench_xml_write(pkgs, tmp_dir);
+    bench_compress_file(tmp_dir);
+    bench_parsers(tmp_dir);
+    bench_sqlite(pkgs, tmp_dir);
+    bench_checksum_file(tmp_dir);
+    bench_json_end();
+
+    for (guint x = 0; x < pkgs->len; x++)
+        cr_package_free(g_ptr_array_index(pkgs, x));
+    g_ptr_array_free(pkgs, TRUE);
+
+    cr_xml_dump_cleanup();
+    cr_remove_dir(tmp_dir, NULL);
+    g_free(tmp_dir);
+
+    return EXIT_SUCCESS;
+}
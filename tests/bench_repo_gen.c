@@ -0,0 +1,365 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+/* Generator of deterministic synthetic repositories for benchmarks.
+ *
+ * Usage: bench_repo_gen [OPTIONS] OUTDIR
+ *
+ * By default OUTDIR/repodata/ with primary, filelists and other xml
+ * and repomd.xml is generated (usable as an input of mergerepo_c,
+ * sqliterepo_c, ...). With --rpms a spec file with a subpackage for
+ * every synthetic package is built by rpmbuild and the resulting
+ * rpms are stored into OUTDIR/Packages/ (input of createrepo_c).
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "bench_common.h"
+#include "createrepo/compression_wrapper.h"
+#include "createrepo/error.h"
+#include "createrepo/misc.h"
+#include "createrepo/package.h"
+#include "createrepo/repomd.h"
+#include "createrepo/xml_dump.h"
+#include "createrepo/xml_file.h"
+
+static gboolean
+gen_xml_repo(const BenchSynthParams *params,
+             const char *outdir,
+             cr_CompressionType comtype,
+             GError **err)
+{
+    gboolean ret = FALSE;
+    const char *suffix = cr_compression_suffix(comtype);
+    gchar *repodata = g_build_filename(outdir, "repodata", NULL);
+    gchar *pri_path, *fil_path, *oth_path, *repomd_path;
+    cr_ContentStat *pri_stat, *fil_stat, *oth_stat;
+    cr_XmlFile *pri_f = NULL, *fil_f = NULL, *oth_f = NULL;
+    cr_Repomd *repomd = NULL;
+    char *repomd_xml = NULL;
+
+    if (g_mkdir_with_parents(repodata, 0755)) {
+        g_set_error(err, CREATEREPO_C_ERROR, CRE_IO,
+                    "Cannot create %s: %s", repodata, g_strerror(errno));
+        g_free(repodata);
+        return FALSE;
+    }
+
+    pri_path = g_strconcat(repodata, "/primary.xml", suffix, NULL);
+    fil_path = g_strconcat(repodata, "/filelists.xml", suffix, NULL);
+    oth_path = g_strconcat(repodata, "/other.xml", suffix, NULL);
+    repomd_path = g_build_filename(repodata, "repomd.xml", NULL);
+
+    pri_stat = cr_contentstat_new(CR_CHECKSUM_SHA256, NULL);
+    fil_stat = cr_contentstat_new(CR_CHECKSUM_SHA256, NULL);
+    oth_stat = cr_contentstat_new(CR_CHECKSUM_SHA256, NULL);
+
+    pri_f = cr_xmlfile_sopen_primary(pri_path, comtype, pri_stat, err);
+    if (!pri_f)
+        goto cleanup;
+    fil_f = cr_xmlfile_sopen_filelists(fil_path, comtype, fil_stat, err);
+    if (!fil_f)
+        goto cleanup;
+    oth_f = cr_xmlfile_sopen_other(oth_path, comtype, oth_stat, err);
+    if (!oth_f)
+        goto cleanup;
+
+    cr_xmlfile_set_num_of_pkgs(pri_f, params->packages, NULL);
+    cr_xmlfile_set_num_of_pkgs(fil_f, params->packages, NULL);
+    cr_xmlfile_set_num_of_pkgs(oth_f, params->packages, NULL);
+
+    for (gint x = 0; x < params->packages; x++) {
+        cr_Package *pkg = bench_synth_package(params, x);
+        struct cr_XmlStruct res = cr_xml_dump(pkg, err);
+        cr_package_free(pkg);
+        if (!res.primary)
+            goto cleanup;
+
+        cr_xmlfile_add_chunk(pri_f, res.primary, NULL);
+        cr_xmlfile_add_chunk(fil_f, res.filelists, NULL);
+        cr_xmlfile_add_chunk(oth_f, res.other, NULL);
+        g_free(res.primary);
+        g_free(res.filelists);
+        g_free(res.other);
+    }
+
+    cr_xmlfile_close(pri_f, NULL);
+    cr_xmlfile_close(fil_f, NULL);
+    cr_xmlfile_close(oth_f, NULL);
+    pri_f = fil_f = oth_f = NULL;
+
+    // repomd.xml
+    repomd = cr_repomd_new();
+    cr_RepomdRecord *pri_rec = cr_repomd_record_new("primary", pri_path);
+    cr_RepomdRecord *fil_rec = cr_repomd_record_new("filelists", fil_path);
+    cr_RepomdRecord *oth_rec = cr_repomd_record_new("other", oth_path);
+    cr_repomd_record_load_contentstat(pri_rec, pri_stat);
+    cr_repomd_record_load_contentstat(fil_rec, fil_stat);
+    cr_repomd_record_load_contentstat(oth_rec, oth_stat);
+    // Fixed timestamps - the output should be reproducible
+    pri_rec->timestamp = fil_rec->timestamp = oth_rec->timestamp = BENCH_EPOCH;
+    cr_repomd_set_record(repomd, pri_rec);
+    cr_repomd_set_record(repomd, fil_rec);
+    cr_repomd_set_record(repomd, oth_rec);
+
+    if (cr_repomd_record_fill(pri_rec, CR_CHECKSUM_SHA256, err) != CRE_OK
+        || cr_repomd_record_fill(fil_rec, CR_CHECKSUM_SHA256, err) != CRE_OK
+        || cr_repomd_record_fill(oth_rec, CR_CHECKSUM_SHA256, err) != CRE_OK)
+        goto cleanup;
+
+    cr_repomd_set_revision(repomd, "1400000000");
+    cr_repomd_sort_records(repomd);
+    repomd_xml = cr_xml_dump_repomd(repomd, err);
+    if (!repomd_xml)
+        goto cleanup;
+
+    if (!g_file_set_contents(repomd_path, repomd_xml, -1, err))
+        goto cleanup;
+
+    ret = TRUE;
+
+cleanup:
+    cr_xmlfile_close(pri_f, NULL);
+    cr_xmlfile_close(fil_f, NULL);
+    cr_xmlfile_close(oth_f, NULL);
+    cr_contentstat_free(pri_stat, NULL);
+    cr_contentstat_free(fil_stat, NULL);
+    cr_contentstat_free(oth_stat, NULL);
+    cr_repomd_free(repomd);
+    g_free(repomd_xml);
+    g_free(pri_path);
+    g_free(fil_path);
+    g_free(oth_path);
+    g_free(repomd_path);
+    g_free(repodata);
+    return ret;
+}
+
+/** Append a subpackage for the synthetic package into the spec.
+ * All subpackages share version, release and arch of the main package.
+ */
+static void
+spec_add_package(GString *spec, GString *install, cr_Package *pkg)
+{
+    g_string_append_printf(spec, "%%package -n %s\nSummary: %s\n",
+                           pkg->name, pkg->summary);
+    for (GSList *elem = pkg->provides; elem; elem = g_slist_next(elem)) {
+        cr_Dependency *dep = elem->data;
+        if (!g_strcmp0(dep->name, pkg->name))
+            continue;  // Provided automatically
+        g_string_append_printf(spec, "Provides: %s\n", dep->name);
+    }
+    for (GSList *elem = pkg->requires; elem; elem = g_slist_next(elem)) {
+        cr_Dependency *dep = elem->data;
+        if (dep->flags)
+            g_string_append_printf(spec, "Requires: %s >= %s\n",
+                                   dep->name, dep->version);
+        else
+            g_string_append_printf(spec, "Requires: %s\n", dep->name);
+    }
+    g_string_append_printf(spec, "\n%%description -n %s\n%s\n\n",
+                           pkg->name, pkg->description);
+
+    g_string_append_printf(spec, "%%files -n %s\n", pkg->name);
+    for (GSList *elem = pkg->files; elem; elem = g_slist_next(elem)) {
+        cr_PackageFile *file = elem->data;
+        g_string_append_printf(install,
+                               "mkdir -p %%{buildroot}%s\n"
+                               "echo %s > %%{buildroot}%s%s\n",
+                               file->path, pkg->pkgId, file->path, file->name);
+        g_string_append_printf(spec, "%s%s\n", file->path, file->name);
+    }
+    g_string_append(spec, "\n");
+}
+
+static gboolean
+gen_rpm_repo(const BenchSynthParams *params, const char *outdir, GError **err)
+{
+    gboolean ret = FALSE;
+    gchar *rpmbuild = g_find_program_in_path("rpmbuild");
+    gchar *topdir = NULL, *spec_path = NULL, *rpmdir = NULL;
+    GString *spec, *install;
+    gint exit_status = 0;
+
+    if (!rpmbuild) {
+        g_set_error(err, CREATEREPO_C_ERROR, CRE_NOFILE,
+                    "rpmbuild is required to generate rpms");
+        return FALSE;
+    }
+
+    rpmdir = g_build_filename(outdir, "Packages", NULL);
+    topdir = g_build_filename(outdir, ".rpmbuild", NULL);
+    spec_path = g_build_filename(outdir, ".rpmbuild", "synth.spec", NULL);
+    if (g_mkdir_with_parents(rpmdir, 0755)
+        || g_mkdir_with_parents(topdir, 0755))
+    {
+        g_set_error(err, CREATEREPO_C_ERROR, CRE_IO,
+                    "Cannot create directories in %s: %s",
+                    outdir, g_strerror(errno));
+        goto cleanup;
+    }
+
+    spec = g_string_new(NULL);
+    install = g_string_new("%install\n");
+    g_string_append(spec,
+            "Name: synthrepo\n"
+            "Version: 1.0\n"
+            "Release: 1\n"
+            "Summary: Synthetic packages for benchmarks\n"
+            "License: GPLv2+\n"
+            "BuildArch: noarch\n"
+            "\n"
+            "%description\n"
+            "Synthetic packages for benchmarks.\n"
+            "\n");
+
+    for (gint x = 0; x < params->packages; x++) {
+        cr_Package *pkg = bench_synth_package(params, x);
+        spec_add_package(spec, install, pkg);
+        cr_package_free(pkg);
+    }
+
+    g_string_append(spec, install->str);
+    g_string_append(spec, "\n%changelog\n");
+    for (gint x = params->changelogs; x > 0; x--) {
+        char date[64];
+        time_t t = (time_t) (BENCH_EPOCH - x * 86400);
+        struct tm tm;
+        gmtime_r(&t, &tm);
+        strftime(date, sizeof(date), "%a %b %d %Y", &tm);
+        g_string_append_printf(spec,
+                "* %s Bench Packager <bench@example.com> - 1.0-1\n"
+                "- Synthetic change %d\n\n", date, x);
+    }
+    g_string_free(install, TRUE);
+
+    if (!g_file_set_contents(spec_path, spec->str, -1, err)) {
+        g_string_free(spec, TRUE);
+        goto cleanup;
+    }
+    g_string_free(spec, TRUE);
+
+    gchar *topdir_def = g_strconcat("_topdir ", topdir, NULL);
+    gchar *rpmdir_def = g_strconcat("_rpmdir ", rpmdir, NULL);
+    gchar *argv[] = { rpmbuild, "--quiet", "-bb",
+                      "--define", topdir_def,
+                      "--define", rpmdir_def,
+                      "--define", "_build_name_fmt %%{NAME}-%%{VERSION}-%%{RELEASE}.%%{ARCH}.rpm",
+                      "--define", "use_source_date_epoch_as_buildtime 1",
+                      "--define", "clamp_mtime_to_source_date_epoch 1",
+                      "--define", "_buildhost bench.example.com",
+                      spec_path, NULL };
+    gchar *epoch = g_strdup_printf("%"G_GINT64_FORMAT, BENCH_EPOCH);
+    g_setenv("SOURCE_DATE_EPOCH", epoch, TRUE);
+
+    ret = g_spawn_sync(NULL, argv, NULL, 0, NULL, NULL,
+                       NULL, NULL, &exit_status, err);
+    if (ret && exit_status != 0) {
+        g_set_error(err, CREATEREPO_C_ERROR, CRE_ERROR,
+                    "rpmbuild failed (status %d)", exit_status);
+        ret = FALSE;
+    }
+
+    g_free(epoch);
+    g_free(topdir_def);
+    g_free(rpmdir_def);
+
+    if (ret)
+        cr_remove_dir(topdir, NULL);
+
+cleanup:
+    g_free(rpmbuild);
+    g_free(rpmdir);
+    g_free(topdir);
+    g_free(spec_path);
+    return ret;
+}
+
+int
+main(int argc, char **argv)
+{
+    BenchSynthParams params;
+    gchar *compress_type = NULL;
+    gboolean rpms = FALSE;
+    GError *tmp_err = NULL;
+    gboolean ret;
+
+    GOptionEntry entries[] = {
+        { "compress-type", 0, 0, G_OPTION_ARG_STRING, &compress_type,
+          "Compression of the generated xml files (gz, bz2, xz)", "TYPE" },
+        { "rpms", 0, 0, G_OPTION_ARG_NONE, &rpms,
+          "Generate rpm packages (requires rpmbuild) instead of xml "
+          "metadata", NULL },
+        { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL },
+    };
+
+    bench_synth_params_init(&params);
+
+    GOptionContext *context = g_option_context_new("OUTDIR");
+    g_option_context_set_summary(context,
+            "Generate a deterministic synthetic repository.");
+    g_option_context_add_main_entries(context,
+                                      bench_synth_option_entries(&params),
+                                      NULL);
+    g_option_context_add_main_entries(context, entries, NULL);
+    ret = g_option_context_parse(context, &argc, &argv, &tmp_err);
+    g_option_context_free(context);
+    if (!ret) {
+        fprintf(stderr, "%s\n", tmp_err->message);
+        g_error_free(tmp_err);
+        return EXIT_FAILURE;
+    }
+
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s [OPTIONS] OUTDIR\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    cr_CompressionType comtype = CR_CW_GZ_COMPRESSION;
+    if (compress_type) {
+        comtype = cr_compression_type(compress_type);
+        if (comtype == CR_CW_UNKNOWN_COMPRESSION) {
+            fprintf(stderr, "Unknown compression type: %s\n", compress_type);
+            return EXIT_FAILURE;
+        }
+    }
+
+    cr_xml_dump_init();
+
+    if (rpms)
+        ret = gen_rpm_repo(&params, argv[1], &tmp_err);
+    else
+        ret = gen_xml_repo(&params, argv[1], comtype, &tmp_err);
+
+    cr_xml_dump_cleanup();
+    g_free(compress_type);
+
+    if (!ret) {
+        fprintf(stderr, "Cannot generate repository: %s\n", tmp_err->message);
+        g_error_free(tmp_err);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -35,3 +35,9 @@ class TestCaseChecksum(unittest.TestCase):
 
         self.assertEqual(cr.checksum_type("foobar"), cr.UNKNOWN_CHECKSUM)
 
+    def test_checksum_file(self):
+        self.assertEqual(cr.checksum_file(FILE_TEXT, cr.SHA256),
+                         FILE_TEXT_SHA256SUM)
+        self.assertRaises(cr.CreaterepoCError, cr.checksum_file,
+                          "/this/file/does/not/exist", cr.SHA256)
+
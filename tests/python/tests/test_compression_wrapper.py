@@ -14,6 +14,8 @@ class TestCaseCompressionWrapper(unittest.TestCase):
         self.assertEqual(cr.compression_suffix(cr.GZ), ".gz")
         self.assertEqual(cr.compression_suffix(cr.BZ2), ".bz2")
         self.assertEqual(cr.compression_suffix(cr.XZ), ".xz")
+        self.assertEqual(cr.compression_suffix(cr.ZSTD), ".zst")
+        self.assertEqual(cr.compression_suffix(cr.ZCK), ".zck")
 
     def test_detect_compression(self):
 
@@ -37,6 +39,11 @@ class TestCaseCompressionWrapper(unittest.TestCase):
         comtype = cr.detect_compression(path)
         self.assertEqual(comtype, cr.XZ)
 
+        # zstd compression
+        path = os.path.join(COMPRESSED_FILES_PATH, "01_plain.txt.zst")
+        comtype = cr.detect_compression(path)
+        self.assertEqual(comtype, cr.ZSTD)
+
         # Bad suffix - no compression
         path = os.path.join(COMPRESSED_FILES_PATH, "01_plain.foo0")
         comtype = cr.detect_compression(path)
@@ -57,6 +64,11 @@ class TestCaseCompressionWrapper(unittest.TestCase):
         comtype = cr.detect_compression(path)
         self.assertEqual(comtype, cr.XZ)
 
+        # Bad suffix - zstd compression
+        path = os.path.join(COMPRESSED_FILES_PATH, "01_plain.foo4")
+        comtype = cr.detect_compression(path)
+        self.assertEqual(comtype, cr.ZSTD)
+
     def test_compression_type(self):
         self.assertEqual(cr.compression_type(None), cr.UNKNOWN_COMPRESSION)
         self.assertEqual(cr.compression_type(""), cr.UNKNOWN_COMPRESSION)
@@ -64,3 +76,6 @@ class TestCaseCompressionWrapper(unittest.TestCase):
         self.assertEqual(cr.compression_type("bz2"), cr.BZ2)
         self.assertEqual(cr.compression_type("xz"), cr.XZ)
         self.assertEqual(cr.compression_type("XZ"), cr.XZ)
+        self.assertEqual(cr.compression_type("zstd"), cr.ZSTD)
+        self.assertEqual(cr.compression_type("zst"), cr.ZSTD)
+        self.assertEqual(cr.compression_type("zck"), cr.ZCK)
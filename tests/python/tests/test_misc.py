@@ -79,3 +79,20 @@ class TestCaseMisc(unittest.TestCase):
         self.assertEqual(stat.checksum_type, cr.SHA256)
         self.assertEqual(stat.size, 910)
 
+
+    def test_decompress_file_read_params(self):
+        self.assertRaises(ValueError, cr.set_read_params, -1)
+
+        tmpfile_gz_comp = os.path.join(self.tmpdir, "gzipedfile.gz")
+        shutil.copy(FILE_TEXT_GZ, tmpfile_gz_comp)
+        dest = os.path.join(self.tmpdir, "decompressed.file")
+
+        # Small buffers, decoding in a separate thread and without it
+        for threaded in (True, False):
+            cr.set_read_params(16, 2, threaded)
+            stat = cr.ContentStat(cr.SHA256)
+            cr.decompress_file(tmpfile_gz_comp, dest, cr.GZ, stat)
+            self.assertEqual(stat.checksum, FILE_TEXT_SHA256SUM)
+            self.assertEqual(stat.size, 910)
+
+        cr.set_read_params()
@@ -229,3 +229,13 @@ class TestCasePackage(unittest.TestCase):
         self.assertEqual(pkg_d.name, "FooPackage")
         del(pkg_d)
 
+    def test_package_copying_keeps_order(self):
+        import copy
+
+        pkg = cr.Package()
+        pkg.files = [(None, '/usr/bin/', 'a'), ('dir', '/usr/', 'lib')]
+        pkg.changelogs = [('me', 1, 'first'), ('me', 2, 'second')]
+        pkg_c = copy.deepcopy(pkg)
+        self.assertEqual(pkg_c.files, pkg.files)
+        self.assertEqual(pkg_c.changelogs, pkg.changelogs)
+
@@ -129,6 +129,48 @@ class TestCaseRepomd(unittest.TestCase):
 </repomd>
 """)
 
+    def test_repomd_zchunk_header(self):
+        md = cr.Repomd()
+        md.revision = "1"
+
+        rec = cr.RepomdRecord("primary_zck", None)
+        rec.location_href = "repodata/primary.xml.zck"
+        rec.checksum = "foo"
+        rec.checksum_type = "sha256"
+        rec.checksum_header = "bar"
+        rec.checksum_header_type = "sha256"
+        rec.size = 200
+        rec.size_header = 100
+        rec.timestamp = 1
+        md.set_record(rec)
+
+        xml = md.xml_dump()
+        self.assertEqual(xml,
+"""<?xml version="1.0" encoding="UTF-8"?>
+<repomd xmlns="http://linux.duke.edu/metadata/repo" xmlns:rpm="http://linux.duke.edu/metadata/rpm">
+  <revision>1</revision>
+  <data type="primary_zck">
+    <checksum type="sha256">foo</checksum>
+    <header-checksum type="sha256">bar</header-checksum>
+    <location href="repodata/primary.xml.zck"/>
+    <timestamp>1</timestamp>
+    <size>200</size>
+    <header-size>100</header-size>
+  </data>
+</repomd>
+""")
+
+        # Parse it back
+        path = os.path.join(self.tmpdir, "repomd.xml")
+        with open(path, "w") as f:
+            f.write(xml)
+
+        rec = cr.Repomd(path)["primary_zck"]
+        self.assertEqual(rec.checksum_header, "bar")
+        self.assertEqual(rec.checksum_header_type, "sha256")
+        self.assertEqual(rec.size_header, 100)
+        self.assertEqual(rec.size_open, -1)
+
     def test_repomd_with_path_in_constructor_repo01(self):
 
         repomd = cr.Repomd(REPO_01_REPOMD)
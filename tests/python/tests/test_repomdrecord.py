@@ -38,6 +38,9 @@ class TestCaseRepomdRecord(unittest.TestCase):
         self.assertEqual(rec.timestamp, 0)
         self.assertEqual(rec.size, 0)
         self.assertEqual(rec.size_open, -1)
+        self.assertEqual(rec.checksum_header, None)
+        self.assertEqual(rec.checksum_header_type, None)
+        self.assertEqual(rec.size_header, -1)
         self.assertEqual(rec.db_ver, 0)
 
         rec.fill(cr.SHA256)
@@ -52,6 +55,9 @@ class TestCaseRepomdRecord(unittest.TestCase):
         self.assertTrue(rec.timestamp > 0)
         self.assertEqual(rec.size, 134)
         self.assertEqual(rec.size_open, 167)
+        # Not a zchunk file
+        self.assertEqual(rec.checksum_header, None)
+        self.assertEqual(rec.size_header, -1)
         self.assertEqual(rec.db_ver, 10)
 
         rec.rename_file()
@@ -92,6 +98,9 @@ class TestCaseRepomdRecord(unittest.TestCase):
         rec.timestamp = 123
         rec.size = 456
         rec.size_open = 789
+        rec.checksum_header = "foobar33"
+        rec.checksum_header_type = "foo3"
+        rec.size_header = 321
         rec.db_ver = 11
 
         # Check
@@ -106,6 +115,9 @@ class TestCaseRepomdRecord(unittest.TestCase):
         self.assertEqual(rec.timestamp, 123)
         self.assertEqual(rec.size, 456)
         self.assertEqual(rec.size_open, 789)
+        self.assertEqual(rec.checksum_header, "foobar33")
+        self.assertEqual(rec.checksum_header_type, "foo3")
+        self.assertEqual(rec.size_header, 321)
         self.assertEqual(rec.db_ver, 11)
 
     def test_repomdrecord_compress_and_fill(self):
@@ -55,6 +55,7 @@ class TestCaseSqlite(unittest.TestCase):
         db.close()
 
         self.assertRaises(cr.CreaterepoCError, db.add_pkg, pkg)
+        self.assertRaises(cr.CreaterepoCError, db.add_pkgs, [pkg])
         self.assertRaises(cr.CreaterepoCError, db.dbinfo_update, "somechecksum")
 
         db.close()  # No error shoud be raised
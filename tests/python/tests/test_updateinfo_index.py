@@ -0,0 +1,84 @@
+import unittest
+import shutil
+import tempfile
+import os.path
+import createrepo_c as cr
+
+from .fixtures import *
+
+class TestCaseUpdateInfoIndex(unittest.TestCase):
+
+    def setUp(self):
+        self.tmpdir = tempfile.mkdtemp(prefix="createrepo_ctest-")
+
+    def tearDown(self):
+        shutil.rmtree(self.tmpdir)
+
+    def _record(self, id, packages):
+        rec = cr.UpdateRecord()
+        rec.id = id
+        col = cr.UpdateCollection()
+        for name, epoch, version, release, arch in packages:
+            pkg = cr.UpdateCollectionPackage()
+            pkg.name = name
+            pkg.epoch = epoch
+            pkg.version = version
+            pkg.release = release
+            pkg.arch = arch
+            col.append(pkg)
+        rec.append_collection(col)
+        return rec
+
+    def _index(self):
+        idx = cr.UpdateInfoIndex()
+        idx.add_record(self._record("UPDATE-2",
+                                    [("foo", "0", "1.1", "1", "x86_64")]))
+        ui = cr.UpdateInfo()
+        ui.append(self._record("UPDATE-1",
+                               [("foo", None, "1.0", "1", "x86_64"),
+                                ("bar", "1", "1.0", "1", "noarch")]))
+        ui.append(self._record("UPDATE-3", []))
+        idx.add_updateinfo(ui)
+        return idx
+
+    def _check(self, idx):
+        self.assertEqual(len(idx), 3)
+        self.assertEqual(idx.updates_by_nevra("foo-0:1.0-1.x86_64"),
+                         ["UPDATE-1"])
+        self.assertEqual(idx.updates_by_nevra("foo-0:1.0-2.x86_64"), [])
+        self.assertEqual(idx.updates_by_name("foo"), ["UPDATE-1", "UPDATE-2"])
+        self.assertEqual(idx.packages("UPDATE-1"),
+                         ["bar-1:1.0-1.noarch", "foo-0:1.0-1.x86_64"])
+        self.assertEqual(idx.packages("UPDATE-3"), [])
+        self.assertEqual(idx.packages("UPDATE-4"), [])
+
+    def test_updateinfoindex_lookups(self):
+        idx = self._index()
+        self.assertTrue(idx)
+        self._check(idx)
+        self.assertRaises(TypeError, idx.add_record, None)
+        self.assertRaises(TypeError, idx.updates_by_nevra, None)
+
+    def test_updateinfoindex_write_load(self):
+        path = os.path.join(self.tmpdir, "updateinfo_index.gz")
+        self._index().write(path, cr.GZ_COMPRESSION)
+        self.assertTrue(os.path.isfile(path))
+        self._check(cr.UpdateInfoIndex(path))
+
+        idx = cr.UpdateInfoIndex()
+        self.assertRaises(cr.CreaterepoCError, idx.load,
+                          os.path.join(self.tmpdir, "missing"))
+
+    def test_updateinfoindex_parse(self):
+        path = os.path.join(self.tmpdir, "updateinfo.xml")
+        ui = cr.UpdateInfo()
+        ui.append(self._record("UPDATE-1",
+                               [("foo", "0", "1.0", "1", "x86_64")]))
+        with open(path, "w") as f:
+            f.write(ui.xml_dump())
+
+        idx = cr.UpdateInfoIndex()
+        idx.parse(path)
+        self.assertEqual(idx.updates_by_name("foo"), ["UPDATE-1"])
+        self.assertRaises(cr.CreaterepoCError, idx.parse,
+                          os.path.join(self.tmpdir, "missing"))
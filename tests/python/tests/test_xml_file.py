@@ -332,3 +332,33 @@ class TestCaseXmlFile(unittest.TestCase):
 <otherdata xmlns="http://linux.duke.edu/metadata/other" packages="0">
   <chunk>Some XML chunk</chunk>
 </otherdata>""")
+
+    def test_xmlfile_add_updaterecord(self):
+        rec = cr.UpdateRecord()
+        rec.fromstr = "security@foo.com"
+        rec.status = "final"
+        rec.type = "enhancement"
+        rec.version = "1"
+        rec.id = "UPDATE-1"
+        rec.title = "Foo <bar> & baz"
+
+        path = os.path.join(self.tmpdir, "updateinfo.xml")
+        f = cr.UpdateInfoXmlFile(path, cr.NO_COMPRESSION)
+        self.assertTrue(f)
+        f.add_updaterecord(rec)
+        self.assertRaises(TypeError, f.add_updaterecord, None)
+        self.assertRaises(TypeError, f.add_updaterecord, "foo")
+        f.close()
+
+        self.assertTrue(os.path.isfile(path))
+        self.assertEqual(open(path).read(),
+"""<?xml version="1.0" encoding="UTF-8"?>
+<updates>
+  <update from="security@foo.com" status="final" type="enhancement" version="1">
+    <id>UPDATE-1</id>
+    <title>Foo &lt;bar&gt; &amp; baz</title>
+    <references/>
+    <pkglist/>
+  </update>
+</updates>""")
+
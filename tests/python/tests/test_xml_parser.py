@@ -126,6 +126,33 @@ class TestCaseXmlParserPrimary(unittest.TestCase):
                           cr.xml_parse_primary,
                           REPO_02_PRIXML, None, None, None, 1)
 
+    def test_xml_parser_primary_repo02_batch(self):
+
+        batches = []
+
+        def batchcb(pkgs):
+            batches.append(pkgs)
+
+        cr.xml_parse_primary_batch(REPO_02_PRIXML, batchcb, batch_size=1)
+
+        self.assertEqual(len(batches), 2)
+        self.assertEqual([pkg.name for batch in batches for pkg in batch],
+            ['fake_bash', 'super_kernel'])
+
+        batches = []
+        cr.xml_parse_primary_batch(REPO_02_PRIXML, batchcb)
+
+        self.assertEqual(len(batches), 1)
+        self.assertEqual([pkg.name for pkg in batches[0]],
+            ['fake_bash', 'super_kernel'])
+
+    def test_xml_parser_primary_batchcb_abort(self):
+        def batchcb(pkgs):
+            raise Error("Foo error")
+        self.assertRaises(Exception,
+                          cr.xml_parse_primary_batch,
+                          REPO_02_PRIXML, batchcb)
+
     def test_xml_parser_primary_warnings(self):
 
         userdata = {
@@ -304,6 +331,18 @@ class TestCaseXmlParserFilelists(unittest.TestCase):
                           cr.xml_parse_filelists,
                           REPO_02_FILXML, None, None, None)
 
+    def test_xml_parser_filelists_repo02_batch(self):
+
+        pkgs = []
+
+        def batchcb(batch):
+            pkgs.extend(batch)
+
+        cr.xml_parse_filelists_batch(REPO_02_FILXML, batchcb, 1)
+
+        self.assertEqual([pkg.name for pkg in pkgs],
+            ['fake_bash', 'super_kernel'])
+
     def test_xml_parser_filelists_warnings(self):
 
         userdata = {
@@ -482,6 +521,18 @@ class TestCaseXmlParserOther(unittest.TestCase):
                           cr.xml_parse_other,
                           REPO_02_OTHXML, None, None, None)
 
+    def test_xml_parser_other_repo02_batch(self):
+
+        pkgs = []
+
+        def batchcb(batch):
+            pkgs.extend(batch)
+
+        cr.xml_parse_other_batch(REPO_02_OTHXML, batchcb, 1)
+
+        self.assertEqual([pkg.name for pkg in pkgs],
+            ['fake_bash', 'super_kernel'])
+
     def test_xml_parser_other_warnings(self):
 
         userdata = {
@@ -0,0 +1,173 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "fixtures.h"
+#include "test_common.h"
+#include "createrepo/checksum_cache.h"
+#include "createrepo/error.h"
+#include "createrepo/locate_metadata.h"
+#include "createrepo/misc.h"
+
+#define NUM_TEST_PKGS   9   // Packages in TEST_PACKAGES_PATH
+#define NUM_REPOS       4
+
+typedef struct {
+    gchar *tmp_dir;
+} TestData;
+
+static void
+testdata_setup(TestData *testdata, G_GNUC_UNUSED gconstpointer test_data)
+{
+    testdata->tmp_dir = g_strdup(TMPDIR_TEMPLATE);
+    g_assert(mkdtemp(testdata->tmp_dir));
+}
+
+static void
+testdata_teardown(TestData *testdata, G_GNUC_UNUSED gconstpointer test_data)
+{
+    cr_remove_dir(testdata->tmp_dir, NULL);
+    g_free(testdata->tmp_dir);
+}
+
+/** Copy the test packages into the pool directory and hardlink them
+ * into every repository directory.
+ */
+static void
+prepare_repos(const char *pool, gchar **repos)
+{
+    GDir *dir;
+    const gchar *name;
+
+    g_assert_cmpint(g_mkdir(pool, 0755), ==, 0);
+    for (int x = 0; repos[x]; x++)
+        g_assert_cmpint(g_mkdir(repos[x], 0755), ==, 0);
+
+    dir = g_dir_open(TEST_PACKAGES_PATH, 0, NULL);
+    g_assert(dir);
+    while ((name = g_dir_read_name(dir))) {
+        gchar *src = g_build_filename(TEST_PACKAGES_PATH, name, NULL);
+        gchar *dst = g_build_filename(pool, name, NULL);
+        gchar *content;
+        gsize len;
+
+        g_assert(g_file_get_contents(src, &content, &len, NULL));
+        g_assert(g_file_set_contents(dst, content, len, NULL));
+        g_free(content);
+
+        for (int x = 0; repos[x]; x++) {
+            gchar *link_path = g_build_filename(repos[x], name, NULL);
+            g_assert_cmpint(link(dst, link_path), ==, 0);
+            g_free(link_path);
+        }
+
+        g_free(src);
+        g_free(dst);
+    }
+    g_dir_close(dir);
+}
+
+static void
+test_createrepo_batch_shared_cache(TestData *testdata,
+                                   G_GNUC_UNUSED gconstpointer test_data)
+{
+    gchar *pool, *cachedir, *batch, *cache_path, *content;
+    gchar *repos[NUM_REPOS+1];
+    gchar **lines;
+    GHashTable *keys;
+    GString *batch_content = g_string_new(NULL);
+    guint records = 0;
+
+    pool = g_build_filename(testdata->tmp_dir, "pool", NULL);
+    cachedir = g_build_filename(testdata->tmp_dir, "cache", NULL);
+    batch = g_build_filename(testdata->tmp_dir, "repos.conf", NULL);
+    for (int x = 0; x < NUM_REPOS; x++) {
+        gchar *name = g_strdup_printf("repo%d", x);
+        gchar *quoted;
+        repos[x] = g_build_filename(testdata->tmp_dir, name, NULL);
+        quoted = g_shell_quote(repos[x]);
+        g_string_append_printf(batch_content, "%s\n", quoted);
+        g_free(quoted);
+        g_free(name);
+    }
+    repos[NUM_REPOS] = NULL;
+
+    prepare_repos(pool, repos);
+    g_assert(g_file_set_contents(batch, batch_content->str, -1, NULL));
+
+    // All repositories at the same time with the same cache
+    test_run_program(CREATEREPO_C_PATH, "--quiet", "--batch", batch,
+                     "--batch-jobs", "4", "--workers", "2",
+                     "--cachedir", cachedir, NULL);
+
+    for (int x = 0; x < NUM_REPOS; x++) {
+        struct cr_MetadataLocation *ml;
+        ml = cr_locate_metadata(repos[x], TRUE, NULL);
+        g_assert(ml);
+        g_assert(ml->pri_xml_href);
+        cr_metadatalocation_free(ml);
+    }
+
+    // Every package was hashed once - by the repository which came first,
+    // the others waited for its record
+    cache_path = g_build_filename(cachedir, CR_CHECKSUM_CACHE_FILENAME, NULL);
+    g_assert(g_file_get_contents(cache_path, &content, NULL, NULL));
+    keys = g_hash_table_new(g_str_hash, g_str_equal);
+    lines = g_strsplit(content, "\n", 0);
+    for (int x = 0; lines[x]; x++) {
+        char *tab;
+        if (*lines[x] == '#' || *lines[x] == '\0')
+            continue;
+        tab = strchr(lines[x], '\t');
+        g_assert(tab);
+        *tab = '\0';
+        g_hash_table_replace(keys, lines[x], lines[x]);
+        records++;
+    }
+    g_assert_cmpint(g_hash_table_size(keys), ==, NUM_TEST_PKGS);
+    g_assert_cmpint(records, ==, NUM_TEST_PKGS);
+
+    g_hash_table_destroy(keys);
+    g_strfreev(lines);
+    g_free(content);
+    g_free(cache_path);
+    for (int x = 0; x < NUM_REPOS; x++)
+        g_free(repos[x]);
+    g_string_free(batch_content, TRUE);
+    g_free(batch);
+    g_free(cachedir);
+    g_free(pool);
+}
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add("/batch/test_createrepo_batch_shared_cache",
+               TestData, NULL, testdata_setup,
+               test_createrepo_batch_shared_cache, testdata_teardown);
+
+    return g_test_run();
+}
@@ -99,6 +99,51 @@ test_cr_checksum_file(void)
 }
 
 
+static void
+test_cr_checksum_file_large(void)
+{
+    int fd;
+    char *checksum, *expected;
+    gchar *path;
+    guchar buf[4096];
+    cr_ChecksumCtx *ctx;
+    GError *tmp_err = NULL;
+
+    // File bigger than the internal read buffer with an odd size
+    for (size_t x = 0; x < sizeof(buf); x++)
+        buf[x] = (guchar) (x * 7);
+
+    path = g_strdup(TMPDIR_TEMPLATE);
+    fd = g_mkstemp(path);
+    g_assert_cmpint(fd, !=, -1);
+
+    ctx = cr_checksum_new(CR_CHECKSUM_SHA256, NULL);
+    for (int x = 0; x < 1000; x++) {
+        g_assert_cmpint(write(fd, buf, sizeof(buf)), ==, sizeof(buf));
+        cr_checksum_update(ctx, buf, sizeof(buf), NULL);
+    }
+    g_assert_cmpint(write(fd, buf, 123), ==, 123);
+    cr_checksum_update(ctx, buf, 123, NULL);
+    close(fd);
+    expected = cr_checksum_final(ctx, NULL);
+
+    checksum = cr_checksum_file(path, CR_CHECKSUM_SHA256, &tmp_err);
+    g_assert(!tmp_err);
+    g_assert_cmpstr(checksum, ==, expected);
+    g_free(checksum);
+
+    // Second run reuses the per-thread context
+    checksum = cr_checksum_file(path, CR_CHECKSUM_SHA256, &tmp_err);
+    g_assert(!tmp_err);
+    g_assert_cmpstr(checksum, ==, expected);
+    g_free(checksum);
+
+    g_free(expected);
+    g_remove(path);
+    g_free(path);
+}
+
+
 static void
 test_cr_checksum_name_str(void)
 {
@@ -136,6 +181,8 @@ main(int argc, char *argv[])
 
     g_test_add_func("/checksum/test_cr_checksum_file",
             test_cr_checksum_file);
+    g_test_add_func("/checksum/test_cr_checksum_file_large",
+            test_cr_checksum_file_large);
     g_test_add_func("/checksum/test_cr_checksum_name_str",
             test_cr_checksum_name_str);
 
@@ -0,0 +1,279 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "fixtures.h"
+#include "createrepo/checksum_cache.h"
+#include "createrepo/error.h"
+#include "createrepo/misc.h"
+
+#define KEY_01      "foo-1.0-1.noarch.rpm-abcdef-1024-1400000000"
+#define KEY_02      "bar-2.0-1.noarch.rpm-012345-2048-1400000001"
+#define KEY_03      "baz-3.0-1.noarch.rpm-6789ab-4096-1400000002"
+#define CHKSUM_01   "d41d8cd98f00b204e9800998ecf8427e"
+#define CHKSUM_02   "da39a3ee5e6b4b0d3255bfef95601890afd80709"
+#define CHKSUM_03   "e3b0c44298fc1c149afbf4c8996fb924"
+
+typedef struct {
+    gchar *tmp_dir;
+    gchar *path;
+} TestData;
+
+static void
+testdata_setup(TestData *testdata, G_GNUC_UNUSED gconstpointer test_data)
+{
+    testdata->tmp_dir = g_strdup(TMPDIR_TEMPLATE);
+    g_assert(mkdtemp(testdata->tmp_dir));
+    testdata->path = g_build_filename(testdata->tmp_dir,
+                                      CR_CHECKSUM_CACHE_FILENAME, NULL);
+}
+
+static void
+testdata_teardown(TestData *testdata, G_GNUC_UNUSED gconstpointer test_data)
+{
+    cr_remove_dir(testdata->tmp_dir, NULL);
+    g_free(testdata->tmp_dir);
+    g_free(testdata->path);
+}
+
+static void
+test_cr_checksumcache_insert_lookup(TestData *testdata,
+                                    G_GNUC_UNUSED gconstpointer test_data)
+{
+    cr_ChecksumCache *cache;
+    cr_ChecksumCacheStats stats;
+    GError *tmp_err = NULL;
+    int ret;
+
+    cache = cr_checksumcache_open(testdata->path, &tmp_err);
+    g_assert(cache);
+    g_assert(!tmp_err);
+
+    g_assert(!cr_checksumcache_lookup(cache, KEY_01));
+
+    ret = cr_checksumcache_insert(cache, KEY_01, CHKSUM_01, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+    g_assert_cmpstr(cr_checksumcache_lookup(cache, KEY_01), ==, CHKSUM_01);
+
+    // Invalid records are refused
+    ret = cr_checksumcache_insert(cache, "foo\tbar", CHKSUM_01, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_BADARG);
+    g_clear_error(&tmp_err);
+    ret = cr_checksumcache_insert(cache, KEY_02, "not a checksum", &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_BADARG);
+    g_clear_error(&tmp_err);
+
+    cr_checksumcache_stats(cache, &stats);
+    g_assert_cmpint(stats.hits, ==, 1);
+    g_assert_cmpint(stats.misses, ==, 1);
+    g_assert_cmpint(stats.inserts, ==, 1);
+
+    ret = cr_checksumcache_close(cache, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+
+    // Reopen - the record must be persistent
+    cache = cr_checksumcache_open(testdata->path, &tmp_err);
+    g_assert(cache);
+    g_assert_cmpstr(cr_checksumcache_lookup(cache, KEY_01), ==, CHKSUM_01);
+    g_assert(!cr_checksumcache_lookup(cache, KEY_02));
+
+    cr_checksumcache_stats(cache, &stats);
+    g_assert_cmpint(stats.records, ==, 1);
+    g_assert_cmpint(stats.stale, ==, 0);
+
+    cr_checksumcache_close(cache, NULL);
+}
+
+static void
+test_cr_checksumcache_compact(TestData *testdata,
+                              G_GNUC_UNUSED gconstpointer test_data)
+{
+    cr_ChecksumCache *cache;
+    cr_ChecksumCacheStats stats;
+    GError *tmp_err = NULL;
+    const gchar *content;
+    int ret;
+
+    // File with a duplicate, a malformed and an incomplete record
+    content = "# createrepo_c checksum cache\n"
+              KEY_01"\t"CHKSUM_02"\n"
+              KEY_01"\t"CHKSUM_01"\n"
+              "malformed record\n"
+              KEY_02"\t"CHKSUM_02"\n"
+              "incomplete\tab";
+    g_assert(g_file_set_contents(testdata->path, content, -1, NULL));
+
+    cache = cr_checksumcache_open(testdata->path, &tmp_err);
+    g_assert(cache);
+    g_assert(!tmp_err);
+
+    cr_checksumcache_stats(cache, &stats);
+    g_assert_cmpint(stats.records, ==, 2);
+    g_assert_cmpint(stats.stale, ==, 3);
+    g_assert_cmpstr(cr_checksumcache_lookup(cache, KEY_01), ==, CHKSUM_01);
+    g_assert_cmpstr(cr_checksumcache_lookup(cache, KEY_02), ==, CHKSUM_02);
+
+    ret = cr_checksumcache_compact(cache, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+    cr_checksumcache_close(cache, NULL);
+
+    cache = cr_checksumcache_open(testdata->path, &tmp_err);
+    g_assert(cache);
+    cr_checksumcache_stats(cache, &stats);
+    g_assert_cmpint(stats.records, ==, 2);
+    g_assert_cmpint(stats.stale, ==, 0);
+    g_assert_cmpstr(cr_checksumcache_lookup(cache, KEY_01), ==, CHKSUM_01);
+    g_assert_cmpstr(cr_checksumcache_lookup(cache, KEY_02), ==, CHKSUM_02);
+    cr_checksumcache_close(cache, NULL);
+}
+
+static void
+test_cr_checksumcache_compact_concurrent(TestData *testdata,
+                                         G_GNUC_UNUSED gconstpointer test_data)
+{
+    cr_ChecksumCache *cache, *other;
+    cr_ChecksumCacheStats stats;
+    GError *tmp_err = NULL;
+    int ret;
+
+    // Two runs share the cache file
+    cache = cr_checksumcache_open(testdata->path, &tmp_err);
+    g_assert(cache);
+    g_assert(!tmp_err);
+    other = cr_checksumcache_open(testdata->path, &tmp_err);
+    g_assert(other);
+    g_assert(!tmp_err);
+
+    // Record of the other run appended after this one indexed the file
+    ret = cr_checksumcache_insert(other, KEY_01, CHKSUM_01, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    ret = cr_checksumcache_flush(other, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+
+    ret = cr_checksumcache_insert(cache, KEY_02, CHKSUM_02, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    ret = cr_checksumcache_compact(cache, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+
+    // The other run writes into the compacted file, not the replaced one
+    ret = cr_checksumcache_insert(other, KEY_03, CHKSUM_03, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    ret = cr_checksumcache_flush(other, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+
+    cr_checksumcache_close(cache, NULL);
+    cr_checksumcache_close(other, NULL);
+
+    cache = cr_checksumcache_open(testdata->path, &tmp_err);
+    g_assert(cache);
+    g_assert(!tmp_err);
+    cr_checksumcache_stats(cache, &stats);
+    g_assert_cmpint(stats.records, ==, 3);
+    g_assert_cmpint(stats.stale, ==, 0);
+    g_assert_cmpstr(cr_checksumcache_lookup(cache, KEY_01), ==, CHKSUM_01);
+    g_assert_cmpstr(cr_checksumcache_lookup(cache, KEY_02), ==, CHKSUM_02);
+    g_assert_cmpstr(cr_checksumcache_lookup(cache, KEY_03), ==, CHKSUM_03);
+    cr_checksumcache_close(cache, NULL);
+}
+
+static void
+test_cr_checksumcache_lookup_concurrent(TestData *testdata,
+                                        G_GNUC_UNUSED gconstpointer test_data)
+{
+    cr_ChecksumCache *cache, *other;
+    cr_ChecksumCacheStats stats;
+    GError *tmp_err = NULL;
+    int ret;
+
+    // Two runs with the same cache file
+    cache = cr_checksumcache_open(testdata->path, &tmp_err);
+    g_assert(cache);
+    other = cr_checksumcache_open(testdata->path, &tmp_err);
+    g_assert(other);
+    g_assert(!tmp_err);
+
+    g_assert(!cr_checksumcache_lookup(cache, KEY_01));
+
+    // Records written by the other run are found
+    ret = cr_checksumcache_insert(other, KEY_01, CHKSUM_01, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!cr_checksumcache_lookup(cache, KEY_01));   // Not written yet
+    ret = cr_checksumcache_flush(other, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+    g_assert(!cr_checksumcache_lookup(cache, KEY_01));   // Not shared
+    cr_checksumcache_set_shared(cache, TRUE);
+    g_assert_cmpstr(cr_checksumcache_lookup(cache, KEY_01), ==, CHKSUM_01);
+
+    // Already known record is not written again
+    ret = cr_checksumcache_insert(cache, KEY_01, CHKSUM_01, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    cr_checksumcache_stats(cache, &stats);
+    g_assert_cmpint(stats.inserts, ==, 0);
+    g_assert_cmpint(stats.hits, ==, 1);
+
+    // And after the other run replaced the file by a compaction
+    ret = cr_checksumcache_insert(other, KEY_02, CHKSUM_02, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    ret = cr_checksumcache_compact(other, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    ret = cr_checksumcache_insert(other, KEY_03, CHKSUM_03, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    ret = cr_checksumcache_flush(other, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+    g_assert_cmpstr(cr_checksumcache_lookup(cache, KEY_03), ==, CHKSUM_03);
+    g_assert_cmpstr(cr_checksumcache_lookup(cache, KEY_02), ==, CHKSUM_02);
+    g_assert_cmpstr(cr_checksumcache_lookup(cache, KEY_01), ==, CHKSUM_01);
+
+    cr_checksumcache_close(other, NULL);
+    cr_checksumcache_close(cache, NULL);
+}
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add("/checksum_cache/test_cr_checksumcache_insert_lookup",
+               TestData, NULL, testdata_setup,
+               test_cr_checksumcache_insert_lookup, testdata_teardown);
+    g_test_add("/checksum_cache/test_cr_checksumcache_compact",
+               TestData, NULL, testdata_setup,
+               test_cr_checksumcache_compact, testdata_teardown);
+    g_test_add("/checksum_cache/test_cr_checksumcache_compact_concurrent",
+               TestData, NULL, testdata_setup,
+               test_cr_checksumcache_compact_concurrent, testdata_teardown);
+    g_test_add("/checksum_cache/test_cr_checksumcache_lookup_concurrent",
+               TestData, NULL, testdata_setup,
+               test_cr_checksumcache_lookup_concurrent, testdata_teardown);
+
+    return g_test_run();
+}
@@ -0,0 +1,205 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "fixtures.h"
+#include "createrepo/checksum_manifest.h"
+#include "createrepo/error.h"
+#include "createrepo/misc.h"
+
+#define SHA256_01   "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"
+#define SHA256_02   "5feceb66ffc86f38d952786c6d696c79c2dbc239dd4e91b46729d73a27fb57e9"
+#define SHA256_03   "6b86b273ff34fce19b6b804eff5c3f5747ada4e2f1d2f8f3d5a7b8c9e1d2f3a4"
+
+typedef struct {
+    gchar *tmp_dir;
+    gchar *path;
+} TestData;
+
+static void
+testdata_setup(TestData *testdata, G_GNUC_UNUSED gconstpointer test_data)
+{
+    testdata->tmp_dir = g_strdup(TMPDIR_TEMPLATE);
+    g_assert(mkdtemp(testdata->tmp_dir));
+    testdata->path = g_build_filename(testdata->tmp_dir, "SHA256SUMS", NULL);
+}
+
+static void
+testdata_teardown(TestData *testdata, G_GNUC_UNUSED gconstpointer test_data)
+{
+    cr_remove_dir(testdata->tmp_dir, NULL);
+    g_free(testdata->tmp_dir);
+    g_free(testdata->path);
+}
+
+static void
+write_manifest(const char *path, const char *content)
+{
+    g_assert(g_file_set_contents(path, content, -1, NULL));
+}
+
+static void
+test_cr_checksummanifest_load_lookup(TestData *testdata,
+                                     G_GNUC_UNUSED gconstpointer test_data)
+{
+    cr_ChecksumManifest *manifest;
+    cr_ChecksumManifestStats stats;
+    GError *tmp_err = NULL;
+    gboolean verify;
+
+    // Both formats, comments, uppercase checksum, "./" prefix,
+    // binary mode mark and a missing newline at the end
+    write_manifest(testdata->path,
+            "# generated by the build system\n"
+            SHA256_01 "  ./Packages/foo-1.0-1.noarch.rpm\r\n"
+            "\n"
+            "5FECEB66FFC86F38D952786C6D696C79C2DBC239DD4E91B46729D73A27FB57E9"
+                " *Packages/bar-2.0-1.noarch.rpm\n"
+            SHA256_03 "\t2048\t1400000000\tPackages/baz-3.0-1.noarch.rpm");
+
+    manifest = cr_checksummanifest_load(testdata->path, CR_CHECKSUM_SHA256,
+                                        &tmp_err);
+    g_assert(manifest);
+    g_assert(!tmp_err);
+
+    g_assert_cmpstr(cr_checksummanifest_lookup(manifest,
+                        "Packages/foo-1.0-1.noarch.rpm", 1, 2, &verify),
+                    ==, SHA256_01);
+    g_assert(!verify);
+    g_assert_cmpstr(cr_checksummanifest_lookup(manifest,
+                        "Packages/bar-2.0-1.noarch.rpm", 1, 2, NULL),
+                    ==, SHA256_02);
+
+    // Size and mtime must match when they are recorded
+    g_assert_cmpstr(cr_checksummanifest_lookup(manifest,
+                        "Packages/baz-3.0-1.noarch.rpm", 2048, 1400000000,
+                        NULL),
+                    ==, SHA256_03);
+    g_assert(!cr_checksummanifest_lookup(manifest,
+                        "Packages/baz-3.0-1.noarch.rpm", 2049, 1400000000,
+                        NULL));
+    g_assert(!cr_checksummanifest_lookup(manifest,
+                        "Packages/baz-3.0-1.noarch.rpm", 2048, 1400000001,
+                        NULL));
+
+    g_assert(!cr_checksummanifest_lookup(manifest,
+                        "Packages/missing-1.0-1.noarch.rpm", 1, 2, NULL));
+
+    cr_checksummanifest_stats(manifest, &stats);
+    g_assert_cmpint(stats.records, ==, 3);
+    g_assert_cmpint(stats.hits, ==, 3);
+    g_assert_cmpint(stats.misses, ==, 1);
+    g_assert_cmpint(stats.outdated, ==, 2);
+    g_assert_cmpint(stats.verified, ==, 0);
+    g_assert_cmpint(stats.mismatches, ==, 0);
+
+    cr_checksummanifest_free(manifest);
+}
+
+static void
+test_cr_checksummanifest_verify(TestData *testdata,
+                                G_GNUC_UNUSED gconstpointer test_data)
+{
+    cr_ChecksumManifest *manifest;
+    cr_ChecksumManifestStats stats;
+    GError *tmp_err = NULL;
+    gboolean verify;
+
+    write_manifest(testdata->path, SHA256_01 "  foo-1.0-1.noarch.rpm\n");
+
+    manifest = cr_checksummanifest_load(testdata->path, CR_CHECKSUM_SHA256,
+                                        &tmp_err);
+    g_assert(manifest);
+    g_assert(!tmp_err);
+
+    cr_checksummanifest_set_verify_rate(manifest, 100.0);
+    g_assert(cr_checksummanifest_lookup(manifest, "foo-1.0-1.noarch.rpm",
+                                        1, 2, &verify));
+    g_assert(verify);
+    cr_checksummanifest_verified(manifest, TRUE);
+    g_assert(cr_checksummanifest_lookup(manifest, "foo-1.0-1.noarch.rpm",
+                                        1, 2, &verify));
+    g_assert(verify);
+    cr_checksummanifest_verified(manifest, FALSE);
+
+    cr_checksummanifest_stats(manifest, &stats);
+    g_assert_cmpint(stats.hits, ==, 2);
+    g_assert_cmpint(stats.verified, ==, 2);
+    g_assert_cmpint(stats.mismatches, ==, 1);
+
+    cr_checksummanifest_free(manifest);
+}
+
+static void
+test_cr_checksummanifest_malformed(TestData *testdata,
+                                   G_GNUC_UNUSED gconstpointer test_data)
+{
+    cr_ChecksumManifest *manifest;
+    GError *tmp_err = NULL;
+
+    // Checksum of another type
+    write_manifest(testdata->path,
+                   SHA256_01 "  foo-1.0-1.noarch.rpm\n"
+                   "d41d8cd98f00b204e9800998ecf8427e  bar-2.0-1.noarch.rpm\n");
+    manifest = cr_checksummanifest_load(testdata->path, CR_CHECKSUM_SHA256,
+                                        &tmp_err);
+    g_assert(!manifest);
+    g_assert(tmp_err);
+    g_assert_cmpint(tmp_err->code, ==, CRE_BADARG);
+    g_assert(strstr(tmp_err->message, ":2:"));
+    g_clear_error(&tmp_err);
+
+    // Missing path
+    write_manifest(testdata->path, SHA256_01 "\n");
+    manifest = cr_checksummanifest_load(testdata->path, CR_CHECKSUM_SHA256,
+                                        &tmp_err);
+    g_assert(!manifest);
+    g_assert(tmp_err);
+    g_clear_error(&tmp_err);
+
+    // Missing file
+    manifest = cr_checksummanifest_load(testdata->tmp_dir, CR_CHECKSUM_SHA256,
+                                        &tmp_err);
+    g_assert(!manifest);
+    g_assert(tmp_err);
+    g_clear_error(&tmp_err);
+}
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add("/checksum_manifest/test_cr_checksummanifest_load_lookup",
+               TestData, NULL, testdata_setup,
+               test_cr_checksummanifest_load_lookup, testdata_teardown);
+    g_test_add("/checksum_manifest/test_cr_checksummanifest_verify",
+               TestData, NULL, testdata_setup,
+               test_cr_checksummanifest_verify, testdata_teardown);
+    g_test_add("/checksum_manifest/test_cr_checksummanifest_malformed",
+               TestData, NULL, testdata_setup,
+               test_cr_checksummanifest_malformed, testdata_teardown);
+
+    return g_test_run();
+}
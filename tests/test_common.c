@@ -0,0 +1,71 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <stdarg.h>
+#include "test_common.h"
+#include "createrepo/compression_wrapper.h"
+
+gchar *
+test_read_content(const char *path)
+{
+    CR_FILE *f;
+    GString *content = g_string_new(NULL);
+    char buf[4096];
+    int ret;
+
+    f = cr_open(path, CR_CW_MODE_READ, CR_CW_AUTO_DETECT_COMPRESSION, NULL);
+    g_assert(f);
+    while ((ret = cr_read(f, buf, sizeof(buf), NULL)) > 0)
+        g_string_append_len(content, buf, ret);
+    g_assert_cmpint(ret, ==, 0);
+    cr_close(f, NULL);
+
+    return g_string_free(content, FALSE);
+}
+
+void
+test_run_program(const char *program, const char *first, ...)
+{
+    va_list args;
+    GPtrArray *argv = g_ptr_array_new();
+    gint exit_status = -1;
+    gchar *out = NULL, *errout = NULL;
+    GError *tmp_err = NULL;
+    gboolean ret;
+
+    g_ptr_array_add(argv, (gpointer) program);
+    va_start(args, first);
+    for (const char *arg = first; arg; arg = va_arg(args, const char *))
+        g_ptr_array_add(argv, (gpointer) arg);
+    va_end(args);
+    g_ptr_array_add(argv, NULL);
+
+    ret = g_spawn_sync(NULL, (gchar **) argv->pdata, NULL, 0, NULL, NULL,
+                       &out, &errout, &exit_status, &tmp_err);
+    g_assert(!tmp_err);
+    g_assert(ret);
+    if (exit_status != 0)
+        g_test_message("%s failed:\n%s%s", program, out, errout);
+    g_assert_cmpint(exit_status, ==, 0);
+
+    g_free(out);
+    g_free(errout);
+    g_ptr_array_free(argv, TRUE);
+}
@@ -0,0 +1,43 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#ifndef __C_CREATEREPOLIB_TEST_COMMON_H__
+#define __C_CREATEREPOLIB_TEST_COMMON_H__
+
+#include <glib.h>
+
+/* Shared code of the tests:
+ *  - reading of (compressed) metadata files
+ *  - runs of the createrepo_c binaries
+ */
+
+/** Read the whole decompressed content of a file, assert it succeeded.
+ * @param path      Path to a file (compression is detected)
+ * @return          Content (free it with g_free())
+ */
+gchar *test_read_content(const char *path);
+
+/** Run a program with the NULL terminated list of arguments, assert
+ * it exited with 0. Its output is shown only if it failed.
+ * @param program   Path to the program
+ * @param first     First argument
+ */
+void test_run_program(const char *program, const char *first, ...);
+
+#endif /* __C_CREATEREPOLIB_TEST_COMMON_H__ */
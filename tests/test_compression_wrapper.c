@@ -22,6 +22,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <string.h>
 #include "fixtures.h"
 #include "createrepo/error.h"
 #include "createrepo/misc.h"
@@ -41,6 +42,8 @@
 #define FILE_COMPRESSED_0_GZ_BAD_SUFFIX         TEST_COMPRESSED_FILES_PATH"/00_plain.foo1"
 #define FILE_COMPRESSED_0_BZ2_BAD_SUFFIX        TEST_COMPRESSED_FILES_PATH"/00_plain.foo2"
 #define FILE_COMPRESSED_0_XZ_BAD_SUFFIX         TEST_COMPRESSED_FILES_PATH"/00_plain.foo3"
+#define FILE_COMPRESSED_0_ZSTD                  TEST_COMPRESSED_FILES_PATH"/00_plain.txt.zst"
+#define FILE_COMPRESSED_0_ZSTD_BAD_SUFFIX       TEST_COMPRESSED_FILES_PATH"/00_plain.foo4"
 
 #define FILE_COMPRESSED_1_CONTENT               "foobar foobar foobar foobar test test\nfolkjsaflkjsadokf\n"
 #define FILE_COMPRESSED_1_CONTENT_LEN           56
@@ -52,6 +55,8 @@
 #define FILE_COMPRESSED_1_GZ_BAD_SUFFIX         TEST_COMPRESSED_FILES_PATH"/01_plain.foo1"
 #define FILE_COMPRESSED_1_BZ2_BAD_SUFFIX        TEST_COMPRESSED_FILES_PATH"/01_plain.foo2"
 #define FILE_COMPRESSED_1_XZ_BAD_SUFFIX         TEST_COMPRESSED_FILES_PATH"/01_plain.foo3"
+#define FILE_COMPRESSED_1_ZSTD                  TEST_COMPRESSED_FILES_PATH"/01_plain.txt.zst"
+#define FILE_COMPRESSED_1_ZSTD_BAD_SUFFIX       TEST_COMPRESSED_FILES_PATH"/01_plain.foo4"
 
 
 static void
@@ -97,6 +102,12 @@ test_cr_compression_suffix(void)
 
     suffix = cr_compression_suffix(CR_CW_XZ_COMPRESSION);
     g_assert_cmpstr(suffix, ==, ".xz");
+
+    suffix = cr_compression_suffix(CR_CW_ZSTD_COMPRESSION);
+    g_assert_cmpstr(suffix, ==, ".zst");
+
+    suffix = cr_compression_suffix(CR_CW_ZCK_COMPRESSION);
+    g_assert_cmpstr(suffix, ==, ".zck");
 }
 
 static void
@@ -133,6 +144,15 @@ test_cr_compression_type(void)
 
     type = cr_compression_type("xz");
     g_assert_cmpint(type, ==, CR_CW_XZ_COMPRESSION);
+
+    type = cr_compression_type("zstd");
+    g_assert_cmpint(type, ==, CR_CW_ZSTD_COMPRESSION);
+
+    type = cr_compression_type("zst");
+    g_assert_cmpint(type, ==, CR_CW_ZSTD_COMPRESSION);
+
+    type = cr_compression_type("zck");
+    g_assert_cmpint(type, ==, CR_CW_ZCK_COMPRESSION);
 }
 
 static void
@@ -176,6 +196,15 @@ test_cr_detect_compression(void)
     ret = cr_detect_compression(FILE_COMPRESSED_1_XZ, &tmp_err);
     g_assert_cmpint(ret, ==, CR_CW_XZ_COMPRESSION);
     g_assert(!tmp_err);
+
+    // Zstd
+
+    ret = cr_detect_compression(FILE_COMPRESSED_0_ZSTD, &tmp_err);
+    g_assert_cmpint(ret, ==, CR_CW_ZSTD_COMPRESSION);
+    g_assert(!tmp_err);
+    ret = cr_detect_compression(FILE_COMPRESSED_1_ZSTD, &tmp_err);
+    g_assert_cmpint(ret, ==, CR_CW_ZSTD_COMPRESSION);
+    g_assert(!tmp_err);
 }
 
 
@@ -220,6 +249,15 @@ test_cr_detect_compression_bad_suffix(void)
     ret = cr_detect_compression(FILE_COMPRESSED_1_XZ_BAD_SUFFIX, &tmp_err);
     g_assert_cmpint(ret, ==, CR_CW_XZ_COMPRESSION);
     g_assert(!tmp_err);
+
+    // Zstd
+
+    ret = cr_detect_compression(FILE_COMPRESSED_0_ZSTD_BAD_SUFFIX, &tmp_err);
+    g_assert_cmpint(ret, ==, CR_CW_ZSTD_COMPRESSION);
+    g_assert(!tmp_err);
+    ret = cr_detect_compression(FILE_COMPRESSED_1_ZSTD_BAD_SUFFIX, &tmp_err);
+    g_assert_cmpint(ret, ==, CR_CW_ZSTD_COMPRESSION);
+    g_assert(!tmp_err);
 }
 
 
@@ -280,6 +318,51 @@ test_cr_read_with_autodetection(void)
             FILE_COMPRESSED_0_CONTENT, FILE_COMPRESSED_0_CONTENT_LEN);
     test_helper_cw_input(FILE_COMPRESSED_1_XZ, CR_CW_AUTO_DETECT_COMPRESSION,
             FILE_COMPRESSED_1_CONTENT, FILE_COMPRESSED_1_CONTENT_LEN);
+
+#ifdef WITH_ZSTD
+    // Zstd
+
+    test_helper_cw_input(FILE_COMPRESSED_0_ZSTD, CR_CW_AUTO_DETECT_COMPRESSION,
+            FILE_COMPRESSED_0_CONTENT, FILE_COMPRESSED_0_CONTENT_LEN);
+    test_helper_cw_input(FILE_COMPRESSED_1_ZSTD, CR_CW_AUTO_DETECT_COMPRESSION,
+            FILE_COMPRESSED_1_CONTENT, FILE_COMPRESSED_1_CONTENT_LEN);
+#endif
+}
+
+
+static void
+test_cr_read_params(void)
+{
+    // Decoding in the calling thread
+
+    cr_compression_set_read_params(0, 1, FALSE);
+    test_helper_cw_input(FILE_COMPRESSED_1_GZ, CR_CW_AUTO_DETECT_COMPRESSION,
+            FILE_COMPRESSED_1_CONTENT, FILE_COMPRESSED_1_CONTENT_LEN);
+    test_helper_cw_input(FILE_COMPRESSED_1_BZ2, CR_CW_AUTO_DETECT_COMPRESSION,
+            FILE_COMPRESSED_1_CONTENT, FILE_COMPRESSED_1_CONTENT_LEN);
+    test_helper_cw_input(FILE_COMPRESSED_1_XZ, CR_CW_AUTO_DETECT_COMPRESSION,
+            FILE_COMPRESSED_1_CONTENT, FILE_COMPRESSED_1_CONTENT_LEN);
+
+    // Decoding thread with tiny buffers - content is handed over
+    // through many buffer switches
+
+    cr_compression_set_read_params(7, 2, TRUE);
+    test_helper_cw_input(FILE_COMPRESSED_0_GZ, CR_CW_AUTO_DETECT_COMPRESSION,
+            FILE_COMPRESSED_0_CONTENT, FILE_COMPRESSED_0_CONTENT_LEN);
+    test_helper_cw_input(FILE_COMPRESSED_1_GZ, CR_CW_AUTO_DETECT_COMPRESSION,
+            FILE_COMPRESSED_1_CONTENT, FILE_COMPRESSED_1_CONTENT_LEN);
+    test_helper_cw_input(FILE_COMPRESSED_1_BZ2, CR_CW_AUTO_DETECT_COMPRESSION,
+            FILE_COMPRESSED_1_CONTENT, FILE_COMPRESSED_1_CONTENT_LEN);
+    test_helper_cw_input(FILE_COMPRESSED_0_XZ, CR_CW_AUTO_DETECT_COMPRESSION,
+            FILE_COMPRESSED_0_CONTENT, FILE_COMPRESSED_0_CONTENT_LEN);
+    test_helper_cw_input(FILE_COMPRESSED_1_XZ, CR_CW_AUTO_DETECT_COMPRESSION,
+            FILE_COMPRESSED_1_CONTENT, FILE_COMPRESSED_1_CONTENT_LEN);
+#ifdef WITH_ZSTD
+    test_helper_cw_input(FILE_COMPRESSED_1_ZSTD, CR_CW_AUTO_DETECT_COMPRESSION,
+            FILE_COMPRESSED_1_CONTENT, FILE_COMPRESSED_1_CONTENT_LEN);
+#endif
+
+    cr_compression_set_read_params(0, 0, TRUE);
 }
 
 
@@ -446,6 +529,171 @@ outputtest_cw_output(Outputtest *outputtest,
     test_helper_cw_output(OUTPUT_TYPE_PRINTF, outputtest->tmp_filename,
                           CR_CW_XZ_COMPRESSION, FILE_COMPRESSED_1_CONTENT,
                           FILE_COMPRESSED_1_CONTENT_LEN);
+
+#ifdef WITH_ZSTD
+    // Zstd
+
+    test_helper_cw_output(OUTPUT_TYPE_WRITE,  outputtest->tmp_filename,
+                          CR_CW_ZSTD_COMPRESSION, FILE_COMPRESSED_0_CONTENT,
+                          FILE_COMPRESSED_0_CONTENT_LEN);
+    test_helper_cw_output(OUTPUT_TYPE_WRITE,  outputtest->tmp_filename,
+                          CR_CW_ZSTD_COMPRESSION, FILE_COMPRESSED_1_CONTENT,
+                          FILE_COMPRESSED_1_CONTENT_LEN);
+    test_helper_cw_output(OUTPUT_TYPE_PUTS,   outputtest->tmp_filename,
+                          CR_CW_ZSTD_COMPRESSION, FILE_COMPRESSED_0_CONTENT,
+                          FILE_COMPRESSED_0_CONTENT_LEN);
+    test_helper_cw_output(OUTPUT_TYPE_PUTS,   outputtest->tmp_filename,
+                          CR_CW_ZSTD_COMPRESSION, FILE_COMPRESSED_1_CONTENT,
+                          FILE_COMPRESSED_1_CONTENT_LEN);
+    test_helper_cw_output(OUTPUT_TYPE_PRINTF, outputtest->tmp_filename,
+                          CR_CW_ZSTD_COMPRESSION, FILE_COMPRESSED_0_CONTENT,
+                          FILE_COMPRESSED_0_CONTENT_LEN);
+    test_helper_cw_output(OUTPUT_TYPE_PRINTF, outputtest->tmp_filename,
+                          CR_CW_ZSTD_COMPRESSION, FILE_COMPRESSED_1_CONTENT,
+                          FILE_COMPRESSED_1_CONTENT_LEN);
+
+    // Zstd with long distance matching and workers
+
+    cr_compression_set_zstd_params(3, TRUE, 2);
+    test_helper_cw_output(OUTPUT_TYPE_WRITE,  outputtest->tmp_filename,
+                          CR_CW_ZSTD_COMPRESSION, FILE_COMPRESSED_1_CONTENT,
+                          FILE_COMPRESSED_1_CONTENT_LEN);
+    cr_compression_set_zstd_params(0, FALSE, 0);
+#endif
+
+#ifdef WITH_ZCHUNK
+    // Zchunk
+
+    test_helper_cw_output(OUTPUT_TYPE_WRITE,  outputtest->tmp_filename,
+                          CR_CW_ZCK_COMPRESSION, FILE_COMPRESSED_0_CONTENT,
+                          FILE_COMPRESSED_0_CONTENT_LEN);
+    test_helper_cw_output(OUTPUT_TYPE_WRITE,  outputtest->tmp_filename,
+                          CR_CW_ZCK_COMPRESSION, FILE_COMPRESSED_1_CONTENT,
+                          FILE_COMPRESSED_1_CONTENT_LEN);
+    test_helper_cw_output(OUTPUT_TYPE_PUTS,   outputtest->tmp_filename,
+                          CR_CW_ZCK_COMPRESSION, FILE_COMPRESSED_0_CONTENT,
+                          FILE_COMPRESSED_0_CONTENT_LEN);
+    test_helper_cw_output(OUTPUT_TYPE_PUTS,   outputtest->tmp_filename,
+                          CR_CW_ZCK_COMPRESSION, FILE_COMPRESSED_1_CONTENT,
+                          FILE_COMPRESSED_1_CONTENT_LEN);
+    test_helper_cw_output(OUTPUT_TYPE_PRINTF, outputtest->tmp_filename,
+                          CR_CW_ZCK_COMPRESSION, FILE_COMPRESSED_0_CONTENT,
+                          FILE_COMPRESSED_0_CONTENT_LEN);
+    test_helper_cw_output(OUTPUT_TYPE_PRINTF, outputtest->tmp_filename,
+                          CR_CW_ZCK_COMPRESSION, FILE_COMPRESSED_1_CONTENT,
+                          FILE_COMPRESSED_1_CONTENT_LEN);
+#endif
+}
+
+
+static void
+test_helper_cw_chunks(const char *filename, cr_CompressionType ctype)
+{
+    int ret;
+    CR_FILE *file;
+    GError *tmp_err = NULL;
+    gchar *content = g_strconcat(FILE_COMPRESSED_0_CONTENT,
+                                 FILE_COMPRESSED_1_CONTENT, NULL);
+
+    file = cr_open(filename, CR_CW_MODE_WRITE, ctype, &tmp_err);
+    g_assert(file);
+    g_assert(!tmp_err);
+
+    ret = cr_puts(file, FILE_COMPRESSED_0_CONTENT, &tmp_err);
+    g_assert_cmpint(ret, ==, FILE_COMPRESSED_0_CONTENT_LEN);
+    g_assert(!tmp_err);
+
+    ret = cr_end_chunk(file, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+
+    ret = cr_puts(file, FILE_COMPRESSED_1_CONTENT, &tmp_err);
+    g_assert_cmpint(ret, ==, FILE_COMPRESSED_1_CONTENT_LEN);
+    g_assert(!tmp_err);
+
+    ret = cr_end_chunk(file, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+
+    ret = cr_close(file, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+
+    test_helper_cw_input(filename, ctype, content, strlen(content));
+    g_free(content);
+}
+
+
+static void
+outputtest_cw_chunks(Outputtest *outputtest,
+                     G_GNUC_UNUSED gconstpointer test_data)
+{
+    CR_FILE *file;
+    int ret;
+    GError *tmp_err = NULL;
+
+    // Ending a chunk is a no-op for a common compression
+
+    test_helper_cw_chunks(outputtest->tmp_filename, CR_CW_NO_COMPRESSION);
+    test_helper_cw_chunks(outputtest->tmp_filename, CR_CW_GZ_COMPRESSION);
+    test_helper_cw_chunks(outputtest->tmp_filename, CR_CW_XZ_COMPRESSION);
+
+    // But a dictionary cannot be used
+
+    file = cr_open(outputtest->tmp_filename, CR_CW_MODE_WRITE,
+                   CR_CW_GZ_COMPRESSION, &tmp_err);
+    g_assert(file);
+    ret = cr_set_dict(file, "dict", 4, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_BADARG);
+    g_assert(tmp_err);
+    g_clear_error(&tmp_err);
+    cr_close(file, NULL);
+
+#ifdef WITH_ZCHUNK
+    char *checksum = NULL;
+    cr_ChecksumType checksum_type;
+    gint64 size = -1;
+
+    test_helper_cw_chunks(outputtest->tmp_filename, CR_CW_ZCK_COMPRESSION);
+
+    ret = cr_get_zchunk_header_info(outputtest->tmp_filename, &checksum,
+                                    &checksum_type, &size, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+    g_assert(checksum);
+    g_assert_cmpint(checksum_type, ==, CR_CHECKSUM_SHA256);
+    g_assert_cmpint(size, >, 0);
+    g_free(checksum);
+
+    // Zchunk with a dictionary
+
+    file = cr_open(outputtest->tmp_filename, CR_CW_MODE_WRITE,
+                   CR_CW_ZCK_COMPRESSION, &tmp_err);
+    g_assert(file);
+    ret = cr_set_dict(file, FILE_COMPRESSED_1_CONTENT,
+                      FILE_COMPRESSED_1_CONTENT_LEN, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+    ret = cr_puts(file, FILE_COMPRESSED_1_CONTENT, &tmp_err);
+    g_assert_cmpint(ret, ==, FILE_COMPRESSED_1_CONTENT_LEN);
+    ret = cr_close(file, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+
+    test_helper_cw_input(outputtest->tmp_filename, CR_CW_ZCK_COMPRESSION,
+                         FILE_COMPRESSED_1_CONTENT,
+                         FILE_COMPRESSED_1_CONTENT_LEN);
+#else
+    char *checksum = NULL;
+    cr_ChecksumType checksum_type;
+    gint64 size = -1;
+
+    ret = cr_get_zchunk_header_info(outputtest->tmp_filename, &checksum,
+                                    &checksum_type, &size, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_ZCK);
+    g_assert(tmp_err);
+    g_clear_error(&tmp_err);
+#endif
 }
 
 
@@ -717,6 +965,95 @@ test_contentstating_multiwrite(Outputtest *outputtest,
 }
 
 
+static void
+test_cr_variant(Outputtest *outputtest, G_GNUC_UNUSED gconstpointer test_data)
+{
+    CR_FILE *f, *variant;
+    int ret;
+    cr_ContentStat *stat, *variant_stat;
+    gchar *variant_filename;
+    GString *content;
+    char *buffer;
+    GError *tmp_err = NULL;
+
+    // More than a single block of the tee
+    content = g_string_new(NULL);
+    for (int x = 0; content->len < 3*1024*1024; x++)
+        g_string_append_printf(content, "<package>%d</package>\n", x);
+
+    variant_filename = g_strconcat(outputtest->tmp_filename, ".xz", NULL);
+
+    stat = cr_contentstat_new(CR_CHECKSUM_SHA256, &tmp_err);
+    g_assert(!tmp_err);
+    variant_stat = cr_contentstat_new(CR_CHECKSUM_SHA256, &tmp_err);
+    g_assert(!tmp_err);
+
+    f = cr_sopen(outputtest->tmp_filename, CR_CW_MODE_WRITE,
+                 CR_CW_GZ_COMPRESSION, stat, &tmp_err);
+    g_assert(f);
+    g_assert(!tmp_err);
+
+    variant = cr_sopen(variant_filename, CR_CW_MODE_WRITE,
+                       CR_CW_XZ_COMPRESSION, variant_stat, &tmp_err);
+    g_assert(variant);
+    g_assert(!tmp_err);
+
+    ret = cr_add_variant(f, variant, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+
+    // Odd sizes to cross the block boundaries
+    for (gsize offset = 0; offset < content->len; offset += 100003) {
+        int len = MIN(100003, content->len - offset);
+        ret = cr_write(f, content->str + offset, len, &tmp_err);
+        g_assert_cmpint(ret, ==, len);
+        g_assert(!tmp_err);
+    }
+
+    ret = cr_close(f, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+
+    g_assert_cmpint(stat->size, ==, content->len);
+    g_assert_cmpint(variant_stat->size, ==, content->len);
+    g_assert_cmpstr(stat->checksum, ==, variant_stat->checksum);
+
+    // Content of the variant
+    buffer = g_malloc(content->len + 1);
+    variant = cr_open(variant_filename, CR_CW_MODE_READ,
+                      CR_CW_AUTO_DETECT_COMPRESSION, &tmp_err);
+    g_assert(variant);
+    g_assert(!tmp_err);
+    ret = cr_read(variant, buffer, content->len + 1, &tmp_err);
+    g_assert_cmpint(ret, ==, content->len);
+    g_assert(!tmp_err);
+    g_assert(!memcmp(buffer, content->str, content->len));
+    cr_close(variant, &tmp_err);
+    g_assert(!tmp_err);
+
+    // Variants must be opened for writing
+    f = cr_open(outputtest->tmp_filename, CR_CW_MODE_WRITE,
+                CR_CW_GZ_COMPRESSION, &tmp_err);
+    g_assert(f);
+    variant = cr_open(variant_filename, CR_CW_MODE_READ,
+                      CR_CW_AUTO_DETECT_COMPRESSION, &tmp_err);
+    g_assert(variant);
+    ret = cr_add_variant(f, variant, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_BADARG);
+    g_assert(tmp_err);
+    g_clear_error(&tmp_err);
+    cr_close(variant, NULL);
+    cr_close(f, NULL);
+
+    remove(variant_filename);
+    g_free(variant_filename);
+    g_free(buffer);
+    g_string_free(content, TRUE);
+    cr_contentstat_free(stat, NULL);
+    cr_contentstat_free(variant_stat, NULL);
+}
+
+
 int
 main(int argc, char *argv[])
 {
@@ -734,8 +1071,12 @@ main(int argc, char *argv[])
             test_cr_detect_compression_bad_suffix);
     g_test_add_func("/compression_wrapper/test_cr_read_with_autodetection",
             test_cr_read_with_autodetection);
+    g_test_add_func("/compression_wrapper/test_cr_read_params",
+                    test_cr_read_params);
     g_test_add("/compression_wrapper/outputtest_cw_output", Outputtest, NULL,
             outputtest_setup, outputtest_cw_output, outputtest_teardown);
+    g_test_add("/compression_wrapper/outputtest_cw_chunks", Outputtest, NULL,
+            outputtest_setup, outputtest_cw_chunks, outputtest_teardown);
     g_test_add_func("/compression_wrapper/test_cr_error_handling",
             test_cr_error_handling);
     g_test_add("/compression_wrapper/test_contentstating_singlewrite",
@@ -744,6 +1085,9 @@ main(int argc, char *argv[])
     g_test_add("/compression_wrapper/test_contentstating_multiwrite",
             Outputtest, NULL, outputtest_setup,
             test_contentstating_multiwrite, outputtest_teardown);
+    g_test_add("/compression_wrapper/test_cr_variant",
+            Outputtest, NULL, outputtest_setup,
+            test_cr_variant, outputtest_teardown);
 
     return g_test_run();
 }
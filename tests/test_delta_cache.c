@@ -0,0 +1,389 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include "fixtures.h"
+#include "createrepo/delta_cache.h"
+#include "createrepo/error.h"
+#include "createrepo/misc.h"
+
+typedef struct {
+    gchar *tmp_dir;
+    gchar *old_pkg;
+    gchar *new_pkg;
+    gchar *drpm_01;
+    gchar *drpm_02;
+} TestData;
+
+/** Write the file in place (g_file_set_contents() changes the inode).
+ */
+static void
+write_file(const char *path, const char *content)
+{
+    FILE *f = fopen(path, "w");
+    g_assert(f);
+    g_assert(fputs(content, f) >= 0);
+    fclose(f);
+}
+
+static void
+testdata_setup(TestData *testdata, G_GNUC_UNUSED gconstpointer test_data)
+{
+    testdata->tmp_dir = g_strdup(TMPDIR_TEMPLATE);
+    g_assert(mkdtemp(testdata->tmp_dir));
+    testdata->old_pkg = g_build_filename(testdata->tmp_dir, "foo-1.rpm", NULL);
+    testdata->new_pkg = g_build_filename(testdata->tmp_dir, "foo-2.rpm", NULL);
+    testdata->drpm_01 = g_build_filename(testdata->tmp_dir, "foo-1_2.drpm", NULL);
+    testdata->drpm_02 = g_build_filename(testdata->tmp_dir, "foo-0_2.drpm", NULL);
+    write_file(testdata->old_pkg, "old package");
+    write_file(testdata->new_pkg, "new package");
+    write_file(testdata->drpm_01, "delta 1");
+    write_file(testdata->drpm_02, "delta 2");
+}
+
+static void
+testdata_teardown(TestData *testdata, G_GNUC_UNUSED gconstpointer test_data)
+{
+    cr_remove_dir(testdata->tmp_dir, NULL);
+    g_free(testdata->tmp_dir);
+    g_free(testdata->old_pkg);
+    g_free(testdata->new_pkg);
+    g_free(testdata->drpm_01);
+    g_free(testdata->drpm_02);
+}
+
+static void
+test_cr_deltacache_insert_lookup(TestData *testdata,
+                                 G_GNUC_UNUSED gconstpointer test_data)
+{
+    cr_DeltaCache *cache;
+    cr_DeltaCacheStats stats;
+    GError *tmp_err = NULL;
+    gchar *old_id, *new_id, *path;
+    int ret;
+
+    cache = cr_deltacache_open(testdata->tmp_dir, CR_CHECKSUM_SHA256, &tmp_err);
+    g_assert(cache);
+    g_assert(!tmp_err);
+
+    old_id = cr_deltacache_pkgid(cache, testdata->old_pkg, &tmp_err);
+    g_assert(old_id);
+    new_id = cr_deltacache_pkgid(cache, testdata->new_pkg, &tmp_err);
+    g_assert(new_id);
+    g_assert_cmpstr(old_id, !=, new_id);
+
+    g_assert(!cr_deltacache_lookup(cache, old_id, new_id));
+
+    ret = cr_deltacache_insert(cache, old_id, new_id, testdata->drpm_01,
+                               2000000, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+
+    path = cr_deltacache_lookup(cache, old_id, new_id);
+    g_assert_cmpstr(path, ==, testdata->drpm_01);
+    g_free(path);
+
+    ret = cr_deltacache_close(cache, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+
+    // The delta survives a reopen
+    cache = cr_deltacache_open(testdata->tmp_dir, CR_CHECKSUM_SHA256, &tmp_err);
+    g_assert(cache);
+    path = cr_deltacache_lookup(cache, old_id, new_id);
+    g_assert_cmpstr(path, ==, testdata->drpm_01);
+    g_free(path);
+
+    cr_deltacache_stats(cache, &stats);
+    g_assert_cmpint(stats.records, ==, 1);
+    g_assert_cmpint(stats.hits, ==, 1);
+    g_assert_cmpint(stats.misses, ==, 0);
+    g_assert_cmpint(stats.saved_us, ==, 2000000);
+
+    // Modified delta is not used
+    write_file(testdata->drpm_01, "modified delta 1");
+    g_assert(!cr_deltacache_lookup(cache, old_id, new_id));
+    cr_deltacache_stats(cache, &stats);
+    g_assert_cmpint(stats.misses, ==, 1);
+
+    cr_deltacache_close(cache, NULL);
+    g_free(old_id);
+    g_free(new_id);
+}
+
+static void
+test_cr_deltacache_pkgid(TestData *testdata,
+                         G_GNUC_UNUSED gconstpointer test_data)
+{
+    cr_DeltaCache *cache;
+    GError *tmp_err = NULL;
+    gchar *pkgid, *pkgid_cached;
+    struct stat st;
+    struct utimbuf times;
+
+    cache = cr_deltacache_open(testdata->tmp_dir, CR_CHECKSUM_SHA256, &tmp_err);
+    g_assert(cache);
+    pkgid = cr_deltacache_pkgid(cache, testdata->old_pkg, &tmp_err);
+    g_assert(pkgid);
+    cr_deltacache_close(cache, NULL);
+
+    // Same size and mtime -> the remembered checksum is used
+    g_assert(stat(testdata->old_pkg, &st) == 0);
+    write_file(testdata->old_pkg, "OLD PACKAGE");
+    times.actime = st.st_atime;
+    times.modtime = st.st_mtime;
+    g_assert(utime(testdata->old_pkg, &times) == 0);
+
+    cache = cr_deltacache_open(testdata->tmp_dir, CR_CHECKSUM_SHA256, &tmp_err);
+    g_assert(cache);
+    pkgid_cached = cr_deltacache_pkgid(cache, testdata->old_pkg, &tmp_err);
+    g_assert_cmpstr(pkgid, ==, pkgid_cached);
+    g_free(pkgid_cached);
+
+    // Changed mtime -> the checksum is calculated again
+    times.modtime = st.st_mtime - 10;
+    g_assert(utime(testdata->old_pkg, &times) == 0);
+    pkgid_cached = cr_deltacache_pkgid(cache, testdata->old_pkg, &tmp_err);
+    g_assert(pkgid_cached);
+    g_assert_cmpstr(pkgid, !=, pkgid_cached);
+    g_free(pkgid_cached);
+
+    // Missing file
+    g_assert(!cr_deltacache_pkgid(cache, "/nonexistent/foo.rpm", &tmp_err));
+    g_assert(tmp_err);
+    g_clear_error(&tmp_err);
+
+    cr_deltacache_close(cache, NULL);
+    g_free(pkgid);
+}
+
+static void
+test_cr_deltacache_prune(TestData *testdata,
+                         G_GNUC_UNUSED gconstpointer test_data)
+{
+    cr_DeltaCache *cache;
+    cr_DeltaCacheStats stats;
+    GError *tmp_err = NULL;
+    gchar *path;
+
+    cache = cr_deltacache_open(testdata->tmp_dir, CR_CHECKSUM_SHA256, &tmp_err);
+    g_assert(cache);
+    cr_deltacache_insert(cache, "aaa", "bbb", testdata->drpm_01, 1, NULL);
+    cr_deltacache_insert(cache, "ccc", "bbb", testdata->drpm_02, 1, NULL);
+    cr_deltacache_close(cache, NULL);
+
+    // Only the first delta is used during the next run
+    cache = cr_deltacache_open(testdata->tmp_dir, CR_CHECKSUM_SHA256, &tmp_err);
+    g_assert(cache);
+    path = cr_deltacache_lookup(cache, "aaa", "bbb");
+    g_assert(path);
+    g_free(path);
+    g_assert_cmpint(cr_deltacache_prune(cache, &tmp_err), ==, CRE_OK);
+    cr_deltacache_stats(cache, &stats);
+    g_assert_cmpint(stats.records, ==, 2);
+    g_assert_cmpint(stats.pruned, ==, 1);
+    cr_deltacache_close(cache, NULL);
+
+    g_assert(g_file_test(testdata->drpm_01, G_FILE_TEST_EXISTS));
+    g_assert(!g_file_test(testdata->drpm_02, G_FILE_TEST_EXISTS));
+
+    cache = cr_deltacache_open(testdata->tmp_dir, CR_CHECKSUM_SHA256, &tmp_err);
+    cr_deltacache_stats(cache, &stats);
+    g_assert_cmpint(stats.records, ==, 1);
+
+    // Records made with another checksum type are not used
+    cr_deltacache_close(cache, NULL);
+    cache = cr_deltacache_open(testdata->tmp_dir, CR_CHECKSUM_SHA1, &tmp_err);
+    g_assert(cache);
+    cr_deltacache_stats(cache, &stats);
+    g_assert_cmpint(stats.records, ==, 0);
+    g_assert(!cr_deltacache_lookup(cache, "aaa", "bbb"));
+    cr_deltacache_prune(cache, NULL);
+    cr_deltacache_close(cache, NULL);
+    g_assert(!g_file_test(testdata->drpm_01, G_FILE_TEST_EXISTS));
+}
+
+#define DELTA_NEVRA     "foo-0:2-1.x86_64"
+#define DELTA_CHUNK     "    <delta oldepoch=\"0\" oldversion=\"1\">\n" \
+                        "      <filename>\tfoo-1_2.drpm</filename>\n" \
+                        "    </delta>\n"
+
+static gchar *
+write_prestodeltacache(TestData *testdata, cr_ChecksumType checksum_type)
+{
+    cr_PrestoDeltaCache *cache;
+    GError *tmp_err = NULL;
+    gchar *path;
+
+    path = g_build_filename(testdata->tmp_dir, ".prestodeltacache", NULL);
+    cache = cr_prestodeltacache_new(checksum_type);
+    cr_prestodeltacache_set(cache, testdata->drpm_01, 7, 100, 200,
+                            DELTA_NEVRA, DELTA_CHUNK);
+    cr_prestodeltacache_set(cache, testdata->drpm_02, 8, 101, 201,
+                            "bar-0:2-1.x86_64", "<delta/>\n");
+    // Paths that cannot be stored are skipped
+    cr_prestodeltacache_set(cache, "foo\tbar.drpm", 1, 1, 1,
+                            DELTA_NEVRA, DELTA_CHUNK);
+    g_assert_cmpint(cr_prestodeltacache_size(cache), ==, 3 - 1);
+    g_assert_cmpint(cr_prestodeltacache_write(cache, path, &tmp_err),
+                    ==, CRE_OK);
+    g_assert(!tmp_err);
+    cr_prestodeltacache_free(cache);
+
+    return path;
+}
+
+static void
+test_cr_prestodeltacache_write_load(TestData *testdata,
+                                    G_GNUC_UNUSED gconstpointer test_data)
+{
+    cr_PrestoDeltaCache *cache;
+    gchar *path, *nevra = NULL, *chunk = NULL;
+
+    path = write_prestodeltacache(testdata, CR_CHECKSUM_SHA256);
+
+    cache = cr_prestodeltacache_load(path, CR_CHECKSUM_SHA256);
+    g_assert_cmpint(cr_prestodeltacache_size(cache), ==, 2);
+    g_assert(cr_prestodeltacache_lookup(cache, testdata->drpm_01, 7, 100, 200,
+                                        &nevra, &chunk));
+    g_assert_cmpstr(nevra, ==, DELTA_NEVRA);
+    g_assert_cmpstr(chunk, ==, DELTA_CHUNK);
+    g_free(nevra);
+    g_free(chunk);
+
+    // A changed size, mtime or inode is a miss
+    g_assert(!cr_prestodeltacache_lookup(cache, testdata->drpm_01, 8, 100, 200,
+                                         &nevra, &chunk));
+    g_assert(!cr_prestodeltacache_lookup(cache, testdata->drpm_01, 7, 101, 200,
+                                         &nevra, &chunk));
+    g_assert(!cr_prestodeltacache_lookup(cache, testdata->drpm_01, 7, 100, 201,
+                                         &nevra, &chunk));
+    g_assert(!cr_prestodeltacache_lookup(cache, testdata->old_pkg, 7, 100, 200,
+                                         &nevra, &chunk));
+    cr_prestodeltacache_free(cache);
+
+    // Chunks rendered with another checksum type are not used
+    cache = cr_prestodeltacache_load(path, CR_CHECKSUM_SHA1);
+    g_assert_cmpint(cr_prestodeltacache_size(cache), ==, 0);
+    g_assert(!cr_prestodeltacache_lookup(cache, testdata->drpm_01, 7, 100, 200,
+                                         &nevra, &chunk));
+    cr_prestodeltacache_free(cache);
+
+    // A missing file is not an error
+    cache = cr_prestodeltacache_load(testdata->old_pkg + 1, CR_CHECKSUM_SHA256);
+    g_assert_cmpint(cr_prestodeltacache_size(cache), ==, 0);
+    cr_prestodeltacache_free(cache);
+    cache = cr_prestodeltacache_load(NULL, CR_CHECKSUM_SHA256);
+    g_assert_cmpint(cr_prestodeltacache_size(cache), ==, 0);
+    cr_prestodeltacache_free(cache);
+
+    g_free(path);
+}
+
+static void
+test_cr_prestodeltacache_damaged(TestData *testdata,
+                                 G_GNUC_UNUSED gconstpointer test_data)
+{
+    cr_PrestoDeltaCache *cache;
+    gchar *path, *content, *nevra, *chunk;
+    gsize len;
+
+    path = write_prestodeltacache(testdata, CR_CHECKSUM_SHA256);
+    g_assert(g_file_get_contents(path, &content, &len, NULL));
+
+    // Every truncation loads without a failure and never yields
+    // a partial record
+    for (gsize x = 0; x < len; x++) {
+        gchar *truncated = g_strndup(content, x);
+        write_file(path, truncated);
+        g_free(truncated);
+
+        cache = cr_prestodeltacache_load(path, CR_CHECKSUM_SHA256);
+        g_assert_cmpint(cr_prestodeltacache_size(cache), <=, 1);
+        if (cr_prestodeltacache_lookup(cache, testdata->drpm_01, 7, 100, 200,
+                                       &nevra, &chunk)) {
+            g_assert_cmpstr(nevra, ==, DELTA_NEVRA);
+            g_assert_cmpstr(chunk, ==, DELTA_CHUNK);
+            g_free(nevra);
+            g_free(chunk);
+        }
+        if (cr_prestodeltacache_lookup(cache, testdata->drpm_02, 8, 101, 201,
+                                       &nevra, &chunk)) {
+            g_assert_cmpstr(nevra, ==, "bar-0:2-1.x86_64");
+            g_assert_cmpstr(chunk, ==, "<delta/>\n");
+            g_free(nevra);
+            g_free(chunk);
+        }
+        cr_prestodeltacache_free(cache);
+    }
+
+    // Garbage
+    write_file(path, "\x01\x02garbage\n\t\t\t\t\t\n");
+    cache = cr_prestodeltacache_load(path, CR_CHECKSUM_SHA256);
+    g_assert_cmpint(cr_prestodeltacache_size(cache), ==, 0);
+    cr_prestodeltacache_free(cache);
+
+    // Damaged records are skipped, the valid ones are kept
+    write_file(path, "# createrepo_c prestodelta cache sha256\n"
+                     "x\t100\t200\t/a.drpm\tfoo-0:2-1.x86_64\t<delta/>\n"
+                     "7\t100\t200\t/b.drpm\t\t<delta/>\n"
+                     "7\t100\t200\t/c.drpm\tfoo-0:2-1.x86_64\n"
+                     "7\t100\t200\t/d.drpm\tfoo-0:2-1.x86_64\t<delta/>\n");
+    cache = cr_prestodeltacache_load(path, CR_CHECKSUM_SHA256);
+    g_assert_cmpint(cr_prestodeltacache_size(cache), ==, 1);
+    g_assert(cr_prestodeltacache_lookup(cache, "/d.drpm", 7, 100, 200,
+                                        &nevra, &chunk));
+    g_free(nevra);
+    g_free(chunk);
+    cr_prestodeltacache_free(cache);
+
+    g_free(content);
+    g_free(path);
+}
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add("/delta_cache/test_cr_deltacache_insert_lookup",
+               TestData, NULL, testdata_setup,
+               test_cr_deltacache_insert_lookup, testdata_teardown);
+    g_test_add("/delta_cache/test_cr_deltacache_pkgid",
+               TestData, NULL, testdata_setup,
+               test_cr_deltacache_pkgid, testdata_teardown);
+    g_test_add("/delta_cache/test_cr_deltacache_prune",
+               TestData, NULL, testdata_setup,
+               test_cr_deltacache_prune, testdata_teardown);
+    g_test_add("/delta_cache/test_cr_prestodeltacache_write_load",
+               TestData, NULL, testdata_setup,
+               test_cr_prestodeltacache_write_load, testdata_teardown);
+    g_test_add("/delta_cache/test_cr_prestodeltacache_damaged",
+               TestData, NULL, testdata_setup,
+               test_cr_prestodeltacache_damaged, testdata_teardown);
+
+    return g_test_run();
+}
@@ -0,0 +1,183 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "fixtures.h"
+#include "createrepo/compression_wrapper.h"
+#include "createrepo/dictionary.h"
+#include "createrepo/error.h"
+#include "createrepo/load_metadata.h"
+#include "createrepo/misc.h"
+
+#define SAMPLES     1000
+
+static gchar *
+sample_chunk(int idx)
+{
+    return g_strdup_printf(
+        "<package type=\"rpm\">\n"
+        "  <name>package-%d</name>\n"
+        "  <arch>x86_64</arch>\n"
+        "  <version epoch=\"0\" ver=\"%d.%d\" rel=\"%d.fc24\"/>\n"
+        "  <checksum type=\"sha256\" pkgid=\"YES\">%064x</checksum>\n"
+        "  <summary>Summary of the package-%d</summary>\n"
+        "  <location href=\"Packages/p/package-%d-%d.%d-%d.fc24.x86_64.rpm\"/>\n"
+        "  <format>\n"
+        "    <rpm:license>GPLv2+</rpm:license>\n"
+        "    <rpm:group>System Environment/Libraries</rpm:group>\n"
+        "  </format>\n"
+        "</package>\n",
+        idx, idx % 7, idx % 13, idx % 3, (unsigned) idx * 7919, idx,
+        idx, idx % 7, idx % 13, idx % 3);
+}
+
+static void
+test_cr_dicttrainer_no_samples(void)
+{
+    int ret;
+    void *dict = NULL;
+    gsize dict_len = 0;
+    GError *tmp_err = NULL;
+    cr_DictTrainer *trainer = cr_dicttrainer_new(0);
+
+    cr_dicttrainer_add_sample(trainer, "", 0);
+    g_assert_cmpuint(cr_dicttrainer_samples(trainer), ==, 0);
+
+    ret = cr_dicttrainer_train(trainer, &dict, &dict_len, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_BADARG);
+    g_assert(tmp_err);
+    g_assert(!dict);
+    g_assert_cmpuint(dict_len, ==, 0);
+    g_error_free(tmp_err);
+
+    cr_dicttrainer_free(trainer);
+}
+
+static void
+test_cr_dict_train_from_metadata_bad_input(void)
+{
+    int ret;
+    void *dict = NULL;
+    gsize dict_len = 0;
+    GError *tmp_err = NULL;
+    cr_Metadata *md = cr_metadata_new(CR_HT_KEY_FILENAME, 0, NULL);
+
+    ret = cr_dict_train_from_metadata(md, CR_XMLFILE_UPDATEINFO, 0, 0,
+                                      &dict, &dict_len, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_BADARG);
+    g_assert(tmp_err);
+    g_clear_error(&tmp_err);
+
+    // Empty metadata
+    ret = cr_dict_train_from_metadata(md, CR_XMLFILE_PRIMARY, 0, 0,
+                                      &dict, &dict_len, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_BADARG);
+    g_assert(tmp_err);
+    g_assert(!dict);
+    g_clear_error(&tmp_err);
+
+    cr_metadata_free(md);
+}
+
+#ifdef WITH_ZSTD
+static void
+test_cr_dicttrainer_train_and_use(void)
+{
+    int ret;
+    void *dict = NULL;
+    gsize dict_len = 0;
+    GError *tmp_err = NULL;
+    GString *content = g_string_new(NULL);
+    cr_DictTrainer *trainer = cr_dicttrainer_new(16 * 1024);
+
+    for (int x = 0; x < SAMPLES; x++) {
+        gchar *chunk = sample_chunk(x);
+        cr_dicttrainer_add_sample(trainer, chunk, strlen(chunk));
+        if (x < 10)
+            g_string_append(content, chunk);
+        g_free(chunk);
+    }
+    g_assert_cmpuint(cr_dicttrainer_samples(trainer), ==, SAMPLES);
+
+    ret = cr_dicttrainer_train(trainer, &dict, &dict_len, &tmp_err);
+    g_assert_no_error(tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(dict);
+    g_assert_cmpuint(dict_len, >, 0);
+    g_assert_cmpuint(dict_len, <=, 16 * 1024);
+    cr_dicttrainer_free(trainer);
+
+    // Round trip through a zstd file compressed with the dictionary
+    gchar *tmp_dir = g_strdup(TMPDIR_TEMPLATE);
+    g_assert(mkdtemp(tmp_dir));
+    gchar *path = g_build_filename(tmp_dir, "file.zst", NULL);
+
+    CR_FILE *f = cr_open(path, CR_CW_MODE_WRITE, CR_CW_ZSTD_COMPRESSION,
+                         &tmp_err);
+    g_assert_no_error(tmp_err);
+    ret = cr_set_dict(f, dict, dict_len, &tmp_err);
+    g_assert_no_error(tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    cr_write(f, content->str, content->len, &tmp_err);
+    g_assert_no_error(tmp_err);
+    cr_close(f, &tmp_err);
+    g_assert_no_error(tmp_err);
+
+    char *buf = g_malloc0(content->len + 1);
+    f = cr_open(path, CR_CW_MODE_READ, CR_CW_ZSTD_COMPRESSION, &tmp_err);
+    g_assert_no_error(tmp_err);
+    ret = cr_set_dict(f, dict, dict_len, &tmp_err);
+    g_assert_no_error(tmp_err);
+    ret = cr_read(f, buf, content->len, &tmp_err);
+    g_assert_no_error(tmp_err);
+    g_assert_cmpint(ret, ==, content->len);
+    g_assert_cmpstr(buf, ==, content->str);
+    cr_close(f, &tmp_err);
+    g_assert_no_error(tmp_err);
+
+    g_free(buf);
+    g_free(path);
+    cr_remove_dir(tmp_dir, NULL);
+    g_free(tmp_dir);
+    g_string_free(content, TRUE);
+    g_free(dict);
+}
+#endif
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/dictionary/test_cr_dicttrainer_no_samples",
+                    test_cr_dicttrainer_no_samples);
+    g_test_add_func("/dictionary/test_cr_dict_train_from_metadata_bad_input",
+                    test_cr_dict_train_from_metadata_bad_input);
+#ifdef WITH_ZSTD
+    g_test_add_func("/dictionary/test_cr_dicttrainer_train_and_use",
+                    test_cr_dicttrainer_train_and_use);
+#endif
+
+    return g_test_run();
+}
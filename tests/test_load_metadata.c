@@ -25,6 +25,7 @@
 #include "createrepo/package.h"
 #include "createrepo/misc.h"
 #include "createrepo/load_metadata.h"
+#include "createrepo/locate_metadata.h"
 
 #define REPO_SIZE_00    0
 static const char *REPO_HASH_KEYS_00[] = {};
@@ -151,6 +152,60 @@ static void test_cr_metadata_locate_and_load_xml_detailed(void)
 }
 
 
+static void test_cr_metadata_load_primary_and_selected_details(void)
+{
+    int ret;
+    cr_Package *kernel, *bash;
+    cr_Metadata *metadata;
+    struct cr_MetadataLocation *ml;
+    GHashTable *selected;
+    GError *tmp_err = NULL;
+
+    ml = cr_locate_metadata(TEST_REPO_02, TRUE, NULL);
+    g_assert(ml);
+
+    metadata = cr_metadata_new(CR_HT_KEY_HASH, 0, NULL);
+    g_assert(metadata);
+    ret = cr_metadata_load_primary_xml(metadata, ml, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+    g_assert_cmpuint(g_hash_table_size(cr_metadata_hashtable(metadata)),
+                     ==, REPO_SIZE_02);
+
+    kernel = g_hash_table_lookup(cr_metadata_hashtable(metadata),
+                                 REPO_HASH_KEYS_02[0]);
+    bash = g_hash_table_lookup(cr_metadata_hashtable(metadata),
+                               REPO_HASH_KEYS_02[1]);
+    g_assert(kernel);
+    g_assert(bash);
+    g_assert_cmpstr(kernel->name, ==, "super_kernel");
+
+    // Only primary was loaded (files from primary are skipped too)
+    g_assert(!kernel->files);
+    g_assert(!kernel->changelogs);
+    g_assert(!bash->files);
+    g_assert(!bash->changelogs);
+
+    // Load the rest only for super_kernel
+    selected = g_hash_table_new(g_str_hash, g_str_equal);
+    g_hash_table_insert(selected, kernel->pkgId, kernel);
+    ret = cr_metadata_load_filelists_other_xml(selected, ml, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+    g_hash_table_destroy(selected);
+
+    g_assert_cmpint(g_slist_length(kernel->files), ==, 2);
+    g_assert_cmpint(g_slist_length(kernel->changelogs), ==, 2);
+    g_assert(kernel->loadingflags & CR_PACKAGE_LOADED_FIL);
+    g_assert(kernel->loadingflags & CR_PACKAGE_LOADED_OTH);
+    g_assert(!bash->files);
+    g_assert(!bash->changelogs);
+
+    cr_metadata_free(metadata);
+    cr_metadatalocation_free(ml);
+}
+
+
 int main(int argc, char *argv[])
 {
     g_test_init(&argc, &argv, NULL);
@@ -158,6 +213,7 @@ int main(int argc, char *argv[])
     g_test_add_func("/load_metadata/test_cr_metadata_new", test_cr_metadata_new);
     g_test_add_func("/load_metadata/test_cr_metadata_locate_and_load_xml", test_cr_metadata_locate_and_load_xml);
     g_test_add_func("/load_metadata/test_cr_metadata_locate_and_load_xml_detailed", test_cr_metadata_locate_and_load_xml_detailed);
+    g_test_add_func("/load_metadata/test_cr_metadata_load_primary_and_selected_details", test_cr_metadata_load_primary_and_selected_details);
 
     return g_test_run();
 }
@@ -0,0 +1,220 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "fixtures.h"
+#include "createrepo/error.h"
+#include "createrepo/misc.h"
+#include "createrepo/package.h"
+#include "createrepo/parsepkg.h"
+#include "createrepo/xml_dump.h"
+
+static const char *packages[] = {
+    TEST_PACKAGES_PATH"Archer-3.4.5-6.x86_64.rpm",
+    TEST_PACKAGES_PATH"Rimmer-1.0.2-2.x86_64.rpm",
+    TEST_PACKAGES_PATH"balicek-iso88591-1.1.1-1.x86_64.rpm",
+    TEST_PACKAGES_PATH"balicek-utf8-1.1.1-1.x86_64.rpm",
+    TEST_PACKAGES_PATH"empty-0-0.src.rpm",
+    TEST_PACKAGES_PATH"empty-0-0.x86_64.rpm",
+    TEST_PACKAGES_PATH"fake_bash-1.1.1-1.x86_64.rpm",
+    TEST_PACKAGES_PATH"super_kernel-6.0.1-2.x86_64.rpm",
+    NULL,
+};
+
+typedef struct {
+    gchar *tmp_dir;
+} TestData;
+
+static void
+testdata_setup(TestData *testdata, G_GNUC_UNUSED gconstpointer test_data)
+{
+    testdata->tmp_dir = g_strdup(TMPDIR_TEMPLATE);
+    g_assert(mkdtemp(testdata->tmp_dir));
+}
+
+static void
+testdata_teardown(TestData *testdata, G_GNUC_UNUSED gconstpointer test_data)
+{
+    cr_remove_dir(testdata->tmp_dir, NULL);
+    g_free(testdata->tmp_dir);
+}
+
+/** Dump all three xml chunks of the package into a single string.
+ * Attributes that are not filled by cr_package_from_rpm_base()
+ * are set to fixed values.
+ */
+static gchar *
+dump_package(cr_Package *pkg)
+{
+    struct cr_XmlStruct xml;
+    GError *tmp_err = NULL;
+    gchar *out;
+
+    pkg->pkgId          = "0123456789abcdef";
+    pkg->checksum_type  = "sha256";
+    pkg->location_href  = "package.rpm";
+
+    xml = cr_xml_dump(pkg, &tmp_err);
+    g_assert(!tmp_err);
+    out = g_strconcat(xml.primary, xml.filelists, xml.other, NULL);
+    g_free(xml.primary);
+    g_free(xml.filelists);
+    g_free(xml.other);
+
+    pkg->pkgId          = NULL;
+    pkg->checksum_type  = NULL;
+    pkg->location_href  = NULL;
+
+    return out;
+}
+
+static void
+test_cr_package_from_rpm_base_readers(void)
+{
+    for (const char **path = packages; *path; path++) {
+        cr_Package *mmap_pkg, *rpmio_pkg;
+        struct cr_HeaderRangeStruct range;
+        gchar *mmap_xml, *rpmio_xml;
+        GError *tmp_err = NULL;
+
+        mmap_pkg = cr_package_from_rpm_base(*path, 10, CR_HDRR_NONE, &tmp_err);
+        g_assert(!tmp_err);
+        g_assert(mmap_pkg);
+        rpmio_pkg = cr_package_from_rpm_base(*path, 10, CR_HDRR_RPMIO,
+                                             &tmp_err);
+        g_assert(!tmp_err);
+        g_assert(rpmio_pkg);
+
+        // Both readers give the same package
+        g_assert_cmpint(mmap_pkg->size_archive, ==, rpmio_pkg->size_archive);
+        g_assert_cmpint(mmap_pkg->size_installed, ==,
+                        rpmio_pkg->size_installed);
+        g_assert_cmpstr(mmap_pkg->rpm_sourcerpm, ==, rpmio_pkg->rpm_sourcerpm);
+        mmap_xml = dump_package(mmap_pkg);
+        rpmio_xml = dump_package(rpmio_pkg);
+        g_assert_cmpstr(mmap_xml, ==, rpmio_xml);
+        g_free(mmap_xml);
+        g_free(rpmio_xml);
+
+        // The header range is a side product of the mmap reader only
+        range = cr_get_header_byte_range(*path, &tmp_err);
+        g_assert(!tmp_err);
+        g_assert_cmpint(range.end, >, range.start);
+#ifndef RPM5
+        g_assert_cmpint(mmap_pkg->rpm_header_start, ==, range.start);
+        g_assert_cmpint(mmap_pkg->rpm_header_end, ==, range.end);
+#endif
+        g_assert_cmpint(rpmio_pkg->rpm_header_start, ==, 0);
+        g_assert_cmpint(rpmio_pkg->rpm_header_end, ==, 0);
+
+        cr_package_free(mmap_pkg);
+        cr_package_free(rpmio_pkg);
+    }
+}
+
+static void
+test_cr_package_from_rpm_header_range(void)
+{
+    for (const char **path = packages; *path; path++) {
+        cr_Package *pkg;
+        struct cr_HeaderRangeStruct range;
+        GError *tmp_err = NULL;
+
+        // Filled regardless of the reader used
+        pkg = cr_package_from_rpm(*path, CR_CHECKSUM_SHA256, *path, NULL, 10,
+                                  NULL, CR_HDRR_RPMIO, &tmp_err);
+        g_assert(!tmp_err);
+        g_assert(pkg);
+        range = cr_get_header_byte_range(*path, NULL);
+        g_assert_cmpint(pkg->rpm_header_start, ==, range.start);
+        g_assert_cmpint(pkg->rpm_header_end, ==, range.end);
+        cr_package_free(pkg);
+    }
+}
+
+static void
+test_cr_package_from_rpm_base_truncated(TestData *testdata,
+                                        G_GNUC_UNUSED gconstpointer test_data)
+{
+    const char *orig = TEST_PACKAGES_PATH"super_kernel-6.0.1-2.x86_64.rpm";
+    struct cr_HeaderRangeStruct range;
+    gchar *content, *path;
+    gsize len;
+
+    g_assert(g_file_get_contents(orig, &content, &len, NULL));
+    range = cr_get_header_byte_range(orig, NULL);
+    g_assert_cmpint(range.end, <=, len);
+
+    path = g_build_filename(testdata->tmp_dir, "truncated.rpm", NULL);
+
+    // Cut in the lead, in the signature, in the header intro,
+    // in the header index, in the header data store and right
+    // before the end of the header
+    gsize sizes[] = { 0, 50, 100, range.start + 8, range.start + 40,
+                      (range.start + range.end) / 2, range.end - 1 };
+
+    for (gsize x = 0; x < G_N_ELEMENTS(sizes); x++) {
+        cr_HeaderReadingFlags flags[] = { CR_HDRR_NONE, CR_HDRR_RPMIO };
+
+        g_assert(g_file_set_contents(path, content, sizes[x], NULL));
+
+        for (gsize y = 0; y < G_N_ELEMENTS(flags); y++) {
+            cr_Package *pkg;
+            GError *tmp_err = NULL;
+
+            pkg = cr_package_from_rpm_base(path, 10, flags[y], &tmp_err);
+            g_assert(!pkg);
+            g_assert(tmp_err);
+            g_error_free(tmp_err);
+        }
+    }
+
+    g_free(path);
+    g_free(content);
+}
+
+int
+main(int argc, char *argv[])
+{
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+
+    cr_package_parser_init();
+    cr_xml_dump_init();
+
+    g_test_add_func("/parsepkg/test_cr_package_from_rpm_base_readers",
+                    test_cr_package_from_rpm_base_readers);
+    g_test_add_func("/parsepkg/test_cr_package_from_rpm_header_range",
+                    test_cr_package_from_rpm_header_range);
+    g_test_add("/parsepkg/test_cr_package_from_rpm_base_truncated",
+               TestData, NULL, testdata_setup,
+               test_cr_package_from_rpm_base_truncated, testdata_teardown);
+
+    ret = g_test_run();
+
+    cr_xml_dump_cleanup();
+    cr_package_parser_cleanup();
+
+    return ret;
+}
@@ -0,0 +1,193 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+
+#include <glib.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "fixtures.h"
+#include "createrepo/checksum.h"
+#include "createrepo/error.h"
+#include "createrepo/prefetch.h"
+
+#define PACKAGE_01              TEST_PACKAGES_PATH"super_kernel-6.0.1-2.x86_64.rpm"
+#define PACKAGE_01_HEADER_START 280
+#define PACKAGE_01_HEADER_END   2637
+#define PACKAGE_02              TEST_PACKAGES_PATH"fake_bash-1.1.1-1.x86_64.rpm"
+#define PACKAGE_03              TEST_PACKAGES_PATH"Archer-3.4.5-6.x86_64.rpm"
+
+static const char *packages[] = { PACKAGE_01, PACKAGE_02, NON_EXIST_FILE,
+                                  PACKAGE_03, NULL };
+
+static gboolean
+skip_all(G_GNUC_UNUSED const char *path,
+         G_GNUC_UNUSED const struct stat *st,
+         gpointer user_data)
+{
+    int *calls = user_data;
+    (*calls)++;
+    return TRUE;
+}
+
+static void
+test_cr_prefetch_read(void)
+{
+    cr_Prefetch *pf;
+    GError *tmp_err = NULL;
+
+    pf = cr_prefetch_new(2, 2, CR_CHECKSUM_SHA256, NULL, NULL, &tmp_err);
+    g_assert(pf);
+    g_assert(!tmp_err);
+
+    for (int x = 0; packages[x]; x++)
+        g_assert_cmpint(cr_prefetch_add(pf, packages[x]), ==, x);
+
+    for (int x = 0; packages[x]; x++) {
+        cr_PrefetchResult *res = cr_prefetch_get(pf, x);
+        g_assert(res);
+
+        if (!strcmp(packages[x], NON_EXIST_FILE)) {
+            g_assert(res->err);
+            g_assert_cmpint(res->err->code, ==, CRE_IO);
+        } else {
+            struct stat st;
+            char *checksum = cr_checksum_file(packages[x],
+                                              CR_CHECKSUM_SHA256, NULL);
+            g_assert(!res->err);
+            g_assert(res->read);
+            g_assert_cmpstr(res->checksum, ==, checksum);
+            g_assert(!stat(packages[x], &st));
+            g_assert_cmpint(res->st.st_size, ==, st.st_size);
+            g_assert_cmpint(res->st.st_mtime, ==, st.st_mtime);
+            g_free(checksum);
+        }
+
+        if (x == 0) {
+            g_assert_cmpuint(res->hdr_range.start, ==, PACKAGE_01_HEADER_START);
+            g_assert_cmpuint(res->hdr_range.end, ==, PACKAGE_01_HEADER_END);
+        }
+
+        cr_prefetch_release(pf, x);
+    }
+
+    // Out of range
+    g_assert(!cr_prefetch_get(pf, 100));
+    cr_prefetch_release(pf, 100);
+
+    cr_prefetch_free(pf);
+}
+
+static void
+test_cr_prefetch_skip(void)
+{
+    cr_Prefetch *pf;
+    cr_PrefetchResult *res;
+    int calls = 0;
+
+    pf = cr_prefetch_new(4, 1, CR_CHECKSUM_SHA256, skip_all, &calls, NULL);
+    g_assert(pf);
+
+    cr_prefetch_add(pf, PACKAGE_01);
+    res = cr_prefetch_get(pf, 0);
+    g_assert(res);
+    g_assert(!res->err);
+    g_assert(!res->read);
+    g_assert(!res->checksum);
+    g_assert_cmpint(res->st.st_size, >, 0);
+    g_assert_cmpint(calls, ==, 1);
+    cr_prefetch_release(pf, 0);
+
+    cr_prefetch_free(pf);
+}
+
+static void
+test_cr_prefetch_window(void)
+{
+    cr_Prefetch *pf;
+    cr_PrefetchResult *res;
+
+    // Headers only
+    pf = cr_prefetch_new(1, 1, CR_CHECKSUM_UNKNOWN, NULL, NULL, NULL);
+    g_assert(pf);
+
+    cr_prefetch_add(pf, PACKAGE_01);
+    cr_prefetch_add(pf, PACKAGE_02);
+    cr_prefetch_add(pf, PACKAGE_03);
+
+    // Package 2 is out of the window, it won't be read at all
+    g_assert(!cr_prefetch_get(pf, 2));
+
+    res = cr_prefetch_get(pf, 0);
+    g_assert(res);
+    g_assert(res->read);
+    g_assert(!res->checksum);
+    g_assert_cmpuint(res->hdr_range.end, ==, PACKAGE_01_HEADER_END);
+
+    // Out of order release
+    cr_prefetch_release(pf, 2);
+    cr_prefetch_release(pf, 0);
+    cr_prefetch_release(pf, 0);
+
+    res = cr_prefetch_get(pf, 1);
+    g_assert(res);
+    g_assert(res->read);
+    cr_prefetch_release(pf, 1);
+
+    g_assert(!cr_prefetch_get(pf, 2));
+
+    cr_prefetch_free(pf);
+
+    // Unreleased packages are freed too
+    pf = cr_prefetch_new(3, 2, CR_CHECKSUM_SHA256, NULL, NULL, NULL);
+    g_assert(pf);
+    cr_prefetch_add(pf, PACKAGE_01);
+    cr_prefetch_add(pf, PACKAGE_02);
+    cr_prefetch_free(pf);
+}
+
+static void
+test_cr_prefetch_bad_depth(void)
+{
+    GError *tmp_err = NULL;
+
+    g_assert(!cr_prefetch_new(0, 1, CR_CHECKSUM_SHA256, NULL, NULL, &tmp_err));
+    g_assert(tmp_err);
+    g_assert_cmpint(tmp_err->code, ==, CRE_BADARG);
+    g_error_free(tmp_err);
+}
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/prefetch/test_cr_prefetch_read",
+                    test_cr_prefetch_read);
+    g_test_add_func("/prefetch/test_cr_prefetch_skip",
+                    test_cr_prefetch_skip);
+    g_test_add_func("/prefetch/test_cr_prefetch_window",
+                    test_cr_prefetch_window);
+    g_test_add_func("/prefetch/test_cr_prefetch_bad_depth",
+                    test_cr_prefetch_bad_depth);
+
+    return g_test_run();
+}
@@ -0,0 +1,78 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <string.h>
+#include "createrepo/profile.h"
+
+static void
+test_cr_profile_disabled(void)
+{
+    gint64 start;
+
+    // Must be the first test - profiling cannot be disabled once enabled
+    g_assert(!cr_profile_enabled());
+    start = cr_profile_start();
+    g_assert_cmpint(start, ==, 0);
+    g_assert_cmpint(cr_profile_stop(CR_PROF_XML_DUMP, start), ==, 0);
+    cr_profile_count(CR_PROF_CNT_PACKAGES, 10);
+}
+
+static void
+test_cr_profile_report_json(void)
+{
+    gint64 start;
+    gchar *json;
+
+    cr_profile_enable();
+    g_assert(cr_profile_enabled());
+
+    start = cr_profile_start();
+    g_assert_cmpint(start, >, 0);
+    g_usleep(1000);
+    g_assert_cmpint(cr_profile_stop(CR_PROF_XML_DUMP, start), >=, 1000);
+
+    cr_profile_count(CR_PROF_CNT_PACKAGES, 2);
+    cr_profile_count(CR_PROF_CNT_PACKAGES, 1);
+    cr_profile_sample(CR_PROF_HIST_BUFFER_DEPTH, 0);
+    cr_profile_sample(CR_PROF_HIST_BUFFER_DEPTH, 1);
+    cr_profile_sample(CR_PROF_HIST_BUFFER_DEPTH, 5);
+
+    json = cr_profile_report_json("test");
+    g_assert(json);
+    g_assert(strstr(json, "\"program\": \"test\""));
+    g_assert(strstr(json, "\"packages\": 3,"));
+    g_assert(strstr(json, "\"buffer_depth\": [1, 1, 0, 1]"));
+    g_assert(strstr(json, "\"xml_dump\": {\"us\": "));
+    g_assert(strstr(json, ", \"calls\": 1}"));
+    g_free(json);
+}
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/profile/test_cr_profile_disabled",
+                    test_cr_profile_disabled);
+    g_test_add_func("/profile/test_cr_profile_report_json",
+                    test_cr_profile_report_json);
+
+    return g_test_run();
+}
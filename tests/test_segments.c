@@ -0,0 +1,326 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#define _XOPEN_SOURCE 700
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "fixtures.h"
+#include "test_common.h"
+#include "createrepo/compression_wrapper.h"
+#include "createrepo/error.h"
+#include "createrepo/misc.h"
+#include "createrepo/profile.h"
+#include "createrepo/segments.h"
+#include "createrepo/xml_file.h"
+
+#define NUM_PKGS        40
+#define SEGMENT_PKGS    2
+
+typedef struct {
+    gchar *tmp_dir;
+} TestData;
+
+static void
+testdata_setup(TestData *testdata, G_GNUC_UNUSED gconstpointer test_data)
+{
+    testdata->tmp_dir = g_strdup(TMPDIR_TEMPLATE);
+    g_assert(mkdtemp(testdata->tmp_dir));
+}
+
+static void
+testdata_teardown(TestData *testdata, G_GNUC_UNUSED gconstpointer test_data)
+{
+    cr_remove_dir(testdata->tmp_dir, NULL);
+    g_free(testdata->tmp_dir);
+}
+
+static GPtrArray *
+pkgids_new(const char *first, ...)
+{
+    va_list args;
+    GPtrArray *pkgids = g_ptr_array_new_with_free_func(g_free);
+
+    va_start(args, first);
+    for (const char *id = first; id; id = va_arg(args, const char *))
+        g_ptr_array_add(pkgids, g_strdup(id));
+    va_end(args);
+
+    return pkgids;
+}
+
+static gint64
+profile_counter(const char *name)
+{
+    gchar *json = cr_profile_report_json(NULL);
+    gchar *key = g_strdup_printf("\"%s\": ", name);
+    gchar *pos = strstr(json, key);
+    gint64 value;
+
+    g_assert(pos);
+    value = g_ascii_strtoll(pos + strlen(key), NULL, 10);
+    g_free(key);
+    g_free(json);
+    return value;
+}
+
+/** Write other.xml with NUM_PKGS packages in segments, the package
+ * with number changed gets a different content.
+ */
+static void
+write_segmented(const char *path,
+                const char *old_index_path,
+                const char *dir,
+                cr_CompressionType comtype,
+                int changed,
+                GString *expected)
+{
+    cr_XmlFile *f;
+    cr_SegmentIndex *old_index = NULL, *index;
+    gchar *index_path;
+    GError *tmp_err = NULL;
+    int ret;
+
+    if (old_index_path) {
+        gchar *old_dir = g_path_get_dirname(old_index_path);
+        old_index = cr_segmentindex_load(old_index_path, old_dir, &tmp_err);
+        g_free(old_dir);
+        g_assert(!tmp_err);
+        g_assert(old_index);
+        g_assert_cmpint(cr_segmentindex_compression(old_index), ==, comtype);
+    }
+
+    f = cr_xmlfile_open_other(path, comtype, &tmp_err);
+    g_assert(f);
+    g_assert(!tmp_err);
+    cr_xmlfile_set_num_of_pkgs(f, NUM_PKGS, NULL);
+
+    index = cr_segmentindex_new();
+    ret = cr_xmlfile_set_segments(f, SEGMENT_PKGS, old_index, index, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+
+    for (int x = 0; x < NUM_PKGS; x++) {
+        gchar *pkgid = g_strdup_printf("pkgid-%02d", x);
+        gchar *chunk = g_strdup_printf("<package pkgid=\"%s\" name=\"pkg\">"
+                                       "<version rel=\"%d\"/></package>\n",
+                                       pkgid, x == changed ? 2 : 1);
+        ret = cr_xmlfile_add_pkg_chunk(f, chunk, pkgid, &tmp_err);
+        g_assert_cmpint(ret, ==, CRE_OK);
+        g_assert(!tmp_err);
+        if (expected)
+            g_string_append(expected, chunk);
+        g_free(chunk);
+        g_free(pkgid);
+    }
+
+    ret = cr_xmlfile_close(f, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+    cr_segmentindex_free(old_index);
+
+    g_assert_cmpint(cr_segmentindex_len(index), >, 1);
+
+    index_path = g_build_filename(dir, "other" CR_SEGMENTS_SUFFIX, NULL);
+    ret = cr_segmentindex_write(index, index_path, path, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+    g_free(index_path);
+    cr_segmentindex_free(index);
+}
+
+static void
+test_cr_segmentindex_write_load(TestData *testdata,
+                                G_GNUC_UNUSED gconstpointer test_data)
+{
+    cr_SegmentIndex *index;
+    gchar *data_path, *path;
+    guchar *segment;
+    gsize len = 0;
+    GPtrArray *pkgids;
+    GError *tmp_err = NULL;
+    int ret;
+
+    data_path = g_build_filename(testdata->tmp_dir, "data.gz", NULL);
+    path = g_build_filename(testdata->tmp_dir, "data" CR_SEGMENTS_SUFFIX, NULL);
+    g_assert(g_file_set_contents(data_path, "\x1f\x8b\x08\x00" "0123456789",
+                                 14, NULL));
+
+    index = cr_segmentindex_new();
+    cr_segmentindex_append(index, 4, 4, "aaaa", pkgids_new("a", "b", NULL));
+    cr_segmentindex_append(index, 8, 6, "bbbb", pkgids_new("c,d", NULL));
+    g_assert_cmpint(cr_segmentindex_len(index), ==, 2);
+
+    // Index which wasn't loaded has no data
+    pkgids = pkgids_new("a", "b", NULL);
+    g_assert(!cr_segmentindex_get(index, "aaaa", pkgids, &len, &tmp_err));
+    g_assert(!tmp_err);
+    g_ptr_array_free(pkgids, TRUE);
+
+    ret = cr_segmentindex_write(index, path, data_path, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+    cr_segmentindex_free(index);
+
+    index = cr_segmentindex_load(path, testdata->tmp_dir, &tmp_err);
+    g_assert(index);
+    g_assert(!tmp_err);
+    g_assert_cmpint(cr_segmentindex_len(index), ==, 2);
+    g_assert_cmpint(cr_segmentindex_compression(index), ==,
+                    CR_CW_GZ_COMPRESSION);
+
+    pkgids = pkgids_new("a", "b", NULL);
+    segment = cr_segmentindex_get(index, "aaaa", pkgids, &len, &tmp_err);
+    g_assert(!tmp_err);
+    g_assert(segment);
+    g_assert_cmpint(len, ==, 4);
+    g_assert(!memcmp(segment, "0123", 4));
+    g_free(segment);
+    g_ptr_array_free(pkgids, TRUE);
+
+    // Separators in pkgIds were replaced
+    pkgids = pkgids_new("c_d", NULL);
+    segment = cr_segmentindex_get(index, "bbbb", pkgids, &len, &tmp_err);
+    g_assert(!tmp_err);
+    g_assert(segment);
+    g_assert_cmpint(len, ==, 6);
+    g_assert(!memcmp(segment, "456789", 6));
+    g_free(segment);
+    g_ptr_array_free(pkgids, TRUE);
+
+    // Same content of different packages is not a match
+    pkgids = pkgids_new("a", NULL);
+    g_assert(!cr_segmentindex_get(index, "aaaa", pkgids, &len, &tmp_err));
+    g_assert(!tmp_err);
+    g_assert(!cr_segmentindex_get(index, "cccc", pkgids, &len, &tmp_err));
+    g_assert(!tmp_err);
+    g_ptr_array_free(pkgids, TRUE);
+    cr_segmentindex_free(index);
+
+    // Index of a modified data file cannot be used
+    g_assert(g_file_set_contents(data_path, "\x1f\x8b\x08\x00" "01234",
+                                 9, NULL));
+    index = cr_segmentindex_load(path, testdata->tmp_dir, &tmp_err);
+    g_assert(!index);
+    g_assert(tmp_err);
+    g_assert_cmpint(tmp_err->code, ==, CRE_STAT);
+    g_clear_error(&tmp_err);
+
+    g_free(data_path);
+    g_free(path);
+}
+
+static void
+test_cr_xmlfile_segments_reuse(TestData *testdata, gconstpointer test_data)
+{
+    cr_CompressionType comtype = GPOINTER_TO_INT(test_data);
+    const char *suffix = cr_compression_suffix(comtype);
+    gchar *old_dir, *old_path, *old_index_path, *path;
+    gchar *content;
+    GString *expected;
+    gint64 reused, written;
+
+    old_dir = g_build_filename(testdata->tmp_dir, "old", NULL);
+    g_assert_cmpint(g_mkdir(old_dir, 0755), ==, 0);
+    old_path = g_strconcat(old_dir, "/other.xml", suffix, NULL);
+    old_index_path = g_build_filename(old_dir, "other" CR_SEGMENTS_SUFFIX,
+                                      NULL);
+    path = g_strconcat(testdata->tmp_dir, "/other.xml", suffix, NULL);
+
+    write_segmented(old_path, NULL, old_dir, comtype, -1, NULL);
+
+    reused = profile_counter("segments_reused");
+    written = profile_counter("segments_written");
+
+    expected = g_string_new(NULL);
+    write_segmented(path, old_index_path, testdata->tmp_dir, comtype,
+                    NUM_PKGS / 2, expected);
+
+    // Only the segment with the changed package was compressed again
+    g_assert_cmpint(profile_counter("segments_reused") - reused, >, 0);
+    g_assert_cmpint(profile_counter("segments_written") - written, ==, 1);
+
+    // Result is a valid file with the complete content
+    content = test_read_content(path);
+    g_assert(strstr(content, expected->str));
+    g_assert(g_str_has_suffix(content, "</otherdata>"));
+    g_free(content);
+
+    g_string_free(expected, TRUE);
+    g_free(old_dir);
+    g_free(old_path);
+    g_free(old_index_path);
+    g_free(path);
+}
+
+static void
+test_cr_set_segmented_unsupported(TestData *testdata,
+                                  G_GNUC_UNUSED gconstpointer test_data)
+{
+    CR_FILE *f;
+    gchar *path;
+    GError *tmp_err = NULL;
+    int ret;
+
+    path = g_build_filename(testdata->tmp_dir, "file.bz2", NULL);
+    f = cr_open(path, CR_CW_MODE_WRITE, CR_CW_BZ2_COMPRESSION, &tmp_err);
+    g_assert(f);
+    ret = cr_set_segmented(f, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_BADARG);
+    g_assert(tmp_err);
+    g_clear_error(&tmp_err);
+    cr_close(f, NULL);
+    g_free(path);
+}
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    cr_profile_enable();
+
+    g_test_add("/segments/test_cr_segmentindex_write_load",
+               TestData, NULL, testdata_setup,
+               test_cr_segmentindex_write_load, testdata_teardown);
+    g_test_add("/segments/test_cr_xmlfile_segments_reuse_gz",
+               TestData, GINT_TO_POINTER(CR_CW_GZ_COMPRESSION),
+               testdata_setup, test_cr_xmlfile_segments_reuse,
+               testdata_teardown);
+    g_test_add("/segments/test_cr_xmlfile_segments_reuse_xz",
+               TestData, GINT_TO_POINTER(CR_CW_XZ_COMPRESSION),
+               testdata_setup, test_cr_xmlfile_segments_reuse,
+               testdata_teardown);
+#ifdef WITH_ZSTD
+    g_test_add("/segments/test_cr_xmlfile_segments_reuse_zstd",
+               TestData, GINT_TO_POINTER(CR_CW_ZSTD_COMPRESSION),
+               testdata_setup, test_cr_xmlfile_segments_reuse,
+               testdata_teardown);
+#endif
+    g_test_add("/segments/test_cr_set_segmented_unsupported",
+               TestData, NULL, testdata_setup,
+               test_cr_set_segmented_unsupported, testdata_teardown);
+
+    return g_test_run();
+}
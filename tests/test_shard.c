@@ -0,0 +1,475 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#define _XOPEN_SOURCE 700
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sqlite3.h>
+#include "fixtures.h"
+#include "test_common.h"
+#include "createrepo/compression_wrapper.h"
+#include "createrepo/error.h"
+#include "createrepo/locate_metadata.h"
+#include "createrepo/misc.h"
+#include "createrepo/segments.h"
+#include "createrepo/shard.h"
+#include "createrepo/xml_file.h"
+
+#define NUM_PKGS        25
+#define NUM_SHARDS      3
+#define SEGMENT_PKGS    2
+
+#define NUM_TEST_PKGS   9   // Packages in TEST_PACKAGES_PATH
+
+typedef struct {
+    gchar *tmp_dir;
+} TestData;
+
+static void
+testdata_setup(TestData *testdata, G_GNUC_UNUSED gconstpointer test_data)
+{
+    testdata->tmp_dir = g_strdup(TMPDIR_TEMPLATE);
+    g_assert(mkdtemp(testdata->tmp_dir));
+}
+
+static void
+testdata_teardown(TestData *testdata, G_GNUC_UNUSED gconstpointer test_data)
+{
+    cr_remove_dir(testdata->tmp_dir, NULL);
+    g_free(testdata->tmp_dir);
+}
+
+/** Open segmented other.xml with the whole package count.
+ */
+static cr_XmlFile *
+open_segmented(const char *path,
+               cr_CompressionType comtype,
+               cr_SegmentIndex *index)
+{
+    cr_XmlFile *f;
+    GError *tmp_err = NULL;
+    int ret;
+
+    f = cr_xmlfile_open_other(path, comtype, &tmp_err);
+    g_assert(f);
+    g_assert(!tmp_err);
+    cr_xmlfile_set_num_of_pkgs(f, NUM_PKGS, NULL);
+    ret = cr_xmlfile_set_segments(f, SEGMENT_PKGS, NULL, index, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+
+    return f;
+}
+
+/** Write repodata/other.xml of a shard like createrepo_c --shard does.
+ */
+static void
+write_shard(const char *dir,
+            cr_CompressionType comtype,
+            const cr_ShardInfo *shard,
+            GString *expected)
+{
+    cr_XmlFile *f;
+    cr_SegmentIndex *index;
+    gchar *path, *index_path;
+    GError *tmp_err = NULL;
+    int ret;
+
+    g_assert_cmpint(g_mkdir_with_parents(dir, 0755), ==, 0);
+    path = g_strconcat(dir, "/other.xml", cr_compression_suffix(comtype),
+                       NULL);
+
+    index = cr_segmentindex_new();
+    f = open_segmented(path, comtype, index);
+
+    for (gint64 x = shard->first; x < shard->first + shard->packages; x++) {
+        gchar *pkgid = g_strdup_printf("pkgid-%02"G_GINT64_FORMAT, x);
+        gchar *chunk = g_strdup_printf("<package pkgid=\"%s\" name=\"pkg\">"
+                                       "<version rel=\"1\"/></package>\n",
+                                       pkgid);
+        ret = cr_xmlfile_add_pkg_chunk(f, chunk, pkgid, &tmp_err);
+        g_assert_cmpint(ret, ==, CRE_OK);
+        g_assert(!tmp_err);
+        g_string_append(expected, chunk);
+        g_free(chunk);
+        g_free(pkgid);
+    }
+
+    ret = cr_xmlfile_close(f, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+
+    index_path = g_build_filename(dir, "other" CR_SEGMENTS_SUFFIX, NULL);
+    ret = cr_segmentindex_write(index, index_path, path, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+
+    cr_segmentindex_free(index);
+    g_free(index_path);
+    g_free(path);
+}
+
+static void
+test_cr_shard_parse(void)
+{
+    guint index = 0, count = 0;
+    GError *tmp_err = NULL;
+    int ret;
+
+    ret = cr_shard_parse("2/5", &index, &count, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+    g_assert_cmpint(index, ==, 2);
+    g_assert_cmpint(count, ==, 5);
+
+    const char *bad[] = { "", "3", "0/2", "3/2", "1/0", "a/2", "1/2x",
+                          "-1/2", "1/", NULL };
+    for (int x = 0; bad[x]; x++) {
+        ret = cr_shard_parse(bad[x], &index, &count, &tmp_err);
+        g_assert_cmpint(ret, ==, CRE_BADARG);
+        g_assert(tmp_err);
+        g_clear_error(&tmp_err);
+    }
+}
+
+static void
+test_cr_shard_range(void)
+{
+    const gint64 totals[] = { 0, 1, 2, 10, 25, 1000 };
+
+    for (guint t = 0; t < G_N_ELEMENTS(totals); t++) {
+        for (guint count = 1; count <= 7; count++) {
+            gint64 next = 0, min = G_MAXINT64, max = 0;
+
+            for (guint index = 1; index <= count; index++) {
+                gint64 first, packages;
+                cr_shard_range(totals[t], index, count, &first, &packages);
+                g_assert_cmpint(first, ==, next);
+                next += packages;
+                min = MIN(min, packages);
+                max = MAX(max, packages);
+            }
+
+            g_assert_cmpint(next, ==, totals[t]);
+            g_assert_cmpint(max - min, <=, 1);
+        }
+    }
+}
+
+static void
+test_cr_shard_write_load(TestData *testdata,
+                         G_GNUC_UNUSED gconstpointer test_data)
+{
+    cr_ShardInfo shard = { 2, 3, 8, 8, 25 }, loaded;
+    gchar *path;
+    GError *tmp_err = NULL;
+    int ret;
+
+    path = g_build_filename(testdata->tmp_dir, CR_SHARD_FILENAME, NULL);
+
+    ret = cr_shard_write(&shard, path, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+
+    memset(&loaded, 0, sizeof(loaded));
+    ret = cr_shard_load(&loaded, path, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+    g_assert(!memcmp(&shard, &loaded, sizeof(shard)));
+
+    // Slice beyond the package list
+    g_assert(g_file_set_contents(path, "shard\t1\n2\t3\t20\t8\t25\n", -1,
+                                 NULL));
+    ret = cr_shard_load(&loaded, path, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_ERROR);
+    g_assert(tmp_err);
+    g_clear_error(&tmp_err);
+
+    // Unknown version
+    g_assert(g_file_set_contents(path, "shard\t2\n2\t3\t8\t8\t25\n", -1,
+                                 NULL));
+    ret = cr_shard_load(&loaded, path, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_ERROR);
+    g_assert(tmp_err);
+    g_clear_error(&tmp_err);
+
+    g_free(path);
+}
+
+static void
+test_cr_shard_check(void)
+{
+    cr_ShardInfo shards[NUM_SHARDS];
+    GError *tmp_err = NULL;
+    int ret;
+
+    for (guint x = 0; x < NUM_SHARDS; x++) {
+        shards[x].index = x + 1;
+        shards[x].count = NUM_SHARDS;
+        shards[x].total = NUM_PKGS;
+        cr_shard_range(NUM_PKGS, x + 1, NUM_SHARDS,
+                       &shards[x].first, &shards[x].packages);
+    }
+
+    ret = cr_shard_check(shards, NUM_SHARDS, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+
+    // Missing shard
+    ret = cr_shard_check(shards, NUM_SHARDS - 1, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_BADARG);
+    g_assert(tmp_err);
+    g_clear_error(&tmp_err);
+
+    // Shards out of order
+    ret = cr_shard_check(shards + 1, 1, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_BADARG);
+    g_assert(tmp_err);
+    g_clear_error(&tmp_err);
+
+    // Shard of a different package list
+    shards[1].total++;
+    ret = cr_shard_check(shards, NUM_SHARDS, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_BADARG);
+    g_assert(tmp_err);
+    g_clear_error(&tmp_err);
+}
+
+static void
+test_cr_shard_append_xml(TestData *testdata, gconstpointer test_data)
+{
+    cr_CompressionType comtype = GPOINTER_TO_INT(test_data);
+    cr_ShardInfo shards[NUM_SHARDS];
+    cr_SegmentIndex *index;
+    cr_XmlFile *f;
+    gchar *dirs[NUM_SHARDS], *path, *content;
+    GString *expected = g_string_new(NULL);
+    GError *tmp_err = NULL;
+    int ret;
+
+    for (guint x = 0; x < NUM_SHARDS; x++) {
+        shards[x].index = x + 1;
+        shards[x].count = NUM_SHARDS;
+        shards[x].total = NUM_PKGS;
+        cr_shard_range(NUM_PKGS, x + 1, NUM_SHARDS,
+                       &shards[x].first, &shards[x].packages);
+        dirs[x] = g_strdup_printf("%s/shard%u/repodata", testdata->tmp_dir,
+                                  x + 1);
+        write_shard(dirs[x], comtype, &shards[x], expected);
+    }
+
+    path = g_strconcat(testdata->tmp_dir, "/other.xml",
+                       cr_compression_suffix(comtype), NULL);
+    index = cr_segmentindex_new();
+    f = open_segmented(path, comtype, index);
+
+    for (guint x = 0; x < NUM_SHARDS; x++) {
+        ret = cr_shard_append_xml(f, &shards[x], dirs[x], "other", &tmp_err);
+        g_assert_cmpint(ret, ==, CRE_OK);
+        g_assert(!tmp_err);
+    }
+
+    ret = cr_xmlfile_close(f, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+
+    // Assembled file has the content of all shards in order
+    content = test_read_content(path);
+    g_assert(strstr(content, "packages=\"25\""));
+    g_assert(strstr(content, expected->str));
+    g_assert(g_str_has_suffix(content, "</otherdata>"));
+    g_free(content);
+
+    // and segments of all shards
+    g_assert_cmpint(cr_segmentindex_len(index), >=,
+                    NUM_PKGS / SEGMENT_PKGS);
+    cr_segmentindex_free(index);
+    g_free(path);
+
+    // Shards with a different compression cannot be used
+    path = g_build_filename(testdata->tmp_dir, "other.xml", NULL);
+    index = cr_segmentindex_new();
+    f = open_segmented(path, comtype == CR_CW_GZ_COMPRESSION
+                                ? CR_CW_XZ_COMPRESSION
+                                : CR_CW_GZ_COMPRESSION, index);
+    ret = cr_shard_append_xml(f, &shards[0], dirs[0], "other", &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_BADARG);
+    g_assert(tmp_err);
+    g_clear_error(&tmp_err);
+    cr_xmlfile_close(f, NULL);
+    cr_segmentindex_free(index);
+    g_free(path);
+
+    // Shard with a wrong package count
+    shards[0].packages++;
+    path = g_build_filename(testdata->tmp_dir, "other2.xml", NULL);
+    index = cr_segmentindex_new();
+    f = open_segmented(path, comtype, index);
+    ret = cr_shard_append_xml(f, &shards[0], dirs[0], "other", &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_ERROR);
+    g_assert(tmp_err);
+    g_clear_error(&tmp_err);
+    cr_xmlfile_close(f, NULL);
+    cr_segmentindex_free(index);
+    g_free(path);
+
+    for (guint x = 0; x < NUM_SHARDS; x++)
+        g_free(dirs[x]);
+    g_string_free(expected, TRUE);
+}
+
+/** Return decompressed primary.xml of the repo.
+ */
+static gchar *
+read_primary(const char *repo)
+{
+    struct cr_MetadataLocation *ml;
+    gchar *content;
+
+    ml = cr_locate_metadata(repo, TRUE, NULL);
+    g_assert(ml);
+    g_assert(ml->pri_xml_href);
+    content = test_read_content(ml->pri_xml_href);
+    cr_metadatalocation_free(ml);
+
+    return content;
+}
+
+/** Return the result of a query on the primary database of the repo.
+ */
+static gint64
+query_primary_db(const char *repo, const char *tmp_dir, const char *sql)
+{
+    struct cr_MetadataLocation *ml;
+    gchar *path;
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+    gint64 value;
+
+    ml = cr_locate_metadata(repo, FALSE, NULL);
+    g_assert(ml);
+    g_assert(ml->pri_sqlite_href);
+    path = g_build_filename(tmp_dir, "primary.sqlite", NULL);
+    g_assert_cmpint(cr_decompress_file(ml->pri_sqlite_href, path,
+                                       CR_CW_AUTO_DETECT_COMPRESSION,
+                                       NULL), ==, CRE_OK);
+    cr_metadatalocation_free(ml);
+
+    g_assert_cmpint(sqlite3_open(path, &db), ==, SQLITE_OK);
+    g_assert_cmpint(sqlite3_prepare_v2(db, sql, -1, &stmt, NULL), ==,
+                    SQLITE_OK);
+    g_assert_cmpint(sqlite3_step(stmt), ==, SQLITE_ROW);
+    value = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+
+    remove(path);
+    g_free(path);
+    return value;
+}
+
+static void
+test_createrepo_shard_assemble(TestData *testdata,
+                               G_GNUC_UNUSED gconstpointer test_data)
+{
+    gchar *full, *shard1, *shard2, *assembled, *path;
+    gchar *expected, *content;
+    cr_ShardInfo shard;
+    GError *tmp_err = NULL;
+    int ret;
+
+    full = g_build_filename(testdata->tmp_dir, "full", NULL);
+    shard1 = g_build_filename(testdata->tmp_dir, "shard1", NULL);
+    shard2 = g_build_filename(testdata->tmp_dir, "shard2", NULL);
+    assembled = g_build_filename(testdata->tmp_dir, "assembled", NULL);
+
+    test_run_program(CREATEREPO_C_PATH, "--quiet", "--segmented",
+                     "--segment-size", "2", "-o", full, TEST_PACKAGES_PATH,
+                     NULL);
+    test_run_program(CREATEREPO_C_PATH, "--quiet", "--shard", "1/2",
+                     "--segment-size", "2", "-o", shard1, TEST_PACKAGES_PATH,
+                     NULL);
+    test_run_program(CREATEREPO_C_PATH, "--quiet", "--shard", "2/2",
+                     "--segment-size", "2", "-o", shard2, TEST_PACKAGES_PATH,
+                     NULL);
+
+    // Shards describe their slices
+    path = g_build_filename(shard2, "repodata", CR_SHARD_FILENAME, NULL);
+    ret = cr_shard_load(&shard, path, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+    g_assert_cmpint(shard.index, ==, 2);
+    g_assert_cmpint(shard.count, ==, 2);
+    g_assert_cmpint(shard.total, ==, NUM_TEST_PKGS);
+    g_assert_cmpint(shard.first + shard.packages, ==, NUM_TEST_PKGS);
+    g_free(path);
+
+    test_run_program(CREATEREPO_C_PATH, "--quiet", "--assemble", shard1,
+                     "--assemble", shard2, "-o", assembled, TEST_PACKAGES_PATH,
+                     NULL);
+
+    // Assembled repo has the same content as the one generated at once
+    expected = read_primary(full);
+    content = read_primary(assembled);
+    g_assert_cmpstr(content, ==, expected);
+    g_free(content);
+    g_free(expected);
+
+    g_assert_cmpint(query_primary_db(assembled, testdata->tmp_dir,
+                    "SELECT COUNT(DISTINCT pkgKey) FROM packages"), ==,
+                    NUM_TEST_PKGS);
+    g_assert_cmpint(query_primary_db(assembled, testdata->tmp_dir,
+                    "SELECT COUNT(*) FROM requires WHERE pkgKey NOT IN "
+                    "(SELECT pkgKey FROM packages)"), ==, 0);
+
+    g_free(full);
+    g_free(shard1);
+    g_free(shard2);
+    g_free(assembled);
+}
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/shard/test_cr_shard_parse", test_cr_shard_parse);
+    g_test_add_func("/shard/test_cr_shard_range", test_cr_shard_range);
+    g_test_add("/shard/test_cr_shard_write_load",
+               TestData, NULL, testdata_setup,
+               test_cr_shard_write_load, testdata_teardown);
+    g_test_add_func("/shard/test_cr_shard_check", test_cr_shard_check);
+    g_test_add("/shard/test_cr_shard_append_xml_gz",
+               TestData, GINT_TO_POINTER(CR_CW_GZ_COMPRESSION),
+               testdata_setup, test_cr_shard_append_xml, testdata_teardown);
+    g_test_add("/shard/test_cr_shard_append_xml_xz",
+               TestData, GINT_TO_POINTER(CR_CW_XZ_COMPRESSION),
+               testdata_setup, test_cr_shard_append_xml, testdata_teardown);
+
+    g_test_add("/shard/test_createrepo_shard_assemble",
+               TestData, NULL, testdata_setup,
+               test_createrepo_shard_assemble, testdata_teardown);
+
+    return g_test_run();
+}
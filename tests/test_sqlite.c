@@ -29,6 +29,7 @@
 #include "createrepo/sqlite.h"
 #include "createrepo/parsepkg.h"
 #include "createrepo/constants.h"
+#include "createrepo/error.h"
 
 #define TMP_DIR_PATTERN         "/tmp/createrepo_test_XXXXXX"
 #define TMP_PRIMARY_NAME        "primary.sqlite"
@@ -347,6 +348,292 @@ test_all(TestData *testdata,
 }
 
 
+static gint64
+db_query_int(const char *path, const char *sql)
+{
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+    gint64 value;
+
+    g_assert_cmpint(sqlite3_open(path, &db), ==, SQLITE_OK);
+    g_assert_cmpint(sqlite3_prepare_v2(db, sql, -1, &stmt, NULL), ==,
+                    SQLITE_OK);
+    g_assert_cmpint(sqlite3_step(stmt), ==, SQLITE_ROW);
+    value = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+
+    return value;
+}
+
+
+static void
+test_cr_db_append(TestData *testdata,
+                  G_GNUC_UNUSED gconstpointer test_data)
+{
+    GError *err = NULL;
+    gchar *path, *shard_path;
+    cr_SqliteDb *db, *shard_db;
+    cr_Package *pkg;
+    int ret;
+
+    path = g_strconcat(testdata->tmp_dir, "/", TMP_PRIMARY_NAME, NULL);
+    shard_path = g_strconcat(testdata->tmp_dir, "/shard.sqlite", NULL);
+    pkg = get_package();
+
+    // Database of a shard
+
+    shard_db = cr_db_open_primary(shard_path, &err);
+    g_assert(shard_db);
+    g_assert(!err);
+    cr_db_add_pkg(shard_db, pkg, &err);
+    g_assert(!err);
+    cr_db_dbinfo_update(shard_db, "shardchecksum", &err);
+    g_assert(!err);
+    cr_db_close(shard_db, &err);
+    g_assert(!err);
+
+    // Append it twice behind a package
+
+    db = cr_db_open_primary(path, &err);
+    g_assert(db);
+    g_assert(!err);
+    cr_db_add_pkg(db, pkg, &err);
+    g_assert(!err);
+    ret = cr_db_append(db, shard_path, &err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!err);
+    ret = cr_db_append(db, shard_path, &err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!err);
+
+    // Packages added after the append get following keys too
+    cr_db_add_pkg(db, pkg, &err);
+    g_assert(!err);
+
+    ret = cr_db_append(db, "/nonexistent/dir/shard.sqlite", &err);
+    g_assert_cmpint(ret, ==, CRE_DB);
+    g_assert(err);
+    g_clear_error(&err);
+
+    // A shard whose last table cannot be copied leaves nothing behind
+    {
+        sqlite3 *raw;
+        g_assert_cmpint(sqlite3_open(shard_path, &raw), ==, SQLITE_OK);
+        g_assert_cmpint(sqlite3_exec(raw, "CREATE TABLE unknown (pkgKey INTEGER)",
+                                     NULL, NULL, NULL), ==, SQLITE_OK);
+        sqlite3_close(raw);
+    }
+    ret = cr_db_append(db, shard_path, &err);
+    g_assert_cmpint(ret, ==, CRE_DB);
+    g_assert(err);
+    g_clear_error(&err);
+
+    cr_db_close(db, &err);
+    g_assert(!err);
+
+    g_assert_cmpint(db_query_int(path, "SELECT COUNT(*) FROM packages"),
+                    ==, 4);
+    g_assert_cmpint(db_query_int(path, "SELECT MAX(pkgKey) FROM packages"),
+                    ==, 4);
+    g_assert_cmpint(db_query_int(path,
+                    "SELECT COUNT(DISTINCT pkgKey) FROM requires"), ==, 4);
+    g_assert_cmpint(db_query_int(path, "SELECT COUNT(*) FROM requires"),
+                    ==, 8);
+    // db_info of shards is not copied
+    g_assert_cmpint(db_query_int(path, "SELECT COUNT(*) FROM db_info"),
+                    ==, 0);
+
+    // Cleanup
+
+    cr_package_free(pkg);
+    g_free(shard_path);
+    g_free(path);
+}
+
+
+static void
+test_cr_db_remove_pkg(TestData *testdata,
+                      G_GNUC_UNUSED gconstpointer test_data)
+{
+    GError *err = NULL;
+    gchar *path, *fil_path;
+    cr_SqliteDb *db, *fil_db;
+    cr_Package *pkg;
+    int ret;
+
+    path = g_strconcat(testdata->tmp_dir, "/", TMP_PRIMARY_NAME, NULL);
+    fil_path = g_strconcat(testdata->tmp_dir, "/", TMP_FILELISTS_NAME, NULL);
+    pkg = get_package();
+
+    db = cr_db_open_primary(path, &err);
+    g_assert(db);
+    fil_db = cr_db_open_filelists(fil_path, &err);
+    g_assert(fil_db);
+
+    // Two copies of one package and another package
+    for (int x = 0; x < 3; x++) {
+        if (x == 2)
+            pkg->pkgId = "abcdef";
+        cr_db_add_pkg(db, pkg, &err);
+        g_assert(!err);
+        cr_db_add_pkg(fil_db, pkg, &err);
+        g_assert(!err);
+    }
+
+    cr_db_close(db, &err);
+    g_assert(!err);
+    cr_db_close(fil_db, &err);
+    g_assert(!err);
+
+    // Remove from the reopened databases
+    db = cr_db_open_primary(path, &err);
+    g_assert(db);
+    g_assert(!err);
+    fil_db = cr_db_open_filelists(fil_path, &err);
+    g_assert(fil_db);
+    g_assert(!err);
+
+    ret = cr_db_remove_pkg(db, "123456", &err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!err);
+    ret = cr_db_remove_pkg(fil_db, "123456", &err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!err);
+
+    // Unknown pkgId is not an error
+    ret = cr_db_remove_pkg(db, "000000", &err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!err);
+
+    cr_db_close(db, &err);
+    g_assert(!err);
+    cr_db_close(fil_db, &err);
+    g_assert(!err);
+
+    g_assert_cmpint(db_query_int(path, "SELECT COUNT(*) FROM packages"),
+                    ==, 1);
+    g_assert_cmpint(db_query_int(path,
+                    "SELECT COUNT(*) FROM packages WHERE pkgId = 'abcdef'"),
+                    ==, 1);
+    g_assert_cmpint(db_query_int(path, "SELECT COUNT(*) FROM requires"),
+                    ==, 2);
+    g_assert_cmpint(db_query_int(fil_path, "SELECT COUNT(*) FROM packages"),
+                    ==, 1);
+    g_assert_cmpint(db_query_int(fil_path,
+                    "SELECT COUNT(*) FROM filelist WHERE pkgKey NOT IN "
+                    "(SELECT pkgKey FROM packages)"), ==, 0);
+    g_assert_cmpint(db_query_int(fil_path,
+                    "SELECT COUNT(DISTINCT pkgKey) FROM filelist"), ==, 1);
+
+    cr_package_free(pkg);
+    g_free(fil_path);
+    g_free(path);
+}
+
+#define CONCURRENT_ADDS     200
+
+struct ConcurrentAdd {
+    cr_SqliteDb *db;
+    cr_Package *pkg;
+};
+
+static gpointer
+concurrent_add_thread(gpointer data)
+{
+    struct ConcurrentAdd *add = data;
+    GError *err = NULL;
+
+    for (int x = 0; x < CONCURRENT_ADDS; x++) {
+        cr_db_add_pkg(add->db, add->pkg, &err);
+        g_assert(!err);
+    }
+
+    return NULL;
+}
+
+
+static void
+test_cr_db_add_pkg_concurrent(TestData *testdata,
+                              G_GNUC_UNUSED gconstpointer test_data)
+{
+    GError *err = NULL;
+    gchar *paths[3];
+    cr_SqliteDb *dbs[3];
+    struct ConcurrentAdd adds[3];
+    GThread *threads[3];
+    cr_Package *pkg;
+    cr_ChangelogEntry *entry;
+
+    paths[0] = g_strconcat(testdata->tmp_dir, "/", TMP_PRIMARY_NAME, NULL);
+    paths[1] = g_strconcat(testdata->tmp_dir, "/", TMP_FILELISTS_NAME, NULL);
+    paths[2] = g_strconcat(testdata->tmp_dir, "/", TMP_OTHER_NAME, NULL);
+    dbs[0] = cr_db_open_primary(paths[0], &err);
+    g_assert(!err);
+    dbs[1] = cr_db_open_filelists(paths[1], &err);
+    g_assert(!err);
+    dbs[2] = cr_db_open_other(paths[2], &err);
+    g_assert(!err);
+
+    pkg = get_package();
+    entry = cr_changelog_entry_new();
+    entry->author = "foo";
+    entry->date = 123;
+    entry->changelog = "bar";
+    pkg->changelogs = g_slist_prepend(pkg->changelogs, entry);
+
+    // Different keys of the package in every db
+    for (int x = 0; x < 3; x++)
+        for (int y = 0; y < x; y++) {
+            cr_db_add_pkg(dbs[x], pkg, &err);
+            g_assert(!err);
+        }
+
+    // The same package is inserted into all dbs at the same time
+    for (int x = 0; x < 3; x++) {
+        adds[x].db = dbs[x];
+        adds[x].pkg = pkg;
+        threads[x] = g_thread_try_new(NULL, concurrent_add_thread,
+                                      &adds[x], &err);
+        g_assert(threads[x]);
+        g_assert(!err);
+    }
+    for (int x = 0; x < 3; x++)
+        g_thread_join(threads[x]);
+
+    for (int x = 0; x < 3; x++) {
+        cr_db_close(dbs[x], &err);
+        g_assert(!err);
+    }
+
+    // Every record belongs to the package inserted along with it
+    g_assert_cmpint(db_query_int(paths[0],
+                    "SELECT COUNT(DISTINCT pkgKey) FROM files"), ==,
+                    CONCURRENT_ADDS);
+    g_assert_cmpint(db_query_int(paths[0],
+                    "SELECT MAX(c) FROM (SELECT COUNT(*) AS c FROM requires "
+                    "GROUP BY pkgKey)"), ==, 2);
+    g_assert_cmpint(db_query_int(paths[1],
+                    "SELECT COUNT(DISTINCT pkgKey) FROM filelist"), ==,
+                    CONCURRENT_ADDS + 1);
+    g_assert_cmpint(db_query_int(paths[1],
+                    "SELECT MAX(c) FROM (SELECT COUNT(*) AS c FROM filelist "
+                    "GROUP BY pkgKey)"), ==, 2);
+    g_assert_cmpint(db_query_int(paths[2],
+                    "SELECT COUNT(DISTINCT pkgKey) FROM changelog"), ==,
+                    CONCURRENT_ADDS + 2);
+    g_assert_cmpint(db_query_int(paths[2],
+                    "SELECT MAX(c) FROM (SELECT COUNT(*) AS c FROM changelog "
+                    "GROUP BY pkgKey)"), ==, 1);
+
+    // Cleanup
+
+    cr_package_free(pkg);
+    for (int x = 0; x < 3; x++)
+        g_free(paths[x]);
+}
+
+
 
 int
 main(int argc, char *argv[])
@@ -356,6 +643,9 @@ main(int argc, char *argv[])
     g_test_add("/sqlite/test_cr_open_db", TestData, NULL, testdata_setup, test_cr_open_db, testdata_teardown);
     g_test_add("/sqlite/test_cr_db_add_primary_pkg", TestData, NULL, testdata_setup, test_cr_db_add_primary_pkg, testdata_teardown);
     g_test_add("/sqlite/test_cr_db_dbinfo_update", TestData, NULL, testdata_setup, test_cr_db_dbinfo_update, testdata_teardown);
+    g_test_add("/sqlite/test_cr_db_add_pkg_concurrent", TestData, NULL, testdata_setup, test_cr_db_add_pkg_concurrent, testdata_teardown);
+    g_test_add("/sqlite/test_cr_db_append", TestData, NULL, testdata_setup, test_cr_db_append, testdata_teardown);
+    g_test_add("/sqlite/test_cr_db_remove_pkg", TestData, NULL, testdata_setup, test_cr_db_remove_pkg, testdata_teardown);
     g_test_add("/sqlite/test_all", TestData, NULL, testdata_setup, test_all, testdata_teardown);
 
     return g_test_run();
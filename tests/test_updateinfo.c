@@ -0,0 +1,94 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+#include <glib.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include "createrepo/error.h"
+#include "createrepo/updateinfo.h"
+
+#define APPENDS     10000
+
+static void
+test_cr_updateinfo_append_order(void)
+{
+    cr_UpdateInfo *ui = cr_updateinfo_new();
+    cr_UpdateRecord *recs[APPENDS];
+    GSList *elem;
+    int x;
+
+    for (x = 0; x < APPENDS; x++) {
+        recs[x] = cr_updaterecord_new();
+        cr_updateinfo_apped_record(ui, recs[x]);
+    }
+
+    g_assert_cmpint(g_slist_length(ui->updates), ==, APPENDS);
+    for (x = 0, elem = ui->updates; elem; elem = g_slist_next(elem), x++)
+        g_assert(elem->data == recs[x]);
+    g_assert(ui->updates_tail->data == recs[APPENDS-1]);
+
+    cr_updateinfo_free(ui);
+}
+
+static void
+test_cr_updaterecord_append_after_copy(void)
+{
+    cr_UpdateRecord *rec = cr_updaterecord_new();
+    cr_UpdateRecord *copy;
+    cr_UpdateCollection *col;
+
+    cr_updaterecord_append_reference(rec, cr_updatereference_new());
+    cr_updaterecord_append_reference(rec, cr_updatereference_new());
+    col = cr_updatecollection_new();
+    cr_updatecollection_append_package(col, cr_updatecollectionpackage_new());
+    cr_updaterecord_append_collection(rec, col);
+
+    // Copy doesn't know its tails
+    copy = cr_updaterecord_copy(rec);
+    cr_updaterecord_append_reference(copy, cr_updatereference_new());
+    cr_updaterecord_append_collection(copy, cr_updatecollection_new());
+    col = copy->collections->data;
+    cr_updatecollection_append_package(col, cr_updatecollectionpackage_new());
+
+    g_assert_cmpint(g_slist_length(copy->references), ==, 3);
+    g_assert_cmpint(g_slist_length(copy->collections), ==, 2);
+    g_assert_cmpint(g_slist_length(col->packages), ==, 2);
+    g_assert(copy->references_tail == g_slist_last(copy->references));
+
+    // The list was extended directly
+    rec->references = g_slist_append(rec->references, cr_updatereference_new());
+    cr_updaterecord_append_reference(rec, cr_updatereference_new());
+    g_assert_cmpint(g_slist_length(rec->references), ==, 4);
+    g_assert(rec->references_tail == g_slist_last(rec->references));
+
+    cr_updaterecord_free(rec);
+    cr_updaterecord_free(copy);
+}
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/updateinfo/test_cr_updateinfo_append_order",
+                    test_cr_updateinfo_append_order);
+    g_test_add_func("/updateinfo/test_cr_updaterecord_append_after_copy",
+                    test_cr_updaterecord_append_after_copy);
+
+    return g_test_run();
+}
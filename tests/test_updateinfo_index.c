@@ -0,0 +1,226 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#define _XOPEN_SOURCE 700
+
+#include <glib.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include "fixtures.h"
+#include "createrepo/error.h"
+#include "createrepo/misc.h"
+#include "createrepo/updateinfo_index.h"
+
+typedef struct {
+    gchar *tmpdir;
+} TestFixtures;
+
+
+static void
+fixtures_setup(TestFixtures *fixtures,
+               G_GNUC_UNUSED gconstpointer test_data)
+{
+    gchar *template = g_strdup(TMPDIR_TEMPLATE);
+    fixtures->tmpdir = mkdtemp(template);
+    g_assert(fixtures->tmpdir);
+}
+
+
+static void
+fixtures_teardown(TestFixtures *fixtures,
+                  G_GNUC_UNUSED gconstpointer test_data)
+{
+    if (!fixtures->tmpdir)
+        return;
+
+    cr_remove_dir(fixtures->tmpdir, NULL);
+    g_free(fixtures->tmpdir);
+}
+
+
+static cr_UpdateRecord *
+new_record(const char *id, const char **nevras)
+{
+    cr_UpdateRecord *rec = cr_updaterecord_new();
+    cr_UpdateCollection *col = cr_updatecollection_new();
+
+    rec->id = g_string_chunk_insert(rec->chunk, id);
+    for (; *nevras; nevras += 5) {
+        cr_UpdateCollectionPackage *pkg = cr_updatecollectionpackage_new();
+        pkg->name    = g_string_chunk_insert(pkg->chunk, nevras[0]);
+        pkg->epoch   = g_string_chunk_insert(pkg->chunk, nevras[1]);
+        pkg->version = g_string_chunk_insert(pkg->chunk, nevras[2]);
+        pkg->release = g_string_chunk_insert(pkg->chunk, nevras[3]);
+        pkg->arch    = g_string_chunk_insert(pkg->chunk, nevras[4]);
+        cr_updatecollection_append_package(col, pkg);
+    }
+    cr_updaterecord_append_collection(rec, col);
+
+    return rec;
+}
+
+
+static void
+check_list(GSList *list, const char **expected)
+{
+    GSList *elem = list;
+
+    for (; *expected; expected++, elem = g_slist_next(elem)) {
+        g_assert(elem);
+        g_assert_cmpstr(elem->data, ==, *expected);
+    }
+    g_assert(!elem);
+    g_slist_free(list);
+}
+
+
+static void
+check_index(cr_UpdateInfoIndex *index)
+{
+    const char *foo_1[] = { "UPDATE-2", "UPDATE-3", NULL };
+    const char *foo[] = { "UPDATE-1", "UPDATE-2", "UPDATE-3", NULL };
+    const char *bar[] = { "UPDATE-1", NULL };
+    const char *pkgs_1[] = { "bar-1:1.0-1.noarch", "foo-0:1.0-1.x86_64", NULL };
+    const char *none[] = { NULL };
+
+    g_assert_cmpint(cr_updateinfoindex_size(index), ==, 4);
+    check_list(cr_updateinfoindex_updates_by_nevra(index, "foo-0:1.1-1.x86_64"),
+               foo_1);
+    check_list(cr_updateinfoindex_updates_by_nevra(index, "foo-0:1.0-1.x86_64"),
+               bar);
+    check_list(cr_updateinfoindex_updates_by_nevra(index, "foo-0:1.0-2.x86_64"),
+               none);
+    check_list(cr_updateinfoindex_updates_by_name(index, "foo"), foo);
+    check_list(cr_updateinfoindex_updates_by_name(index, "bar"), bar);
+    check_list(cr_updateinfoindex_updates_by_name(index, "baz"), none);
+    check_list(cr_updateinfoindex_packages(index, "UPDATE-1"), pkgs_1);
+    check_list(cr_updateinfoindex_packages(index, "UPDATE-4"), none);
+    check_list(cr_updateinfoindex_packages(index, "UPDATE-5"), none);
+}
+
+
+static cr_UpdateInfoIndex *
+build_index(void)
+{
+    const char *pkgs_1[] = { "foo", "", "1.0", "1", "x86_64",
+                             "bar", "1", "1.0", "1", "noarch", NULL };
+    const char *pkgs_2[] = { "foo", "0", "1.1", "1", "x86_64",
+                             "foo", "0", "1.1", "1", "x86_64", NULL };
+    const char *pkgs_3[] = { "foo", "0", "1.1", "1", "i686", NULL };
+    const char *pkgs_3b[] = { "foo", "0", "1.1", "1", "x86_64", NULL };
+    const char *pkgs_4[] = { NULL };
+    const char *ids[] = { "UPDATE-3", "UPDATE-1", "UPDATE-2", "UPDATE-3",
+                          "UPDATE-4" };
+    const char **pkgs[] = { pkgs_3, pkgs_1, pkgs_2, pkgs_3b, pkgs_4 };
+    cr_UpdateInfoIndex *index = cr_updateinfoindex_new();
+
+    for (int x = 0; x < 5; x++) {
+        cr_UpdateRecord *rec = new_record(ids[x], pkgs[x]);
+        cr_updateinfoindex_add_record(index, rec);
+        cr_updaterecord_free(rec);
+    }
+
+    return index;
+}
+
+
+static void
+test_cr_updateinfoindex_lookups(void)
+{
+    cr_UpdateInfoIndex *index = build_index();
+    check_index(index);
+
+    // Additions after a lookup
+    const char *pkgs[] = { "foo", "0", "1.1", "1", "x86_64", NULL };
+    const char *foo_1[] = { "UPDATE-0", "UPDATE-2", "UPDATE-3", NULL };
+    cr_UpdateRecord *rec = new_record("UPDATE-0", pkgs);
+    cr_updateinfoindex_add_record(index, rec);
+    cr_updaterecord_free(rec);
+    check_list(cr_updateinfoindex_updates_by_nevra(index, "foo-0:1.1-1.x86_64"),
+               foo_1);
+
+    cr_updateinfoindex_free(index);
+}
+
+
+static void
+test_cr_updateinfoindex_write_load(TestFixtures *fixtures,
+                                   G_GNUC_UNUSED gconstpointer test_data)
+{
+    GError *err = NULL;
+    cr_UpdateInfoIndex *index = build_index();
+    cr_UpdateInfoIndex *loaded;
+    gchar *path = g_build_filename(fixtures->tmpdir, "updateinfo_index.gz",
+                                   NULL);
+
+    g_assert_cmpint(cr_updateinfoindex_write(index, path, CR_CW_GZ_COMPRESSION,
+                                             NULL, &err), ==, CRE_OK);
+    g_assert(!err);
+    cr_updateinfoindex_free(index);
+
+    loaded = cr_updateinfoindex_load(path, &err);
+    g_assert(loaded);
+    g_assert(!err);
+    check_index(loaded);
+    cr_updateinfoindex_free(loaded);
+
+    // Not an index
+    loaded = cr_updateinfoindex_load(TEST_UPDATEINFO_01, &err);
+    g_assert(!loaded);
+    g_assert(err);
+    g_clear_error(&err);
+
+    g_free(path);
+}
+
+
+static void
+test_cr_updateinfoindex_parse(void)
+{
+    GError *err = NULL;
+    cr_UpdateInfoIndex *index = cr_updateinfoindex_new();
+    const char *updates[] = { "foobarupdate_1", NULL };
+    const char *pkgs[] = { "bar-0:2.0.1-3.noarch", NULL };
+
+    g_assert_cmpint(cr_updateinfoindex_parse(index, TEST_UPDATEINFO_01, &err),
+                    ==, CRE_OK);
+    g_assert(!err);
+    g_assert_cmpint(cr_updateinfoindex_size(index), ==, 1);
+    check_list(cr_updateinfoindex_updates_by_name(index, "bar"), updates);
+    check_list(cr_updateinfoindex_packages(index, "foobarupdate_1"), pkgs);
+
+    cr_updateinfoindex_free(index);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/updateinfo_index/test_cr_updateinfoindex_lookups",
+                    test_cr_updateinfoindex_lookups);
+    g_test_add("/updateinfo_index/test_cr_updateinfoindex_write_load",
+               TestFixtures, NULL, fixtures_setup,
+               test_cr_updateinfoindex_write_load, fixtures_teardown);
+    g_test_add_func("/updateinfo_index/test_cr_updateinfoindex_parse",
+                    test_cr_updateinfoindex_parse);
+
+    return g_test_run();
+}
@@ -0,0 +1,221 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2016  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "fixtures.h"
+#include "test_common.h"
+#include "createrepo/locate_metadata.h"
+#include "createrepo/misc.h"
+
+#define CONNECT_TRIES   100     // Times 100 ms
+
+typedef struct {
+    gchar *tmp_dir;
+} TestData;
+
+static void
+testdata_setup(TestData *testdata, G_GNUC_UNUSED gconstpointer test_data)
+{
+    testdata->tmp_dir = g_strdup(TMPDIR_TEMPLATE);
+    g_assert(mkdtemp(testdata->tmp_dir));
+}
+
+static void
+testdata_teardown(TestData *testdata, G_GNUC_UNUSED gconstpointer test_data)
+{
+    cr_remove_dir(testdata->tmp_dir, NULL);
+    g_free(testdata->tmp_dir);
+}
+
+/** Copy a test package into the repo under the given name. The file
+ * is written aside and renamed, as a package upload would do.
+ */
+static void
+put_package(const char *repo, const char *test_pkg, const char *name)
+{
+    gchar *src = g_build_filename(TEST_PACKAGES_PATH, test_pkg, NULL);
+    gchar *dst = g_build_filename(repo, name ? name : test_pkg, NULL);
+    gchar *content;
+    gsize len;
+
+    g_assert(g_file_get_contents(src, &content, &len, NULL));
+    g_assert(g_file_set_contents(dst, content, len, NULL));
+
+    g_free(content);
+    g_free(dst);
+    g_free(src);
+}
+
+/** Send a request to the control socket and return the whole reply.
+ * The daemon is waited for until it listens.
+ */
+static gchar *
+request(const char *socket_path, const char *line)
+{
+    struct sockaddr_un addr;
+    GString *reply = g_string_new(NULL);
+    char buf[4096];
+    ssize_t len;
+    int fd = -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    g_assert_cmpint(strlen(socket_path), <, sizeof(addr.sun_path));
+    strcpy(addr.sun_path, socket_path);
+
+    for (int x = 0; x < CONNECT_TRIES; x++) {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        g_assert_cmpint(fd, !=, -1);
+        if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0)
+            break;
+        close(fd);
+        fd = -1;
+        g_usleep(100000);
+    }
+    g_assert_cmpint(fd, !=, -1);
+
+    g_assert_cmpint(write(fd, line, strlen(line)), ==, strlen(line));
+    g_assert_cmpint(write(fd, "\n", 1), ==, 1);
+    while ((len = read(fd, buf, sizeof(buf))) > 0)
+        g_string_append_len(reply, buf, len);
+    g_assert_cmpint(len, ==, 0);
+    close(fd);
+
+    return g_string_free(reply, FALSE);
+}
+
+/** Return decompressed primary.xml of the repo.
+ */
+static gchar *
+read_primary(const char *repo)
+{
+    struct cr_MetadataLocation *ml;
+    gchar *content;
+
+    ml = cr_locate_metadata(repo, TRUE, NULL);
+    g_assert(ml);
+    g_assert(ml->pri_xml_href);
+    content = test_read_content(ml->pri_xml_href);
+    cr_metadatalocation_free(ml);
+
+    return content;
+}
+
+static void
+test_watchrepo_update(TestData *testdata,
+                      G_GNUC_UNUSED gconstpointer test_data)
+{
+    gchar *repo, *expected_repo, *socket_path, *update, *path;
+    gchar *reply, *expected, *content;
+    gchar *argv[9];
+    GPid pid;
+    int status;
+    GError *tmp_err = NULL;
+
+    repo = g_build_filename(testdata->tmp_dir, "repo", NULL);
+    expected_repo = g_build_filename(testdata->tmp_dir, "expected", NULL);
+    socket_path = g_build_filename(testdata->tmp_dir, "socket", NULL);
+    update = g_strconcat("update ", repo, NULL);
+
+    g_assert_cmpint(g_mkdir(repo, 0755), ==, 0);
+    put_package(repo, "Archer-3.4.5-6.x86_64.rpm", NULL);
+    put_package(repo, "Rimmer-1.0.2-2.x86_64.rpm", NULL);
+    put_package(repo, "fake_bash-1.1.1-1.x86_64.rpm", NULL);
+
+    // Only requested runs (and the initial one) within the test
+    argv[0] = WATCHREPO_C_PATH;
+    argv[1] = "--quiet";
+    argv[2] = "--delay=3600";
+    argv[3] = "--max-delay=3600";
+    argv[4] = "--workers=2";
+    argv[5] = "--socket";
+    argv[6] = socket_path;
+    argv[7] = repo;
+    argv[8] = NULL;
+    g_assert(g_spawn_async(NULL, argv, NULL,
+                           G_SPAWN_DO_NOT_REAP_CHILD
+                           | G_SPAWN_STDOUT_TO_DEV_NULL
+                           | G_SPAWN_STDERR_TO_DEV_NULL,
+                           NULL, NULL, &pid, &tmp_err));
+    g_assert(!tmp_err);
+
+    reply = request(socket_path, update);
+    g_assert_cmpstr(reply, ==, "OK\n");
+    g_free(reply);
+
+    // Add, replace and remove a package
+    put_package(repo, "balicek-utf8-1.1.1-1.x86_64.rpm", NULL);
+    put_package(repo, "super_kernel-6.0.1-2.x86_64.rpm",
+                "Rimmer-1.0.2-2.x86_64.rpm");
+    path = g_build_filename(repo, "fake_bash-1.1.1-1.x86_64.rpm", NULL);
+    g_assert_cmpint(g_unlink(path), ==, 0);
+    g_free(path);
+
+    reply = request(socket_path, update);
+    g_assert_cmpstr(reply, ==, "OK\n");
+    g_free(reply);
+
+    // Resident packages are reported
+    reply = request(socket_path, "status");
+    g_assert(g_str_has_prefix(reply, repo));
+    g_assert(strstr(reply, " packages=3 loaded=3 "));
+    g_assert(strstr(reply, " running=0 "));
+    g_assert(strstr(reply, " failures=0"));
+    g_free(reply);
+
+    kill(pid, SIGTERM);
+    g_assert_cmpint(waitpid(pid, &status, 0), ==, pid);
+    g_spawn_close_pid(pid);
+
+    // Same metadata as a plain run of createrepo_c
+    g_assert_cmpint(g_mkdir(expected_repo, 0755), ==, 0);
+    test_run_program(CREATEREPO_C_PATH, "--quiet", "--no-database",
+                     "-o", expected_repo, repo, NULL);
+    expected = read_primary(expected_repo);
+    content = read_primary(repo);
+    g_assert_cmpstr(content, ==, expected);
+    g_free(content);
+    g_free(expected);
+
+    g_free(update);
+    g_free(socket_path);
+    g_free(expected_repo);
+    g_free(repo);
+}
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add("/watchrepo/test_watchrepo_update",
+               TestData, NULL, testdata_setup,
+               test_watchrepo_update, testdata_teardown);
+
+    return g_test_run();
+}